@@ -14,9 +14,12 @@
 #define LLVM_CLANG_SEMA_SEMAMOS_H
 
 #include "clang/AST/DeclBase.h"
+#include "clang/Basic/SourceLocation.h"
 #include "clang/Sema/SemaBase.h"
+#include "llvm/ADT/StringRef.h"
 
 namespace clang {
+class FunctionDecl;
 class ParsedAttr;
 
 class SemaMOS : public SemaBase {
@@ -26,6 +29,28 @@ public:
   void handleInterruptAttr(Decl *D, const ParsedAttr &AL);
   void handleInterruptNorecurseAttr(Decl *D, const ParsedAttr &AL);
   void handleInterruptNoISRAttr(Decl *D, const ParsedAttr &AL);
+  void handleBankedAttr(Decl *D, const ParsedAttr &AL);
+  void handleBasePageAttr(Decl *D, const ParsedAttr &AL);
+  void handleCycleBudgetAttr(Decl *D, const ParsedAttr &AL);
+  void handleCostAttr(Decl *D, const ParsedAttr &AL);
+  void handleCPUClonesAttr(Decl *D, const ParsedAttr &AL);
+  void handleStaticCoroutineAttr(Decl *D, const ParsedAttr &AL);
+  void handleTimedAttr(Decl *D, const ParsedAttr &AL);
+  void handleMaxDepthAttr(Decl *D, const ParsedAttr &AL);
+
+  /// Called on well formed \#pragma clang mos cost. An empty Mode restores
+  /// the command line's.
+  void ActOnPragmaCost(SourceLocation PragmaLoc, StringRef Mode);
+
+  /// Only called on function definitions; if a \#pragma clang mos cost is in
+  /// effect, give the function its mode unless it has one of its own.
+  void AddRangeBasedCost(FunctionDecl *FD);
+
+private:
+  /// The mode of the last \#pragma clang mos cost, and its location, or empty
+  /// if none is in effect.
+  StringRef CostPragmaMode;
+  SourceLocation CostPragmaLoc;
 };
 
 } // namespace clang
@@ -12,14 +12,30 @@
 
 #include "MOS.h"
 #include "clang/Basic/MacroBuilder.h"
+#include "clang/Basic/TargetBuiltins.h"
 #include "clang/Basic/TargetInfo.h"
 
+using namespace clang;
 using namespace clang::targets;
 
+static constexpr int NumBuiltins =
+    clang::MOS::LastTSBuiltin - Builtin::FirstTSBuiltin;
+
+#define GET_BUILTIN_STR_TABLE
+#include "clang/Basic/BuiltinsMOS.inc"
+#undef GET_BUILTIN_STR_TABLE
+
+static constexpr Builtin::Info BuiltinInfos[] = {
+#define GET_BUILTIN_INFOS
+#include "clang/Basic/BuiltinsMOS.inc"
+#undef GET_BUILTIN_INFOS
+};
+static_assert(std::size(BuiltinInfos) == NumBuiltins);
+
 MOSTargetInfo::MOSTargetInfo(const llvm::Triple &Triple, const TargetOptions &)
     : TargetInfo(Triple) {
   static const char Layout[] =
-      "e-m:e-p:16:8-p1:8:8-i16:8-i32:8-i64:8-f32:8-f64:8-a:8-Fi8-n8";
+      "e-m:e-p:16:8-p1:8:8-p2:32:8-i16:8-i32:8-i64:8-f32:8-f64:8-a:8-Fi8-n8";
   resetDataLayout(Layout);
 
   PointerWidth = 16;
@@ -204,11 +220,27 @@ uint64_t MOSTargetInfo::getPointerWidthV(LangAS AddrSpace) const {
   switch (toTargetAddressSpace(AddrSpace)) {
   case 1: // Zero page memory
     return 8;
+  case 2: // Far memory
+    return 32;
   default:
     return 16;
   }
 }
 
+bool MOSTargetInfo::isAddressSpaceSupersetOf(LangAS A, LangAS B) const {
+  if (A == B)
+    return true;
+  // The zero page is the first page of memory, so zero page pointers convert
+  // implicitly to ordinary ones. The reverse needs a cast.
+  const auto IsMemory = [](LangAS AS) {
+    return AS == LangAS::Default ||
+           (isTargetAddressSpace(AS) && toTargetAddressSpace(AS) == 0);
+  };
+  return IsMemory(A) &&
+         (IsMemory(B) ||
+          (isTargetAddressSpace(B) && toTargetAddressSpace(B) == 1));
+}
+
 static constexpr llvm::StringLiteral ValidCPUNames[] = {
     {"mos6502"},    {"mos6502x"},   {"mos65c02"},   {"mosr65c02"},
     {"mosw65c02"},  {"mosw65816"},  {"mos65el02"},  {"mos65ce02"},
@@ -231,6 +263,37 @@ bool MOSTargetInfo::setCPU(const std::string &Name) {
   return false;
 }
 
+bool MOSTargetInfo::initFeatureMap(
+    llvm::StringMap<bool> &Features, DiagnosticsEngine &Diags, StringRef CPU,
+    const std::vector<std::string> &FeaturesVec) const {
+  // Builtins that need decimal mode check for it here. The backend treats an
+  // unnamed CPU as the 6502.
+  if (CPU != "mossweet16" && CPU != "mosspc700")
+    Features["mos-insns-6502bcd"] = true;
+  return TargetInfo::initFeatureMap(Features, Diags, CPU, FeaturesVec);
+}
+
+bool MOSTargetInfo::handleTargetFeatures(std::vector<std::string> &Features,
+                                         DiagnosticsEngine &Diags) {
+  if (llvm::is_contained(Features, "+int8")) {
+    // As in some legacy 8-bit compilers, int is 8 bits, so the integer
+    // promotions leave 8-bit arithmetic alone. The 16-bit types take short,
+    // which stays 16 bits.
+    IntWidth = 8;
+    SizeType = UnsignedShort;
+    PtrDiffType = SignedShort;
+    IntPtrType = SignedShort;
+    Char16Type = UnsignedShort;
+    Int16Type = SignedShort;
+  }
+  return true;
+}
+
+llvm::SmallVector<Builtin::InfosShard>
+MOSTargetInfo::getTargetBuiltins() const {
+  return {{&BuiltinStrings, BuiltinInfos}};
+}
+
 void MOSTargetInfo::getTargetDefines(const LangOptions &Opts,
                                      MacroBuilder &Builder) const {
   Builder.defineMacro("__mos__");
@@ -261,4 +324,5 @@ void MOSTargetInfo::getTargetDefines(const LangOptions &Opts,
 
   Builder.defineMacro("__zp", "__attribute__((__address_space__(1)))");
   Builder.defineMacro("__zeropage", "__attribute__((__address_space__(1)))");
+  Builder.defineMacro("__far", "__attribute__((__address_space__(2)))");
 }
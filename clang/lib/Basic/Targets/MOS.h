@@ -31,7 +31,7 @@ public:
   void getTargetDefines(const LangOptions &Opts,
                         MacroBuilder &Builder) const override;
 
-  SmallVector<Builtin::InfosShard> getTargetBuiltins() const override { return {}; }
+  SmallVector<Builtin::InfosShard> getTargetBuiltins() const override;
 
   BuiltinVaListKind getBuiltinVaListKind() const override {
     return TargetInfo::VoidPtrBuiltinVaList;
@@ -58,11 +58,19 @@ public:
   }
   unsigned getRegisterWidth() const override { return 8; }
   uint64_t getPointerWidthV(LangAS AddrSpace) const override;
+  bool isAddressSpaceSupersetOf(LangAS A, LangAS B) const override;
 
   bool isValidCPUName(StringRef Name) const override;
   void fillValidCPUList(SmallVectorImpl<StringRef> &Values) const override;
   bool setCPU(const std::string &Name) override;
 
+  bool
+  initFeatureMap(llvm::StringMap<bool> &Features, DiagnosticsEngine &Diags,
+                 StringRef CPU,
+                 const std::vector<std::string> &FeaturesVec) const override;
+  bool handleTargetFeatures(std::vector<std::string> &Features,
+                            DiagnosticsEngine &Diags) override;
+
   bool hasBitIntType() const override { return true; }
 };
 
@@ -8,6 +8,7 @@
 
 #include "ABIInfoImpl.h"
 #include "TargetInfo.h"
+#include "llvm/ADT/StringExtras.h"
 
 using namespace clang;
 using namespace clang::CodeGen;
@@ -43,19 +44,58 @@ public:
 
   void setTargetAttributes(const Decl *D, llvm::GlobalValue *GV,
                            CodeGen::CodeGenModule &CGM) const override {
-    if (GV->isDeclaration())
-      return;
     const auto *FD = dyn_cast_or_null<FunctionDecl>(D);
     if (!FD)
       return;
     auto *Fn = cast<llvm::Function>(GV);
 
+    // Callers need to know that a function is banked, so this applies to
+    // declarations too.
+    if (FD->getAttr<MOSBankedAttr>())
+      Fn->addFnAttr("banked");
+    // Callers that have budgets of their own count calls at the callee's.
+    if (const auto *Budget = FD->getAttr<MOSCycleBudgetAttr>())
+      Fn->addFnAttr("mos-cycle-budget", llvm::utostr(Budget->getBudget()));
+    if (GV->isDeclaration())
+      return;
+
     if (FD->getAttr<MOSInterruptAttr>())
       Fn->addFnAttr("interrupt");
     if (FD->getAttr<MOSInterruptNorecurseAttr>())
       Fn->addFnAttr("interrupt-norecurse");
     if (FD->getAttr<MOSNoISRAttr>())
       Fn->addFnAttr("no-isr");
+    if (const auto *Page = FD->getAttr<MOSBasePageAttr>())
+      Fn->addFnAttr("mos-base-page", Page->getPage());
+    // The backend picks its cost mode from the size attributes, as do the
+    // generic optimizations, so the function's mode overrides the command
+    // line's -Oz or -Os. Optnone wins over any of these.
+    if (const auto *Cost = FD->getAttr<MOSCostAttr>()) {
+      Fn->removeFnAttr(llvm::Attribute::MinSize);
+      Fn->removeFnAttr(llvm::Attribute::OptimizeForSize);
+      if (!Fn->hasFnAttribute(llvm::Attribute::OptimizeNone)) {
+        if (Cost->getMode() == "bytes")
+          Fn->addFnAttr(llvm::Attribute::MinSize);
+        if (Cost->getMode() != "cycles")
+          Fn->addFnAttr(llvm::Attribute::OptimizeForSize);
+      }
+    }
+    // The function dispatches to a clone for the processor it runs on.
+    if (const auto *Clones = FD->getAttr<MOSCPUClonesAttr>()) {
+      SmallVector<StringRef> CPUs(Clones->processors());
+      Fn->addFnAttr("mos-cpu-clones", llvm::join(CPUs, ","));
+    }
+    // At most one instance of the coroutine is live at a time, so its frame
+    // can be static.
+    if (FD->getAttr<MOSStaticCoroutineAttr>())
+      Fn->addFnAttr("static-coroutine");
+    // The function is kept within a page and its cycle counts reported.
+    if (FD->getAttr<MOSTimedAttr>())
+      Fn->addFnAttr("mos-timed");
+    // At most this many invocations of the function are live at once, so
+    // each depth of its recursion can have a static frame of its own.
+    if (const auto *Depth = FD->getAttr<MOSMaxDepthAttr>())
+      Fn->addFnAttr("mos-max-depth", llvm::utostr(Depth->getDepth()));
   }
 };
 
@@ -55,4 +55,28 @@ void mos::getMOSTargetFeatures(const Driver &D, const ArgList &Args,
     else
       Features.push_back("-static-stack");
   }
+
+  if (Args.hasFlag(options::OPT_mint8, options::OPT_mno_int8, false))
+    Features.push_back("+int8");
+}
+
+/// Passes the trace port instrumentation options to the backend, which adds
+/// the instrumentation during code generation, and thus during LTO.
+void mos::addMOSTraceArgs(const Driver &D, const ArgList &Args,
+                          ArgStringList &CmdArgs) {
+  Arg *A = Args.getLastArg(options::OPT_fmos_trace_port_EQ);
+  if (!A)
+    return;
+  unsigned Port;
+  if (StringRef(A->getValue()).getAsInteger(0, Port) || Port > 0xfffa) {
+    D.Diag(diag::err_drv_invalid_value) << A->getAsString(Args)
+                                        << A->getValue();
+    return;
+  }
+  CmdArgs.push_back("-mllvm");
+  CmdArgs.push_back(Args.MakeArgString("-mos-trace-port=" + Twine(Port)));
+  if (Args.hasArg(options::OPT_fmos_trace_blocks)) {
+    CmdArgs.push_back("-mllvm");
+    CmdArgs.push_back("-mos-trace-blocks");
+  }
 }
@@ -25,6 +25,9 @@ std::string getMOSTargetCPU(const llvm::opt::ArgList &Args);
 void getMOSTargetFeatures(const Driver &D, const llvm::opt::ArgList &Args,
                           std::vector<llvm::StringRef> &Features);
 
+void addMOSTraceArgs(const Driver &D, const llvm::opt::ArgList &Args,
+                     llvm::opt::ArgStringList &CmdArgs);
+
 } // end namespace mos
 } // end namespace tools
 } // end namespace driver
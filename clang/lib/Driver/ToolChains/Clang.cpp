@@ -178,8 +178,9 @@ static bool addExceptionArgs(const ArgList &Args, types::ID InputType,
   }
 
   if (types::isCXX(InputType)) {
-    // Disable C++ EH by default on XCore and PS4/PS5.
+    // Disable C++ EH by default on XCore, PS4/PS5, and MOS.
     bool CXXExceptionsEnabled = Triple.getArch() != llvm::Triple::xcore &&
+                                Triple.getArch() != llvm::Triple::mos &&
                                 !Triple.isPS() && !Triple.isDriverKit();
     Arg *ExceptionArg = Args.getLastArg(
         options::OPT_fcxx_exceptions, options::OPT_fno_cxx_exceptions,
@@ -1905,6 +1906,7 @@ void Clang::AddMIPSTargetArgs(const ArgList &Args,
 void Clang::AddMOSTargetArgs(const ArgList &Args,
                                  ArgStringList &CmdArgs) const {
   addMOSCodeGenArgs(CmdArgs);
+  mos::addMOSTraceArgs(getToolChain().getDriver(), Args, CmdArgs);
 }
 
 void Clang::AddPPCTargetArgs(const ArgList &Args,
@@ -2681,7 +2683,9 @@ static void CollectArgsForIntegratedAssembler(Compilation &C,
   if (ImplicitIt.size())
     AddARMImplicitITArgs(Args, CmdArgs, ImplicitIt);
   if (Crel) {
-    if (!ExperimentalCrel)
+    // MOS objects are only ever consumed by the linker and tools shipped with
+    // the compiler, all of which read CREL, so it isn't experimental there.
+    if (!ExperimentalCrel && !Triple.isMOS())
       D.Diag(diag::err_drv_experimental_crel);
     if (Triple.isOSBinFormatELF() && !Triple.isMIPS()) {
       CmdArgs.push_back("--crel");
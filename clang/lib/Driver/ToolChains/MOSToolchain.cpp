@@ -8,11 +8,13 @@
 
 #include "MOSToolchain.h"
 
+#include "Arch/MOS.h"
 #include "clang/Driver/CommonArgs.h"
 #include "clang/Driver/Compilation.h"
 #include "clang/Driver/Driver.h"
 #include "clang/Options/Options.h"
 #include "llvm/Support/Path.h"
+#include "llvm/Support/Threading.h"
 
 using namespace llvm::opt;
 using namespace clang::driver;
@@ -39,12 +41,44 @@ void MOSToolChain::AddClangSystemIncludeArgs(const ArgList &DriverArgs,
   }
 }
 
+DerivedArgList *
+MOSToolChain::TranslateArgs(const DerivedArgList &Args, StringRef BoundArch,
+                            Action::OffloadKind DeviceOffloadKind) const {
+  // The SDK headers are large, and each device has its own. Give the modules
+  // built from them a cache per device, so that all of its projects share it.
+  if (!Args.hasFlag(options::OPT_fmodules, options::OPT_fno_modules, false) ||
+      !Args.hasFlag(options::OPT_fimplicit_modules,
+                    options::OPT_fno_implicit_modules, true) ||
+      Args.hasArg(options::OPT_fmodules_cache_path))
+    return nullptr;
+
+  SmallString<128> Path;
+  if (!Driver::getDefaultModuleCachePath(Path))
+    return nullptr;
+  std::string Device = tools::mos::getMOSTargetCPU(Args);
+  if (Device.empty())
+    Device = "mos";
+  if (Arg *A = Args.getLastArg(options::OPT_fstatic_stack,
+                               options::OPT_fno_static_stack))
+    Device += A->getOption().matches(options::OPT_fstatic_stack)
+                  ? "+static-stack"
+                  : "-static-stack";
+  llvm::sys::path::append(Path, "mos", Device);
+
+  DerivedArgList *DAL = new DerivedArgList(Args.getBaseArgs());
+  for (Arg *A : Args)
+    DAL->append(A);
+  DAL->AddJoinedArg(nullptr,
+                    getDriver().getOpts().getOption(
+                        options::OPT_fmodules_cache_path),
+                    Args.MakeArgString(Path));
+  return DAL;
+}
+
 void MOSToolChain::addClangTargetOptions(const ArgList &DriverArgs,
                                 ArgStringList &CC1Args,
                                 Action::OffloadKind) const {
   CC1Args.push_back("-nostdsysteminc");
-  // Not yet implemented for GlobalISel.
-  CC1Args.push_back("-fexperimental-assignment-tracking=disabled");
 }
 
 static bool hasLTOEmitAsm(const ArgList &Args) {
@@ -71,6 +105,11 @@ void mos::Linker::ConstructJob(Compilation &C, const JobAction &JA,
   // options, which should override these.
   CmdArgs.push_back("--gc-sections");
   CmdArgs.push_back("--sort-section=alignment");
+  // Scripts that spill sections across banks should pack them tightly.
+  CmdArgs.push_back("--spill-best-fit");
+  // Fold identical functions and constants whose addresses are never taken;
+  // template instantiations otherwise end up duplicated across objects.
+  CmdArgs.push_back("--icf=safe");
 
   AddLinkerInputs(TC, Inputs, Args, CmdArgs, JA);
 
@@ -137,9 +176,31 @@ void mos::Linker::AddLTOOptions(const toolchains::MOSToolChain &TC, const ArgLis
                                 const InputInfoList &Inputs,
                                 ArgStringList &CmdArgs) const {
   assert(!Inputs.empty() && "Must have at least one input.");
-  addLTOOptions(TC, Args, CmdArgs, Output, Inputs,
-                TC.getDriver().getLTOMode() == LTOK_Thin);
+  const bool IsThinLTO = TC.getDriver().getLTOMode() == LTOK_Thin;
+  addLTOOptions(TC, Args, CmdArgs, Output, Inputs, IsThinLTO);
   addMOSCodeGenArgs(CmdArgs);
+  tools::mos::addMOSTraceArgs(TC.getDriver(), Args, CmdArgs);
+  if (IsThinLTO) {
+    // Each ThinLTO backend sees only its own module and what it imports, much
+    // like a separately compiled translation unit, so none of them may take
+    // the whole zero page. -mos-zp-link-candidates would leave the rest for
+    // the linker to divide, but only with a linker script that places the
+    // .zp_candidate.* sections; without one they would lose their zeroing,
+    // so it is left for such scripts to ask for.
+    CmdArgs.push_back("-mllvm");
+    CmdArgs.push_back("-mos-thinlto");
+  } else {
+    // Full LTO code generation runs on one thread. With -flto-jobs, split
+    // the module into a partition per job; the target keeps each partition's
+    // call graph whole, so zero page and static stack allocation still work.
+    // An invalid value was already diagnosed by addLTOOptions.
+    if (Arg *A = Args.getLastArg(options::OPT_flto_jobs_EQ)) {
+      if (std::optional<llvm::ThreadPoolStrategy> S =
+              llvm::get_threadpool_strategy(A->getValue()))
+        CmdArgs.push_back(Args.MakeArgString(
+            "--lto-partitions=" + Twine(S->compute_thread_count())));
+    }
+  }
   unsigned ZPBytes = 0;
   StringRef LTOZP = Args.getLastArgValue(options::OPT_mlto_zp_EQ);
   if (!LTOZP.empty()) {
@@ -161,8 +222,18 @@ void mos::Linker::AddLTOOptions(const toolchains::MOSToolChain &TC, const ArgLis
     }
     ZPBytes -= Amt;
   }
-  if (ZPBytes) {
+  if (ZPBytes && !IsThinLTO) {
     CmdArgs.push_back("-mllvm");
     CmdArgs.push_back(Args.MakeArgString("-zp-avail=" + Twine(ZPBytes)));
   }
+  if (Arg *A = Args.getLastArg(options::OPT_mstatic_stack_EQ)) {
+    StringRef Val = A->getValue();
+    if (Val != "report" && Val != "strict") {
+      TC.getDriver().Diag(diag::err_drv_invalid_value)
+          << A->getAsString(Args) << Val;
+    } else {
+      CmdArgs.push_back("-mllvm");
+      CmdArgs.push_back(Args.MakeArgString("-mos-static-stack=" + Val));
+    }
+  }
 }
@@ -23,6 +23,7 @@
 #include "clang/Sema/Scope.h"
 #include "clang/Sema/SemaCUDA.h"
 #include "clang/Sema/SemaCodeCompletion.h"
+#include "clang/Sema/SemaMOS.h"
 #include "clang/Sema/SemaRISCV.h"
 #include "llvm/ADT/ArrayRef.h"
 #include "llvm/ADT/StringSwitch.h"
@@ -405,6 +406,15 @@ private:
   Sema &Actions;
 };
 
+struct PragmaMOSHandler : public PragmaHandler {
+  PragmaMOSHandler(Sema &Actions) : PragmaHandler("mos"), Actions(Actions) {}
+  void HandlePragma(Preprocessor &PP, PragmaIntroducer Introducer,
+                    Token &FirstToken) override;
+
+private:
+  Sema &Actions;
+};
+
 void markAsReinjectedForRelexing(llvm::MutableArrayRef<clang::Token> Toks) {
   for (auto &T : Toks)
     T.setFlag(clang::Token::IsReinjected);
@@ -562,6 +572,11 @@ void Parser::initializePragmaHandlers() {
     RISCVPragmaHandler = std::make_unique<PragmaRISCVHandler>(Actions);
     PP.AddPragmaHandler("clang", RISCVPragmaHandler.get());
   }
+
+  if (getTargetInfo().getTriple().isMOS()) {
+    MOSPragmaHandler = std::make_unique<PragmaMOSHandler>(Actions);
+    PP.AddPragmaHandler("clang", MOSPragmaHandler.get());
+  }
 }
 
 void Parser::resetPragmaHandlers() {
@@ -696,6 +711,11 @@ void Parser::resetPragmaHandlers() {
     PP.RemovePragmaHandler("clang", RISCVPragmaHandler.get());
     RISCVPragmaHandler.reset();
   }
+
+  if (getTargetInfo().getTriple().isMOS()) {
+    PP.RemovePragmaHandler("clang", MOSPragmaHandler.get());
+    MOSPragmaHandler.reset();
+  }
 }
 
 void Parser::HandlePragmaUnused() {
@@ -4173,3 +4193,53 @@ void PragmaRISCVHandler::HandlePragma(Preprocessor &PP,
   else if (II->isStr("andes_vector"))
     Actions.RISCV().DeclareAndesVectorBuiltins = true;
 }
+
+// #pragma clang mos cost(bytes|average|cycles|default)
+void PragmaMOSHandler::HandlePragma(Preprocessor &PP,
+                                    PragmaIntroducer Introducer,
+                                    Token &FirstToken) {
+  Token Tok;
+  PP.Lex(Tok);
+  IdentifierInfo *II = Tok.getIdentifierInfo();
+
+  if (!II || !II->isStr("cost")) {
+    PP.Diag(Tok.getLocation(), diag::warn_pragma_invalid_argument)
+        << PP.getSpelling(Tok) << "clang mos" << /*Expected=*/true << "'cost'";
+    return;
+  }
+
+  PP.Lex(Tok);
+  if (Tok.isNot(tok::l_paren)) {
+    PP.Diag(Tok.getLocation(), diag::warn_pragma_expected_lparen)
+        << "clang mos cost";
+    return;
+  }
+
+  PP.Lex(Tok);
+  II = Tok.getIdentifierInfo();
+  if (!II || !(II->isStr("bytes") || II->isStr("average") ||
+               II->isStr("cycles") || II->isStr("default"))) {
+    PP.Diag(Tok.getLocation(), diag::warn_pragma_invalid_argument)
+        << PP.getSpelling(Tok) << "clang mos cost" << /*Expected=*/true
+        << "'bytes', 'average', 'cycles' or 'default'";
+    return;
+  }
+
+  PP.Lex(Tok);
+  if (Tok.isNot(tok::r_paren)) {
+    PP.Diag(Tok.getLocation(), diag::warn_pragma_expected_rparen)
+        << "clang mos cost";
+    return;
+  }
+
+  PP.Lex(Tok);
+  if (Tok.isNot(tok::eod)) {
+    PP.Diag(Tok.getLocation(), diag::warn_pragma_extra_tokens_at_eol)
+        << "clang mos cost";
+    return;
+  }
+
+  Actions.MOS().ActOnPragmaCost(
+      FirstToken.getLocation(),
+      II->isStr("default") ? StringRef() : II->getName());
+}
@@ -7150,6 +7150,30 @@ ProcessDeclAttribute(Sema &S, Scope *scope, Decl *D, const ParsedAttr &AL,
   case ParsedAttr::AT_MOSNoISR:
     S.MOS().handleInterruptNoISRAttr(D, AL);
     break;
+  case ParsedAttr::AT_MOSBanked:
+    S.MOS().handleBankedAttr(D, AL);
+    break;
+  case ParsedAttr::AT_MOSBasePage:
+    S.MOS().handleBasePageAttr(D, AL);
+    break;
+  case ParsedAttr::AT_MOSCycleBudget:
+    S.MOS().handleCycleBudgetAttr(D, AL);
+    break;
+  case ParsedAttr::AT_MOSCost:
+    S.MOS().handleCostAttr(D, AL);
+    break;
+  case ParsedAttr::AT_MOSCPUClones:
+    S.MOS().handleCPUClonesAttr(D, AL);
+    break;
+  case ParsedAttr::AT_MOSStaticCoroutine:
+    S.MOS().handleStaticCoroutineAttr(D, AL);
+    break;
+  case ParsedAttr::AT_MOSTimed:
+    S.MOS().handleTimedAttr(D, AL);
+    break;
+  case ParsedAttr::AT_MOSMaxDepth:
+    S.MOS().handleMaxDepthAttr(D, AL);
+    break;
   case ParsedAttr::AT_WebAssemblyExportName:
     S.Wasm().handleWebAssemblyExportNameAttr(D, AL);
     break;
@@ -13,7 +13,10 @@
 #include "clang/Sema/SemaMOS.h"
 
 #include "clang/AST/ASTContext.h"
+#include "clang/AST/Decl.h"
+#include "clang/Basic/CharInfo.h"
 #include "clang/Sema/Attr.h"
+#include "clang/Sema/Sema.h"
 
 using namespace llvm;
 
@@ -58,6 +61,194 @@ void SemaMOS::handleInterruptNoISRAttr(Decl *D, const ParsedAttr &AL) {
   handleSimpleAttribute<MOSNoISRAttr>(*this, D, AL);
 }
 
+void SemaMOS::handleBankedAttr(Decl *D, const ParsedAttr &AL) {
+  if (!isFuncOrMethodForAttrSubject(D)) {
+    Diag(D->getLocation(), diag::warn_attribute_wrong_decl_type)
+        << "'banked'" << ExpectedFunction;
+    return;
+  }
+
+  if (!AL.checkExactlyNumArgs(SemaRef, 0))
+    return;
+
+  handleSimpleAttribute<MOSBankedAttr>(*this, D, AL);
+}
+
+void SemaMOS::handleBasePageAttr(Decl *D, const ParsedAttr &AL) {
+  if (!isFuncOrMethodForAttrSubject(D)) {
+    Diag(D->getLocation(), diag::warn_attribute_wrong_decl_type)
+        << "'base_page'" << ExpectedFunction;
+    return;
+  }
+
+  if (!AL.checkExactlyNumArgs(SemaRef, 1))
+    return;
+
+  StringRef Page;
+  SourceLocation LiteralLoc;
+  if (!SemaRef.checkStringLiteralArgumentAttr(AL, 0, Page, &LiteralLoc))
+    return;
+
+  // The page names the .bp.<page> section and the __bp_<page> symbol.
+  if (!isValidAsciiIdentifier(Page)) {
+    Diag(LiteralLoc, diag::err_mos_base_page_name_invalid) << Page;
+    return;
+  }
+
+  // The function doesn't share its imaginary registers with its caller, so
+  // nothing can be passed to it or returned from it in them.
+  if (hasFunctionProto(D) && getFunctionOrMethodNumParams(D) != 0) {
+    Diag(D->getLocation(), diag::warn_mos_base_page_attribute_invalid) << 0;
+    return;
+  }
+  if (!getFunctionOrMethodResultType(D)->isVoidType()) {
+    Diag(D->getLocation(), diag::warn_mos_base_page_attribute_invalid) << 1;
+    return;
+  }
+
+  D->addAttr(::new (getASTContext())
+                 MOSBasePageAttr(getASTContext(), AL, Page));
+}
+
+void SemaMOS::handleCycleBudgetAttr(Decl *D, const ParsedAttr &AL) {
+  if (!isFuncOrMethodForAttrSubject(D)) {
+    Diag(D->getLocation(), diag::warn_attribute_wrong_decl_type)
+        << "'mos_cycle_budget'" << ExpectedFunction;
+    return;
+  }
+
+  if (!AL.checkExactlyNumArgs(SemaRef, 1))
+    return;
+
+  uint32_t Budget;
+  if (!SemaRef.checkUInt32Argument(AL, AL.getArgAsExpr(0), Budget))
+    return;
+
+  D->addAttr(::new (getASTContext())
+                 MOSCycleBudgetAttr(getASTContext(), AL, Budget));
+}
+
+// The cost modes of the backend, as selected by -Oz, -Os, and otherwise.
+static bool isValidCostMode(StringRef Mode) {
+  return Mode == "bytes" || Mode == "average" || Mode == "cycles";
+}
+
+void SemaMOS::handleCostAttr(Decl *D, const ParsedAttr &AL) {
+  if (!isFuncOrMethodForAttrSubject(D)) {
+    Diag(D->getLocation(), diag::warn_attribute_wrong_decl_type)
+        << "'mos_cost'" << ExpectedFunction;
+    return;
+  }
+
+  if (!AL.checkExactlyNumArgs(SemaRef, 1))
+    return;
+
+  StringRef Mode;
+  SourceLocation LiteralLoc;
+  if (!SemaRef.checkStringLiteralArgumentAttr(AL, 0, Mode, &LiteralLoc))
+    return;
+  if (!isValidCostMode(Mode)) {
+    Diag(LiteralLoc, diag::warn_attribute_type_not_supported) << AL << Mode;
+    return;
+  }
+
+  D->addAttr(::new (getASTContext()) MOSCostAttr(getASTContext(), AL, Mode));
+}
+
+void SemaMOS::ActOnPragmaCost(SourceLocation PragmaLoc, StringRef Mode) {
+  assert((Mode.empty() || isValidCostMode(Mode)) && "unknown cost mode");
+  CostPragmaMode = Mode;
+  CostPragmaLoc = PragmaLoc;
+}
+
+void SemaMOS::AddRangeBasedCost(FunctionDecl *FD) {
+  if (CostPragmaMode.empty() || FD->hasAttr<MOSCostAttr>())
+    return;
+  FD->addAttr(
+      MOSCostAttr::CreateImplicit(getASTContext(), CostPragmaMode,
+                                  CostPragmaLoc));
+}
+
+void SemaMOS::handleCPUClonesAttr(Decl *D, const ParsedAttr &AL) {
+  if (!isFuncOrMethodForAttrSubject(D)) {
+    Diag(D->getLocation(), diag::warn_attribute_wrong_decl_type)
+        << "'mos_cpu_clones'" << ExpectedFunction;
+    return;
+  }
+
+  if (!AL.checkAtLeastNumArgs(SemaRef, 1))
+    return;
+
+  // Only the processor families that the runtime can tell apart can be
+  // dispatched to.
+  static constexpr StringRef Families[] = {"mos6502", "mos65c02", "mosw65816"};
+  SmallVector<StringRef> CPUs;
+  for (unsigned I = 0, E = AL.getNumArgs(); I != E; ++I) {
+    StringRef CPU;
+    SourceLocation LiteralLoc;
+    if (!SemaRef.checkStringLiteralArgumentAttr(AL, I, CPU, &LiteralLoc))
+      return;
+    if (!is_contained(Families, CPU) || is_contained(CPUs, CPU)) {
+      Diag(LiteralLoc, diag::warn_attribute_type_not_supported) << AL << CPU;
+      return;
+    }
+    CPUs.push_back(CPU);
+  }
+
+  D->addAttr(::new (getASTContext()) MOSCPUClonesAttr(
+      getASTContext(), AL, CPUs.data(), CPUs.size()));
+}
+
+void SemaMOS::handleStaticCoroutineAttr(Decl *D, const ParsedAttr &AL) {
+  if (!isFuncOrMethodForAttrSubject(D)) {
+    Diag(D->getLocation(), diag::warn_attribute_wrong_decl_type)
+        << "'static_coroutine'" << ExpectedFunction;
+    return;
+  }
+
+  if (!AL.checkExactlyNumArgs(SemaRef, 0))
+    return;
+
+  handleSimpleAttribute<MOSStaticCoroutineAttr>(*this, D, AL);
+}
+
+void SemaMOS::handleTimedAttr(Decl *D, const ParsedAttr &AL) {
+  if (!isFuncOrMethodForAttrSubject(D)) {
+    Diag(D->getLocation(), diag::warn_attribute_wrong_decl_type)
+        << "'mos_timed'" << ExpectedFunction;
+    return;
+  }
+
+  if (!AL.checkExactlyNumArgs(SemaRef, 0))
+    return;
+
+  handleSimpleAttribute<MOSTimedAttr>(*this, D, AL);
+}
+
+void SemaMOS::handleMaxDepthAttr(Decl *D, const ParsedAttr &AL) {
+  if (!isFuncOrMethodForAttrSubject(D)) {
+    Diag(D->getLocation(), diag::warn_attribute_wrong_decl_type)
+        << "'mos_max_depth'" << ExpectedFunction;
+    return;
+  }
+
+  if (!AL.checkExactlyNumArgs(SemaRef, 1))
+    return;
+
+  uint32_t Depth;
+  const Expr *E = AL.getArgAsExpr(0);
+  if (!SemaRef.checkUInt32Argument(AL, E, Depth))
+    return;
+  if (!Depth) {
+    Diag(AL.getLoc(), diag::err_attribute_argument_is_zero)
+        << AL << E->getSourceRange();
+    return;
+  }
+
+  D->addAttr(::new (getASTContext())
+                 MOSMaxDepthAttr(getASTContext(), AL, Depth));
+}
+
 SemaMOS::SemaMOS(Sema &S) : SemaBase(S) {}
 
 } // namespace clang
@@ -0,0 +1,26 @@
+// RUN: %clang_cc1 -triple mos -emit-llvm %s -o - | FileCheck %s
+// RUN: %clang_cc1 -triple mos -fsyntax-only -verify -DERRORS %s
+
+#ifdef ERRORS
+
+int banked_var __attribute__((banked)); // expected-warning {{attribute only applies to functions}}
+__attribute__((banked(1))) void banked_arg(void); // expected-error {{attribute takes no arguments}}
+
+#else
+
+// CHECK-LABEL: define dso_local void @banked_def() #[[DEF:[0-9]+]] {
+__attribute__((banked)) void banked_def(void) {}
+
+// Callers must see the attribute on declarations too.
+__attribute__((banked)) void banked_decl(void);
+
+// CHECK-LABEL: define dso_local void @caller() #[[CALLER:[0-9]+]] {
+// CHECK: call void @banked_decl()
+// CHECK: declare void @banked_decl() #[[DECL:[0-9]+]]
+void caller(void) { banked_decl(); }
+
+// CHECK: attributes #[[DEF]] = { {{.*}}"banked"{{.*}} }
+// CHECK-NOT: attributes #[[CALLER]] = { {{.*}}"banked"
+// CHECK: attributes #[[DECL]] = { {{.*}}"banked"{{.*}} }
+
+#endif
@@ -0,0 +1,31 @@
+// RUN: %clang_cc1 -triple mos -emit-llvm %s -o - | FileCheck %s
+// RUN: %clang_cc1 -triple mos -target-cpu mos65c02 -emit-llvm %s -o - \
+// RUN:   | FileCheck %s
+// RUN: %clang_cc1 -triple mos -target-cpu mossweet16 -verify=nobcd \
+// RUN:   -emit-llvm-only %s
+// RUN: %clang_cc1 -triple mos -target-cpu mosspc700 -verify=nobcd \
+// RUN:   -emit-llvm-only %s
+
+// CHECK-LABEL: define dso_local i16 @add(
+// CHECK: call i16 @llvm.mos.bcd.add(i16 %{{.*}}, i16 %{{.*}})
+unsigned add(unsigned a, unsigned b) {
+  return __builtin_mos_bcd_add(a, b); // nobcd-error {{needs target feature mos-insns-6502bcd}}
+}
+
+// CHECK-LABEL: define dso_local i16 @sub(
+// CHECK: call i16 @llvm.mos.bcd.sub(i16 %{{.*}}, i16 %{{.*}})
+unsigned sub(unsigned a, unsigned b) {
+  return __builtin_mos_bcd_sub(a, b); // nobcd-error {{needs target feature mos-insns-6502bcd}}
+}
+
+// CHECK-LABEL: define dso_local i32 @addl(
+// CHECK: call i32 @llvm.mos.bcd.addl(i32 %{{.*}}, i32 %{{.*}})
+unsigned long addl(unsigned long a, unsigned long b) {
+  return __builtin_mos_bcd_addl(a, b); // nobcd-error {{needs target feature mos-insns-6502bcd}}
+}
+
+// CHECK-LABEL: define dso_local i32 @subl(
+// CHECK: call i32 @llvm.mos.bcd.subl(i32 %{{.*}}, i32 %{{.*}})
+unsigned long subl(unsigned long a, unsigned long b) {
+  return __builtin_mos_bcd_subl(a, b); // nobcd-error {{needs target feature mos-insns-6502bcd}}
+}
@@ -0,0 +1,34 @@
+// REQUIRES: mos-registered-target
+// RUN: %clang_cc1 -triple mos -O2 -S %s -o - | FileCheck %s --check-prefix=ABORT
+// RUN: %clang_cc1 -triple mos -O2 -S -mllvm -mos-compact-traps %s -o - \
+// RUN:   | FileCheck %s --check-prefix=BRK
+
+volatile char v;
+
+// By default, a trap calls abort, since a BRK needs a handler to mean
+// anything.
+// ABORT: jsr abort
+// ABORT-NOT: brk
+// ABORT-NOT: .mos.trap
+
+// With compact traps, each trap is a BRK followed by its ID. The IDs count
+// up within the module, and the note records each BRK's address.
+// BRK-NOT: abort
+// BRK: brk
+// BRK-NEXT: .short 0
+// BRK: brk
+// BRK-NEXT: .short 1
+// BRK-NOT: abort
+// BRK: .section .mos.trap,"",@note
+
+void check_first(void) {
+  if (v)
+    __builtin_trap();
+  v = 1;
+}
+
+void check_second(void) {
+  if (v == 2)
+    __builtin_trap();
+  v = 3;
+}
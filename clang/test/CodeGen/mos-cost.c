@@ -0,0 +1,61 @@
+// RUN: %clang_cc1 -triple mos -O2 -disable-llvm-passes -emit-llvm %s -o - \
+// RUN:   | FileCheck %s --check-prefix=O2
+// RUN: %clang_cc1 -triple mos -Oz -disable-llvm-passes -emit-llvm %s -o - \
+// RUN:   | FileCheck %s --check-prefix=OZ
+// RUN: %clang_cc1 -triple mos -O2 -disable-llvm-passes -emit-llvm -DPRAGMA \
+// RUN:   %s -o - | FileCheck %s --check-prefix=PRAGMA
+// RUN: %clang_cc1 -triple mos -fsyntax-only -verify -DERRORS %s
+
+#if defined(ERRORS)
+
+__attribute__((mos_cost("fast"))) void fast(void); // expected-warning {{attribute argument not supported: fast}}
+__attribute__((mos_cost)) void no_mode(void); // expected-error {{attribute takes one argument}}
+#pragma clang mos cost(fast) // expected-warning {{unexpected argument 'fast' to '#pragma clang mos cost'}}
+#pragma clang mos speed // expected-warning {{unexpected argument 'speed' to '#pragma clang mos'}}
+
+#elif defined(PRAGMA)
+
+// PRAGMA-LABEL: define dso_local void @before() #[[BEFORE:[0-9]+]]
+void before(void) {}
+
+#pragma clang mos cost(bytes)
+
+// PRAGMA-LABEL: define dso_local void @in_bytes() #[[BYTES:[0-9]+]]
+void in_bytes(void) {}
+
+// An explicit attribute overrides the pragma.
+// PRAGMA-LABEL: define dso_local void @in_bytes_average() #[[AVERAGE:[0-9]+]]
+__attribute__((mos_cost("average"))) void in_bytes_average(void) {}
+
+#pragma clang mos cost(default)
+
+// PRAGMA-LABEL: define dso_local void @after() #[[BEFORE]]
+void after(void) {}
+
+// PRAGMA: attributes #[[BEFORE]] = { nounwind "
+// PRAGMA: attributes #[[BYTES]] = { minsize nounwind optsize "
+// PRAGMA: attributes #[[AVERAGE]] = { nounwind optsize "
+
+#else
+
+// The function's mode overrides the command line's -Oz or -Os.
+// O2-LABEL: define dso_local void @bytes() #[[BYTES:[0-9]+]]
+// OZ-LABEL: define dso_local void @bytes() #[[BYTES:[0-9]+]]
+__attribute__((mos_cost("bytes"))) void bytes(void) {}
+
+// O2-LABEL: define dso_local void @average() #[[AVERAGE:[0-9]+]]
+// OZ-LABEL: define dso_local void @average() #[[AVERAGE:[0-9]+]]
+__attribute__((mos_cost("average"))) void average(void) {}
+
+// O2-LABEL: define dso_local void @cycles() #[[CYCLES:[0-9]+]]
+// OZ-LABEL: define dso_local void @cycles() #[[CYCLES:[0-9]+]]
+__attribute__((mos_cost("cycles"))) void cycles(void) {}
+
+// O2: attributes #[[BYTES]] = { minsize nounwind optsize "
+// O2: attributes #[[AVERAGE]] = { nounwind optsize "
+// O2: attributes #[[CYCLES]] = { nounwind "
+// OZ: attributes #[[BYTES]] = { minsize nounwind optsize "
+// OZ: attributes #[[AVERAGE]] = { nounwind optsize "
+// OZ: attributes #[[CYCLES]] = { nounwind "
+
+#endif
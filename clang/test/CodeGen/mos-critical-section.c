@@ -0,0 +1,53 @@
+// REQUIRES: mos-registered-target
+// RUN: %clang_cc1 -triple mos -emit-llvm %s -o - | FileCheck %s
+// RUN: %clang_cc1 -triple mos -O2 -S %s -o - | FileCheck %s --check-prefix=ASM
+
+volatile char v;
+
+// CHECK-LABEL: define dso_local void @single()
+// CHECK: call void @llvm.mos.sei()
+// CHECK: store volatile i8 1, ptr @v
+// CHECK: call void @llvm.mos.cli()
+// ASM-LABEL: single:
+// ASM: sei
+// ASM: sta v
+// ASM: cli
+void single(void) {
+  __builtin_mos_sei();
+  v = 1;
+  __builtin_mos_cli();
+}
+
+// Adjacent sections merge into one.
+// ASM-LABEL: adjacent:
+// ASM: sei
+// ASM-NOT: {{sei|cli}}
+// ASM: sta v
+// ASM-NOT: {{sei|cli}}
+// ASM: sta v
+// ASM-NOT: sei
+// ASM: cli
+// ASM-NOT: {{sei|cli}}
+// ASM-LABEL: nested:
+void adjacent(void) {
+  __builtin_mos_sei();
+  v = 1;
+  __builtin_mos_cli();
+  __builtin_mos_sei();
+  v = 2;
+  __builtin_mos_cli();
+}
+
+// Nested sections flatten into the outermost one.
+// ASM: sei
+// ASM-NOT: {{sei|cli}}
+// ASM: sta v
+// ASM-NOT: sei
+// ASM: cli
+// ASM-NOT: {{sei|cli}}
+void nested(void) {
+  __builtin_mos_sei();
+  __builtin_mos_sei();
+  v = 1;
+  __builtin_mos_cli();
+}
@@ -0,0 +1,49 @@
+// REQUIRES: mos-registered-target
+// RUN: %clang_cc1 -triple mos -emit-llvm %s -o - | FileCheck %s
+// RUN: %clang_cc1 -triple mos -O2 -S %s -o /dev/null 2>&1 \
+// RUN:   | FileCheck %s --check-prefix=BACKEND
+// RUN: %clang_cc1 -triple mos -fsyntax-only -verify -DERRORS %s
+
+#ifdef ERRORS
+
+__attribute__((mos_cycle_budget)) void no_budget(void); // expected-error {{attribute takes one argument}}
+__attribute__((mos_cycle_budget("100"))) void string_budget(void); // expected-error {{integer constant}}
+int budget_var __attribute__((mos_cycle_budget(100))); // expected-warning {{attribute only applies to functions}}
+
+#else
+
+volatile char v;
+
+// CHECK-LABEL: define dso_local void @within() #[[WITHIN:[0-9]+]] {
+// BACKEND-NOT: in 'within'
+__attribute__((mos_cycle_budget(1000))) void within(void) { v = 1; }
+
+// CHECK-LABEL: define dso_local void @over() #[[OVER:[0-9]+]] {
+// BACKEND: warning: worst case cycle count ({{[0-9]+}}) exceeds limit (1) in 'over'
+__attribute__((mos_cycle_budget(1))) void over(void) {
+  v = 1;
+  v = 2;
+}
+
+// Calls count at the callee's budget, so callers need it on declarations.
+__attribute__((mos_cycle_budget(50))) void budgeted(void);
+void unbudgeted(void);
+
+// CHECK-LABEL: define dso_local void @calls_budgeted()
+// CHECK: declare void @budgeted() #[[DECL:[0-9]+]]
+__attribute__((mos_cycle_budget(1000))) void calls_budgeted(void) {
+  budgeted();
+  v = 1;
+}
+
+// BACKEND: warning: cycle budget cannot be verified: calls a function without a cycle budget
+__attribute__((mos_cycle_budget(1000))) void calls_unbudgeted(void) {
+  unbudgeted();
+  v = 1;
+}
+
+// CHECK: attributes #[[WITHIN]] = { {{.*}}"mos-cycle-budget"="1000"{{.*}} }
+// CHECK: attributes #[[OVER]] = { {{.*}}"mos-cycle-budget"="1"{{.*}} }
+// CHECK: attributes #[[DECL]] = { {{.*}}"mos-cycle-budget"="50"{{.*}} }
+
+#endif
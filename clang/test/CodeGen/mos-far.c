@@ -0,0 +1,30 @@
+// RUN: %clang_cc1 -triple mos -emit-llvm %s -o - | FileCheck %s
+// RUN: %clang_cc1 -triple mos -fsyntax-only -verify -DERRORS %s
+
+_Static_assert(sizeof(__far char *) == 4, "incorrect far pointer size");
+_Static_assert(_Alignof(__far char *) == 1, "incorrect far pointer alignment");
+
+// CHECK: target datalayout = "{{.*}}-p2:32:8-{{.*}}"
+
+#ifdef ERRORS
+
+// Far memory is not part of the ordinary address space, so neither kind of
+// pointer converts implicitly to the other.
+void convert(char *p, __far char *f) {
+  __far char *g = p; // expected-error {{changes address space of pointer}}
+  char *q = f; // expected-error {{changes address space of pointer}}
+}
+
+#else
+
+// CHECK-LABEL: define dso_local {{.*}}i8 @load(ptr addrspace(2) noundef %p)
+// CHECK: [[P:%.*]] = load ptr addrspace(2), ptr %p.addr
+// CHECK: load i8, ptr addrspace(2) [[P]]
+char load(__far char *p) { return *p; }
+
+// CHECK-LABEL: define dso_local void @store(ptr addrspace(2) noundef %p, i8 noundef {{.*}}%c)
+// CHECK: [[ARRAYIDX:%.*]] = getelementptr inbounds{{.*}} i8, ptr addrspace(2) {{%.*}}, i32 70000
+// CHECK: store i8 {{%.*}}, ptr addrspace(2) [[ARRAYIDX]]
+void store(__far char *p, char c) { p[70000L] = c; }
+
+#endif
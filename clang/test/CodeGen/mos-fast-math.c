@@ -0,0 +1,42 @@
+// REQUIRES: mos-registered-target
+// RUN: %clang -target mos -O2 -ffast-math -S %s -o - \
+// RUN:   | FileCheck %s --check-prefix=FAST
+// RUN: %clang -target mos -O2 -S %s -o - \
+// RUN:   | FileCheck %s --check-prefix=IEEE
+
+// Single-precision arithmetic calls the fast routines only when NaNs,
+// infinities, and signed zeros may be ignored. Double precision always
+// calls the generic ones.
+
+// FAST-LABEL: add:
+// FAST: __fast_addsf3
+// IEEE-LABEL: add:
+// IEEE-NOT: __fast_addsf3
+// IEEE: __addsf3
+float add(float a, float b) { return a + b; }
+
+// FAST-LABEL: sub:
+// FAST: __fast_subsf3
+// IEEE-LABEL: sub:
+// IEEE-NOT: __fast_subsf3
+// IEEE: __subsf3
+float sub(float a, float b) { return a - b; }
+
+// FAST-LABEL: mul:
+// FAST: __fast_mulsf3
+// IEEE-LABEL: mul:
+// IEEE-NOT: __fast_mulsf3
+// IEEE: __mulsf3
+float mul(float a, float b) { return a * b; }
+
+// FAST-LABEL: div:
+// FAST: __fast_divsf3
+// IEEE-LABEL: div:
+// IEEE-NOT: __fast_divsf3
+// IEEE: __divsf3
+float div(float a, float b) { return a / b; }
+
+// FAST-LABEL: add_double:
+// FAST-NOT: __fast_
+// FAST: __adddf3
+double add_double(double a, double b) { return a + b; }
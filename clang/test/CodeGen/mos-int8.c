@@ -0,0 +1,31 @@
+// RUN: %clang_cc1 -triple mos -target-feature +int8 -ffreestanding \
+// RUN:   -emit-llvm %s -o - \
+// RUN:   | FileCheck %s --check-prefix=INT8
+// RUN: %clang_cc1 -triple mos -ffreestanding -emit-llvm %s -o - \
+// RUN:   | FileCheck %s --check-prefix=INT16
+
+#include <stddef.h>
+#include <stdint.h>
+
+// The 16-bit types move to short, which stays 16 bits wide; long stays 32.
+_Static_assert(sizeof(short) == 2, "incorrect short size");
+_Static_assert(sizeof(long) == 4, "incorrect long size");
+_Static_assert(sizeof(size_t) == 2, "incorrect size_t size");
+_Static_assert(sizeof(ptrdiff_t) == 2, "incorrect ptrdiff_t size");
+_Static_assert(sizeof(intptr_t) == 2, "incorrect intptr_t size");
+_Static_assert(sizeof(int16_t) == 2, "incorrect int16_t size");
+_Static_assert(sizeof(void *) == 2, "incorrect pointer size");
+
+// With 8-bit int, the integer promotions leave 8-bit arithmetic alone.
+// INT8-LABEL: define dso_local signext i8 @add(
+// INT8: add nsw i8
+// INT16-LABEL: define dso_local signext i8 @add(
+// INT16: sext i8 %{{.*}} to i16
+// INT16: add nsw i16
+signed char add(signed char a, signed char b) { return a + b; }
+
+// INT8-LABEL: define dso_local i8 @int_size()
+// INT8: ret i8 1
+// INT16-LABEL: define dso_local i16 @int_size()
+// INT16: ret i16 2
+int int_size(void) { return sizeof(int); }
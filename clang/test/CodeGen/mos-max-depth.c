@@ -0,0 +1,44 @@
+// REQUIRES: mos-registered-target
+// RUN: %clang_cc1 -triple mos -emit-llvm %s -o - | FileCheck %s
+// RUN: %clang_cc1 -triple mos -O2 -disable-llvm-passes -S %s -o - \
+// RUN:   | FileCheck %s --check-prefix=ASM
+// RUN: %clang_cc1 -triple mos -O2 -disable-llvm-passes -S \
+// RUN:   -Rpass=mos-nonreentrant -Rpass-missed=mos-nonreentrant %s \
+// RUN:   -o /dev/null 2>&1 | FileCheck %s --check-prefix=REMARK
+// RUN: %clang_cc1 -triple mos -fsyntax-only -verify -DERRORS %s
+
+#ifdef ERRORS
+
+__attribute__((mos_max_depth)) void no_depth(void); // expected-error {{attribute takes one argument}}
+__attribute__((mos_max_depth(0))) void zero_depth(void); // expected-error {{attribute must be greater than 0}}
+__attribute__((mos_max_depth("2"))) void string_depth(void); // expected-error {{integer constant}}
+int depth_var __attribute__((mos_max_depth(2))); // expected-warning {{attribute only applies to functions}}
+
+#else
+
+volatile char v;
+
+// The store after the call keeps the recursion from becoming a loop.
+// CHECK-LABEL: define dso_local {{.*}}i8 @sum(
+// CHECK-SAME: #[[SUM:[0-9]+]] {
+// REMARK-DAG: remark: function copied for each of the 3 depths of its recursion, so that each can have a static frame
+// ASM-DAG: sum.depth2:
+// ASM-DAG: sum.depth3:
+__attribute__((mos_max_depth(3))) char sum(char n) {
+  if (!n)
+    return 0;
+  char r = sum(n - 1);
+  v = r;
+  return r + n;
+}
+
+// CHECK-LABEL: define dso_local void @flat(
+// CHECK-SAME: #[[FLAT:[0-9]+]] {
+// REMARK-DAG: remark: mos_max_depth has no effect, since the function does not call itself directly
+// ASM-NOT: flat.depth2:
+__attribute__((mos_max_depth(2))) void flat(void) { v = 1; }
+
+// CHECK: attributes #[[SUM]] = { {{.*}}"mos-max-depth"="3"{{.*}} }
+// CHECK: attributes #[[FLAT]] = { {{.*}}"mos-max-depth"="2"{{.*}} }
+
+#endif
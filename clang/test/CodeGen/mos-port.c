@@ -0,0 +1,22 @@
+// RUN: %clang_cc1 -triple mos -emit-llvm %s -o - | FileCheck %s
+
+#define PORT ((volatile unsigned char *)0x2007)
+
+// CHECK-LABEL: define dso_local void @write_block(
+// CHECK: call void @llvm.mos.port.write.block(ptr inttoptr (i16 8199 to ptr),
+// CHECK-SAME: ptr %{{.*}}, i16 %{{.*}})
+void write_block(const unsigned char *src, __SIZE_TYPE__ n) {
+  __builtin_mos_port_write_block(PORT, src, n);
+}
+
+// CHECK-LABEL: define dso_local void @read_block(
+// CHECK: call void @llvm.mos.port.read.block(ptr %{{.*}},
+// CHECK-SAME: ptr inttoptr (i16 8199 to ptr), i16 %{{.*}})
+void read_block(unsigned char *dst, __SIZE_TYPE__ n) {
+  __builtin_mos_port_read_block(dst, PORT, n);
+}
+
+// CHECK-LABEL: define dso_local void @fill(
+// CHECK: call void @llvm.mos.port.fill(ptr inttoptr (i16 8199 to ptr),
+// CHECK-SAME: i8 0, i16 256)
+void fill(void) { __builtin_mos_port_fill(PORT, 0, 256); }
@@ -0,0 +1,43 @@
+// REQUIRES: mos-registered-target
+// RUN: %clang_cc1 -triple mos -emit-llvm %s -o - | FileCheck %s
+// RUN: %clang_cc1 -triple mos -O2 -S %s -o - | FileCheck %s --check-prefix=ASM
+// RUN: %clang_cc1 -triple mos -O2 -S -Rpass-analysis=asm-printer %s \
+// RUN:   -o /dev/null 2>&1 | FileCheck %s --check-prefix=REMARK
+// RUN: %clang_cc1 -triple mos -fsyntax-only -verify -DERRORS %s
+
+#ifdef ERRORS
+
+__attribute__((mos_timed(1))) void timed_arg(void); // expected-error {{attribute takes no arguments}}
+int timed_var __attribute__((mos_timed)); // expected-warning {{attribute only applies to functions}}
+
+#else
+
+volatile char v;
+
+// CHECK-LABEL: define dso_local void @straight() #[[TIMED:[0-9]+]] {
+// REMARK: remark: timed function takes {{[0-9]+}} to {{[0-9]+}} cycles
+// ASM: .section .text.timed.straight,"ax",@progbits
+// ASM-NEXT: .p2align
+// ASM: straight:
+__attribute__((mos_timed)) void straight(void) {
+  v = 1;
+  v = 2;
+}
+
+// CHECK-LABEL: define dso_local void @loop(
+// CHECK-SAME: #[[TIMED]] {
+// REMARK: remark: timed function has no fixed cycle count: contains a loop
+// ASM: .section .text.timed.loop,"ax",@progbits
+__attribute__((mos_timed)) void loop(char n) {
+  for (char i = 0; i < n; ++i)
+    v = i;
+}
+
+// CHECK-LABEL: define dso_local void @untimed() #[[UNTIMED:[0-9]+]] {
+// ASM-NOT: .text.timed.untimed
+void untimed(void) { v = 3; }
+
+// CHECK: attributes #[[TIMED]] = { {{.*}}"mos-timed"{{.*}} }
+// CHECK-NOT: attributes #[[UNTIMED]] = { {{.*}}"mos-timed"
+
+#endif
@@ -0,0 +1,31 @@
+// RUN: %clang_cc1 -triple mos -emit-llvm %s -o - | FileCheck %s
+// RUN: %clang_cc1 -triple mos -fsyntax-only -verify -DERRORS %s
+
+_Static_assert(sizeof(__zp char *) == 1, "incorrect zero page pointer size");
+
+void take(char *p);
+
+#ifdef ERRORS
+
+// Narrowing an ordinary pointer to a zero page one still needs a cast.
+void narrow(char *p) {
+  __zp char *q = p; // expected-error {{changes address space of pointer}}
+  __zp char *r = (__zp char *)p;
+}
+
+#else
+
+// Zero page pointers convert implicitly to ordinary ones.
+// CHECK-LABEL: define dso_local void @widen(ptr addrspace(1) noundef %p)
+// CHECK: [[P:%.*]] = load ptr addrspace(1), ptr %p.addr
+// CHECK: [[CAST:%.*]] = addrspacecast ptr addrspace(1) [[P]] to ptr
+// CHECK: call void @take(ptr noundef [[CAST]])
+void widen(__zp char *p) { take(p); }
+
+__zp char zp_var;
+
+// CHECK-LABEL: define dso_local void @widen_global()
+// CHECK: call void @take(ptr noundef addrspacecast (ptr addrspace(1) @zp_var to ptr))
+void widen_global(void) { take(&zp_var); }
+
+#endif
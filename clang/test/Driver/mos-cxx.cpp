@@ -0,0 +1,13 @@
+// C++ for MOS defaults to no exceptions and no RTTI.
+// RUN: %clang -target mos -### -c %s 2>&1 \
+// RUN:   | FileCheck -check-prefix=CHECK-DEFAULT %s
+// RUN: %clang -target mos -fexceptions -frtti -### -c %s 2>&1 \
+// RUN:   | FileCheck -check-prefix=CHECK-ENABLED %s
+
+// CHECK-DEFAULT-NOT: "-fcxx-exceptions"
+// CHECK-DEFAULT: "-fno-rtti"
+// CHECK-DEFAULT-NOT: "-fcxx-exceptions"
+
+// CHECK-ENABLED-NOT: "-fno-rtti"
+// CHECK-ENABLED: "-fcxx-exceptions" "-fexceptions"
+// CHECK-ENABLED-NOT: "-fno-rtti"
@@ -6,3 +6,13 @@
 
 // CHECK-STATIC-STACK: "-target-feature" "+static-stack"
 // CHECK-NO-STATIC-STACK: "-target-feature" "-static-stack"
+
+// RUN: %clang -target mos -mint8 \
+// RUN: -### -c %s 2>&1 | FileCheck -check-prefix=CHECK-INT8 %s
+// RUN: %clang -target mos -mint8 -mno-int8 \
+// RUN: -### -c %s 2>&1 | FileCheck -check-prefix=CHECK-NO-INT8 %s
+// RUN: %clang -target mos \
+// RUN: -### -c %s 2>&1 | FileCheck -check-prefix=CHECK-NO-INT8 %s
+
+// CHECK-INT8: "-target-feature" "+int8"
+// CHECK-NO-INT8-NOT: "+int8"
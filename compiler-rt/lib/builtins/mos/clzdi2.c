@@ -0,0 +1,36 @@
+//===-- mos/clzdi2.c - Count leading zeros of a 64-bit integer ----*- C -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements __clzdi2 a byte at a time, as __clzsi2 is, on the
+// nonzero half of the value. The result is undefined for zero.
+//
+//===----------------------------------------------------------------------===//
+
+#include "../int_lib.h"
+
+COMPILER_RT_ABI int __clzdi2(di_int a) {
+  dwords x;
+  x.all = a;
+  su_int w = x.s.high;
+  int n = 0;
+  if (!w) {
+    n = 32;
+    w = x.s.low;
+  }
+  if (!(w >> 16)) {
+    n += 16;
+    w <<= 16;
+  }
+  if (!(w >> 24)) {
+    n += 8;
+    w <<= 8;
+  }
+  for (unsigned char b = w >> 24; b && !(b & 0x80); b <<= 1)
+    ++n;
+  return n;
+}
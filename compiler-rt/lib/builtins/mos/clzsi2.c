@@ -0,0 +1,33 @@
+//===-- mos/clzsi2.c - Count leading zeros of a 32-bit integer ----*- C -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements __clzsi2 a byte at a time. The generic version's
+// bit tricks need shifts by amounts that aren't multiples of 8, each a chain
+// of rotates through every byte on the 6502. Here the top nonzero byte is
+// found by moving whole bytes, and only its bits are shifted. The result is
+// undefined for zero.
+//
+//===----------------------------------------------------------------------===//
+
+#include "../int_lib.h"
+
+COMPILER_RT_ABI int __clzsi2(si_int a) {
+  su_int x = (su_int)a;
+  int n = 0;
+  if (!(x >> 16)) {
+    n = 16;
+    x <<= 16;
+  }
+  if (!(x >> 24)) {
+    n += 8;
+    x <<= 8;
+  }
+  for (unsigned char b = x >> 24; b && !(b & 0x80); b <<= 1)
+    ++n;
+  return n;
+}
@@ -0,0 +1,36 @@
+//===-- mos/ctzdi2.c - Count trailing zeros of a 64-bit integer ---*- C -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements __ctzdi2 a byte at a time, as __ctzsi2 is, on the
+// nonzero half of the value. The result is undefined for zero.
+//
+//===----------------------------------------------------------------------===//
+
+#include "../int_lib.h"
+
+COMPILER_RT_ABI int __ctzdi2(di_int a) {
+  dwords x;
+  x.all = a;
+  su_int w = x.s.low;
+  int n = 0;
+  if (!w) {
+    n = 32;
+    w = x.s.high;
+  }
+  if (!(uint16_t)w) {
+    n += 16;
+    w >>= 16;
+  }
+  if (!(uint8_t)w) {
+    n += 8;
+    w >>= 8;
+  }
+  for (unsigned char b = w; b && !(b & 1); b >>= 1)
+    ++n;
+  return n;
+}
@@ -0,0 +1,31 @@
+//===-- mos/ctzsi2.c - Count trailing zeros of a 32-bit integer ---*- C -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements __ctzsi2 a byte at a time. The lowest nonzero byte is
+// found by moving whole bytes, and only its bits are shifted. The result is
+// undefined for zero.
+//
+//===----------------------------------------------------------------------===//
+
+#include "../int_lib.h"
+
+COMPILER_RT_ABI int __ctzsi2(si_int a) {
+  su_int x = (su_int)a;
+  int n = 0;
+  if (!(uint16_t)x) {
+    n = 16;
+    x >>= 16;
+  }
+  if (!(uint8_t)x) {
+    n += 8;
+    x >>= 8;
+  }
+  for (unsigned char b = x; b && !(b & 1); b >>= 1)
+    ++n;
+  return n;
+}
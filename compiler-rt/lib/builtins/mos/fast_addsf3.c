@@ -0,0 +1,88 @@
+//===-- mos/fast_addsf3.c - Fast single-precision addition --------*- C -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements single-precision soft-float addition and subtraction
+// for code that assumes no NaNs or infinities, as under -ffast-math. Denormal
+// operands and results are flushed to zero.
+//
+//===----------------------------------------------------------------------===//
+
+#define SINGLE_PRECISION
+#include "../fp_lib.h"
+
+COMPILER_RT_ABI fp_t __fast_addsf3(fp_t a, fp_t b) {
+  rep_t aRep = toRep(a);
+  rep_t bRep = toRep(b);
+
+  // Make a the operand with the larger magnitude.
+  if ((bRep & absMask) > (aRep & absMask)) {
+    const rep_t temp = aRep;
+    aRep = bRep;
+    bRep = temp;
+  }
+
+  int aExponent = aRep >> significandBits & maxExponent;
+  const int bExponent = bRep >> significandBits & maxExponent;
+  if (!bExponent) {
+    if (aExponent)
+      return fromRep(aRep);
+    // Both are zero; the sum is -0 only if both are.
+    return fromRep(aRep & bRep & signBit);
+  }
+
+  // Three extra bits of precision for rounding: guard, round, and sticky.
+  rep_t aSignificand = ((aRep & significandMask) | implicitBit) << 3;
+  rep_t bSignificand = ((bRep & significandMask) | implicitBit) << 3;
+
+  const unsigned int align = aExponent - bExponent;
+  if (align) {
+    if (align < typeWidth) {
+      const bool sticky = (bSignificand << (typeWidth - align)) != 0;
+      bSignificand = bSignificand >> align | sticky;
+    } else {
+      bSignificand = 1;
+    }
+  }
+
+  const rep_t resultSign = aRep & signBit;
+  if ((aRep ^ bRep) & signBit) {
+    aSignificand -= bSignificand;
+    if (!aSignificand)
+      return fromRep(0);
+    if (aSignificand < implicitBit << 3) {
+      const int shift = rep_clz(aSignificand) - rep_clz(implicitBit << 3);
+      aSignificand <<= shift;
+      aExponent -= shift;
+    }
+  } else {
+    aSignificand += bSignificand;
+    if (aSignificand & implicitBit << 4) {
+      const bool sticky = aSignificand & 1;
+      aSignificand = aSignificand >> 1 | sticky;
+      aExponent += 1;
+    }
+  }
+
+  if (aExponent <= 0)
+    return fromRep(resultSign);
+
+  const int roundGuardSticky = aSignificand & 0x7;
+  rep_t result = (aSignificand >> 3 & significandMask) |
+                 (rep_t)aExponent << significandBits | resultSign;
+  // Round to nearest, ties to even. A carry out of the significand correctly
+  // bumps the exponent.
+  if (roundGuardSticky > 0x4)
+    result++;
+  if (roundGuardSticky == 0x4)
+    result += result & 1;
+  return fromRep(result);
+}
+
+COMPILER_RT_ABI fp_t __fast_subsf3(fp_t a, fp_t b) {
+  return __fast_addsf3(a, fromRep(toRep(b) ^ signBit));
+}
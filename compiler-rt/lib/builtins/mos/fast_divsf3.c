@@ -0,0 +1,64 @@
+//===-- mos/fast_divsf3.c - Fast single-precision division --------*- C -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements single-precision soft-float division for code that
+// assumes no NaNs or infinities, as under -ffast-math. Denormal operands and
+// results are flushed to zero.
+//
+// The quotient is produced by restoring division, one bit at a time, which
+// only needs 32-bit arithmetic.
+//
+//===----------------------------------------------------------------------===//
+
+#define SINGLE_PRECISION
+#include "../fp_lib.h"
+
+COMPILER_RT_ABI fp_t __fast_divsf3(fp_t a, fp_t b) {
+  const rep_t aRep = toRep(a);
+  const rep_t bRep = toRep(b);
+  const rep_t quotientSign = (aRep ^ bRep) & signBit;
+
+  const int aExponent = aRep >> significandBits & maxExponent;
+  const int bExponent = bRep >> significandBits & maxExponent;
+  if (!aExponent)
+    return fromRep(quotientSign);
+  // Division by zero would give an infinity, which the caller has promised
+  // not to produce; give it anyway.
+  if (!bExponent)
+    return fromRep(quotientSign | exponentMask);
+
+  rep_t remainder = (aRep & significandMask) | implicitBit;
+  const rep_t bSignificand = (bRep & significandMask) | implicitBit;
+  int quotientExponent = aExponent - bExponent + exponentBias;
+  if (remainder < bSignificand) {
+    remainder <<= 1;
+    quotientExponent -= 1;
+  }
+  if (quotientExponent <= 0)
+    return fromRep(quotientSign);
+
+  rep_t quotient = 0;
+  for (int i = 0; i <= significandBits; ++i) {
+    quotient <<= 1;
+    if (remainder >= bSignificand) {
+      remainder -= bSignificand;
+      quotient |= 1;
+    }
+    remainder <<= 1;
+  }
+
+  rep_t result = quotientSign | (rep_t)quotientExponent << significandBits |
+                 (quotient & significandMask);
+  // The remainder has been doubled, so comparing it against the divisor
+  // rounds to nearest, ties to even.
+  if (remainder > bSignificand)
+    result++;
+  else if (remainder == bSignificand)
+    result += result & 1;
+  return fromRep(result);
+}
@@ -0,0 +1,51 @@
+//===-- mos/fast_mulsf3.c - Fast single-precision multiply --------*- C -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements single-precision soft-float multiplication for code
+// that assumes no NaNs or infinities, as under -ffast-math. Denormal operands
+// and results are flushed to zero.
+//
+//===----------------------------------------------------------------------===//
+
+#define SINGLE_PRECISION
+#include "../fp_lib.h"
+
+COMPILER_RT_ABI fp_t __fast_mulsf3(fp_t a, fp_t b) {
+  const rep_t aRep = toRep(a);
+  const rep_t bRep = toRep(b);
+  const rep_t productSign = (aRep ^ bRep) & signBit;
+
+  const int aExponent = aRep >> significandBits & maxExponent;
+  const int bExponent = bRep >> significandBits & maxExponent;
+  if (!aExponent || !bExponent)
+    return fromRep(productSign);
+
+  const rep_t aSignificand = (aRep & significandMask) | implicitBit;
+  const rep_t bSignificand = (bRep & significandMask) | implicitBit;
+
+  // The 48-bit product lies in [2^46, 2^48); normalize it to [2^47, 2^48).
+  uint64_t product = (uint64_t)aSignificand * bSignificand;
+  int productExponent = aExponent + bExponent - exponentBias;
+  if (product & (uint64_t)1 << 47)
+    productExponent += 1;
+  else
+    product <<= 1;
+
+  if (productExponent <= 0)
+    return fromRep(productSign);
+
+  const rep_t rest = (rep_t)product & 0xffffff;
+  rep_t result = productSign | (rep_t)productExponent << significandBits |
+                 ((rep_t)(product >> 24) & significandMask);
+  // Round to nearest, ties to even.
+  if (rest > 0x800000)
+    result++;
+  else if (rest == 0x800000)
+    result += result & 1;
+  return fromRep(result);
+}
@@ -0,0 +1,17 @@
+//===-- mos/ffsdi2.c - Find first set bit of a 64-bit integer -----*- C -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements __ffsdi2 with the byte-wise __ctzdi2.
+//
+//===----------------------------------------------------------------------===//
+
+#include "../int_lib.h"
+
+COMPILER_RT_ABI int __ctzdi2(di_int a);
+
+COMPILER_RT_ABI int __ffsdi2(di_int a) { return a ? __ctzdi2(a) + 1 : 0; }
@@ -0,0 +1,18 @@
+//===-- mos/ffssi2.c - Find first set bit of a 32-bit integer -----*- C -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements __ffssi2 with the byte-wise __ctzsi2, which the
+// generic version would otherwise inline as bit tricks.
+//
+//===----------------------------------------------------------------------===//
+
+#include "../int_lib.h"
+
+COMPILER_RT_ABI int __ctzsi2(si_int a);
+
+COMPILER_RT_ABI int __ffssi2(si_int a) { return a ? __ctzsi2(a) + 1 : 0; }
@@ -0,0 +1,26 @@
+//===-- mos/memcpy_short.c - Copy fewer than 256 bytes ------------*- C -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements __memcpy_short, which the compiler calls in place of
+// memcpy when the length is known to fit in a byte. The whole count fits in
+// the index register, so the loop needs no 16-bit counter, and nothing is
+// returned, so callers need not keep the destination.
+//
+//===----------------------------------------------------------------------===//
+
+#include "../int_lib.h"
+
+COMPILER_RT_ABI void __memcpy_short(void *dst, const void *src,
+                                    unsigned char n) {
+  unsigned char *d = dst;
+  const unsigned char *s = src;
+  while (n) {
+    --n;
+    d[n] = s[n];
+  }
+}
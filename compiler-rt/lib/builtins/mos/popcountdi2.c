@@ -0,0 +1,33 @@
+//===-- mos/popcountdi2.c - Count set bits of a 64-bit integer ----*- C -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements __popcountdi2 by looking up the bits of each nibble in
+// a table, as __popcountsi2 does.
+//
+//===----------------------------------------------------------------------===//
+
+#include "../int_lib.h"
+
+// The number of set bits in each 4-bit value.
+static const unsigned char nibble_bits[16] = {0, 1, 1, 2, 1, 2, 2, 3,
+                                              1, 2, 2, 3, 2, 3, 3, 4};
+
+static unsigned char byte_bits(unsigned char b) {
+  return nibble_bits[b & 15] + nibble_bits[b >> 4];
+}
+
+static unsigned char word_bits(su_int x) {
+  return byte_bits(x) + byte_bits(x >> 8) + byte_bits(x >> 16) +
+         byte_bits(x >> 24);
+}
+
+COMPILER_RT_ABI int __popcountdi2(di_int a) {
+  dwords x;
+  x.all = a;
+  return word_bits(x.s.low) + word_bits(x.s.high);
+}
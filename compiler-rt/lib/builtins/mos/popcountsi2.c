@@ -0,0 +1,30 @@
+//===-- mos/popcountsi2.c - Count set bits of a 32-bit integer ----*- C -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements __popcountsi2 by looking up the bits of each nibble in
+// a table. The generic version's bit tricks need shifts by amounts that
+// aren't multiples of 8 and a multiply, all slow on the 6502, while indexed
+// loads are fast.
+//
+//===----------------------------------------------------------------------===//
+
+#include "../int_lib.h"
+
+// The number of set bits in each 4-bit value.
+static const unsigned char nibble_bits[16] = {0, 1, 1, 2, 1, 2, 2, 3,
+                                              1, 2, 2, 3, 2, 3, 3, 4};
+
+static unsigned char byte_bits(unsigned char b) {
+  return nibble_bits[b & 15] + nibble_bits[b >> 4];
+}
+
+COMPILER_RT_ABI int __popcountsi2(si_int a) {
+  su_int x = (su_int)a;
+  return byte_bits(x) + byte_bits(x >> 8) + byte_bits(x >> 16) +
+         byte_bits(x >> 24);
+}
@@ -0,0 +1,74 @@
+// REQUIRES: target-is-mos
+// RUN: %clang_builtins %s %librt -o %t && %run %t
+
+// The MOS bit counting builtins work a byte at a time, so check them against
+// a bit at a time on every pair of set bits, which puts the lowest and
+// highest set bits in every combination of bytes.
+
+#include "int_lib.h"
+#include <stdio.h>
+
+COMPILER_RT_ABI int __clzsi2(si_int a);
+COMPILER_RT_ABI int __ctzsi2(si_int a);
+COMPILER_RT_ABI int __popcountsi2(si_int a);
+COMPILER_RT_ABI int __ffssi2(si_int a);
+COMPILER_RT_ABI int __clzdi2(di_int a);
+COMPILER_RT_ABI int __ctzdi2(di_int a);
+COMPILER_RT_ABI int __popcountdi2(di_int a);
+COMPILER_RT_ABI int __ffsdi2(di_int a);
+
+static int check(const char *name, du_int a, int x, int expected) {
+  if (x != expected)
+    printf("error in %s(0x%llX) = %d, expected %d\n", name,
+           (unsigned long long)a, x, expected);
+  return x != expected;
+}
+
+static int test_si(su_int a) {
+  int clz = 0, ctz = 0, popcount = 0;
+  while (clz < 32 && !(a & (su_int)1 << (31 - clz)))
+    ++clz;
+  while (ctz < 32 && !(a & (su_int)1 << ctz))
+    ++ctz;
+  for (int i = 0; i < 32; ++i)
+    popcount += (a >> i) & 1;
+
+  // clz and ctz are undefined for zero.
+  if (a && (check("__clzsi2", a, __clzsi2(a), clz) ||
+            check("__ctzsi2", a, __ctzsi2(a), ctz)))
+    return 1;
+  return check("__popcountsi2", a, __popcountsi2(a), popcount) ||
+         check("__ffssi2", a, __ffssi2(a), a ? ctz + 1 : 0);
+}
+
+static int test_di(du_int a) {
+  int clz = 0, ctz = 0, popcount = 0;
+  while (clz < 64 && !(a & (du_int)1 << (63 - clz)))
+    ++clz;
+  while (ctz < 64 && !(a & (du_int)1 << ctz))
+    ++ctz;
+  for (int i = 0; i < 64; ++i)
+    popcount += (a >> i) & 1;
+
+  if (a && (check("__clzdi2", a, __clzdi2(a), clz) ||
+            check("__ctzdi2", a, __ctzdi2(a), ctz)))
+    return 1;
+  return check("__popcountdi2", a, __popcountdi2(a), popcount) ||
+         check("__ffsdi2", a, __ffsdi2(a), a ? ctz + 1 : 0);
+}
+
+int main() {
+  if (test_si(0) || test_si(0xFFFFFFFF) || test_di(0) ||
+      test_di(0xFFFFFFFFFFFFFFFFULL))
+    return 1;
+  for (int i = 0; i < 64; ++i) {
+    for (int j = 0; j <= i; ++j) {
+      du_int a = (du_int)1 << i | (du_int)1 << j;
+      if (test_di(a) || test_di(~a))
+        return 1;
+      if (i < 32 && (test_si(a) || test_si(~(su_int)a)))
+        return 1;
+    }
+  }
+  return 0;
+}
@@ -7,13 +7,23 @@
 //===----------------------------------------------------------------------===//
 
 #include "InputFiles.h"
+#include "LinkerScript.h"
+#include "OutputSections.h"
+#include "SymbolTable.h"
 #include "Symbols.h"
+#include "SyntheticSections.h"
 #include "Target.h"
+#include "Thunks.h"
 #include "lld/Common/ErrorHandler.h"
+#include "llvm/ADT/MapVector.h"
+#include "llvm/ADT/StringExtras.h"
 #include "llvm/BinaryFormat/ELF.h"
 #include "llvm/BinaryFormat/MOSFlags.h"
 #include "llvm/Object/ELF.h"
 #include "llvm/Support/Endian.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Parallel.h"
+#include "llvm/Support/TimeProfiler.h"
 
 using namespace llvm;
 using namespace llvm::object;
@@ -32,6 +42,9 @@ public:
                      const uint8_t *loc) const override;
   void relocate(uint8_t *loc, const Relocation &rel,
                 uint64_t val) const override;
+  void relocateAlloc(InputSection &sec, uint8_t *buf) const override;
+  bool relaxOnce(int pass) const override;
+  void finalizeRelax(int passes) const override;
 };
 } // namespace
 
@@ -72,6 +85,9 @@ RelExpr MOS::getRelExpr(RelType type, const Symbol &s,
   case R_MOS_PCREL_8:
   case R_MOS_PCREL_16:
     return R_PC;
+  case R_MOS_RELAX_ZP:
+  case R_MOS_RELAX_BRANCH:
+    return ctx.arg.relax ? R_RELAX_HINT : R_NONE;
   }
 }
 
@@ -159,6 +175,637 @@ void MOS::relocate(uint8_t *loc, const Relocation &rel, uint64_t val) const {
   }
 }
 
+// Returns the base page output section, .bp.<page>, that sym lies in, if any.
+// The 65CE02's B register selects the page that zero page addressing reaches,
+// so code running on the page refers to its contents by their offsets.
+static const OutputSection *getBasePage(const Symbol &sym) {
+  const auto *d = dyn_cast<Defined>(&sym);
+  if (!d || !d->section)
+    return nullptr;
+  const OutputSection *os = d->section->getOutputSection();
+  if (!os || !os->name.starts_with(".bp.") || os->name.size() <= 4)
+    return nullptr;
+  return os;
+}
+
+// Asset sections can carry hundreds of thousands of relocations, and
+// OutputSection::writeTo writes each input section in a single task. Apply the
+// relocations of such sections in shards instead; see mosRelocShardSize. Each
+// relocation writes only the bytes at its own offset, and relocate keeps no
+// state between relocations, so the shards are independent.
+void MOS::relocateAlloc(InputSection &sec, uint8_t *buf) const {
+  const uint64_t secAddr = sec.getOutputSection()->addr + sec.outSecOff;
+  const ArrayRef<Relocation> relocs = sec.relocs();
+  auto apply = [&](size_t begin, size_t end) {
+    for (const Relocation &rel : relocs.slice(begin, end - begin)) {
+      if (rel.expr == R_RELAX_HINT)
+        continue;
+      uint8_t *loc = buf + rel.offset;
+      uint64_t val = SignExtend64<32>(
+          sec.getRelocTargetVA(ctx, rel, secAddr + rel.offset));
+      // Zero page references to a base page are offsets within it.
+      if (rel.type == R_MOS_ADDR8)
+        if (const OutputSection *page = getBasePage(*rel.sym))
+          val -= page->addr;
+      relocate(loc, rel, val);
+    }
+  };
+
+  if (relocs.size() < mosRelocShardSize) {
+    apply(0, relocs.size());
+    return;
+  }
+  const size_t numShards = divideCeil(relocs.size(), mosRelocShardSize);
+  parallelFor(0, numShards, [&](size_t i) {
+    apply(i * mosRelocShardSize,
+          std::min((i + 1) * mosRelocShardSize, relocs.size()));
+  });
+}
+
+// Returns whether the absolute opcode, which has a zero page form, is indexed
+// by X or Y. These lie in the odd rows of the opcode matrix; the only unindexed
+// ones there are TRB and STZ absolute.
+static bool isIndexedAbsolute(uint8_t opcode) {
+  if (opcode == 0x8b) // 65CE02 STY abs,X
+    return true;
+  if (!(opcode & 0x10))
+    return false;
+  switch (opcode & 0x0f) {
+  case 0x9:
+  case 0xb:
+  case 0xd:
+  case 0xe:
+    return true;
+  case 0xc:
+    return opcode != 0x1c && opcode != 0x9c;
+  default:
+    return false;
+  }
+}
+
+// Relax the instruction marked by the R_MOS_RELAX_ZP or R_MOS_RELAX_BRANCH at
+// relocs[i], which is at loc, to its short form if its operand now fits.
+static void relaxShort(Ctx &ctx, const InputSection &sec, size_t i,
+                       uint64_t loc, bool allowNew) {
+  const ArrayRef<Relocation> relocs = sec.relocs();
+  auto &aux = *sec.relaxAux;
+  if (i + 1 == relocs.size())
+    return;
+  const Relocation &r = relocs[i];
+  const Relocation &op = relocs[i + 1];
+  if (op.offset != r.offset + 1)
+    return;
+  // Shrinking code can move a target out of range of an instruction already
+  // relaxed, so that it must grow again. To converge, stop relaxing more
+  // instructions after a few passes. relocDeltas still holds the last pass's
+  // values here.
+  if (!allowNew && aux.relocDeltas[i + 1] == aux.relocDeltas[i])
+    return;
+
+  RelType newType;
+  switch (r.type) {
+  case R_MOS_RELAX_ZP: {
+    if (op.type != R_MOS_ADDR16 || op.expr != R_ABS)
+      return;
+    // The HuC6280's zero page is at 0x2000.
+    const uint64_t zpBase =
+        (ctx.arg.eflags & EF_MOS_ARCH_HUC6280) ? 0x2000 : 0;
+    if (op.sym->getVA(ctx, op.addend) - zpBase >= 0x100)
+      return;
+    // An indexed zero page access wraps around within the zero page, so the
+    // whole object it indexes into must lie there. Without a size, its extent
+    // is unknown.
+    if (isIndexedAbsolute(sec.content()[r.offset])) {
+      const uint64_t size = op.sym->getSize();
+      if (!size || op.sym->getVA(ctx) - zpBase + size > 0x100)
+        return;
+    }
+    newType = R_MOS_ADDR8;
+    break;
+  }
+  case R_MOS_RELAX_BRANCH: {
+    if (!(op.type == R_MOS_ADDR16 && op.expr == R_ABS) &&
+        !(op.type == R_MOS_PCREL_16 && op.expr == R_PC))
+      return;
+    // A short branch is relative to the end of its two bytes.
+    const int64_t displace = op.sym->getVA(ctx, op.addend) - (loc + 2);
+    if (!isInt<8>(displace))
+      return;
+    newType = R_MOS_PCREL_8;
+    break;
+  }
+  default:
+    llvm_unreachable("not a relaxation marker");
+  }
+
+  aux.relocTypes[i] = r.type;
+  aux.relocTypes[i + 1] = newType;
+  aux.writes.push_back(r.addend & 0xff);
+}
+
+static bool relax(Ctx &ctx, int pass, InputSection &sec) {
+  const uint64_t secAddr = sec.getVA();
+  const MutableArrayRef<Relocation> relocs = sec.relocs();
+  auto &aux = *sec.relaxAux;
+  bool changed = false;
+  ArrayRef<SymbolAnchor> sa = ArrayRef(aux.anchors);
+  uint64_t delta = 0;
+
+  std::fill_n(aux.relocTypes.get(), relocs.size(), R_MOS_NONE);
+  aux.writes.clear();
+  for (auto [i, r] : llvm::enumerate(relocs)) {
+    const uint64_t loc = secAddr + r.offset - delta;
+    uint32_t &cur = aux.relocDeltas[i], remove = 0;
+    switch (r.type) {
+    case R_MOS_RELAX_ZP:
+    case R_MOS_RELAX_BRANCH:
+      if (r.expr == R_RELAX_HINT)
+        relaxShort(ctx, sec, i, loc, pass < 4);
+      break;
+    case R_MOS_ADDR16:
+    case R_MOS_PCREL_16:
+      // Delete the high byte of a relaxed operand.
+      if (aux.relocTypes[i] != R_MOS_NONE)
+        remove = 1;
+      break;
+    }
+
+    // For all anchors whose offsets are <= r.offset, they are preceded by
+    // the previous relocation whose `relocDeltas` value equals `delta`.
+    // Decrease their st_value and update their st_size.
+    for (; sa.size() && sa[0].offset <= r.offset; sa = sa.slice(1)) {
+      if (sa[0].end)
+        sa[0].d->size = sa[0].offset - delta - sa[0].d->value;
+      else
+        sa[0].d->value = sa[0].offset - delta;
+    }
+    delta += remove;
+    if (delta != cur) {
+      cur = delta;
+      changed = true;
+    }
+  }
+
+  for (const SymbolAnchor &a : sa) {
+    if (a.end)
+      a.d->size = a.offset - delta - a.d->value;
+    else
+      a.d->value = a.offset - delta;
+  }
+  // Inform assignAddresses that the size has changed.
+  if (!isUInt<32>(delta))
+    Err(ctx) << "section size decrease is too large: " << delta;
+  sec.bytesDropped = delta;
+  return changed;
+}
+
+// The assembler marks absolute addressing modes that have a zero page form
+// with R_MOS_RELAX_ZP, and jumps and long branches that have a short branch
+// form with R_MOS_RELAX_BRANCH. Once addresses are assigned, those whose
+// operands fit are shrunk by a byte, which moves everything after them. This
+// can in turn move other targets into or out of range, so iterate until
+// nothing changes.
+bool MOS::relaxOnce(int pass) const {
+  llvm::TimeTraceScope timeScope("MOS relaxOnce");
+  if (pass == 0)
+    initSymbolAnchors(ctx);
+
+  SmallVector<InputSection *, 0> storage;
+  bool changed = false;
+  for (OutputSection *osec : ctx.outputSections) {
+    // Compressed sections are SHT_NOBITS by now. Their contents are
+    // compressed as they stand each pass, so leave them unrelaxed.
+    if (!(osec->flags & SHF_EXECINSTR) || osec->type == SHT_NOBITS)
+      continue;
+    for (InputSection *sec : getInputSections(*osec, storage)) {
+      // Deleting bytes would misalign whatever the assembler padded to an
+      // alignment within the section, such as page-aligned loops and tables.
+      // Only sections with such content need alignment beyond a byte.
+      if (sec->addralign > 1)
+        continue;
+      changed |= relax(ctx, pass, *sec);
+    }
+  }
+  return changed;
+}
+
+void MOS::finalizeRelax(int passes) const {
+  llvm::TimeTraceScope timeScope("Finalize MOS relaxation");
+  Log(ctx) << "relaxation passes: " << passes;
+  SmallVector<InputSection *, 0> storage;
+  for (OutputSection *osec : ctx.outputSections) {
+    if (!(osec->flags & SHF_EXECINSTR))
+      continue;
+    for (InputSection *sec : getInputSections(*osec, storage)) {
+      RelaxAux &aux = *sec->relaxAux;
+      if (!aux.relocDeltas)
+        continue;
+
+      MutableArrayRef<Relocation> rels = sec->relocs();
+      ArrayRef<uint8_t> old = sec->content();
+      size_t newSize = old.size() - aux.relocDeltas[rels.size() - 1];
+      if (newSize == old.size())
+        continue;
+      size_t writesIdx = 0;
+      uint8_t *p = ctx.bAlloc.Allocate<uint8_t>(newSize);
+      uint64_t offset = 0;
+      int64_t delta = 0;
+      sec->content_ = p;
+      sec->size = newSize;
+      sec->bytesDropped = 0;
+
+      // Rewrite the opcodes of relaxed instructions and delete the high bytes
+      // of their operands.
+      for (size_t i = 0, e = rels.size(); i != e; ++i) {
+        uint32_t remove = aux.relocDeltas[i] - delta;
+        delta = aux.relocDeltas[i];
+        if (remove == 0 && aux.relocTypes[i] == R_MOS_NONE)
+          continue;
+
+        // Copy from last location to the current relocated location.
+        const Relocation &r = rels[i];
+        uint64_t size = r.offset - offset;
+        memcpy(p, old.data() + offset, size);
+        p += size;
+
+        switch (aux.relocTypes[i]) {
+        case R_MOS_RELAX_ZP:
+        case R_MOS_RELAX_BRANCH:
+          *p = aux.writes[writesIdx++];
+          break;
+        case R_MOS_ADDR8:
+        case R_MOS_PCREL_8:
+          *p = old[r.offset];
+          break;
+        default:
+          llvm_unreachable("unsupported type");
+        }
+
+        p += 1;
+        offset = r.offset + 1 + remove;
+      }
+      memcpy(p, old.data() + offset, old.size() - offset);
+
+      // Subtract the previous relocDeltas value from the relocation offset.
+      delta = 0;
+      for (size_t i = 0, e = rels.size(); i != e; ++i) {
+        rels[i].offset -= delta;
+        if (aux.relocTypes[i] != R_MOS_NONE)
+          rels[i].type = aux.relocTypes[i];
+        // Jumps relaxed to branches become PC-relative.
+        if (rels[i].type == R_MOS_PCREL_8)
+          rels[i].expr = R_PC;
+        delta = aux.relocDeltas[i];
+      }
+    }
+  }
+}
+
+static bool isSplitTable(const InputSection &sec) {
+  return sec.name == ".split_table" || sec.name.starts_with(".split_table.");
+}
+
+// Split one table of 16-bit entries; see splitMOSAddressTables.
+static void splitTable(Ctx &ctx, InputSection &sec) {
+  if (sec.type == SHT_NOBITS || sec.size % 2) {
+    Err(ctx) << &sec << ": split table must contain 16-bit entries";
+    return;
+  }
+  const uint64_t n = sec.size / 2;
+  ArrayRef<uint8_t> old = sec.content();
+  uint8_t *p = ctx.bAlloc.Allocate<uint8_t>(sec.size);
+  for (uint64_t i = 0; i != n; ++i) {
+    p[i] = old[2 * i];
+    p[n + i] = old[2 * i + 1];
+  }
+  sec.content_ = p;
+
+  // Byte i of the table moves here.
+  auto moved = [&](uint64_t i) { return i % 2 ? n + i / 2 : i / 2; };
+  SmallVector<Relocation, 0> rels;
+  for (const Relocation &rel : sec.relocs()) {
+    switch (rel.type) {
+    case R_MOS_ADDR16:
+      if (rel.offset % 2 == 0) {
+        rels.push_back({rel.expr, R_MOS_ADDR16_LO, moved(rel.offset),
+                        rel.addend, rel.sym});
+        rels.push_back({rel.expr, R_MOS_ADDR16_HI, moved(rel.offset + 1),
+                        rel.addend, rel.sym});
+        continue;
+      }
+      break;
+    case R_MOS_NONE:
+    case R_MOS_IMM8:
+    case R_MOS_ADDR8:
+    case R_MOS_ADDR16_LO:
+    case R_MOS_ADDR16_HI:
+    case R_MOS_ADDR24_SEGMENT_LO:
+    case R_MOS_ADDR24_SEGMENT_HI:
+    case R_MOS_ADDR24_BANK:
+      rels.push_back(rel);
+      rels.back().offset = moved(rel.offset);
+      continue;
+    default:
+      break;
+    }
+    Err(ctx) << &sec << ": relocation " << rel.type << " against " << rel.sym
+             << " does not fit a 16-bit split table entry";
+    return;
+  }
+  llvm::stable_sort(rels, [](const Relocation &a, const Relocation &b) {
+    return a.offset < b.offset;
+  });
+  sec.relocations = std::move(rels);
+
+  // A table indexed by X never needs more than a page per half.
+  if (n <= 256) {
+    sec.addralign = std::max<uint32_t>(sec.addralign, 256);
+    OutputSection *osec = sec.getParent();
+    osec->addralign = std::max<uint32_t>(osec->addralign, 256);
+  }
+}
+
+// Tables of addresses are usually read a byte at a time, which is much
+// cheaper when the low and high bytes are kept in separate tables: both are
+// then indexed by the entry number, instead of twice it. Sections named
+// .split_table or .split_table.* contain such a table written as ordinary
+// 16-bit entries (e.g. with .short or an array of pointers), and the linker
+// transposes them: the low bytes of the N entries come first, followed by the
+// high bytes, so entry i is read with
+//
+//   lda tbl,x
+//   ldy tbl+N,x
+//
+// Tables of up to 256 entries are page aligned, so the low table never
+// crosses a page, nor the high one when N <= 128. R_MOS_ADDR16 entries are
+// split into R_MOS_ADDR16_LO and R_MOS_ADDR16_HI; byte-sized relocations just
+// move with their byte.
+void splitMOSAddressTables(Ctx &ctx) {
+  for (InputSectionBase *s : ctx.inputSections)
+    if (auto *sec = dyn_cast<InputSection>(s))
+      if (sec->isLive() && sec->getParent() && isSplitTable(*sec))
+        splitTable(ctx, *sec);
+}
+
+// Returns the number of imaginary register bytes that a reference to name
+// reaches, if it names one: __rcN is byte N, and __rsN the pair of bytes 2N and
+// 2N+1.
+static std::optional<uint64_t> getRCBytes(StringRef name) {
+  uint64_t index;
+  if (name.consume_front("__rc") && to_integer(name, index, 10))
+    return index + 1;
+  if (name.consume_front("__rs") && to_integer(name, index, 10))
+    return 2 * index + 2;
+  return std::nullopt;
+}
+
+// The imaginary registers are a block of zero page from __rc0 up, and every
+// translation unit declares the full set it could use. Every byte of the block
+// that code actually touches is referenced by name from some object file,
+// though, whether compiled, hand-written, or from a library. __rc_count gives
+// the number of bytes up to the last one referenced anywhere in the link, so
+// that a linker script can start the zero page it gives to data right after
+// them:
+//
+//   MEMORY { zp : ORIGIN = __rc0 + __rc_count, LENGTH = ... }
+void setMOSRCCount(Ctx &ctx) {
+  uint64_t count = 0;
+  for (ELFFileBase *file : ctx.objectFiles) {
+    if (file->lazy)
+      continue;
+    // The file that defines the block, if any, doesn't use it by doing so.
+    for (Symbol *sym : file->getGlobalSymbols())
+      if (sym->file != file)
+        if (std::optional<uint64_t> bytes = getRCBytes(sym->getName()))
+          count = std::max(count, *bytes);
+  }
+  ctx.sym.mosRCCount->value = count;
+}
+
+namespace {
+struct Overlay {
+  // The number loaders know the overlay by.
+  unsigned index;
+  // Overlays in the same OVERLAY statement share a window and replace each
+  // other when loaded.
+  unsigned window;
+};
+} // namespace
+
+// Number the overlays from zero in linker script order, across all OVERLAY
+// statements.
+static MapVector<const OutputSection *, Overlay> getOverlays(Ctx &ctx) {
+  MapVector<const OutputSection *, Overlay> overlays;
+  unsigned window = 0;
+  for (SectionCommand *cmd : ctx.script->sectionCommands) {
+    auto *osd = dyn_cast<OutputDesc>(cmd);
+    if (!osd || !osd->osec.inOverlay)
+      continue;
+    if (osd->osec.firstInOverlay)
+      ++window;
+    unsigned index = overlays.size();
+    overlays.insert({&osd->osec, {index, window}});
+  }
+  return overlays;
+}
+
+static bool isOverlayStubReloc(const Relocation &rel) {
+  switch (rel.type) {
+  case R_MOS_ADDR16:
+  case R_MOS_ADDR16_LO:
+  case R_MOS_ADDR16_HI:
+    return rel.expr == R_ABS;
+  default:
+    return false;
+  }
+}
+
+// Code in an OVERLAY output section runs in a window of RAM shared with the
+// other overlays in the statement, and the disk loader brings it in on demand.
+// With --overlay-stubs, references to functions in an overlay from any other
+// output section, whether calls, jumps, or function pointers being taken, are
+// redirected to a resident stub:
+//
+//   jsr __overlay_load
+//   .byte <overlay number>
+//   jmp <function>
+//
+// __overlay_load is provided by the runtime. It loads the overlay unless it's
+// already in its window, and returns past the overlay number. It must preserve
+// A, X, Y, and the imaginary registers, since they hold the arguments of the
+// call being made.
+//
+// All stubs are placed together in the first resident executable output
+// section that refers to an overlay. This runs once sections are assigned to
+// output sections, but before addresses are, since whether a stub is needed
+// depends only on where the caller and callee are placed.
+void createMOSOverlayStubs(Ctx &ctx) {
+  MapVector<const OutputSection *, Overlay> overlays = getOverlays(ctx);
+  if (overlays.empty())
+    return;
+  if (overlays.size() > 256) {
+    ErrAlways(ctx) << "--overlay-stubs supports at most 256 overlays, found "
+                   << overlays.size();
+    return;
+  }
+
+  OutputSection *stubSec = nullptr;
+  SmallVector<Relocation *, 0> redirects;
+  SmallVector<InputSection *, 0> storage;
+  for (OutputSection *osec : ctx.outputSections) {
+    if (!(osec->flags & SHF_ALLOC))
+      continue;
+    auto from = overlays.find(osec);
+    for (InputSection *isec : getInputSections(*osec, storage)) {
+      for (Relocation &rel : isec->relocs()) {
+        if (!isOverlayStubReloc(rel))
+          continue;
+        auto *d = dyn_cast<Defined>(rel.sym);
+        if (!d || !d->section || !(d->isFunc() || d->isSection()))
+          continue;
+        const OutputSection *target = d->section->getOutputSection();
+        auto to = overlays.find(target);
+        if (to == overlays.end() || target == osec ||
+            !(target->flags & SHF_EXECINSTR))
+          continue;
+
+        if (ctx.mosOverlayCalls[{osec, target}]++ == 0 &&
+            from != overlays.end() &&
+            from->second.window == to->second.window)
+          Warn(ctx) << isec << ": reference to " << rel.sym << " in overlay "
+                    << target->name << " replaces overlay " << osec->name
+                    << ", which is needed to return to";
+        if (!stubSec && from == overlays.end() &&
+            (osec->flags & SHF_EXECINSTR))
+          stubSec = osec;
+        redirects.push_back(&rel);
+      }
+    }
+  }
+  if (redirects.empty())
+    return;
+
+  if (!stubSec)
+    for (OutputSection *osec : ctx.outputSections)
+      if ((osec->flags & SHF_ALLOC) && (osec->flags & SHF_EXECINSTR) &&
+          !overlays.count(osec)) {
+        stubSec = osec;
+        break;
+      }
+  if (!stubSec) {
+    ErrAlways(ctx) << "no resident executable output section to place "
+                      "overlay stubs in";
+    return;
+  }
+  Symbol *loader = ctx.symtab->find("__overlay_load");
+  if (!loader || !loader->isDefined()) {
+    ErrAlways(ctx) << "undefined symbol: __overlay_load\n>>> referenced by "
+                      "overlay stubs";
+    return;
+  }
+
+  auto *ts = make<ThunkSection>(ctx, stubSec, 0);
+  ts->addralign = 1;
+  DenseMap<std::pair<Symbol *, int64_t>, Thunk *> stubs;
+  for (Relocation *rel : redirects) {
+    Thunk *&t = stubs[{rel->sym, rel->addend}];
+    if (!t) {
+      const OutputSection *target =
+          cast<Defined>(rel->sym)->section->getOutputSection();
+      t = addMOSOverlayThunk(ctx, *rel->sym, rel->addend, *loader,
+                             overlays.lookup(target).index);
+      ts->addThunk(t);
+    }
+    rel->sym = t->getThunkTargetSym();
+    rel->addend = 0;
+  }
+  ts->assignOffsets();
+
+  InputSectionDescription *isd = nullptr;
+  for (SectionCommand *cmd : stubSec->commands)
+    if (auto *d = dyn_cast<InputSectionDescription>(cmd))
+      isd = d;
+  if (!isd) {
+    isd = make<InputSectionDescription>("");
+    stubSec->commands.push_back(isd);
+  }
+  isd->sections.push_back(ts);
+}
+
+// Write --print-overlays: for each overlay, its size, the resident set while
+// it is loaded (everything outside the overlays plus the overlay), and the
+// output sections that reach it through stubs.
+void writeMOSOverlayReport(Ctx &ctx) {
+  std::error_code ec;
+  raw_fd_ostream os = ctx.openAuxiliaryFile(ctx.arg.printOverlays, ec);
+  if (ec) {
+    ErrAlways(ctx) << "cannot open " << ctx.arg.printOverlays << ": "
+                   << ec.message();
+    return;
+  }
+
+  MapVector<const OutputSection *, Overlay> overlays = getOverlays(ctx);
+  uint64_t resident = 0;
+  for (OutputSection *osec : ctx.outputSections)
+    if ((osec->flags & SHF_ALLOC) && !overlays.count(osec))
+      resident += osec->size;
+
+  os << "resident: " << resident << " bytes\n";
+  for (auto &[osec, ov] : overlays) {
+    os << "overlay " << ov.index << " " << osec->name << " (window "
+       << ov.window << "): " << osec->size << " bytes at 0x"
+       << utohexstr(osec->addr) << ", resident set " << resident + osec->size
+       << " bytes\n";
+    for (auto &[edge, count] : ctx.mosOverlayCalls)
+      if (edge.second == osec)
+        os << "  referenced " << count << " times from " << edge.first->name
+           << "\n";
+  }
+}
+
+// Store the output sections matched by --compress-load-sections compressed in
+// .compressed instead of in place; see MOSCompressedSection.
+void compressMOSSections(Ctx &ctx) {
+  MOSCompressedSection &sec = *ctx.in.mosCompressed;
+  for (OutputSection *osec : ctx.outputSections) {
+    if (llvm::none_of(ctx.arg.compressLoadSections,
+                      [&](const GlobPattern &pat) {
+                        return pat.match(osec->name);
+                      }))
+      continue;
+    if (!(osec->flags & SHF_ALLOC) || osec->type == SHT_NOBITS ||
+        osec == sec.getParent()) {
+      Err(ctx) << "--compress-load-sections: section '" << osec->name
+               << "' cannot be compressed";
+      continue;
+    }
+    osec->type = SHT_NOBITS;
+    sec.sections.push_back(osec);
+  }
+  if (sec.tableEnd)
+    sec.tableEnd->value = sec.sections.size() * MOSCompressedSection::entrySize;
+}
+
+// Initialize the output sections matched by --init-table-sections from the
+// records of .init_table instead of loading them; see MOSInitTableSection.
+void buildMOSInitTable(Ctx &ctx) {
+  MOSInitTableSection &sec = *ctx.in.mosInitTable;
+  for (OutputSection *osec : ctx.outputSections) {
+    if (llvm::none_of(ctx.arg.initTableSections,
+                      [&](const GlobPattern &pat) {
+                        return pat.match(osec->name);
+                      }))
+      continue;
+    if (!(osec->flags & SHF_ALLOC) || osec == sec.getParent()) {
+      Err(ctx) << "--init-table-sections: section '" << osec->name
+               << "' cannot be initialized from .init_table";
+      continue;
+    }
+    sec.sections.push_back({osec, osec->type != SHT_NOBITS});
+    osec->type = SHT_NOBITS;
+  }
+}
+
 void setMOSTargetInfo(Ctx &ctx) { ctx.target.reset(new MOS(ctx)); }
 
 } // namespace elf
@@ -9,6 +9,7 @@
 #include "BPSectionOrderer.h"
 #include "InputFiles.h"
 #include "InputSection.h"
+#include "OutputSections.h"
 #include "SymbolTable.h"
 #include "Symbols.h"
 #include "lld/Common/BPSectionOrdererBase.inc"
@@ -71,6 +72,21 @@ DenseMap<const InputSectionBase *, int> elf::runBalancedPartitioning(
   DenseMap<CachedHashStringRef, std::set<unsigned>> rootSymbolToSectionIdxs;
   BPOrdererELF orderer;
 
+  // MOS compresses whole output sections with --compress-load-sections, so the
+  // order within the rest doesn't affect the compressed size. Each compressed
+  // section is also decompressed on its own, so similar sections only help
+  // when placed in the same one, which sorting within output sections
+  // already guarantees.
+  auto isCompressed = [&](const InputSection &sec) {
+    if (ctx.arg.emachine != ELF::EM_MOS || ctx.arg.compressLoadSections.empty())
+      return true;
+    const OutputSection *osec = sec.getParent();
+    return osec && llvm::any_of(ctx.arg.compressLoadSections,
+                                [&](const GlobPattern &pat) {
+                                  return pat.match(osec->name);
+                                });
+  };
+
   auto addSection = [&](Symbol &sym) {
     auto *d = dyn_cast<Defined>(&sym);
     if (!d)
@@ -80,7 +96,7 @@ DenseMap<const InputSectionBase *, int> elf::runBalancedPartitioning(
     // Skipping ICF folded sections reduces duplicate detection work in
     // BPSectionOrderer.
     if (sym.isSection() || !sec || sec->size == 0 || !sec->isLive() ||
-        sec->repl != sec || !sec->content().data() ||
+        sec->repl != sec || !sec->content().data() || !isCompressed(*sec) ||
         !orderer.secToSym.try_emplace(sec, d).second)
       return;
     rootSymbolToSectionIdxs[CachedHashStringRef(
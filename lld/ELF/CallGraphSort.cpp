@@ -21,18 +21,29 @@
 /// - a more advanced one, referred to as Cache-Directed-Sort (CDSort), which
 ///   typically produces layouts with higher locality, and hence, yields fewer
 ///   instruction cache misses on large binaries.
+///
+/// For targets with switchable ROM banks, like MOS cartridge mappers, what
+/// matters instead is that callers and callees end up in the same bank, so
+/// that no bank switch is needed for the call. The "bank" variant of C^3 never
+/// grows a cluster beyond the memory region of its output section, so each
+/// cluster fits into a single bank, and --print-cross-bank-calls reports the
+/// calls that still cross into a switchable bank after layout.
 //===----------------------------------------------------------------------===//
 
 #include "CallGraphSort.h"
 #include "InputFiles.h"
 #include "InputSection.h"
+#include "LinkerScript.h"
+#include "OutputSections.h"
 #include "Symbols.h"
+#include "llvm/ADT/DenseSet.h"
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Transforms/Utils/CodeLayout.h"
 
 #include <numeric>
 
 using namespace llvm;
+using namespace llvm::ELF;
 using namespace lld;
 using namespace lld::elf;
 
@@ -93,9 +104,12 @@ public:
   DenseMap<const InputSectionBase *, int> run();
 
 private:
+  uint64_t getMaxClusterSize(const InputSectionBase *isec);
+
   Ctx &ctx;
   std::vector<Cluster> clusters;
   std::vector<const InputSectionBase *> sections;
+  DenseMap<const OutputSection *, uint64_t> bankSizes;
 };
 
 // Maximum amount the combined cluster density can be worse than the original
@@ -159,6 +173,22 @@ CallGraphSort::CallGraphSort(Ctx &ctx) : ctx(ctx) {
     c.initialWeight = c.weight;
 }
 
+// With --call-graph-profile-sort=bank, a cluster may grow only as large as the
+// memory region its output section is placed in, since that is the size of
+// the bank it will be laid out in.
+uint64_t CallGraphSort::getMaxClusterSize(const InputSectionBase *isec) {
+  if (ctx.arg.callGraphProfileSort != CGProfileSortKind::Bank)
+    return MAX_CLUSTER_SIZE;
+  const OutputSection *osec = isec->getOutputSection();
+  auto [it, inserted] = bankSizes.try_emplace(osec, MAX_CLUSTER_SIZE);
+  if (inserted && osec && !osec->memoryRegionName.empty())
+    if (MemoryRegion *mr =
+            ctx.script->memoryRegions.lookup(osec->memoryRegionName))
+      if (uint64_t length = mr->getLength())
+        it->second = std::min(length, MAX_CLUSTER_SIZE);
+  return it->second;
+}
+
 // It's bad to merge clusters which would degrade the density too much.
 static bool isNewDensityBad(Cluster &a, Cluster &b) {
   double newDensity = double(a.weight + b.weight) / double(a.size + b.size);
@@ -215,7 +245,7 @@ DenseMap<const InputSectionBase *, int> CallGraphSort::run() {
       continue;
 
     Cluster *predC = &clusters[predL];
-    if (c.size + predC->size > MAX_CLUSTER_SIZE)
+    if (c.size + predC->size > getMaxClusterSize(sections[l]))
       continue;
 
     if (isNewDensityBad(*predC, c))
@@ -345,3 +375,65 @@ elf::computeCallGraphProfileOrder(Ctx &ctx) {
     return computeCacheDirectedSortOrder(ctx);
   return CallGraphSort(ctx).run();
 }
+
+// Returns the executable output sections that share their addresses with
+// another one. These are the switchable banks; only one of them can be mapped
+// in at a time.
+static DenseSet<const OutputSection *> getSwitchableBanks(Ctx &ctx) {
+  SmallVector<const OutputSection *, 0> code;
+  for (OutputSection *osec : ctx.outputSections)
+    if ((osec->flags & SHF_ALLOC) && (osec->flags & SHF_EXECINSTR) &&
+        osec->size)
+      code.push_back(osec);
+
+  DenseSet<const OutputSection *> banks;
+  for (size_t i = 0, e = code.size(); i != e; ++i)
+    for (size_t j = i + 1; j != e; ++j)
+      if (code[i]->addr < code[j]->addr + code[j]->size &&
+          code[j]->addr < code[i]->addr + code[i]->size) {
+        banks.insert(code[i]);
+        banks.insert(code[j]);
+      }
+  return banks;
+}
+
+CrossBankCalls elf::getCrossBankCalls(Ctx &ctx) {
+  DenseSet<const OutputSection *> banks = getSwitchableBanks(ctx);
+  CrossBankCalls calls;
+  for (std::pair<SectionPair, uint64_t> &c : ctx.arg.callGraphProfile) {
+    const InputSectionBase *from = c.first.first;
+    const InputSectionBase *to = c.first.second;
+    const OutputSection *fromOsec = from->getOutputSection();
+    const OutputSection *toOsec = to->getOutputSection();
+    if (!from->isLive() || !to->isLive() || !fromOsec || !toOsec)
+      continue;
+    calls.totalWeight += c.second;
+    if (fromOsec == toOsec || !banks.contains(toOsec))
+      continue;
+    calls.crossingWeight += c.second;
+    calls.edges.push_back({from, to, c.second});
+  }
+  llvm::stable_sort(calls.edges, [](auto &a, auto &b) {
+    return a.weight > b.weight;
+  });
+  return calls;
+}
+
+// Write getCrossBankCalls into --print-cross-bank-calls.
+void elf::writeCrossBankCallReport(Ctx &ctx) {
+  std::error_code ec;
+  raw_fd_ostream os = ctx.openAuxiliaryFile(ctx.arg.printCrossBankCalls, ec);
+  if (ec) {
+    ErrAlways(ctx) << "cannot open " << ctx.arg.printCrossBankCalls << ": "
+                   << ec.message();
+    return;
+  }
+
+  CrossBankCalls calls = getCrossBankCalls(ctx);
+  os << "cross-bank call weight: " << calls.crossingWeight << " of "
+     << calls.totalWeight << "\n";
+  for (const CrossBankCalls::Edge &e : calls.edges)
+    os << e.weight << " " << toStr(ctx, e.from) << " ("
+       << e.from->getOutputSection()->name << ") -> " << toStr(ctx, e.to)
+       << " (" << e.to->getOutputSection()->name << ")\n";
+}
@@ -10,6 +10,7 @@
 #define LLD_ELF_CALL_GRAPH_SORT_H
 
 #include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallVector.h"
 
 namespace lld::elf {
 struct Ctx;
@@ -17,6 +18,24 @@ class InputSectionBase;
 
 llvm::DenseMap<const InputSectionBase *, int>
 computeCallGraphProfileOrder(Ctx &);
+
+// The call graph profile edges whose callee ended up in a switchable bank
+// other than the caller's output section, by decreasing weight. Each such call
+// needs a bank switch (or a trampoline in a fixed bank) at run time.
+struct CrossBankCalls {
+  struct Edge {
+    const InputSectionBase *from;
+    const InputSectionBase *to;
+    uint64_t weight;
+  };
+  llvm::SmallVector<Edge, 0> edges;
+  uint64_t crossingWeight = 0;
+  // The weight of all profile edges between live sections.
+  uint64_t totalWeight = 0;
+};
+CrossBankCalls getCrossBankCalls(Ctx &);
+
+void writeCrossBankCallReport(Ctx &);
 } // namespace lld::elf
 
 #endif
@@ -67,6 +67,8 @@ class InputSection;
 class IpltSection;
 class MipsGotSection;
 class MipsRldMapSection;
+class MOSCompressedSection;
+class MOSInitTableSection;
 class PPC32Got2Section;
 class PPC64LongBranchTargetSection;
 class PltSection;
@@ -92,8 +94,8 @@ enum class BsymbolicKind { None, NonWeakFunctions, Functions, NonWeak, All };
 // For --build-id.
 enum class BuildIdKind { None, Fast, Md5, Sha1, Hexstring, Uuid };
 
-// For --call-graph-profile-sort={none,hfsort,cdsort}.
-enum class CGProfileSortKind { None, Hfsort, Cdsort };
+// For --call-graph-profile-sort={none,hfsort,cdsort,bank}.
+enum class CGProfileSortKind { None, Hfsort, Cdsort, Bank };
 
 // For --discard-{all,locals,none}.
 enum class DiscardPolicy { Default, All, Locals, None };
@@ -230,6 +232,7 @@ struct Config {
   llvm::StringRef entry;
   llvm::StringRef emulation;
   llvm::StringRef fini;
+  llvm::StringRef incrementalLayout;
   llvm::StringRef init;
   llvm::StringRef ltoAAPipeline;
   llvm::StringRef ltoCSProfileFile;
@@ -237,6 +240,7 @@ struct Config {
   llvm::StringRef ltoObjPath;
   llvm::StringRef ltoSampleProfile;
   llvm::StringRef mapFile;
+  llvm::StringRef memoryReport;
   llvm::StringRef outputFile;
   llvm::StringRef optRemarksFilename;
   std::optional<uint64_t> optRemarksHotnessThreshold = 0;
@@ -245,6 +249,8 @@ struct Config {
   llvm::StringRef optStatsFilename;
   llvm::StringRef progName;
   llvm::StringRef printArchiveStats;
+  llvm::StringRef printCrossBankCalls;
+  llvm::StringRef printOverlays;
   llvm::StringRef printSymbolOrder;
   llvm::StringRef soName;
   llvm::StringRef sysroot;
@@ -316,6 +322,8 @@ struct Config {
   llvm::SmallVector<
       std::tuple<llvm::GlobPattern, llvm::DebugCompressionType, unsigned>, 0>
       compressSections;
+  llvm::SmallVector<llvm::GlobPattern, 0> compressLoadSections;
+  llvm::SmallVector<llvm::GlobPattern, 0> initTableSections;
   bool cref;
   llvm::SmallVector<std::pair<llvm::GlobPattern, uint64_t>, 0>
       deadRelocInNonAlloc;
@@ -340,6 +348,7 @@ struct Config {
   bool gnuUnique;
   bool ignoreDataAddressEquality;
   bool ignoreFunctionAddressEquality;
+  bool initTableCompress;
   bool ltoCSProfileGenerate;
   bool ltoPGOWarnMismatch;
   bool ltoDebugPassManager;
@@ -347,6 +356,7 @@ struct Config {
   bool ltoUniqueBasicBlockSectionNames;
   bool ltoValidateAllVtablesHaveTypeInfos;
   bool ltoWholeProgramVisibility;
+  bool memoryReportJSON;
   bool mergeArmExidx;
   bool mipsN32Abi = false;
   bool mmapOutputFile;
@@ -359,6 +369,7 @@ struct Config {
   bool optEL = false;
   bool optimizeBBJumps;
   bool optRemarksWithHotness;
+  bool overlayStubs;
   bool picThunk;
   bool pie;
   llvm::StringRef printGcSections;
@@ -377,6 +388,7 @@ struct Config {
   bool singleRoRx;
   bool singleXoRx;
   bool shared;
+  bool spillBestFit;
   bool symbolic;
   bool isStatic = false;
   bool sysvHash = false;
@@ -446,6 +458,7 @@ struct Config {
   uint16_t emachine = llvm::ELF::EM_NONE;
   std::optional<uint64_t> imageBase;
   uint64_t commonPageSize;
+  uint64_t incrementalSlack;
   uint64_t maxPageSize;
   uint64_t mipsGotSize;
   uint64_t zStackSize;
@@ -592,6 +605,8 @@ struct InStruct {
   std::unique_ptr<SyntheticSection> mipsOptions;
   std::unique_ptr<SyntheticSection> mipsReginfo;
   std::unique_ptr<MipsRldMapSection> mipsRldMap;
+  std::unique_ptr<MOSCompressedSection> mosCompressed;
+  std::unique_ptr<MOSInitTableSection> mosInitTable;
   std::unique_ptr<SyntheticSection> partEnd;
   std::unique_ptr<SyntheticSection> partIndex;
   std::unique_ptr<PltSection> plt;
@@ -663,6 +678,9 @@ struct Ctx : CommonLinkerContext {
     // __global_pointer$ for RISC-V.
     Defined *riscvGlobalPointer;
 
+    // __rc_count for MOS.
+    Defined *mosRCCount;
+
     // __rel{,a}_iplt_{start,end} symbols.
     Defined *relaIpltStart;
     Defined *relaIpltEnd;
@@ -681,6 +699,11 @@ struct Ctx : CommonLinkerContext {
   SmallVector<BitcodeFile *, 0> bitcodeFiles;
   SmallVector<BitcodeFile *, 0> lazyBitcodeFiles;
   XO65Enclave *xo65Enclave = nullptr;
+  // The number of references from one output section redirected through a
+  // load stub into an overlay, by --overlay-stubs on MOS.
+  llvm::MapVector<std::pair<const OutputSection *, const OutputSection *>,
+                  unsigned>
+      mosOverlayCalls;
   SmallVector<InputSectionBase *, 0> inputSections;
   SmallVector<EhInputSection *, 0> ehInputSections;
 
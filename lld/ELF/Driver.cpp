@@ -440,6 +440,14 @@ static void checkOptions(Ctx &ctx) {
       ErrAlways(ctx) << "-z zicfiss is only supported on RISC-V targets";
   }
 
+  if (ctx.arg.emachine != EM_MOS && ctx.arg.overlayStubs)
+    ErrAlways(ctx) << "--overlay-stubs is only supported on MOS targets";
+  if (ctx.arg.emachine != EM_MOS && !ctx.arg.compressLoadSections.empty())
+    ErrAlways(ctx)
+        << "--compress-load-sections is only supported on MOS targets";
+  if (ctx.arg.emachine != EM_MOS && !ctx.arg.initTableSections.empty())
+    ErrAlways(ctx) << "--init-table-sections is only supported on MOS targets";
+
   if (ctx.arg.emachine != EM_386 && ctx.arg.emachine != EM_X86_64 &&
       ctx.arg.zCetReport != ReportPolicy::None)
     ErrAlways(ctx) << "-z cet-report only supported on X86 and X86_64";
@@ -1194,11 +1202,20 @@ static CGProfileSortKind getCGProfileSortKind(Ctx &ctx,
     return CGProfileSortKind::Hfsort;
   if (s == "cdsort")
     return CGProfileSortKind::Cdsort;
+  if (s == "bank")
+    return CGProfileSortKind::Bank;
   if (s != "none")
     ErrAlways(ctx) << "unknown --call-graph-profile-sort= value: " << s;
   return CGProfileSortKind::None;
 }
 
+static bool isMemoryReportJSON(Ctx &ctx, opt::InputArgList &args) {
+  StringRef s = args.getLastArgValue(OPT_memory_report_format, "text");
+  if (s != "text" && s != "json")
+    ErrAlways(ctx) << "unknown --memory-report-format= value: " << s;
+  return s == "json";
+}
+
 static void parseBPOrdererOptions(Ctx &ctx, opt::InputArgList &args) {
   if (auto *arg = args.getLastArg(OPT_bp_compression_sort)) {
     StringRef s = arg->getValue();
@@ -1447,6 +1464,7 @@ static void readConfigs(Ctx &ctx, opt::InputArgList &args) {
   ctx.arg.ignoreFunctionAddressEquality =
       args.hasArg(OPT_ignore_function_address_equality);
   ctx.arg.init = args.getLastArgValue(OPT_init, "_init");
+  ctx.arg.initTableCompress = args.hasArg(OPT_init_table_compress);
   ctx.arg.ld65Path = args.getLastArgValue(OPT_ld65_path);
   ctx.arg.ltoAAPipeline = args.getLastArgValue(OPT_lto_aa_pipeline);
   ctx.arg.ltoCSProfileGenerate = args.hasArg(OPT_lto_cs_profile_generate);
@@ -1513,6 +1531,7 @@ static void readConfigs(Ctx &ctx, opt::InputArgList &args) {
   ctx.arg.optRemarksWithHotness = args.hasArg(OPT_opt_remarks_with_hotness);
   ctx.arg.optRemarksFormat = args.getLastArgValue(OPT_opt_remarks_format);
   ctx.arg.optimize = args::getInteger(args, OPT_O, 1);
+  ctx.arg.overlayStubs = args.hasArg(OPT_overlay_stubs);
   ctx.arg.orphanHandling = getOrphanHandling(ctx, args);
   ctx.arg.outputFile = args.getLastArgValue(OPT_o);
   if (auto *arg = args.getLastArg(OPT_package_metadata))
@@ -1529,7 +1548,15 @@ static void readConfigs(Ctx &ctx, opt::InputArgList &args) {
       ctx.arg.printGcSections = arg->getValue();
   }
   ctx.arg.printMemoryUsage = args.hasArg(OPT_print_memory_usage);
+  ctx.arg.memoryReport = args.getLastArgValue(OPT_memory_report);
+  ctx.arg.incrementalLayout = args.getLastArgValue(OPT_incremental_layout);
+  ctx.arg.incrementalSlack =
+      args::getInteger(args, OPT_incremental_slack, 16);
+  ctx.arg.memoryReportJSON = isMemoryReportJSON(ctx, args);
   ctx.arg.printArchiveStats = args.getLastArgValue(OPT_print_archive_stats);
+  ctx.arg.printCrossBankCalls =
+      args.getLastArgValue(OPT_print_cross_bank_calls);
+  ctx.arg.printOverlays = args.getLastArgValue(OPT_print_overlays);
   ctx.arg.printSymbolOrder = args.getLastArgValue(OPT_print_symbol_order);
   ctx.arg.rejectMismatch = !args.hasArg(OPT_no_warn_mismatch);
   ctx.arg.relax = args.hasFlag(OPT_relax, OPT_no_relax, true);
@@ -1562,6 +1589,7 @@ static void readConfigs(Ctx &ctx, opt::InputArgList &args) {
   ctx.arg.singleXoRx = !args.hasFlag(OPT_xosegment, OPT_no_xosegment, false);
   ctx.arg.soName = args.getLastArgValue(OPT_soname);
   ctx.arg.sortSection = getSortSection(ctx, args);
+  ctx.arg.spillBestFit = args.hasArg(OPT_spill_best_fit);
   ctx.arg.splitStackAdjustSize =
       args::getInteger(args, OPT_split_stack_adjust_size, 16384);
   ctx.arg.zSectionHeader =
@@ -1608,6 +1636,9 @@ static void readConfigs(Ctx &ctx, opt::InputArgList &args) {
       args::getInteger(args, OPT_time_trace_granularity, 500);
   ctx.arg.trace = args.hasArg(OPT_trace);
   ctx.arg.undefined = args::getStrings(args, OPT_undefined);
+  // Overlay stubs call into the runtime's loader.
+  if (ctx.arg.overlayStubs)
+    ctx.arg.undefined.push_back("__overlay_load");
   ctx.arg.undefinedVersion =
       args.hasFlag(OPT_undefined_version, OPT_no_undefined_version, false);
   ctx.arg.unique = args.hasArg(OPT_unique);
@@ -1777,6 +1808,27 @@ static void readConfigs(Ctx &ctx, opt::InputArgList &args) {
     }
   }
 
+  for (opt::Arg *arg : args.filtered(OPT_compress_load_sections)) {
+    if (Expected<GlobPattern> pat = GlobPattern::create(arg->getValue()))
+      ctx.arg.compressLoadSections.push_back(std::move(*pat));
+    else
+      ErrAlways(ctx) << arg->getSpelling() << ": " << pat.takeError();
+  }
+  // Compressed sections are ordered for compression unless asked otherwise.
+  if (!ctx.arg.compressLoadSections.empty() &&
+      !args.hasArg(OPT_bp_compression_sort) &&
+      !args.hasArg(OPT_call_graph_ordering_file)) {
+    ctx.arg.bpFunctionOrderForCompression = true;
+    ctx.arg.bpDataOrderForCompression = true;
+  }
+
+  for (opt::Arg *arg : args.filtered(OPT_init_table_sections)) {
+    if (Expected<GlobPattern> pat = GlobPattern::create(arg->getValue()))
+      ctx.arg.initTableSections.push_back(std::move(*pat));
+    else
+      ErrAlways(ctx) << arg->getSpelling() << ": " << pat.takeError();
+  }
+
   for (opt::Arg *arg : args.filtered(OPT_z)) {
     std::pair<StringRef, StringRef> option =
         StringRef(arg->getValue()).split('=');
@@ -3359,6 +3411,9 @@ template <class ELFT> void LinkerDriver::link(opt::InputArgList &args) {
   // Replace common symbols with regular symbols.
   replaceCommonSymbols(ctx);
 
+  if (ctx.sym.mosRCCount)
+    setMOSRCCount(ctx);
+
   {
     llvm::TimeTraceScope timeScope("Aggregate sections");
     // Now that we have a complete list of input files.
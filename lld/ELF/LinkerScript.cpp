@@ -1577,6 +1577,130 @@ static bool hasRegionOverflowed(MemoryRegion *mr) {
   return mr->curPos - mr->getOrigin() > mr->getLength();
 }
 
+// Returns whether moving a section of osec to spill could relieve the
+// overflow of osec's memory regions.
+static bool canSpillHelp(OutputSection *osec, PotentialSpillSection *spill) {
+  // Spills to the same region that overflowed cannot help.
+  if (hasRegionOverflowed(osec->memRegion) &&
+      spill->getParent()->memRegion == osec->memRegion)
+    return false;
+  if (hasRegionOverflowed(osec->lmaRegion) &&
+      spill->getParent()->lmaRegion == osec->lmaRegion)
+    return false;
+  return true;
+}
+
+// Replace the spill location with the spilled section and adjust its
+// properties to match the new location. Note that the alignment of the spill
+// section may have diverged from the original due to e.g. a SUBALIGN. Correct
+// assignment requires the spill's alignment to be used, not the original.
+static void moveToSpill(InputSection *isec, PotentialSpillSection *spill,
+                        OutputSection *osec) {
+  *llvm::find(spill->isd->sections, spill) = isec;
+  isec->parent = spill->parent;
+  isec->addralign = spill->addralign;
+
+  // Record the (potential) reduction in the region's end position.
+  osec->memRegion->curPos -= isec->getSize();
+  if (osec->lmaRegion)
+    osec->lmaRegion->curPos -= isec->getSize();
+}
+
+// Returns the space left in a memory region as of the last address
+// assignment, or the maximum if there is no region to constrain.
+static uint64_t getRegionFreeSpace(MemoryRegion *mr) {
+  if (!mr)
+    return std::numeric_limits<uint64_t>::max();
+  uint64_t used = mr->curPos - mr->getOrigin();
+  return used >= mr->getLength() ? 0 : mr->getLength() - used;
+}
+
+// Spill the largest spillable input sections of an overflowing output section
+// first, each to the spill location whose memory regions have the least space
+// left that still fits it. This is best-fit-decreasing bin packing across the
+// regions, which keeps the large holes for the large sections, where spilling
+// in reverse order of address assignment would fill them with whatever came
+// last.
+bool LinkerScript::spillSectionsBestFit(
+    OutputSection *osec, DenseSet<PotentialSpillSection *> &skippedSpills) {
+  SmallVector<std::pair<InputSection *, InputSectionDescription *>, 0>
+      candidates;
+  for (SectionCommand *cmd : osec->commands)
+    if (auto *isd = dyn_cast<InputSectionDescription>(cmd))
+      for (InputSection *isec : isd->sections)
+        if (!isa<PotentialSpillSection>(isec) &&
+            potentialSpillLists.contains(isec))
+          candidates.emplace_back(isec, isd);
+  // Among sections of the same size, spill the last assigned first, as the
+  // ordered policy would. Scripts can then sort the sections to keep the most
+  // valuable ones in place, like the MOS zero page candidates.
+  std::reverse(candidates.begin(), candidates.end());
+  llvm::stable_sort(candidates, [](const auto &a, const auto &b) {
+    return a.first->getSize() > b.first->getSize();
+  });
+
+  DenseMap<InputSectionDescription *, DenseSet<InputSection *>>
+      spilledInputSections;
+  for (auto [isec, isd] : candidates) {
+    if (!hasRegionOverflowed(osec->memRegion) &&
+        !hasRegionOverflowed(osec->lmaRegion))
+      break;
+
+    // Pick the tightest fit. If nothing fits as of the last assignment, fall
+    // back to the first location that might help, as the ordered policy
+    // would; the next round of assignment will tell.
+    PotentialSpillList &list = potentialSpillLists.find(isec)->second;
+    PotentialSpillSection *best = nullptr;
+    PotentialSpillSection *first = nullptr;
+    uint64_t bestFree = 0;
+    for (PotentialSpillSection *spill = list.head; spill;
+         spill = spill->next) {
+      if (!canSpillHelp(osec, spill))
+        continue;
+      if (!first)
+        first = spill;
+      OutputSection *to = spill->getParent();
+      uint64_t free = std::min(getRegionFreeSpace(to->memRegion),
+                               getRegionFreeSpace(to->lmaRegion));
+      if (free >= isec->getSize() && (!best || free < bestFree)) {
+        best = spill;
+        bestFree = free;
+      }
+    }
+    if (!best)
+      best = first;
+    if (!best)
+      continue;
+
+    // Spills only ever move later in the list, so the locations passed over
+    // are no longer needed.
+    for (PotentialSpillSection *spill = list.head; spill != best;
+         spill = spill->next)
+      skippedSpills.insert(spill);
+    if (best->next)
+      list.head = best->next;
+    else
+      potentialSpillLists.erase(isec);
+
+    spilledInputSections[isd].insert(isec);
+    moveToSpill(isec, best, osec);
+    // Account for the section in its new region, so that the sections after
+    // it see the space it takes.
+    OutputSection *to = best->getParent();
+    if (to->memRegion)
+      to->memRegion->curPos += isec->getSize();
+    if (to->lmaRegion)
+      to->lmaRegion->curPos += isec->getSize();
+  }
+
+  // Remove the spilled input sections to complete their move.
+  for (auto &[isd, spilled] : spilledInputSections)
+    llvm::erase_if(isd->sections, [&](InputSection *isec) {
+      return spilled.contains(isec);
+    });
+  return !spilledInputSections.empty();
+}
+
 // Spill input sections in reverse order of address assignment to (potentially)
 // bring memory regions out of overflow. The size savings of a spill can only be
 // estimated, since general linker script arithmetic may occur afterwards.
@@ -1597,6 +1721,13 @@ bool LinkerScript::spillSections() {
     if (!osec->memRegion)
       continue;
 
+    if (ctx.arg.spillBestFit) {
+      if (hasRegionOverflowed(osec->memRegion) ||
+          hasRegionOverflowed(osec->lmaRegion))
+        spilled |= spillSectionsBestFit(osec, skippedSpills);
+      continue;
+    }
+
     // Input sections that have replaced a potential spill and should be removed
     // from their input section description.
     DenseSet<InputSection *> spilledInputSections;
@@ -1619,16 +1750,6 @@ bool LinkerScript::spillSections() {
           break;
 
         // Consume spills until finding one that might help, then consume it.
-        auto canSpillHelp = [&](PotentialSpillSection *spill) {
-          // Spills to the same region that overflowed cannot help.
-          if (hasRegionOverflowed(osec->memRegion) &&
-              spill->getParent()->memRegion == osec->memRegion)
-            return false;
-          if (hasRegionOverflowed(osec->lmaRegion) &&
-              spill->getParent()->lmaRegion == osec->lmaRegion)
-            return false;
-          return true;
-        };
         PotentialSpillList &list = it->second;
         PotentialSpillSection *spill;
         for (spill = list.head; spill; spill = spill->next) {
@@ -1636,27 +1757,15 @@ bool LinkerScript::spillSections() {
             list.head = spill->next;
           else
             potentialSpillLists.erase(isec);
-          if (canSpillHelp(spill))
+          if (canSpillHelp(osec, spill))
             break;
           skippedSpills.insert(spill);
         }
         if (!spill)
           continue;
 
-        // Replace the next spill location with the spilled section and adjust
-        // its properties to match the new location. Note that the alignment of
-        // the spill section may have diverged from the original due to e.g. a
-        // SUBALIGN. Correct assignment requires the spill's alignment to be
-        // used, not the original.
         spilledInputSections.insert(isec);
-        *llvm::find(spill->isd->sections, spill) = isec;
-        isec->parent = spill->parent;
-        isec->addralign = spill->addralign;
-
-        // Record the (potential) reduction in the region's end position.
-        osec->memRegion->curPos -= isec->getSize();
-        if (osec->lmaRegion)
-          osec->lmaRegion->curPos -= isec->getSize();
+        moveToSpill(isec, spill, osec);
 
         // Spilling continues until the end position no longer overflows the
         // region. Then, another round of address assignment will either confirm
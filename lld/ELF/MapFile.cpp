@@ -16,9 +16,13 @@
 //   0020100e 00000000     0                 local
 //   00201005 00000000     0                 f(int)
 //
+// It also implements --memory-report, a summary of memory use aimed at small
+// targets like MOS.
+//
 //===----------------------------------------------------------------------===//
 
 #include "MapFile.h"
+#include "CallGraphSort.h"
 #include "InputFiles.h"
 #include "LinkerScript.h"
 #include "OutputSections.h"
@@ -27,11 +31,13 @@
 #include "llvm/ADT/MapVector.h"
 #include "llvm/ADT/SetVector.h"
 #include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/Support/JSON.h"
 #include "llvm/Support/Parallel.h"
 #include "llvm/Support/TimeProfiler.h"
 #include "llvm/Support/raw_ostream.h"
 
 using namespace llvm;
+using namespace llvm::ELF;
 using namespace llvm::object;
 using namespace lld;
 using namespace lld::elf;
@@ -278,3 +284,175 @@ void elf::writeMapAndCref(Ctx &ctx) {
   if (ctx.arg.cref)
     writeCref(ctx, os);
 }
+
+namespace {
+struct ReportSymbol {
+  std::string name;
+  uint64_t addr;
+  uint64_t size;
+};
+
+struct SectionWeight {
+  std::string name;
+  uint64_t weight;
+};
+} // namespace
+
+// Whether d is a zero page variable on MOS: data whose 16-bit address falls in
+// the zero page.
+static bool isZeroPageSymbol(Ctx &ctx, Defined *d) {
+  const OutputSection *osec = d->getOutputSection();
+  if (!osec || !(osec->flags & SHF_ALLOC) || (osec->flags & SHF_EXECINSTR))
+    return false;
+  // The HuC6280's zero page is at 0x2000.
+  uint64_t zpBase = (ctx.arg.eflags & ELF::EF_MOS_ARCH_HUC6280) ? 0x2000 : 0;
+  uint64_t addr = d->getVA(ctx) & 0xffff;
+  return addr >= zpBase && addr < zpBase + 0x100;
+}
+
+// Write --memory-report. It lists the use of each MEMORY region, the output
+// sections, the zero page variables, the static stack frame of each function
+// (the <function>_sstk symbols from MOSStaticStackAlloc), the call graph
+// profile weight of calls that cross into a switchable bank, and, given a
+// call graph profile, how often each section is called.
+//
+// The report is meant to be kept as a build artifact and diffed between
+// builds, so every list is in a stable order.
+void elf::writeMemoryReport(Ctx &ctx) {
+  llvm::TimeTraceScope timeScope("Write memory report");
+  std::error_code ec;
+  raw_fd_ostream os = ctx.openAuxiliaryFile(ctx.arg.memoryReport, ec);
+  if (ec) {
+    ErrAlways(ctx) << "cannot open " << ctx.arg.memoryReport << ": "
+                   << ec.message();
+    return;
+  }
+
+  SmallVector<ReportSymbol, 0> zeroPage, staticStacks;
+  for (Defined *d : getSymbols(ctx)) {
+    if (d->getName().ends_with("_sstk"))
+      staticStacks.push_back({std::string(d->getName().drop_back(5)),
+                              d->getVA(ctx), d->getSize()});
+    else if (isZeroPageSymbol(ctx, d))
+      zeroPage.push_back({toStr(ctx, *d), d->getVA(ctx), d->getSize()});
+  }
+  llvm::sort(zeroPage, [](const ReportSymbol &a, const ReportSymbol &b) {
+    return std::tie(a.addr, a.name) < std::tie(b.addr, b.name);
+  });
+  llvm::sort(staticStacks, [](const ReportSymbol &a, const ReportSymbol &b) {
+    return std::tie(b.size, a.name) < std::tie(a.size, b.name);
+  });
+
+  MapVector<const InputSectionBase *, uint64_t> calledWeights;
+  for (auto &[edge, weight] : ctx.arg.callGraphProfile)
+    if (edge.second->isLive())
+      calledWeights[edge.second] += weight;
+  SmallVector<SectionWeight, 0> called;
+  for (auto &[sec, weight] : calledWeights)
+    called.push_back({toStr(ctx, sec), weight});
+  llvm::sort(called, [](const SectionWeight &a, const SectionWeight &b) {
+    return std::tie(b.weight, a.name) < std::tie(a.weight, b.name);
+  });
+
+  CrossBankCalls crossBank = getCrossBankCalls(ctx);
+
+  if (ctx.arg.memoryReportJSON) {
+    json::OStream j(os, 2);
+    j.object([&] {
+      j.attributeArray("regions", [&] {
+        for (auto &pair : ctx.script->memoryRegions)
+          j.object([&, m = pair.second] {
+            j.attribute("name", m->name);
+            j.attribute("origin", m->getOrigin());
+            j.attribute("length", m->getLength());
+            j.attribute("used", m->curPos - m->getOrigin());
+          });
+      });
+      j.attributeArray("sections", [&] {
+        for (OutputSection *osec : ctx.outputSections) {
+          if (!(osec->flags & SHF_ALLOC))
+            continue;
+          j.object([&] {
+            j.attribute("name", osec->name);
+            j.attribute("vma", osec->addr);
+            j.attribute("lma", osec->getLMA());
+            j.attribute("size", osec->size);
+            j.attribute("nobits", osec->type == SHT_NOBITS);
+            if (osec->memRegion)
+              j.attribute("region", osec->memRegion->name);
+          });
+        }
+      });
+      auto symbols = [&](StringRef key, ArrayRef<ReportSymbol> syms) {
+        j.attributeArray(key, [&] {
+          for (const ReportSymbol &sym : syms)
+            j.object([&] {
+              j.attribute("name", sym.name);
+              j.attribute("addr", sym.addr);
+              j.attribute("size", sym.size);
+            });
+        });
+      };
+      symbols("zeroPage", zeroPage);
+      symbols("staticStacks", staticStacks);
+      j.attributeObject("crossBankCalls", [&] {
+        j.attribute("weight", crossBank.crossingWeight);
+        j.attribute("totalWeight", crossBank.totalWeight);
+        j.attributeArray("calls", [&] {
+          for (const CrossBankCalls::Edge &e : crossBank.edges)
+            j.object([&] {
+              j.attribute("from", toStr(ctx, e.from));
+              j.attribute("to", toStr(ctx, e.to));
+              j.attribute("weight", e.weight);
+            });
+        });
+      });
+      j.attributeArray("called", [&] {
+        for (const SectionWeight &s : called)
+          j.object([&] {
+            j.attribute("section", s.name);
+            j.attribute("weight", s.weight);
+          });
+      });
+    });
+    os << "\n";
+    return;
+  }
+
+  os << "Memory regions:\n";
+  for (auto &pair : ctx.script->memoryRegions) {
+    MemoryRegion *m = pair.second;
+    uint64_t used = m->curPos - m->getOrigin();
+    os << format("  %-16s origin 0x%06llx length 0x%06llx used %llu",
+                 m->name.c_str(), (unsigned long long)m->getOrigin(),
+                 (unsigned long long)m->getLength(), (unsigned long long)used);
+    if (m->getLength())
+      os << format(" (%.2f%%)", used * 100.0 / m->getLength());
+    os << "\n";
+  }
+  os << "Sections:\n";
+  for (OutputSection *osec : ctx.outputSections)
+    if (osec->flags & SHF_ALLOC)
+      os << format("  %-16s vma 0x%06llx lma 0x%06llx size %llu%s%s\n",
+                   osec->name.str().c_str(), (unsigned long long)osec->addr,
+                   (unsigned long long)osec->getLMA(),
+                   (unsigned long long)osec->size,
+                   osec->memRegion ? " region " : "",
+                   osec->memRegion ? osec->memRegion->name.c_str() : "");
+  os << "Zero page:\n";
+  for (const ReportSymbol &sym : zeroPage)
+    os << format("  0x%04llx %4llu ", (unsigned long long)sym.addr,
+                 (unsigned long long)sym.size)
+       << sym.name << "\n";
+  os << "Static stacks:\n";
+  for (const ReportSymbol &sym : staticStacks)
+    os << format("  %6llu ", (unsigned long long)sym.size) << sym.name << "\n";
+  os << "Cross-bank calls: " << crossBank.crossingWeight << " of "
+     << crossBank.totalWeight << "\n";
+  for (const CrossBankCalls::Edge &e : crossBank.edges)
+    os << "  " << e.weight << " " << toStr(ctx, e.from) << " -> "
+       << toStr(ctx, e.to) << "\n";
+  os << "Called:\n";
+  for (const SectionWeight &s : called)
+    os << "  " << s.weight << " " << s.name << "\n";
+}
@@ -12,6 +12,7 @@
 namespace lld::elf {
 struct Ctx;
 void writeMapAndCref(Ctx &);
+void writeMemoryReport(Ctx &);
 }
 
 #endif
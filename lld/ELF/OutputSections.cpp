@@ -597,6 +597,20 @@ void OutputSection::writeTo(Ctx &ctx, uint8_t *buf, parallel::TaskGroup &tg) {
   // to supress the error), the output may be non-deterministic.
   const size_t taskSizeLimit = 4 << 20;
   for (size_t begin = 0, i = 0, taskSize = 0;;) {
+    // MOS shards the relocations of sections that have many of them. Nested
+    // parallelism runs serially in llvm/Support/Parallel.h, so write those
+    // sections on this thread instead of in a task.
+    if (ctx.arg.emachine == EM_MOS &&
+        sections[i]->relocs().size() >= mosRelocShardSize) {
+      if (begin != i)
+        tg.spawn([=] { fn(begin, i); });
+      fn(i, i + 1);
+      begin = ++i;
+      taskSize = 0;
+      if (i == numSections)
+        break;
+      continue;
+    }
     taskSize += sections[i]->getSize();
     bool done = ++i == numSections;
     if (done || taskSize >= taskSizeLimit) {
@@ -1338,8 +1338,9 @@ void TargetInfo::scanSectionImpl(InputSectionBase &sec, Relocs<RelTy> rels) {
 
   // Sort relocations by offset for more efficient searching for
   // R_RISCV_PCREL_HI20, ALIGN relocations, R_PPC64_ADDR64 and the
-  // branch-to-branch optimization.
-  if (is_contained({EM_RISCV, EM_LOONGARCH}, ctx.arg.emachine) ||
+  // branch-to-branch optimization. MOS relaxation pairs each R_MOS_RELAX_ZP
+  // with the relocation that follows it.
+  if (is_contained({EM_RISCV, EM_LOONGARCH, EM_MOS}, ctx.arg.emachine) ||
       (ctx.arg.emachine == EM_PPC64 && sec.name == ".toc") ||
       ctx.arg.branchToBranch)
     llvm::stable_sort(sec.relocs(),
@@ -51,6 +51,7 @@ using namespace lld;
 using namespace lld::elf;
 
 using llvm::support::endian::read32le;
+using llvm::support::endian::write16le;
 using llvm::support::endian::write32le;
 using llvm::support::endian::write64le;
 
@@ -2761,6 +2762,237 @@ void PaddingSection::writeTo(uint8_t *buf) {
   memcpy(buf, &filler[0], end - buf);
 }
 
+SlotPaddingSection::SlotPaddingSection(Ctx &ctx, InputSection *sec,
+                                       uint64_t slot, OutputSection *parent)
+    : SyntheticSection(ctx, ".slot_padding",
+                       sec->type == SHT_NOBITS ? SHT_NOBITS : SHT_PROGBITS,
+                       SHF_ALLOC, 1),
+      sec(sec), slot(slot) {
+  this->parent = parent;
+}
+
+size_t SlotPaddingSection::getSize() const {
+  uint64_t size = sec->getSize();
+  return size < slot ? slot - size : 0;
+}
+
+void SlotPaddingSection::writeTo(uint8_t *buf) {
+  std::array<uint8_t, 4> filler = getParent()->getFiller(ctx);
+  uint8_t *end = buf + getSize();
+  for (; buf + 4 <= end; buf += 4)
+    memcpy(buf, &filler[0], 4);
+  memcpy(buf, &filler[0], end - buf);
+}
+
+MOSCompressedSection::MOSCompressedSection(Ctx &ctx)
+    : SyntheticSection(ctx, ".compressed", SHT_PROGBITS, SHF_ALLOC, 1) {}
+
+// Compresses in into the LZ4 block format, greedily taking the most recent
+// match found through a hash of the next four bytes. The format's decoders are
+// among the fastest on the 6502; as it requires, the last match starts at least
+// 12 bytes before the end, and the last 5 bytes are literals.
+static SmallVector<uint8_t, 0> compressLZ4(ArrayRef<uint8_t> in) {
+  SmallVector<uint8_t, 0> out;
+  auto writeLength = [&](size_t len) {
+    for (; len >= 255; len -= 255)
+      out.push_back(255);
+    out.push_back(len);
+  };
+  auto writeSequence = [&](ArrayRef<uint8_t> literals, size_t offset,
+                           size_t matchLen) {
+    const size_t litLen = literals.size();
+    const size_t extra = matchLen ? matchLen - 4 : 0;
+    out.push_back(std::min<size_t>(litLen, 15) << 4 |
+                  std::min<size_t>(extra, 15));
+    if (litLen >= 15)
+      writeLength(litLen - 15);
+    out.append(literals.begin(), literals.end());
+    if (!matchLen)
+      return;
+    out.push_back(offset);
+    out.push_back(offset >> 8);
+    if (extra >= 15)
+      writeLength(extra - 15);
+  };
+
+  const size_t n = in.size();
+  size_t anchor = 0;
+  if (n > 12) {
+    const size_t matchStartLimit = n - 12, matchEndLimit = n - 5;
+    // The most recent position plus one of each hashed four byte sequence.
+    SmallVector<uint32_t, 0> table(1 << 12);
+    for (size_t i = 0; i < matchStartLimit;) {
+      const uint32_t seq = read32le(in.data() + i);
+      uint32_t &entry = table[(seq * 2654435761u) >> 20];
+      const size_t cand = entry;
+      entry = i + 1;
+      if (!cand || i - (cand - 1) > 0xffff ||
+          read32le(in.data() + cand - 1) != seq) {
+        ++i;
+        continue;
+      }
+      size_t len = 4;
+      while (i + len < matchEndLimit && in[cand - 1 + len] == in[i + len])
+        ++len;
+      writeSequence(in.slice(anchor, i - anchor), i - (cand - 1), len);
+      i += len;
+      anchor = i;
+    }
+  }
+  writeSequence(in.slice(anchor), 0, 0);
+  return out;
+}
+
+// The contents of the output sections depend on addresses, so compress them
+// again each time addresses change. To converge, the section only grows, and
+// any room left over after a shrink is left as zeros.
+bool MOSCompressedSection::updateAllocSize(Ctx &ctx) {
+  data.resize(sections.size());
+  size_t newSize = sections.size() * entrySize;
+  SmallVector<InputSection *, 0> storage;
+  for (auto [osec, compressed] : llvm::zip(sections, data)) {
+    SmallVector<uint8_t, 0> buf(osec->size);
+    for (InputSection *isec : getInputSections(*osec, storage)) {
+      if (auto *s = dyn_cast<SyntheticSection>(isec))
+        s->writeTo(buf.data() + isec->outSecOff);
+      else
+        isec->writeTo<ELF32LE>(ctx, buf.data() + isec->outSecOff);
+    }
+    compressed = compressLZ4(buf);
+    newSize += compressed.size();
+  }
+  if (newSize <= size)
+    return false;
+  size = newSize;
+  return true;
+}
+
+void MOSCompressedSection::writeTo(uint8_t *buf) {
+  uint64_t src = getVA(sections.size() * entrySize);
+  uint8_t *p = buf;
+  for (auto [osec, compressed] : llvm::zip(sections, data)) {
+    if (!isUInt<16>(src + compressed.size()) ||
+        !isUInt<16>(osec->addr + osec->size))
+      Err(ctx) << "section '" << osec->name
+               << "' and its compressed contents must be addressable with 16 "
+                  "bits";
+    write16le(p, src);
+    write16le(p + 2, osec->addr);
+    write16le(p + 4, osec->size);
+    p += entrySize;
+    src += compressed.size();
+  }
+  for (const SmallVector<uint8_t, 0> &compressed : data) {
+    memcpy(p, compressed.data(), compressed.size());
+    p += compressed.size();
+  }
+}
+
+MOSInitTableSection::MOSInitTableSection(Ctx &ctx)
+    : SyntheticSection(ctx, ".init_table", SHT_PROGBITS, SHF_ALLOC, 1) {}
+
+// Adds records that initialize the bytes from addr to contents. A run of zeros
+// becomes a fill if that saves more than the headers it adds: its own, and one
+// more for each side of it that must still be copied.
+void MOSInitTableSection::addRecords(uint64_t addr,
+                                     ArrayRef<uint8_t> contents) {
+  auto write16 = [&](uint64_t val) {
+    data.push_back(val);
+    data.push_back(val >> 8);
+  };
+  auto add = [&](size_t begin, size_t end, bool zero) {
+    for (size_t i = begin; i < end; i += maxLength) {
+      ArrayRef<uint8_t> chunk =
+          contents.slice(i, std::min<size_t>(maxLength, end - i));
+      write16(addr + i);
+      if (zero) {
+        write16(0x8000 | chunk.size());
+        continue;
+      }
+      if (ctx.arg.initTableCompress) {
+        SmallVector<uint8_t, 0> compressed = compressLZ4(chunk);
+        if (compressed.size() + 2 < chunk.size()) {
+          write16(0x4000 | chunk.size());
+          write16(compressed.size());
+          data.append(compressed.begin(), compressed.end());
+          continue;
+        }
+      }
+      write16(chunk.size());
+      data.append(chunk.begin(), chunk.end());
+    }
+  };
+
+  const size_t n = contents.size();
+  size_t copyBegin = 0;
+  for (size_t i = 0; i < n;) {
+    if (contents[i]) {
+      ++i;
+      continue;
+    }
+    size_t j = i;
+    while (j < n && !contents[j])
+      ++j;
+    if (j - i > headerSize * ((i != copyBegin) + (j != n))) {
+      add(copyBegin, i, /*zero=*/false);
+      add(i, j, /*zero=*/true);
+      copyBegin = j;
+    }
+    i = j;
+  }
+  add(copyBegin, n, /*zero=*/false);
+}
+
+// Like .compressed, the records depend on addresses, so they are made again
+// each time addresses change, and the section only grows. The end of the table
+// follows the records, so any room left over is ignored.
+bool MOSInitTableSection::updateAllocSize(Ctx &ctx) {
+  llvm::stable_sort(sections, [](const auto &a, const auto &b) {
+    return a.first->addr < b.first->addr;
+  });
+  data.clear();
+  SmallVector<InputSection *, 0> storage;
+  // The contents of the current run of adjacent sections, starting at addr.
+  uint64_t addr = 0;
+  SmallVector<uint8_t, 0> run;
+  for (auto [osec, hasContents] : sections) {
+    if (osec->addr != addr + run.size()) {
+      addRecords(addr, run);
+      run.clear();
+      addr = osec->addr;
+    }
+    size_t off = run.size();
+    run.resize(off + osec->size);
+    if (!hasContents)
+      continue;
+    for (InputSection *isec : getInputSections(*osec, storage)) {
+      if (isec->type == SHT_NOBITS)
+        continue;
+      if (auto *s = dyn_cast<SyntheticSection>(isec))
+        s->writeTo(run.data() + off + isec->outSecOff);
+      else
+        isec->writeTo<ELF32LE>(ctx, run.data() + off + isec->outSecOff);
+    }
+  }
+  addRecords(addr, run);
+  if (tableEnd)
+    tableEnd->value = data.size();
+
+  if (data.size() <= size)
+    return false;
+  size = data.size();
+  return true;
+}
+
+void MOSInitTableSection::writeTo(uint8_t *buf) {
+  for (auto [osec, hasContents] : sections)
+    if (!isUInt<16>(osec->addr + osec->size))
+      Err(ctx) << "section '" << osec->name
+               << "' must be addressable with 16 bits to be initialized from "
+                  ".init_table";
+  memcpy(buf, data.data(), data.size());
+}
+
 // The string hash function for .gdb_index.
 static uint32_t computeGdbHash(StringRef s) {
   uint32_t h = 0;
@@ -4889,6 +5121,16 @@ template <class ELFT> void elf::createSyntheticSections(Ctx &ctx) {
     add(*ctx.in.relroPadding);
   }
 
+  if (!ctx.arg.compressLoadSections.empty()) {
+    ctx.in.mosCompressed = std::make_unique<MOSCompressedSection>(ctx);
+    add(*ctx.in.mosCompressed);
+  }
+
+  if (!ctx.arg.initTableSections.empty()) {
+    ctx.in.mosInitTable = std::make_unique<MOSInitTableSection>(ctx);
+    add(*ctx.in.mosInitTable);
+  }
+
   if (ctx.arg.emachine == EM_ARM) {
     ctx.in.armCmseSGSection = std::make_unique<ArmCmseSGSection>(ctx);
     add(*ctx.in.armCmseSGSection);
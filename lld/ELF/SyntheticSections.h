@@ -777,6 +777,84 @@ public:
   void writeTo(uint8_t *buf) override;
 };
 
+// Pads the input section before it out to the slot reserved for it by
+// --incremental-layout, so that the sections after it keep their addresses as
+// long as it fits. The padding follows the section's current size, which can
+// change as linker relaxation shrinks it.
+class SlotPaddingSection final : public SyntheticSection {
+public:
+  SlotPaddingSection(Ctx &ctx, InputSection *sec, uint64_t slot,
+                     OutputSection *parent);
+  size_t getSize() const override;
+  void writeTo(uint8_t *buf) override;
+
+  static bool classof(const SectionBase *s) {
+    return SyntheticSection::classof(s) && s->name == ".slot_padding";
+  }
+
+  // The section padded and the size of its slot.
+  InputSection *sec;
+  uint64_t slot;
+};
+
+// The contents of the output sections matched by --compress-load-sections,
+// compressed in the LZ4 block format, after a table with an entry for each of
+// them. Those output sections become SHT_NOBITS, so they take no room in the
+// image; startup code or a loader walks the table from
+// __compressed_table_start to __compressed_table_end and decompresses each
+// into place. An entry is three 16-bit words: the address of the compressed
+// data, the address of the output section, and its size. Since every address
+// is final, the decompressed contents need no further fixups.
+class MOSCompressedSection final : public SyntheticSection {
+public:
+  MOSCompressedSection(Ctx &ctx);
+  size_t getSize() const override { return size; }
+  bool updateAllocSize(Ctx &) override;
+  void writeTo(uint8_t *buf) override;
+
+  static constexpr size_t entrySize = 6;
+
+  SmallVector<OutputSection *, 0> sections;
+  Defined *tableEnd = nullptr;
+
+private:
+  SmallVector<SmallVector<uint8_t, 0>, 0> data;
+  size_t size = 0;
+};
+
+// The initial contents of the output sections matched by
+// --init-table-sections, as records for startup code to walk from
+// __init_table_start to __init_table_end, in place of copying .data and
+// zeroing .bss. Sections adjacent in memory, like the .data and .bss of one
+// region, are merged, and runs of zeros within them become zero fills instead
+// of data. The sections that had contents become SHT_NOBITS, so they take no
+// room in the image.
+//
+// A record starts with two 16-bit words: the address to initialize, and the
+// number of bytes, below 0x4000, with bit 15 set for a zero fill or bit 14 set
+// for LZ4-compressed data. Data follows as is, or LZ4-compressed after its
+// 16-bit compressed size.
+class MOSInitTableSection final : public SyntheticSection {
+public:
+  MOSInitTableSection(Ctx &ctx);
+  size_t getSize() const override { return size; }
+  bool updateAllocSize(Ctx &) override;
+  void writeTo(uint8_t *buf) override;
+
+  static constexpr size_t headerSize = 4;
+  static constexpr size_t maxLength = 0x3fff;
+
+  // The output sections initialized, and whether each had contents.
+  SmallVector<std::pair<OutputSection *, bool>, 0> sections;
+  Defined *tableEnd = nullptr;
+
+private:
+  void addRecords(uint64_t addr, ArrayRef<uint8_t> contents);
+
+  SmallVector<uint8_t, 0> data;
+  size_t size = 0;
+};
+
 // Used by the merged DWARF32 .debug_names (a per-module index). If we
 // move to DWARF64, most of this data will need to be re-sized.
 class DebugNamesBaseSection : public SyntheticSection {
@@ -268,6 +268,15 @@ void sortArmMappingSymbols(Ctx &);
 void convertArmInstructionstoBE8(Ctx &, InputSection *sec, uint8_t *buf);
 void createTaggedSymbols(Ctx &);
 void initSymbolAnchors(Ctx &);
+// MOS::relocateAlloc applies the relocations of a section in parallel shards
+// of this many once it has at least this many.
+constexpr size_t mosRelocShardSize = 1 << 14;
+void splitMOSAddressTables(Ctx &);
+void createMOSOverlayStubs(Ctx &);
+void setMOSRCCount(Ctx &);
+void compressMOSSections(Ctx &);
+void buildMOSInitTable(Ctx &);
+void writeMOSOverlayReport(Ctx &);
 
 void setTarget(Ctx &);
 
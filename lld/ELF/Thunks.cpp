@@ -415,6 +415,25 @@ public:
   void addSymbols(ThunkSection &isec) override;
 };
 
+// MOS functions in an overlay can only be called once the overlay is loaded
+// into its window, so references from outside the overlay go through a
+// resident stub that has the runtime's loader load it first.
+class MOSOverlayThunk final : public Thunk {
+public:
+  MOSOverlayThunk(Ctx &ctx, Symbol &dest, int64_t addend, Symbol &loader,
+                  uint8_t overlay)
+      : Thunk(ctx, dest, addend), loader(loader), overlay(overlay) {
+    alignment = 1;
+  }
+  uint32_t size() override { return 7; }
+  void writeTo(uint8_t *buf) override;
+  void addSymbols(ThunkSection &isec) override;
+
+private:
+  Symbol &loader;
+  uint8_t overlay;
+};
+
 // Hexagon CPUs need thunks for R_HEX_B{9,1{3,5},22}_PCREL,
 // R_HEX_{,GD_}PLT_B22_PCREL when their destination is out of
 // range.
@@ -1245,6 +1264,23 @@ void AVRThunk::addSymbols(ThunkSection &isec) {
             isec);
 }
 
+// The loader returns past the overlay number that follows its call.
+void MOSOverlayThunk::writeTo(uint8_t *buf) {
+  buf[0] = 0x20; // jsr __overlay_load
+  ctx.target->relocateNoSym(buf + 1, R_MOS_ADDR16, loader.getVA(ctx));
+  buf[3] = overlay;
+  buf[4] = 0x4c; // jmp func
+  ctx.target->relocateNoSym(buf + 5, R_MOS_ADDR16,
+                            destination.getVA(ctx, addend));
+}
+
+void MOSOverlayThunk::addSymbols(ThunkSection &isec) {
+  StringRef name = destination.getName();
+  if (destination.isSection())
+    name = cast<Defined>(destination).section->name;
+  addSymbol(ctx.saver.save("__overlay_stub_" + name), STT_FUNC, 0, isec);
+}
+
 // Write MIPS LA25 thunk code to call PIC function from the non-PIC one.
 void MipsThunk::writeTo(uint8_t *buf) {
   uint64_t s = destination.getVA(ctx);
@@ -1836,6 +1872,11 @@ std::unique_ptr<Thunk> elf::addThunk(Ctx &ctx, const InputSection &isec,
   }
 }
 
+Thunk *elf::addMOSOverlayThunk(Ctx &ctx, Symbol &s, int64_t a,
+                               Symbol &loader, uint8_t overlay) {
+  return make<MOSOverlayThunk>(ctx, s, a, loader, overlay);
+}
+
 std::unique_ptr<Thunk> elf::addLandingPadThunk(Ctx &ctx, Symbol &s, int64_t a) {
   switch (ctx.arg.emachine) {
   case EM_AARCH64:
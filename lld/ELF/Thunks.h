@@ -83,6 +83,11 @@ std::unique_ptr<Thunk> addThunk(Ctx &, const InputSection &isec,
 // are restricted.
 std::unique_ptr<Thunk> addLandingPadThunk(Ctx &, Symbol &s, int64_t a);
 
+// Create a stub for a reference to MOS function s+a in an overlay that has
+// loader load the overlay first. See createMOSOverlayStubs.
+Thunk *addMOSOverlayThunk(Ctx &, Symbol &s, int64_t a, Symbol &loader,
+                          uint8_t overlay);
+
 void writePPC32PltCallStub(Ctx &, uint8_t *buf, uint64_t gotPltVA,
                            const InputFile *file, int64_t addend);
 void writePPC64LoadAndBranch(Ctx &, uint8_t *buf, int64_t offset);
@@ -101,6 +101,8 @@ private:
 };
 } // anonymous namespace
 
+static void writeIncrementalLayout(Ctx &ctx);
+
 template <class ELFT> void elf::writeResult(Ctx &ctx) {
   Writer<ELFT>(ctx).run();
 }
@@ -199,6 +201,10 @@ void elf::addReservedSymbols(Ctx &ctx) {
     addOptionalRegular(ctx, "_SDA_BASE_", nullptr, 0, STV_HIDDEN);
   } else if (ctx.arg.emachine == EM_PPC64) {
     addPPC64SaveRestore(ctx);
+  } else if (ctx.arg.emachine == EM_MOS) {
+    // The number of imaginary register bytes the program references. Its
+    // value is set once LTO has compiled the last of the objects.
+    ctx.sym.mosRCCount = addOptionalRegular(ctx, "__rc_count", nullptr, 0);
   }
 
   // The Power Architecture 64-bit v2 ABI defines a TableOfContents (TOC) which
@@ -356,6 +362,22 @@ template <class ELFT> void Writer<ELFT>::run() {
   // fails, for example, due to an erroneous file size.
   writeMapAndCref(ctx);
 
+  // Handle --print-cross-bank-calls.
+  if (!ctx.arg.printCrossBankCalls.empty())
+    writeCrossBankCallReport(ctx);
+
+  // Handle --print-overlays.
+  if (!ctx.arg.printOverlays.empty())
+    writeMOSOverlayReport(ctx);
+
+  // Handle --incremental-layout.
+  if (!ctx.arg.incrementalLayout.empty() && !ctx.arg.relocatable)
+    writeIncrementalLayout(ctx);
+
+  // Handle --memory-report.
+  if (!ctx.arg.memoryReport.empty())
+    writeMemoryReport(ctx);
+
   // Handle --print-memory-usage option.
   if (ctx.arg.printMemoryUsage)
     ctx.script->printMemoryUsage(ctx.e.outs());
@@ -1135,6 +1157,12 @@ static DenseMap<const InputSectionBase *, int> buildSectionOrder(Ctx &ctx) {
         ctx.arg.bpDataOrderForCompression,
         ctx.arg.bpCompressionSortStartupFunctions,
         ctx.arg.bpVerboseSectionOrderer);
+    // On MOS, only compressed sections are ordered for compression, so the
+    // call graph profile still orders the rest.
+    if (ctx.arg.emachine == EM_MOS && !ctx.arg.compressLoadSections.empty() &&
+        !ctx.arg.callGraphProfile.empty())
+      for (auto [sec, priority] : computeCallGraphProfileOrder(ctx))
+        sectionOrder.try_emplace(sec, priority);
   } else if (!ctx.arg.callGraphProfile.empty()) {
     sectionOrder = computeCallGraphProfileOrder(ctx);
   }
@@ -1534,6 +1562,115 @@ static void randomizeSectionPadding(Ctx &ctx) {
   }
 }
 
+// Returns the input sections that --incremental-layout reserves slots for,
+// with the keys that identify them from one link to the next: the file and
+// section name, numbered if a file has several sections of the same name.
+// Zero page sections are left alone, since slack there is too costly, as are
+// sections that may spill to another output section.
+static SmallVector<std::pair<InputSection *, std::string>, 0>
+getIncrementalSections(Ctx &ctx) {
+  SmallVector<std::pair<InputSection *, std::string>, 0> ret;
+  StringMap<unsigned> seen;
+  for (OutputSection *os : ctx.outputSections) {
+    if (!(os->flags & SHF_ALLOC) ||
+        (ctx.arg.emachine == EM_MOS &&
+         (os->name == ".zp" || os->name.starts_with(".zp."))))
+      continue;
+    for (SectionCommand *bc : os->commands) {
+      auto *isd = dyn_cast<InputSectionDescription>(bc);
+      if (!isd)
+        continue;
+      for (InputSection *isec : isd->sections) {
+        if (isa<SyntheticSection>(isec) ||
+            ctx.script->potentialSpillLists.count(isec))
+          continue;
+        std::string key = toStr(ctx, isec);
+        if (unsigned n = seen[key]++)
+          key += "#" + std::to_string(n);
+        ret.emplace_back(isec, std::move(key));
+      }
+    }
+  }
+  return ret;
+}
+
+// Reserve a slot for each input section: the slot recorded by the previous
+// link if the section still fits, or else its size plus --incremental-slack.
+static void addIncrementalSlots(Ctx &ctx) {
+  StringMap<uint64_t> slots;
+  if (sys::fs::exists(ctx.arg.incrementalLayout)) {
+    if (std::optional<MemoryBufferRef> mb =
+            readFile(ctx, ctx.arg.incrementalLayout)) {
+      SmallVector<StringRef, 0> lines;
+      mb->getBuffer().split(lines, '\n', -1, false);
+      for (StringRef line : lines) {
+        auto [slotStr, key] = line.split(' ');
+        uint64_t slot;
+        if (slotStr.getAsInteger(10, slot) || key.empty()) {
+          ErrAlways(ctx) << ctx.arg.incrementalLayout
+                         << ": malformed line: " << line;
+          return;
+        }
+        slots[key] = slot;
+      }
+    }
+  }
+
+  DenseMap<InputSection *, SlotPaddingSection *> paddings;
+  unsigned moved = 0;
+  for (auto &[isec, key] : getIncrementalSections(ctx)) {
+    uint64_t size = isec->getSize();
+    auto it = slots.find(key);
+    uint64_t slot;
+    if (it != slots.end() && size <= it->second) {
+      slot = it->second;
+    } else {
+      if (it != slots.end())
+        ++moved;
+      slot = size + ctx.arg.incrementalSlack;
+    }
+    paddings[isec] =
+        make<SlotPaddingSection>(ctx, isec, slot, isec->getParent());
+  }
+  if (moved)
+    Log(ctx) << "--incremental-layout: " << moved
+             << " sections outgrew their slots";
+
+  for (OutputSection *os : ctx.outputSections)
+    for (SectionCommand *bc : os->commands)
+      if (auto *isd = dyn_cast<InputSectionDescription>(bc)) {
+        SmallVector<InputSection *, 0> tmp;
+        for (InputSection *isec : isd->sections) {
+          tmp.push_back(isec);
+          if (SlotPaddingSection *padding = paddings.lookup(isec))
+            tmp.push_back(padding);
+        }
+        isd->sections = std::move(tmp);
+      }
+}
+
+// Record each input section's slot for the next link with
+// --incremental-layout.
+static void writeIncrementalLayout(Ctx &ctx) {
+  std::error_code ec;
+  raw_fd_ostream os = ctx.openAuxiliaryFile(ctx.arg.incrementalLayout, ec);
+  if (ec) {
+    ErrAlways(ctx) << "cannot open " << ctx.arg.incrementalLayout << ": "
+                   << ec.message();
+    return;
+  }
+  DenseMap<InputSection *, uint64_t> slots;
+  for (OutputSection *osec : ctx.outputSections)
+    for (SectionCommand *bc : osec->commands)
+      if (auto *isd = dyn_cast<InputSectionDescription>(bc))
+        for (InputSection *isec : isd->sections)
+          if (auto *padding = dyn_cast<SlotPaddingSection>(isec))
+            slots[padding->sec] = padding->slot;
+  for (auto &[isec, key] : getIncrementalSections(ctx))
+    if (uint64_t slot = slots.lookup(isec))
+      os << slot << " " << key << "\n";
+}
+
 // We need to generate and finalize the content that depends on the address of
 // InputSections. As the generation of the content may also alter InputSection
 // addresses we must converge to a fixed point. We do that here. See the comment
@@ -1563,6 +1700,9 @@ template <class ELFT> void Writer<ELFT>::finalizeAddressDependentContent() {
   if (ctx.arg.randomizeSectionPadding)
     randomizeSectionPadding(ctx);
 
+  if (!ctx.arg.incrementalLayout.empty() && !ctx.arg.relocatable)
+    addIncrementalSlots(ctx);
+
   // Iterate until a fixed point is reached, skipping relocatable links since
   // the final addresses are unavailable.
   uint32_t pass = 0, assignPasses = 0;
@@ -1633,6 +1773,10 @@ template <class ELFT> void Writer<ELFT>::finalizeAddressDependentContent() {
       if (part.memtagGlobalDescriptors)
         changed |= part.memtagGlobalDescriptors->updateAllocSize(ctx);
     }
+    if (ctx.in.mosCompressed)
+      changed |= ctx.in.mosCompressed->updateAllocSize(ctx);
+    if (ctx.in.mosInitTable)
+      changed |= ctx.in.mosInitTable->updateAllocSize(ctx);
 
     std::pair<const OutputSection *, const Defined *> changes =
         ctx.script->assignAddresses();
@@ -2071,6 +2215,13 @@ template <class ELFT> void Writer<ELFT>::finalizeSections() {
     ctx.partitions[0].dynSymTab->addSymbol(sym);
   }
 
+  // Sections initialized from the table are no longer loaded, so they can't
+  // be compressed as well.
+  if (ctx.in.mosInitTable)
+    buildMOSInitTable(ctx);
+  if (ctx.in.mosCompressed)
+    compressMOSSections(ctx);
+
   // This is a bit of a hack. A value of 0 means undef, so we set it
   // to 1 to make __ehdr_start defined. The section number is not
   // particularly relevant.
@@ -2169,6 +2320,13 @@ template <class ELFT> void Writer<ELFT>::finalizeSections() {
   if (!ctx.script->hasSectionsCommand && !ctx.arg.relocatable)
     fixSectionAlignments();
 
+  if (ctx.arg.emachine == EM_MOS)
+    splitMOSAddressTables(ctx);
+
+  // Redirect references into MOS overlays through their load stubs.
+  if (ctx.arg.overlayStubs)
+    createMOSOverlayStubs(ctx);
+
   // This is used to:
   // 1) Create "thunks":
   //    Jump instructions in many ISAs have small displacements, and therefore
@@ -2303,6 +2461,16 @@ template <class ELFT> void Writer<ELFT>::addStartEndSymbols() {
   // create an empty PT_ARM_EXIDX.
   if (OutputSection *sec = findSection(ctx, ".ARM.exidx"))
     define("__exidx_start", "__exidx_end", sec);
+
+  // The end of the table is set once the compressed sections are known.
+  if (MOSCompressedSection *sec = ctx.in.mosCompressed.get()) {
+    addOptionalRegular(ctx, "__compressed_table_start", sec, 0);
+    sec->tableEnd = addOptionalRegular(ctx, "__compressed_table_end", sec, 0);
+  }
+  if (MOSInitTableSection *sec = ctx.in.mosInitTable.get()) {
+    addOptionalRegular(ctx, "__init_table_start", sec, 0);
+    sec->tableEnd = addOptionalRegular(ctx, "__init_table_end", sec, 0);
+  }
 }
 
 // If a section name is valid as a C identifier (which is rare because of
@@ -2313,9 +2481,19 @@ template <class ELFT> void Writer<ELFT>::addStartEndSymbols() {
 template <class ELFT>
 void Writer<ELFT>::addStartStopSymbols(OutputSection &osec) {
   StringRef s = osec.name;
+  StringSaver &ss = ctx.saver;
+  // A MOS base page, .bp.<page>, must begin a page, since 65CE02 code on the
+  // page addresses it by offset from the page selected by the B register.
+  // Code switching to the page loads the high byte of __bp_<page>.
+  if (ctx.arg.emachine == EM_MOS && s.starts_with(".bp.") && s.size() > 4) {
+    osec.addralign = std::max<uint32_t>(osec.addralign, 256);
+    if (addOptionalRegular(ctx, ss.save("__bp_" + s.drop_front(4)), &osec, 0,
+                           ctx.arg.zStartStopVisibility))
+      osec.usedInExpression = true;
+    return;
+  }
   if (!isValidCIdentifier(s))
     return;
-  StringSaver &ss = ctx.saver;
   Defined *startSym = addOptionalRegular(ctx, ss.save("__start_" + s), &osec, 0,
                                          ctx.arg.zStartStopVisibility);
   Defined *stopSym = addOptionalRegular(ctx, ss.save("__stop_" + s), &osec, -1,
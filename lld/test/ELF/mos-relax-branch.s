@@ -0,0 +1,57 @@
+# REQUIRES: mos
+## Jumps and long branches marked with R_MOS_RELAX_BRANCH are relaxed to
+## short branches once their targets are in range of one.
+
+# RUN: rm -rf %t && split-file %s %t && cd %t
+# RUN: llvm-mc -filetype=obj -triple=mos -mcpu=mos65ce02 -mos-linker-relax a.s -o a.o
+# RUN: llvm-readobj -r a.o | FileCheck %s --check-prefix=RELOC
+# RUN: ld.lld a.o -T near.t -o near
+# RUN: llvm-objdump -d near | FileCheck %s --check-prefix=NEAR
+# RUN: ld.lld a.o -T far.t -o far
+# RUN: llvm-objdump -d far | FileCheck %s --check-prefix=FAR
+# RUN: ld.lld a.o -T near.t --no-relax -o norelax
+# RUN: llvm-objdump -d norelax | FileCheck %s --check-prefix=FAR
+
+## The marker's addend is the short branch opcode: BRA for the JMP, and the
+## 8-bit BNE for the 16-bit one.
+# RELOC:      R_MOS_RELAX_BRANCH - 0x80
+# RELOC-NEXT: R_MOS_ADDR16 target
+# RELOC-NEXT: R_MOS_RELAX_BRANCH - 0xD0
+# RELOC-NEXT: R_MOS_PCREL_16 target
+
+## Each branch is relative to its end, and the relaxed JMP pulls the BNE and
+## the target a byte closer.
+# NEAR:      1000: 80 03 bra
+# NEAR-NEXT: 1002: d0 01 bne
+# NEAR-NEXT: 1004: 60 rts
+# NEAR:      1005: 60 rts
+
+# FAR:      1000: 4c {{.*}} jmp
+# FAR-NEXT: 1003: d3 {{.*}} bne
+# FAR-NEXT: 1006: 60 rts
+
+#--- a.s
+.section .text,"ax",@progbits
+.globl _start
+_start:
+  jmp target
+  bne target
+  rts
+
+.section .text.target,"ax",@progbits
+target:
+  rts
+
+#--- near.t
+SECTIONS {
+  . = 0x1000;
+  .text : { *(.text) *(.text.target) }
+}
+
+#--- far.t
+SECTIONS {
+  . = 0x1000;
+  .text : { *(.text) }
+  . = 0x2000;
+  .text.target : { *(.text.target) }
+}
@@ -403,6 +403,10 @@ public:
   /// threshold; boosts for desireable runtime benefits are not applied.
   bool strictInliningCosts() const;
 
+  /// \returns A cost to add to that of inlining CB, for the pressure the
+  /// callee puts on scarce storage of the caller once inlined.
+  unsigned getInliningPressureCost(const CallBase *CB) const;
+
   /// \return the expected cost of a memcpy, which could e.g. depend on the
   /// source/destination type and alignment and the number of bytes copied.
   LLVM_ABI InstructionCost getMemcpyCost(const Instruction *I) const;
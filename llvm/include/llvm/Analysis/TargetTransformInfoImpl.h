@@ -109,6 +109,9 @@ public:
 
   virtual int getInlinerVectorBonusPercent() const { return 150; }
   virtual bool strictInliningCosts() const { return false; }
+  virtual unsigned getInliningPressureCost(const CallBase *CB) const {
+    return 0;
+  }
 
   virtual InstructionCost getMemcpyCost(const Instruction *I) const {
     return TTI::TCC_Expensive;
@@ -544,6 +544,21 @@ enum : unsigned {
   EF_MOS_ARCH_SPC700 = 0x00020000   // SPC700 instructions
 };
 
+// Note types for MOS, in notes named "MOS".
+enum : unsigned {
+  // Best and worst case cycle counts of basic blocks. Each descriptor entry
+  // is a 32-bit block address followed by 16-bit best and worst counts.
+  NT_MOS_CYCLES = 1,
+  // Trace IDs of functions instrumented with -mos-trace-port. Each descriptor
+  // entry is a 32-bit function address followed by the 16-bit first ID and
+  // number of IDs.
+  NT_MOS_TRACE = 2,
+  // Trap sites compiled with -mos-compact-traps. Each descriptor entry is a
+  // 32-bit address of a BRK, its 16-bit trap ID and source line, and its
+  // NUL-terminated source file name, padded to a multiple of 4 bytes.
+  NT_MOS_TRAP = 3
+};
+
 // ELF Relocation types for AVR
 enum {
 #include "ELFRelocs/AVR.def"
@@ -7,7 +7,8 @@
 //===----------------------------------------------------------------------===//
 //
 // This header contains shared EF_MOS_* information and verification tools for
-// targeting MOS.
+// targeting MOS, and the section naming rules shared by the MOS backend and
+// object tools.
 //
 //===----------------------------------------------------------------------===//
 
@@ -32,6 +33,10 @@ std::string makeEFlagsString(unsigned EFlags);
 /// combinations in a module under assembly.
 bool checkEFlagsCompatibility(unsigned EFlags, unsigned ModuleEFlags);
 
+/// Returns whether the section is placed on the zero page by name: .zp,
+/// .zeropage, or .directpage, or one of their dot-separated subsections.
+bool isZeroPageSectionName(StringRef Name);
+
 } // namespace MOS
 } // namespace llvm
 
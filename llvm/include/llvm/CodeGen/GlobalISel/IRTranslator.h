@@ -43,6 +43,7 @@ class ConstrainedFPIntrinsic;
 class DataLayout;
 class DbgDeclareInst;
 class DbgValueInst;
+class FunctionVarLocs;
 class Instruction;
 class MachineBasicBlock;
 class MachineFunction;
@@ -632,6 +633,10 @@ private:
 
   AAResults *AA = nullptr;
   AssumptionCache *AC = nullptr;
+  /// The variable locations computed by AssignmentTrackingAnalysis, if
+  /// assignment tracking is enabled. These replace the function's dbg.assign
+  /// and dbg.value records.
+  const FunctionVarLocs *FnVarLocs = nullptr;
   const TargetLibraryInfo *LibInfo = nullptr;
   const TargetLowering *TLI = nullptr;
   FunctionLoweringInfo FuncInfo;
@@ -384,6 +384,7 @@ struct ScalarEnumerationTraits<TargetStackID::Value> {
     IO.enumCase(ID, "wasm-local", TargetStackID::WasmLocal);
     IO.enumCase(ID, "mos-static", TargetStackID::MosStatic);
     IO.enumCase(ID, "mos-zero-page", TargetStackID::MosZeroPage);
+    IO.enumCase(ID, "mos-hard-stack", TargetStackID::MosHardStack);
     IO.enumCase(ID, "noalloc", TargetStackID::NoAlloc);
   }
 };
@@ -36,6 +36,7 @@ enum Value {
   ScalablePredicateVector = 4,
   MosStatic = 5,
   MosZeroPage = 6,
+  MosHardStack = 7,
   NoAlloc = 255
 };
 }
@@ -81,6 +81,11 @@ LLVM_ABI std::string computeLTOCacheKey(
 LLVM_ABI std::string recomputeLTOCacheKey(const std::string &Key,
                                           StringRef ExtraID);
 
+/// Computes a cache key for the code generated from one partition of the
+/// regular LTO module, given the partition's bitcode.
+LLVM_ABI std::string computeLTOPartitionCacheKey(const lto::Config &Conf,
+                                                 StringRef Bitcode);
+
 namespace lto {
 
 LLVM_ABI StringLiteral getThinLTODefaultCPU(const Triple &TheTriple);
@@ -574,7 +579,7 @@ private:
   addThinLTO(BitcodeModule BM, ArrayRef<InputFile::Symbol> Syms,
              ArrayRef<SymbolResolution> Res);
 
-  Error runRegularLTO(AddStreamFn AddStream);
+  Error runRegularLTO(AddStreamFn AddStream, FileCache Cache);
   Error runThinLTO(AddStreamFn AddStream, FileCache Cache,
                    const DenseSet<GlobalValue::GUID> &GUIDPreservedSymbols);
 
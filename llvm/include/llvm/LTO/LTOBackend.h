@@ -43,9 +43,12 @@ LLVM_ABI bool opt(const Config &Conf, TargetMachine *TM, unsigned Task,
 
 /// Runs a regular LTO backend. The regular LTO backend can also act as the
 /// regular LTO phase of ThinLTO, which may need to access the combined index.
+/// If \p Cache is valid, the code generated for each partition of a split
+/// module is cached, keyed on the partition's bitcode.
 LLVM_ABI Error backend(const Config &C, AddStreamFn AddStream,
                        unsigned ParallelCodeGenParallelismLevel, Module &M,
-                       ModuleSummaryIndex &CombinedIndex);
+                       ModuleSummaryIndex &CombinedIndex,
+                       FileCache Cache = FileCache());
 
 /// Runs a ThinLTO backend.
 /// If \p ModuleMap is not nullptr, all the module files to be imported have
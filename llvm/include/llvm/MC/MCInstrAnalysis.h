@@ -21,6 +21,7 @@
 #include "llvm/MC/MCRegisterInfo.h"
 #include "llvm/Support/Compiler.h"
 #include <cstdint>
+#include <optional>
 #include <vector>
 
 namespace llvm {
@@ -197,6 +198,29 @@ public:
   virtual std::optional<uint64_t>
   getMemoryOperandRelocationOffset(const MCInst &Inst, uint64_t Size) const;
 
+  /// The timing of an instruction, on targets that execute one instruction at
+  /// a time in a fixed number of cycles.
+  struct InstrTiming {
+    /// The cycles taken; for a conditional branch, when the branch is taken.
+    unsigned Cycles = 0;
+    /// The cycles taken by a conditional branch that falls through, or Cycles
+    /// for other instructions.
+    unsigned NotTakenCycles = 0;
+    /// Whether an indexed address takes one more cycle when it lies on a
+    /// different page than its base.
+    bool IndexPagePenalty = false;
+    /// The base of the indexed address, if it is a constant.
+    std::optional<uint64_t> IndexBase;
+  };
+
+  /// Returns the timing of the instruction at Addr, if the target knows it.
+  virtual std::optional<InstrTiming> getTiming(const MCInst &Inst,
+                                               const MCSubtargetInfo &STI,
+                                               uint64_t Addr,
+                                               uint64_t Size) const {
+    return std::nullopt;
+  }
+
   /// Returns (PLT virtual address, GOT virtual address) pairs for PLT entries.
   virtual std::vector<std::pair<uint64_t, uint64_t>>
   findPltEntries(uint64_t PltSectionVA, ArrayRef<uint8_t> PltContents,
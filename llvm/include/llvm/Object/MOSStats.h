@@ -0,0 +1,61 @@
+//===-- llvm/Object/MOSStats.h - MOS Footprint Summary ----------*- C++ -*-===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file declares a summary of the memory and cycle footprint of a MOS ELF
+/// file, for llvm-size and llvm-readobj.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_OBJECT_MOSSTATS_H
+#define LLVM_OBJECT_MOSSTATS_H
+
+#include "llvm/Support/Compiler.h"
+#include "llvm/Support/Error.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace llvm {
+namespace object {
+
+class ObjectFile;
+
+struct MOSFunctionStats {
+  std::string Name;
+  /// The size of the function's code, in bytes.
+  uint64_t Size = 0;
+  /// The size of the function's static stack frame (its <name>_sstk symbol),
+  /// in bytes.
+  uint64_t StaticFrameSize = 0;
+  /// The number of the function's basic blocks timed in the .mos.cycles note,
+  /// and the sums of their best and worst case cycle counts. This is the cost
+  /// of running each timed block once.
+  unsigned TimedBlocks = 0;
+  uint64_t BestCycles = 0;
+  uint64_t WorstCycles = 0;
+};
+
+struct MOSStats {
+  /// Bytes of zero page, RAM and ROM used by allocated sections. ROM holds the
+  /// initialized sections: code, read-only data, and the initial values of
+  /// writable data.
+  uint64_t ZeroPage = 0;
+  uint64_t RAM = 0;
+  uint64_t ROM = 0;
+  /// The defined functions, sorted by name.
+  std::vector<MOSFunctionStats> Functions;
+};
+
+/// Summarizes a MOS ELF object file or executable.
+LLVM_ABI Expected<MOSStats> getMOSStats(const ObjectFile &Obj);
+
+} // namespace object
+} // namespace llvm
+
+#endif // LLVM_OBJECT_MOSSTATS_H
@@ -110,6 +110,10 @@ public:
     return Invariants;
   }
 
+  /// The instruction evaluated last, which is the one that could not be
+  /// evaluated if evaluation failed.
+  const Instruction *getLastInstruction() const { return LastInst; }
+
 private:
   bool EvaluateBlock(BasicBlock::iterator CurInst, BasicBlock *&NextBB,
                      bool &StrippedPointerCastsForAliasAnalysis);
@@ -165,6 +169,8 @@ private:
   /// in a static initializer of a global.
   SmallPtrSet<Constant*, 8> SimpleConstants;
 
+  const Instruction *LastInst = nullptr;
+
   const DataLayout &DL;
   const TargetLibraryInfo *TLI;
 };
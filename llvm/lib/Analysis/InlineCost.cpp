@@ -1083,6 +1083,8 @@ class InlineCostCallAnalyzer final : public CallAnalyzer {
   }
 
   InlineResult finalizeAnalysis() override {
+    addCost(TTI.getInliningPressureCost(&CandidateCall));
+
     // Loops generally act a lot like calls in that they act like barriers to
     // movement, require a certain amount of setup, etc. So when optimising for
     // size, we penalise any call sites that perform loops. We do this after all
@@ -253,6 +253,11 @@ bool TargetTransformInfo::strictInliningCosts() const {
   return TTIImpl->strictInliningCosts();
 }
 
+unsigned
+TargetTransformInfo::getInliningPressureCost(const CallBase *CB) const {
+  return TTIImpl->getInliningPressureCost(CB);
+}
+
 InstructionCost TargetTransformInfo::getGEPCost(
     Type *PointeeType, const Value *Ptr, ArrayRef<const Value *> Operands,
     Type *AccessType, TTI::TargetCostKind CostKind) const {
@@ -55,5 +55,21 @@ bool checkEFlagsCompatibility(unsigned EFlags, unsigned ModuleEFlags) {
   return true;
 }
 
+constexpr StringRef ZPPrefixes[] = {
+    ".zp",
+    ".zeropage",
+    ".directpage",
+};
+
+bool isZeroPageSectionName(StringRef Name) {
+  if (Name.empty())
+    return false;
+  for (StringRef Prefix : ZPPrefixes)
+    if (Name.starts_with(Prefix) &&
+        (Name.size() == Prefix.size() || Name[Prefix.size()] == '.'))
+      return true;
+  return false;
+}
+
 } // namespace MOS
 } // namespace llvm
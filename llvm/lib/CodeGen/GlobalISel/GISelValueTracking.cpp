@@ -629,6 +629,28 @@ void GISelValueTracking::computeKnownBitsImpl(Register R, KnownBits &Known,
   case TargetOpcode::G_SSUBE:
   case TargetOpcode::G_UMULO:
   case TargetOpcode::G_SMULO: {
+    // The wrapped result of an addition or subtraction, with an optional
+    // carry (or borrow) in. L - R - B is computed as L + ~R + ~B.
+    if (const auto *AddSub = dyn_cast<GAddSubCarryOut>(&MI);
+        AddSub && AddSub->getDstReg() == R) {
+      KnownBits Carry = KnownBits::makeConstant(APInt(1, 0));
+      if (const auto *CarryIn = dyn_cast<GAddSubCarryInOut>(AddSub)) {
+        if (MRI.getType(CarryIn->getCarryInReg()).getScalarSizeInBits() != 1)
+          break;
+        computeKnownBitsImpl(CarryIn->getCarryInReg(), Carry, DemandedElts,
+                             Depth + 1);
+      }
+      computeKnownBitsImpl(AddSub->getLHSReg(), Known, DemandedElts,
+                           Depth + 1);
+      computeKnownBitsImpl(AddSub->getRHSReg(), Known2, DemandedElts,
+                           Depth + 1);
+      if (AddSub->isSub()) {
+        std::swap(Known2.Zero, Known2.One);
+        std::swap(Carry.Zero, Carry.One);
+      }
+      Known = KnownBits::computeForAddCarry(Known, Known2, Carry);
+      break;
+    }
     if (MI.getOperand(1).getReg() == R) {
       // If we know the result of a compare has the top bits zero, use this
       // info.
@@ -22,6 +22,7 @@
 #include "llvm/Analysis/ValueTracking.h"
 #include "llvm/Analysis/VectorUtils.h"
 #include "llvm/CodeGen/Analysis.h"
+#include "llvm/CodeGen/AssignmentTrackingAnalysis.h"
 #include "llvm/CodeGen/GlobalISel/CSEInfo.h"
 #include "llvm/CodeGen/GlobalISel/CSEMIRBuilder.h"
 #include "llvm/CodeGen/GlobalISel/CallLowering.h"
@@ -103,6 +104,7 @@ char IRTranslator::ID = 0;
 INITIALIZE_PASS_BEGIN(IRTranslator, DEBUG_TYPE, "IRTranslator LLVM IR -> MI",
                 false, false)
 INITIALIZE_PASS_DEPENDENCY(TargetPassConfig)
+INITIALIZE_PASS_DEPENDENCY(AssignmentTrackingAnalysis)
 INITIALIZE_PASS_DEPENDENCY(GISelCSEAnalysisWrapperPass)
 INITIALIZE_PASS_DEPENDENCY(BlockFrequencyInfoWrapperPass)
 INITIALIZE_PASS_DEPENDENCY(StackProtector)
@@ -180,6 +182,10 @@ void IRTranslator::getAnalysisUsage(AnalysisUsage &AU) const {
   }
   AU.addRequired<TargetLibraryInfoWrapperPass>();
   AU.addPreserved<TargetLibraryInfoWrapperPass>();
+  // AssignmentTrackingAnalysis only runs if assignment tracking is enabled for
+  // the module.
+  AU.addRequired<AssignmentTrackingAnalysis>();
+  AU.addPreserved<AssignmentTrackingAnalysis>();
   getSelectionDAGFallbackAnalysisUsage(AU);
   MachineFunctionPass::getAnalysisUsage(AU);
 }
@@ -2267,11 +2273,13 @@ bool IRTranslator::translateKnownIntrinsic(const CallInst &CI, Intrinsic::ID ID,
   case Intrinsic::dbg_assign:
     // A dbg.assign is a dbg.value with more information about stack locations,
     // typically produced during optimisation of variables with leaked
-    // addresses. We can treat it like a normal dbg_value intrinsic here; to
-    // benefit from the full analysis of stack/SSA locations, GlobalISel would
-    // need to register for and use the AssignmentTrackingAnalysis pass.
+    // addresses. When assignment tracking is enabled, the locations computed
+    // by AssignmentTrackingAnalysis are emitted instead by translateDbgInfo;
+    // otherwise, we can treat it like a normal dbg_value intrinsic here.
     [[fallthrough]];
   case Intrinsic::dbg_value: {
+    if (FnVarLocs)
+      return true;
     // This form of DBG_VALUE is target-independent.
     const DbgValueInst &DI = cast<DbgValueInst>(CI);
     translateDbgValueRecord(DI.getValue(), DI.hasArgList(), DI.getVariable(),
@@ -3709,6 +3717,22 @@ void IRTranslator::translateDbgDeclareRecord(Value *Address, bool HasArgList,
 
 void IRTranslator::translateDbgInfo(const Instruction &Inst,
                                       MachineIRBuilder &MIRBuilder) {
+  // With assignment tracking, the analysis gives the locations of variables
+  // just before each instruction, and these supersede the records.
+  if (FnVarLocs) {
+    for (auto It = FnVarLocs->locs_begin(&Inst),
+              End = FnVarLocs->locs_end(&Inst);
+         It != End; ++It) {
+      const DILocalVariable *Variable =
+          FnVarLocs->getDILocalVariable(It->VariableID);
+      Value *V = It->Values.isKillLocation(It->Expr) || It->Values.hasArgList()
+                     ? nullptr
+                     : It->Values.getVariableLocationOp(0);
+      translateDbgValueRecord(V, /*HasArgList=*/false, Variable, It->Expr,
+                              It->DL, MIRBuilder);
+    }
+  }
+
   for (DbgRecord &DR : Inst.getDbgRecordRange()) {
     if (DbgLabelRecord *DLR = dyn_cast<DbgLabelRecord>(&DR)) {
       MIRBuilder.setDebugLoc(DLR->getDebugLoc());
@@ -3719,6 +3743,8 @@ void IRTranslator::translateDbgInfo(const Instruction &Inst,
       MIRBuilder.buildDbgLabel(DLR->getLabel());
       continue;
     }
+    if (FnVarLocs)
+      continue;
     DbgVariableRecord &DVR = cast<DbgVariableRecord>(DR);
     const DILocalVariable *Variable = DVR.getVariable();
     const DIExpression *Expression = DVR.getExpression();
@@ -4119,6 +4145,9 @@ bool IRTranslator::runOnMachineFunction(MachineFunction &CurMF) {
   TM.resetTargetOptions(F);
   EnableOpts = OptLevel != CodeGenOptLevel::None && !skipFunction(F);
   FuncInfo.MF = MF;
+  FnVarLocs = isAssignmentTrackingEnabled(*F.getParent())
+                  ? getAnalysis<AssignmentTrackingAnalysis>().getResults()
+                  : nullptr;
   if (EnableOpts) {
     AA = &getAnalysis<AAResultsWrapperPass>().getAAResults();
     FuncInfo.BPI = &getAnalysis<BranchProbabilityInfoWrapperPass>().getBPI();
@@ -4215,6 +4244,22 @@ bool IRTranslator::runOnMachineFunction(MachineFunction &CurMF) {
     return false;
   }
 
+  // Variables with a single location for their whole scope are described like
+  // dbg.declares. This is done after argument lowering in case the locations
+  // refer to arguments.
+  if (FnVarLocs) {
+    for (auto It = FnVarLocs->single_locs_begin(),
+              End = FnVarLocs->single_locs_end();
+         It != End; ++It) {
+      assert(!It->Values.hasArgList() &&
+             "Single loc variadic ops not supported");
+      translateDbgDeclareRecord(It->Values.getVariableLocationOp(0),
+                                /*HasArgList=*/false,
+                                FnVarLocs->getDILocalVariable(It->VariableID),
+                                It->Expr, It->DL, *EntryBuilder);
+    }
+  }
+
   // Need to visit defs before uses when translating instructions.
   GISelObserverWrapper WrapperObserver;
   if (EnableCSE && CSEInfo)
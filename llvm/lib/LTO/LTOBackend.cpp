@@ -471,7 +471,7 @@ static void codegen(const Config &Conf, TargetMachine *TM,
 }
 
 static void splitCodeGen(const Config &C, TargetMachine *TM,
-                         AddStreamFn AddStream,
+                         AddStreamFn AddStream, FileCache Cache,
                          unsigned ParallelCodeGenParallelismLevel, Module &Mod,
                          const ModuleSummaryIndex &CombinedIndex) {
   DefaultThreadPool CodegenThreadPool(
@@ -490,10 +490,25 @@ static void splitCodeGen(const Config &C, TargetMachine *TM,
         SmallString<0> BC;
         raw_svector_ostream BCOS(BC);
         WriteBitcodeToFile(*MPart, BCOS);
+        unsigned Task = ThreadCount++;
+
+        // A partition whose bitcode is unchanged since a previous link needs
+        // no code generation; the cache hands its object to the linker.
+        AddStreamFn PartAddStream = AddStream;
+        if (Cache.isValid()) {
+          Expected<AddStreamFn> CacheAddStreamOrErr = Cache(
+              Task, computeLTOPartitionCacheKey(C, BC.str()), "ld-temp.o");
+          if (!CacheAddStreamOrErr)
+            report_fatal_error(CacheAddStreamOrErr.takeError());
+          if (!*CacheAddStreamOrErr)
+            return;
+          PartAddStream = std::move(*CacheAddStreamOrErr);
+        }
 
         // Enqueue the task
         CodegenThreadPool.async(
-            [&](const SmallString<0> &BC, unsigned ThreadId) {
+            [&](const SmallString<0> &BC, unsigned ThreadId,
+                const AddStreamFn &TaskAddStream) {
               LTOLLVMContext Ctx(C);
               Expected<std::unique_ptr<Module>> MOrErr =
                   parseBitcodeFile(MemoryBufferRef(BC.str(), "ld-temp.o"), Ctx);
@@ -504,12 +519,12 @@ static void splitCodeGen(const Config &C, TargetMachine *TM,
               std::unique_ptr<TargetMachine> TM =
                   createTargetMachine(C, T, *MPartInCtx);
 
-              codegen(C, TM.get(), AddStream, ThreadId, *MPartInCtx,
+              codegen(C, TM.get(), TaskAddStream, ThreadId, *MPartInCtx,
                       CombinedIndex);
             },
             // Pass BC using std::move to ensure that it get moved rather than
             // copied into the thread's context.
-            std::move(BC), ThreadCount++);
+            std::move(BC), Task, std::move(PartAddStream));
       };
 
   // Try target-specific module splitting first, then fallback to the default.
@@ -552,7 +567,7 @@ Error lto::finalizeOptimizationRemarks(LLVMRemarkFileHandle DiagOutputFile) {
 
 Error lto::backend(const Config &C, AddStreamFn AddStream,
                    unsigned ParallelCodeGenParallelismLevel, Module &Mod,
-                   ModuleSummaryIndex &CombinedIndex) {
+                   ModuleSummaryIndex &CombinedIndex, FileCache Cache) {
   llvm::TimeTraceScope timeScope("LTO backend");
   Expected<const Target *> TOrErr = initAndLookupTarget(C, Mod);
   if (!TOrErr)
@@ -571,8 +586,8 @@ Error lto::backend(const Config &C, AddStreamFn AddStream,
   if (ParallelCodeGenParallelismLevel == 1) {
     codegen(C, TM.get(), AddStream, 0, Mod, CombinedIndex);
   } else {
-    splitCodeGen(C, TM.get(), AddStream, ParallelCodeGenParallelismLevel, Mod,
-                 CombinedIndex);
+    splitCodeGen(C, TM.get(), AddStream, std::move(Cache),
+                 ParallelCodeGenParallelismLevel, Mod, CombinedIndex);
   }
   return Error::success();
 }
@@ -180,6 +180,16 @@ static std::unique_ptr<Writer> createWriter(const CommonConfig &Config,
     return std::make_unique<IHexWriter>(Obj, Out, Config.OutputFilename);
   case FileFormat::SREC:
     return std::make_unique<SRECWriter>(Obj, Out, Config.OutputFilename);
+  case FileFormat::INES:
+    return std::make_unique<INESWriter>(Obj, Out, Config);
+  case FileFormat::PCE:
+    return std::make_unique<PCEWriter>(Obj, Out, Config);
+  case FileFormat::PRG:
+    return std::make_unique<PRGWriter>(Obj, Out, Config);
+  case FileFormat::CRT:
+    return std::make_unique<CRTWriter>(Obj, Out, Config);
+  case FileFormat::XEX:
+    return std::make_unique<XEXWriter>(Obj, Out, Config);
   default:
     return createELFWriter(Config, Obj, Out, OutputElfType);
   }
@@ -23,6 +23,7 @@
 #include <cstddef>
 #include <cstdint>
 #include <iterator>
+#include <map>
 #include <unordered_set>
 #include <utility>
 #include <vector>
@@ -858,6 +859,13 @@ Expected<Symbol *> SymbolTableSection::getSymbolByIndex(uint32_t Index) {
   return const_cast<Symbol *>(*Sym);
 }
 
+const Symbol *SymbolTableSection::findSymbol(StringRef Name) const {
+  for (const SymPtr &Sym : llvm::drop_begin(Symbols))
+    if (Sym->Name == Name && Sym->getShndx() != SHN_UNDEF)
+      return Sym.get();
+  return nullptr;
+}
+
 template <class ELFT>
 Error ELFSectionWriter<ELFT>::visit(const SymbolTableSection &Sec) {
   Elf_Sym *Sym = reinterpret_cast<Elf_Sym *>(Out.getBufferStart() + Sec.Offset);
@@ -3068,6 +3076,297 @@ Error SRECWriter::write() {
   return Error::success();
 }
 
+static void appendLE16(SmallVectorImpl<uint8_t> &Out, uint16_t Val) {
+  Out.push_back(Val & 0xff);
+  Out.push_back(Val >> 8);
+}
+
+static void appendBE16(SmallVectorImpl<uint8_t> &Out, uint16_t Val) {
+  Out.push_back(Val >> 8);
+  Out.push_back(Val & 0xff);
+}
+
+static void appendBE32(SmallVectorImpl<uint8_t> &Out, uint32_t Val) {
+  appendBE16(Out, Val >> 16);
+  appendBE16(Out, Val & 0xffff);
+}
+
+SmallVector<std::pair<uint64_t, uint64_t>> MOSImageWriter::getRuns() const {
+  SmallVector<std::pair<uint64_t, uint64_t>> Runs;
+  for (const SectionBase *Sec : Sections) {
+    uint64_t Addr = sectionPhysicalAddr(Sec);
+    if (!Runs.empty() && Addr <= Runs.back().second)
+      Runs.back().second = std::max(Runs.back().second, Addr + Sec->Size);
+    else
+      Runs.push_back({Addr, Addr + Sec->Size});
+  }
+  return Runs;
+}
+
+uint64_t MOSImageWriter::getSymbolValue(StringRef Name,
+                                        uint64_t Default) const {
+  if (!Obj.SymbolTable)
+    return Default;
+  const Symbol *Sym = Obj.SymbolTable->findSymbol(Name);
+  return Sym ? Sym->Value : Default;
+}
+
+Error MOSImageWriter::check16Bit(const SectionBase &Sec) const {
+  uint64_t Addr = sectionPhysicalAddr(&Sec);
+  if (Addr + Sec.Size > 0x10000)
+    return createStringError(
+        errc::invalid_argument,
+        "section '%s' address range [0x%llx, 0x%llx] is not 16 bit",
+        Sec.Name.c_str(), Addr, Addr + Sec.Size - 1);
+  return Error::success();
+}
+
+Error MOSImageWriter::finalize() {
+  for (SectionBase &Sec : Obj.allocSections())
+    if (Sec.Type != SHT_NOBITS && Sec.Size > 0)
+      Sections.push_back(&Sec);
+  llvm::stable_sort(Sections, [](const SectionBase *A, const SectionBase *B) {
+    return sectionPhysicalAddr(A) < sectionPhysicalAddr(B);
+  });
+
+  if (Error E = layout())
+    return E;
+
+  // Place each section in the chunk that holds its addresses. Since both are
+  // in order of address, this is a single walk over each.
+  uint64_t Offset = 0;
+  auto SecIt = Sections.begin();
+  for (const MOSImageChunk &Chunk : Chunks) {
+    Offset += Chunk.Header.size();
+    for (; SecIt != Sections.end() && sectionPhysicalAddr(*SecIt) < Chunk.End;
+         ++SecIt) {
+      SectionBase &Sec = **SecIt;
+      uint64_t Addr = sectionPhysicalAddr(&Sec);
+      if (Addr < Chunk.Begin || Addr + Sec.Size > Chunk.End)
+        return createStringError(
+            errc::invalid_argument,
+            "section '%s' address range [0x%llx, 0x%llx] crosses a boundary "
+            "of the image",
+            Sec.Name.c_str(), Addr, Addr + Sec.Size - 1);
+      Sec.Offset = Offset + Addr - Chunk.Begin;
+    }
+    Offset += Chunk.End - Chunk.Begin;
+  }
+  assert(SecIt == Sections.end() && "section not covered by any chunk");
+
+  Buf = WritableMemoryBuffer::getNewMemBuffer(Offset);
+  if (!Buf)
+    return createStringError(errc::not_enough_memory,
+                             "failed to allocate memory buffer of 0x" +
+                                 Twine::utohexstr(Offset) + " bytes");
+  SecWriter = std::make_unique<BinarySectionWriter>(*Buf);
+  return Error::success();
+}
+
+Error MOSImageWriter::write() {
+  uint8_t *Data = reinterpret_cast<uint8_t *>(Buf->getBufferStart());
+  for (const MOSImageChunk &Chunk : Chunks) {
+    Data = llvm::copy(Chunk.Header, Data);
+    Data = std::fill_n(Data, Chunk.End - Chunk.Begin, GapFill);
+  }
+  for (const SectionBase *Sec : Sections)
+    if (Error E = Sec->accept(*SecWriter))
+      return E;
+  Out.write(Buf->getBufferStart(), Buf->getBufferSize());
+  return Error::success();
+}
+
+Error PRGWriter::layout() {
+  if (Sections.empty())
+    return Error::success();
+
+  MOSImageChunk Chunk;
+  Chunk.Begin = sectionPhysicalAddr(Sections.front());
+  for (const SectionBase *Sec : Sections) {
+    if (Error E = check16Bit(*Sec))
+      return E;
+    Chunk.End = std::max(Chunk.End, sectionPhysicalAddr(Sec) + Sec->Size);
+  }
+  appendLE16(Chunk.Header, Chunk.Begin);
+  Chunks.push_back(std::move(Chunk));
+  return Error::success();
+}
+
+Error XEXWriter::layout() {
+  for (const SectionBase *Sec : Sections)
+    if (Error E = check16Bit(*Sec))
+      return E;
+  if (Obj.Entry > 0xffff)
+    return createStringError(errc::invalid_argument,
+                             "entry point address 0x%llx is not 16 bit",
+                             Obj.Entry);
+
+  // Only the first segment must begin with the $FFFF signature.
+  auto AddSegment = [&](uint64_t Begin, uint64_t End) -> MOSImageChunk & {
+    MOSImageChunk &Chunk = Chunks.emplace_back();
+    if (Chunks.size() == 1)
+      appendLE16(Chunk.Header, 0xffff);
+    appendLE16(Chunk.Header, Begin);
+    appendLE16(Chunk.Header, End - 1);
+    return Chunk;
+  };
+  for (auto [Begin, End] : getRuns()) {
+    MOSImageChunk &Chunk = AddSegment(Begin, End);
+    Chunk.Begin = Begin;
+    Chunk.End = End;
+  }
+  // DOS jumps to the address in RUNAD once the whole file is loaded.
+  if (Obj.Entry)
+    appendLE16(AddSegment(0x2e0, 0x2e2).Header, Obj.Entry);
+  return Error::success();
+}
+
+Error INESWriter::layout() {
+  uint64_t PRGSize = 0;
+  uint64_t CHRSize = 0;
+  for (const SectionBase *Sec : Sections) {
+    uint64_t Addr = sectionPhysicalAddr(Sec);
+    if (Addr >= PRGBase && Addr < CHRBase)
+      PRGSize = std::max(PRGSize, Addr + Sec->Size - PRGBase);
+    else if (Addr >= CHRBase && Addr < CHRBase + (CHRBase - PRGBase))
+      CHRSize = std::max(CHRSize, Addr + Sec->Size - CHRBase);
+    else
+      return createStringError(
+          errc::invalid_argument,
+          "section '%s' at 0x%llx is in neither PRG-ROM nor CHR-ROM",
+          Sec->Name.c_str(), Addr);
+  }
+
+  // The header gives the sizes of PRG-ROM in 16 KiB units, and CHR-ROM in 8
+  // KiB units. A cartridge without CHR-ROM uses CHR-RAM instead.
+  uint64_t PRGUnits = divideCeil(PRGSize, 0x4000);
+  uint64_t CHRUnits = divideCeil(CHRSize, 0x2000);
+  if (!PRGUnits)
+    return createStringError(errc::invalid_argument,
+                             "iNES image has no PRG-ROM");
+  if (PRGUnits > 0xff || CHRUnits > 0xff)
+    return createStringError(
+        errc::invalid_argument,
+        "PRG-ROM size 0x%llx or CHR-ROM size 0x%llx is too large for iNES",
+        PRGSize, CHRSize);
+  uint64_t Mapper = getSymbolValue("__mapper", 0);
+  if (Mapper > 0xff)
+    return createStringError(errc::invalid_argument,
+                             "mapper %llu is too large for iNES", Mapper);
+
+  MOSImageChunk &PRG = Chunks.emplace_back();
+  PRG.Header = {'N', 'E', 'S', 0x1a, uint8_t(PRGUnits), uint8_t(CHRUnits)};
+  PRG.Header.push_back((Mapper & 0xf) << 4 |
+                       (getSymbolValue("__four_screen", 0) & 1) << 3 |
+                       (getSymbolValue("__battery", 0) & 1) << 1 |
+                       (getSymbolValue("__mirroring", 0) & 1));
+  PRG.Header.push_back(Mapper & 0xf0);
+  PRG.Header.resize(16);
+  PRG.Begin = PRGBase;
+  PRG.End = PRGBase + PRGUnits * 0x4000;
+  if (CHRUnits) {
+    MOSImageChunk &CHR = Chunks.emplace_back();
+    CHR.Begin = CHRBase;
+    CHR.End = CHRBase + CHRUnits * 0x2000;
+  }
+  return Error::success();
+}
+
+Error PCEWriter::layout() {
+  uint64_t Size = 0;
+  for (const SectionBase *Sec : Sections) {
+    uint64_t Addr = sectionPhysicalAddr(Sec);
+    if (Addr < PRGBase || Addr >= CHRBase)
+      return createStringError(errc::invalid_argument,
+                               "section '%s' at 0x%llx is not in the ROM",
+                               Sec->Name.c_str(), Addr);
+    Size = std::max(Size, Addr + Sec->Size - PRGBase);
+  }
+  if (!Size)
+    return Error::success();
+
+  MOSImageChunk &ROM = Chunks.emplace_back();
+  ROM.Begin = PRGBase;
+  ROM.End = PRGBase + alignTo(Size, 0x2000);
+  return Error::success();
+}
+
+Error CRTWriter::layout() {
+  // The 8 KiB windows used in each bank, keyed by the physical address of the
+  // bank. The cartridge ROM appears at $8000-$9FFF (ROML), $A000-$BFFF (ROMH)
+  // or, in Ultimax mode, $E000-$FFFF.
+  std::map<uint64_t, uint8_t> Windows;
+  for (const SectionBase *Sec : Sections) {
+    uint64_t Addr = sectionPhysicalAddr(Sec);
+    uint64_t BankAddr = Addr & ~uint64_t(0xffff);
+    uint64_t First = (Addr & 0xffff) >> 13;
+    uint64_t Last = (Addr - BankAddr + Sec->Size - 1) >> 13;
+    for (uint64_t W = First; W <= Last; ++W) {
+      if ((BankAddr && BankAddr < PRGBase) || BankAddr >= CHRBase ||
+          (W != 4 && W != 5 && W != 7))
+        return createStringError(
+            errc::invalid_argument,
+            "section '%s' address range [0x%llx, 0x%llx] is outside the "
+            "cartridge ROM",
+            Sec->Name.c_str(), Addr, Addr + Sec->Size - 1);
+      Windows[BankAddr] |= 1 << W;
+    }
+  }
+
+  uint8_t AllWindows = 0;
+  for (const auto &[BankAddr, Mask] : Windows)
+    AllWindows |= Mask;
+  // The lines are active low: GAME alone selects an 8 KiB cartridge, both a
+  // 16 KiB one, and EXROM alone Ultimax mode.
+  bool Ultimax = AllWindows & 1 << 7;
+  bool HasROMH = AllWindows & 1 << 5;
+  uint8_t EXROM = getSymbolValue("__cart_exrom", Ultimax);
+  uint8_t GAME = getSymbolValue("__cart_game", !Ultimax && !HasROMH);
+
+  MOSImageChunk &Header = Chunks.emplace_back();
+  StringRef Signature = "C64 CARTRIDGE   ";
+  Header.Header.append(Signature.begin(), Signature.end());
+  appendBE32(Header.Header, 0x40);
+  appendBE16(Header.Header, 0x0100);
+  appendBE16(Header.Header, getSymbolValue("__cart_type", 0));
+  Header.Header.push_back(EXROM);
+  Header.Header.push_back(GAME);
+  Header.Header.resize(0x20);
+  std::string Name = sys::path::stem(OutputFileName).upper();
+  Name.resize(std::min<size_t>(Name.size(), 0x20));
+  Header.Header.append(Name.begin(), Name.end());
+  Header.Header.resize(0x40);
+
+  auto AddChip = [&](uint64_t BankAddr, uint64_t Window, uint64_t Size) {
+    MOSImageChunk &Chip = Chunks.emplace_back();
+    uint64_t Bank = BankAddr ? (BankAddr - PRGBase) >> 16 : 0;
+    uint64_t LoadAddr = Window << 13;
+    Chip.Header = {'C', 'H', 'I', 'P'};
+    appendBE32(Chip.Header, 0x10 + Size);
+    // The chip type of ROM.
+    appendBE16(Chip.Header, 0);
+    appendBE16(Chip.Header, Bank);
+    appendBE16(Chip.Header, LoadAddr);
+    appendBE16(Chip.Header, Size);
+    Chip.Begin = BankAddr + LoadAddr;
+    Chip.End = Chip.Begin + Size;
+  };
+  for (const auto &[BankAddr, Mask] : Windows) {
+    // ROML and ROMH together form one 16 KiB chip.
+    if ((Mask & 0x30) == 0x30) {
+      AddChip(BankAddr, 4, 0x4000);
+    } else {
+      if (Mask & 1 << 4)
+        AddChip(BankAddr, 4, 0x2000);
+      if (Mask & 1 << 5)
+        AddChip(BankAddr, 5, 0x2000);
+    }
+    if (Mask & 1 << 7)
+      AddChip(BankAddr, 7, 0x2000);
+  }
+  return Error::success();
+}
+
 namespace llvm {
 namespace objcopy {
 namespace elf {
@@ -417,6 +417,118 @@ private:
   getTotalSize(WritableMemoryBuffer &EmptyBuffer) const override;
 };
 
+// A piece of a MOS platform image: a header of the format's own, followed by
+// the contents of the physical addresses [Begin, End).
+struct MOSImageChunk {
+  SmallVector<uint8_t, 16> Header;
+  uint64_t Begin = 0;
+  uint64_t End = 0;
+};
+
+// A base class for writing the executable and ROM image formats of MOS
+// platforms. An image is a sequence of chunks laid out by the format, into
+// which the allocated sections are copied by physical address. Any gaps
+// between sections within a chunk are filled with the gap fill byte.
+//
+// ROM images are linked at physical addresses in regions of their own: from
+// PRGBase on for the program ROM of a cartridge, and from CHRBase on for the
+// character ROM of a NES cartridge.
+class MOSImageWriter : public Writer {
+public:
+  static constexpr uint64_t PRGBase = 0x01000000;
+  static constexpr uint64_t CHRBase = 0x02000000;
+
+  MOSImageWriter(Object &Obj, raw_ostream &Out, const CommonConfig &Config)
+      : Writer(Obj, Out), GapFill(Config.GapFill) {}
+  Error finalize() override;
+  Error write() override;
+
+protected:
+  // The sections to write, sorted by physical address.
+  std::vector<SectionBase *> Sections;
+  // The chunks of the image, in file order. The chunks holding contents must
+  // also be in order of address.
+  std::vector<MOSImageChunk> Chunks;
+
+  // Splits the image into chunks.
+  virtual Error layout() = 0;
+
+  // Returns the maximal ranges of consecutive addresses covered by sections.
+  SmallVector<std::pair<uint64_t, uint64_t>> getRuns() const;
+  // Returns the value of the named defined symbol, or Default if there is
+  // none.
+  uint64_t getSymbolValue(StringRef Name, uint64_t Default) const;
+  // Checks that a section can be addressed with 16 bits.
+  Error check16Bit(const SectionBase &Sec) const;
+
+private:
+  const uint8_t GapFill;
+  std::unique_ptr<BinarySectionWriter> SecWriter;
+};
+
+// Writes a Commodore PRG file: the 16-bit load address, followed by a flat
+// copy of the program.
+class PRGWriter : public MOSImageWriter {
+public:
+  PRGWriter(Object &Obj, raw_ostream &Out, const CommonConfig &Config)
+      : MOSImageWriter(Obj, Out, Config) {}
+
+private:
+  Error layout() override;
+};
+
+// Writes an Atari XEX file: one segment for each range of consecutive
+// addresses, followed by a segment holding the entry point in RUNAD.
+class XEXWriter : public MOSImageWriter {
+public:
+  XEXWriter(Object &Obj, raw_ostream &Out, const CommonConfig &Config)
+      : MOSImageWriter(Obj, Out, Config) {}
+
+private:
+  Error layout() override;
+};
+
+// Writes an iNES image of a NES cartridge. The mapper and mirroring fields
+// of the header come from the symbols __mapper, __mirroring, __battery and
+// __four_screen, where defined.
+class INESWriter : public MOSImageWriter {
+public:
+  INESWriter(Object &Obj, raw_ostream &Out, const CommonConfig &Config)
+      : MOSImageWriter(Obj, Out, Config) {}
+
+private:
+  Error layout() override;
+};
+
+// Writes a PC Engine HuCard image: the program ROM, padded to a whole number
+// of 8 KiB banks.
+class PCEWriter : public MOSImageWriter {
+public:
+  PCEWriter(Object &Obj, raw_ostream &Out, const CommonConfig &Config)
+      : MOSImageWriter(Obj, Out, Config) {}
+
+private:
+  Error layout() override;
+};
+
+// Writes a C64 CRT image of a cartridge, with a CHIP packet for each bank and
+// window of the cartridge ROM. The program ROM region holds 64 KiB per bank,
+// each at its CPU addresses; an unbanked cartridge may instead be linked
+// directly at its CPU addresses. The hardware type and the EXROM and GAME
+// lines of the header come from the symbols __cart_type, __cart_exrom and
+// __cart_game, where defined.
+class CRTWriter : public MOSImageWriter {
+public:
+  CRTWriter(Object &Obj, raw_ostream &Out, const CommonConfig &Config)
+      : MOSImageWriter(Obj, Out, Config),
+        OutputFileName(Config.OutputFilename) {}
+
+private:
+  StringRef OutputFileName;
+
+  Error layout() override;
+};
+
 using SRecLineData = SmallVector<char, 64>;
 struct SRecord {
   uint8_t Type;
@@ -840,6 +952,7 @@ public:
   const SectionBase *getStrTab() const { return SymbolNames; }
   Expected<const Symbol *> getSymbolByIndex(uint32_t Index) const;
   Expected<Symbol *> getSymbolByIndex(uint32_t Index);
+  const Symbol *findSymbol(StringRef Name) const;
   void updateSymbols(function_ref<void(Symbol &)> Callable);
 
   Error removeSectionReferences(
@@ -0,0 +1,184 @@
+//===-- MOSStats.cpp - MOS Footprint Summary ------------------------------===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file summarizes the memory and cycle footprint of a MOS ELF file.
+///
+//===----------------------------------------------------------------------===//
+
+#include "llvm/Object/MOSStats.h"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/BinaryFormat/ELF.h"
+#include "llvm/BinaryFormat/MOSFlags.h"
+#include "llvm/Object/ELFObjectFile.h"
+#include "llvm/Support/Endian.h"
+#include <utility>
+
+using namespace llvm;
+using namespace llvm::object;
+
+namespace {
+
+using ELFT = ELF32LE;
+using Elf_Shdr = ELFT::Shdr;
+using Elf_Sym = ELFT::Sym;
+using Elf_Rela = ELFT::Rela;
+using Elf_Note = ELFT::Note;
+
+// A location of code: a section index and an offset within that section in
+// relocatable files, or section zero and an address in linked ones.
+using Location = std::pair<unsigned, uint64_t>;
+
+} // namespace
+
+static bool isZeroPage(const Elf_Shdr &Sec, StringRef Name) {
+  return (Sec.sh_flags & ELF::SHF_MOS_ZEROPAGE) ||
+         MOS::isZeroPageSectionName(Name);
+}
+
+Expected<MOSStats> object::getMOSStats(const ObjectFile &File) {
+  const auto *ELFObj = dyn_cast<ELF32LEObjectFile>(&File);
+  if (!ELFObj || ELFObj->getELFFile().getHeader().e_machine != ELF::EM_MOS)
+    return createStringError(object_error::invalid_file_type,
+                             "not a MOS ELF file");
+  const ELFFile<ELFT> &Obj = ELFObj->getELFFile();
+  bool Relocatable = Obj.getHeader().e_type == ELF::ET_REL;
+
+  Expected<ELFFile<ELFT>::Elf_Shdr_Range> SectionsOrErr = Obj.sections();
+  if (!SectionsOrErr)
+    return SectionsOrErr.takeError();
+  ELFFile<ELFT>::Elf_Shdr_Range Sections = *SectionsOrErr;
+
+  MOSStats Stats;
+  const Elf_Shdr *SymTab = nullptr;
+  const Elf_Shdr *Cycles = nullptr;
+  for (const Elf_Shdr &Sec : Sections) {
+    if (Sec.sh_type == ELF::SHT_SYMTAB)
+      SymTab = &Sec;
+    Expected<StringRef> NameOrErr = Obj.getSectionName(Sec);
+    if (!NameOrErr)
+      return NameOrErr.takeError();
+    if (Sec.sh_type == ELF::SHT_NOTE && *NameOrErr == ".mos.cycles")
+      Cycles = &Sec;
+    if (!(Sec.sh_flags & ELF::SHF_ALLOC))
+      continue;
+
+    if (isZeroPage(Sec, *NameOrErr))
+      Stats.ZeroPage += Sec.sh_size;
+    else if (Sec.sh_flags & ELF::SHF_WRITE)
+      Stats.RAM += Sec.sh_size;
+    if (Sec.sh_type != ELF::SHT_NOBITS)
+      Stats.ROM += Sec.sh_size;
+  }
+
+  // The functions by starting location, for attributing the timed blocks.
+  std::vector<std::pair<Location, size_t>> Starts;
+  if (SymTab) {
+    Expected<ELFFile<ELFT>::Elf_Sym_Range> SymsOrErr = Obj.symbols(SymTab);
+    if (!SymsOrErr)
+      return SymsOrErr.takeError();
+    Expected<StringRef> StrTabOrErr = Obj.getStringTableForSymtab(*SymTab);
+    if (!StrTabOrErr)
+      return StrTabOrErr.takeError();
+
+    StringMap<uint64_t> FrameSizes;
+    for (const Elf_Sym &Sym : *SymsOrErr) {
+      if (Sym.isUndefined() || !Sym.st_size)
+        continue;
+      Expected<StringRef> NameOrErr = Sym.getName(*StrTabOrErr);
+      if (!NameOrErr)
+        return NameOrErr.takeError();
+      if (Sym.getType() == ELF::STT_FUNC) {
+        Location Start = {Relocatable ? Sym.st_shndx : 0, Sym.st_value};
+        Starts.push_back({Start, Stats.Functions.size()});
+        MOSFunctionStats &F = Stats.Functions.emplace_back();
+        F.Name = NameOrErr->str();
+        F.Size = Sym.st_size;
+      } else if (NameOrErr->ends_with("_sstk")) {
+        FrameSizes[NameOrErr->drop_back(5)] = Sym.st_size;
+      }
+    }
+    for (MOSFunctionStats &F : Stats.Functions)
+      F.StaticFrameSize = FrameSizes.lookup(F.Name);
+  }
+  llvm::sort(Starts);
+
+  if (Cycles) {
+    Expected<ArrayRef<uint8_t>> ContentsOrErr =
+        Obj.getSectionContents(*Cycles);
+    if (!ContentsOrErr)
+      return ContentsOrErr.takeError();
+
+    // In relocatable files, the block addresses are given by relocations,
+    // found here by their offsets within the note section.
+    DenseMap<uint64_t, Location> Relocated;
+    unsigned CyclesIndex = Cycles - Sections.begin();
+    for (const Elf_Shdr &Sec : Sections) {
+      if (Sec.sh_type != ELF::SHT_RELA || Sec.sh_info != CyclesIndex)
+        continue;
+      Expected<const Elf_Shdr *> RelSymTabOrErr = Obj.getSection(Sec.sh_link);
+      if (!RelSymTabOrErr)
+        return RelSymTabOrErr.takeError();
+      Expected<ELFFile<ELFT>::Elf_Rela_Range> RelasOrErr = Obj.relas(Sec);
+      if (!RelasOrErr)
+        return RelasOrErr.takeError();
+      for (const Elf_Rela &R : *RelasOrErr) {
+        Expected<const Elf_Sym *> SymOrErr =
+            Obj.getRelocationSymbol(R, *RelSymTabOrErr);
+        if (!SymOrErr)
+          return SymOrErr.takeError();
+        if (*SymOrErr)
+          Relocated[R.r_offset] = {(*SymOrErr)->st_shndx,
+                                   (*SymOrErr)->st_value + R.r_addend};
+      }
+    }
+
+    Error Err = Error::success();
+    for (const Elf_Note &Note : Obj.notes(*Cycles, Err)) {
+      if (Note.getName() != "MOS" || Note.getType() != ELF::NT_MOS_CYCLES)
+        continue;
+      ArrayRef<uint8_t> Desc = Note.getDesc(Cycles->sh_addralign);
+      uint64_t DescOffset = Desc.data() - ContentsOrErr->data();
+      for (size_t I = 0; I + 8 <= Desc.size(); I += 8) {
+        const uint8_t *Entry = Desc.data() + I;
+        Location Loc = {0, support::endian::read32le(Entry)};
+        auto It = Relocated.find(DescOffset + I);
+        if (It != Relocated.end())
+          Loc = It->second;
+
+        // The block belongs to the last function starting at or before it,
+        // if the function extends that far.
+        auto Start = llvm::upper_bound(Starts, Loc, [](const Location &L,
+                                                       const auto &S) {
+          return L < S.first;
+        });
+        if (Start == Starts.begin())
+          continue;
+        --Start;
+        MOSFunctionStats &F = Stats.Functions[Start->second];
+        if (Start->first.first != Loc.first ||
+            Loc.second >= Start->first.second + F.Size)
+          continue;
+        ++F.TimedBlocks;
+        F.BestCycles += support::endian::read16le(Entry + 4);
+        F.WorstCycles += support::endian::read16le(Entry + 6);
+      }
+    }
+    if (Err)
+      return std::move(Err);
+  }
+
+  llvm::stable_sort(Stats.Functions,
+                    [](const MOSFunctionStats &A, const MOSFunctionStats &B) {
+                      return A.Name < B.Name;
+                    });
+  return Stats;
+}
@@ -930,6 +930,7 @@ bool SIFrameLowering::isSupportedStackID(TargetStackID::Value ID) const {
   case TargetStackID::WasmLocal:
   case TargetStackID::MosStatic:
   case TargetStackID::MosZeroPage:
+  case TargetStackID::MosHardStack:
     return false;
   }
   llvm_unreachable("Invalid TargetStackID::Value");
@@ -6,6 +6,7 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include "MCTargetDesc/MOSAsmBackend.h"
 #include "MCTargetDesc/MOSFixupKinds.h"
 #include "MCTargetDesc/MOSMCELFStreamer.h"
 #include "MCTargetDesc/MOSMCExpr.h"
@@ -305,6 +306,9 @@ public:
 
   bool emit(MCInst &Inst, SMLoc const &Loc, MCStreamer &Out) const {
     Inst.setLoc(Loc);
+    // The matcher picks the zero page form for any symbolic address. Widen
+    // those already known to lie elsewhere, so they needn't wait for layout.
+    MOSAsmBackend::relaxForImmediate(Inst, getSTI());
     Out.emitInstruction(Inst, getSTI());
 
     return false;
@@ -649,8 +653,8 @@ public:
       Parser.Lex(); // Eat closing parenthesis
     }
 
-    MCExpr const *Expression = MOSMCExpr::create(ModifierKind, InnerExpression,
-                                                 IsNegated, getContext());
+    MCExpr const *Expression = MOSMCExpr::createOrFold(
+        ModifierKind, InnerExpression, IsNegated, getContext());
 
     SMLoc E = SMLoc::getFromPointer(Parser.getTok().getLoc().getPointer() - 1);
     pushExpr(Operands, Expression, S, E);
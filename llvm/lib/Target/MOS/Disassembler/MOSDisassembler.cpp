@@ -24,6 +24,7 @@
 #include "llvm/MC/MCInst.h"
 #include "llvm/MC/TargetRegistry.h"
 #include "llvm/Support/ErrorHandling.h"
+#include <array>
 #include <optional>
 
 using namespace llvm;
@@ -40,6 +41,16 @@ class MOSDisassembler : public MCDisassembler {
   mutable bool MLow = false;
   mutable bool XLow = false;
 
+  // The decoder table and size of the instruction that each opcode byte
+  // begins on this subtarget, or a null table if none does.
+  struct OpcodeEntry {
+    const uint8_t *Table = nullptr;
+    uint8_t Size = 0;
+  };
+  std::array<OpcodeEntry, 256> Opcodes;
+
+  void buildOpcodeTable();
+
 public:
   uint16_t ZeroPageOffset = 0;
 
@@ -47,7 +58,9 @@ public:
       : MCDisassembler(STI, Ctx),
         Has65816RegisterWidths(STI.hasFeature(MOS::FeatureW65816) ||
                                STI.hasFeature(MOS::Feature65EL02)),
-        ZeroPageOffset(STI.hasFeature(MOS::FeatureHUC6280) ? 0x2000 : 0) {}
+        ZeroPageOffset(STI.hasFeature(MOS::FeatureHUC6280) ? 0x2000 : 0) {
+    buildOpcodeTable();
+  }
   Expected<bool> onSymbolStart(SymbolInfoTy &Symbol, uint64_t &Size,
                                ArrayRef<uint8_t> Bytes,
                                uint64_t Address) const override;
@@ -241,6 +254,60 @@ maybeDecodeInstruction(std::optional<const uint8_t *> DecodeTable, MCInst &MI,
   return decodeInstruction(DecodeTable.value(), MI, insn, Address, DisAsm, STI);
 }
 
+// Appends the decoder tables that may hold instructions of the given size on
+// the subtarget, most specific first.
+static void getDecoderTables(const MCSubtargetInfo &STI, size_t Size,
+                             SmallVectorImpl<const uint8_t *> &Tables) {
+  auto Add = [&](std::optional<const uint8_t *> Table) {
+    if (Table)
+      Tables.push_back(*Table);
+  };
+  if (STI.getFeatureBits()[MOS::FeatureSPC700]) {
+    Add(getDecoderTableSPC700(Size));
+    return;
+  }
+  if (STI.getFeatureBits()[MOS::Feature65CE02])
+    Add(getDecoderTable65CE02(Size));
+  if (STI.getFeatureBits()[MOS::Feature65EL02])
+    Add(getDecoderTable65EL02(Size));
+  if (STI.getFeatureBits()[MOS::FeatureW65816])
+    Add(getDecoderTableW65816(Size));
+  if (STI.getFeatureBits()[MOS::FeatureHUC6280])
+    Add(getDecoderTableHUC6280(Size));
+  if (STI.getFeatureBits()[MOS::FeatureR65C02])
+    Add(getDecoderTableR65C02(Size));
+  if (STI.getFeatureBits()[MOS::Feature65DTV02])
+    Add(getDecoderTable65DTV02(Size));
+  if (STI.getFeatureBits()[MOS::Feature6502X])
+    Add(getDecoderTable6502X(Size));
+  Add(getDecoderTable(Size));
+}
+
+// Outside of the 45GS02 prefixed instructions and the 65816 16-bit
+// immediates, only the first byte of an instruction is fixed, so a search of
+// the tables for each opcode byte decides every instruction it begins. This
+// saves trying each table in turn for each instruction.
+void MOSDisassembler::buildOpcodeTable() {
+  static constexpr size_t MaxInsnSize = 7;
+  SmallVector<const uint8_t *> Tables[MaxInsnSize + 1];
+  for (size_t InsnSize : seq_inclusive<size_t>(1, MaxInsnSize))
+    getDecoderTables(STI, InsnSize, Tables[InsnSize]);
+
+  for (unsigned Op : seq(0u, 256u)) {
+    for (size_t InsnSize : seq_inclusive<size_t>(1, MaxInsnSize)) {
+      const auto *It = find_if(Tables[InsnSize], [&](const uint8_t *Table) {
+        MCInst Inst;
+        return decodeInstruction(Table, Inst, uint64_t(Op), 0, this, STI) !=
+               MCDisassembler::Fail;
+      });
+      if (It != Tables[InsnSize].end()) {
+        Opcodes[Op] = {*It, static_cast<uint8_t>(InsnSize)};
+        break;
+      }
+    }
+  }
+}
+
 Expected<bool> MOSDisassembler::onSymbolStart(SymbolInfoTy &Symbol,
                                               uint64_t &Size,
                                               ArrayRef<uint8_t> Bytes,
@@ -266,28 +333,13 @@ DecodeStatus MOSDisassembler::getInstruction(MCInst &Instr, uint64_t &Size,
                                              raw_ostream &CStream) const {
   Size = 0;
 
-  // If on SPC700, process the SPC700 table only.
-  if (STI.getFeatureBits()[MOS::FeatureSPC700]) {
-    for (size_t InsnSize : seq_inclusive(1, 3)) {
-      if (Bytes.size() < InsnSize) {
-        return MCDisassembler::Fail;
-      }
-      uint64_t Insn = 0;
-      for (size_t Byte : seq((size_t)0, InsnSize)) {
-        Insn |= ((uint64_t)Bytes[Byte]) << (8 * Byte);
-      }
-      DecodeStatus Result = maybeDecodeInstruction(
-          getDecoderTableSPC700(InsnSize), Instr, Insn, Address, this, STI);
-      if (Result != MCDisassembler::Fail) {
-        Size = InsnSize;
-        return Result;
-      }
-    }
+  if (Bytes.empty())
     return MCDisassembler::Fail;
-  }
 
-  // Check for 45GS02 extended mnemonics (5, 4, or 3 bytes)
-  if (STI.getFeatureBits()[MOS::Feature45GS02]) {
+  // Check for 45GS02 extended mnemonics (5, 4, or 3 bytes). These all begin
+  // with a NEG or NOP prefix.
+  if (STI.getFeatureBits()[MOS::Feature45GS02] &&
+      (Bytes[0] == 0x42 || Bytes[0] == 0xea)) {
     for (size_t i : seq_inclusive(0, 2)) {
       size_t InsnSize = 5 - i;
       uint64_t Insn = 0;
@@ -338,68 +390,17 @@ DecodeStatus MOSDisassembler::getInstruction(MCInst &Instr, uint64_t &Size,
   }
 
   // Otherwise decode from the normal tables.
-  for (size_t InsnSize : seq_inclusive(1, 7)) {
-    uint64_t Insn = 0;
-    DecodeStatus Result = MCDisassembler::Fail;
-    if (Bytes.size() < InsnSize) {
-      return MCDisassembler::Fail;
-    }
-    for (size_t Byte : seq((size_t)0, InsnSize)) {
-      Insn |= ((uint64_t)Bytes[Byte]) << (8 * Byte);
-    }
-    if (Result == MCDisassembler::Fail) {
-      if (STI.getFeatureBits()[MOS::Feature65CE02]) {
-        Result = maybeDecodeInstruction(getDecoderTable65CE02(InsnSize), Instr,
-                                        Insn, Address, this, STI);
-      }
-    }
-    if (Result == MCDisassembler::Fail) {
-      if (STI.getFeatureBits()[MOS::Feature65EL02]) {
-        Result = maybeDecodeInstruction(getDecoderTable65EL02(InsnSize), Instr,
-                                        Insn, Address, this, STI);
-      }
-    }
-    if (Result == MCDisassembler::Fail) {
-      if (STI.getFeatureBits()[MOS::FeatureW65816]) {
-        Result = maybeDecodeInstruction(getDecoderTableW65816(InsnSize), Instr,
-                                        Insn, Address, this, STI);
-      }
-    }
-    if (Result == MCDisassembler::Fail) {
-      if (STI.getFeatureBits()[MOS::FeatureHUC6280]) {
-        Result = maybeDecodeInstruction(getDecoderTableHUC6280(InsnSize), Instr,
-                                        Insn, Address, this, STI);
-      }
-    }
-    if (Result == MCDisassembler::Fail) {
-      if (STI.getFeatureBits()[MOS::FeatureR65C02]) {
-        Result = maybeDecodeInstruction(getDecoderTableR65C02(InsnSize), Instr,
-                                        Insn, Address, this, STI);
-      }
-    }
-    if (Result == MCDisassembler::Fail) {
-      if (STI.getFeatureBits()[MOS::Feature65DTV02]) {
-        Result = maybeDecodeInstruction(getDecoderTable65DTV02(InsnSize), Instr,
-                                        Insn, Address, this, STI);
-      }
-    }
-    if (Result == MCDisassembler::Fail) {
-      if (STI.getFeatureBits()[MOS::Feature6502X]) {
-        Result = maybeDecodeInstruction(getDecoderTable6502X(InsnSize), Instr,
-                                        Insn, Address, this, STI);
-      }
-    }
-    if (Result == MCDisassembler::Fail) {
-      Result = maybeDecodeInstruction(getDecoderTable(InsnSize), Instr, Insn,
-                                      Address, this, STI);
-    }
-    if (Result != MCDisassembler::Fail) {
-      Size = InsnSize;
-      return Result;
-    }
-  }
-
-  return MCDisassembler::Fail;
+  const OpcodeEntry &Entry = Opcodes[Bytes[0]];
+  if (!Entry.Table || Bytes.size() < Entry.Size)
+    return MCDisassembler::Fail;
+  uint64_t Insn = 0;
+  for (size_t Byte : seq<size_t>(0, Entry.Size))
+    Insn |= ((uint64_t)Bytes[Byte]) << (8 * Byte);
+  DecodeStatus Result =
+      decodeInstruction(Entry.Table, Instr, Insn, Address, this, STI);
+  if (Result != MCDisassembler::Fail)
+    Size = Entry.Size;
+  return Result;
 }
 
 using DecodeFunc = DecodeStatus (*)(MCInst &, unsigned int, uint64_t,
@@ -0,0 +1,136 @@
+//===-- MOSCustomBehaviour.cpp - MOS llvm-mca Customization ---------------===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines the MOS instruments for llvm-mca.
+//
+//===----------------------------------------------------------------------===//
+
+#include "MOSCustomBehaviour.h"
+
+#include "MCTargetDesc/MOSMCTargetDesc.h"
+#include "TargetInfo/MOSTargetInfo.h"
+
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/MC/MCInstrInfo.h"
+#include "llvm/MC/MCSubtargetInfo.h"
+#include "llvm/MC/TargetRegistry.h"
+#include "llvm/MCA/Instruction.h"
+#include "llvm/Support/Compiler.h"
+
+namespace llvm {
+namespace mca {
+
+const StringRef MOSPageCrossInstrument::DESC_NAME = "MOS-PAGE-CROSS";
+
+bool MOSPageCrossInstrument::isDataValid(StringRef Data) {
+  return Data == "yes" || Data == "no";
+}
+
+const StringRef MOSBranchInstrument::DESC_NAME = "MOS-BRANCH";
+
+bool MOSBranchInstrument::isDataValid(StringRef Data) {
+  return Data == "taken" || Data == "not-taken";
+}
+
+MOSInstrumentManager::MOSInstrumentManager(const MCSubtargetInfo &STI,
+                                           const MCInstrInfo &MCII)
+    : InstrumentManager(STI, MCII) {
+  for (unsigned Opcode = 0, E = MCII.getNumOpcodes(); Opcode != E; ++Opcode)
+    if (MOS::getMOSInstrCostEntry(Opcode))
+      OpcodeBySchedClass[MCII.get(Opcode).getSchedClass()] = Opcode;
+}
+
+bool MOSInstrumentManager::supportsInstrumentType(StringRef Type) const {
+  return Type == MOSPageCrossInstrument::DESC_NAME ||
+         Type == MOSBranchInstrument::DESC_NAME ||
+         InstrumentManager::supportsInstrumentType(Type);
+}
+
+UniqueInstrument MOSInstrumentManager::createInstrument(StringRef Desc,
+                                                        StringRef Data) {
+  Data = Data.trim();
+  if (Desc == MOSPageCrossInstrument::DESC_NAME) {
+    if (!MOSPageCrossInstrument::isDataValid(Data))
+      return nullptr;
+    return std::make_unique<MOSPageCrossInstrument>(Data);
+  }
+  if (Desc == MOSBranchInstrument::DESC_NAME) {
+    if (!MOSBranchInstrument::isDataValid(Data))
+      return nullptr;
+    return std::make_unique<MOSBranchInstrument>(Data);
+  }
+  return InstrumentManager::createInstrument(Desc, Data);
+}
+
+bool MOSInstrumentManager::canCustomize(
+    const ArrayRef<Instrument *> IVec) const {
+  return any_of(IVec,
+                [](const Instrument *I) {
+                  return I->getDesc() == MOSPageCrossInstrument::DESC_NAME ||
+                         I->getDesc() == MOSBranchInstrument::DESC_NAME;
+                }) ||
+         InstrumentManager::canCustomize(IVec);
+}
+
+void MOSInstrumentManager::customize(const ArrayRef<Instrument *> IVec,
+                                     InstrDesc &Desc) const {
+  bool CrossesPage = false;
+  bool Taken = true;
+  for (const Instrument *I : IVec) {
+    if (I->getDesc() == MOSPageCrossInstrument::DESC_NAME)
+      CrossesPage =
+          static_cast<const MOSPageCrossInstrument *>(I)->crossesPage();
+    else if (I->getDesc() == MOSBranchInstrument::DESC_NAME)
+      Taken = static_cast<const MOSBranchInstrument *>(I)->isTaken();
+  }
+
+  auto It = OpcodeBySchedClass.find(Desc.SchedClassID);
+  if (It != OpcodeBySchedClass.end()) {
+    const MCInstrDesc &MCDesc = MCII.get(It->second);
+    const MOS::MOSInstrCostEntry &Entry =
+        *MOS::getMOSInstrCostEntry(It->second);
+    bool HasPagePenalty;
+    int32_t Cycles = MOS::getTableCycles(Entry, STI, HasPagePenalty);
+
+    // As in MOSInstrCost::getCycleRange, a taken branch to another page costs
+    // one more cycle, while a branch that falls through only fetches its
+    // operand.
+    bool IsRelative = any_of(MCDesc.operands(), [](const MCOperandInfo &Op) {
+      return Op.OperandType == MCOI::OPERAND_PCREL;
+    });
+    if (IsRelative && MCDesc.isConditionalBranch() && !Taken)
+      Cycles = Entry.Bytes;
+    else if (CrossesPage && HasPagePenalty && (IsRelative || Entry.PageCross))
+      ++Cycles;
+
+    for (WriteDescriptor &W : Desc.Writes)
+      W.Latency = Cycles;
+    Desc.MaxLatency = Cycles;
+    for (auto &[Mask, Usage] : Desc.Resources)
+      Usage.CS = CycleSegment(0, Cycles);
+  }
+
+  // An explicit latency overrides the above.
+  InstrumentManager::customize(IVec, Desc);
+}
+
+} // namespace mca
+} // namespace llvm
+
+using namespace llvm;
+using namespace mca;
+
+static InstrumentManager *createMOSInstrumentManager(const MCSubtargetInfo &STI,
+                                                     const MCInstrInfo &MCII) {
+  return new MOSInstrumentManager(STI, MCII);
+}
+
+extern "C" LLVM_ABI LLVM_EXTERNAL_VISIBILITY void LLVMInitializeMOSTargetMCA() {
+  TargetRegistry::RegisterInstrumentManager(getTheMOSTarget(),
+                                            createMOSInstrumentManager);
+}
@@ -0,0 +1,77 @@
+//===-- MOSCustomBehaviour.h - MOS llvm-mca Customization -------*- C++ -*-===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares the MOS instruments for llvm-mca.
+//
+// The scheduling models time each real instruction as the cost table does:
+// without page crossings, and with branches taken. Since MOS processors run
+// one instruction at a time, that is exact for straight-line code, and these
+// instruments supply the rest, applying to the instructions that follow them:
+//
+//   # LLVM-MCA-MOS-PAGE-CROSS yes|no
+//   # LLVM-MCA-MOS-BRANCH taken|not-taken
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_LIB_TARGET_MOS_MCA_MOSCUSTOMBEHAVIOUR_H
+#define LLVM_LIB_TARGET_MOS_MCA_MOSCUSTOMBEHAVIOUR_H
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/MCA/CustomBehaviour.h"
+
+namespace llvm {
+namespace mca {
+
+// Whether indexed addresses and taken branches cross a page boundary.
+class MOSPageCrossInstrument : public Instrument {
+public:
+  static const StringRef DESC_NAME;
+  static bool isDataValid(StringRef Data);
+
+  explicit MOSPageCrossInstrument(StringRef Data)
+      : Instrument(DESC_NAME, Data) {}
+
+  bool crossesPage() const { return getData() == "yes"; }
+};
+
+// Whether conditional branches are taken.
+class MOSBranchInstrument : public Instrument {
+public:
+  static const StringRef DESC_NAME;
+  static bool isDataValid(StringRef Data);
+
+  explicit MOSBranchInstrument(StringRef Data) : Instrument(DESC_NAME, Data) {}
+
+  bool isTaken() const { return getData() == "taken"; }
+};
+
+class MOSInstrumentManager : public InstrumentManager {
+  // The cost table instructions by scheduling class. Each is given its own
+  // class by MOSSchedule.td.
+  DenseMap<unsigned, unsigned> OpcodeBySchedClass;
+
+public:
+  MOSInstrumentManager(const MCSubtargetInfo &STI, const MCInstrInfo &MCII);
+
+  bool shouldIgnoreInstruments() const override { return false; }
+  bool supportsInstrumentType(StringRef Type) const override;
+
+  UniqueInstrument createInstrument(StringRef Desc, StringRef Data) override;
+
+  bool canCustomize(const ArrayRef<Instrument *> IVec) const override;
+
+  /// Adjusts the timing of a cost table instruction for the page crossing and
+  /// branch assumptions in effect.
+  void customize(const ArrayRef<Instrument *> IVec,
+                 InstrDesc &Desc) const override;
+};
+
+} // namespace mca
+} // namespace llvm
+
+#endif // not LLVM_LIB_TARGET_MOS_MCA_MOSCUSTOMBEHAVIOUR_H
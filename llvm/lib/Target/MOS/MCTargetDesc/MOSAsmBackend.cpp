@@ -30,6 +30,7 @@
 #include "llvm/MC/MCObjectWriter.h"
 #include "llvm/MC/MCSectionELF.h"
 #include "llvm/MC/MCSubtargetInfo.h"
+#include "llvm/MC/MCSymbol.h"
 #include "llvm/MC/MCValue.h"
 #include "llvm/Support/Casting.h"
 #include "llvm/Support/CommandLine.h"
@@ -40,6 +41,7 @@
 #include <climits>
 #include <cstdint>
 #include <memory>
+#include <optional>
 #include <string>
 
 namespace llvm {
@@ -111,7 +113,7 @@ bool isBasedOnZeroPageSymbol(const MCExpr *E) {
            ELF::STO_MOS_ZEROPAGE;
 
   case MCExpr::Unary:
-    return cast<MCUnaryExpr>(E)->getSubExpr()->findAssociatedFragment();
+    return isBasedOnZeroPageSymbol(cast<MCUnaryExpr>(E)->getSubExpr());
 
   case MCExpr::Binary: {
     const MCBinaryExpr *BE = cast<MCBinaryExpr>(E);
@@ -123,11 +125,37 @@ bool isBasedOnZeroPageSymbol(const MCExpr *E) {
   }
 }
 
+// Returns whether an address expression is known to refer to the zero page,
+// either through a symbol marked as such or through the section it lies in.
+// Returns std::nullopt if this can't be told without the final addresses.
+static std::optional<bool> isKnownZeroPage(const MCExpr *E) {
+  if (isBasedOnZeroPageSymbol(E))
+    return true;
+
+  MCFragment *Frag = E->findAssociatedFragment();
+  if (!Frag || Frag == MCSymbol::AbsolutePseudoFragment)
+    return std::nullopt;
+  const auto *Sec = static_cast<const MCSectionELF *>(Frag->getParent());
+  if (!Sec)
+    return std::nullopt;
+
+  // If the section of the symbol is marked with special zero-page flag
+  // then this is an 8 bit instruction and it doesn't need relaxation.
+  if (Sec->getFlags() & ELF::SHF_MOS_ZEROPAGE)
+    return true;
+  return MOS::isZeroPageSectionName(Sec->getName()) ||
+         MOS::isBasePageSectionName(Sec->getName());
+}
+
 bool MOSAsmBackend::fixupNeedsRelaxationAdvanced(const MCFragment &F,
                                                  const MCFixup &Fixup,
                                                  const MCValue &Target,
                                                  uint64_t Value,
                                                  bool Resolved) const {
+  // Linker relaxation markers don't constrain the instruction.
+  if (mc::isRelocation(Fixup.getKind()))
+    return false;
+
   // On 65816, it is possible to zero-bank relax from Addr16 to Addr24. The
   // assembler relaxes in a loop until instructions cannot be relaxed further,
   // so this is able to follow zero-page relaxation.
@@ -156,33 +184,20 @@ bool MOSAsmBackend::fixupNeedsRelaxationAdvanced(const MCFragment &F,
            !fitsIntoFixup(Value + getRelativeMOSPCCorrection(IsPCRel16), false);
   }
 
-  // See if the expression is derived from a zero page symbol.
-  if (isBasedOnZeroPageSymbol(Fixup.getValue()))
-    return false;
-
   // In order to resolve an eight to sixteen bit possible relaxation, we need
   // to figure out whether the symbol in question is in zero page or not.  If
   // it is in zero page, then we don't need to do anything.  If not, we need
-  // to relax the instruction to 16 bits.
-  // If we're not writing to ELF, punt on this whole idea, just do the
-  // relaxation for safety's sake
-  MCFragment *Frag = Fixup.getValue()->findAssociatedFragment();
-  if (!Frag)
-    return true;
-  const auto *Sec = static_cast<const MCSectionELF *>(Frag->getParent());
-  if (!Sec)
-    return true;
-
-  // If the section of the symbol is marked with special zero-page flag
-  // then this is an 8 bit instruction and it doesn't need
-  // relaxation.
-  if (Sec->getFlags() & ELF::SHF_MOS_ZEROPAGE)
-    return false;
-
-  return !MOS::isZeroPageSectionName(Sec->getName());
+  // to relax the instruction to 16 bits. If that can't be told, just do the
+  // relaxation for safety's sake.
+  return !isKnownZeroPage(Fixup.getValue()).value_or(false);
 }
 
 MCFixupKindInfo MOSAsmBackend::getFixupKindInfo(MCFixupKind Kind) const {
+  // Literal relocations, like the markers for linker relaxation, need no
+  // processing of their own.
+  if (mc::isRelocation(Kind))
+    return {};
+
   if (Kind < FirstTargetFixupKind) {
     return MCAsmBackend::getFixupKindInfo(Kind);
   }
@@ -199,10 +214,16 @@ void MOSAsmBackend::applyFixup(const MCFragment &F, const MCFixup &Fixup,
                                uint64_t Value, bool IsResolved) {
   if (IsResolved && shouldForceRelocation(Fixup, Target))
     IsResolved = false;
+  // The linker may shrink the code between a PC-relative fixup and its target
+  // in a linker-relaxable section, so leave the displacement to it.
+  if (IsResolved && Fixup.isPCRel() && F.getParent()->isLinkerRelaxable())
+    IsResolved = false;
   if (!IsResolved)
     Asm->getWriter().recordRelocation(F, Fixup, Target, Value);
 
   unsigned int Kind = Fixup.getKind();
+  if (mc::isRelocation(Kind))
+    return;
 
   switch (Kind) {
   case MOS::AddrAsciz: {
@@ -261,6 +282,28 @@ void MOSAsmBackend::applyFixup(const MCFragment &F, const MCFixup &Fixup,
   }
 }
 
+unsigned MOSAsmBackend::getZeroPageOpcode(unsigned Opcode) {
+  const auto *ZPIRE = MOS::getZeroPageInstructionRelaxationEntryByTo(Opcode);
+  return ZPIRE ? ZPIRE->From : 0;
+}
+
+unsigned MOSAsmBackend::getShortBranchOpcode(unsigned Opcode,
+                                             const MCSubtargetInfo &STI) {
+  switch (Opcode) {
+  case MOS::JMP_Absolute:
+    if (STI.hasFeature(MOS::Feature65C02))
+      return MOS::BRA_Relative;
+    if (STI.hasFeature(MOS::Feature65DTV02))
+      return MOS::BRA_Relative_DTV02;
+    return 0;
+  case MOS::BRL_Relative16:
+    return STI.hasFeature(MOS::FeatureW65816) ? MOS::BRA_Relative : 0;
+  }
+
+  const auto *BIRE = MOS::getBranchInstructionRelaxationEntryByTo(Opcode);
+  return BIRE && STI.hasFeature(MOS::Feature65CE02) ? BIRE->From : 0;
+}
+
 unsigned MOSAsmBackend::relaxInstructionTo(unsigned Opcode,
                                            const MCSubtargetInfo &STI,
                                            bool &BankRelax) {
@@ -318,24 +361,32 @@ static bool isImmediateBankRelaxable(const MCSubtargetInfo &STI, int64_t Imm,
 
 void MOSAsmBackend::relaxForImmediate(MCInst &Inst,
                                       const MCSubtargetInfo &STI) {
+  auto Visit = [&Inst, &STI](const MCOperand &Operand, unsigned RelaxTo,
+                             bool BankRelax) {
+    int64_t Imm;
+    if (Operand.evaluateAsConstantImm(Imm)) {
+      // If the expression evaluates cleanly to an 8-bit value (or 16-bit for
+      // bank relaxation), then it doesn't need relaxation.
+      if (isImmediateBankRelaxable(STI, Imm, BankRelax))
+        return false;
+    } else {
+      // A symbol outside the zero page can never be reached with an 8-bit
+      // address, so there's no reason to wait for layout to relax it. The
+      // widths of modifiers are fixed, and branches are resolved by distance.
+      if (BankRelax || !Operand.isExpr() ||
+          isa<MOSMCExpr>(Operand.getExpr()) ||
+          !MOS::getZeroPageInstructionRelaxationEntry(Inst.getOpcode()) ||
+          isKnownZeroPage(Operand.getExpr()).value_or(true))
+        return false;
+    }
+    // This instruction can be relaxed, do it now.
+    Inst.setOpcode(RelaxTo);
+    return true;
+  };
+
   // Two steps are required for zero-bank relaxation on 65816.
   while (visitRelaxableOperand(Inst.getOpcode(), Inst.getOperands(), STI,
-                               [&Inst, &STI](const MCOperand &Operand,
-                                             unsigned RelaxTo, bool BankRelax) {
-                                 int64_t Imm;
-                                 if (!Operand.evaluateAsConstantImm(Imm) ||
-                                     isImmediateBankRelaxable(STI, Imm,
-                                                              BankRelax)) {
-                                   // If the expression evaluates cleanly to an
-                                   // 8-bit value (or 16-bit for bank
-                                   // relaxation), then it doesn't need
-                                   // relaxation.
-                                   return false;
-                                 }
-                                 // This instruction can be relaxed, do it now.
-                                 Inst.setOpcode(RelaxTo);
-                                 return true;
-                               }))
+                               Visit))
     ;
 }
 
@@ -344,9 +395,22 @@ bool MOSAsmBackend::mayNeedRelaxation(unsigned Opcode,
                                       const MCSubtargetInfo &STI) const {
   RelaxedOpcode = Opcode;
   RelaxedSTI = &STI;
-  return visitRelaxableOperand(Opcode, Operands, STI,
-                               [](const MCOperand &Operand, unsigned RelaxTo,
-                                  bool BankRelax) { return Operand.isExpr(); });
+  return visitRelaxableOperand(
+      Opcode, Operands, STI,
+      [this, Opcode](const MCOperand &Operand, unsigned RelaxTo,
+                     bool BankRelax) {
+        if (!Operand.isExpr())
+          return false;
+        // Modifiers fix the width of their value, so whether they fit can be
+        // told without a relaxable fragment.
+        if (const auto *MME = dyn_cast<MOSMCExpr>(Operand.getExpr()))
+          return getFixupKindInfo(MME->getFixupKind()).TargetSize >
+                 (BankRelax ? 16 : 8);
+        // Likewise, references to the zero page never need to grow.
+        return BankRelax ||
+               !MOS::getZeroPageInstructionRelaxationEntry(Opcode) ||
+               !isKnownZeroPage(Operand.getExpr()).value_or(false);
+      });
 }
 
 void MOSAsmBackend::relaxInstruction(MCInst &Inst,
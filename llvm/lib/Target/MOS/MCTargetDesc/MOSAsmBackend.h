@@ -109,6 +109,15 @@ public:
     return relaxInstructionTo(Opcode, STI, BankRelax);
   }
 
+  /// If the given absolute addressing mode opcode has a zero page form, return
+  /// its opcode. Otherwise, return zero.
+  static unsigned getZeroPageOpcode(unsigned Opcode);
+
+  /// If the given jump or long branch opcode has a short relative branch
+  /// equivalent on this subtarget, return its opcode. Otherwise, return zero.
+  static unsigned getShortBranchOpcode(unsigned Opcode,
+                                       const MCSubtargetInfo &STI);
+
   /// If the provided subtarget uses a custom set of machine instructions,
   /// translate the provided MOS machine instruction to the subtarget's.
   static void translateOpcodeToSubtarget(MCInst &Inst,
@@ -19,6 +19,7 @@
 #include "llvm/MC/MCFixup.h"
 #include "llvm/MC/MCObjectWriter.h"
 #include "llvm/MC/MCSection.h"
+#include "llvm/MC/MCSymbol.h"
 #include "llvm/MC/MCValue.h"
 #include "llvm/Support/ErrorHandling.h"
 
@@ -106,6 +107,14 @@ unsigned MOSELFObjectWriter::getRelocType(const MCFixup &Fixup,
   }
 }
 
+bool MOSELFObjectWriter::needsRelocateWithSymbol(const MCValue &Val,
+                                                 unsigned Type) const {
+  // The linker moves symbols in linker-relaxable sections relative to the
+  // section, so an offset from the section symbol would go stale.
+  const MCSymbol *Sym = Val.getAddSym();
+  return Sym && Sym->isInSection() && Sym->getSection().isLinkerRelaxable();
+}
+
 std::unique_ptr<MCObjectTargetWriter> createMOSELFObjectWriter(uint8_t OSABI) {
   return std::make_unique<MOSELFObjectWriter>(OSABI);
 }
@@ -6,6 +6,9 @@
 //
 //===----------------------------------------------------------------------===//
 
+#ifndef LLVM_LIB_TARGET_MOS_MCTARGETDESC_MOSELFOBJECTWRITER_H
+#define LLVM_LIB_TARGET_MOS_MCTARGETDESC_MOSELFOBJECTWRITER_H
+
 #include "MCTargetDesc/MOSFixupKinds.h"
 #include "MCTargetDesc/MOSMCTargetDesc.h"
 
@@ -26,6 +29,10 @@ public:
   virtual ~MOSELFObjectWriter() = default;
   unsigned getRelocType(const MCFixup &Fixup, const MCValue &Target,
                         bool IsPCRel) const override;
+  bool needsRelocateWithSymbol(const MCValue &Val,
+                               unsigned Type) const override;
 };
 
 } // end of namespace llvm
+
+#endif // LLVM_LIB_TARGET_MOS_MCTARGETDESC_MOSELFOBJECTWRITER_H
@@ -0,0 +1,290 @@
+//===-- MOSFlatObjectWriter.cpp - MOS Flat Binary Writer ------------------===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements the MOS flat binary writer.
+//
+// For quick edit-compile-run cycles on a single translation unit, going
+// through an ELF object, the linker, and objcopy is far more work than
+// necessary. If everything the translation unit references is defined within
+// it, the assembler can lay out the sections itself and resolve the fixups
+// that would otherwise become relocations, giving a loadable image directly.
+//
+// Symbols the linker script would usually provide, like the imaginary
+// registers, must be defined in the translation unit, for example with
+// --defsym.
+//
+//===----------------------------------------------------------------------===//
+
+#include "MOSFlatObjectWriter.h"
+
+#include "MCTargetDesc/MOSMCTargetDesc.h"
+
+#include "llvm/BinaryFormat/ELF.h"
+#include "llvm/MC/MCAssembler.h"
+#include "llvm/MC/MCContext.h"
+#include "llvm/MC/MCExpr.h"
+#include "llvm/MC/MCSectionELF.h"
+#include "llvm/MC/MCSubtargetInfo.h"
+#include "llvm/MC/MCSymbol.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/EndianStream.h"
+#include "llvm/Support/MathExtras.h"
+
+using namespace llvm;
+using namespace llvm::support;
+
+static cl::opt<MOS::FlatOutputFormat> FlatOutput(
+    "mos-flat-output",
+    cl::desc("Write object files as flat binary images instead of ELF"),
+    cl::values(clEnumValN(MOS::FlatOutputFormat::None, "none",
+                          "Write ELF object files"),
+               clEnumValN(MOS::FlatOutputFormat::Raw, "raw",
+                          "Write the image alone"),
+               clEnumValN(MOS::FlatOutputFormat::PRG, "prg",
+                          "Write the load address, then the image")),
+    cl::init(MOS::FlatOutputFormat::None), cl::Hidden);
+
+static cl::opt<uint64_t>
+    FlatLoadAddress("mos-flat-load-address",
+                    cl::desc("Address that flat binary images are loaded at"),
+                    cl::init(0x1000), cl::Hidden);
+
+static cl::opt<uint64_t> FlatZeroPageAddress(
+    "mos-flat-zp-address",
+    cl::desc("Address that flat binary images place zero page sections at"),
+    cl::init(0x80), cl::Hidden);
+
+MOS::FlatOutputFormat MOS::getFlatOutputFormat() { return FlatOutput; }
+
+void MOSFlatObjectWriter::reset() {
+  Fixups.clear();
+  SectionAddrs.clear();
+  MCObjectWriter::reset();
+}
+
+void MOSFlatObjectWriter::recordRelocation(const MCFragment &F,
+                                           const MCFixup &Fixup,
+                                           MCValue Target,
+                                           uint64_t &FixedValue) {
+  // Linker relaxation markers have nothing to resolve.
+  if (mc::isRelocation(Fixup.getKind()))
+    return;
+  // Section addresses aren't known until writeObject, so resolve then.
+  Fixups.push_back({&F, Fixup, Target});
+}
+
+std::optional<uint64_t>
+MOSFlatObjectWriter::getSymbolAddress(const MCSymbol &Sym, SMLoc Loc) const {
+  if (Sym.isVariable()) {
+    MCValue Val;
+    if (!Sym.getVariableValue()->evaluateAsValue(Val, *Asm)) {
+      getContext().reportError(Loc, "cannot evaluate equated symbol '" +
+                                        Sym.getName() + "'");
+      return std::nullopt;
+    }
+    return getValueAddress(Val, Loc);
+  }
+  if (Sym.isInSection()) {
+    auto It = SectionAddrs.find(&Sym.getSection());
+    if (It != SectionAddrs.end())
+      return It->second + Asm->getSymbolOffset(Sym);
+  }
+  getContext().reportError(Loc, "symbol '" + Sym.getName() +
+                                    "' is not defined in the flat binary");
+  return std::nullopt;
+}
+
+std::optional<uint64_t>
+MOSFlatObjectWriter::getValueAddress(const MCValue &Val, SMLoc Loc) const {
+  uint64_t Addr = Val.getConstant();
+  if (const MCSymbol *A = Val.getAddSym()) {
+    std::optional<uint64_t> AddrA = getSymbolAddress(*A, Loc);
+    if (!AddrA)
+      return std::nullopt;
+    Addr += *AddrA;
+  }
+  if (const MCSymbol *B = Val.getSubSym()) {
+    std::optional<uint64_t> AddrB = getSymbolAddress(*B, Loc);
+    if (!AddrB)
+      return std::nullopt;
+    Addr -= *AddrB;
+  }
+  return Addr;
+}
+
+// Patches the fixup the way the linker would patch the corresponding
+// relocation; see MOS::relocate in lld.
+void MOSFlatObjectWriter::resolveFixup(const PendingFixup &P, uint8_t *Data,
+                                       uint64_t FixupAddr) {
+  MCContext &Ctx = getContext();
+  SMLoc Loc = P.Fixup.getLoc();
+  std::optional<uint64_t> Addr = getValueAddress(P.Target, Loc);
+  if (!Addr)
+    return;
+  int64_t Val = *Addr;
+  if (P.Fixup.isPCRel())
+    Val -= FixupAddr;
+
+  auto Check = [&](bool InRange) {
+    if (!InRange)
+      Ctx.reportError(Loc, "fixup value out of range");
+  };
+  auto IntUInt = [](int64_t Val, unsigned N) {
+    return isIntN(N, Val) || isUIntN(N, Val);
+  };
+
+  switch (RelocTypes.getRelocType(P.Fixup, P.Target, P.Fixup.isPCRel())) {
+  case ELF::R_MOS_IMM8:
+    Check(IntUInt(Val, 8));
+    *Data = Val;
+    break;
+  case ELF::R_MOS_IMM16:
+    Check(IntUInt(Val, 16));
+    endian::write16le(Data, Val);
+    break;
+  case ELF::R_MOS_PCREL_8:
+    // MOS's PC relative addressing is off by one from the standard LLVM PC
+    // relative convention.
+    Check(isInt<8>(Val - 1));
+    *Data = Val - 1;
+    break;
+  case ELF::R_MOS_PCREL_16:
+    Check(isInt<16>(Val - 2));
+    endian::write16le(Data, Val - 2);
+    break;
+  case ELF::R_MOS_ADDR8: {
+    Val = SignExtend64<16>(Val & 0xffff);
+    // The HuC6280's zero page is at 0x2000.
+    const MCSubtargetInfo *STI = Ctx.getSubtargetInfo();
+    if (STI && STI->hasFeature(MOS::FeatureHUC6280))
+      Val -= 0x2000;
+    Check(IntUInt(Val, 8));
+    *Data = Val;
+    break;
+  }
+  case ELF::R_MOS_ADDR13:
+    Check(isInt<13>(Val & 0xffff));
+    endian::write16le(Data, (endian::read16le(Data) & ~0x1fff) | (Val & 0x1fff));
+    break;
+  case ELF::R_MOS_ADDR16:
+    endian::write16le(Data, Val);
+    break;
+  case ELF::R_MOS_ADDR16_LO:
+    *Data = Val;
+    break;
+  case ELF::R_MOS_ADDR16_HI:
+    *Data = Val >> 8;
+    break;
+  case ELF::R_MOS_ADDR24:
+    Check(isUInt<24>(Val));
+    endian::write16le(Data, Val);
+    Data[2] = Val >> 16;
+    break;
+  case ELF::R_MOS_ADDR24_SEGMENT:
+    Check(isUInt<24>(Val));
+    endian::write16le(Data, Val);
+    break;
+  case ELF::R_MOS_ADDR24_SEGMENT_LO:
+    Check(isUInt<24>(Val));
+    *Data = Val;
+    break;
+  case ELF::R_MOS_ADDR24_SEGMENT_HI:
+    Check(isUInt<24>(Val));
+    *Data = Val >> 8;
+    break;
+  case ELF::R_MOS_ADDR24_BANK:
+    Check(isUInt<24>(Val));
+    *Data = Val >> 16;
+    break;
+  case ELF::R_MOS_FK_DATA_4:
+    endian::write32le(Data, Val);
+    break;
+  case ELF::R_MOS_FK_DATA_8:
+    endian::write64le(Data, Val);
+    break;
+  default:
+    Ctx.reportError(Loc, "fixup cannot be resolved in a flat binary");
+    break;
+  }
+}
+
+uint64_t MOSFlatObjectWriter::writeObject() {
+  MCContext &Ctx = getContext();
+  uint64_t StartOffset = OS.tell();
+
+  // Lay out the loaded sections first, then the uninitialized ones after
+  // them, and the zero page sections in the zero page. Sections that aren't
+  // allocated, like debug info, are dropped.
+  SmallVector<const MCSectionELF *> Loaded;
+  SmallVector<const MCSectionELF *> NoBits;
+  uint64_t Addr = FlatLoadAddress;
+  uint64_t ZPAddr = FlatZeroPageAddress;
+  for (const MCSection &S : *Asm) {
+    const auto &Sec = static_cast<const MCSectionELF &>(S);
+    if (!(Sec.getFlags() & ELF::SHF_ALLOC))
+      continue;
+    uint64_t Size = Asm->getSectionAddressSize(Sec);
+    if (MOS::isZeroPageSectionName(Sec.getName())) {
+      if (Sec.getType() != ELF::SHT_NOBITS && Size) {
+        Ctx.reportError(SMLoc(), "zero page section '" + Sec.getName() +
+                                     "' cannot be initialized by a flat "
+                                     "binary");
+        continue;
+      }
+      ZPAddr = alignTo(ZPAddr, Sec.getAlign());
+      SectionAddrs[&Sec] = ZPAddr;
+      ZPAddr += Size;
+      continue;
+    }
+    if (Sec.getType() == ELF::SHT_NOBITS) {
+      NoBits.push_back(&Sec);
+      continue;
+    }
+    Addr = alignTo(Addr, Sec.getAlign());
+    SectionAddrs[&Sec] = Addr;
+    Addr += Size;
+    Loaded.push_back(&Sec);
+  }
+  uint64_t End = Addr;
+  for (const MCSectionELF *Sec : NoBits) {
+    Addr = alignTo(Addr, Sec->getAlign());
+    SectionAddrs[Sec] = Addr;
+    Addr += Asm->getSectionAddressSize(*Sec);
+  }
+  if (ZPAddr > 0x100)
+    Ctx.reportError(SMLoc(), "zero page sections do not fit in the zero page");
+  if (Format == MOS::FlatOutputFormat::PRG && End > 0x10000)
+    Ctx.reportError(SMLoc(), "flat binary does not fit in 64 KiB");
+
+  SmallVector<char, 0> Image(End - FlatLoadAddress);
+  DenseMap<const MCSection *, uint64_t> ImageOffsets;
+  for (const MCSectionELF *Sec : Loaded) {
+    SmallVector<char, 0> Data;
+    raw_svector_ostream DataOS(Data);
+    Asm->writeSectionData(DataOS, Sec);
+    uint64_t Offset = SectionAddrs[Sec] - FlatLoadAddress;
+    llvm::copy(Data, Image.begin() + Offset);
+    ImageOffsets[Sec] = Offset;
+  }
+
+  for (const PendingFixup &P : Fixups) {
+    auto It = ImageOffsets.find(P.F->getParent());
+    if (It == ImageOffsets.end())
+      continue;
+    uint64_t Offset =
+        It->second + Asm->getFragmentOffset(*P.F) + P.Fixup.getOffset();
+    resolveFixup(P, reinterpret_cast<uint8_t *>(&Image[Offset]),
+                 FlatLoadAddress + Offset);
+  }
+
+  if (Format == MOS::FlatOutputFormat::PRG)
+    endian::write<uint16_t>(OS, FlatLoadAddress, endianness::little);
+  OS << StringRef(Image.data(), Image.size());
+  return OS.tell() - StartOffset;
+}
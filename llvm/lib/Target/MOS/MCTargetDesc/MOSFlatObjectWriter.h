@@ -0,0 +1,86 @@
+//===-- MOSFlatObjectWriter.h - MOS Flat Binary Writer ----------*- C++ -*-===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares a writer that emits a single translation unit directly
+// as a flat binary image, resolving every fixup itself instead of leaving
+// relocations for the linker.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_LIB_TARGET_MOS_MCTARGETDESC_MOSFLATOBJECTWRITER_H
+#define LLVM_LIB_TARGET_MOS_MCTARGETDESC_MOSFLATOBJECTWRITER_H
+
+#include "MOSELFObjectWriter.h"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/MC/MCFixup.h"
+#include "llvm/MC/MCObjectWriter.h"
+#include "llvm/MC/MCValue.h"
+#include "llvm/Support/raw_ostream.h"
+#include <optional>
+
+namespace llvm {
+
+class MCFragment;
+class MCSection;
+class MCSymbol;
+
+namespace MOS {
+
+enum class FlatOutputFormat {
+  None,
+  // The bytes of the image, starting at the load address.
+  Raw,
+  // A two byte little-endian load address followed by the image.
+  PRG,
+};
+
+/// Returns the flat binary format requested on the command line, if any.
+FlatOutputFormat getFlatOutputFormat();
+
+} // namespace MOS
+
+/// Writes a translation unit as a flat binary image. Allocatable sections are
+/// laid out back to back from the load address in the order they were
+/// created, with zero page sections placed separately from the zero page
+/// address. Every symbol must be defined in the translation unit.
+class MOSFlatObjectWriter final : public MCObjectWriter {
+  raw_pwrite_stream &OS;
+  MOS::FlatOutputFormat Format;
+  // Classifies fixups the same way the ELF writer would, so that they are
+  // resolved with the same semantics as the linker gives the relocations.
+  MOSELFObjectWriter RelocTypes;
+
+  struct PendingFixup {
+    const MCFragment *F;
+    MCFixup Fixup;
+    MCValue Target;
+  };
+  SmallVector<PendingFixup, 0> Fixups;
+  DenseMap<const MCSection *, uint64_t> SectionAddrs;
+
+public:
+  MOSFlatObjectWriter(raw_pwrite_stream &OS, MOS::FlatOutputFormat Format)
+      : OS(OS), Format(Format), RelocTypes(/*OSABI=*/0) {}
+
+  void reset() override;
+  void recordRelocation(const MCFragment &F, const MCFixup &Fixup,
+                        MCValue Target, uint64_t &FixedValue) override;
+  uint64_t writeObject() override;
+
+private:
+  std::optional<uint64_t> getSymbolAddress(const MCSymbol &Sym,
+                                           SMLoc Loc) const;
+  std::optional<uint64_t> getValueAddress(const MCValue &Val,
+                                          SMLoc Loc) const;
+  void resolveFixup(const PendingFixup &P, uint8_t *Data, uint64_t FixupAddr);
+};
+
+} // end namespace llvm
+
+#endif // LLVM_LIB_TARGET_MOS_MCTARGETDESC_MOSFLATOBJECTWRITER_H
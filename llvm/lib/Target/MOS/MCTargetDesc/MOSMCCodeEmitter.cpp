@@ -12,11 +12,13 @@
 
 #include "MOSMCCodeEmitter.h"
 
+#include "MCTargetDesc/MOSAsmBackend.h"
 #include "MCTargetDesc/MOSMCExpr.h"
 #include "MCTargetDesc/MOSMCTargetDesc.h"
 
 #include "llvm/ADT/APFloat.h"
 #include "llvm/ADT/SmallVector.h"
+#include "llvm/BinaryFormat/ELF.h"
 #include "llvm/MC/MCContext.h"
 #include "llvm/MC/MCExpr.h"
 #include "llvm/MC/MCFixup.h"
@@ -25,7 +27,9 @@
 #include "llvm/MC/MCRegisterInfo.h"
 #include "llvm/MC/MCSubtargetInfo.h"
 #include "llvm/Support/Casting.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/EndianStream.h"
+#include "llvm/Support/MathExtras.h"
 #include "llvm/Support/raw_ostream.h"
 
 using namespace llvm;
@@ -38,6 +42,13 @@ using namespace llvm;
 
 namespace llvm {
 
+static cl::opt<bool> LinkerRelax(
+    "mos-linker-relax",
+    cl::desc("Allow the linker to relax absolute addressing modes to zero page "
+             "and jumps to short branches once it knows their targets' "
+             "addresses."),
+    cl::init(false), cl::Hidden);
+
 static void emitLittleEndian(uint64_t Val, unsigned Size,
                              SmallVectorImpl<char> &CB) {
   for (int64_t I = 0; I < Size; ++I) {
@@ -67,8 +78,77 @@ void MOSMCCodeEmitter::encodeInstruction(const MCInst &MI,
 
   assert(Size > 0 && "Instruction size cannot be zero");
 
+  size_t FirstFixup = Fixups.size();
   uint64_t BinaryOpCode = getBinaryCodeForInstr(MI, Fixups, STI);
   emitLittleEndian(BinaryOpCode, Size, CB);
+  if (LinkerRelax && Fixups.size() == FirstFixup + 1)
+    addLinkerRelaxation(MI, Size, BinaryOpCode, Fixups, STI);
+}
+
+void MOSMCCodeEmitter::addLinkerRelaxation(const MCInst &MI, unsigned Size,
+                                           uint64_t Encoding,
+                                           SmallVectorImpl<MCFixup> &Fixups,
+                                           const MCSubtargetInfo &STI) const {
+  MCFixup &Fixup = Fixups.back();
+  const MCExpr *Expr = Fixup.getValue();
+  int64_t Imm;
+  if (isa<MOSMCExpr>(Expr) || Expr->evaluateAsAbsolute(Imm))
+    return;
+
+  unsigned Opcode = MI.getOpcode();
+  unsigned ShortOpcode;
+  unsigned RelaxType;
+  switch (Fixup.getKind()) {
+  default:
+    return;
+  case MOS::Addr8:
+  case MOS::PCRel8: {
+    // The assembler may still relax this to a longer form that the linker
+    // could relax back, but its later re-encoding doesn't mark the fragment or
+    // section as linker relaxable. Do so now.
+    unsigned LongOpcode = MOSAsmBackend::relaxInstructionTo(Opcode, STI);
+    if (LongOpcode &&
+        (MOSAsmBackend::getZeroPageOpcode(LongOpcode) == Opcode ||
+         MOSAsmBackend::getShortBranchOpcode(LongOpcode, STI) == Opcode))
+      Fixup.setLinkerRelaxable();
+    return;
+  }
+  case MOS::Addr16:
+    ShortOpcode = MOSAsmBackend::getShortBranchOpcode(Opcode, STI);
+    if (ShortOpcode) {
+      RelaxType = ELF::R_MOS_RELAX_BRANCH;
+      break;
+    }
+    ShortOpcode = MOSAsmBackend::getZeroPageOpcode(Opcode);
+    RelaxType = ELF::R_MOS_RELAX_ZP;
+    break;
+  case MOS::PCRel16:
+    ShortOpcode = MOSAsmBackend::getShortBranchOpcode(Opcode, STI);
+    RelaxType = ELF::R_MOS_RELAX_BRANCH;
+    break;
+  }
+
+  // The operand must be the last two bytes of the instruction, and the short
+  // form must differ only by lacking the high byte.
+  if (!ShortOpcode || Fixup.getOffset() + 2 != Size ||
+      MCII.get(ShortOpcode).getSize() + 1 != Size)
+    return;
+  MCInst Short = MI;
+  Short.setOpcode(ShortOpcode);
+  SmallVector<MCFixup, 1> ShortFixups;
+  uint64_t ShortEncoding = getBinaryCodeForInstr(Short, ShortFixups, STI);
+  unsigned OpcodeOffset = Size - 3;
+  uint64_t PrefixMask = maskTrailingOnes<uint64_t>(OpcodeOffset * 8);
+  if ((ShortEncoding & PrefixMask) != (Encoding & PrefixMask))
+    return;
+
+  // Mark the opcode with the short opcode that the linker may substitute.
+  Fixup.setLinkerRelaxable();
+  const MCExpr *ShortOpcodeByte = MCConstantExpr::create(
+      (ShortEncoding >> (OpcodeOffset * 8)) & 0xff, Ctx);
+  Fixups.insert(std::prev(Fixups.end()),
+                MCFixup::create(OpcodeOffset, ShortOpcodeByte,
+                                FirstLiteralRelocationKind + RelaxType));
 }
 
 template <MOS::Fixups Fixup, unsigned Offset>
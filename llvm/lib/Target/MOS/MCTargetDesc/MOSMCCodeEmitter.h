@@ -100,6 +100,12 @@ private:
                          SmallVectorImpl<MCFixup> &Fixups,
                          const MCSubtargetInfo &STI) const override;
 
+  /// Marks an absolute address or long branch operand as linker relaxable,
+  /// adding an R_MOS_RELAX_ZP or R_MOS_RELAX_BRANCH relocation for the opcode.
+  void addLinkerRelaxation(const MCInst &MI, unsigned Size, uint64_t Encoding,
+                           SmallVectorImpl<MCFixup> &Fixups,
+                           const MCSubtargetInfo &STI) const;
+
   MOSMCCodeEmitter(const MOSMCCodeEmitter &) = delete;
   void operator=(const MOSMCCodeEmitter &) = delete;
 
@@ -15,10 +15,13 @@
 #include "llvm/MC/MCELFStreamer.h"
 #define DEBUG_TYPE "mosmcelfstreamer"
 
+#include "MCTargetDesc/MOSFlatObjectWriter.h"
 #include "MCTargetDesc/MOSMCELFStreamer.h"
+#include "MCTargetDesc/MOSMCFlatStreamer.h"
 #include "llvm/MC/MCAsmInfo.h"
 #include "llvm/MC/MCAssembler.h"
 #include "llvm/MC/MCContext.h"
+#include "llvm/MC/MCELFObjectWriter.h"
 #include "llvm/MC/MCExpr.h"
 #include "llvm/MC/MCObjectFileInfo.h"
 #include "llvm/MC/MCObjectWriter.h"
@@ -57,6 +60,9 @@ void MOSMCELFStreamer::changeSection(MCSection *Section, uint32_t Subsection) {
   HasData |= HasPrefix(Section->getName(), ".data");
   HasZPData |= HasPrefix(Section->getName(), ".zp.data");
   HasZPData |= HasPrefix(Section->getName(), ".zp.rodata");
+  // Zero page candidates end up in either region, as the linker decides.
+  HasBSS |= HasPrefix(Section->getName(), ".zp_candidate");
+  HasZPBSS |= HasPrefix(Section->getName(), ".zp_candidate");
   HasInitArray |= HasPrefix(Section->getName(), ".init_array");
   HasFiniArray |= HasPrefix(Section->getName(), ".fini_array");
   MState = MXFlagUnknown;
@@ -123,6 +129,16 @@ MCStreamer *createMOSMCELFStreamer(const Triple & /*T*/, MCContext &Ctx,
                                    std::unique_ptr<MCAsmBackend> &&TAB,
                                    std::unique_ptr<MCObjectWriter> &&OW,
                                    std::unique_ptr<MCCodeEmitter> &&Emitter) {
+  // Flat binary output replaces the ELF writer with one writing to the same
+  // stream.
+  MOS::FlatOutputFormat Format = MOS::getFlatOutputFormat();
+  if (Format != MOS::FlatOutputFormat::None) {
+    raw_pwrite_stream &OS = static_cast<ELFObjectWriter &>(*OW).OS;
+    return new MOSMCFlatStreamer(
+        Ctx, std::move(TAB), std::make_unique<MOSFlatObjectWriter>(OS, Format),
+        std::move(Emitter));
+  }
+
   auto *S = new MOSMCELFStreamer(Ctx, std::move(TAB), std::move(OW),
                                  std::move(Emitter));
   return S;
@@ -46,6 +46,26 @@ const MOSMCExpr *MOSMCExpr::create(VariantKind Kind, const MCExpr *Expr,
   return new (Ctx) MOSMCExpr(Kind, Expr, Negated);
 }
 
+const MCExpr *MOSMCExpr::createOrFold(VariantKind Kind, const MCExpr *Expr,
+                                      bool Negated, MCContext &Ctx) {
+  switch (Kind) {
+  default:
+    return create(Kind, Expr, Negated, Ctx);
+  case VK_ADDR16_LO:
+  case VK_ADDR16_HI:
+  case VK_ADDR24_BANK:
+  case VK_ADDR24_SEGMENT_LO:
+  case VK_ADDR24_SEGMENT_HI:
+    break;
+  }
+
+  int64_t Value;
+  if (!Expr->evaluateAsAbsolute(Value))
+    return create(Kind, Expr, Negated, Ctx);
+  return MCConstantExpr::create(
+      MOSMCExpr(Kind, Expr, Negated).evaluateAsInt64(Value), Ctx);
+}
+
 void MOSMCExpr::printImpl(raw_ostream &OS, const MCAsmInfo *MAI) const {
   assert(Kind != VK_NONE);
 
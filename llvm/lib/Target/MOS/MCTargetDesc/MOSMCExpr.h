@@ -40,6 +40,12 @@ public:
   static const MOSMCExpr *create(VariantKind Kind, const MCExpr *Expr,
                                  bool IsNegated, MCContext &Ctx);
 
+  /// Creates an MOS machine code expression, or the constant it evaluates to
+  /// if Expr is constant and Kind merely selects some of its bytes. Other
+  /// kinds also fix the width of the operand, so they are kept as is.
+  static const MCExpr *createOrFold(VariantKind Kind, const MCExpr *Expr,
+                                    bool IsNegated, MCContext &Ctx);
+
   /// Gets the type of the expression.
   VariantKind getKind() const { return Kind; }
   /// Gets the name of the expression.
@@ -0,0 +1,36 @@
+//===-- MOSMCFlatStreamer.cpp - MOS Flat Binary Streamer ------------------===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "MOSMCFlatStreamer.h"
+
+#include "MCTargetDesc/MOSMCExpr.h"
+
+#include "llvm/MC/MCContext.h"
+#include "llvm/MC/MCSymbol.h"
+
+using namespace llvm;
+
+void MOSMCFlatStreamer::emitCommonSymbol(MCSymbol *Symbol, uint64_t Size,
+                                         Align ByteAlignment) {
+  getContext().reportError(SMLoc(), "common symbol '" + Symbol->getName() +
+                                        "' cannot be placed in a flat binary");
+}
+
+void MOSMCFlatStreamer::emitValueImpl(const MCExpr *Value, unsigned Size,
+                                      SMLoc Loc) {
+  // The decimal address is only known once the image is laid out, and its
+  // length needn't match the space reserved for it.
+  if (const auto *MME = dyn_cast<MOSMCExpr>(Value)) {
+    if (MME->getKind() == MOSMCExpr::VK_ADDR_ASCIZ) {
+      getContext().reportError(
+          Loc, "mos_addr_asciz cannot be resolved in a flat binary");
+      return;
+    }
+  }
+  MCObjectStreamer::emitValueImpl(Value, Size, Loc);
+}
@@ -0,0 +1,40 @@
+//===-- MOSMCFlatStreamer.h - MOS Flat Binary Streamer ----------*- C++ -*-===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_LIB_TARGET_MOS_MCTARGETDESC_MOSMCFLATSTREAMER_H
+#define LLVM_LIB_TARGET_MOS_MCTARGETDESC_MOSMCFLATSTREAMER_H
+
+#include "llvm/MC/MCAsmBackend.h"
+#include "llvm/MC/MCCodeEmitter.h"
+#include "llvm/MC/MCObjectStreamer.h"
+#include "llvm/MC/MCObjectWriter.h"
+
+namespace llvm {
+
+/// Streams a translation unit into a MOSFlatObjectWriter. Symbol attributes
+/// have no meaning in a flat binary, so they are accepted and ignored.
+class MOSMCFlatStreamer : public MCObjectStreamer {
+public:
+  MOSMCFlatStreamer(MCContext &Context, std::unique_ptr<MCAsmBackend> TAB,
+                    std::unique_ptr<MCObjectWriter> OW,
+                    std::unique_ptr<MCCodeEmitter> Emitter)
+      : MCObjectStreamer(Context, std::move(TAB), std::move(OW),
+                         std::move(Emitter)) {}
+
+  bool emitSymbolAttribute(MCSymbol *Symbol, MCSymbolAttr Attribute) override {
+    return true;
+  }
+  void emitCommonSymbol(MCSymbol *Symbol, uint64_t Size,
+                        Align ByteAlignment) override;
+  void emitValueImpl(const MCExpr *Value, unsigned Size,
+                     SMLoc Loc = SMLoc()) override;
+};
+
+} // end namespace llvm
+
+#endif // LLVM_LIB_TARGET_MOS_MCTARGETDESC_MOSMCFLATSTREAMER_H
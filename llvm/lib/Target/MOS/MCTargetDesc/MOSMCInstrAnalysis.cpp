@@ -13,6 +13,7 @@
 #include "MOSMCInstrAnalysis.h"
 #include "MOSMCTargetDesc.h"
 #include "MOSSubtarget.h"
+#include "llvm/ADT/STLExtras.h"
 #include "llvm/MC/MCInstrDesc.h"
 #include "llvm/MC/MCSubtargetInfo.h"
 
@@ -82,4 +83,47 @@ MOSMCInstrAnalysis::evaluateMemoryOperandAddress(const MCInst &Inst,
   return std::nullopt;
 }
 
+std::optional<MCInstrAnalysis::InstrTiming>
+MOSMCInstrAnalysis::getTiming(const MCInst &Inst, const MCSubtargetInfo &STI,
+                              uint64_t Addr, uint64_t Size) const {
+  const MOS::MOSInstrCostEntry *Entry =
+      MOS::getMOSInstrCostEntry(Inst.getOpcode());
+  if (!Entry)
+    return std::nullopt;
+
+  InstrTiming Timing;
+  bool HasPagePenalty;
+  Timing.Cycles = MOS::getTableCycles(*Entry, STI, HasPagePenalty);
+  Timing.NotTakenCycles = Timing.Cycles;
+
+  const MCInstrDesc &Desc = Info->get(Inst.getOpcode());
+  bool IsRelative = any_of(Desc.operands(), [](const MCOperandInfo &Op) {
+    return Op.OperandType == MCOI::OPERAND_PCREL;
+  });
+  if (IsRelative) {
+    // As in MOSInstrCost::getCycleRange, a branch that falls through only
+    // fetches its operand, and a taken branch to another page costs one more
+    // cycle. Branch targets are constant, so the latter is known here.
+    if (Desc.isConditionalBranch())
+      Timing.NotTakenCycles = Entry->Bytes;
+    uint64_t Target;
+    if (HasPagePenalty && evaluateBranch(Inst, Addr, Size, Target) &&
+        (Target & ~0xffULL) != ((Addr + Size) & ~0xffULL))
+      ++Timing.Cycles;
+    return Timing;
+  }
+
+  Timing.IndexPagePenalty = HasPagePenalty && Entry->PageCross;
+  if (Timing.IndexPagePenalty) {
+    // Only absolute indexed addresses have constant bases; indirect indexed
+    // ones are based on a pointer in the zero page.
+    for (const MCOperandInfo &Op : Desc.operands())
+      if (Op.OperandType == MOSOp::OPERAND_ADDR16 ||
+          Op.OperandType == MOSOp::OPERAND_ADDR24)
+        Timing.IndexBase =
+            evaluateMemoryOperandAddress(Inst, &STI, Addr, Size);
+  }
+  return Timing;
+}
+
 } //  namespace llvm
@@ -30,6 +30,11 @@ public:
   std::optional<uint64_t>
   evaluateMemoryOperandAddress(const MCInst &Inst, const MCSubtargetInfo *STI,
                                uint64_t Addr, uint64_t Size) const override;
+
+  std::optional<InstrTiming> getTiming(const MCInst &Inst,
+                                       const MCSubtargetInfo &STI,
+                                       uint64_t Addr,
+                                       uint64_t Size) const override;
 };
 
 } // end namespace llvm
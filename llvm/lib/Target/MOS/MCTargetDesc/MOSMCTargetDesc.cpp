@@ -11,6 +11,7 @@
 //===----------------------------------------------------------------------===//
 
 #include "MOSMCTargetDesc.h"
+#include "MOSFlatObjectWriter.h"
 #include "MOSInstPrinter.h"
 #include "MOSMCAsmInfo.h"
 #include "MOSMCELFStreamer.h"
@@ -84,6 +85,8 @@ static MCInstPrinter *createMOSMCInstPrinter(const Triple &T,
 
 static MCTargetStreamer *
 createMOSObjectTargetStreamer(MCStreamer &S, const MCSubtargetInfo &STI) {
+  if (MOS::getFlatOutputFormat() != MOS::FlatOutputFormat::None)
+    return new MOSTargetFlatStreamer(S);
   return new MOSTargetELFStreamer(S, STI);
 }
 
@@ -139,18 +142,31 @@ extern "C" LLVM_EXTERNAL_VISIBILITY void LLVMInitializeMOSTargetMC() {
   TargetRegistry::RegisterMCAsmBackend(getTheMOSTarget(), createMOSAsmBackend);
 }
 
-constexpr StringRef ZPPrefixes[] = {
-    ".zp",
-    ".zeropage",
-    ".directpage",
-};
-
-bool MOS::isZeroPageSectionName(StringRef Name) {
-  if (Name.empty())
-    return false;
-  for (StringRef Prefix : ZPPrefixes)
-    if (Name.starts_with(Prefix) &&
-        (Name.size() == Prefix.size() || Name[Prefix.size()] == '.'))
-      return true;
-  return false;
+namespace llvm {
+namespace MOS {
+#define GET_MOSInstrCostTable_IMPL
+#include "MOSGenSearchableTables.inc"
+} // namespace MOS
+} // namespace llvm
+
+int32_t MOS::getTableCycles(const MOSInstrCostEntry &Entry,
+                            const MCSubtargetInfo &STI, bool &HasPagePenalty) {
+  // The HuC6280 and SPC700 have fixed timings; the rest pay a cycle for
+  // carrying into the high byte of an indexed address.
+  HasPagePenalty = false;
+  if (STI.hasFeature(MOS::FeatureSPC700))
+    return Entry.CyclesSPC700;
+  if (STI.hasFeature(MOS::FeatureHUC6280))
+    return Entry.CyclesHUC6280;
+  HasPagePenalty = true;
+  // Without its dead cycles, the DTV runs about as fast as the 65CE02, which
+  // dropped them too.
+  if (STI.hasFeature(MOS::Feature65CE02) ||
+      STI.hasFeature(MOS::FeatureDTVSkipCycles))
+    return Entry.Cycles65CE02;
+  return Entry.Cycles;
+}
+
+bool MOS::isBasePageSectionName(StringRef Name) {
+  return Name.starts_with(".bp.") && Name.size() > 4;
 }
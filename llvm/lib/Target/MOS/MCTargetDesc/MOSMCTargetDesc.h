@@ -14,6 +14,7 @@
 #define LLVM_MOS_MCTARGET_DESC_H
 
 #include "llvm/ADT/Sequence.h"
+#include "llvm/BinaryFormat/MOSFlags.h"
 #include "llvm/MC/MCInstrDesc.h"
 #include "llvm/Support/DataTypes.h"
 
@@ -91,7 +92,31 @@ enum TSFlag {
   TSFlagXHigh = (1 << 3)
 };
 
-bool isZeroPageSectionName(StringRef Name);
+/// Returns whether the section is a base page, .bp.<page>. These are addressed
+/// like the zero page, but relative to the page selected by the 65CE02's B
+/// register.
+bool isBasePageSectionName(StringRef Name);
+
+/// An entry of the instruction cost table in MOSInstrInfoTables.td.
+struct MOSInstrCostEntry {
+  unsigned Opcode;
+  uint8_t Bytes;
+  uint8_t Cycles;
+  uint8_t CyclesHUC6280;
+  uint8_t Cycles65CE02;
+  uint8_t CyclesSPC700;
+  bool PageCross;
+};
+
+/// Returns the cost table entry of the real instruction Opcode, or nullptr if
+/// it has none.
+const MOSInstrCostEntry *getMOSInstrCostEntry(unsigned Opcode);
+
+/// Returns the table cycle count of Entry on the processor family of STI, and
+/// sets HasPagePenalty to whether that family pays a cycle for carrying into
+/// the high byte of an indexed address or taken branch.
+int32_t getTableCycles(const MOSInstrCostEntry &Entry,
+                       const MCSubtargetInfo &STI, bool &HasPagePenalty);
 } // namespace MOS
 } // namespace llvm
 
@@ -96,6 +96,9 @@ void MOSTargetAsmStreamer::changeSection(const MCSection *CurSection,
   HasData |= HasPrefix(Section->getName(), ".data");
   HasZPData |= HasPrefix(Section->getName(), ".zp.data");
   HasZPData |= HasPrefix(Section->getName(), ".zp.rodata");
+  // Zero page candidates end up in either region, as the linker decides.
+  HasBSS |= HasPrefix(Section->getName(), ".zp_candidate");
+  HasZPBSS |= HasPrefix(Section->getName(), ".zp_candidate");
   HasInitArray |= HasPrefix(Section->getName(), ".init_array");
   HasFiniArray |= HasPrefix(Section->getName(), ".fini_array");
 }
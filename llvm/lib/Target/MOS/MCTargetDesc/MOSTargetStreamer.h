@@ -94,6 +94,24 @@ private:
   void stronglyReference(MCSymbol *Sym) override;
 };
 
+/// A target streamer for an MOS flat binary. There is no C runtime to inform
+/// of anything, and zero page symbols are placed by section alone.
+class MOSTargetFlatStreamer final : public MOSTargetStreamer {
+public:
+  explicit MOSTargetFlatStreamer(MCStreamer &S) : MOSTargetStreamer(S) {}
+
+private:
+  bool emitDirectiveZeroPage(MCSymbol *Symbol) override { return true; }
+  bool hasBSS() override { return false; }
+  bool hasZPBSS() override { return false; }
+  bool hasData() override { return false; }
+  bool hasZPData() override { return false; }
+  bool hasInitArray() override { return false; }
+  bool hasFiniArray() override { return false; }
+
+  void stronglyReference(MCSymbol *Sym) override {}
+};
+
 } // end namespace llvm
 
 #endif // LLVM_MOS_TARGET_STREAMER_H
@@ -19,17 +19,35 @@
 
 namespace llvm {
 
+void initializeMOSAAWrapperPassPass(PassRegistry &);
+void initializeMOSBitSkipPass(PassRegistry &);
+void initializeMOSBranchIslandsPass(PassRegistry &);
+void initializeMOSColdSplittingPass(PassRegistry &);
 void initializeMOSCombinerPass(PassRegistry &);
 void initializeMOSCopyOptPass(PassRegistry &);
+void initializeMOSCoroFramesPass(PassRegistry &);
+void initializeMOSExternalAAWrapperPass(PassRegistry &);
 void initializeMOSIndexIVPass(PassRegistry &);
 void initializeMOSInsertCopiesPass(PassRegistry &);
 void initializeMOSInternalizePass(PassRegistry &);
+void initializeMOSInterruptRegUsagePass(PassRegistry &);
 void initializeMOSLateOptimizationPass(PassRegistry &);
+void initializeMOSLowerFarPass(PassRegistry &);
+void initializeMOSLowerPortIOPass(PassRegistry &);
 void initializeMOSLowerSelectPass(PassRegistry &);
 void initializeMOSNonReentrantPass(PassRegistry &);
+void initializeMOSPageAlignPass(PassRegistry &);
+void initializeMOSPointerArgsPass(PassRegistry &);
 void initializeMOSPostRAScavengingPass(PassRegistry &);
+void initializeMOSRedundantTransfersPass(PassRegistry &);
+void initializeMOSRegPlacementPass(PassRegistry &);
+void initializeMOSSelfModifyPass(PassRegistry &);
 void initializeMOSShiftRotateChainPass(PassRegistry &);
+void initializeMOSStaticArgsPass(PassRegistry &);
 void initializeMOSStaticStackAllocPass(PassRegistry &);
+void initializeMOSSwitchTablesPass(PassRegistry &);
+void initializeMOSTraceHooksPass(PassRegistry &);
+void initializeMOSWideAccumulatorPass(PassRegistry &);
 void initializeMOSZeroPageAllocPass(PassRegistry &);
 
 // The behind-by-one property of the std::reverse_iterator adaptor applied by
@@ -0,0 +1,232 @@
+//===-- MOSAliasAnalysis.cpp - MOS Memory Map Alias Analysis --------------===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines the MOS memory map based alias analysis.
+//
+// The compiler knows nothing of a target's memory map by itself, so accesses
+// to constant addresses, like memory-mapped I/O registers, and through zero
+// page pointers may alias any RAM as far as BasicAA is concerned. This
+// analysis takes the memory map of the target device from -mos-memory-map,
+// usually given by the SDK's per-platform configuration, and classifies each
+// memory location by the kinds of memory it may lie in:
+//
+//  - Constant addresses lie in the regions they overlap.
+//  - Zero page pointers lie in the regions overlapping $00-$FF.
+//  - Globals defined without an explicit section lie in zero page or RAM, or
+//    in ROM if constant, since the linker places them there.
+//  - Stack objects lie in zero page, the stack page, or RAM.
+//
+// Addresses left out of the map may hold anything. Locations that share no
+// kind of memory cannot alias, and neither can disjoint constant ranges within
+// the map. Constant ranges wholly in ROM cannot be modified.
+//
+// The map must describe each physical location by only one address. Mirrors,
+// like those of the NES's RAM, and bank-switched windows should be left out,
+// so that they may alias anything.
+//
+//===----------------------------------------------------------------------===//
+
+#include "MOSAliasAnalysis.h"
+
+#include "MOS.h"
+#include "MOSInstrInfo.h"
+
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringSwitch.h"
+#include "llvm/Analysis/MemoryLocation.h"
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/MathExtras.h"
+
+using namespace llvm;
+using namespace llvm::mos;
+
+#define DEBUG_TYPE "mos-aa"
+
+static cl::list<std::string>
+    MemoryMap("mos-memory-map", cl::CommaSeparated,
+              cl::desc("Regions of the target's memory map, each as "
+                       "<kind>:<first>-<last>, with kind one of zp, stack, "
+                       "ram, io or rom"),
+              cl::Hidden);
+
+struct MOSAAResult::Extent {
+  unsigned Kinds = MK_All;
+  // The constant address range of the location, if known.
+  std::optional<std::pair<uint64_t, uint64_t>> Range;
+};
+
+MOSAAResult::MOSAAResult(const DataLayout &DL) : DL(DL) {
+  for (StringRef Entry : MemoryMap) {
+    auto [KindName, Bounds] = Entry.split(':');
+    auto [FirstStr, LastStr] = Bounds.split('-');
+    std::optional<MemoryKind> Kind =
+        StringSwitch<std::optional<MemoryKind>>(KindName.trim())
+            .Case("zp", MK_ZeroPage)
+            .Case("stack", MK_Stack)
+            .Case("ram", MK_RAM)
+            .Case("io", MK_IO)
+            .Case("rom", MK_ROM)
+            .Default(std::nullopt);
+    uint64_t First, Last;
+    if (!Kind || FirstStr.trim().getAsInteger(0, First) ||
+        LastStr.trim().getAsInteger(0, Last) || First > Last)
+      report_fatal_error("invalid -mos-memory-map region: " + Entry);
+    Map.push_back({First, Last + 1, *Kind});
+  }
+  sort(Map, [](const MemoryRegion &A, const MemoryRegion &B) {
+    return A.Begin < B.Begin;
+  });
+}
+
+unsigned MOSAAResult::getKinds(uint64_t Begin, uint64_t End) const {
+  unsigned Kinds = 0;
+  uint64_t Cur = Begin;
+  for (const MemoryRegion &R : Map) {
+    if (R.End <= Cur)
+      continue;
+    if (R.Begin >= End)
+      break;
+    if (R.Begin > Cur)
+      Kinds |= MK_Unmapped;
+    Kinds |= R.Kind;
+    Cur = R.End;
+  }
+  if (Cur < End)
+    Kinds |= MK_Unmapped;
+  return Kinds;
+}
+
+MOSAAResult::Extent MOSAAResult::getExtent(const MemoryLocation &Loc) const {
+  Extent E;
+  const Value *Ptr = Loc.Ptr;
+  unsigned AS = Ptr->getType()->getPointerAddressSpace();
+  // Far addresses lie outside the memory map, save through the window that
+  // they are mapped into.
+  if (AS == MOS::AS_Far)
+    return E;
+  unsigned PtrBits = DL.getPointerSizeInBits(AS);
+
+  APInt Offset(DL.getIndexTypeSizeInBits(Ptr->getType()), 0);
+  const Value *Base =
+      Ptr->stripAndAccumulateConstantOffsets(DL, Offset,
+                                             /*AllowNonInbounds=*/true);
+  std::optional<uint64_t> Addr;
+  if (isa<ConstantPointerNull>(Base))
+    Addr = 0;
+  else if (const auto *CE = dyn_cast<ConstantExpr>(Base);
+           CE && CE->getOpcode() == Instruction::IntToPtr)
+    if (const auto *CI = dyn_cast<ConstantInt>(CE->getOperand(0)))
+      Addr = CI->getZExtValue();
+  if (Addr) {
+    if (!Loc.Size.hasValue() || Loc.Size.isScalable())
+      return E;
+    uint64_t Begin = (*Addr + Offset.getSExtValue()) &
+                     maskTrailingOnes<uint64_t>(PtrBits);
+    uint64_t End = Begin + Loc.Size.getValue().getFixedValue();
+    if (End > (uint64_t(1) << PtrBits))
+      return E;
+    E.Kinds = getKinds(Begin, End);
+    E.Range = {Begin, End};
+    return E;
+  }
+
+  // Zero page pointers can reach no further than the zero page, since
+  // indexing wraps around within it.
+  if (AS == MOS::AS_ZeroPage) {
+    E.Kinds = getKinds(0, 0x100);
+    return E;
+  }
+
+  const Value *Obj = getUnderlyingObject(Ptr);
+  if (isa<AllocaInst>(Obj)) {
+    E.Kinds = MK_ZeroPage | MK_Stack | MK_RAM | MK_Unmapped;
+  } else if (const auto *GV = dyn_cast<GlobalVariable>(Obj)) {
+    // Declarations may be absolute symbols, and sections may be placed
+    // anywhere.
+    if (!GV->isDeclaration() && !GV->hasSection()) {
+      E.Kinds = MK_ZeroPage | MK_RAM | MK_Unmapped;
+      if (GV->isConstant())
+        E.Kinds |= MK_ROM;
+    }
+  }
+  return E;
+}
+
+AliasResult MOSAAResult::alias(const MemoryLocation &LocA,
+                               const MemoryLocation &LocB, AAQueryInfo &AAQI,
+                               const Instruction *) {
+  if (Map.empty())
+    return AliasResult::MayAlias;
+
+  Extent A = getExtent(LocA);
+  Extent B = getExtent(LocB);
+  if (!(A.Kinds & B.Kinds))
+    return AliasResult::NoAlias;
+  if (A.Range && B.Range && !((A.Kinds | B.Kinds) & MK_Unmapped) &&
+      (A.Range->second <= B.Range->first || B.Range->second <= A.Range->first))
+    return AliasResult::NoAlias;
+  return AliasResult::MayAlias;
+}
+
+ModRefInfo MOSAAResult::getModRefInfoMask(const MemoryLocation &Loc,
+                                          AAQueryInfo &AAQI,
+                                          bool IgnoreLocals) {
+  if (Map.empty())
+    return ModRefInfo::ModRef;
+
+  Extent E = getExtent(Loc);
+  if (E.Range && E.Kinds == MK_ROM)
+    return ModRefInfo::NoModRef;
+  return ModRefInfo::ModRef;
+}
+
+AnalysisKey MOSAA::Key;
+
+MOSAAResult MOSAA::run(Function &F, AnalysisManager<Function> &AM) {
+  return MOSAAResult(F.getDataLayout());
+}
+
+char MOSAAWrapperPass::ID = 0;
+char MOSExternalAAWrapper::ID = 0;
+
+INITIALIZE_PASS(MOSAAWrapperPass, "mos-aa",
+                "MOS Memory Map Alias Analysis", false, true)
+
+INITIALIZE_PASS(MOSExternalAAWrapper, "mos-aa-wrapper",
+                "MOS Memory Map Alias Analysis Wrapper", false, true)
+
+ImmutablePass *llvm::createMOSAAWrapperPass() { return new MOSAAWrapperPass(); }
+
+ImmutablePass *llvm::createMOSExternalAAWrapperPass() {
+  return new MOSExternalAAWrapper();
+}
+
+MOSAAWrapperPass::MOSAAWrapperPass() : ImmutablePass(ID) {
+  initializeMOSAAWrapperPassPass(*PassRegistry::getPassRegistry());
+}
+
+bool MOSAAWrapperPass::doInitialization(Module &M) {
+  Result.reset(new MOSAAResult(M.getDataLayout()));
+  return false;
+}
+
+bool MOSAAWrapperPass::doFinalization(Module &M) {
+  Result.reset();
+  return false;
+}
+
+void MOSAAWrapperPass::getAnalysisUsage(AnalysisUsage &AU) const {
+  AU.setPreservesAll();
+}
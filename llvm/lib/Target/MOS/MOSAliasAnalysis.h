@@ -0,0 +1,132 @@
+//===-- MOSAliasAnalysis.h - MOS Memory Map Alias Analysis ------*- C++ -*-===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares the MOS memory map based alias analysis.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_LIB_TARGET_MOS_MOSALIASANALYSIS_H
+#define LLVM_LIB_TARGET_MOS_MOSALIASANALYSIS_H
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Analysis/AliasAnalysis.h"
+#include "llvm/Pass.h"
+
+namespace llvm {
+
+class DataLayout;
+class MemoryLocation;
+
+namespace mos {
+
+// The kinds of memory that an address region may hold, as a bitmask.
+enum MemoryKind : unsigned {
+  MK_ZeroPage = 1 << 0,
+  MK_Stack = 1 << 1,
+  MK_RAM = 1 << 2,
+  MK_IO = 1 << 3,
+  MK_ROM = 1 << 4,
+  // Addresses outside of the memory map.
+  MK_Unmapped = 1 << 5,
+  MK_All = (1 << 6) - 1,
+};
+
+// A region of the memory map, covering [Begin, End).
+struct MemoryRegion {
+  uint64_t Begin;
+  uint64_t End;
+  MemoryKind Kind;
+};
+
+} // namespace mos
+
+class MOSAAResult : public AAResultBase {
+  const DataLayout &DL;
+  // The memory map, sorted by address.
+  SmallVector<mos::MemoryRegion> Map;
+
+public:
+  explicit MOSAAResult(const DataLayout &DL);
+  MOSAAResult(MOSAAResult &&Arg)
+      : AAResultBase(std::move(Arg)), DL(Arg.DL), Map(std::move(Arg.Map)) {}
+
+  /// Handle invalidation events from the new pass manager.
+  ///
+  /// By definition, this result is stateless and so remains valid.
+  bool invalidate(Function &, const PreservedAnalyses &,
+                  FunctionAnalysisManager::Invalidator &Inv) {
+    return false;
+  }
+
+  AliasResult alias(const MemoryLocation &LocA, const MemoryLocation &LocB,
+                    AAQueryInfo &AAQI, const Instruction *CtxI = nullptr);
+
+  ModRefInfo getModRefInfoMask(const MemoryLocation &Loc, AAQueryInfo &AAQI,
+                               bool IgnoreLocals);
+
+  /// Returns the mask of the kinds of memory that the addresses [Begin, End)
+  /// may hold, including MK_Unmapped for any outside the memory map.
+  unsigned getKinds(uint64_t Begin, uint64_t End) const;
+
+private:
+  struct Extent;
+  Extent getExtent(const MemoryLocation &Loc) const;
+};
+
+/// Analysis pass providing a never-invalidated alias analysis result.
+class MOSAA : public AnalysisInfoMixin<MOSAA> {
+  friend AnalysisInfoMixin<MOSAA>;
+
+  static AnalysisKey Key;
+
+public:
+  using Result = MOSAAResult;
+
+  MOSAAResult run(Function &F, AnalysisManager<Function> &AM);
+};
+
+/// Legacy wrapper pass to provide the MOSAAResult object.
+class MOSAAWrapperPass : public ImmutablePass {
+  std::unique_ptr<MOSAAResult> Result;
+
+public:
+  static char ID;
+
+  MOSAAWrapperPass();
+
+  MOSAAResult &getResult() { return *Result; }
+  const MOSAAResult &getResult() const { return *Result; }
+
+  bool doInitialization(Module &M) override;
+  bool doFinalization(Module &M) override;
+  void getAnalysisUsage(AnalysisUsage &AU) const override;
+};
+
+// Wrapper around ExternalAAWrapperPass so that the default constructor gets
+// the callback.
+class MOSExternalAAWrapper : public ExternalAAWrapperPass {
+public:
+  static char ID;
+
+  MOSExternalAAWrapper()
+      : ExternalAAWrapperPass([](Pass &P, Function &, AAResults &AAR) {
+          if (auto *WrapperPass = P.getAnalysisIfAvailable<MOSAAWrapperPass>())
+            AAR.addAAResult(WrapperPass->getResult());
+        }) {}
+
+  StringRef getPassName() const override {
+    return "MOS Memory Map Alias Analysis Wrapper";
+  }
+};
+
+ImmutablePass *createMOSAAWrapperPass();
+ImmutablePass *createMOSExternalAAWrapperPass();
+
+} // end namespace llvm
+
+#endif // not LLVM_LIB_TARGET_MOS_MOSALIASANALYSIS_H
@@ -15,35 +15,91 @@
 #include "MCTargetDesc/MOSMCExpr.h"
 #include "MCTargetDesc/MOSMCTargetDesc.h"
 #include "MCTargetDesc/MOSTargetStreamer.h"
+#include "MOSInstrCost.h"
 #include "MOSMCInstLower.h"
 #include "MOSMachineFunctionInfo.h"
 #include "MOSRegisterInfo.h"
 #include "MOSSubtarget.h"
+#include "MOSTraceHooks.h"
 #include "TargetInfo/MOSTargetInfo.h"
 
+#include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/ADT/StringSet.h"
 #include "llvm/BinaryFormat/MOSFlags.h"
 #include "llvm/CodeGen/AsmPrinter.h"
 #include "llvm/CodeGen/MachineFrameInfo.h"
 #include "llvm/CodeGen/MachineJumpTableInfo.h"
+#include "llvm/CodeGen/MachineOptimizationRemarkEmitter.h"
 #include "llvm/CodeGen/TargetFrameLowering.h"
 #include "llvm/CodeGen/TargetSubtargetInfo.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DebugInfoMetadata.h"
+#include "llvm/IR/DiagnosticInfo.h"
 #include "llvm/IR/Module.h"
 #include "llvm/MC/MCAssembler.h"
+#include "llvm/MC/MCContext.h"
+#include "llvm/MC/MCInstBuilder.h"
+#include "llvm/MC/MCSectionELF.h"
 #include "llvm/MC/MCStreamer.h"
 #include "llvm/MC/TargetRegistry.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/MathExtras.h"
 #include "llvm/Target/TargetLoweringObjectFile.h"
 
 using namespace llvm;
 
 #define DEBUG_TYPE "asm-printer"
 
+static cl::opt<bool> AnnotateCycles(
+    "mos-annotate-cycles",
+    cl::desc("Annotate instructions and basic blocks with their cycle counts, "
+             "and record the block counts in a .mos.cycles note"),
+    cl::Hidden);
+
 namespace {
 
 class MOSAsmPrinter : public AsmPrinter {
   MOSMCInstLower InstLowering;
 
+  // The best and worst case cycle counts of some code.
+  using CycleRange = std::pair<int32_t, int32_t>;
+
+  // The best and worst case cycle counts of a basic block.
+  struct BlockCycles {
+    const MCSymbol *Begin;
+    int32_t Best;
+    int32_t Worst;
+  };
+
+  // Cycle annotation state for the block being emitted. The block is untimed
+  // if any of its instructions has no known cycle count.
+  bool InBlock = false;
+  MCSymbol *BlockBegin = nullptr;
+  int32_t BlockBest = 0;
+  int32_t BlockWorst = 0;
+  bool BlockTimed = false;
+
+  // The timed blocks of the module, for the .mos.cycles note.
+  SmallVector<BlockCycles> TimedBlocks;
+
+  // A BRK trap and its source location, for the .mos.trap note. Its ID is its
+  // index in Traps.
+  struct TrapSite {
+    const MCSymbol *Begin;
+    unsigned Line;
+    std::string File;
+  };
+  SmallVector<TrapSite> Traps;
+
+  // The "mos-cycle-budget" of the function being emitted, whether it is
+  // "mos-timed", and the best and worst case cycle counts of its blocks, or
+  // none for untimed blocks.
+  std::optional<uint64_t> CycleBudget;
+  bool Timed = false;
+  DenseMap<const MachineBasicBlock *, std::optional<CycleRange>>
+      BlockCycleRanges;
+
 public:
   explicit MOSAsmPrinter(TargetMachine &TM,
                          std::unique_ptr<MCStreamer> Streamer)
@@ -60,8 +116,28 @@ public:
                               uint64_t Offset = 0) override;
 
   void EmitToStreamer(MCStreamer &S, MCInst &Inst);
-
+  void annotateCycles(unsigned Opcode);
+  std::optional<std::pair<uint64_t, uint64_t>>
+  getFunctionCycles(function_ref<void(const Twine &)> Unknown) const;
+  void checkCycleBudget();
+  void reportTimedCycles();
+
+  bool runOnMachineFunction(MachineFunction &MF) override;
+
+  void emitFunctionBodyStart() override;
+  void emitFunctionBodyEnd() override;
+  void emitBasicBlockStart(const MachineBasicBlock &MBB) override;
+  void emitBasicBlockEnd(const MachineBasicBlock &MBB) override;
   void emitInstruction(const MachineInstr *MI) override;
+  void emitJMPRTS(const MachineInstr *MI);
+  void emitBITSkip(const MachineInstr *MI);
+  void emitTrapBRK(const MachineInstr *MI);
+  void emitTXRemap(const MachineInstr *MI);
+  void emitMemoryLoop(const MachineInstr *MI);
+  void emitMEGA65DMA(const MachineInstr *MI);
+  void emitMEGA65DivWait(const MachineInstr *MI);
+  void emitDecimal(const MachineInstr *MI);
+  const MCExpr *lowerAddress(const MachineOperand &MO, int64_t Offset);
 
   bool PrintAsmOperand(const MachineInstr *MI, unsigned OpNo,
                        const char *ExtraCode, raw_ostream &OS) override;
@@ -70,6 +146,9 @@ public:
                              const char *ExtraCode, raw_ostream &OS) override;
 
   void emitStartOfAsmFile(Module &M) override;
+  void emitEndOfAsmFile(Module &M) override;
+  void emitTraceNote(Module &M);
+  void emitTrapNote();
 
   void emitJumpTableInfo() override;
 
@@ -117,14 +196,294 @@ const MCExpr *MOSAsmPrinter::lowerConstant(const Constant *CV,
 }
 
 void MOSAsmPrinter::EmitToStreamer(MCStreamer &S, MCInst &Inst) {
-  MOSAsmBackend::translateOpcodeToSubtarget(Inst, MF->getSubtarget());
+  const MOSSubtarget &STI = MF->getSubtarget<MOSSubtarget>();
+  // The cost table is keyed on 6502 opcodes, with a column for the SPC700.
+  unsigned CostOpcode = Inst.getOpcode();
+  MOSAsmBackend::translateOpcodeToSubtarget(Inst, STI);
   // If this instruction contains an out-of-range immediate address, perform an
   // early relax.
-  MOSAsmBackend::relaxForImmediate(Inst, MF->getSubtarget<MOSSubtarget>());
+  MOSAsmBackend::relaxForImmediate(Inst, STI);
+  if (AnnotateCycles || CycleBudget || Timed)
+    annotateCycles(STI.hasSPC700() ? CostOpcode : Inst.getOpcode());
   AsmPrinter::EmitToStreamer(S, Inst);
 }
 
+static std::string formatCycles(int32_t Best, int32_t Worst) {
+  if (Best == Worst)
+    return (Twine(Best) + " cycles").str();
+  return (Twine(Best) + "-" + Twine(Worst) + " cycles").str();
+}
+
+void MOSAsmPrinter::annotateCycles(unsigned Opcode) {
+  if (!InBlock)
+    return;
+  const MOSSubtarget &STI = MF->getSubtarget<MOSSubtarget>();
+  auto Range =
+      MOSInstrCost::getCycleRange(STI.getInstrInfo()->get(Opcode), STI);
+  if (!Range) {
+    BlockTimed = false;
+    return;
+  }
+  auto [Best, Worst] = *Range;
+  BlockBest += Best;
+  BlockWorst += Worst;
+  if (AnnotateCycles && isVerbose())
+    OutStreamer->addComment(formatCycles(Best, Worst));
+}
+
+void MOSAsmPrinter::emitBasicBlockStart(const MachineBasicBlock &MBB) {
+  AsmPrinter::emitBasicBlockStart(MBB);
+  if (!AnnotateCycles && !CycleBudget && !Timed)
+    return;
+
+  if (AnnotateCycles) {
+    // The block symbol isn't always emitted, so mark the block's start for the
+    // note separately.
+    BlockBegin = OutContext.createTempSymbol();
+    OutStreamer->emitLabel(BlockBegin);
+  }
+  InBlock = true;
+  BlockBest = BlockWorst = 0;
+  // Inline assembly and the pseudos that expand to loops can't be timed as
+  // straight-line code.
+  BlockTimed = none_of(MBB, [](const MachineInstr &MI) {
+    switch (MI.getOpcode()) {
+    default:
+      return MI.isInlineAsm();
+    case MOS::MemcpyIdx:
+    case MOS::MemsetIdx:
+    case MOS::MEGA65DMA:
+    case MOS::MEGA65DivWait:
+      return true;
+    }
+  });
+}
+
+void MOSAsmPrinter::emitBasicBlockEnd(const MachineBasicBlock &MBB) {
+  AsmPrinter::emitBasicBlockEnd(MBB);
+  if (!InBlock)
+    return;
+  InBlock = false;
+
+  if (CycleBudget || Timed)
+    BlockCycleRanges[&MBB] =
+        BlockTimed ? std::optional(std::make_pair(BlockBest, BlockWorst))
+                   : std::nullopt;
+  if (!AnnotateCycles)
+    return;
+
+  if (BlockTimed) {
+    if (isVerbose())
+      OutStreamer->emitRawComment(" block: " +
+                                  formatCycles(BlockBest, BlockWorst));
+    TimedBlocks.push_back({BlockBegin, BlockBest, BlockWorst});
+  } else if (isVerbose()) {
+    OutStreamer->emitRawComment(" block: cycles unknown");
+  }
+  BlockBegin = nullptr;
+}
+
+// A timed function that fits in a page is aligned to the next power of two
+// at or above its size, which keeps all of it within one page. Its taken
+// branches then never pay for crossing a page, wherever it is linked.
+bool MOSAsmPrinter::runOnMachineFunction(MachineFunction &MF) {
+  const Function &F = MF.getFunction();
+  if (F.hasFnAttribute("mos-timed")) {
+    const TargetInstrInfo &TII = *MF.getSubtarget().getInstrInfo();
+    uint64_t Size = 0;
+    for (const MachineBasicBlock &MBB : MF)
+      for (const MachineInstr &MI : MBB)
+        Size += TII.getInstSizeInBytes(MI);
+    if (Size > 256)
+      F.getContext().diagnose(DiagnosticInfoUnsupported(
+          F, "timed function is larger than a page, so its branches may "
+             "cross page boundaries",
+          DebugLoc(), DS_Warning));
+    else
+      MF.ensureAlignment(Align(PowerOf2Ceil(std::max<uint64_t>(Size, 1))));
+  }
+  return AsmPrinter::runOnMachineFunction(MF);
+}
+
+void MOSAsmPrinter::emitFunctionBodyStart() {
+  CycleBudget.reset();
+  BlockCycleRanges.clear();
+  Attribute Budget = MF->getFunction().getFnAttribute("mos-cycle-budget");
+  uint64_t Cycles;
+  if (Budget.isValid() && !Budget.getValueAsString().getAsInteger(10, Cycles))
+    CycleBudget = Cycles;
+  Timed = MF->getFunction().hasFnAttribute("mos-timed");
+}
+
+void MOSAsmPrinter::emitFunctionBodyEnd() {
+  if (CycleBudget)
+    checkCycleBudget();
+  if (Timed)
+    reportTimedCycles();
+  CycleBudget.reset();
+  Timed = false;
+  BlockCycleRanges.clear();
+}
+
+// Returns the cycle budget of the function called by MI, if it has one.
+static std::optional<uint64_t> getCalleeCycleBudget(const MachineInstr &MI) {
+  for (const MachineOperand &MO : MI.operands()) {
+    if (!MO.isGlobal())
+      continue;
+    const auto *Callee = dyn_cast<Function>(MO.getGlobal());
+    if (!Callee)
+      return std::nullopt;
+    Attribute Budget = Callee->getFnAttribute("mos-cycle-budget");
+    uint64_t Cycles;
+    if (!Budget.isValid() || Budget.getValueAsString().getAsInteger(10, Cycles))
+      return std::nullopt;
+    return Cycles;
+  }
+  return std::nullopt;
+}
+
+// Returns the best and worst case cycle counts of the function. Since the
+// printer sees the final instructions, these are the shortest and longest
+// paths through the CFG, with calls counted at their callees' own budgets in
+// the worst case and as free in the best. Functions with loops, untimed
+// blocks, or calls to functions without budgets can't be bounded this way, so
+// Unknown is called with the reason instead.
+std::optional<std::pair<uint64_t, uint64_t>> MOSAsmPrinter::getFunctionCycles(
+    function_ref<void(const Twine &)> Unknown) const {
+  // The best and worst case cycles from the start of each block to a return,
+  // filled in as a postorder DFS finishes the block.
+  DenseMap<const MachineBasicBlock *, std::pair<uint64_t, uint64_t>> ToExit;
+  SmallPtrSet<const MachineBasicBlock *, 16> OnStack;
+  struct Frame {
+    const MachineBasicBlock *MBB;
+    MachineBasicBlock::const_succ_iterator Next;
+  };
+  SmallVector<Frame> Stack;
+  const MachineBasicBlock *Entry = &MF->front();
+  Stack.push_back({Entry, Entry->succ_begin()});
+  OnStack.insert(Entry);
+  while (!Stack.empty()) {
+    Frame &Top = Stack.back();
+    if (Top.Next != Top.MBB->succ_end()) {
+      const MachineBasicBlock *Succ = *Top.Next++;
+      if (OnStack.contains(Succ)) {
+        Unknown("contains a loop");
+        return std::nullopt;
+      }
+      if (!ToExit.contains(Succ)) {
+        Stack.push_back({Succ, Succ->succ_begin()});
+        OnStack.insert(Succ);
+      }
+      continue;
+    }
+
+    const MachineBasicBlock *MBB = Top.MBB;
+    std::optional<CycleRange> Own = BlockCycleRanges.lookup(MBB);
+    if (!Own) {
+      Unknown("contains code with unknown timing");
+      return std::nullopt;
+    }
+    uint64_t Best = Own->first;
+    uint64_t Worst = Own->second;
+    for (const MachineInstr &MI : *MBB) {
+      if (!MI.isCall())
+        continue;
+      std::optional<uint64_t> CalleeBudget = getCalleeCycleBudget(MI);
+      if (!CalleeBudget) {
+        Unknown("calls a function without a cycle budget");
+        return std::nullopt;
+      }
+      Worst += *CalleeBudget;
+    }
+    if (!MBB->succ_empty()) {
+      uint64_t BestSucc = UINT64_MAX;
+      uint64_t WorstSucc = 0;
+      for (const MachineBasicBlock *Succ : MBB->successors()) {
+        auto [SuccBest, SuccWorst] = ToExit.lookup(Succ);
+        BestSucc = std::min(BestSucc, SuccBest);
+        WorstSucc = std::max(WorstSucc, SuccWorst);
+      }
+      Best += BestSucc;
+      Worst += WorstSucc;
+    }
+    ToExit[MBB] = {Best, Worst};
+    OnStack.erase(MBB);
+    Stack.pop_back();
+  }
+  return ToExit.lookup(Entry);
+}
+
+// Checks the worst case cycle count of the function against its budget,
+// warning if it can't be bounded.
+void MOSAsmPrinter::checkCycleBudget() {
+  const Function &F = MF->getFunction();
+  std::optional<std::pair<uint64_t, uint64_t>> Cycles =
+      getFunctionCycles([&](const Twine &Reason) {
+        F.getContext().diagnose(DiagnosticInfoUnsupported(
+            F, "cycle budget cannot be verified: " + Reason, DebugLoc(),
+            DS_Warning));
+      });
+  if (Cycles && Cycles->second > *CycleBudget)
+    F.getContext().diagnose(DiagnosticInfoResourceLimit(
+        F, "worst case cycle count", Cycles->second, *CycleBudget,
+        DS_Warning));
+}
+
+// Reports the cycle counts of a timed function as an analysis remark, for
+// -Rpass-analysis=asm-printer.
+void MOSAsmPrinter::reportTimedCycles() {
+  const MachineBasicBlock &Entry = MF->front();
+  std::optional<std::pair<uint64_t, uint64_t>> Cycles =
+      getFunctionCycles([&](const Twine &Reason) {
+        ORE->emit([&]() {
+          return MachineOptimizationRemarkAnalysis(DEBUG_TYPE, "TimedCycles",
+                                                   DebugLoc(), &Entry)
+                 << "timed function has no fixed cycle count: "
+                 << Reason.str();
+        });
+      });
+  if (!Cycles)
+    return;
+  ORE->emit([&]() {
+    return MachineOptimizationRemarkAnalysis(DEBUG_TYPE, "TimedCycles",
+                                             DebugLoc(), &Entry)
+           << "timed function takes " << ore::NV("BestCycles", Cycles->first)
+           << " to " << ore::NV("WorstCycles", Cycles->second) << " cycles";
+  });
+}
+
 void MOSAsmPrinter::emitInstruction(const MachineInstr *MI) {
+  switch (MI->getOpcode()) {
+  case MOS::JMPRTS:
+    emitJMPRTS(MI);
+    return;
+  case MOS::BITSkip:
+    emitBITSkip(MI);
+    return;
+  case MOS::TrapBRK:
+    emitTrapBRK(MI);
+    return;
+  case MOS::TXRemap:
+    emitTXRemap(MI);
+    return;
+  case MOS::MemcpyIdx:
+  case MOS::MemsetIdx:
+    emitMemoryLoop(MI);
+    return;
+  case MOS::MEGA65DMA:
+    emitMEGA65DMA(MI);
+    return;
+  case MOS::MEGA65DivWait:
+    emitMEGA65DivWait(MI);
+    return;
+  case MOS::ADCDecImm:
+  case MOS::ADCDecImag8:
+  case MOS::SBCDecImm:
+  case MOS::SBCDecImag8:
+    emitDecimal(MI);
+    return;
+  }
+
   // Do any auto-generated pseudo lowerings.
   if (MCInst OutInst; lowerPseudoInstExpansion(MI, OutInst)) {
     EmitToStreamer(*OutStreamer, OutInst);
@@ -136,6 +495,220 @@ void MOSAsmPrinter::emitInstruction(const MachineInstr *MI) {
   EmitToStreamer(*OutStreamer, Inst);
 }
 
+void MOSAsmPrinter::emitJMPRTS(const MachineInstr *MI) {
+  const MachineOperand &Table = MI->getOperand(0);
+  const MachineJumpTableInfo *JTI = MF->getJumpTableInfo();
+  size_t NumEntries = JTI->getJumpTables()[Table.getIndex()].MBBs.size();
+  unsigned LoadOpcode =
+      MI->getOperand(1).getReg() == MOS::X ? MOS::LDA_AbsoluteX
+                                           : MOS::LDA_AbsoluteY;
+
+  // RTS pops the low byte first, so the high byte must be pushed first.
+  const MCExpr *Lo =
+      MCSymbolRefExpr::create(GetJTISymbol(Table.getIndex()), OutContext);
+  const MCExpr *Hi = MCBinaryExpr::createAdd(
+      Lo, MCConstantExpr::create(NumEntries, OutContext), OutContext);
+  for (const MCExpr *Expr : {Hi, Lo}) {
+    EmitToStreamer(*OutStreamer, MCInstBuilder(LoadOpcode).addExpr(Expr));
+    EmitToStreamer(*OutStreamer, MCInstBuilder(MOS::PHA_Implied));
+  }
+  EmitToStreamer(*OutStreamer, MCInstBuilder(MOS::RTS_Implied));
+}
+
+static bool isDecimal(const MachineInstr &MI) {
+  switch (MI.getOpcode()) {
+  default:
+    return false;
+  case MOS::ADCDecImm:
+  case MOS::ADCDecImag8:
+  case MOS::SBCDecImm:
+  case MOS::SBCDecImag8:
+    return true;
+  }
+}
+
+void MOSAsmPrinter::emitDecimal(const MachineInstr *MI) {
+  // Decimal mode only lasts between the first and last of a run of decimal
+  // instructions; everything else, including interrupt handlers, assumes it's
+  // off.
+  const MachineBasicBlock &MBB = *MI->getParent();
+  bool Continues = false;
+  if (MI->getIterator() != MBB.instr_begin()) {
+    auto Prev = skipDebugInstructionsBackward(std::prev(MI->getIterator()),
+                                              MBB.instr_begin());
+    Continues = isDecimal(*Prev);
+  }
+  if (!Continues)
+    EmitToStreamer(*OutStreamer, MCInstBuilder(MOS::SED_Implied));
+
+  unsigned Opcode;
+  switch (MI->getOpcode()) {
+  default:
+    llvm_unreachable("Unexpected decimal instruction");
+  case MOS::ADCDecImm:
+    Opcode = MOS::ADC_Immediate;
+    break;
+  case MOS::ADCDecImag8:
+    Opcode = MOS::ADC_ZeroPage;
+    break;
+  case MOS::SBCDecImm:
+    Opcode = MOS::SBC_Immediate;
+    break;
+  case MOS::SBCDecImag8:
+    Opcode = MOS::SBC_ZeroPage;
+    break;
+  }
+  MCOperand R;
+  lowerOperand(MI->getOperand(4), R);
+  EmitToStreamer(*OutStreamer, MCInstBuilder(Opcode).addOperand(R));
+
+  auto Next = skipDebugInstructionsForward(std::next(MI->getIterator()),
+                                           MBB.instr_end());
+  if (Next == MBB.instr_end() || !isDecimal(*Next))
+    EmitToStreamer(*OutStreamer, MCInstBuilder(MOS::CLD_Implied));
+}
+
+const MCExpr *MOSAsmPrinter::lowerAddress(const MachineOperand &MO,
+                                          int64_t Offset) {
+  MCOperand Op;
+  lowerOperand(MO, Op);
+  const MCExpr *Expr =
+      Op.isImm() ? MCConstantExpr::create(Op.getImm(), OutContext)
+                 : Op.getExpr();
+  if (Offset)
+    Expr = MCBinaryExpr::createAdd(
+        Expr, MCConstantExpr::create(Offset, OutContext), OutContext);
+  return Expr;
+}
+
+void MOSAsmPrinter::emitMemoryLoop(const MachineInstr *MI) {
+  bool IsSet = MI->getOpcode() == MOS::MemsetIdx;
+  const MachineOperand &Src = MI->getOperand(0);
+  const MachineOperand &Dst = MI->getOperand(1);
+  uint64_t Length = MI->getOperand(2).getImm();
+  uint64_t Pages = Length / 256;
+  uint64_t Rest = Length % 256;
+
+  if (IsSet)
+    EmitToStreamer(*OutStreamer, MCInstBuilder(MOS::LDA_Immediate)
+                                     .addImm(Src.getImm() & 0xff));
+
+  // Emits one iteration's accesses to the bytes at offset Offset + X.
+  auto EmitAccesses = [&](int64_t Offset) {
+    if (!IsSet)
+      EmitToStreamer(*OutStreamer, MCInstBuilder(MOS::LDA_AbsoluteX)
+                                       .addExpr(lowerAddress(Src, Offset)));
+    EmitToStreamer(*OutStreamer, MCInstBuilder(MOS::STA_AbsoluteX)
+                                     .addExpr(lowerAddress(Dst, Offset)));
+  };
+
+  if (Pages) {
+    EmitToStreamer(*OutStreamer, MCInstBuilder(MOS::LDX_Immediate).addImm(0));
+    MCSymbol *Loop = OutContext.createTempSymbol();
+    OutStreamer->emitLabel(Loop);
+    for (uint64_t Page = 0; Page < Pages; ++Page)
+      EmitAccesses(Page * 256);
+    EmitToStreamer(*OutStreamer, MCInstBuilder(MOS::INX_Implied));
+    EmitToStreamer(*OutStreamer, MCInstBuilder(MOS::BNE_Relative)
+                                     .addExpr(MCSymbolRefExpr::create(
+                                         Loop, OutContext)));
+  }
+
+  if (Rest) {
+    // X runs from Rest down to 1, so the bases are one below the first byte.
+    EmitToStreamer(*OutStreamer,
+                   MCInstBuilder(MOS::LDX_Immediate).addImm(Rest));
+    MCSymbol *Loop = OutContext.createTempSymbol();
+    OutStreamer->emitLabel(Loop);
+    EmitAccesses(Pages * 256 - 1);
+    EmitToStreamer(*OutStreamer, MCInstBuilder(MOS::DEX_Implied));
+    EmitToStreamer(*OutStreamer, MCInstBuilder(MOS::BNE_Relative)
+                                     .addExpr(MCSymbolRefExpr::create(
+                                         Loop, OutContext)));
+  }
+}
+
+void MOSAsmPrinter::emitMEGA65DMA(const MachineInstr *MI) {
+  const MachineOperand &Src = MI->getOperand(0);
+  const MachineOperand &Dst = MI->getOperand(1);
+  uint64_t Length = MI->getOperand(2).getImm();
+  bool Fill = MI->getOperand(3).getImm();
+
+  // Any write to $D707 starts a DMA job whose list follows the write inline;
+  // the CPU resumes after the list once the job completes. The value written
+  // is irrelevant.
+  EmitToStreamer(*OutStreamer,
+                 MCInstBuilder(MOS::STA_Absolute).addImm(0xD707));
+  // Enhanced options: use the F018B list format; end of options.
+  OutStreamer->emitIntValue(0x0B, 1);
+  OutStreamer->emitIntValue(0x00, 1);
+  // Command: copy or fill.
+  OutStreamer->emitIntValue(Fill ? 3 : 0, 1);
+  OutStreamer->emitIntValue(Length, 2);
+  // Source address (or fill value) and bank.
+  if (Fill)
+    OutStreamer->emitIntValue(Src.getImm() & 0xff, 2);
+  else
+    OutStreamer->emitValue(lowerAddress(Src, 0), 2);
+  OutStreamer->emitIntValue(0, 1);
+  // Destination address and bank.
+  OutStreamer->emitValue(lowerAddress(Dst, 0), 2);
+  OutStreamer->emitIntValue(0, 1);
+  // Command high byte and modulo.
+  OutStreamer->emitIntValue(0, 1);
+  OutStreamer->emitIntValue(0, 2);
+}
+
+void MOSAsmPrinter::emitBITSkip(const MachineInstr *MI) {
+  // The opcode of BIT abs, whose operand is the instruction that follows.
+  if (AnnotateCycles || CycleBudget || Timed)
+    annotateCycles(MOS::BIT_Absolute);
+  OutStreamer->emitIntValue(0x2C, 1);
+}
+
+void MOSAsmPrinter::emitTrapBRK(const MachineInstr *MI) {
+  // IDs are only unique within the module, like trace IDs.
+  if (Traps.size() > UINT16_MAX) {
+    OutContext.reportError(SMLoc(), "too many traps in module");
+    return;
+  }
+  MCSymbol *Begin = OutContext.createTempSymbol();
+  OutStreamer->emitLabel(Begin);
+  const DebugLoc &DL = MI->getDebugLoc();
+  Traps.push_back({Begin, DL ? DL.getLine() : 0,
+                   DL ? DL->getFilename().str() : std::string()});
+
+  unsigned Opcode = MF->getSubtarget<MOSSubtarget>().hasSPC700()
+                        ? MOS::SPC700_BRK_Implied
+                        : MOS::BRK_Implied;
+  EmitToStreamer(*OutStreamer, MCInstBuilder(Opcode));
+  OutStreamer->emitInt16(Traps.size() - 1);
+}
+
+void MOSAsmPrinter::emitTXRemap(const MachineInstr *MI) {
+  // The DTV numbers its registers A = 0, Y = 1, X = 2. The high nibble of SAC
+  // selects the register written as the accumulator, and the low nibble the
+  // one read.
+  bool ToY = MI->getOperand(0).getReg() == MOS::Y;
+  assert(MI->getOperand(1).getReg() == (ToY ? MOS::X : MOS::Y));
+  EmitToStreamer(*OutStreamer,
+                 MCInstBuilder(MOS::SAC_Immediate).addImm(ToY ? 0x10 : 0x20));
+  EmitToStreamer(*OutStreamer,
+                 MCInstBuilder(ToY ? MOS::TXA_Implied : MOS::TYA_Implied));
+  EmitToStreamer(*OutStreamer, MCInstBuilder(MOS::SAC_Immediate).addImm(0));
+}
+
+void MOSAsmPrinter::emitMEGA65DivWait(const MachineInstr *MI) {
+  // Bit 7 of $D70F is set while the divider is busy.
+  MCSymbol *Loop = OutContext.createTempSymbol();
+  OutStreamer->emitLabel(Loop);
+  EmitToStreamer(*OutStreamer,
+                 MCInstBuilder(MOS::BIT_Absolute).addImm(0xD70F));
+  EmitToStreamer(*OutStreamer,
+                 MCInstBuilder(MOS::BMI_Relative)
+                     .addExpr(MCSymbolRefExpr::create(Loop, OutContext)));
+}
+
 void MOSAsmPrinter::lowerOperand(const MachineOperand &MO, MCOperand &MCOp) {
   if (!InstLowering.lowerOperand(MO, MCOp))
     llvm_unreachable("Failed to lower operand.");
@@ -203,6 +776,83 @@ void MOSAsmPrinter::emitStartOfAsmFile(Module &M) {
     MTS.emitDirectiveZeroPage(OutContext.getOrCreateSymbol("__rc" + Twine(I)));
 }
 
+void MOSAsmPrinter::emitEndOfAsmFile(Module &M) {
+  emitTraceNote(M);
+  emitTrapNote();
+  if (TimedBlocks.empty())
+    return;
+
+  // A single note holds the counts of every timed block in the module.
+  OutStreamer->switchSection(
+      OutContext.getELFSection(".mos.cycles", ELF::SHT_NOTE, 0));
+  emitAlignment(Align(4));
+  OutStreamer->emitInt32(4);                      // namesz
+  OutStreamer->emitInt32(TimedBlocks.size() * 8); // descsz
+  OutStreamer->emitInt32(ELF::NT_MOS_CYCLES);     // type
+  OutStreamer->emitBytes(StringRef("MOS", 4));    // name
+  for (const BlockCycles &B : TimedBlocks) {
+    OutStreamer->emitValue(MCSymbolRefExpr::create(B.Begin, OutContext), 4);
+    OutStreamer->emitInt16(std::min<int32_t>(B.Best, UINT16_MAX));
+    OutStreamer->emitInt16(std::min<int32_t>(B.Worst, UINT16_MAX));
+  }
+  TimedBlocks.clear();
+}
+
+void MOSAsmPrinter::emitTraceNote(Module &M) {
+  SmallVector<std::pair<const Function *, MDNode *>> Traced;
+  for (const Function &F : M)
+    if (MDNode *MD = F.getMetadata(MOSTraceMD); MD && !F.isDeclaration())
+      Traced.push_back({&F, MD});
+  if (Traced.empty())
+    return;
+
+  // A single note gives the trace IDs of every instrumented function in the
+  // module.
+  OutStreamer->switchSection(
+      OutContext.getELFSection(".mos.trace", ELF::SHT_NOTE, 0));
+  emitAlignment(Align(4));
+  OutStreamer->emitInt32(4);                   // namesz
+  OutStreamer->emitInt32(Traced.size() * 8);   // descsz
+  OutStreamer->emitInt32(ELF::NT_MOS_TRACE);   // type
+  OutStreamer->emitBytes(StringRef("MOS", 4)); // name
+  for (const auto &[F, MD] : Traced) {
+    OutStreamer->emitValue(
+        MCSymbolRefExpr::create(getSymbol(F), OutContext), 4);
+    for (const MDOperand &Op : MD->operands())
+      OutStreamer->emitInt16(mdconst::extract<ConstantInt>(Op)->getZExtValue());
+  }
+}
+
+void MOSAsmPrinter::emitTrapNote() {
+  if (Traps.empty())
+    return;
+
+  // Each entry is padded so that the next begins at a multiple of 4 bytes.
+  auto EntrySize = [](const TrapSite &T) {
+    return alignTo(8 + T.File.size() + 1, 4);
+  };
+  uint64_t DescSize = 0;
+  for (const TrapSite &T : Traps)
+    DescSize += EntrySize(T);
+
+  // A single note gives the trap sites of the module.
+  OutStreamer->switchSection(
+      OutContext.getELFSection(".mos.trap", ELF::SHT_NOTE, 0));
+  emitAlignment(Align(4));
+  OutStreamer->emitInt32(4);                   // namesz
+  OutStreamer->emitInt32(DescSize);            // descsz
+  OutStreamer->emitInt32(ELF::NT_MOS_TRAP);    // type
+  OutStreamer->emitBytes(StringRef("MOS", 4)); // name
+  for (const auto &[ID, T] : enumerate(Traps)) {
+    OutStreamer->emitValue(MCSymbolRefExpr::create(T.Begin, OutContext), 4);
+    OutStreamer->emitInt16(ID);
+    OutStreamer->emitInt16(std::min<unsigned>(T.Line, UINT16_MAX));
+    OutStreamer->emitBytes(T.File);
+    OutStreamer->emitZeros(EntrySize(T) - 8 - T.File.size());
+  }
+  Traps.clear();
+}
+
 void MOSAsmPrinter::emitJumpTableInfo() {
   const DataLayout &DL = MF->getDataLayout();
   const MachineJumpTableInfo *MJTI = MF->getJumpTableInfo();
@@ -213,6 +863,7 @@ void MOSAsmPrinter::emitJumpTableInfo() {
   if (JT.empty())
     return;
   const MOSSubtarget &STI = MF->getSubtarget<MOSSubtarget>();
+  const MOSFunctionInfo &MFI = *MF->getInfo<MOSFunctionInfo>();
 
   // Pick the directive to use to print the jump table entries, and switch to
   // the appropriate section.
@@ -250,21 +901,27 @@ void MOSAsmPrinter::emitJumpTableInfo() {
             MCSymbolRefExpr::create(JTBB->getSymbol(), OutContext), 2);
       }
     } else {
+      // Tables dispatched by RTS hold each target address less one, since RTS
+      // adds one to the address it pops. The relocation addend makes the
+      // selected byte that of the adjusted address.
+      bool ViaRTS = MFI.RTSJumpTables.contains(JTI.index());
+      auto EmitByte = [&](const MachineBasicBlock *JTBB,
+                          MOSMCExpr::VariantKind Kind) {
+        const MCExpr *Expr =
+            MCSymbolRefExpr::create(JTBB->getSymbol(), Kind, OutContext);
+        if (ViaRTS)
+          Expr = MCBinaryExpr::createAdd(
+              Expr, MCConstantExpr::create(-1, OutContext), OutContext);
+        OutStreamer->emitValue(Expr, 1);
+      };
+
       // Emit an array of the low bytes of the target addresses.
-      for (const MachineBasicBlock *JTBB : JTBBs) {
-        OutStreamer->emitValue(MCSymbolRefExpr::create(JTBB->getSymbol(),
-                                                       MOSMCExpr::VK_ADDR16_LO,
-                                                       OutContext),
-                               1);
-      }
+      for (const MachineBasicBlock *JTBB : JTBBs)
+        EmitByte(JTBB, MOSMCExpr::VK_ADDR16_LO);
 
       // Emit an array of the high bytes of the target addresses.
-      for (const MachineBasicBlock *JTBB : JTBBs) {
-        OutStreamer->emitValue(MCSymbolRefExpr::create(JTBB->getSymbol(),
-                                                       MOSMCExpr::VK_ADDR16_HI,
-                                                       OutContext),
-                               1);
-      }
+      for (const MachineBasicBlock *JTBB : JTBBs)
+        EmitByte(JTBB, MOSMCExpr::VK_ADDR16_HI);
     }
   }
   if (!JTInDiffSection)
@@ -0,0 +1,194 @@
+//===-- MOSBitSkip.cpp - MOS BIT Skip Branches ----------------------------===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines the MOS BIT skip branch pass.
+//
+// An if/else that assigns one of two constants, like "a = c ? 1 : 2", is laid
+// out as the first arm, a JMP over the second, and the second:
+//
+//     LDA #1
+//     JMP join
+//   else:
+//     LDA #2
+//   join:
+//
+// Hand-written 6502 code instead jumps over the second arm with a lone $2C
+// byte, the opcode of BIT abs. BIT takes the LDA #2 as its operand, so the
+// first arm reads the address $02A9 rather than executing it, and continues at
+// the join. This replaces a 3-byte JMP with a single byte, at the cost of a
+// cycle.
+//
+// The skip defines N, V, and Z, so it is only used where none of these are live
+// into the join. The address read must also be known, by the memory map given
+// to the alias analysis, to hold no I/O registers, since reading those can have
+// side effects. Only immediate loads are skipped, since the address is formed
+// from the bytes of their encoding.
+//
+// This runs at the very end of the pipeline, once the layout of every block is
+// final. The skip is an unconditional branch as far as the rest of the compiler
+// is concerned.
+//
+//===----------------------------------------------------------------------===//
+
+#include "MOSBitSkip.h"
+
+#include "MCTargetDesc/MOSMCTargetDesc.h"
+#include "MOS.h"
+#include "MOSAliasAnalysis.h"
+#include "MOSInstrCost.h"
+#include "MOSInstrInfo.h"
+#include "MOSSubtarget.h"
+
+#include "llvm/ADT/Statistic.h"
+#include "llvm/CodeGen/LivePhysRegs.h"
+#include "llvm/CodeGen/MachineFunctionPass.h"
+#include "llvm/CodeGen/MachineInstrBuilder.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/Format.h"
+#include <optional>
+
+#define DEBUG_TYPE "mos-bit-skip"
+
+STATISTIC(NumBitSkips, "Number of jumps replaced by BIT skips");
+
+using namespace llvm;
+
+static cl::opt<bool>
+    BitSkip("mos-bit-skip",
+            cl::desc("Jump over two-byte immediate loads using the opcode of "
+                     "BIT abs"),
+            cl::init(true), cl::Hidden);
+
+namespace {
+
+struct MOSBitSkip : public MachineFunctionPass {
+  static char ID;
+
+  MOSBitSkip() : MachineFunctionPass(ID) {
+    llvm::initializeMOSBitSkipPass(*PassRegistry::getPassRegistry());
+  }
+
+  bool runOnMachineFunction(MachineFunction &MF) override;
+};
+
+} // namespace
+
+// Returns the address that BIT abs would read if it took the contents of MBB
+// as its operand, or std::nullopt if MBB isn't a lone immediate load falling
+// through to its layout successor.
+static std::optional<uint16_t> getSkippedAddress(const MachineBasicBlock &MBB) {
+  auto Next = std::next(MBB.getIterator());
+  if (Next == MBB.getParent()->end() || MBB.succ_size() != 1 ||
+      *MBB.succ_begin() != &*Next)
+    return std::nullopt;
+
+  const MachineInstr *Load = nullptr;
+  for (const MachineInstr &MI : MBB) {
+    if (MI.isDebugInstr())
+      continue;
+    if (Load)
+      return std::nullopt;
+    Load = &MI;
+  }
+  if (!Load || Load->getOpcode() != MOS::LDImm || !Load->getOperand(1).isImm())
+    return std::nullopt;
+
+  // The opcodes of LDA #imm, LDX #imm and LDY #imm.
+  uint8_t Opcode;
+  switch (Load->getOperand(0).getReg()) {
+  default:
+    return std::nullopt;
+  case MOS::A:
+    Opcode = 0xA9;
+    break;
+  case MOS::X:
+    Opcode = 0xA2;
+    break;
+  case MOS::Y:
+    Opcode = 0xA0;
+    break;
+  }
+  return Opcode | (Load->getOperand(1).getImm() & 0xff) << 8;
+}
+
+bool MOSBitSkip::runOnMachineFunction(MachineFunction &MF) {
+  if (!BitSkip || skipFunction(MF.getFunction()))
+    return false;
+
+  const MOSSubtarget &STI = MF.getSubtarget<MOSSubtarget>();
+  // The SPC700 encodes its instructions differently, and the 65816 and 65EL02
+  // read absolute addresses from a data bank that isn't known here.
+  if (STI.hasSPC700() || STI.hasW65816Or65EL02())
+    return false;
+  if (!MF.getProperties().hasProperty(
+          MachineFunctionProperties::Property::TracksLiveness))
+    return false;
+
+  const MOSInstrInfo &TII = *STI.getInstrInfo();
+  const MachineRegisterInfo &MRI = MF.getRegInfo();
+  MOSInstrCost::Mode Mode = MOSInstrCost::getModeFor(MF);
+  // The skip is BIT abs, but its operand bytes belong to the skipped load.
+  MOSInstrCost Skip =
+      MOSInstrCost::get(MOS::BIT_Absolute, STI) - MOSInstrCost(2, 0);
+  MOSAAResult AA(MF.getDataLayout());
+
+  bool Changed = false;
+  for (MachineBasicBlock &MBB : MF) {
+    auto Else = std::next(MBB.getIterator());
+    if (Else == MF.end())
+      break;
+    auto Join = std::next(Else);
+    if (Join == MF.end())
+      break;
+
+    auto Jump = MBB.getLastNonDebugInstr();
+    if (Jump == MBB.end() ||
+        (Jump->getOpcode() != MOS::JMP && Jump->getOpcode() != MOS::BRA) ||
+        Jump->getOperand(0).getMBB() != &*Join)
+      continue;
+
+    // Any padding or section break would come between the skip and the load.
+    if (Else->getAlignment() != Align(1) || Join->getAlignment() != Align(1) ||
+        !MBB.sameSection(&*Else) || !Else->sameSection(&*Join))
+      continue;
+
+    std::optional<uint16_t> Addr = getSkippedAddress(*Else);
+    if (!Addr)
+      continue;
+    if (AA.getKinds(*Addr, *Addr + 1) & (mos::MK_IO | mos::MK_Unmapped)) {
+      LLVM_DEBUG(dbgs() << "Skip would read from $"
+                        << format_hex_no_prefix(*Addr, 4) << "\n");
+      continue;
+    }
+
+    LivePhysRegs LiveRegs(*STI.getRegisterInfo());
+    LiveRegs.addLiveIns(*Join);
+    if (!LiveRegs.available(MRI, MOS::NZ) || !LiveRegs.available(MRI, MOS::V))
+      continue;
+
+    unsigned JumpOpcode =
+        Jump->getOpcode() == MOS::BRA ? MOS::BRA_Relative : MOS::JMP_Absolute;
+    if (Skip.value(Mode) >= MOSInstrCost::get(JumpOpcode, STI).value(Mode))
+      continue;
+
+    LLVM_DEBUG(dbgs() << "Skipping " << *Else->getFirstNonDebugInstr());
+    BuildMI(MBB, Jump, Jump->getDebugLoc(), TII.get(MOS::BITSkip))
+        .addMBB(&*Join);
+    Jump->eraseFromParent();
+    ++NumBitSkips;
+    Changed = true;
+  }
+  return Changed;
+}
+
+char MOSBitSkip::ID = 0;
+
+INITIALIZE_PASS(MOSBitSkip, DEBUG_TYPE, "MOS BIT Skip Branches", false, false)
+
+MachineFunctionPass *llvm::createMOSBitSkipPass() { return new MOSBitSkip(); }
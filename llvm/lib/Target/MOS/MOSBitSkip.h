@@ -0,0 +1,24 @@
+//===-- MOSBitSkip.h - MOS BIT Skip Branches --------------------*- C++ -*-===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares the MOS BIT skip branch pass.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_LIB_TARGET_MOS_MOSBITSKIP_H
+#define LLVM_LIB_TARGET_MOS_MOSBITSKIP_H
+
+#include "llvm/CodeGen/MachineFunctionPass.h"
+
+namespace llvm {
+
+MachineFunctionPass *createMOSBitSkipPass();
+
+} // namespace llvm
+
+#endif // not LLVM_LIB_TARGET_MOS_MOSBITSKIP_H
@@ -0,0 +1,322 @@
+//===-- MOSBranchIslands.cpp - MOS Shared Branch Islands ------------------===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines the MOS shared branch island pass.
+//
+// Branch relaxation turns each conditional branch that can't reach its target
+// into an inverted branch over a JMP, five bytes in all. Large state machines
+// often have many such branches to one error or exit block, and each gets a
+// copy of the same JMP.
+//
+// This pass runs just before branch relaxation and instead places islands: a
+// block holding a single JMP to the target, after a block that can't fall
+// through, and within reach of several of the branches. Those branches are
+// redirected to the island and need no relaxation. Each branch so redirected
+// saves three bytes, and its path past the branch saves a cycle, since it's no
+// longer a taken branch; its path to the target costs one more cycle, for
+// taking the branch to the island. Each island costs the three bytes of its
+// JMP. Islands are placed greedily, each at the site that saves the most by
+// the function's cost mode, with the paths weighed by block frequency, and
+// only while that saving is positive.
+//
+// Placing an island moves the code after it, so a site is only considered if
+// the branches already redirected stay in reach of their islands. Any other
+// branch it pushes out of reach is left to branch relaxation. Since islands
+// end in an absolute JMP, they can reach any target, and never need to be
+// chained.
+//
+//===----------------------------------------------------------------------===//
+
+#include "MOSBranchIslands.h"
+
+#include "MCTargetDesc/MOSMCTargetDesc.h"
+#include "MOS.h"
+#include "MOSInstrCost.h"
+#include "MOSInstrInfo.h"
+#include "MOSSubtarget.h"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/MapVector.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/CodeGen/MachineBlockFrequencyInfo.h"
+#include "llvm/CodeGen/MachineBranchProbabilityInfo.h"
+#include "llvm/CodeGen/MachineFunctionPass.h"
+#include "llvm/CodeGen/MachineInstrBuilder.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+
+#define DEBUG_TYPE "mos-branch-islands"
+
+using namespace llvm;
+
+STATISTIC(NumIslands, "Number of shared branch islands placed");
+STATISTIC(NumIslandBranches, "Number of branches redirected to islands");
+
+static cl::opt<bool>
+    BranchIslands("mos-branch-islands",
+                  cl::desc("Share jump islands between conditional branches "
+                           "that can't reach their targets"),
+                  cl::init(true), cl::Hidden);
+
+namespace {
+
+// A branch that can't reach the target being considered.
+struct Source {
+  MachineInstr *MI;
+  // Saving from redirecting the branch to an island, by the cost mode.
+  double Saving;
+};
+
+// A branch redirected to an island, which must stay within its reach.
+struct Assignment {
+  MachineInstr *MI;
+  MachineBasicBlock *Island;
+};
+
+struct MOSBranchIslands : public MachineFunctionPass {
+  static char ID;
+
+  MOSBranchIslands() : MachineFunctionPass(ID) {
+    llvm::initializeMOSBranchIslandsPass(*PassRegistry::getPassRegistry());
+  }
+
+  bool runOnMachineFunction(MachineFunction &MF) override;
+  void getAnalysisUsage(AnalysisUsage &AU) const override;
+
+private:
+  const MOSSubtarget *STI;
+  const MOSInstrInfo *TII;
+  const MachineBlockFrequencyInfo *MBFI;
+  MOSInstrCost::Mode CostMode;
+
+  DenseMap<const MachineBasicBlock *, int64_t> BlockOffsets;
+  DenseMap<const MachineBasicBlock *, int64_t> BlockEnds;
+  DenseMap<const MachineInstr *, int64_t> BranchOffsets;
+  SmallVector<MachineBasicBlock *> Sites;
+  SmallVector<Assignment> Assignments;
+
+  void computeOffsets(MachineFunction &MF);
+  bool reaches(const MachineInstr &MI, int64_t Dest, int64_t InsertAt) const;
+  bool keepsAssignments(int64_t InsertAt) const;
+  double value(int64_t Bytes, double Cycles) const;
+  double weight(const MachineBasicBlock &MBB) const;
+  bool placeIslands(MachineFunction &MF, MachineBasicBlock &Target,
+                    ArrayRef<MachineInstr *> Branches);
+};
+
+} // namespace
+
+static bool isRelativeBranch(const MachineInstr &MI) {
+  return MI.getOpcode() == MOS::BR || MI.getOpcode() == MOS::BRBit;
+}
+
+// The size of an island's JMP.
+static constexpr int64_t IslandBytes = 3;
+
+// Computes the offset of each block, each conditional branch, and each block's
+// end, and finds the blocks that can't fall through, which islands may follow.
+void MOSBranchIslands::computeOffsets(MachineFunction &MF) {
+  BlockOffsets.clear();
+  BlockEnds.clear();
+  BranchOffsets.clear();
+  Sites.clear();
+  int64_t Offset = 0;
+  for (MachineBasicBlock &MBB : MF) {
+    Offset = alignTo(Offset, MBB.getAlignment());
+    BlockOffsets[&MBB] = Offset;
+    for (const MachineInstr &MI : MBB) {
+      if (isRelativeBranch(MI))
+        BranchOffsets[&MI] = Offset;
+      Offset += TII->getInstSizeInBytes(MI);
+    }
+    BlockEnds[&MBB] = Offset;
+    if (!MBB.canFallThrough())
+      Sites.push_back(&MBB);
+  }
+}
+
+// Returns whether MI reaches Dest once an island is inserted at InsertAt,
+// moving everything from there on. Dest is taken to be there already.
+bool MOSBranchIslands::reaches(const MachineInstr &MI, int64_t Dest,
+                               int64_t InsertAt) const {
+  int64_t Offset = BranchOffsets.lookup(&MI);
+  if (Offset >= InsertAt)
+    Offset += IslandBytes;
+  return TII->isBranchOffsetInRange(MI.getOpcode(), Dest - Offset);
+}
+
+bool MOSBranchIslands::keepsAssignments(int64_t InsertAt) const {
+  return all_of(Assignments, [&](const Assignment &A) {
+    int64_t Dest = BlockOffsets.lookup(A.Island);
+    if (Dest >= InsertAt)
+      Dest += IslandBytes;
+    return reaches(*A.MI, Dest, InsertAt);
+  });
+}
+
+// Combines a size and an expected cycle count as MOSInstrCost::value does.
+double MOSBranchIslands::value(int64_t Bytes, double Cycles) const {
+  switch (CostMode) {
+  case MOSInstrCost::Mode::PreferBytes:
+    return double(Bytes) * double(1ull << 32) + Cycles;
+  case MOSInstrCost::Mode::PreferCycles:
+    return Cycles * double(1ull << 32) + double(Bytes);
+  case MOSInstrCost::Mode::Average:
+    return double(Bytes) + Cycles;
+  }
+  llvm_unreachable("Invalid cost mode");
+}
+
+// Paths are counted once each when optimizing for size, and by how often they
+// execute otherwise.
+double MOSBranchIslands::weight(const MachineBasicBlock &MBB) const {
+  if (CostMode == MOSInstrCost::Mode::PreferBytes)
+    return 1.0;
+  return MBFI->getBlockFreqRelativeToEntryBlock(&MBB);
+}
+
+// Redirects the branches to Target that can't reach it to islands, for as
+// long as each new island saves something.
+bool MOSBranchIslands::placeIslands(MachineFunction &MF,
+                                    MachineBasicBlock &Target,
+                                    ArrayRef<MachineInstr *> Branches) {
+  const MachineBranchProbabilityInfo &MBPI = *MBFI->getMBPI();
+  int64_t TargetOffset = BlockOffsets.lookup(&Target);
+
+  SmallVector<Source> Sources;
+  for (MachineInstr *MI : Branches) {
+    // Islands placed for other targets may have brought it into reach.
+    if (reaches(*MI, TargetOffset, INT64_MAX))
+      continue;
+    // Relaxed, the path to the target takes no branch and then the JMP, and
+    // the path past it takes the inverted branch. To an island, the path to
+    // the target takes the branch and the JMP, and the path past it no
+    // branch.
+    MachineBasicBlock &MBB = *MI->getParent();
+    BranchProbability Prob = MBPI.getEdgeProbability(&MBB, &Target);
+    double Taken = weight(MBB) * Prob.getNumerator() / Prob.getDenominator();
+    double Past = weight(MBB) - Taken;
+    double Saving = value(IslandBytes, Past - Taken);
+    if (Saving > 0)
+      Sources.push_back({MI, Saving});
+  }
+
+  bool Changed = false;
+  double IslandCost = value(IslandBytes, 0);
+  while (!Sources.empty()) {
+    MachineBasicBlock *BestSite = nullptr;
+    double BestSaving = 0;
+    SmallVector<unsigned> BestUsers;
+    for (MachineBasicBlock *Site : Sites) {
+      int64_t InsertAt = BlockEnds.lookup(Site);
+      if (!keepsAssignments(InsertAt))
+        continue;
+      double Saving = -IslandCost;
+      SmallVector<unsigned> Users;
+      for (auto [Idx, S] : enumerate(Sources)) {
+        if (!reaches(*S.MI, InsertAt, InsertAt))
+          continue;
+        Users.push_back(Idx);
+        Saving += S.Saving;
+      }
+      if (Saving > BestSaving) {
+        BestSite = Site;
+        BestSaving = Saving;
+        BestUsers = std::move(Users);
+      }
+    }
+    if (!BestSite)
+      break;
+
+    LLVM_DEBUG(dbgs() << "Placing island to " << printMBBReference(Target)
+                      << " after " << printMBBReference(*BestSite) << " for "
+                      << BestUsers.size() << " branches, saving " << BestSaving
+                      << "\n");
+    MachineBasicBlock *Island = MF.CreateMachineBasicBlock();
+    MF.insert(std::next(BestSite->getIterator()), Island);
+    BuildMI(*Island, Island->end(), DebugLoc(), TII->get(MOS::JMP))
+        .addMBB(&Target);
+    Island->addSuccessor(&Target);
+    // The JMP passes everything live into the target through.
+    for (const MachineBasicBlock::RegisterMaskPair &LI : Target.liveins())
+      Island->addLiveIn(LI);
+    ++NumIslands;
+
+    for (unsigned Idx : reverse(BestUsers)) {
+      MachineInstr *MI = Sources[Idx].MI;
+      MI->getOperand(0).setMBB(Island);
+      MI->getParent()->replaceSuccessor(&Target, Island);
+      Assignments.push_back({MI, Island});
+      Sources.erase(Sources.begin() + Idx);
+      ++NumIslandBranches;
+    }
+    computeOffsets(MF);
+    Changed = true;
+  }
+  return Changed;
+}
+
+bool MOSBranchIslands::runOnMachineFunction(MachineFunction &MF) {
+  // Timed functions must stay within their page, and the distances between
+  // sections aren't known.
+  if (!BranchIslands || skipFunction(MF.getFunction()) ||
+      MF.getFunction().hasFnAttribute("mos-timed") || MF.hasBBSections())
+    return false;
+
+  STI = &MF.getSubtarget<MOSSubtarget>();
+  TII = STI->getInstrInfo();
+  MBFI = &getAnalysis<MachineBlockFrequencyInfoWrapperPass>().getMBFI();
+  CostMode = MOSInstrCost::getModeFor(MF);
+  Assignments.clear();
+
+  // Gather the branches that can't reach their targets. Only the branch may
+  // lead its block to the target, so that its edge can move to an island.
+  computeOffsets(MF);
+  MapVector<MachineBasicBlock *, SmallVector<MachineInstr *>> ByTarget;
+  for (MachineBasicBlock &MBB : MF) {
+    for (MachineInstr &MI : MBB.terminators()) {
+      if (!isRelativeBranch(MI))
+        continue;
+      MachineBasicBlock *Target = TII->getBranchDestBlock(MI);
+      if (TII->isBranchOffsetInRange(MI.getOpcode(),
+                                     BlockOffsets.lookup(Target) -
+                                         BranchOffsets.lookup(&MI)))
+        continue;
+      if (MBB.getFallThrough(/*JumpToFallThrough=*/false) == Target)
+        continue;
+      unsigned Edges = 0;
+      for (const MachineInstr &Term : MBB.terminators())
+        for (const MachineOperand &MO : Term.operands())
+          Edges += MO.isMBB() && MO.getMBB() == Target;
+      if (Edges == 1)
+        ByTarget[Target].push_back(&MI);
+    }
+  }
+
+  bool Changed = false;
+  for (auto &[Target, Branches] : ByTarget)
+    Changed |= placeIslands(MF, *Target, Branches);
+  return Changed;
+}
+
+void MOSBranchIslands::getAnalysisUsage(AnalysisUsage &AU) const {
+  AU.addRequired<MachineBlockFrequencyInfoWrapperPass>();
+  MachineFunctionPass::getAnalysisUsage(AU);
+}
+
+char MOSBranchIslands::ID = 0;
+
+INITIALIZE_PASS_BEGIN(MOSBranchIslands, DEBUG_TYPE, "MOS Shared Branch Islands",
+                      false, false)
+INITIALIZE_PASS_DEPENDENCY(MachineBlockFrequencyInfoWrapperPass)
+INITIALIZE_PASS_END(MOSBranchIslands, DEBUG_TYPE, "MOS Shared Branch Islands",
+                    false, false)
+
+MachineFunctionPass *llvm::createMOSBranchIslandsPass() {
+  return new MOSBranchIslands();
+}
@@ -0,0 +1,186 @@
+//===-- MOSCPUClones.cpp - MOS Processor Family Dispatch ------------------===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines the MOS processor family dispatch pass.
+//
+// A program built for the NMOS 6502 runs unchanged on the 65C02 and the
+// 65816, but it can't use their extra instructions and addressing modes. A
+// function given the mos_cpu_clones attribute is instead compiled once for
+// each processor family it names, and the clone for the processor it runs on
+// is picked the first time it is called.
+//
+// The original function keeps its name and becomes a dispatcher: it loads
+// the address of the chosen clone from an internal pointer and tail calls it,
+// so arguments passed on the stack are left in place. That pointer starts out
+// at a resolver, which asks the SDK routine __mos_cpu_family for the family
+// of the running processor, stores the best clone for it, and then tail
+// calls it as well. __mos_cpu_family returns 0 for an NMOS 6502, 1 for a 65C02
+// and 2 for a 65816; the chosen clone is the one for the most capable family
+// named that the processor can run, or the function compiled for the default
+// processor if there is none.
+//
+// The body is cloned before any optimization, so that each clone is
+// optimized for its own processor.
+//
+//===----------------------------------------------------------------------===//
+
+#include "MOSCPUClones.h"
+
+#include "llvm/ADT/Statistic.h"
+#include "llvm/ADT/StringSwitch.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DiagnosticInfo.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+
+#define DEBUG_TYPE "mos-cpu-clones"
+
+STATISTIC(NumCPUClones, "Number of processor family clones");
+
+using namespace llvm;
+
+// Returns the family of CPU as reported by __mos_cpu_family, or -1 if CPU
+// can't be dispatched to.
+static int getFamily(StringRef CPU) {
+  return StringSwitch<int>(CPU)
+      .Case("mos6502", 0)
+      .Case("mos65c02", 1)
+      .Case("mosw65816", 2)
+      .Default(-1);
+}
+
+// Returns whether the calls to the clones can be tail calls, which is how
+// they're dispatched to.
+static bool canDispatch(const Function &F) {
+  if (F.isVarArg() || F.hasFnAttribute(Attribute::Naked) ||
+      F.hasFnAttribute("interrupt") ||
+      F.hasFnAttribute("interrupt-norecurse") ||
+      F.hasFnAttribute("mos-base-page"))
+    return false;
+  // The SPC700 has no indirect jump to tail call through, and it can't run
+  // 6502 code anyway.
+  if (F.getFnAttribute("target-cpu").getValueAsString() == "mosspc700")
+    return false;
+  return none_of(F.args(), [](const Argument &Arg) {
+    return Arg.hasPassPointeeByValueCopyAttr();
+  });
+}
+
+static Function *cloneFor(Function &F, const Twine &Suffix) {
+  ValueToValueMapTy VMap;
+  Function *Clone = CloneFunction(&F, VMap);
+  Clone->setName(F.getName() + "." + Suffix);
+  Clone->setLinkage(GlobalValue::InternalLinkage);
+  Clone->setVisibility(GlobalValue::DefaultVisibility);
+  Clone->setComdat(nullptr);
+  Clone->setUnnamedAddr(GlobalValue::UnnamedAddr::Global);
+  return Clone;
+}
+
+// Tail calls Callee with the arguments of the function being built and
+// returns its result.
+static void emitTailCall(IRBuilder<> &Builder, Function &F, Value *Callee) {
+  SmallVector<Value *> Args;
+  for (Argument &Arg : F.args())
+    Args.push_back(&Arg);
+  CallInst *Call = Builder.CreateCall(F.getFunctionType(), Callee, Args);
+  Call->setTailCallKind(CallInst::TCK_MustTail);
+  Call->setCallingConv(F.getCallingConv());
+  Call->setAttributes(F.getAttributes().removeFnAttributes(F.getContext()));
+  if (F.getReturnType()->isVoidTy())
+    Builder.CreateRetVoid();
+  else
+    Builder.CreateRet(Call);
+}
+
+static void dispatch(Function &F, FunctionCallee FamilyFn) {
+  StringRef List = F.getFnAttribute("mos-cpu-clones").getValueAsString();
+  SmallVector<StringRef> CPUs;
+  List.split(CPUs, ',', -1, /*KeepEmpty=*/false);
+  F.removeFnAttr("mos-cpu-clones");
+
+  if (!canDispatch(F)) {
+    F.getContext().diagnose(DiagnosticInfoUnsupported(
+        F, "mos_cpu_clones function cannot be dispatched with a tail call; "
+           "ignored"));
+    return;
+  }
+
+  // The clones for each family, least capable first.
+  SmallVector<std::pair<int, Function *>> Clones;
+  for (StringRef CPU : CPUs) {
+    int Family = getFamily(CPU);
+    if (Family < 0) {
+      F.getContext().diagnose(DiagnosticInfoUnsupported(
+          F, "mos_cpu_clones processor " + CPU + " cannot be dispatched to"));
+      continue;
+    }
+    Function *Clone = cloneFor(F, CPU);
+    Clone->addFnAttr("target-cpu", CPU);
+    Clones.push_back({Family, Clone});
+    LLVM_DEBUG(dbgs() << "Cloned " << F.getName() << " as "
+                      << Clone->getName() << "\n");
+    ++NumCPUClones;
+  }
+  if (Clones.empty())
+    return;
+  llvm::stable_sort(Clones, [](const auto &A, const auto &B) {
+    return A.first < B.first;
+  });
+  Function *Default = cloneFor(F, "default");
+
+  Module &M = *F.getParent();
+  LLVMContext &Ctx = M.getContext();
+  auto *Resolver =
+      Function::Create(F.getFunctionType(), GlobalValue::InternalLinkage,
+                       F.getAddressSpace(), F.getName() + ".resolver", M);
+  Resolver->copyAttributesFrom(&F);
+  Resolver->setUnnamedAddr(GlobalValue::UnnamedAddr::Global);
+  auto *Impl = new GlobalVariable(M, F.getType(), /*isConstant=*/false,
+                                  GlobalValue::InternalLinkage, Resolver,
+                                  F.getName() + ".impl");
+
+  IRBuilder<> Builder(BasicBlock::Create(Ctx, "", Resolver));
+  Value *Family = Builder.CreateCall(FamilyFn, {}, "family");
+  Value *Chosen = Default;
+  for (auto [CloneFamily, Clone] : Clones) {
+    if (!CloneFamily) {
+      Chosen = Clone;
+      continue;
+    }
+    Value *Runs = Builder.CreateICmpUGE(
+        Family, ConstantInt::get(Family->getType(), CloneFamily));
+    Chosen = Builder.CreateSelect(Runs, Clone, Chosen);
+  }
+  Builder.CreateStore(Chosen, Impl);
+  emitTailCall(Builder, *Resolver, Chosen);
+
+  // The debug info and the body now belong to the clones.
+  GlobalValue::LinkageTypes Linkage = F.getLinkage();
+  F.deleteBody();
+  F.setLinkage(Linkage);
+  Builder.SetInsertPoint(BasicBlock::Create(Ctx, "", &F));
+  emitTailCall(Builder, F, Builder.CreateLoad(F.getType(), Impl, "impl"));
+}
+
+PreservedAnalyses MOSCPUClonesPass::run(Module &M, ModuleAnalysisManager &AM) {
+  SmallVector<Function *> Funcs;
+  for (Function &F : M)
+    if (!F.isDeclaration() && F.hasFnAttribute("mos-cpu-clones"))
+      Funcs.push_back(&F);
+  if (Funcs.empty())
+    return PreservedAnalyses::all();
+
+  FunctionCallee FamilyFn = M.getOrInsertFunction(
+      "__mos_cpu_family", Type::getInt8Ty(M.getContext()));
+  for (Function *F : Funcs)
+    dispatch(*F, FamilyFn);
+  return PreservedAnalyses::none();
+}
@@ -0,0 +1,29 @@
+//===-- MOSCPUClones.h - MOS Processor Family Dispatch ----------*- C++ -*-===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares the MOS processor family dispatch pass.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_LIB_TARGET_MOS_MOSCPUCLONES_H
+#define LLVM_LIB_TARGET_MOS_MOSCPUCLONES_H
+
+#include "llvm/IR/Module.h"
+#include "llvm/IR/PassManager.h"
+
+namespace llvm {
+
+// Clones functions for each processor family named by their mos-cpu-clones
+// attribute, dispatching to the clones at run time.
+struct MOSCPUClonesPass : PassInfoMixin<MOSCPUClonesPass> {
+  PreservedAnalyses run(Module &M, ModuleAnalysisManager &AM);
+};
+
+} // end namespace llvm
+
+#endif // not LLVM_LIB_TARGET_MOS_MOSCPUCLONES_H
@@ -15,13 +15,33 @@
 
 #include "MOSCallGraphUtils.h"
 
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/SmallVector.h"
 #include "llvm/Analysis/CallGraph.h"
 #include "llvm/CodeGen/MachineFunction.h"
 #include "llvm/CodeGen/MachineModuleInfo.h"
+#include "llvm/IR/InstrTypes.h"
 #include "llvm/IR/Module.h"
+#include "llvm/Support/CommandLine.h"
 
 using namespace llvm;
 
+static cl::list<std::string> InterruptOverlayGroups(
+    "mos-overlay-group",
+    cl::desc("Comma-separated interrupt-norecurse entry points that can never "
+             "run at the same time, and may thus share zero page and static "
+             "stack. May be given more than once."),
+    cl::value_desc("function,..."));
+
+static cl::opt<bool> ResolveIndirectCalls(
+    "mos-resolve-indirect-calls",
+    cl::desc("Assume that indirect calls can only reach functions whose "
+             "address is taken in the module, and whose type matches; "
+             "unsound if function pointers come from outside the module"),
+    cl::init(false), cl::Hidden);
+
 Function *mos::getSymbolFunction(Module &M, StringRef Name) {
   Value *V = M.getNamedValue(Name);
   return V ? dyn_cast<Function>(V->stripPointerCastsAndAliases()) : nullptr;
@@ -53,6 +73,45 @@ void mos::addLibcallEdges(CallGraph &CG, const MachineModuleInfo &MMI) {
   }
 }
 
+void mos::resolveIndirectCalls(CallGraph &CG) {
+  if (!ResolveIndirectCalls)
+    return;
+
+  // Collect the possible targets of indirect calls by type. Calling a
+  // function through a pointer of a different type is undefined.
+  DenseMap<const FunctionType *, SmallVector<Function *>> Targets;
+  SmallPtrSet<const FunctionType *, 4> Unresolved;
+  for (Function &F : CG.getModule()) {
+    if (F.isIntrinsic() || !F.hasAddressTaken())
+      continue;
+    if (F.isDeclaration())
+      Unresolved.insert(F.getFunctionType());
+    else
+      Targets[F.getFunctionType()].push_back(&F);
+  }
+
+  for (auto &KV : CG) {
+    CallGraphNode &CGN = *KV.second;
+    if (!CGN.getFunction())
+      continue;
+    SmallVector<CallBase *> Indirect;
+    for (const CallGraphNode::CallRecord &CR : CGN) {
+      if (CR.second != CG.getCallsExternalNode() || !CR.first)
+        continue;
+      Value *Call = *CR.first;
+      auto *CB = dyn_cast_or_null<CallBase>(Call);
+      if (CB && CB->isIndirectCall() &&
+          !Unresolved.contains(CB->getFunctionType()))
+        Indirect.push_back(CB);
+    }
+    for (CallBase *CB : Indirect) {
+      CGN.removeCallEdgeFor(*CB);
+      for (Function *Target : Targets.lookup(CB->getFunctionType()))
+        CGN.addCalledFunction(CB, CG[Target]);
+    }
+  }
+}
+
 void mos::addExternalEdges(CallGraph &CG) {
   assert(CG.getCallsExternalNode()->empty());
   for (auto &KV : *CG.getExternalCallingNode()) {
@@ -62,3 +121,18 @@ void mos::addExternalEdges(CallGraph &CG) {
       CG.getCallsExternalNode()->addCalledFunction(nullptr, KV.second);
   }
 }
+
+unsigned mos::getInterruptOverlayGroup(const Function &F) {
+  for (auto [Idx, Group] : enumerate(InterruptOverlayGroups)) {
+    SmallVector<StringRef> Names;
+    StringRef(Group).split(Names, ',', /*MaxSplit=*/-1, /*KeepEmpty=*/false);
+    if (any_of(Names,
+               [&](StringRef Name) { return Name.trim() == F.getName(); }))
+      return Idx + 1;
+  }
+  return 0;
+}
+
+StringRef mos::getBasePage(const Function &F) {
+  return F.getFnAttribute("mos-base-page").getValueAsString();
+}
@@ -38,10 +38,29 @@ Function *getSymbolFunction(Module &M, StringRef Name);
 // calls that only exist in generated code. This routine corrects this.
 void addLibcallEdges(CallGraph &CG, const MachineModuleInfo &MMI);
 
+// Replace the external edges of indirect calls with edges to each function
+// they may call: those whose address is taken and whose type matches the
+// call's. This assumes that the module is the whole program, in that no
+// function pointer reaches it from code outside of it, such as assembly or
+// non-LTO libraries. It therefore only does anything under
+// -mos-resolve-indirect-calls, which must be asked for explicitly.
+// Calls that may reach a function that is only declared are left alone.
+void resolveIndirectCalls(CallGraph &CG);
+
 // Nodes that call external nodes may transitively call any external funciton
 // except interrupt handlers, so add edges to record this.
 void addExternalEdges(CallGraph &CG);
 
+// Returns the overlay group that the user placed the given interrupt-norecurse
+// entry point in, or zero if none. Entry points in the same group never run at
+// the same time, so their zero page and static stack may overlap.
+unsigned getInterruptOverlayGroup(const Function &F);
+
+// Returns the name of the base page that the given entry point switches the
+// 65CE02's B register to, or an empty string if it runs on the zero page of
+// its caller.
+StringRef getBasePage(const Function &F);
+
 } // namespace mos
 } // namespace llvm
 
@@ -14,8 +14,10 @@
 #include "MOSCallLowering.h"
 
 #include "MCTargetDesc/MOSMCTargetDesc.h"
+#include "MOSCallGraphUtils.h"
 #include "MOSCallingConv.h"
 #include "MOSFrameLowering.h"
+#include "MOSInstrCost.h"
 #include "MOSMachineFunctionInfo.h"
 #include "MOSRegisterInfo.h"
 #include "MOSSubtarget.h"
@@ -34,6 +36,10 @@
 #include "llvm/CodeGen/TargetOpcodes.h"
 #include "llvm/CodeGen/TargetRegisterInfo.h"
 #include "llvm/IR/CallingConv.h"
+#include "llvm/IR/DiagnosticInfo.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
 #include "llvm/Target/TargetMachine.h"
 #include <memory>
 
@@ -49,10 +55,18 @@ struct MOSValueAssigner : CallLowering::ValueAssigner {
   /// registers must be avoided when selecting registers for arguments.
   BitVector Reserved;
 
+  /// Registers chosen by whole-program placement for the leading pointer
+  /// arguments, and the number of pointer arguments assigned so far.
+  SmallVector<Register> PtrArgRegs;
+  unsigned NumPtrArgs = 0;
+
   MOSValueAssigner(bool IsIncoming, MachineRegisterInfo &MRI,
-                   const MachineFunction &MF)
+                   const MachineFunction &MF,
+                   const Function *Callee = nullptr)
       : CallLowering::ValueAssigner(IsIncoming, CC_MOS, CC_MOS_VarArgs) {
     Reserved = MRI.getTargetRegisterInfo()->getReservedRegs(MF);
+    if (Callee)
+      getPointerArgRegs(*Callee, PtrArgRegs);
   }
 
   bool assignArg(unsigned ValNo, EVT OrigVT, MVT ValVT, MVT LocVT,
@@ -64,6 +78,16 @@ struct MOSValueAssigner : CallLowering::ValueAssigner {
     for (Register R : Reserved.set_bits())
       State.AllocateReg(R);
 
+    if (Flags.isPointer() && !Flags.isVarArg() &&
+        NumPtrArgs < PtrArgRegs.size()) {
+      Register Reg = PtrArgRegs[NumPtrArgs++];
+      if (!State.isAllocated(Reg)) {
+        State.AllocateReg(Reg);
+        State.addLoc(CCValAssign::getReg(ValNo, ValVT, Reg, LocVT, LocInfo));
+        return false;
+      }
+    }
+
     if (getAssignFn(Flags.isVarArg())(ValNo, ValVT, LocVT, LocInfo, Flags,
                                       Info.Ty, State))
       return true;
@@ -130,6 +154,8 @@ struct MOSOutgoingArgsHandler : MOSOutgoingValueHandler {
   }
 };
 
+/// Handler for values passed out through the current function's own incoming
+/// stack region: stack return values, and the stack arguments of tail calls.
 struct MOSOutgoingReturnHandler : MOSOutgoingValueHandler {
   MOSOutgoingReturnHandler(MachineIRBuilder &MIRBuilder,
                            MachineInstrBuilder &MIB, MachineRegisterInfo &MRI)
@@ -175,14 +201,18 @@ struct MOSIncomingValueHandler : CallLowering::IncomingValueHandler {
 };
 
 struct MOSIncomingArgsHandler : public MOSIncomingValueHandler {
-  MOSIncomingArgsHandler(MachineIRBuilder &MIRBuilder, MachineRegisterInfo &MRI)
-      : MOSIncomingValueHandler(MIRBuilder, MRI) {}
+  /// Whether tail calls may overwrite the incoming stack arguments.
+  bool Mutable;
+
+  MOSIncomingArgsHandler(MachineIRBuilder &MIRBuilder, MachineRegisterInfo &MRI,
+                         bool Mutable)
+      : MOSIncomingValueHandler(MIRBuilder, MRI), Mutable(Mutable) {}
 
   Register getStackAddress(uint64_t Size, int64_t Offset,
                            MachinePointerInfo &MPO,
                            ISD::ArgFlagsTy Flags) override {
     auto &MFI = MIRBuilder.getMF().getFrameInfo();
-    int FI = MFI.CreateFixedObject(Size, Offset, true);
+    int FI = MFI.CreateFixedObject(Size, Offset, !Mutable);
     MPO = MachinePointerInfo::getFixedStack(MIRBuilder.getMF(), FI);
     auto AddrReg = MIRBuilder.buildFrameIndex(LLT::pointer(0, 16), FI);
     return AddrReg.getReg(0);
@@ -192,11 +222,14 @@ struct MOSIncomingArgsHandler : public MOSIncomingValueHandler {
                             const MachinePointerInfo &MPO,
                             const CCValAssign &VA) override {
     MachineFunction &MF = MIRBuilder.getMF();
-    // All such loads are invariant: if the values are later spilled, they'll be
-    // spilled to spill slots, not the original incoming argument slots.
-    auto *MMO = MF.getMachineMemOperand(
-        MPO, MachineMemOperand::MOLoad | MachineMemOperand::MOInvariant, MemTy,
-        inferAlignFromPtrInfo(MF, MPO));
+    // Unless a tail call reuses their slots, all such loads are invariant: if
+    // the values are later spilled, they'll be spilled to spill slots, not the
+    // original incoming argument slots.
+    auto Flags = MachineMemOperand::MOLoad;
+    if (!Mutable)
+      Flags |= MachineMemOperand::MOInvariant;
+    auto *MMO = MF.getMachineMemOperand(MPO, Flags, MemTy,
+                                        inferAlignFromPtrInfo(MF, MPO));
     MIRBuilder.buildLoad(ValVReg, Addr, *MMO);
   }
 
@@ -274,7 +307,11 @@ bool MOSCallLowering::lowerReturn(MachineIRBuilder &MIRBuilder,
   auto Return =
       MIRBuilder.buildInstrNoInsert(TFI.isISR(MF) ? MOS::RTI : MOS::RTS);
 
-  if (Val) {
+  if (Val && returnsInCarry(F)) {
+    assert(VRegs.size() == 1);
+    MIRBuilder.buildCopy(MOS::C, VRegs[0]);
+    Return.addUse(MOS::C, RegState::Implicit);
+  } else if (Val) {
     MachineRegisterInfo &MRI = MF.getRegInfo();
     const TargetLowering &TLI = *getTLI();
     const DataLayout &DL = MF.getDataLayout();
@@ -325,9 +362,14 @@ bool MOSCallLowering::lowerFormalArguments(MachineIRBuilder &MIRBuilder,
   const auto &TFI = static_cast<const MOSFrameLowering &>(
       *MF.getSubtarget().getFrameLowering());
 
-  // The Decimal Flag is undefined upon interrupt and must be cleared.
-  if (TFI.isISR(MF))
+  if (TFI.isISR(MF)) {
+    // A 65816 in native mode may be interrupted while the accumulator is 16
+    // bits wide. Narrow it before anything is saved; RTI restores the width.
+    if (MF.getSubtarget<MOSSubtarget>().hasW65816Native())
+      MIRBuilder.buildInstr(MOS::SEP_Immediate).addImm(0x20);
+    // The Decimal Flag is undefined upon interrupt and must be cleared.
     MIRBuilder.buildInstr(MOS::CLD_Implied);
+  }
 
   SmallVector<ArgInfo> SplitArgs;
   unsigned Idx = 0;
@@ -342,40 +384,203 @@ bool MOSCallLowering::lowerFormalArguments(MachineIRBuilder &MIRBuilder,
     ++Idx;
   }
 
-  MOSIncomingArgsHandler Handler(MIRBuilder, MRI);
-  MOSValueAssigner Assigner(/*IsIncoming=*/true, MRI, MF);
+  // Tail calls store their stack arguments over the incoming ones.
+  bool MayTailCall = any_of(instructions(F), [](const Instruction &I) {
+    const auto *CI = dyn_cast<CallInst>(&I);
+    return CI && CI->isTailCall();
+  });
+
+  MOSIncomingArgsHandler Handler(MIRBuilder, MRI, MayTailCall);
+  MOSValueAssigner Assigner(/*IsIncoming=*/true, MRI, MF, &F);
   // Invoke TableGen compatibility layer to create loads and copies from the
   // formal argument physical and stack locations to virtual registers.
-  if (!determineAndHandleAssignments(Handler, Assigner, SplitArgs, MIRBuilder,
-                                     F.getCallingConv(), F.isVarArg()))
+  SmallVector<CCValAssign, 16> ArgLocs;
+  CCState CCInfo(F.getCallingConv(), F.isVarArg(), MF, ArgLocs,
+                 F.getContext());
+  if (!determineAssignments(Assigner, SplitArgs, CCInfo) ||
+      !handleAssignments(Handler, SplitArgs, CCInfo, ArgLocs, MIRBuilder))
     return false;
+  MF.getInfo<MOSFunctionInfo>()->ArgsStackSize = Assigner.StackSize;
 
   // Record the beginning of the varargs region of the stack by creating a fake
   // stack argument a4 that location. The varargs instructions are lowered by
   // walking a pointer forward from that memory location.
   if (F.isVarArg()) {
     auto *FuncInfo = MF.getInfo<MOSFunctionInfo>();
-    FuncInfo->VarArgsStackIndex = MF.getFrameInfo().CreateFixedObject(
+    MachineFrameInfo &MFI = MF.getFrameInfo();
+
+    // Variable arguments passed in registers are stored just below those on
+    // the stack, in the order they were assigned. Only va_start can observe
+    // them, so functions that never call it skip the stores.
+    SmallVector<MCPhysReg> VarArgRegs;
+    bool CallsVAStart = any_of(instructions(F), [](const Instruction &I) {
+      const auto *II = dyn_cast<IntrinsicInst>(&I);
+      return II && II->getIntrinsicID() == Intrinsic::vastart;
+    });
+    if (useRegisterVarArgs() && !Assigner.StackSize && CallsVAStart)
+      for (MCPhysReg Reg : getVarArgRegs())
+        if (!CCInfo.isAllocated(Reg))
+          VarArgRegs.push_back(Reg);
+
+    FuncInfo->VarArgsStackIndex = MFI.CreateFixedObject(
         /*Size=*/1, Assigner.StackSize, /*IsImmutable=*/true);
+    LLT P = LLT::pointer(0, 16);
+    int64_t Offset = -int64_t(VarArgRegs.size());
+    for (MCPhysReg Reg : VarArgRegs) {
+      int FI = MFI.CreateFixedObject(/*Size=*/1, Offset++,
+                                     /*IsImmutable=*/false);
+      if (Reg == VarArgRegs.front())
+        FuncInfo->VarArgsStackIndex = FI;
+      MIRBuilder.getMBB().addLiveIn(Reg);
+      auto *MMO = MF.getMachineMemOperand(
+          MachinePointerInfo::getFixedStack(MF, FI), MachineMemOperand::MOStore,
+          LLT::scalar(8), Align());
+      MIRBuilder.buildStore(MIRBuilder.buildCopy(LLT::scalar(8), Reg),
+                            MIRBuilder.buildFrameIndex(P, FI), *MMO);
+    }
   }
 
   return true;
 }
 
+// Returns whether a call from Caller to Callee must switch banks. Functions
+// placed in the same section are assumed to be in the same bank.
+static bool isBankedCall(const Function &Caller, const Function &Callee) {
+  if (!Callee.hasFnAttribute("banked"))
+    return false;
+  return !Callee.hasSection() || Callee.getSection() != Caller.getSection();
+}
+
+// Returns whether the call can be lowered to a jump after the current
+// function's epilogue. The callee's arguments must fit within the current
+// function's incoming stack region, and its results must be returned the same
+// way as the current function's.
+bool MOSCallLowering::isEligibleForTailCall(
+    CallLoweringInfo &Info, MachineFunction &MF,
+    SmallVectorImpl<ArgInfo> &OutArgs, SmallVectorImpl<ArgInfo> &InArgs) const {
+  const Function &Caller = MF.getFunction();
+  const auto &TFI = static_cast<const MOSFrameLowering &>(
+      *MF.getSubtarget().getFrameLowering());
+  MachineRegisterInfo &MRI = MF.getRegInfo();
+
+  if (!Info.IsTailCall)
+    return false;
+  // Interrupt handlers must return with RTI.
+  if (TFI.isISR(MF))
+    return false;
+  // The callee would run on the caller's base page after it's been left.
+  if (!mos::getBasePage(Caller).empty())
+    return false;
+  if (Info.CallConv != Caller.getCallingConv())
+    return false;
+  // Variable arguments would have to be placed past the caller's own.
+  if (Info.IsVarArg)
+    return false;
+  // The SPC700 indirect call thunk lives in RC17, which the epilogue may use.
+  if (Info.Callee.isReg() && MF.getSubtarget<MOSSubtarget>().hasSPC700())
+    return false;
+  if (any_of(OutArgs,
+             [](const ArgInfo &Arg) { return Arg.Flags[0].isByVal(); }))
+    return false;
+
+  const Function *Callee = nullptr;
+  if (Info.Callee.isGlobal())
+    Callee = dyn_cast<Function>(Info.Callee.getGlobal());
+  if (Callee && isBankedCall(Caller, *Callee))
+    return false;
+  // The callee must leave its result where the caller's caller expects it.
+  if (returnsInCarry(Caller) != (Callee && returnsInCarry(*Callee)))
+    return false;
+
+  SmallVector<CCValAssign, 16> ArgLocs;
+  CCState ArgCCInfo(Info.CallConv, Info.IsVarArg, MF, ArgLocs,
+                    Caller.getContext());
+  MOSValueAssigner ArgsAssigner(/*IsIncoming=*/false, MRI, MF, Callee);
+  SmallVector<ArgInfo, 8> Args(OutArgs);
+  if (!determineAssignments(ArgsAssigner, Args, ArgCCInfo))
+    return false;
+  if (ArgsAssigner.StackSize > MF.getInfo<MOSFunctionInfo>()->ArgsStackSize)
+    return false;
+
+  // A musttail callee has the caller's prototype, so it returns its results
+  // exactly where the caller would. Otherwise, results on the stack might
+  // not fit in the caller's incoming region.
+  if (InArgs.empty() || Info.IsMustTailCall)
+    return true;
+  SmallVector<CCValAssign, 16> RetLocs;
+  CCState RetCCInfo(Info.CallConv, Info.IsVarArg, MF, RetLocs,
+                    Caller.getContext());
+  MOSValueAssigner RetAssigner(/*IsIncoming=*/true, MRI, MF);
+  SmallVector<ArgInfo, 8> Rets(InArgs);
+  if (!determineAssignments(RetAssigner, Rets, RetCCInfo))
+    return false;
+  return !RetAssigner.StackSize;
+}
+
 bool MOSCallLowering::lowerCall(MachineIRBuilder &MIRBuilder,
                                 CallLoweringInfo &Info) const {
-  if (Info.IsMustTailCall)
-    report_fatal_error("Musttail calls not supported.");
-
   MachineFunction &MF = MIRBuilder.getMF();
   MachineRegisterInfo &MRI = MF.getRegInfo();
   const DataLayout &DL = MF.getDataLayout();
   const MOSSubtarget &STI = MF.getSubtarget<MOSSubtarget>();
-  const TargetRegisterInfo &TRI = *STI.getRegisterInfo();
+  const MOSRegisterInfo &TRI = *STI.getRegisterInfo();
+
+  // Runtime helpers with a known clobber set preserve everything else.
+  const uint32_t *Mask = TRI.getCallPreservedMask(MF, Info.CallConv);
+  if (Info.Callee.isSymbol())
+    if (const uint32_t *M =
+            TRI.getLibcallPreservedMask(Info.Callee.getSymbolName()))
+      Mask = M;
+
+  SmallVector<ArgInfo, 8> OutArgs;
+  for (auto &OrigArg : Info.OrigArgs) {
+    // Variable pointer arguments are passed as integers in registers, since
+    // va_arg must be able to find their bytes split across registers and the
+    // stack.
+    if (useRegisterVarArgs() && OrigArg.Flags[0].isVarArg() &&
+        OrigArg.Ty->isPointerTy()) {
+      Type *IntTy = DL.getIntPtrType(OrigArg.Ty);
+      Register Int =
+          MIRBuilder
+              .buildPtrToInt(LLT::scalar(IntTy->getIntegerBitWidth()),
+                             OrigArg.Regs[0])
+              .getReg(0);
+      ISD::ArgFlagsTy Flags;
+      Flags.setVarArg();
+      splitToValueTypes(ArgInfo({Int}, IntTy, OrigArg.OrigArgIndex, Flags),
+                        OutArgs, DL);
+      continue;
+    }
+    splitToValueTypes(OrigArg, OutArgs, DL);
+  }
+
+  SmallVector<ArgInfo, 8> InArgs;
+  if (!Info.OrigRet.Ty->isVoidTy())
+    splitToValueTypes(Info.OrigRet, InArgs, DL);
+
+  bool IsTailCall = isEligibleForTailCall(Info, MF, OutArgs, InArgs);
+  // Report a musttail call that can't be honored, then lower it as a normal
+  // call so that code generation can finish and report any other errors.
+  if (Info.IsMustTailCall && !IsTailCall) {
+    const Function &Caller = MF.getFunction();
+    Caller.getContext().diagnose(DiagnosticInfoUnsupported(
+        Caller,
+        "failed to perform tail call elimination on a call site marked "
+        "musttail",
+        MIRBuilder.getDebugLoc()));
+  }
 
   bool IsIndirect = Info.Callee.isReg();
   if (IsIndirect) {
-    // Store the callee in RS9 (used by the libcall).
+    // A function with a base page of its own writes RS9 on that page, but the
+    // trampoline reads it from the zero page.
+    const Function &Caller = MF.getFunction();
+    if (!mos::getBasePage(Caller).empty())
+      Caller.getContext().diagnose(DiagnosticInfoUnsupported(
+          Caller, "indirect call in a function with its own base page",
+          MIRBuilder.getDebugLoc()));
+
+    // Store the callee in RS9 (used by the libcall or indirect JSR).
     // Doing this before argument lowering gives additional freedom to
     // instruction scheduling. This just needs to happen some time before the
     // call, and no specific arguments or stack pointer state are required.
@@ -399,6 +604,49 @@ bool MOSCallLowering::lowerCall(MachineIRBuilder &MIRBuilder,
     }
   }
 
+  const Function *Callee = nullptr;
+  if (Info.Callee.isGlobal())
+    Callee = dyn_cast<Function>(Info.Callee.getGlobal());
+
+  if (IsTailCall) {
+    // The epilogue is inserted before the jump, which leaves the callee to
+    // return directly to the current function's caller.
+    auto Jump = MIRBuilder.buildInstrNoInsert(MOS::TailJMP)
+                    .add(Info.Callee)
+                    .addRegMask(TRI.getCallPreservedMask(MF, Info.CallConv));
+    if (IsIndirect)
+      Jump.addUse(MOS::RS9, RegState::Implicit);
+
+    // Stack arguments overwrite the current function's incoming ones, which
+    // now sit at the same offsets from the stack pointer as the callee's.
+    MOSOutgoingReturnHandler ArgsHandler(MIRBuilder, Jump, MRI);
+    MOSValueAssigner ArgsAssigner(/*IsIncoming=*/false, MRI, MF, Callee);
+    if (!determineAndHandleAssignments(ArgsHandler, ArgsAssigner, OutArgs,
+                                       MIRBuilder, Info.CallConv,
+                                       Info.IsVarArg))
+      return false;
+
+    MIRBuilder.insertInstr(Jump);
+    Info.LoweredTailCall = true;
+    return true;
+  }
+
+  // Calls to banked functions store the callee in RS9 and its bank in Y, then
+  // go through __call_banked. The trampoline maps in the callee's bank, calls
+  // it, and maps the caller's bank back in before returning. Bank switching is
+  // mapper-specific, so the target's C library provides it; see the banked
+  // attribute's documentation for the contract.
+  Register Bank;
+  if (Callee && isBankedCall(MF.getFunction(), *Callee)) {
+    MIRBuilder.buildCopy(MOS::RS9,
+                         MIRBuilder.buildGlobalValue(LLT::pointer(0, 16),
+                                                     Callee));
+    Bank = MIRBuilder.buildInstr(MOS::LDImm, {&MOS::GPRRegClass}, {})
+               .addGlobalAddress(Callee, 0, MOS::MO_BANK)
+               .getReg(0);
+    Info.Callee.ChangeToES("__call_banked");
+  }
+
   // Generate the setup call frame pseudo instruction. This will record the size
   // of the outgoing stack frame once it's known. Usually, all such pseudos can
   // be folded into the prolog/epilog of the function without emitting any
@@ -407,7 +655,7 @@ bool MOSCallLowering::lowerCall(MachineIRBuilder &MIRBuilder,
 
   auto Call = MIRBuilder.buildInstrNoInsert(MOS::JSR)
                   .add(Info.Callee)
-                  .addRegMask(TRI.getCallPreservedMask(MF, Info.CallConv));
+                  .addRegMask(Mask);
 
   // Indirect calls store the callee in RS9.
   if (IsIndirect) {
@@ -415,29 +663,63 @@ bool MOSCallLowering::lowerCall(MachineIRBuilder &MIRBuilder,
     if (STI.hasSPC700())
       Call.addUse(MOS::RC17, RegState::Implicit);
   }
-
-  SmallVector<ArgInfo, 8> OutArgs;
-  for (auto &OrigArg : Info.OrigArgs) {
-    splitToValueTypes(OrigArg, OutArgs, DL);
+  if (Bank) {
+    Call.addUse(MOS::RS9, RegState::Implicit);
+    Call.addUse(MOS::Y, RegState::Implicit);
   }
 
-  SmallVector<ArgInfo, 8> InArgs;
-  if (!Info.OrigRet.Ty->isVoidTy())
-    splitToValueTypes(Info.OrigRet, InArgs, DL);
-
   // Copy arguments from virtual registers to their real physical locations.
   MOSOutgoingArgsHandler ArgsHandler(MIRBuilder, Call, MRI);
-  MOSValueAssigner ArgsAssigner(/*IsIncoming=*/false, MRI, MF);
+  MOSValueAssigner ArgsAssigner(/*IsIncoming=*/false, MRI, MF, Callee);
   if (!determineAndHandleAssignments(ArgsHandler, ArgsAssigner, OutArgs,
                                      MIRBuilder, Info.CallConv, Info.IsVarArg))
     return false;
 
+  // Passing stack arguments may use Y, so the bank goes in last.
+  if (Bank)
+    MIRBuilder.buildCopy(MOS::Y, Bank);
+
+  // Processors with an indirect JSR can call through RS9 directly, rather
+  // than calling a JMP (RS9) trampoline. The 65816's only indirect JSR is
+  // indexed by X, so it's only usable if X is free to be zeroed. Either reads
+  // RS9 at its absolute address, which isn't where a function with a base
+  // page of its own wrote it.
+  if (IsIndirect && !STI.hasSPC700() &&
+      mos::getBasePage(MF.getFunction()).empty()) {
+    MOSInstrCost::Mode Mode = MOSInstrCost::getModeFor(MF);
+    int64_t Trampoline = (MOSInstrCost::get(MOS::JSR_Absolute, STI) +
+                          MOSInstrCost::get(MOS::JMP_Indirect16, STI))
+                             .value(Mode);
+    unsigned Opcode = MOS::JSR;
+    if (STI.has65CE02() &&
+        MOSInstrCost::get(MOS::JSR_AbsoluteIndirect, STI).value(Mode) <
+            Trampoline)
+      Opcode = MOS::JSRIndir;
+    else if (STI.hasW65816Or65EL02() && !Call->readsRegister(MOS::X, &TRI) &&
+             (MOSInstrCost::get(MOS::LDX_Immediate, STI) +
+              MOSInstrCost::get(MOS::JSR_IndexedIndirect16, STI))
+                     .value(Mode) < Trampoline)
+      Opcode = MOS::JSRIdxIndir;
+    if (Opcode != MOS::JSR) {
+      Call->setDesc(STI.getInstrInfo()->get(Opcode));
+      Call->getOperand(0).ChangeToRegister(MOS::RS9, /*isDef=*/false);
+      if (Opcode == MOS::JSRIdxIndir) {
+        MIRBuilder.buildCopy(MOS::X,
+                             MIRBuilder.buildConstant(LLT::scalar(8), 0));
+        Call.addUse(MOS::X, RegState::Implicit);
+      }
+    }
+  }
+
   // Insert the call once the outgoing arguments are in place.
   MIRBuilder.insertInstr(Call);
 
   uint64_t StackSize = ArgsAssigner.StackSize;
 
-  if (!Info.OrigRet.Ty->isVoidTy()) {
+  if (Callee && returnsInCarry(*Callee)) {
+    Call.addDef(MOS::C, RegState::Implicit);
+    MIRBuilder.buildCopy(Info.OrigRet.Regs[0], Register(MOS::C));
+  } else if (!Info.OrigRet.Ty->isVoidTy()) {
     // Copy the return value from its physical location into a virtual register.
     MOSIncomingReturnHandler RetHandler(MIRBuilder, MRI, Call);
     MOSValueAssigner RetAssigner(/*IsIncoming=*/true, MRI, MF);
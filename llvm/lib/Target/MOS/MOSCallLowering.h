@@ -34,6 +34,10 @@ public:
                  CallLoweringInfo &Info) const override;
 
 private:
+  bool isEligibleForTailCall(CallLoweringInfo &Info, MachineFunction &MF,
+                             SmallVectorImpl<ArgInfo> &OutArgs,
+                             SmallVectorImpl<ArgInfo> &InArgs) const;
+
   void splitToValueTypes(const ArgInfo &OrigArg,
                          SmallVectorImpl<ArgInfo> &SplitArgs,
                          const DataLayout &DL) const;
@@ -14,5 +14,70 @@
 
 #include "llvm/CodeGen/MachineFunction.h"
 #include "llvm/IR/DataLayout.h"
+#include "llvm/IR/Function.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/ErrorHandling.h"
+
+using namespace llvm;
+
+static cl::opt<bool> RegisterVarArgs(
+    "mos-register-varargs",
+    cl::desc("Pass the leading bytes of variable arguments in imaginary "
+             "registers"),
+    cl::init(false));
+
+static cl::opt<bool> CarryReturn(
+    "mos-carry-return",
+    cl::desc("Return the i1 results of internal functions in the carry flag"),
+    cl::init(false), cl::Hidden);
+
+static const MCPhysReg VarArgRegs[] = {MOS::RC8,  MOS::RC9,  MOS::RC10,
+                                       MOS::RC11, MOS::RC12, MOS::RC13,
+                                       MOS::RC14, MOS::RC15};
+
+// Assigns a variable argument byte to the next free variable argument
+// register. Once a byte goes on the stack, so do all that follow, since
+// va_arg finds them directly after the registers' save area.
+static bool CC_MOS_VarArgReg(unsigned &ValNo, MVT &ValVT, MVT &LocVT,
+                             CCValAssign::LocInfo &LocInfo,
+                             ISD::ArgFlagsTy &ArgFlags, CCState &State) {
+  if (!RegisterVarArgs || State.getStackSize())
+    return false;
+  MCRegister Reg = State.AllocateReg(VarArgRegs);
+  if (!Reg)
+    return false;
+  State.addLoc(CCValAssign::getReg(ValNo, ValVT, Reg, LocVT, LocInfo));
+  return true;
+}
 
 #include "MOSGenCallingConv.inc"
+
+bool llvm::useRegisterVarArgs() { return RegisterVarArgs; }
+
+ArrayRef<MCPhysReg> llvm::getVarArgRegs() { return VarArgRegs; }
+
+void llvm::getPointerArgRegs(const Function &F,
+                             SmallVectorImpl<Register> &Regs) {
+  Attribute Attr = F.getFnAttribute("mos-pointer-arg-regs");
+  if (!Attr.isStringAttribute())
+    return;
+  SmallVector<StringRef> Nums;
+  Attr.getValueAsString().split(Nums, ',');
+  for (StringRef Num : Nums) {
+    unsigned RS;
+    if (Num.getAsInteger(10, RS) || RS < 1 || RS > 7)
+      report_fatal_error("invalid mos-pointer-arg-regs attribute");
+    Regs.push_back(MOS::RS0 + RS);
+  }
+}
+
+// Only functions whose every call is visible, and thus lowered to match, may
+// change where their results go. Callers can then branch on the carry
+// directly, and comparisons already leave their results there.
+bool llvm::returnsInCarry(const Function &F) {
+  if (!CarryReturn || !F.getReturnType()->isIntegerTy(1) ||
+      !F.hasLocalLinkage() || F.isVarArg() || F.hasFnAttribute("interrupt") ||
+      F.hasFnAttribute("interrupt-norecurse"))
+    return false;
+  return !F.hasAddressTaken();
+}
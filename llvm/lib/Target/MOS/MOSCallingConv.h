@@ -16,6 +16,7 @@
 
 #include "MCTargetDesc/MOSMCTargetDesc.h"
 #include "llvm/CodeGen/CallingConvLower.h"
+#include "llvm/CodeGen/Register.h"
 #include "llvm/CodeGenTypes/MachineValueType.h"
 
 namespace llvm {
@@ -24,12 +25,25 @@ namespace llvm {
 bool CC_MOS(unsigned ValNo, MVT ValVT, MVT LocVT, CCValAssign::LocInfo LocInfo,
             ISD::ArgFlagsTy ArgFlags, Type *OrigTy, CCState &State);
 
-/// Calling convention used for the dynamic portion of varargs calls. Just puts
-/// everything on the stack.
+/// Calling convention used for the dynamic portion of varargs calls. Puts
+/// everything on the stack, unless register variable arguments are enabled.
 bool CC_MOS_VarArgs(unsigned ValNo, MVT ValVT, MVT LocVT,
                     CCValAssign::LocInfo LocInfo, ISD::ArgFlagsTy ArgFlags,
                     Type *OrigTy, CCState &State);
 
+/// Returns whether the leading variable argument bytes are passed in the
+/// registers given by getVarArgRegs, in order, rather than on the stack.
+bool useRegisterVarArgs();
+ArrayRef<MCPhysReg> getVarArgRegs();
+
+/// Appends the imaginary registers that whole-program pointer argument
+/// placement chose for the leading pointer arguments of F, if any.
+void getPointerArgRegs(const Function &F, SmallVectorImpl<Register> &Regs);
+
+/// Returns whether F returns its i1 result in the carry flag, rather than
+/// promoted to a byte in A.
+bool returnsInCarry(const Function &F);
+
 } // namespace llvm
 
 #endif // not LLVM_LIB_TARGET_MOS_MOSCALLINGCONV_H
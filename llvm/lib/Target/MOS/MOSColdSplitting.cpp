@@ -0,0 +1,255 @@
+//===-- MOSColdSplitting.cpp - MOS Cold Block Splitting -------------------===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines the MOS cold block splitting pass.
+//
+// Relative branches only reach about 128 bytes in either direction, and branch
+// relaxation turns each one that doesn't into a branch over a JMP, which costs
+// three bytes and a cycle on the path not taken. Cold blocks laid out between
+// hot ones push the hot branches apart, so this pass moves cold blocks after
+// all the hot ones whenever the estimated cost of the branches that would
+// need relaxation goes down.
+//
+// With profile data, blocks that were never executed are instead placed in a
+// separate cold section. Branches into and out of that section are always
+// relaxed, which is why the generic machine function splitter, which runs
+// after branch relaxation, is disabled for MOS in favor of this pass.
+//
+//===----------------------------------------------------------------------===//
+
+#include "MOSColdSplitting.h"
+
+#include "MCTargetDesc/MOSMCTargetDesc.h"
+#include "MOS.h"
+#include "MOSInstrCost.h"
+#include "MOSInstrInfo.h"
+#include "MOSSubtarget.h"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/Analysis/ProfileSummaryInfo.h"
+#include "llvm/CodeGen/BasicBlockSectionUtils.h"
+#include "llvm/CodeGen/MachineBlockFrequencyInfo.h"
+#include "llvm/CodeGen/MachineFunctionPass.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+
+#define DEBUG_TYPE "mos-cold-splitting"
+
+using namespace llvm;
+
+static cl::opt<unsigned> ColdFreqRatio(
+    "mos-cold-block-ratio",
+    cl::desc("Consider blocks executed less than once per this many entries "
+             "to a function cold"),
+    cl::init(1000), cl::Hidden);
+
+static cl::opt<bool>
+    SplitColdSection("mos-split-cold-section",
+                     cl::desc("Place blocks that profile data shows are never "
+                              "executed in a separate section"),
+                     cl::init(true), cl::Hidden);
+
+namespace {
+
+struct MOSColdSplitting : public MachineFunctionPass {
+  static char ID;
+
+  MOSColdSplitting() : MachineFunctionPass(ID) {
+    llvm::initializeMOSColdSplittingPass(*PassRegistry::getPassRegistry());
+  }
+
+  bool runOnMachineFunction(MachineFunction &MF) override;
+  void getAnalysisUsage(AnalysisUsage &AU) const override;
+
+private:
+  const MOSSubtarget *STI;
+  const MOSInstrInfo *TII;
+  const MachineBlockFrequencyInfo *MBFI;
+  MOSInstrCost::Mode CostMode;
+
+  double weight(const MachineBasicBlock &MBB) const;
+  double relaxationCost(ArrayRef<MachineBasicBlock *> Order,
+                        ArrayRef<MachineBasicBlock *> FallThroughs) const;
+  void updateBranches(MachineFunction &MF,
+                      ArrayRef<MachineBasicBlock *> FallThroughs) const;
+};
+
+} // namespace
+
+// Branches are counted once each when optimizing for size, and by how often
+// they execute otherwise.
+double MOSColdSplitting::weight(const MachineBasicBlock &MBB) const {
+  if (CostMode == MOSInstrCost::Mode::PreferBytes)
+    return 1.0;
+  return MBFI->getBlockFreqRelativeToEntryBlock(&MBB);
+}
+
+// Estimates the cost of relaxing the branches that would be out of range if the
+// blocks were laid out in the given order. Blocks that lose their fallthrough
+// are charged a JMP, both for its size and for the distance it adds.
+double MOSColdSplitting::relaxationCost(
+    ArrayRef<MachineBasicBlock *> Order,
+    ArrayRef<MachineBasicBlock *> FallThroughs) const {
+  MOSInstrCost JMP = MOSInstrCost::get(MOS::JMP_Absolute, *STI);
+  int64_t JMPSize = TII->get(MOS::JMP_Absolute).getSize();
+  double JMPCost = JMP.value(CostMode);
+
+  double Cost = 0;
+  DenseMap<const MachineBasicBlock *, int64_t> Offsets;
+  int64_t Offset = 0;
+  for (auto [Idx, MBB] : enumerate(Order)) {
+    Offsets[MBB] = Offset;
+    for (const MachineInstr &MI : *MBB)
+      Offset += TII->getInstSizeInBytes(MI);
+    MachineBasicBlock *FT = FallThroughs[MBB->getNumber()];
+    if (FT && (Idx + 1 == Order.size() || Order[Idx + 1] != FT)) {
+      Offset += JMPSize;
+      Cost += weight(*MBB) * JMPCost;
+    }
+  }
+
+  for (const MachineBasicBlock *MBB : Order) {
+    int64_t Offset = Offsets[MBB];
+    for (const MachineInstr &MI : *MBB) {
+      switch (MI.getOpcode()) {
+      case MOS::BR:
+      case MOS::BRBit: {
+        int64_t Dest = Offsets.lookup(TII->getBranchDestBlock(MI));
+        if (!TII->isBranchOffsetInRange(MI.getOpcode(), Dest - Offset))
+          Cost += weight(*MBB) * JMPCost;
+        break;
+      }
+      default:
+        break;
+      }
+      Offset += TII->getInstSizeInBytes(MI);
+    }
+  }
+  return Cost;
+}
+
+// After reordering, give each block that lost its fallthrough an explicit
+// branch, and let analyzable blocks pick the cheapest form of their
+// terminators for the new layout.
+void MOSColdSplitting::updateBranches(
+    MachineFunction &MF, ArrayRef<MachineBasicBlock *> FallThroughs) const {
+  SmallVector<MachineOperand, 4> Cond;
+  for (MachineBasicBlock &MBB : MF) {
+    MachineBasicBlock *FT = FallThroughs[MBB.getNumber()];
+    if (FT && (MBB.isEndSection() || MBB.getNextNode() != FT))
+      TII->insertUnconditionalBranch(MBB, FT, MBB.findBranchDebugLoc());
+    if (MBB.isEndSection())
+      continue;
+    Cond.clear();
+    MachineBasicBlock *TBB = nullptr, *FBB = nullptr;
+    if (TII->analyzeBranch(MBB, TBB, FBB, Cond))
+      continue;
+    MBB.updateTerminator(FT);
+  }
+}
+
+bool MOSColdSplitting::runOnMachineFunction(MachineFunction &MF) {
+  if (skipFunction(MF.getFunction()) || MF.size() < 3)
+    return false;
+
+  STI = &MF.getSubtarget<MOSSubtarget>();
+  TII = STI->getInstrInfo();
+  MBFI = &getAnalysis<MachineBlockFrequencyInfoWrapperPass>().getMBFI();
+  CostMode = MOSInstrCost::getModeFor(MF);
+  ProfileSummaryInfo *PSI =
+      &getAnalysis<ProfileSummaryInfoWrapperPass>().getPSI();
+  // Timed functions must stay within their page, so they are never split.
+  bool HasProfile = MF.getFunction().hasProfileData() &&
+                    PSI->hasProfileSummary() &&
+                    !MF.getFunction().hasFnAttribute("mos-timed");
+
+  // The entry block must stay in front, and blocks reached other than by
+  // branches are left where they are.
+  SmallVector<bool> IsCold(MF.getNumBlockIDs());
+  SmallVector<bool> NeverRun(MF.getNumBlockIDs());
+  bool AnyCold = false;
+  for (MachineBasicBlock &MBB : drop_begin(MF)) {
+    if (MBB.isEHPad() || MBB.isInlineAsmBrIndirectTarget())
+      continue;
+    if (HasProfile) {
+      std::optional<uint64_t> Count = MBFI->getBlockProfileCount(&MBB);
+      if (!Count)
+        continue;
+      NeverRun[MBB.getNumber()] = !*Count;
+      IsCold[MBB.getNumber()] = PSI->isColdCount(*Count);
+    } else {
+      IsCold[MBB.getNumber()] =
+          MBFI->getBlockFreqRelativeToEntryBlock(&MBB) * ColdFreqRatio < 1.0;
+    }
+    AnyCold |= IsCold[MBB.getNumber()];
+  }
+  if (!AnyCold)
+    return false;
+
+  SmallVector<MachineBasicBlock *> FallThroughs(MF.getNumBlockIDs());
+  SmallVector<MachineBasicBlock *> Order;
+  for (MachineBasicBlock &MBB : MF) {
+    FallThroughs[MBB.getNumber()] =
+        MBB.getFallThrough(/*JumpToFallThrough=*/false);
+    Order.push_back(&MBB);
+  }
+
+  if (HasProfile && SplitColdSection &&
+      any_of(NeverRun, [](bool B) { return B; })) {
+    LLVM_DEBUG(dbgs() << "Splitting never-executed blocks of " << MF.getName()
+                      << " into the cold section\n");
+    for (MachineBasicBlock &MBB : MF)
+      if (NeverRun[MBB.getNumber()])
+        MBB.setSectionID(MBBSectionID::ColdSectionID);
+    MF.setBBSectionsType(BasicBlockSection::Preset);
+    sortBasicBlocksAndUpdateBranches(
+        MF, [](const MachineBasicBlock &X, const MachineBasicBlock &Y) {
+          return X.getSectionID().Type < Y.getSectionID().Type;
+        });
+    return true;
+  }
+
+  SmallVector<MachineBasicBlock *> NewOrder(Order);
+  llvm::stable_partition(NewOrder, [&](const MachineBasicBlock *MBB) {
+    return !IsCold[MBB->getNumber()];
+  });
+  if (NewOrder == Order)
+    return false;
+  double OldCost = relaxationCost(Order, FallThroughs);
+  double NewCost = relaxationCost(NewOrder, FallThroughs);
+  LLVM_DEBUG(dbgs() << "Moving cold blocks of " << MF.getName()
+                    << " changes relaxation cost from " << OldCost << " to "
+                    << NewCost << "\n");
+  if (NewCost >= OldCost)
+    return false;
+
+  MF.sort([&](const MachineBasicBlock &X, const MachineBasicBlock &Y) {
+    return !IsCold[X.getNumber()] && IsCold[Y.getNumber()];
+  });
+  updateBranches(MF, FallThroughs);
+  return true;
+}
+
+void MOSColdSplitting::getAnalysisUsage(AnalysisUsage &AU) const {
+  AU.addRequired<MachineBlockFrequencyInfoWrapperPass>();
+  AU.addRequired<ProfileSummaryInfoWrapperPass>();
+  MachineFunctionPass::getAnalysisUsage(AU);
+}
+
+char MOSColdSplitting::ID = 0;
+
+INITIALIZE_PASS_BEGIN(MOSColdSplitting, DEBUG_TYPE, "MOS Cold Block Splitting",
+                      false, false)
+INITIALIZE_PASS_DEPENDENCY(MachineBlockFrequencyInfoWrapperPass)
+INITIALIZE_PASS_DEPENDENCY(ProfileSummaryInfoWrapperPass)
+INITIALIZE_PASS_END(MOSColdSplitting, DEBUG_TYPE, "MOS Cold Block Splitting",
+                    false, false)
+
+MachineFunctionPass *llvm::createMOSColdSplittingPass() {
+  return new MOSColdSplitting();
+}
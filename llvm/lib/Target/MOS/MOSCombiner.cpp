@@ -17,10 +17,13 @@
 
 #include "MCTargetDesc/MOSMCTargetDesc.h"
 #include "MOS.h"
+#include "MOSInstrCost.h"
 #include "MOSLegalizerInfo.h"
 #include "MOSSubtarget.h"
 
+#include "llvm/ADT/Statistic.h"
 #include "llvm/Analysis/AliasAnalysis.h"
+#include "llvm/Analysis/ConstantFolding.h"
 #include "llvm/CodeGen/GlobalISel/CSEInfo.h"
 #include "llvm/CodeGen/GlobalISel/Combiner.h"
 #include "llvm/CodeGen/GlobalISel/CombinerHelper.h"
@@ -43,6 +46,7 @@
 #include "llvm/CodeGen/TargetOpcodes.h"
 #include "llvm/CodeGen/TargetPassConfig.h"
 #include "llvm/IR/Function.h"
+#include "llvm/IR/GlobalVariable.h"
 #include "llvm/IR/PatternMatch.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Target/TargetMachine.h"
@@ -55,17 +59,56 @@
 
 using namespace llvm;
 
+STATISTIC(NumFoldGlobalOffset, "Number of fold_global_offset combines");
+STATISTIC(NumFoldConstantLoad, "Number of fold_constant_load combines");
+STATISTIC(NumSbcEqual, "Number of sbc_equal combines");
+STATISTIC(NumExtractLowBit, "Number of extract_low_bit combines");
+STATISTIC(NumExtractHighBit, "Number of extract_high_bit combines");
+STATISTIC(NumUaddo1, "Number of uaddo_1 combines");
+STATISTIC(NumCmpzZero, "Number of cmpz_zero combines");
+STATISTIC(NumLoadStoreToMemcpy, "Number of load_store_to_memcpy combines");
+STATISTIC(NumPortUpload, "Number of port_upload combines");
+STATISTIC(NumStoreToMemset, "Number of store_to_memset combines");
+STATISTIC(NumFoldAdde, "Number of fold_adde combines");
+STATISTIC(NumFoldSbc, "Number of fold_sbc combines");
+STATISTIC(NumFoldShift, "Number of fold_shift combines");
+STATISTIC(NumShiftUnusedCarryIn, "Number of shift_unused_carry_in combines");
+STATISTIC(NumMulToShiftAndAdd, "Number of mul_to_shift_and_add combines");
+
 namespace {
 
+// A run of byte copies from consecutive addresses to a fixed I/O port, or
+// alternately to a pair of ports.
+struct PortUpload {
+  MachineOperand Src = MachineOperand::CreateImm(0);
+  int64_t Dst = 0;
+  bool Alternate = false;
+  SmallVector<std::pair<GLoad *, GStore *>> Copies;
+};
+
 #define GET_GICOMBINER_TYPES
 #include "MOSGenGICombiner.inc"
 #undef GET_GICOMBINER_TYPES
 
+// The demanded bits of the registers queried so far, shared by all combines.
+// A change anywhere in the MIR may add uses to a register or change the known
+// bits its demanded bits were derived from, so any change drops the lot.
+class DemandedBitsCache : public GISelChangeObserver {
+public:
+  DenseMap<Register, APInt> Bits;
+
+  void erasingInstr(MachineInstr &MI) override { Bits.clear(); }
+  void createdInstr(MachineInstr &MI) override { Bits.clear(); }
+  void changingInstr(MachineInstr &MI) override { Bits.clear(); }
+  void changedInstr(MachineInstr &MI) override { Bits.clear(); }
+};
+
 class MOSCombinerImpl : public Combiner {
   // TODO: Make CombinerHelper methods const.
   mutable CombinerHelper Helper;
   const MOSCombinerImplRuleConfig &RuleConfig;
   AAResults *AA;
+  mutable DemandedBitsCache DemandedCache;
 
 public:
   MOSCombinerImpl(MachineFunction &MF, CombinerInfo &CInfo,
@@ -78,6 +121,7 @@ public:
   static const char *getName() { return "MOSCombiner"; }
 
   bool tryCombineAll(MachineInstr &I) const override;
+  bool tryCombineAllImpl(MachineInstr &I) const;
 
   // G_PTR_ADD (GLOBAL_VALUE @x + y_const), z_const =>
   // GLOBAL_VALUE @x + (y_const + z_const)
@@ -90,12 +134,18 @@ public:
       MachineInstr &MI,
       std::pair<const MachineOperand *, int64_t> &MatchInfo) const;
 
+  // G_LOAD (GLOBAL_VALUE @const + y_const) => G_CONSTANT
+  bool matchFoldConstantLoad(MachineInstr &MI, BuildFnTy &MatchInfo) const;
+
   bool matchSBCEqual(MachineInstr &MI) const;
   void applySBCEqual(MachineInstr &MI) const;
 
   bool matchExtractLowBit(MachineInstr &MI, MachineInstr *&Shift) const;
   void applyExtractLowBit(MachineInstr &MI, MachineInstr *&Shift) const;
 
+  // G_AND (G_LSHR x, 5 or 6), 1 => G_LSHR (G_SHL x, 2 or 1), 7
+  bool matchExtractHighBit(MachineInstr &MI, BuildFnTy &MatchInfo) const;
+
   bool matchUAddO1(MachineInstr &MI) const;
   void applyUAddO1(MachineInstr &MI) const;
 
@@ -106,6 +156,10 @@ public:
   bool matchLoadStoreToMemcpy(MachineInstr &MI, GLoad *&Load) const;
   void applyLoadStoreToMemcpy(MachineInstr &MI, GLoad *&Load) const;
 
+  // G_LOAD/volatile G_STORE pairs => HuCPortCopy (TIA, TIN)
+  bool matchPortUpload(MachineInstr &MI, PortUpload &Info) const;
+  void applyPortUpload(MachineInstr &MI, PortUpload &Info) const;
+
   // G_STORE => G_MEMSET
   bool matchStoreToMemset(MachineInstr &MI, uint8_t &Value) const;
   void applyStoreToMemset(MachineInstr &MI, uint8_t &Value) const;
@@ -119,7 +173,6 @@ public:
   bool matchMulToShiftAndAdd(MachineInstr &MI, BuildFnTy &MatchInfo) const;
 
   APInt getDemandedBits(Register R) const;
-  APInt getDemandedBits(Register R, DenseMap<Register, APInt> &Cache) const;
 
 private:
 #define GET_GICOMBINER_CLASS_MEMBERS
@@ -145,6 +198,17 @@ MOSCombinerImpl::MOSCombinerImpl(
 {
 }
 
+bool MOSCombinerImpl::tryCombineAll(MachineInstr &I) const {
+  // The Combiner replaces its observers at the start of each iteration, so the
+  // demanded bits cache only watches the MIR while combining. In between, the
+  // Combiner only erases dead instructions, which cannot add demanded bits.
+  auto &Wrapper = static_cast<GISelObserverWrapper &>(Observer);
+  Wrapper.addObserver(&DemandedCache);
+  bool Changed = tryCombineAllImpl(I);
+  Wrapper.removeObserver(&DemandedCache);
+  return Changed;
+}
+
 // G_PTR_ADD (GLOBAL_VALUE @x + y_const), z_const =>
 // GLOBAL_VALUE @x + (y_const + z_const)
 bool MOSCombinerImpl::matchFoldGlobalOffset(
@@ -182,6 +246,102 @@ void MOSCombinerImpl::applyFoldGlobalOffset(
   Observer.changedInstr(MI);
 }
 
+// G_LOAD (GLOBAL_VALUE @const + y_const) => G_CONSTANT
+//
+// Loads from constant tables at known offsets are folded to the initializer's
+// value. These often only become known after IR optimization, for example once
+// loads of wide values have been split by the legalizer, or once the index of
+// a switch lookup table has been constant folded.
+bool MOSCombinerImpl::matchFoldConstantLoad(MachineInstr &MI,
+                                            BuildFnTy &MatchInfo) const {
+  using namespace TargetOpcode;
+  if (MI.hasOrderedMemoryRef() || !MI.hasOneMemOperand())
+    return false;
+
+  const MachineOperand *Global;
+  int64_t Offset = 0;
+  if (MI.getOpcode() == MOS::G_LOAD_ABS) {
+    Global = &MI.getOperand(1);
+    if (!Global->isGlobal())
+      return false;
+  } else {
+    Register Addr = cast<GAnyLoad>(MI).getPointerReg();
+    while (const auto *PtrAdd =
+               cast_if_present<GPtrAdd>(getOpcodeDef(G_PTR_ADD, Addr, MRI))) {
+      auto ConstOffset =
+          getIConstantVRegValWithLookThrough(PtrAdd->getOffsetReg(), MRI);
+      if (!ConstOffset)
+        return false;
+      Offset += ConstOffset->Value.getSExtValue();
+      Addr = PtrAdd->getBaseReg();
+    }
+    MachineInstr *GlobalBase = getOpcodeDef(G_GLOBAL_VALUE, Addr, MRI);
+    if (!GlobalBase)
+      return false;
+    Global = &GlobalBase->getOperand(1);
+  }
+  Offset += Global->getOffset();
+
+  // The initializer must be the one that will be linked in.
+  const auto *GV = dyn_cast<GlobalVariable>(Global->getGlobal());
+  if (!GV || !GV->isConstant() || !GV->hasDefinitiveInitializer() ||
+      Offset < 0)
+    return false;
+
+  Register Dst = MI.getOperand(0).getReg();
+  LLT Ty = MRI.getType(Dst);
+  const MachineMemOperand &MMO = **MI.memoperands_begin();
+  LocationSize MemSize = MMO.getSizeInBits();
+  if (!MemSize.hasValue() || MemSize.isScalable())
+    return false;
+  uint64_t MemBits = MemSize.getValue().getFixedValue();
+  if (!MemBits || MemBits % 8)
+    return false;
+
+  const DataLayout &DL = MI.getMF()->getDataLayout();
+  LLVMContext &Ctx = GV->getContext();
+  Type *MemTy = Ty.isPointer() && MemBits == Ty.getSizeInBits()
+                    ? PointerType::get(Ctx, Ty.getAddressSpace())
+                    : IntegerType::get(Ctx, MemBits);
+  Constant *C = ConstantFoldLoadFromConst(
+      const_cast<Constant *>(GV->getInitializer()), MemTy,
+      APInt(DL.getIndexSizeInBits(GV->getAddressSpace()), Offset), DL);
+  if (!C)
+    return false;
+
+  if (const auto *CI = dyn_cast<ConstantInt>(C)) {
+    if (!Ty.isScalar())
+      return false;
+    APInt Val = MI.getOpcode() == G_SEXTLOAD
+                    ? CI->getValue().sext(Ty.getSizeInBits())
+                    : CI->getValue().zext(Ty.getSizeInBits());
+    MatchInfo = [=](MachineIRBuilder &B) { B.buildConstant(Dst, Val); };
+    return true;
+  }
+
+  // Tables of pointers fold to the addresses they contain. Pointers are
+  // only legal as such before legalization.
+  if (!Ty.isPointer() || !Helper.isPreLegalize())
+    return false;
+  APInt PtrOffset(DL.getIndexSizeInBits(Ty.getAddressSpace()), 0);
+  const auto *Target = dyn_cast<GlobalValue>(
+      C->stripAndAccumulateConstantOffsets(DL, PtrOffset,
+                                           /*AllowNonInbounds=*/true));
+  if (!Target)
+    return false;
+  int64_t TargetOffset = PtrOffset.getSExtValue();
+  MatchInfo = [=](MachineIRBuilder &B) {
+    if (!TargetOffset) {
+      B.buildGlobalValue(Dst, Target);
+      return;
+    }
+    LLT IdxTy = LLT::scalar(PtrOffset.getBitWidth());
+    B.buildPtrAdd(Dst, B.buildGlobalValue(Ty, Target),
+                  B.buildConstant(IdxTy, TargetOffset));
+  };
+  return true;
+}
+
 bool MOSCombinerImpl::matchSBCEqual(MachineInstr &MI) const {
   assert(MI.getOpcode() == MOS::G_SBC);
   Register LHS = MI.getOperand(5).getReg();
@@ -289,7 +449,8 @@ void MOSCombinerImpl::applyExtractLowBit(MachineInstr &MI,
     B.buildNot(MI.getOperand(0).getReg(), EvenShift.getReg(1));
   else
     B.buildCopy(MI.getOperand(0).getReg(), EvenShift.getReg(1));
-  MOSLegalizerInfo Legalizer(B.getMF().getSubtarget<MOSSubtarget>());
+  const MOSLegalizerInfo &Legalizer =
+      MOSLegalizerInfo::get(B.getMF().getSubtarget<MOSSubtarget>());
   LegalizerHelper LegalizerHelper(B.getMF(), Legalizer, Observer, B);
   B.setInstrAndDebugLoc(*EvenShift);
   if (!Legalizer.legalizeLshrEShlE(LegalizerHelper, MRI, *EvenShift))
@@ -298,6 +459,35 @@ void MOSCombinerImpl::applyExtractLowBit(MachineInstr &MI,
   MI.eraseFromParent();
 }
 
+// A single high bit of a byte, like a bitfield flag, is better extracted by
+// shifting it up into the carry than by shifting it down. The final shift by
+// seven becomes ASL, LDA #0, ROL, so bit 6 takes four instructions rather than
+// a widened shift and a mask. Bit 7 needs no mask, and bits 4 and below are
+// no cheaper this way.
+bool MOSCombinerImpl::matchExtractHighBit(MachineInstr &MI,
+                                          BuildFnTy &MatchInfo) const {
+  using namespace MIPatternMatch;
+  LLT S8 = LLT::scalar(8);
+  Register Dst = MI.getOperand(0).getReg();
+  if (MRI.getType(Dst) != S8)
+    return false;
+
+  Register Shift, Src;
+  int64_t Amt;
+  if (!mi_match(Dst, MRI,
+                m_GAnd(m_Reg(Shift), MIPatternMatch::m_SpecificICst(1))) ||
+      !mi_match(Shift, MRI, m_GLShr(m_Reg(Src), m_ICst(Amt))))
+    return false;
+  if (Amt < 5 || Amt > 6 || !MRI.hasOneNonDBGUse(Shift))
+    return false;
+
+  MatchInfo = [=](MachineIRBuilder &B) {
+    auto Up = B.buildShl(S8, Src, B.buildConstant(S8, 7 - Amt));
+    B.buildLShr(Dst, Up, B.buildConstant(S8, 7));
+  };
+  return true;
+}
+
 // Use of the overflow flag from an increment is better done on the 6502 by
 // comparing the result to zero, since this allows increment and decrement
 // operators instead of just ADC.
@@ -400,6 +590,172 @@ void MOSCombinerImpl::applyLoadStoreToMemcpy(MachineInstr &MI,
   MI.eraseFromParent();
 }
 
+// Returns the absolute address Addr holds, as a global or immediate operand.
+static std::optional<MachineOperand>
+getAbsoluteAddress(Register Addr, const MachineRegisterInfo &MRI) {
+  int64_t Offset = 0;
+  while (true) {
+    if (auto Const = getIConstantVRegValWithLookThrough(Addr, MRI))
+      return MachineOperand::CreateImm(Const->Value.getSExtValue() + Offset);
+    if (const MachineInstr *GV =
+            getOpcodeDef(TargetOpcode::G_GLOBAL_VALUE, Addr, MRI)) {
+      const MachineOperand &Op = GV->getOperand(1);
+      return MachineOperand::CreateGA(Op.getGlobal(), Op.getOffset() + Offset,
+                                      Op.getTargetFlags());
+    }
+    const auto *PtrAdd = cast_if_present<GPtrAdd>(
+        getOpcodeDef(TargetOpcode::G_PTR_ADD, Addr, MRI));
+    if (!PtrAdd)
+      return std::nullopt;
+    auto ConstOffset =
+        getIConstantVRegValWithLookThrough(PtrAdd->getOffsetReg(), MRI);
+    if (!ConstOffset)
+      return std::nullopt;
+    Offset += ConstOffset->Value.getSExtValue();
+    Addr = PtrAdd->getBaseReg();
+  }
+}
+
+// Returns whether Addr is Base offset by Offset bytes.
+static bool isOffsetAddress(const MachineOperand &Addr,
+                            const MachineOperand &Base, int64_t Offset) {
+  if (Addr.isImm())
+    return Base.isImm() && Addr.getImm() == Base.getImm() + Offset;
+  return Base.isGlobal() && Addr.getGlobal() == Base.getGlobal() &&
+         Addr.getOffset() == Base.getOffset() + Offset;
+}
+
+// Matches a volatile byte store to a fixed address of a value loaded just
+// before from an absolute address, returning the load.
+static GLoad *matchPortCopy(MachineInstr &MI, const MachineRegisterInfo &MRI,
+                            MachineOperand &Src, int64_t &Dst) {
+  auto *Store = dyn_cast<GStore>(&MI);
+  if (!Store || !Store->isVolatile() || Store->isAtomic() ||
+      Store->getMemSize() != 1)
+    return nullptr;
+  auto *Load = getOpcodeDef<GLoad>(Store->getValueReg(), MRI);
+  if (!Load || Load->getParent() != MI.getParent() || !Load->isUnordered() ||
+      Load->getMemSize() != 1 || !MRI.hasOneNonDBGUse(Load->getDstReg()))
+    return nullptr;
+  for (const MachineInstr &I :
+       make_range(std::next(Load->getIterator()), MI.getIterator()))
+    if (I.mayLoadOrStore() || I.hasUnmodeledSideEffects())
+      return nullptr;
+
+  auto SrcAddr = getAbsoluteAddress(Load->getPointerReg(), MRI);
+  auto DstAddr = getAbsoluteAddress(Store->getPointerReg(), MRI);
+  if (!SrcAddr || !DstAddr || !DstAddr->isImm())
+    return nullptr;
+  Src = *SrcAddr;
+  Dst = DstAddr->getImm();
+  return Load;
+}
+
+// G_LOAD/volatile G_STORE pairs => HuCPortCopy (TIA, TIN)
+//
+// Uploads of buffers to I/O ports, like the PC Engine's VDC data registers,
+// appear as runs of byte copies to the same port, or alternately to the low
+// and high ports of a pair. TIN and TIA make exactly the same sequence of
+// accesses.
+bool MOSCombinerImpl::matchPortUpload(MachineInstr &MI,
+                                      PortUpload &Info) const {
+  const MachineFunction &MF = *MI.getMF();
+  const MOSSubtarget &STI = MF.getSubtarget<MOSSubtarget>();
+  if (!STI.hasHUC6280())
+    return false;
+
+  GLoad *Load = matchPortCopy(MI, MRI, Info.Src, Info.Dst);
+  if (!Load)
+    return false;
+
+  // Only the first copy of a run roots the match.
+  for (MachineInstr &I : make_range(std::next(Load->getReverseIterator()),
+                                    MI.getParent()->rend())) {
+    MachineOperand Src = MachineOperand::CreateImm(0);
+    int64_t Dst;
+    if (matchPortCopy(I, MRI, Src, Dst) && isOffsetAddress(Info.Src, Src, 1) &&
+        Dst >= Info.Dst - 1 && Dst <= Info.Dst + 1)
+      return false;
+    if (I.mayLoadOrStore() || I.hasUnmodeledSideEffects())
+      break;
+  }
+
+  Info.Copies.clear();
+  Info.Copies.push_back({Load, cast<GStore>(&MI)});
+  GLoad *Pending = nullptr;
+  for (MachineInstr &I :
+       make_range(std::next(MI.getIterator()), MI.getParent()->end())) {
+    MachineOperand Src = MachineOperand::CreateImm(0);
+    int64_t Dst;
+    if (GLoad *L = matchPortCopy(I, MRI, Src, Dst)) {
+      int64_t N = Info.Copies.size();
+      if (N == 1 && Dst == Info.Dst + 1)
+        Info.Alternate = true;
+      if (L != Pending || !isOffsetAddress(Src, Info.Src, N) ||
+          Dst != Info.Dst + (Info.Alternate ? N % 2 : 0))
+        break;
+      Info.Copies.push_back({L, cast<GStore>(&I)});
+      Pending = nullptr;
+      continue;
+    }
+    // Each copy's load comes just before its store.
+    if (isa<GLoad>(I) && !Pending) {
+      Pending = cast<GLoad>(&I);
+      continue;
+    }
+    if (I.mayLoadOrStore() || I.hasUnmodeledSideEffects() || I.isTerminator())
+      break;
+  }
+
+  // A source overlapping the ports would observe the writes.
+  uint64_t Length = Info.Copies.size();
+  if (Info.Src.isImm() && Info.Src.getImm() <= Info.Dst + 1 &&
+      Info.Dst < Info.Src.getImm() + static_cast<int64_t>(Length))
+    return false;
+
+  // Each transfer is 7 bytes and (17 + 6n) cycles.
+  auto Get = [&](unsigned Opcode) { return MOSInstrCost::get(Opcode, STI); };
+  uint64_t Transfers = divideCeil(Length, HuCBytesPerTransfer);
+  MOSInstrCost Block(7 * Transfers, 17 * Transfers + 6 * Length);
+  MOSInstrCost Unrolled =
+      (Get(MOS::LDA_Absolute) + Get(MOS::STA_Absolute)) * Length;
+  MOSInstrCost::Mode Mode = MOSInstrCost::getModeFor(MF);
+  return Block.value(Mode) < Unrolled.value(Mode);
+}
+
+void MOSCombinerImpl::applyPortUpload(MachineInstr &MI,
+                                      PortUpload &Info) const {
+  B.setInstrAndDebugLoc(MI);
+
+  // Transfers of an even length keep the alternation in phase.
+  uint64_t Length = Info.Copies.size();
+  for (uint64_t Offset = 0; Offset < Length; Offset += HuCBytesPerTransfer) {
+    uint64_t TransferLen = std::min(Length - Offset, HuCBytesPerTransfer);
+    SmallVector<const MachineInstr *> Accesses;
+    for (const auto &[Load, Store] :
+         ArrayRef(Info.Copies).slice(Offset, TransferLen)) {
+      Accesses.push_back(Load);
+      Accesses.push_back(Store);
+    }
+    MachineOperand Src = Info.Src;
+    if (Src.isImm())
+      Src.setImm(Src.getImm() + Offset);
+    else
+      Src.setOffset(Src.getOffset() + Offset);
+    B.buildInstr(MOS::HuCPortCopy)
+        .add(Src)
+        .addImm(Info.Dst)
+        .addImm(TransferLen)
+        .addImm(Info.Alternate)
+        .cloneMergedMemRefs(Accesses);
+  }
+
+  for (const auto &[Load, Store] : Info.Copies) {
+    Store->eraseFromParent();
+    Load->eraseFromParent();
+  }
+}
+
 // G_STORE => G_MEMSET (large constant stores of repeating bytes)
 bool MOSCombinerImpl::matchStoreToMemset(MachineInstr &MI,
                                          uint8_t &Value) const {
@@ -651,14 +1007,8 @@ bool MOSCombinerImpl::matchMulToShiftAndAdd(MachineInstr &MI,
 }
 
 APInt MOSCombinerImpl::getDemandedBits(Register R) const {
-  DenseMap<Register, APInt> Cache;
-  return getDemandedBits(R, Cache);
-}
-
-APInt MOSCombinerImpl::getDemandedBits(Register R,
-                                       DenseMap<Register, APInt> &Cache) const {
-  auto It = Cache.find(R);
-  if (It != Cache.end())
+  auto It = DemandedCache.Bits.find(R);
+  if (It != DemandedCache.Bits.end())
     return It->second;
 
   uint64_t Size = MRI.getType(R).getSizeInBits();
@@ -683,10 +1033,9 @@ APInt MOSCombinerImpl::getDemandedBits(Register R,
       break;
     }
     case MOS::G_LSHRE: {
-      APInt DstDemandedBits = getDemandedBits(MI.getOperand(0).getReg(), Cache);
+      APInt DstDemandedBits = getDemandedBits(MI.getOperand(0).getReg());
       if (Use.getOperandNo() == 2) {
-        APInt CarryOutDemanded =
-            getDemandedBits(MI.getOperand(1).getReg(), Cache);
+        APInt CarryOutDemanded = getDemandedBits(MI.getOperand(1).getReg());
         DemandedBits |= DstDemandedBits << 1 | CarryOutDemanded.zext(8);
       } else {
         assert(Use.getOperandNo() == 3);
@@ -695,10 +1044,9 @@ APInt MOSCombinerImpl::getDemandedBits(Register R,
       break;
     }
     case MOS::G_SHLE: {
-      APInt DstDemandedBits = getDemandedBits(MI.getOperand(0).getReg(), Cache);
+      APInt DstDemandedBits = getDemandedBits(MI.getOperand(0).getReg());
       if (Use.getOperandNo() == 2) {
-        APInt CarryOutDemanded =
-            getDemandedBits(MI.getOperand(1).getReg(), Cache);
+        APInt CarryOutDemanded = getDemandedBits(MI.getOperand(1).getReg());
         DemandedBits |=
             DstDemandedBits.lshr(1) | (CarryOutDemanded.zext(8) << 7);
       } else {
@@ -711,7 +1059,7 @@ APInt MOSCombinerImpl::getDemandedBits(Register R,
     if (DemandedBits.isAllOnes())
       break;
   }
-  Cache.try_emplace(R, DemandedBits);
+  DemandedCache.Bits.try_emplace(R, DemandedBits);
   return DemandedBits;
 }
 
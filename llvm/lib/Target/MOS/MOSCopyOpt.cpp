@@ -9,6 +9,11 @@
 // This file defines the MOS pass to fully optimize COPY operations before
 // lowering.
 //
+// Copies are forwarded from earlier copies and rematerialized from immediate
+// loads by searching backwards from each copy for the definitions reaching it.
+// The searches query a per-block index of register definitions, so each block
+// along a path costs a lookup rather than a walk over its instructions.
+//
 //===----------------------------------------------------------------------===//
 
 #include "MOSCopyOpt.h"
@@ -22,13 +27,25 @@
 #include "llvm/ADT/DenseSet.h"
 #include "llvm/ADT/PostOrderIterator.h"
 #include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/Statistic.h"
 #include "llvm/CodeGen/LivePhysRegs.h"
 #include "llvm/CodeGen/MachineMemOperand.h"
 #include "llvm/CodeGen/TargetRegisterInfo.h"
 #include "llvm/CodeGen/TargetSubtargetInfo.h"
+#include "llvm/Support/TimeProfiler.h"
 
 #define DEBUG_TYPE "mos-copy-opt"
 
+STATISTIC(NumCopiesForwarded,
+          "Number of copies forwarded from earlier sources");
+STATISTIC(NumCopiesErased, "Number of copies made redundant by forwarding");
+STATISTIC(NumCopiesRematerialized,
+          "Number of copies replaced by rematerialized immediate loads");
+STATISTIC(NumDeadCopies, "Number of dead copies erased");
+STATISTIC(NumReachingDefBlocks,
+          "Number of blocks searched for reaching definitions");
+STATISTIC(NumClobberBlocks, "Number of blocks searched for clobbers");
+
 using namespace llvm;
 
 namespace {
@@ -44,63 +61,197 @@ public:
   bool runOnMachineFunction(MachineFunction &MF) override;
 };
 
+// An index of the instructions in each block that modify each register unit,
+// so that the last modification of a register before a point in a block can
+// be found without walking the block. Blocks are indexed when first queried,
+// and the index is updated in place as the pass erases and rematerializes
+// copies.
+class DefIndex {
+public:
+  DefIndex(const TargetRegisterInfo &TRI) : TRI(TRI) {}
+
+  // Returns the position of MI within its block.
+  unsigned getPos(const MachineInstr &MI) {
+    get(*MI.getParent());
+    return Positions.lookup(&MI);
+  }
+
+  // Returns the position one past the end of MBB.
+  unsigned getEnd(const MachineBasicBlock &MBB) { return get(MBB).End; }
+
+  // Returns the last instruction before position End in MBB that modifies Reg,
+  // in the sense of MachineInstr::modifiesRegister, or nullptr if none does.
+  MachineInstr *findLastDef(const MachineBasicBlock &MBB, unsigned End,
+                            Register Reg);
+
+  // Notes that MI is about to be erased.
+  void erase(MachineInstr &MI);
+  // Notes that New has taken the place of Old, which is about to be erased.
+  void replace(MachineInstr &Old, MachineInstr &New);
+
+private:
+  struct Def {
+    unsigned Pos;
+    MachineInstr *MI;
+    bool operator<(const Def &Other) const { return Pos < Other.Pos; }
+  };
+  struct BlockDefs {
+    DenseMap<unsigned, SmallVector<Def, 4>> UnitDefs;
+    // Register masks clobber registers, not units, so they're checked per
+    // query.
+    SmallVector<Def> RegMasks;
+    unsigned End = 0;
+  };
+
+  BlockDefs &get(const MachineBasicBlock &MBB);
+  void add(BlockDefs &Defs, unsigned Pos, MachineInstr &MI);
+  void remove(BlockDefs &Defs, unsigned Pos, MachineInstr &MI);
+
+  const TargetRegisterInfo &TRI;
+  DenseMap<const MachineBasicBlock *, BlockDefs> Blocks;
+  DenseMap<const MachineInstr *, unsigned> Positions;
+};
+
 } // namespace
 
+DefIndex::BlockDefs &DefIndex::get(const MachineBasicBlock &MBB) {
+  auto [It, Inserted] = Blocks.try_emplace(&MBB);
+  BlockDefs &Defs = It->second;
+  if (!Inserted)
+    return Defs;
+  for (const MachineInstr &MI : MBB) {
+    Positions[&MI] = Defs.End;
+    add(Defs, Defs.End++, const_cast<MachineInstr &>(MI));
+  }
+  return Defs;
+}
+
+void DefIndex::add(BlockDefs &Defs, unsigned Pos, MachineInstr &MI) {
+  const auto Insert = [&](SmallVectorImpl<Def> &List) {
+    Def D = {Pos, &MI};
+    List.insert(upper_bound(List, D), D);
+  };
+  for (const MachineOperand &MO : MI.operands()) {
+    if (MO.isRegMask()) {
+      Insert(Defs.RegMasks);
+      continue;
+    }
+    if (!MO.isReg() || !MO.isDef() || !MO.getReg().isPhysical())
+      continue;
+    for (MCRegUnit Unit : TRI.regunits(MO.getReg())) {
+      SmallVectorImpl<Def> &List = Defs.UnitDefs[Unit];
+      if (List.empty() || List.back().MI != &MI)
+        Insert(List);
+    }
+  }
+}
+
+void DefIndex::remove(BlockDefs &Defs, unsigned Pos, MachineInstr &MI) {
+  const auto Erase = [&](SmallVectorImpl<Def> &List) {
+    auto It = lower_bound(List, Def{Pos, nullptr});
+    while (It != List.end() && It->Pos == Pos)
+      It = It->MI == &MI ? List.erase(It) : std::next(It);
+  };
+  for (auto &[Unit, List] : Defs.UnitDefs)
+    Erase(List);
+  Erase(Defs.RegMasks);
+}
+
+MachineInstr *DefIndex::findLastDef(const MachineBasicBlock &MBB, unsigned End,
+                                    Register Reg) {
+  BlockDefs &Defs = get(MBB);
+  const Def *Last = nullptr;
+  const auto Consider = [&](const Def &D) {
+    if (!Last || Last->Pos < D.Pos)
+      Last = &D;
+  };
+  for (MCRegUnit Unit : TRI.regunits(Reg)) {
+    auto It = Defs.UnitDefs.find(Unit);
+    if (It == Defs.UnitDefs.end())
+      continue;
+    auto DefIt = lower_bound(It->second, Def{End, nullptr});
+    if (DefIt != It->second.begin())
+      Consider(*std::prev(DefIt));
+  }
+  auto MaskIt = lower_bound(Defs.RegMasks, Def{End, nullptr});
+  while (MaskIt != Defs.RegMasks.begin()) {
+    --MaskIt;
+    if (Last && MaskIt->Pos < Last->Pos)
+      break;
+    if (MaskIt->MI->modifiesRegister(Reg, &TRI)) {
+      Consider(*MaskIt);
+      break;
+    }
+  }
+  return Last ? Last->MI : nullptr;
+}
+
+void DefIndex::erase(MachineInstr &MI) {
+  auto It = Blocks.find(MI.getParent());
+  if (It == Blocks.end())
+    return;
+  remove(It->second, Positions.lookup(&MI), MI);
+  Positions.erase(&MI);
+}
+
+void DefIndex::replace(MachineInstr &Old, MachineInstr &New) {
+  auto It = Blocks.find(Old.getParent());
+  if (It == Blocks.end())
+    return;
+  unsigned Pos = Positions.lookup(&Old);
+  remove(It->second, Pos, Old);
+  Positions.erase(&Old);
+  Positions[&New] = Pos;
+  add(It->second, Pos, New);
+}
+
 template <typename AcceptDefT>
-static bool findReachingDefs(MachineInstr &MI,
+static bool findReachingDefs(MachineInstr &MI, DefIndex &Index,
                              SmallVectorImpl<MachineInstr *> &DefMIs,
                              const AcceptDefT &AcceptDef) {
   assert(MI.isCopy());
-  const TargetRegisterInfo &TRI = *MI.getMF()->getSubtarget().getRegisterInfo();
-
   Register Src = MI.getOperand(1).getReg();
 
+  // Each entry is a block to search backwards from the position End.
   struct Entry {
     MachineBasicBlock &MBB;
-    MachineBasicBlock::reverse_iterator I;
+    unsigned End;
   };
 
-  SmallVector<Entry> WorkList = {
-      {*MI.getParent(), MachineBasicBlock::reverse_iterator(MI.getIterator())}};
+  SmallVector<Entry> WorkList = {{*MI.getParent(), Index.getPos(MI)}};
   DenseSet<const MachineBasicBlock *> Seen;
   while (!WorkList.empty()) {
     Entry E = WorkList.back();
     WorkList.pop_back();
     if (Seen.contains(&E.MBB))
       continue;
+    ++NumReachingDefBlocks;
 
     // Don't count the start MBB as seen until it's been seen as a predecessor.
-    if (E.I == E.MBB.rbegin())
+    if (E.End == Index.getEnd(E.MBB))
       Seen.insert(&E.MBB);
 
-    bool Found = false;
-    for (MachineInstr &MI : make_range(E.I, E.MBB.rend())) {
-      if (!MI.modifiesRegister(Src, &TRI))
-        continue;
-
-      if (!AcceptDef(MI))
+    if (MachineInstr *Def = Index.findLastDef(E.MBB, E.End, Src)) {
+      if (!AcceptDef(*Def))
         return false;
-
-      Found = true;
-      DefMIs.push_back(&MI);
-      break;
-    }
-    if (!Found) {
-      // The register must have been live-in.
-      if (E.MBB.isEntryBlock())
-        return false;
-      for (MachineBasicBlock *MBB : E.MBB.predecessors())
-        WorkList.push_back({*MBB, MBB->rbegin()});
+      DefMIs.push_back(Def);
+      continue;
     }
+
+    // The register must have been live-in.
+    if (E.MBB.isEntryBlock())
+      return false;
+    for (MachineBasicBlock *MBB : E.MBB.predecessors())
+      WorkList.push_back({*MBB, Index.getEnd(*MBB)});
   }
   return true;
 }
 
-static Register findForwardedCopy(MachineInstr &MI,
+static Register findForwardedCopy(MachineInstr &MI, DefIndex &Index,
                                   SmallVectorImpl<MachineInstr *> &NewSrcMIs) {
   Register Src = MI.getOperand(1).getReg();
   Register NewSrc = 0;
-  if (!findReachingDefs(MI, NewSrcMIs, [&](MachineInstr &Def) {
+  if (!findReachingDefs(MI, Index, NewSrcMIs, [&](MachineInstr &Def) {
         if (!Def.isCopy())
           return false;
         Register Dst = Def.getOperand(0).getReg();
@@ -117,12 +268,12 @@ static Register findForwardedCopy(MachineInstr &MI,
   return NewSrc;
 }
 
-static bool findLdImm(MachineInstr &MI,
+static bool findLdImm(MachineInstr &MI, DefIndex &Index,
                       SmallVectorImpl<MachineInstr *> &LdImms) {
   const TargetInstrInfo &TII = *MI.getMF()->getSubtarget().getInstrInfo();
   Register Dst = MI.getOperand(0).getReg();
   Register Src = MI.getOperand(1).getReg();
-  return findReachingDefs(MI, LdImms, [&](MachineInstr &Def) {
+  return findReachingDefs(MI, Index, LdImms, [&](MachineInstr &Def) {
     if (!Def.isMoveImmediate())
       return false;
     if (Def.getOperand(0).getReg() != Src)
@@ -136,40 +287,44 @@ static bool findLdImm(MachineInstr &MI,
   });
 }
 
-static bool isClobbered(MachineInstr &MI, Register NewSrc,
+// Returns whether NewSrc may be modified on some path from one of NewSrcMIs to
+// MI.
+static bool isClobbered(MachineInstr &MI, DefIndex &Index, Register NewSrc,
                         const SmallVectorImpl<MachineInstr *> &NewSrcMIs) {
-  const TargetRegisterInfo &TRI = *MI.getMF()->getSubtarget().getRegisterInfo();
-
   struct Entry {
     MachineBasicBlock &MBB;
-    MachineBasicBlock::reverse_iterator I;
+    unsigned End;
   };
 
-  SmallVector<Entry> WorkList = {
-      {*MI.getParent(), MachineBasicBlock::reverse_iterator(MI.getIterator())}};
+  SmallVector<Entry> WorkList = {{*MI.getParent(), Index.getPos(MI)}};
   DenseSet<const MachineBasicBlock *> Seen;
   while (!WorkList.empty()) {
     Entry E = WorkList.back();
     WorkList.pop_back();
     if (Seen.contains(&E.MBB))
       continue;
+    ++NumClobberBlocks;
 
     // Don't count the start MBB as seen until it's been seen as a predecessor.
-    if (E.I == E.MBB.rbegin())
+    if (E.End == Index.getEnd(E.MBB))
       Seen.insert(&E.MBB);
 
-    bool Found = false;
-    for (MachineInstr &MI : make_range(E.I, E.MBB.rend())) {
-      if (is_contained(NewSrcMIs, &MI)) {
-        Found = true;
-        break;
-      }
-      if (MI.modifiesRegister(NewSrc, &TRI))
-        return true;
+    // The search along this path stops at the last of NewSrcMIs in the block,
+    // unless something modifies NewSrc after it.
+    std::optional<unsigned> Begin;
+    for (MachineInstr *NewSrcMI : NewSrcMIs) {
+      if (NewSrcMI->getParent() != &E.MBB)
+        continue;
+      unsigned Pos = Index.getPos(*NewSrcMI);
+      if (Pos < E.End && (!Begin || *Begin < Pos))
+        Begin = Pos;
     }
-    if (!Found)
+    if (MachineInstr *Def = Index.findLastDef(E.MBB, E.End, NewSrc))
+      if (!Begin || *Begin < Index.getPos(*Def))
+        return true;
+    if (!Begin)
       for (MachineBasicBlock *MBB : E.MBB.predecessors())
-        WorkList.push_back({*MBB, MBB->rbegin()});
+        WorkList.push_back({*MBB, Index.getEnd(*MBB)});
   }
   return false;
 }
@@ -181,6 +336,9 @@ bool MOSCopyOpt::runOnMachineFunction(MachineFunction &MF) {
   auto CostMode = MOSInstrCost::getModeFor(MF);
 
   LLVM_DEBUG(dbgs() << MF.getName() << "\n");
+  TimeTraceScope Scope("MOSCopyOpt", MF.getName());
+
+  DefIndex Index(TRI);
 
   for (MachineBasicBlock &MBB : MF) {
     for (MachineInstr &MI : make_early_inc_range(MBB)) {
@@ -190,7 +348,7 @@ bool MOSCopyOpt::runOnMachineFunction(MachineFunction &MF) {
       Register Dst = MI.getOperand(0).getReg();
       Register Src = MI.getOperand(1).getReg();
       SmallVector<MachineInstr *> NewSrcMIs;
-      Register NewSrc = findForwardedCopy(MI, NewSrcMIs);
+      Register NewSrc = findForwardedCopy(MI, Index, NewSrcMIs);
       if (!NewSrc)
         continue;
 
@@ -204,7 +362,7 @@ bool MOSCopyOpt::runOnMachineFunction(MachineFunction &MF) {
         continue;
       }
 
-      if (isClobbered(MI, NewSrc, NewSrcMIs)) {
+      if (isClobbered(MI, Index, NewSrc, NewSrcMIs)) {
         LLVM_DEBUG(dbgs() << "Clobbered.\n");
         continue;
       }
@@ -214,8 +372,11 @@ bool MOSCopyOpt::runOnMachineFunction(MachineFunction &MF) {
         NewSrcMI->clearRegisterKills(NewSrc, &TRI);
       if (Dst == NewSrc) {
         LLVM_DEBUG(dbgs() << "Erased.\n");
+        ++NumCopiesErased;
+        Index.erase(MI);
         MI.eraseFromParent();
       } else {
+        ++NumCopiesForwarded;
         MI.getOperand(1).setReg(NewSrc);
         MI.getOperand(1).setIsKill(false);
         LLVM_DEBUG(dbgs() << "Rewrote to: " << MI);
@@ -227,7 +388,8 @@ bool MOSCopyOpt::runOnMachineFunction(MachineFunction &MF) {
         continue;
 
       auto [Dst, Src] = MI.getFirst2Regs();
-      auto LdImmCostVal = MOSInstrCost(2, 2).value(CostMode);
+      auto LdImmCostVal =
+          MOSInstrCost::get(MOS::LDA_Immediate, STI).value(CostMode);
 
       if (!MOS::Imag16RegClass.contains(Dst) && Dst != MOS::C &&
           Dst != MOS::V &&
@@ -235,13 +397,14 @@ bool MOSCopyOpt::runOnMachineFunction(MachineFunction &MF) {
         continue;
 
       SmallVector<MachineInstr *> LdImms;
-      if (!findLdImm(MI, LdImms))
+      if (!findLdImm(MI, Index, LdImms))
         continue;
 
       LLVM_DEBUG(dbgs() << MI);
       LLVM_DEBUG(dbgs() << "Found remat candidate: " << *LdImms.front());
 
-      if (isClobbered(MI, LdImms.front()->getOperand(0).getReg(), LdImms)) {
+      if (isClobbered(MI, Index, LdImms.front()->getOperand(0).getReg(),
+                      LdImms)) {
         LLVM_DEBUG(dbgs() << "Clobbered.\n");
         continue;
       }
@@ -250,7 +413,9 @@ bool MOSCopyOpt::runOnMachineFunction(MachineFunction &MF) {
         LdImm->clearRegisterKills(Src, &TRI);
       LdImms.front()->clearRegisterKills(Src, &TRI);
       TII.reMaterialize(MBB, MI, Dst, 0, *LdImms.front());
+      Index.replace(MI, *std::prev(MI.getIterator()));
       MI.eraseFromParent();
+      ++NumCopiesRematerialized;
     }
   }
 
@@ -262,6 +427,7 @@ bool MOSCopyOpt::runOnMachineFunction(MachineFunction &MF) {
       if (MI.isCopy() && MI.getOperand(0).isDead()) {
         LLVM_DEBUG(dbgs() << "Erasing dead copy: " << MI);
         MI.eraseFromParent();
+        ++NumDeadCopies;
       }
     }
 
@@ -0,0 +1,236 @@
+//===-- MOSCoroFrames.cpp - MOS Static Coroutine Frames -------------------===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines the MOS static coroutine frame passes.
+//
+// CoroSplit allocates the frame of each coroutine instance on the heap unless
+// the allocation can be elided, but MOS programs seldom have a heap. Where at
+// most one instance of a coroutine can be live at a time, the frame can
+// instead be a static global, sized once CoroSplit has laid it out.
+//
+// Before splitting, the frame's allocation and deallocations are still
+// recognizable by their use of llvm.coro.size and llvm.coro.free. The marking
+// pass tags them with !mos.coro.frame metadata naming the coroutine, which
+// survives splitting, cloning into the resume and destroy functions, and
+// inlining. The codegen pass then gives each allocation site its own static
+// frame, provided every allocation of the coroutine qualifies, and removes the
+// deallocations. A coroutine qualifies if it is declared static_coroutine, or
+// if each site can only run once in the whole program: outside of any cycle
+// in main, or in a function with only one caller that itself runs once.
+//
+// Frames are live across suspension points, and thus across arbitrary calls,
+// so they cannot share memory with the static stack.
+//
+//===----------------------------------------------------------------------===//
+
+#include "MOSCoroFrames.h"
+
+#include "MOS.h"
+
+#include "llvm/ADT/MapVector.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/CFG.h"
+#include "llvm/Analysis/MemoryBuiltins.h"
+#include "llvm/Analysis/OptimizationRemarkEmitter.h"
+#include "llvm/Analysis/TargetLibraryInfo.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Metadata.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Transforms/Utils/Local.h"
+
+#define DEBUG_TYPE "mos-coro-frames"
+
+STATISTIC(NumStaticCoroFrames, "Number of coroutine frames made static");
+STATISTIC(NumStaticCoroFrameBytes, "Number of bytes of static coroutine "
+                                   "frames");
+
+using namespace llvm;
+
+static cl::opt<bool> StaticCoroFrames(
+    "mos-static-coro-frames",
+    cl::desc("Allocate the frames of single-instance coroutines statically"),
+    cl::init(true), cl::Hidden);
+
+static const char FrameMD[] = "mos.coro.frame";
+
+PreservedAnalyses MOSMarkCoroFramesPass::run(Module &M,
+                                             ModuleAnalysisManager &AM) {
+  if (!StaticCoroFrames)
+    return PreservedAnalyses::all();
+
+  FunctionAnalysisManager &FAM =
+      AM.getResult<FunctionAnalysisManagerModuleProxy>(M).getManager();
+  LLVMContext &Ctx = M.getContext();
+  bool Changed = false;
+  for (Function &F : M) {
+    if (!F.isPresplitCoroutine())
+      continue;
+    const TargetLibraryInfo &TLI = FAM.getResult<TargetLibraryAnalysis>(F);
+
+    // The coroutine, and whether it was declared to be single-instance.
+    MDNode *MD = MDNode::get(
+        Ctx, {MDString::get(Ctx, F.getName()),
+              ConstantAsMetadata::get(ConstantInt::getBool(
+                  Ctx, F.hasFnAttribute("static-coroutine")))});
+
+    for (Instruction &I : instructions(F)) {
+      const auto *II = dyn_cast<IntrinsicInst>(&I);
+      if (!II || (II->getIntrinsicID() != Intrinsic::coro_size &&
+                  II->getIntrinsicID() != Intrinsic::coro_free))
+        continue;
+      for (User *U : II->users()) {
+        auto *CB = dyn_cast<CallBase>(U);
+        if (!CB)
+          continue;
+        bool IsFrame = II->getIntrinsicID() == Intrinsic::coro_size
+                           ? isAllocationFn(CB, &TLI) &&
+                                 CB->arg_size() &&
+                                 CB->getArgOperand(0) == II
+                           : getFreedOperand(CB, &TLI) == II;
+        if (!IsFrame)
+          continue;
+        CB->setMetadata(FrameMD, MD);
+        Changed = true;
+      }
+    }
+  }
+  return Changed ? PreservedAnalyses::none() : PreservedAnalyses::all();
+}
+
+namespace {
+
+struct MOSCoroFrames : public ModulePass {
+  static char ID; // Pass identification, replacement for typeid
+
+  MOSCoroFrames() : ModulePass(ID) {
+    initializeMOSCoroFramesPass(*PassRegistry::getPassRegistry());
+  }
+
+  bool runOnModule(Module &M) override;
+};
+
+} // namespace
+
+// Returns whether I can execute at most once over the whole run of the
+// program.
+static bool runsAtMostOnce(const Instruction &I,
+                           SmallPtrSetImpl<const Function *> &Visited) {
+  const BasicBlock *BB = I.getParent();
+  if (any_of(successors(BB), [&](const BasicBlock *Succ) {
+        return isPotentiallyReachable(Succ, BB);
+      }))
+    return false;
+
+  const Function &F = *BB->getParent();
+  if (!Visited.insert(&F).second)
+    return false;
+  if (F.getName() == "main")
+    return F.use_empty();
+  if (!F.hasLocalLinkage() || !F.hasOneUse())
+    return false;
+  const auto *Call = dyn_cast<CallBase>(F.user_back());
+  return Call && Call->isCallee(&*F.use_begin()) &&
+         runsAtMostOnce(*Call, Visited);
+}
+
+// Returns whether the frame allocated by Alloc can be static.
+static bool canBeStatic(const CallBase &Alloc) {
+  if (!isa<ConstantInt>(Alloc.getArgOperand(0)))
+    return false;
+  MDNode *MD = Alloc.getMetadata(FrameMD);
+  if (mdconst::extract<ConstantInt>(MD->getOperand(1))->isOne())
+    return true;
+  SmallPtrSet<const Function *, 4> Visited;
+  return runsAtMostOnce(Alloc, Visited);
+}
+
+bool MOSCoroFrames::runOnModule(Module &M) {
+  if (!StaticCoroFrames)
+    return false;
+
+  struct Coroutine {
+    SmallVector<CallBase *> Allocs;
+    SmallVector<CallBase *> Frees;
+  };
+  MapVector<const MDString *, Coroutine> Coroutines;
+  for (Function &F : M) {
+    for (Instruction &I : instructions(F)) {
+      MDNode *MD = I.getMetadata(FrameMD);
+      auto *CB = dyn_cast<CallBase>(&I);
+      if (!MD || !CB)
+        continue;
+      Coroutine &C = Coroutines[cast<MDString>(MD->getOperand(0))];
+      (CB->getType()->isVoidTy() ? C.Frees : C.Allocs).push_back(CB);
+    }
+  }
+
+  bool Changed = false;
+  for (auto &[Name, C] : Coroutines) {
+    // All instances of a coroutine share its resume and destroy functions, so
+    // either all of its frames are static, or none are.
+    if (C.Allocs.empty())
+      continue;
+    if (!all_of(C.Allocs, [](const CallBase *A) { return canBeStatic(*A); })) {
+      for (CallBase *Alloc : C.Allocs) {
+        OptimizationRemarkEmitter ORE(Alloc->getFunction());
+        ORE.emit([&]() {
+          return OptimizationRemarkMissed(DEBUG_TYPE, "HeapCoroFrame", Alloc)
+                 << "coroutine frame is allocated on the heap, since more "
+                    "than one instance of the coroutine may be live at once";
+        });
+      }
+      continue;
+    }
+
+    for (CallBase *Alloc : C.Allocs) {
+      uint64_t Size =
+          cast<ConstantInt>(Alloc->getArgOperand(0))->getZExtValue();
+      Type *Typ = ArrayType::get(Type::getInt8Ty(M.getContext()), Size);
+      auto *Frame = new GlobalVariable(M, Typ, false,
+                                       GlobalValue::InternalLinkage,
+                                       UndefValue::get(Typ),
+                                       Name->getString() + "_cframe");
+      if (MaybeAlign A = Alloc->getRetAlign())
+        Frame->setAlignment(A);
+      LLVM_DEBUG(dbgs() << *Frame << "\n");
+      ++NumStaticCoroFrames;
+      NumStaticCoroFrameBytes += Size;
+      OptimizationRemarkEmitter ORE(Alloc->getFunction());
+      ORE.emit([&]() {
+        return OptimizationRemark(DEBUG_TYPE, "StaticCoroFrame", Alloc)
+               << "coroutine frame of " << ore::NV("Bytes", Size)
+               << " bytes allocated statically";
+      });
+
+      if (auto *Invoke = dyn_cast<InvokeInst>(Alloc))
+        Alloc = changeToCall(Invoke);
+      Alloc->replaceAllUsesWith(Frame);
+      Alloc->eraseFromParent();
+    }
+    for (CallBase *Free : C.Frees) {
+      if (auto *Invoke = dyn_cast<InvokeInst>(Free))
+        Free = changeToCall(Invoke);
+      Free->eraseFromParent();
+    }
+    Changed = true;
+  }
+  return Changed;
+}
+
+char MOSCoroFrames::ID = 0;
+
+INITIALIZE_PASS(MOSCoroFrames, DEBUG_TYPE,
+                "Allocate single-instance coroutine frames statically", false,
+                false)
+
+ModulePass *llvm::createMOSCoroFramesPass() { return new MOSCoroFrames(); }
@@ -0,0 +1,33 @@
+//===-- MOSCoroFrames.h - MOS Static Coroutine Frames -----------*- C++ -*-===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares the MOS static coroutine frame passes.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_LIB_TARGET_MOS_MOSCOROFRAMES_H
+#define LLVM_LIB_TARGET_MOS_MOSCOROFRAMES_H
+
+#include "llvm/IR/Module.h"
+#include "llvm/IR/PassManager.h"
+#include "llvm/Pass.h"
+
+namespace llvm {
+
+// Marks the frame allocations and deallocations of coroutines before they
+// are split.
+struct MOSMarkCoroFramesPass : PassInfoMixin<MOSMarkCoroFramesPass> {
+  PreservedAnalyses run(Module &M, ModuleAnalysisManager &AM);
+};
+
+// Replaces the marked allocations with static frames where possible.
+ModulePass *createMOSCoroFramesPass();
+
+} // end namespace llvm
+
+#endif // not LLVM_LIB_TARGET_MOS_MOSCOROFRAMES_H
@@ -0,0 +1,178 @@
+//===-- MOSCountDown.cpp - MOS Count Down Pass ----------------------------===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines the MOS Count Down pass.
+//
+// DEX, DEY, and DEC set Z, so a loop that counts down to zero can test for
+// termination without a compare. This pass reverses counted loops whose
+// iteration order cannot be observed, so that they run from their last
+// iteration to their first. Every induction variable then steps the other way,
+// and the loop exits once a dedicated 8-bit counter from the trip count
+// reaches zero. MOSIndexIV can then use that same counter as the index of the
+// loop's memory accesses.
+//
+// The iteration order is unobservable if the only values carried between
+// iterations are induction variables, no value computed in the loop is used
+// after it, and the loop's memory accesses have no dependences across
+// iterations.
+//===----------------------------------------------------------------------===//
+
+#include "MOSCountDown.h"
+
+#include "llvm/Analysis/LoopAccessAnalysis.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/Analysis/ScalarEvolutionExpressions.h"
+#include "llvm/IR/PatternMatch.h"
+#include "llvm/Transforms/Utils/Local.h"
+#include "llvm/Transforms/Utils/LoopUtils.h"
+#include "llvm/Transforms/Utils/ScalarEvolutionExpander.h"
+
+#define DEBUG_TYPE "mos-count-down"
+
+using namespace llvm;
+using namespace llvm::PatternMatch;
+
+// Returns whether reordering the iterations of L may change the effects of
+// its memory accesses.
+static bool hasOrderedMemory(Loop &L, LoopStandardAnalysisResults &AR) {
+  bool HasStores = false;
+  for (BasicBlock *B : L.blocks()) {
+    for (Instruction &I : *B) {
+      if (auto *SI = dyn_cast<StoreInst>(&I)) {
+        // The last iteration's store to an invariant address is the one that
+        // sticks, so it must stay last.
+        if (!SI->isSimple() || L.isLoopInvariant(SI->getPointerOperand()))
+          return true;
+        HasStores = true;
+      } else if (auto *LI = dyn_cast<LoadInst>(&I)) {
+        if (!LI->isSimple())
+          return true;
+      } else if (I.mayReadOrWriteMemory() || I.mayHaveSideEffects()) {
+        return true;
+      }
+    }
+  }
+  if (!HasStores)
+    return false;
+
+  LoopAccessInfo LAI(&L, &AR.SE, &AR.TTI, &AR.TLI, &AR.AA, &AR.DT, &AR.LI,
+                     &AR.AC);
+  if (!LAI.canVectorizeMemory() || LAI.getRuntimePointerChecking()->Need ||
+      !LAI.getStoresToInvariantAddresses().empty())
+    return true;
+  const auto *Deps = LAI.getDepChecker().getDependences();
+  if (!Deps)
+    return true;
+  return any_of(*Deps, [](const MemoryDepChecker::Dependence &D) {
+    return D.Type != MemoryDepChecker::Dependence::NoDep;
+  });
+}
+
+PreservedAnalyses MOSCountDown::run(Loop &L, LoopAnalysisManager &AM,
+                                    LoopStandardAnalysisResults &AR,
+                                    LPMUpdater &) {
+  auto &SE = AR.SE;
+
+  if (!L.isInnermost() || !L.isLoopSimplifyForm())
+    return PreservedAnalyses::all();
+  BasicBlock *Header = L.getHeader();
+  BasicBlock *Latch = L.getLoopLatch();
+  if (L.getExitingBlock() != Latch)
+    return PreservedAnalyses::all();
+  auto *BI = dyn_cast<BranchInst>(Latch->getTerminator());
+  if (!BI || !BI->isConditional())
+    return PreservedAnalyses::all();
+  // Loops that already count down to zero are left alone.
+  if (match(BI->getCondition(), m_ICmp(m_Value(), m_Zero())))
+    return PreservedAnalyses::all();
+
+  // The counter must fit into 8 bits.
+  const SCEV *BTC = SE.getBackedgeTakenCount(&L);
+  if (isa<SCEVCouldNotCompute>(BTC) || !SE.isLoopInvariant(BTC, &L) ||
+      SE.getUnsignedRangeMax(BTC).uge(255))
+    return PreservedAnalyses::all();
+
+  LLVM_DEBUG(dbgs() << "Considering: " << L << "BTC: " << *BTC << "\n");
+
+  // Only induction variables may be carried from one iteration to the next.
+  SmallVector<std::pair<PHINode *, const SCEVAddRecExpr *>> IVs;
+  for (PHINode &PN : Header->phis()) {
+    if (!SE.isSCEVable(PN.getType()))
+      return PreservedAnalyses::all();
+    const auto *R = dyn_cast<SCEVAddRecExpr>(SE.getSCEV(&PN));
+    if (!R || R->getLoop() != &L || !R->isAffine())
+      return PreservedAnalyses::all();
+    IVs.emplace_back(&PN, R);
+  }
+
+  // Nothing in the loop may be used after it, since those uses would see the
+  // values of the first iteration rather than the last.
+  for (BasicBlock *B : L.blocks())
+    for (Instruction &I : *B)
+      for (const User *U : I.users())
+        if (!L.contains(cast<Instruction>(U)))
+          return PreservedAnalyses::all();
+
+  if (hasOrderedMemory(L, AR)) {
+    LLVM_DEBUG(dbgs() << "Iteration order is observable.\n");
+    return PreservedAnalyses::all();
+  }
+
+  LLVM_DEBUG(dbgs() << "Reversing loop.\n");
+
+  const DataLayout &DL = Header->getModule()->getDataLayout();
+  SCEVExpander Rewriter(SE, DL, "mos-count-down");
+  // Expand the reversed IVs as recurrences of their own, rather than as
+  // functions of a canonical IV.
+  Rewriter.disableCanonicalMode();
+
+  // Each IV starts where it would have ended and steps the other way.
+  SmallVector<std::pair<PHINode *, Value *>> Replacements;
+  for (const auto &[PN, R] : IVs) {
+    const SCEV *Step = R->getStepRecurrence(SE);
+    const SCEV *Last = SE.getAddExpr(
+        R->getStart(),
+        SE.getMulExpr(SE.getTruncateOrZeroExtend(BTC, Step->getType()), Step));
+    const SCEV *Reversed = SE.getAddRecExpr(Last, SE.getNegativeSCEV(Step), &L,
+                                            SCEV::FlagAnyWrap);
+    Replacements.emplace_back(
+        PN, Rewriter.expandCodeFor(Reversed, PN->getType(),
+                                   Header->getFirstInsertionPt()));
+  }
+
+  // The counter runs from the trip count down to one, and the loop exits once
+  // its decrement reaches zero.
+  Type *I8 = Type::getInt8Ty(SE.getContext());
+  const SCEV *TripCount =
+      SE.getAddExpr(SE.getTruncateOrZeroExtend(BTC, I8), SE.getOne(I8));
+  const SCEV *Counter =
+      SE.getAddRecExpr(TripCount, SE.getMinusOne(I8), &L, SCEV::FlagAnyWrap);
+  Rewriter.setPostInc({&L});
+  Value *Next = Rewriter.expandCodeFor(Counter, I8, BI);
+  Rewriter.clearPostInc();
+
+  SE.forgetLoop(&L);
+
+  Value *OldCond = BI->getCondition();
+  IRBuilder<> Builder(BI);
+  BI->setCondition(BI->getSuccessor(0) == Header
+                       ? Builder.CreateICmpNE(Next, ConstantInt::get(I8, 0))
+                       : Builder.CreateICmpEQ(Next, ConstantInt::get(I8, 0)));
+  RecursivelyDeleteTriviallyDeadInstructions(OldCond);
+
+  for (const auto &[PN, V] : Replacements) {
+    PN->replaceAllUsesWith(V);
+    Value *Incoming = PN->getIncomingValueForBlock(Latch);
+    PN->eraseFromParent();
+    RecursivelyDeleteTriviallyDeadInstructions(Incoming);
+  }
+
+  auto PA = getLoopPassPreservedAnalyses();
+  PA.preserveSet<CFGAnalyses>();
+  return PA;
+}
@@ -0,0 +1,248 @@
+//===-- MOSEvalCtors.cpp - MOS Link-Time Constructor Evaluation -----------===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines the MOS link-time constructor evaluation pass.
+//
+// Static constructors run from .init_array at startup, and their code stays in
+// the image. GlobalOpt evaluates the constructors it can early in LTO, but
+// many only become evaluable once LTO has inlined into and simplified them.
+// This pass runs the same evaluator again at the end of LTO, when the whole
+// program has been optimized.
+//
+// C++ constructors of objects with destructors also register the destructors
+// with __cxa_atexit, which the evaluator can't run. When such a registration
+// runs exactly once in the constructor, with constant arguments, the rest of
+// the constructor is evaluated without it, and the constructor is reduced to
+// just the registrations. This keeps the order of registration, and thus of
+// destruction, since the constructor keeps its place among the others.
+//
+// A constructor that can't be evaluated, and any later constructor that might
+// observe its effects, still runs at startup. Each is reported with an
+// optimization remark naming the instruction that couldn't be evaluated.
+//
+//===----------------------------------------------------------------------===//
+
+#include "MOSEvalCtors.h"
+
+#include "llvm/ADT/SetVector.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/OptimizationRemarkEmitter.h"
+#include "llvm/Analysis/TargetLibraryInfo.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/CtorUtils.h"
+#include "llvm/Transforms/Utils/Evaluator.h"
+#include <optional>
+
+#define DEBUG_TYPE "mos-eval-ctors"
+
+STATISTIC(NumCtorsEvaluated, "Number of static constructors evaluated");
+STATISTIC(NumCtorsReduced, "Number of static constructors reduced to "
+                           "destructor registrations");
+
+using namespace llvm;
+
+namespace {
+
+enum class EvalResult { Failed, Evaluated, Reduced };
+
+// A call to __cxa_atexit, kept to be made again.
+struct AtExitCall {
+  FunctionCallee Callee;
+  SmallVector<Value *> Args;
+  AttributeList Attrs;
+  CallingConv::ID CC;
+};
+
+} // namespace
+
+// Returns the calls to __cxa_atexit in F, in the order they're made, if each
+// runs exactly once with constant arguments and an unused result. Returns
+// std::nullopt otherwise. The SDK provides __cxa_atexit, but TLI doesn't know
+// it as a library function on MOS, so it's found by name.
+static std::optional<SmallVector<CallInst *>>
+getAtExitCalls(Function &F, const DominatorTree &DT, const LoopInfo &LI) {
+  SmallVector<const BasicBlock *> Returns;
+  for (const BasicBlock &BB : F)
+    if (isa<ReturnInst>(BB.getTerminator()))
+      Returns.push_back(&BB);
+
+  SmallVector<CallInst *> Calls;
+  for (BasicBlock &BB : F) {
+    for (Instruction &I : BB) {
+      auto *CI = dyn_cast<CallInst>(&I);
+      if (!CI || !CI->getCalledFunction() ||
+          CI->getCalledFunction()->getName() != "__cxa_atexit")
+        continue;
+      if (!CI->use_empty() || LI.getLoopFor(&BB) ||
+          !all_of(Returns,
+                  [&](const BasicBlock *R) { return DT.dominates(&BB, R); }) ||
+          !all_of(CI->args(), [](const Use &U) { return isa<Constant>(U); }))
+        return std::nullopt;
+      Calls.push_back(CI);
+    }
+  }
+  // Each call runs on every path, so they are ordered by dominance.
+  llvm::sort(Calls, [&](const CallInst *A, const CallInst *B) {
+    return A != B && DT.dominates(A, B);
+  });
+  return Calls;
+}
+
+static void reportFailure(Function &F, const Instruction *I) {
+  OptimizationRemarkEmitter ORE(&F);
+  ORE.emit([&]() {
+    OptimizationRemarkMissed R(DEBUG_TYPE, "CtorNotEvaluated",
+                               I ? I->getDebugLoc() : DebugLoc(),
+                               &F.getEntryBlock());
+    R << "static constructor " << ore::NV("Function", &F)
+      << " runs at startup, since it could not be evaluated at link time";
+    if (!I)
+      return R;
+    R << ": cannot evaluate " << ore::NV("Inst", StringRef(I->getOpcodeName()));
+    if (const auto *CB = dyn_cast<CallBase>(I))
+      if (const Function *Callee = CB->getCalledFunction())
+        R << " of " << ore::NV("Callee", Callee);
+    return R;
+  });
+}
+
+static EvalResult evaluate(Function &F, const DataLayout &DL,
+                           FunctionAnalysisManager &FAM) {
+  if (F.isDeclaration())
+    return EvalResult::Failed;
+  const TargetLibraryInfo &TLI = FAM.getResult<TargetLibraryAnalysis>(F);
+
+  // Only a constructor called from nowhere else can be reduced.
+  SmallVector<CallInst *> AtExits;
+  if (F.hasOneUse()) {
+    if (std::optional<SmallVector<CallInst *>> Calls =
+            getAtExitCalls(F, FAM.getResult<DominatorTreeAnalysis>(F),
+                           FAM.getResult<LoopAnalysis>(F)))
+      AtExits = std::move(*Calls);
+  }
+
+  Function *Body = &F;
+  if (!AtExits.empty()) {
+    ValueToValueMapTy VMap;
+    Body = CloneFunction(&F, VMap);
+    for (CallInst *CI : AtExits)
+      cast<Instruction>(VMap[CI])->eraseFromParent();
+  }
+
+  Evaluator Eval(DL, &TLI);
+  Constant *RetVal;
+  bool Success = Eval.EvaluateFunction(Body, RetVal, {});
+  if (!Success) {
+    // The clone is a copy without the registrations, so note the instruction
+    // by its location alone.
+    reportFailure(F, Eval.getLastInstruction());
+    if (Body != &F)
+      Body->eraseFromParent();
+    return EvalResult::Failed;
+  }
+
+  LLVM_DEBUG(dbgs() << "Evaluated " << F.getName() << " to "
+                    << Eval.getMutatedInitializers().size() << " stores\n");
+  for (const auto &[GV, Init] : Eval.getMutatedInitializers())
+    GV->setInitializer(Init);
+  for (GlobalVariable *GV : Eval.getInvariants())
+    GV->setConstant(true);
+
+  OptimizationRemarkEmitter ORE(&F);
+  if (AtExits.empty()) {
+    ++NumCtorsEvaluated;
+    ORE.emit([&]() {
+      return OptimizationRemark(DEBUG_TYPE, "CtorEvaluated", &F)
+             << "static constructor " << ore::NV("Function", &F)
+             << " evaluated at link time";
+    });
+    return EvalResult::Evaluated;
+  }
+
+  Body->eraseFromParent();
+  SmallVector<AtExitCall> Calls;
+  for (CallInst *CI : AtExits)
+    Calls.push_back({FunctionCallee(CI->getFunctionType(),
+                                    CI->getCalledOperand()),
+                     SmallVector<Value *>(CI->args()), CI->getAttributes(),
+                     CI->getCallingConv()});
+  GlobalValue::LinkageTypes Linkage = F.getLinkage();
+  F.deleteBody();
+  F.setLinkage(Linkage);
+  IRBuilder<> Builder(BasicBlock::Create(F.getContext(), "", &F));
+  for (const AtExitCall &Call : Calls) {
+    CallInst *CI = Builder.CreateCall(Call.Callee, Call.Args);
+    CI->setAttributes(Call.Attrs);
+    CI->setCallingConv(Call.CC);
+  }
+  Builder.CreateRetVoid();
+  FAM.invalidate(F, PreservedAnalyses::none());
+
+  ++NumCtorsReduced;
+  ORE.emit([&]() {
+    return OptimizationRemark(DEBUG_TYPE, "CtorReduced", &F)
+           << "static constructor " << ore::NV("Function", &F)
+           << " evaluated at link time, except for registering "
+           << ore::NV("NumDestructors", unsigned(Calls.size()))
+           << " destructors";
+  });
+  return EvalResult::Reduced;
+}
+
+PreservedAnalyses MOSEvalCtorsPass::run(Module &M, ModuleAnalysisManager &AM) {
+  FunctionAnalysisManager &FAM =
+      AM.getResult<FunctionAnalysisManagerModuleProxy>(M).getManager();
+  const DataLayout &DL = M.getDataLayout();
+
+  // A constructor that isn't evaluated may observe the effects of those of
+  // its priority, but no constructor of a later priority can be evaluated
+  // before it.
+  std::optional<uint32_t> FirstFailedPriority;
+  SmallSetVector<Function *, 8> Evaluated;
+  bool Reduced = false;
+  auto ShouldRemove = [&](uint32_t Priority, Function *F) {
+    if (FirstFailedPriority && *FirstFailedPriority != Priority) {
+      OptimizationRemarkEmitter ORE(F);
+      ORE.emit([&]() {
+        return OptimizationRemarkMissed(DEBUG_TYPE, "CtorNotEvaluated", F)
+               << "static constructor " << ore::NV("Function", F)
+               << " runs at startup, after one that could not be evaluated "
+                  "at link time";
+      });
+      return false;
+    }
+    switch (evaluate(*F, DL, FAM)) {
+    case EvalResult::Failed:
+      FirstFailedPriority = Priority;
+      return false;
+    case EvalResult::Reduced:
+      Reduced = true;
+      return false;
+    case EvalResult::Evaluated:
+      Evaluated.insert(F);
+      return true;
+    }
+    llvm_unreachable("Unexpected evaluation result");
+  };
+  bool Changed = optimizeGlobalCtorsList(M, ShouldRemove) || Reduced;
+
+  // Nothing runs at the end of LTO to clean up constructors no longer run.
+  for (Function *F : Evaluated) {
+    if (!F->hasLocalLinkage() || !F->use_empty())
+      continue;
+    FAM.clear(*F, F->getName());
+    F->eraseFromParent();
+  }
+  return Changed ? PreservedAnalyses::none() : PreservedAnalyses::all();
+}
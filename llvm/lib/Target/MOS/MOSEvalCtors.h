@@ -0,0 +1,29 @@
+//===-- MOSEvalCtors.h - MOS Link-Time Constructor Evaluation ---*- C++ -*-===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares the MOS link-time constructor evaluation pass.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_LIB_TARGET_MOS_MOSEVALCTORS_H
+#define LLVM_LIB_TARGET_MOS_MOSEVALCTORS_H
+
+#include "llvm/IR/Module.h"
+#include "llvm/IR/PassManager.h"
+
+namespace llvm {
+
+// Evaluates the static constructors left once LTO has optimized them,
+// folding their effects into the initializers of the globals they construct.
+struct MOSEvalCtorsPass : PassInfoMixin<MOSEvalCtorsPass> {
+  PreservedAnalyses run(Module &M, ModuleAnalysisManager &AM);
+};
+
+} // end namespace llvm
+
+#endif // not LLVM_LIB_TARGET_MOS_MOSEVALCTORS_H
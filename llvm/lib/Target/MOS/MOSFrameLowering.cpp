@@ -14,7 +14,9 @@
 
 #include "MCTargetDesc/MOSMCTargetDesc.h"
 #include "MOS.h"
+#include "MOSCallGraphUtils.h"
 #include "MOSInstrBuilder.h"
+#include "MOSInstrCost.h"
 #include "MOSMachineFunctionInfo.h"
 #include "MOSRegisterInfo.h"
 #include "MOSSubtarget.h"
@@ -22,6 +24,7 @@
 #include "llvm/ADT/SmallSet.h"
 #include "llvm/CodeGen/GlobalISel/CallLowering.h"
 #include "llvm/CodeGen/GlobalISel/MachineIRBuilder.h"
+#include "llvm/CodeGen/LivePhysRegs.h"
 #include "llvm/CodeGen/MachineBasicBlock.h"
 #include "llvm/CodeGen/MachineFrameInfo.h"
 #include "llvm/CodeGen/MachineFunction.h"
@@ -32,6 +35,7 @@
 #include "llvm/CodeGen/TargetFrameLowering.h"
 #include "llvm/CodeGen/TargetInstrInfo.h"
 #include "llvm/CodeGen/TargetRegisterInfo.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Compiler.h"
 #include "llvm/Support/ErrorHandling.h"
 
@@ -39,6 +43,19 @@
 
 using namespace llvm;
 
+static cl::opt<bool> SPHelpers(
+    "mos-sp-helpers",
+    cl::desc("Adjust the soft stack pointer by calling shared helpers in "
+             "functions optimized for minimum size: __inc_sp and __dec_sp, "
+             "from the MOS compiler-rt builtins"),
+    cl::init(false), cl::Hidden);
+
+static cl::opt<unsigned> HardStackFrameSize(
+    "mos-hard-stack-frame",
+    cl::desc("Maximum number of bytes of a leaf function's frame to place on "
+             "the hardware stack"),
+    cl::init(4), cl::Hidden);
+
 MOSFrameLowering::MOSFrameLowering()
     : TargetFrameLowering(StackGrowsDown, /*StackAlignment=*/Align(1),
                           /*LocalAreaOffset=*/0) {}
@@ -55,6 +72,11 @@ bool MOSFrameLowering::assignCalleeSavedSpillSlots(
   MachineFrameInfo &MFI = MF.getFrameInfo();
   const auto &MOSFI = *MF.getInfo<MOSFunctionInfo>();
 
+  // Handlers marked "naked-fast" save X and Y to static stack slots, since
+  // STX/LDX absolute is cheaper than moving them through A to the hard stack.
+  bool FastSaves = isISR(MF) && usesStaticStack(MF) &&
+                   MF.getFunction().hasFnAttribute("naked-fast");
+
   size_t HardStackRemaining = 4;
   for (CalleeSavedInfo &Info : CSI) {
     // Some CSRs may be rewritten to other zero page locations at
@@ -65,6 +87,11 @@ bool MOSFrameLowering::assignCalleeSavedSpillSlots(
       continue;
     }
 
+    if (FastSaves && (Info.getReg() == MOS::X || Info.getReg() == MOS::Y)) {
+      Info.setFrameIdx(MFI.CreateSpillStackObject(1, Align()));
+      continue;
+    }
+
     // We place the first four CSRs on the hard stack, which we don't
     // explicitly model in PEI.
     if (HardStackRemaining) {
@@ -89,7 +116,10 @@ bool MOSFrameLowering::enableShrinkWrapping(const MachineFunction &MF) const {
   // time shrink wrapping occurs.  Since there's no way for shrink wrapping to
   // determine which blocks will eventually use those locations, we can't use it
   // in that case.
-  return !isISR(MF);
+  //
+  // A function with a base page of its own must switch to it before anything
+  // else touches the zero page, so its prologue must come first.
+  return !isISR(MF) && mos::getBasePage(MF.getFunction()).empty();
 }
 
 bool MOSFrameLowering::spillCalleeSavedRegisters(
@@ -212,9 +242,13 @@ void MOSFrameLowering::determineCalleeSaves(MachineFunction &MF,
                                             RegScavenger *RS) const {
   TargetFrameLowering::determineCalleeSaves(MF, SavedRegs, RS);
 
+  // The imaginary registers of a function with its own base page aren't those
+  // of its caller, so they needn't be saved.
+  bool OwnBasePage = !mos::getBasePage(MF.getFunction()).empty();
+
   // If we have a frame pointer, the frame register RS15 needs to be saved as
   // well, since the code that uses it hasn't yet been emitted.
-  if (hasFP(MF)) {
+  if (hasFP(MF) && !OwnBasePage) {
     SavedRegs.set(MOS::RC30);
     SavedRegs.set(MOS::RC31);
   }
@@ -222,8 +256,10 @@ void MOSFrameLowering::determineCalleeSaves(MachineFunction &MF,
   if (isISR(MF)) {
     // Accesses to RS8 can occur through the register scavenger, which occurs
     // after PEI. Conservatively assume these are used.
-    SavedRegs.set(MOS::RC16);
-    SavedRegs.set(MOS::RC17);
+    if (!OwnBasePage) {
+      SavedRegs.set(MOS::RC16);
+      SavedRegs.set(MOS::RC17);
+    }
 
     // We need A to save anything else. This may require in turn saving A.
     // Normally, this could be done with __save_A, but for ISRs, that location
@@ -258,6 +294,97 @@ void MOSFrameLowering::processFunctionBeforeFrameFinalized(
     }
     return;
   }
+
+  assignHardStackObjects(MF);
+}
+
+// Places small frames of leaf functions on the hardware stack, where TSX and
+// an indexed access reach them in fewer bytes and cycles than (RS0),Y. The
+// 65816 and 65EL02 address them relative to the stack pointer instead, which
+// needs no index register at all. Only leaves qualify: they come last in any
+// chain of calls, so bounding their frames bounds how much deeper into the
+// 256-byte page they can reach than their callers already do.
+void MOSFrameLowering::assignHardStackObjects(MachineFunction &MF) const {
+  MachineFrameInfo &MFI = MF.getFrameInfo();
+  const MOSSubtarget &STI = MF.getSubtarget<MOSSubtarget>();
+  const TargetRegisterInfo &TRI = *STI.getRegisterInfo();
+
+  // The HuC6280 maps the stack page elsewhere. Functions with a base page of
+  // their own push their caller's just where the frame would go.
+  if (!HardStackFrameSize || isISR(MF) || hasFP(MF) || STI.hasHUC6280() ||
+      !mos::getBasePage(MF.getFunction()).empty())
+    return;
+  const bool StackRel = STI.hasW65816Or65EL02();
+
+  // The epilogue pops the frame off into a register unused by the returns.
+  auto FreeAtReturns = [&](Register Reg) {
+    return none_of(MF, [&](const MachineBasicBlock &MBB) {
+      return MBB.isReturnBlock() && MBB.back().readsRegister(Reg, &TRI);
+    });
+  };
+  Register Release;
+  if (STI.hasGPRStackRegs() && FreeAtReturns(MOS::Y))
+    Release = MOS::Y;
+  else if (FreeAtReturns(MOS::A))
+    Release = MOS::A;
+  else if (!StackRel && FreeAtReturns(MOS::X))
+    // TSX and TXS would truncate a wider stack pointer.
+    Release = MOS::X;
+  else
+    return;
+
+  // An object qualifies if it's only ever loaded or stored outside of frame
+  // setup and teardown, while X is free for TSX (if needed). The hardware
+  // stack pointer must also stay put outside of the prologue and epilogue.
+  BitVector Bad(MFI.getObjectIndexEnd());
+  LivePhysRegs LiveRegs(TRI);
+  for (MachineBasicBlock &MBB : MF) {
+    LiveRegs.init(TRI);
+    LiveRegs.addLiveOuts(MBB);
+    for (MachineInstr &MI : reverse(MBB)) {
+      if (MI.isCall())
+        return;
+      bool IsFrameSetupOrDestroy = MI.getFlag(MachineInstr::FrameSetup) ||
+                                   MI.getFlag(MachineInstr::FrameDestroy);
+      if ((MI.getOpcode() == MOS::PH || MI.getOpcode() == MOS::PL) &&
+          !IsFrameSetupOrDestroy)
+        return;
+      for (const MachineOperand &MO : MI.operands()) {
+        if (!MO.isFI() || MO.getIndex() < 0)
+          continue;
+        bool IsLoad = MI.getOpcode() == MOS::LDStk;
+        bool OK = !IsFrameSetupOrDestroy &&
+                  (IsLoad || MI.getOpcode() == MOS::STStk) &&
+                  MO.getOperandNo() == 2 &&
+                  (StackRel ||
+                   (MI.getOperand(IsLoad ? 0 : 1).getReg() != MOS::X &&
+                    !LiveRegs.contains(MOS::X)));
+        if (!OK)
+          Bad.set(MO.getIndex());
+      }
+      LiveRegs.stepBackward(MI);
+    }
+  }
+
+  int64_t Offset = 0;
+  for (int Idx : seq(0, MFI.getObjectIndexEnd())) {
+    if (Bad[Idx] || MFI.isDeadObjectIndex(Idx) ||
+        MFI.isVariableSizedObjectIndex(Idx) ||
+        MFI.getStackID(Idx) != TargetStackID::Default)
+      continue;
+    int64_t Size = MFI.getObjectSize(Idx);
+    if (!Size || Offset + Size > HardStackFrameSize)
+      continue;
+    MFI.setStackID(Idx, TargetStackID::MosHardStack);
+    MFI.setObjectOffset(Idx, Offset);
+    Offset += Size;
+  }
+  if (!Offset)
+    return;
+
+  auto &MOSFI = *MF.getInfo<MOSFunctionInfo>();
+  MOSFI.HardStackSize = Offset;
+  MOSFI.HardStackReleaseReg = Release;
 }
 
 MachineBasicBlock::iterator MOSFrameLowering::eliminateCallFramePseudoInstr(
@@ -291,18 +418,74 @@ void MOSFrameLowering::emitPrologue(MachineFunction &MF,
     if (MI.getOpcode() == MOS::CLD_Implied)
       Builder.setInsertPt(MBB, std::next(MI.getIterator()));
 
+  // The interrupted routine may be in the middle of a quad instruction
+  // sequence, so Z must be saved and given the zero the compiler assumes.
+  if (isISR(MF) && MF.getSubtarget<MOSSubtarget>().has45GS02()) {
+    Builder.buildInstr(MOS::PHZ_Implied).setMIFlag(MachineInstr::FrameSetup);
+    Builder.buildInstr(MOS::LDZ_Immediate)
+        .addImm(0)
+        .setMIFlag(MachineInstr::FrameSetup);
+  }
+
+  // A function with a base page of its own pushes its caller's once the
+  // processor registers are saved, then switches to its own before anything
+  // else touches the zero page, even the stack pointer.
+  StringRef BasePage = mos::getBasePage(MF.getFunction());
+  if (!BasePage.empty()) {
+    if (!MF.getSubtarget<MOSSubtarget>().has65CE02())
+      report_fatal_error("base page of " + MF.getName() +
+                         " requires the 65CE02's B register");
+    Builder.setInsertPt(MBB, std::find_if_not(Builder.getInsertPt(), MBB.end(),
+                                              [](const MachineInstr &MI) {
+                                                return MI.getFlag(
+                                                    MachineInstr::FrameSetup);
+                                              }));
+    Builder.buildInstr(MOS::TBA_Implied)
+        .addDef(MOS::A, RegState::Implicit)
+        .addDef(MOS::NZ, RegState::Implicit | RegState::Dead)
+        .setMIFlag(MachineInstr::FrameSetup);
+    Builder.buildInstr(MOS::PH)
+        .addUse(MOS::A, RegState::Kill)
+        .setMIFlag(MachineInstr::FrameSetup);
+    Builder.buildInstr(MOS::LDImm)
+        .addDef(MOS::A)
+        .addExternalSymbol(
+            MF.createExternalSymbolName((Twine("__bp_") + BasePage).str()),
+            MOS::MO_HI)
+        .setMIFlag(MachineInstr::FrameSetup);
+    Builder.buildInstr(MOS::TAB_Implied)
+        .addUse(MOS::A, RegState::Implicit | RegState::Kill)
+        .setMIFlag(MachineInstr::FrameSetup);
+  }
+
   int64_t StackSize = MFI.getStackSize();
   // If the interrupted routine is in the middle of decrementing its stack
   // pointer, this routine may observe a stack pointer up to 255 bytes higher
   // than its atomic value.  Accordingly, summarily decrement the SP by a page.
   // Interrupts are rarer than the the routines they interrupt, so they pay the
-  // cost of dealing with this atomicity problem.
-  if (isISR(MF))
+  // cost of dealing with this atomicity problem. Those with a base page of
+  // their own have a stack pointer of their own too.
+  if (isISR(MF) && BasePage.empty())
     StackSize += 256;
 
   if (StackSize)
     offsetSP(Builder, -StackSize);
 
+  // Reserve the hardware stack part of the frame below the callee-saved
+  // registers pushed there.
+  const auto &MOSFI = *MF.getInfo<MOSFunctionInfo>();
+  if (MOSFI.HardStackSize) {
+    auto MBBI = std::find_if_not(Builder.getInsertPt(), MBB.end(),
+                                 [](const MachineInstr &MI) {
+                                   return MI.getFlag(MachineInstr::FrameSetup);
+                                 });
+    MachineIRBuilder HSBuilder(MBB, MBBI);
+    for (unsigned I = 0; I < MOSFI.HardStackSize; ++I)
+      HSBuilder.buildInstr(MOS::PH)
+          .addUse(MOS::A, RegState::Undef)
+          .setMIFlag(MachineInstr::FrameSetup);
+  }
+
   if (!hasFP(MF))
     return;
 
@@ -338,14 +521,61 @@ void MOSFrameLowering::emitEpilogue(MachineFunction &MF,
     Builder.setInsertPt(MBB, MBB.getFirstTerminator());
   }
 
+  // A function with a base page of its own restores its caller's after it's
+  // done with the zero page, but before the processor registers are restored.
+  StringRef BasePage = mos::getBasePage(MF.getFunction());
+  if (!BasePage.empty())
+    Builder.setInsertPt(
+        MBB, MachineBasicBlock::iterator(
+                 find_if_not(mbb_reverse(MBB.begin(), Builder.getInsertPt()),
+                             [](const MachineInstr &MI) {
+                               return MI.getFlag(MachineInstr::FrameDestroy);
+                             })));
+
+  const auto &MOSFI = *MF.getInfo<MOSFunctionInfo>();
+  if (MOSFI.HardStackSize) {
+    // Discard the hardware stack part of the frame before the callee-saved
+    // registers below it are pulled.
+    auto MBBI = find_if_not(mbb_reverse(MBB.begin(), MBB.getFirstTerminator()),
+                            [](const MachineInstr &MI) {
+                              return MI.getFlag(MachineInstr::FrameDestroy);
+                            });
+    MachineIRBuilder HSBuilder(MBB, MachineBasicBlock::iterator(MBBI));
+    discardHardStack(HSBuilder, MOSFI.HardStackSize,
+                     MOSFI.HardStackReleaseReg);
+  }
+
   int64_t StackSize = MFI.getStackSize();
 
-  if (isISR(MF))
+  if (isISR(MF) && BasePage.empty())
     StackSize += 256;
 
-  // If soft stack is used, increase the soft stack pointer SP.
-  if (StackSize)
+  // If soft stack is used, increase the soft stack pointer SP. Adjusting it
+  // clobbers the carry, so a result returned there is saved around it.
+  if (StackSize) {
+    bool SaveCarry = MBB.getFirstTerminator() != MBB.end() &&
+                     MBB.getFirstTerminator()->readsRegister(MOS::C, &TRI);
+    if (SaveCarry)
+      Builder.buildInstr(MOS::PH, {}, {Register(MOS::P)})
+          .setMIFlag(MachineInstr::FrameDestroy);
     offsetSP(Builder, StackSize);
+    if (SaveCarry)
+      Builder.buildInstr(MOS::PL, {Register(MOS::P)}, {})
+          .setMIFlag(MachineInstr::FrameDestroy);
+  }
+
+  if (!BasePage.empty()) {
+    Builder.buildInstr(MOS::PL)
+        .addDef(MOS::A)
+        .setMIFlag(MachineInstr::FrameDestroy);
+    Builder.buildInstr(MOS::TAB_Implied)
+        .addUse(MOS::A, RegState::Implicit | RegState::Kill)
+        .setMIFlag(MachineInstr::FrameDestroy);
+    Builder.setInsertPt(MBB, MBB.getFirstTerminator());
+  }
+
+  if (isISR(MF) && MF.getSubtarget<MOSSubtarget>().has45GS02())
+    Builder.buildInstr(MOS::PLZ_Implied).setMIFlag(MachineInstr::FrameDestroy);
 }
 
 uint64_t MOSFrameLowering::staticSize(const MachineFrameInfo &MFI) const {
@@ -356,6 +586,31 @@ uint64_t MOSFrameLowering::staticSize(const MachineFrameInfo &MFI) const {
   return Size;
 }
 
+StackOffset
+MOSFrameLowering::getFrameIndexReference(const MachineFunction &MF, int FI,
+                                         Register &FrameReg) const {
+  const MachineFrameInfo &MFI = MF.getFrameInfo();
+  switch (MFI.getStackID(FI)) {
+  default:
+    return TargetFrameLowering::getFrameIndexReference(MF, FI, FrameReg);
+  case TargetStackID::MosHardStack:
+    // The hardware stack pointer points just below the frame, as in
+    // MOSRegisterInfo::eliminateFrameIndex. Outside of the 65816 and 65EL02,
+    // it's only the low byte of an address in the stack page.
+    FrameReg = MOS::S;
+    return StackOffset::getFixed(
+        (MF.getSubtarget<MOSSubtarget>().hasW65816Or65EL02() ? 1 : 0x101) +
+        MFI.getObjectOffset(FI));
+  case TargetStackID::MosStatic:
+  case TargetStackID::MosZeroPage:
+    // These frames are at fixed addresses, which no register holds. The debug
+    // info locates them relative to the frame symbol given by
+    // MOSAsmPrinter::getFunctionFrameSymbol instead.
+    FrameReg = MOS::NoRegister;
+    return StackOffset::getFixed(MFI.getObjectOffset(FI));
+  }
+}
+
 bool MOSFrameLowering::hasFPImpl(const MachineFunction &MF) const {
   const MachineFrameInfo &MFI = MF.getFrameInfo();
   return MFI.isFrameAddressTaken() || MFI.hasVarSizedObjects();
@@ -369,6 +624,26 @@ void MOSFrameLowering::offsetSP(MachineIRBuilder &Builder,
   if (Offset > SHRT_MAX)
     report_fatal_error("Stack pointer increment too large: " + Twine(Offset));
 
+  // With -mos-sp-helpers, small adjustments in functions optimized for minimum
+  // size call __inc_sp or __dec_sp instead, which add A to or subtract A from
+  // RS0, clobbering only the flags. This takes five bytes instead of thirteen.
+  // The choice is made separately at each adjustment, so shrink-wrapped and
+  // call frame adjustments are handled alike.
+  if (SPHelpers && Offset >= -255 && Offset <= 255 &&
+      MOSInstrCost::getModeFor(Builder.getMF()) ==
+          MOSInstrCost::Mode::PreferBytes) {
+    Register A = Builder.getMRI()->createVirtualRegister(&MOS::AcRegClass);
+    Register P = Builder.getMRI()->createVirtualRegister(&MOS::PcRegClass);
+    Builder.buildInstr(MOS::LDImm, {A}, {std::abs(Offset)});
+    Builder.buildInstr(MOS::JSR)
+        .addExternalSymbol(Offset < 0 ? "__dec_sp" : "__inc_sp")
+        .addUse(A, RegState::Implicit | RegState::Kill)
+        .addUse(MOS::RS0, RegState::Implicit)
+        .addDef(MOS::RS0, RegState::Implicit)
+        .addDef(P, RegState::Implicit | RegState::Dead);
+    return;
+  }
+
   auto Bytes = static_cast<uint16_t>(Offset);
   int64_t LoBytes = Bytes & 0xFF;
   int64_t HiBytes = Bytes >> 8;
@@ -399,6 +674,31 @@ void MOSFrameLowering::offsetSP(MachineIRBuilder &Builder,
   Builder.buildCopy(MOS::RC1, A);
 }
 
+void MOSFrameLowering::discardHardStack(MachineIRBuilder &Builder,
+                                        unsigned Size, Register Via) const {
+  if (Via != MOS::X) {
+    for (unsigned I = 0; I < Size; ++I)
+      Builder.buildInstr(MOS::PL)
+          .addDef(Via, RegState::Dead)
+          .setMIFlag(MachineInstr::FrameDestroy);
+    return;
+  }
+
+  Builder.buildInstr(MOS::TSX_Implied)
+      .addDef(MOS::X, RegState::Implicit)
+      .addDef(MOS::NZ, RegState::Implicit | RegState::Dead)
+      .setMIFlag(MachineInstr::FrameDestroy);
+  for (unsigned I = 0; I < Size; ++I)
+    Builder.buildInstr(MOS::INX_Implied)
+        .addDef(MOS::X, RegState::Implicit)
+        .addDef(MOS::NZ, RegState::Implicit | RegState::Dead)
+        .addUse(MOS::X, RegState::Implicit)
+        .setMIFlag(MachineInstr::FrameDestroy);
+  Builder.buildInstr(MOS::TXS_Implied)
+      .addUse(MOS::X, RegState::Implicit | RegState::Kill)
+      .setMIFlag(MachineInstr::FrameDestroy);
+}
+
 bool MOSFrameLowering::isISR(const MachineFunction &MF) const {
   const Function &F = MF.getFunction();
   if (F.hasFnAttribute("no-isr"))
@@ -57,6 +57,9 @@ public:
   void emitPrologue(MachineFunction &MF, MachineBasicBlock &MBB) const override;
   void emitEpilogue(MachineFunction &MF, MachineBasicBlock &MBB) const override;
 
+  StackOffset getFrameIndexReference(const MachineFunction &MF, int FI,
+                                     Register &FrameReg) const override;
+
   // Computes the size of the static stack.
   uint64_t staticSize(const MachineFrameInfo &MFI) const;
 
@@ -67,6 +70,12 @@ private:
   bool hasFPImpl(const MachineFunction &MF) const override;
 
   void offsetSP(MachineIRBuilder &Builder, int64_t Offset) const;
+
+  void assignHardStackObjects(MachineFunction &MF) const;
+
+  // Pops Size bytes off the hardware stack, clobbering Via.
+  void discardHardStack(MachineIRBuilder &Builder, unsigned Size,
+                        Register Via) const;
 };
 
 } // namespace llvm
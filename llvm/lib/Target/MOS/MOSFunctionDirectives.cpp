@@ -0,0 +1,184 @@
+//===-- MOSFunctionDirectives.cpp - MOS Function Directives ---------------===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines the MOS function directives pass.
+//
+// With -mos-function-directives=<file>, the optimization decisions for
+// individual functions are read from a YAML file, as written by
+// utils/mos-tune, and applied to the functions of the module as attributes
+// before anything is optimized. The file is a sequence of entries:
+//
+//   - function:    main_loop
+//     mode:        cycles      # or average, or bytes
+//     inline:      never       # or always
+//     unroll:      false
+//     zp-priority: 4
+//
+// The mode selects between -O2, -Os, and -Oz behaviour for the function, as
+// the optsize and minsize attributes would. Inlining becomes alwaysinline or
+// noinline. An unroll of false keeps the function's loops rolled, through the
+// mos-no-unroll attribute. A zero page priority scales the benefit that zero
+// page allocation sees in the function's candidates, through the
+// mos-zp-priority attribute. Every field but the function name is optional,
+// and functions the module does not define are ignored, so one file can serve
+// every translation unit of a program.
+//
+//===----------------------------------------------------------------------===//
+
+#include "MOSFunctionDirectives.h"
+
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/IR/Function.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/YAMLTraits.h"
+#include <optional>
+
+#define DEBUG_TYPE "mos-function-directives"
+
+using namespace llvm;
+
+static cl::opt<std::string> DirectivesFile(
+    "mos-function-directives",
+    cl::desc("Read per-function optimization directives from a YAML file"),
+    cl::value_desc("file"), cl::Hidden);
+
+namespace {
+
+enum class DirectiveMode { Default, Cycles, Average, Bytes };
+enum class DirectiveInline { Default, Always, Never };
+
+struct FunctionDirective {
+  std::string Function;
+  DirectiveMode Mode = DirectiveMode::Default;
+  DirectiveInline Inline = DirectiveInline::Default;
+  std::optional<bool> Unroll;
+  std::optional<unsigned> ZPPriority;
+};
+
+} // namespace
+
+LLVM_YAML_IS_SEQUENCE_VECTOR(FunctionDirective)
+
+namespace llvm {
+namespace yaml {
+
+template <> struct ScalarEnumerationTraits<DirectiveMode> {
+  static void enumeration(IO &IO, DirectiveMode &Mode) {
+    IO.enumCase(Mode, "default", DirectiveMode::Default);
+    IO.enumCase(Mode, "cycles", DirectiveMode::Cycles);
+    IO.enumCase(Mode, "average", DirectiveMode::Average);
+    IO.enumCase(Mode, "bytes", DirectiveMode::Bytes);
+  }
+};
+
+template <> struct ScalarEnumerationTraits<DirectiveInline> {
+  static void enumeration(IO &IO, DirectiveInline &Inline) {
+    IO.enumCase(Inline, "default", DirectiveInline::Default);
+    IO.enumCase(Inline, "always", DirectiveInline::Always);
+    IO.enumCase(Inline, "never", DirectiveInline::Never);
+  }
+};
+
+template <> struct MappingTraits<FunctionDirective> {
+  static void mapping(IO &IO, FunctionDirective &D) {
+    IO.mapRequired("function", D.Function);
+    IO.mapOptional("mode", D.Mode, DirectiveMode::Default);
+    IO.mapOptional("inline", D.Inline, DirectiveInline::Default);
+    IO.mapOptional("unroll", D.Unroll);
+    IO.mapOptional("zp-priority", D.ZPPriority);
+  }
+};
+
+} // namespace yaml
+} // namespace llvm
+
+static std::vector<FunctionDirective> readDirectives(StringRef Filename) {
+  ErrorOr<std::unique_ptr<MemoryBuffer>> Buffer =
+      MemoryBuffer::getFile(Filename, /*IsText=*/true);
+  if (!Buffer)
+    report_fatal_error("cannot read -mos-function-directives file " +
+                       Filename + ": " + Buffer.getError().message());
+  std::vector<FunctionDirective> Directives;
+  yaml::Input In((*Buffer)->getBuffer());
+  In >> Directives;
+  if (In.error())
+    report_fatal_error("invalid -mos-function-directives file " + Filename);
+  return Directives;
+}
+
+static bool apply(Function &F, const FunctionDirective &D) {
+  // Optimization directives would contradict optnone.
+  if (F.hasOptNone())
+    return false;
+  LLVM_DEBUG(dbgs() << "Applying directives to " << F.getName() << "\n");
+
+  switch (D.Mode) {
+  case DirectiveMode::Default:
+    break;
+  case DirectiveMode::Cycles:
+    F.removeFnAttr(Attribute::MinSize);
+    F.removeFnAttr(Attribute::OptimizeForSize);
+    break;
+  case DirectiveMode::Average:
+    F.removeFnAttr(Attribute::MinSize);
+    F.addFnAttr(Attribute::OptimizeForSize);
+    break;
+  case DirectiveMode::Bytes:
+    F.addFnAttr(Attribute::MinSize);
+    F.addFnAttr(Attribute::OptimizeForSize);
+    break;
+  }
+
+  switch (D.Inline) {
+  case DirectiveInline::Default:
+    break;
+  case DirectiveInline::Always:
+    F.removeFnAttr(Attribute::NoInline);
+    F.addFnAttr(Attribute::AlwaysInline);
+    break;
+  case DirectiveInline::Never:
+    F.removeFnAttr(Attribute::AlwaysInline);
+    F.addFnAttr(Attribute::NoInline);
+    break;
+  }
+
+  if (D.Unroll) {
+    if (*D.Unroll)
+      F.removeFnAttr("mos-no-unroll");
+    else
+      F.addFnAttr("mos-no-unroll");
+  }
+  if (D.ZPPriority)
+    F.addFnAttr("mos-zp-priority", utostr(*D.ZPPriority));
+  return true;
+}
+
+PreservedAnalyses MOSFunctionDirectivesPass::run(Module &M,
+                                                 ModuleAnalysisManager &AM) {
+  if (DirectivesFile.empty())
+    return PreservedAnalyses::all();
+
+  StringMap<const FunctionDirective *> ByName;
+  std::vector<FunctionDirective> Directives = readDirectives(DirectivesFile);
+  for (const FunctionDirective &D : Directives)
+    ByName[D.Function] = &D;
+
+  bool Changed = false;
+  for (Function &F : M) {
+    if (F.isDeclaration())
+      continue;
+    auto It = ByName.find(F.getName());
+    if (It != ByName.end())
+      Changed |= apply(F, *It->second);
+  }
+  return Changed ? PreservedAnalyses::none() : PreservedAnalyses::all();
+}
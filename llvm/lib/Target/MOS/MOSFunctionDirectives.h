@@ -0,0 +1,27 @@
+//===-- MOSFunctionDirectives.h - MOS Function Directives -------*- C++ -*-===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares the MOS function directives pass.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_LIB_TARGET_MOS_MOSFUNCTIONDIRECTIVES_H
+#define LLVM_LIB_TARGET_MOS_MOSFUNCTIONDIRECTIVES_H
+
+#include "llvm/IR/Module.h"
+#include "llvm/IR/PassManager.h"
+
+namespace llvm {
+
+struct MOSFunctionDirectivesPass : PassInfoMixin<MOSFunctionDirectivesPass> {
+  PreservedAnalyses run(Module &M, ModuleAnalysisManager &AM);
+};
+
+} // end namespace llvm
+
+#endif // not LLVM_LIB_TARGET_MOS_MOSFUNCTIONDIRECTIVES_H
@@ -15,27 +15,39 @@
 
 #include "llvm/ADT/StringSwitch.h"
 #include "llvm/CodeGen/CallingConvLower.h"
+#include "llvm/CodeGen/GlobalISel/GISelValueTracking.h"
 #include "llvm/CodeGen/GlobalISel/MachineIRBuilder.h"
+#include "llvm/CodeGen/GlobalISel/Utils.h"
 #include "llvm/CodeGen/LivePhysRegs.h"
 #include "llvm/CodeGen/MachineBasicBlock.h"
 #include "llvm/CodeGen/MachineFrameInfo.h"
 #include "llvm/CodeGen/MachineInstrBuilder.h"
+#include "llvm/CodeGen/MachineLoopInfo.h"
 #include "llvm/CodeGen/MachineRegisterInfo.h"
 #include "llvm/CodeGen/SelectionDAG.h"
 #include "llvm/CodeGen/TargetLoweringObjectFileImpl.h"
 #include "llvm/IR/Function.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/KnownBits.h"
 
 #include "MCTargetDesc/MOSMCTargetDesc.h"
 #include "MOS.h"
 #include "MOSInstrBuilder.h"
 #include "MOSInstrInfo.h"
+#include "MOSPageAlign.h"
 #include "MOSRegisterInfo.h"
 #include "MOSSubtarget.h"
 #include "MOSTargetMachine.h"
 
 using namespace llvm;
 
+static cl::opt<unsigned> LocalizeMaxRegUses(
+    "mos-localize-max-reg-uses",
+    cl::desc("Maximum number of uses needing a 16-bit constant or address in a "
+             "register for it to be rematerialized in each using block"),
+    cl::init(2), cl::Hidden);
+
 MOSTargetLowering::MOSTargetLowering(const MOSTargetMachine &TM,
                                      const MOSSubtarget &STI)
     : TargetLowering(TM) {
@@ -50,6 +62,72 @@ MOSTargetLowering::MOSTargetLowering(const MOSTargetMachine &TM,
   setMaximumJumpTableSize(std::min(256u, getMaximumJumpTableSize()));
 }
 
+// Relative branches take an extra cycle when taken across a page boundary.
+// Innermost loops that fit in a page are aligned to the next power of two of
+// their size, which divides the page, so that wherever the linker places the
+// section, the loop can't cross into the next page. This also bounds the
+// alignment the section takes on, and with it the padding the linker inserts
+// before it. Padding within the section is limited to what's needed to keep
+// the loop from crossing an alignment boundary.
+//
+// Block placement asks this for every block of the loop, and aligns any of
+// them that isn't entered mostly by falling through. Padding before any block
+// but the loop's first would push the rest of the loop out of its aligned
+// span, so only loops whose other blocks are each entered just from the block
+// laid out before them are aligned.
+Align MOSTargetLowering::getPrefLoopAlignment(MachineLoop *ML) const {
+  if (!mos::avoidPageCrossings() || !ML || !ML->isInnermost())
+    return Align(1);
+  // Block placement has already laid out the function, so measure the loop
+  // from its first block to its last, including anything placed in between.
+  const MachineFunction &MF = *ML->getHeader()->getParent();
+  const TargetInstrInfo &TII = *MF.getSubtarget().getInstrInfo();
+  unsigned Size = 0;
+  unsigned BlocksLeft = ML->getNumBlocks();
+  const MachineBasicBlock *Prev = nullptr;
+  for (const MachineBasicBlock &MBB : MF) {
+    bool InLoop = ML->contains(&MBB);
+    if (BlocksLeft == ML->getNumBlocks() && !InLoop) {
+      Prev = &MBB;
+      continue;
+    }
+    if (InLoop && BlocksLeft != ML->getNumBlocks() &&
+        (MBB.pred_size() != 1 || *MBB.pred_begin() != Prev))
+      return Align(1);
+    for (const MachineInstr &MI : MBB)
+      Size += TII.getInstSizeInBytes(MI);
+    if (Size > 256)
+      return Align(1);
+    if (InLoop && !--BlocksLeft)
+      break;
+    Prev = &MBB;
+  }
+  return Size > 1 ? Align(PowerOf2Ceil(Size)) : Align(1);
+}
+
+unsigned MOSTargetLowering::getMaxPermittedBytesForAlignment(
+    MachineBasicBlock *MBB) const {
+  // The loop spans from its aligned top through the layout block that branches
+  // back to it. Padding is only worthwhile if the loop would otherwise cross
+  // the boundary, that is, if its start lies within its size of the end of the
+  // aligned block.
+  const TargetInstrInfo &TII = *MBB->getParent()->getSubtarget().getInstrInfo();
+  unsigned Size = 0;
+  for (const MachineBasicBlock &Block :
+       make_range(MBB->getIterator(), MBB->getParent()->end())) {
+    for (const MachineInstr &MI : Block)
+      Size += TII.getInstSizeInBytes(MI);
+    if (Size > MBB->getAlignment().value())
+      break;
+    if (Size > 1 && Block.isSuccessor(MBB))
+      return Size - 1;
+  }
+  // getPrefLoopAlignment only aligns the tops of loops that fit, so this isn't
+  // reached. A bound of zero would leave the padding unbounded, so allow the
+  // least padding instead.
+  return 1;
+}
+
 MVT MOSTargetLowering::getRegisterType(MVT VT) const {
   // Even though a 16-bit register is available, it's not actually an integer
   // register, so split to 8 bits instead.
@@ -223,6 +301,212 @@ bool MOSTargetLowering::isZExtFree(LLT FromTy, LLT ToTy,
   return FromTy.getScalarSizeInBits() < ToTy.getScalarSizeInBits();
 }
 
+// Returns whether the use of a 16-bit address by UseMI selects to a pair of
+// mos16lo/mos16hi immediates at the use, so no register ever holds it.
+static bool foldsAsImmediates(const MachineInstr &UseMI) {
+  return UseMI.getOpcode() == MOS::G_UNMERGE_VALUES;
+}
+
+// Returns whether a 16-bit constant or address defined by MI should be
+// rematerialized in each block that uses it. Uses that fold in its bytes as
+// immediates are free, but every other use needs the whole value in an
+// imaginary register pair, and each copy costs an LDImm16, two immediate loads
+// and two stores. Past a few of these, one register shared across blocks is
+// cheaper, and the register allocator can still rematerialize it if needed.
+static bool shouldLocalize16(const MachineInstr &MI, bool AddrFolds) {
+  const MachineRegisterInfo &MRI = MI.getMF()->getRegInfo();
+  unsigned RegUses = 0;
+  for (const MachineInstr &UseMI :
+       MRI.use_nodbg_instructions(MI.getOperand(0).getReg())) {
+    if (AddrFolds && foldsAsImmediates(UseMI))
+      continue;
+    if (++RegUses > LocalizeMaxRegUses)
+      return false;
+  }
+  return true;
+}
+
+// The generic Localizer sinks constants from the entry block into the blocks
+// that use them. On MOS, 8-bit constants nearly always fold into an immediate
+// operand (LDA #imm, ADC #imm, CMP #imm), and at worst cost a two-byte load,
+// so they're always localized. 16-bit values are localized by how many of
+// their uses need a register.
+bool MOSTargetLowering::shouldLocalize(const MachineInstr &MI,
+                                       const TargetTransformInfo *TTI) const {
+  const MachineRegisterInfo &MRI = MI.getMF()->getRegInfo();
+  switch (MI.getOpcode()) {
+  default:
+    return false;
+  case MOS::G_CONSTANT:
+    if (MRI.getType(MI.getOperand(0).getReg()).getSizeInBits() <= 8)
+      return true;
+    return shouldLocalize16(MI, /*AddrFolds=*/false);
+  case MOS::G_GLOBAL_VALUE:
+  case MOS::G_BLOCK_ADDR:
+    return shouldLocalize16(MI, /*AddrFolds=*/true);
+  case MOS::G_MERGE_VALUES: {
+    // The legalizer splits 16-bit constants into a merge of two bytes, which
+    // selects to an LDImm16 wherever the merge is.
+    for (const MachineOperand &MO : MI.uses())
+      if (!getIConstantVRegVal(MO.getReg(), MRI))
+        return false;
+    return shouldLocalize16(MI, /*AddrFolds=*/false);
+  }
+  // Frame indices and integer-to-pointer casts stay as the generic Localizer
+  // treats them.
+  case MOS::G_FRAME_INDEX:
+  case MOS::G_INTTOPTR:
+    return true;
+  }
+}
+
+// Computes the known bits of the byte R of a multi-byte G_INC or G_DEC. Each
+// byte is its source plus the carry out of the bytes below it, or less their
+// borrow. Whether a byte in memory passes on the carry is unknown.
+static void computeKnownBitsForIncDec(GISelValueTracking &VT, Register R,
+                                      KnownBits &Known,
+                                      const APInt &DemandedElts,
+                                      const MachineInstr &MI, unsigned Depth) {
+  bool IsInc = MI.getOpcode() == MOS::G_INC;
+  // Whether the increment (or decrement) reaches this byte.
+  KnownBits Carry = KnownBits::makeConstant(APInt(1, 1));
+  KnownBits Addend = KnownBits::makeConstant(
+      IsInc ? APInt::getZero(8) : APInt::getAllOnes(8));
+  unsigned DefIdx = 0;
+  for (const MachineOperand &MO : MI.explicit_uses()) {
+    if (!MO.isReg()) {
+      Carry &= KnownBits(1);
+      continue;
+    }
+    KnownBits Src = VT.getKnownBits(MO.getReg(), DemandedElts, Depth + 1);
+    if (MI.getOperand(DefIdx++).getReg() == R) {
+      // Src - B is computed as Src + 0xff + ~B.
+      KnownBits In = Carry;
+      if (!IsInc)
+        std::swap(In.Zero, In.One);
+      Known = KnownBits::computeForAddCarry(Src, Addend, In);
+      return;
+    }
+    // The carry stops at the first byte that doesn't wrap.
+    std::optional<bool> Wraps = KnownBits::eq(
+        Src, KnownBits::makeConstant(IsInc ? APInt::getAllOnes(8)
+                                           : APInt::getZero(8)));
+    Carry &= Wraps ? KnownBits::makeConstant(APInt(1, *Wraps)) : KnownBits(1);
+  }
+}
+
+void MOSTargetLowering::computeKnownBitsForTargetInstr(
+    GISelValueTracking &VT, Register R, KnownBits &Known,
+    const APInt &DemandedElts, const MachineRegisterInfo &MRI,
+    unsigned Depth) const {
+  const MachineInstr &MI = *MRI.getVRegDef(R);
+  const auto GetKnown = [&](unsigned Idx) {
+    return VT.getKnownBits(MI.getOperand(Idx).getReg(), DemandedElts,
+                           Depth + 1);
+  };
+  const auto IsDef = [&](unsigned Idx) {
+    return MI.getOperand(Idx).getReg() == R;
+  };
+
+  switch (MI.getOpcode()) {
+  default:
+    return;
+  case MOS::G_SBC: {
+    // A, C, N, V, Z = L - R - !Cin, computed as L + ~R + Cin with the carry
+    // out in the ninth bit.
+    KnownBits L = GetKnown(5);
+    KnownBits RHS = GetKnown(6);
+    KnownBits NotR = RHS;
+    std::swap(NotR.Zero, NotR.One);
+    KnownBits Sum =
+        KnownBits::computeForAddCarry(L.zext(9), NotR.zext(9), GetKnown(7));
+    KnownBits A = Sum.trunc(8);
+    if (IsDef(0)) {
+      Known = A;
+    } else if (IsDef(1)) {
+      Known = Sum.extractBits(1, 8);
+    } else if (IsDef(2)) {
+      Known = A.extractBits(1, 7);
+    } else if (IsDef(3)) {
+      // Overflow occurs if the operands differ in sign and the result differs
+      // in sign from L.
+      KnownBits LSign = L.extractBits(1, 7);
+      Known = (LSign ^ RHS.extractBits(1, 7)) & (LSign ^ A.extractBits(1, 7));
+    } else {
+      assert(IsDef(4));
+      std::optional<bool> IsZero =
+          KnownBits::eq(A, KnownBits::makeConstant(APInt::getZero(8)));
+      Known = IsZero ? KnownBits::makeConstant(APInt(1, *IsZero))
+                     : KnownBits(1);
+    }
+    return;
+  }
+  case MOS::G_SHLE: {
+    KnownBits Src = GetKnown(2);
+    Known = IsDef(0) ? Src.extractBits(7, 0).concat(GetKnown(3))
+                     : Src.extractBits(1, 7);
+    return;
+  }
+  case MOS::G_LSHRE: {
+    KnownBits Src = GetKnown(2);
+    Known = IsDef(0) ? GetKnown(3).concat(Src.extractBits(7, 1))
+                     : Src.extractBits(1, 0);
+    return;
+  }
+  case MOS::G_UMUL8: {
+    KnownBits Product =
+        KnownBits::mul(GetKnown(2).zext(16), GetKnown(3).zext(16));
+    Known = Product.extractBits(8, IsDef(0) ? 0 : 8);
+    return;
+  }
+  case MOS::G_UDIVREM8:
+    Known = IsDef(0) ? KnownBits::udiv(GetKnown(2), GetKnown(3))
+                     : KnownBits::urem(GetKnown(2), GetKnown(3));
+    return;
+  case MOS::G_CMPZ: {
+    // Set if every operand is zero.
+    Known = KnownBits::makeConstant(APInt(1, 1));
+    for (const MachineOperand &MO : MI.explicit_uses()) {
+      KnownBits Op = VT.getKnownBits(MO.getReg(), DemandedElts, Depth + 1);
+      if (Op.isNonZero())
+        Known = KnownBits::makeConstant(APInt(1, 0));
+      else if (!Op.isZero() && !Known.isZero())
+        Known = KnownBits(1);
+    }
+    return;
+  }
+  case MOS::G_INC:
+  case MOS::G_DEC:
+    computeKnownBitsForIncDec(VT, R, Known, DemandedElts, MI, Depth);
+    return;
+  }
+}
+
+unsigned MOSTargetLowering::computeNumSignBitsForTargetInstr(
+    GISelValueTracking &VT, Register R, const APInt &DemandedElts,
+    const MachineRegisterInfo &MRI, unsigned Depth) const {
+  const MachineInstr &MI = *MRI.getVRegDef(R);
+  const auto NumSignBits = [&](unsigned Idx) {
+    return VT.computeNumSignBits(MI.getOperand(Idx).getReg(), DemandedElts,
+                                 Depth + 1);
+  };
+
+  switch (MI.getOpcode()) {
+  default:
+    return 1;
+  case MOS::G_SBC:
+    // As with G_SUB, the result can only lose one sign bit to the borrow.
+    if (MI.getOperand(0).getReg() != R)
+      return 1;
+    return std::max(std::min(NumSignBits(5), NumSignBits(6)), 2u) - 1;
+  case MOS::G_SHLE:
+    // The carry in fills the low bit, leaving the rest shifted up by one.
+    if (MI.getOperand(0).getReg() != R)
+      return 1;
+    return std::max(NumSignBits(2), 2u) - 1;
+  }
+}
+
 static MachineBasicBlock *emitSelectImm(MachineInstr &MI,
                                         MachineBasicBlock *MBB);
 static MachineBasicBlock *emitIncDecMB(MachineInstr &MI,
@@ -41,6 +41,11 @@ public:
     return !Fn->getFnAttribute("no-jump-tables").getValueAsBool();
   }
 
+  Align getPrefLoopAlignment(MachineLoop *ML) const override;
+
+  unsigned
+  getMaxPermittedBytesForAlignment(MachineBasicBlock *MBB) const override;
+
   MVT getRegisterType(MVT VT) const override;
 
   unsigned
@@ -77,6 +82,20 @@ public:
 
   bool preferNarrowTypes() const override { return true; }
 
+  bool shouldLocalize(const MachineInstr &MI,
+                      const TargetTransformInfo *TTI) const override;
+
+  void computeKnownBitsForTargetInstr(GISelValueTracking &VT, Register R,
+                                      KnownBits &Known,
+                                      const APInt &DemandedElts,
+                                      const MachineRegisterInfo &MRI,
+                                      unsigned Depth = 0) const override;
+
+  unsigned computeNumSignBitsForTargetInstr(GISelValueTracking &VT, Register R,
+                                            const APInt &DemandedElts,
+                                            const MachineRegisterInfo &MRI,
+                                            unsigned Depth = 0) const override;
+
   EVT getOptimalMemOpType(LLVMContext &Context, const MemOp &Op,
                           const AttributeList &FuncAttributes) const override {
     return MVT::i8;
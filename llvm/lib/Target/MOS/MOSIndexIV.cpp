@@ -8,34 +8,55 @@
 //
 // This file defines the MOS Index IV pass.
 //
-// This pass locates GEP instructions in a loop that have SCEV's of the form
+// This pass locates pointers formed in a loop that have SCEV's of the form
 // Base + Index, where Index fits within an unsigned 8-bit integer. It creates
-// dedicated IVs for such indices, then rewrites the GEPs to use their zero
+// dedicated IVs for such indices, then rewrites the pointers to use their zero
 // extension. This allows the backend to recognize that the high byte of the
 // index is zero and to use the 8-bit indexed addressing modes if appropriate.
+// Pointers may be formed by GEPs, by pointer phis, or by integer arithmetic
+// converted with inttoptr.
+//
+// Descending recurrences are based one step past their last value, so their
+// index counts down towards zero; this pairs with MOSCountDown.
+//
+// If the step fits in 8 bits but the index doesn't, the index is instead split
+// into a low byte that wraps around and a base that advances by a page each
+// time it does. This keeps the per-iteration increment to 8 bits, with a
+// 16-bit add only once every 256 bytes. Pointers sharing a step share the low
+// byte IV.
+//
+// Each candidate pointer gets an optimization remark (-Rpass=mos-indexiv)
+// saying how it was rewritten, or why it could not be.
 //===----------------------------------------------------------------------===//
 
 #include "MOSIndexIV.h"
 #include "MOSInstrInfo.h"
 
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/OptimizationRemarkEmitter.h"
 #include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/Support/TimeProfiler.h"
 #include "llvm/Transforms/Scalar/LoopPassManager.h"
-#include "llvm/Transforms/Utils/BasicBlockUtils.h"
 #include "llvm/Transforms/Utils/LoopUtils.h"
 #include "llvm/Transforms/Utils/ScalarEvolutionExpander.h"
 
 #define DEBUG_TYPE "mos-indexiv"
 
+STATISTIC(NumByteIndexed, "Number of pointers rewritten to an 8-bit index");
+STATISTIC(NumPageIndexed, "Number of pointers split into pages");
+
 using namespace llvm;
 
 PreservedAnalyses MOSIndexIV::run(Loop &L, LoopAnalysisManager &AM,
                                   LoopStandardAnalysisResults &AR,
                                   LPMUpdater &) {
+  TimeTraceScope Scope("MOSIndexIV", L.getName());
   LLVM_DEBUG(dbgs() << "***************************** MOS INDEX IV PASS "
                        "*****************************\n");
 
   auto &SE = AR.SE;
   const DataLayout &DL = L.getHeader()->getModule()->getDataLayout();
+  OptimizationRemarkEmitter ORE(L.getHeader()->getParent());
 
   // InRange returns whether the given range can be contained within an
   // unsigned 8-bit index.
@@ -49,79 +70,183 @@ PreservedAnalyses MOSIndexIV::run(Loop &L, LoopAnalysisManager &AM,
   Type *Ptr = PointerType::get(SE.getContext(), 0);
   bool Changed = false;
 
+  // Collect the candidates up front, since rewriting inserts new instructions.
+  SmallVector<std::pair<Instruction *, const SCEVAddRecExpr *>> Candidates;
   for (BasicBlock *B : L.blocks()) {
-    for (auto I = B->begin(), E = B->end(); I != E; ++I) {
-      // For now, only direct GEP instructions are handled, but in principle,
-      // any other means of forming pointers should work as well.
-      auto *GEP = dyn_cast<GetElementPtrInst>(I);
-      if (!GEP)
+    for (Instruction &I : *B) {
+      // Only 16-bit pointer values are currently supported by this pass.
+      if (!I.getType()->isPointerTy() ||
+          I.getType()->getPointerAddressSpace() != MOS::AS_Memory)
+        continue;
+      const SCEV *S;
+      if (auto *IntToPtr = dyn_cast<IntToPtrInst>(&I))
+        S = SE.getSCEV(IntToPtr->getOperand(0));
+      else if (isa<GetElementPtrInst, PHINode>(I))
+        S = SE.getSCEV(&I);
+      else
         continue;
-      LLVM_DEBUG(dbgs() << "Considering: " << *GEP << "\n");
+      LLVM_DEBUG(dbgs() << "Considering: " << I << "\n");
 
       // Only pointer values with an additive recurrence can be made into
       // Base+Index.
-      const auto *R = dyn_cast<SCEVAddRecExpr>(SE.getSCEV(GEP));
-      if (!R || R->getLoop() != &L)
-        continue;
-      // Only 16-bit pointer values are currently supported by this pass.
-      if (R->getType()->getPointerAddressSpace() != MOS::AS_Memory)
+      const auto *R = dyn_cast<SCEVAddRecExpr>(S);
+      if (!R || R->getLoop() != &L || !R->isAffine())
         continue;
       LLVM_DEBUG(dbgs() << "SCEV: " << *R << "\n");
+      Candidates.emplace_back(&I, R);
+    }
+  }
+
+  // The low byte IV for each step of split indices, along with the amount to
+  // advance the base by on its way around the loop.
+  struct ByteIV {
+    PHINode *Lo;
+    Value *Page;
+  };
+  DenseMap<const SCEV *, ByteIV> ByteIVs;
+  BasicBlock *Preheader = L.getLoopPreheader();
+  BasicBlock *Latch = L.getLoopLatch();
+  const auto GetByteIV = [&](const SCEV *Step) -> const ByteIV & {
+    auto [It, Inserted] = ByteIVs.try_emplace(Step);
+    if (!Inserted)
+      return It->second;
 
-      // If the step doesn't fit in 8 bits, incrementing the index requires a
-      // 16-bit add, so there's no point to the optimization.
-      const auto *Step = R->getStepRecurrence(SE);
-      const auto StepRange = SE.getSignedRange(Step);
-      if (!InRange(StepRange)) {
+    SCEVExpander Rewriter(SE, DL, "mos-indexiv");
+    Value *StepVal = Rewriter.expandCodeFor(SE.getTruncateOrNoop(Step, I8), I8,
+                                            Preheader->getTerminator());
+    IRBuilder<> Builder(&L.getHeader()->front());
+    PHINode *Lo = Builder.CreatePHI(I8, 2, "lo");
+    Builder.SetInsertPoint(Latch->getTerminator());
+    Value *Next = Builder.CreateAdd(Lo, StepVal, "lo.next");
+    Type *IndexTy = DL.getIndexType(Ptr);
+    Value *Page = Builder.CreateSelect(Builder.CreateICmpULT(Next, Lo),
+                                       ConstantInt::get(IndexTy, 256),
+                                       ConstantInt::get(IndexTy, 0), "page");
+    Lo->addIncoming(ConstantInt::get(I8, 0), Preheader);
+    Lo->addIncoming(Next, Latch);
+    return It->second = {Lo, Page};
+  };
+
+  for (const auto &[I, R] : Candidates) {
+    // If the step doesn't fit in 8 bits, incrementing the index requires a
+    // 16-bit add, so there's no point to the optimization.
+    const auto *Step = R->getStepRecurrence(SE);
+    const auto StepRange = SE.getSignedRange(Step);
+    // A descending recurrence with a known trip count can instead be based one
+    // step past its last value, so that its index counts down to the magnitude
+    // of the step.
+    const SCEV *Base = R->getStart();
+    const SCEV *IndexStart = SE.getConstant(R->getType(), 0);
+    bool Descending = false;
+    if (!InRange(StepRange)) {
+      const SCEV *BTC = SE.getBackedgeTakenCount(&L);
+      if (!InRange(SE.getSignedRange(SE.getNegativeSCEV(Step))) ||
+          isa<SCEVCouldNotCompute>(BTC) || !SE.isLoopInvariant(BTC, &L) ||
+          SE.getUnsignedRangeMax(BTC).uge(255)) {
         LLVM_DEBUG(dbgs() << "Step range does not fit in 8 bits\n");
         LLVM_DEBUG(dbgs() << "Step: " << *Step << "\n");
         LLVM_DEBUG(dbgs() << "Range: " << StepRange << "\n");
+        ORE.emit([&]() {
+          return OptimizationRemarkMissed(DEBUG_TYPE, "StepTooWide", I)
+                 << "pointer not given an 8-bit index: its step does not fit "
+                    "in 8 bits";
+        });
         continue;
       }
+      const SCEV *TripCount = SE.getTruncateOrZeroExtend(
+          SE.getAddExpr(BTC, SE.getOne(BTC->getType())), Step->getType());
+      Base = SE.getAddExpr(R->getStart(), SE.getMulExpr(TripCount, Step));
+      IndexStart = SE.getMulExpr(TripCount, SE.getNegativeSCEV(Step));
+      Descending = true;
+    }
 
-      // The index must itself fit into 8 bits.
-      const auto *Index =
-          SE.getAddRecExpr(/*Start=*/SE.getConstant(R->getType(), 0), Step, &L,
-                           R->getNoWrapFlags());
-      const auto IndexRange = SE.getSignedRange(Index);
-      if (!InRange(IndexRange)) {
-        LLVM_DEBUG(dbgs() << "Index range does not fit in 8 bits\n");
-        LLVM_DEBUG(dbgs() << "Index: " << *Index << "\n");
-        LLVM_DEBUG(dbgs() << "Range: " << IndexRange << "\n");
-        continue;
-      }
+    // Phis can only be replaced by values computed after all of them.
+    Instruction *InsertPt =
+        isa<PHINode>(I) ? &*I->getParent()->getFirstInsertionPt() : I;
+    IRBuilder<> Builder(InsertPt);
+    const auto AsPointer = [&](Value *V) {
+      return V->getType()->isPointerTy() ? V : Builder.CreateIntToPtr(V, Ptr);
+    };
+
+    SCEVExpander Rewriter(SE, DL, "mos-indexiv");
+    // The IVs should be computed from already available subexpressions
+    // wherever possible. Canonical mode instead expands them fully to make
+    // them easier to analyze.
+    Rewriter.disableCanonicalMode();
 
+    // The index must itself fit into 8 bits.
+    const auto *Index =
+        SE.getAddRecExpr(IndexStart, Step, &L,
+                         Descending ? SCEV::FlagAnyWrap : R->getNoWrapFlags());
+    const auto IndexRange = SE.getSignedRange(Index);
+    Value *V;
+    if (InRange(IndexRange)) {
       // Once the step and index are both known to fit in 8 bits, we can
       // always rewrite to a 16-bit base + 8-bit index.
       LLVM_DEBUG(dbgs() << "Rewriting to 8-bit index.\n");
-      Changed = true;
+      ORE.emit([&]() {
+        return OptimizationRemark(DEBUG_TYPE, "ByteIndex", I)
+               << "pointer rewritten as a 16-bit base plus an 8-bit "
+               << (Descending ? "descending " : "") << "index";
+      });
 
-      SCEVExpander Rewriter(SE, DL, "mos-indexiv");
-      // The IVs should be computed from already available subexpressions
-      // wherever possible. Canonical mode instead expands them fully to make
-      // them easier to analyze.
-      Rewriter.disableCanonicalMode();
-
-      Rewriter.setInsertPoint(&*I);
+      ++NumByteIndexed;
+      Rewriter.setInsertPoint(InsertPt);
 
       // Get a value for the 16-bit base.
-      Value *BaseVal = Rewriter.expandCodeFor(R->getStart());
+      Value *BaseVal = Rewriter.expandCodeFor(Base);
       // Get a value for the 8-bit index.
-      Value *IndexVal = Rewriter.expandCodeFor(SE.getTruncateExpr(Index, I8));
+      Value *IndexVal = Rewriter.expandCodeFor(SE.getTruncateOrNoop(Index, I8));
 
       // Emit an "uglygep" to avoid having to find a real GEP calculation that
       // leads to the SCEV. This always works, and still preserves at least
       // some aliasing information.
-      IRBuilder<> Builder(B, I);
-      Value *V = Builder.CreateBitCast(BaseVal, Ptr);
       V = Builder.CreateGEP(
-          I8, V, Builder.CreateZExt(IndexVal, DL.getIndexType(Ptr)), "uglygep");
-      V = Builder.CreateBitCast(V, GEP->getType());
+          I8, AsPointer(BaseVal),
+          Builder.CreateZExt(IndexVal, DL.getIndexType(Ptr)), "uglygep");
+    } else {
+      LLVM_DEBUG(dbgs() << "Index range does not fit in 8 bits\n");
+      LLVM_DEBUG(dbgs() << "Index: " << *Index << "\n");
+      LLVM_DEBUG(dbgs() << "Range: " << IndexRange << "\n");
+      if (Descending || !Preheader || !Latch ||
+          !SE.isLoopInvariant(Step, &L)) {
+        ORE.emit([&]() {
+          return OptimizationRemarkMissed(DEBUG_TYPE, "IndexTooWide", I)
+                 << "pointer not given an 8-bit index: its index does not "
+                    "fit in 8 bits, and cannot be split into pages";
+        });
+        continue;
+      }
+      LLVM_DEBUG(dbgs() << "Splitting into page and 8-bit index.\n");
+      ORE.emit([&]() {
+        return OptimizationRemark(DEBUG_TYPE, "PagedIndex", I)
+               << "pointer rewritten as a page-stepping base plus a wrapping "
+                  "8-bit index";
+      });
+
+      ++NumPageIndexed;
+      const ByteIV &IV = GetByteIV(Step);
+      IRBuilder<> PreheaderBuilder(Preheader->getTerminator());
+      Value *Start = Rewriter.expandCodeFor(R->getStart(), nullptr,
+                                            Preheader->getTerminator());
+      if (!Start->getType()->isPointerTy())
+        Start = PreheaderBuilder.CreateIntToPtr(Start, Ptr);
+
+      IRBuilder<> HeaderBuilder(&L.getHeader()->front());
+      PHINode *Base = HeaderBuilder.CreatePHI(Ptr, 2, "base");
+      IRBuilder<> LatchBuilder(Latch->getTerminator());
+      Base->addIncoming(Start, Preheader);
+      Base->addIncoming(LatchBuilder.CreateGEP(I8, Base, IV.Page, "base.next"),
+                        Latch);
 
-      auto Inst = I;
-      --I;
-      ReplaceInstWithValue(Inst, V);
+      Builder.SetInsertPoint(InsertPt);
+      V = Builder.CreateGEP(I8, Base,
+                            Builder.CreateZExt(IV.Lo, DL.getIndexType(Ptr)),
+                            "uglygep");
     }
+    Changed = true;
+    I->replaceAllUsesWith(V);
+    I->eraseFromParent();
   }
 
   LLVM_DEBUG(dbgs() << "*****************************************************"
@@ -12,7 +12,12 @@
 
 #include "MOSInstrCost.h"
 
+#include "MCTargetDesc/MOSMCTargetDesc.h"
+#include "MOSSubtarget.h"
+
+#include "llvm/ADT/STLExtras.h"
 #include "llvm/IR/Function.h"
+#include "llvm/MC/MCInstrDesc.h"
 
 using namespace llvm; 
 
@@ -29,12 +34,51 @@ int64_t MOSInstrCost::value(Mode Mode) const {
   }
 }
 
-MOSInstrCost::Mode MOSInstrCost::getModeFor(const MachineFunction &MF) {
-  if (MF.getFunction().hasMinSize())
+MOSInstrCost::Mode MOSInstrCost::getModeFor(const Function &F) {
+  if (F.hasMinSize())
     return Mode::PreferBytes;
-  if (MF.getFunction().hasOptSize() || MF.getFunction().hasOptNone())
+  if (F.hasOptSize() || F.hasOptNone())
     return Mode::Average;
   return Mode::PreferCycles;
 }
 
+MOSInstrCost MOSInstrCost::get(unsigned Opcode, const MOSSubtarget &STI,
+                               bool PageCrossed) {
+  const MOS::MOSInstrCostEntry *Entry = MOS::getMOSInstrCostEntry(Opcode);
+  assert(Entry && "Missing cost table entry for opcode");
+  if (!Entry)
+    return MOSInstrCost();
+
+  bool HasPagePenalty;
+  int32_t Cycles = MOS::getTableCycles(*Entry, STI, HasPagePenalty);
+  if (PageCrossed && HasPagePenalty && Entry->PageCross)
+    ++Cycles;
+  return MOSInstrCost(Entry->Bytes, Cycles);
+}
+
+std::optional<std::pair<int32_t, int32_t>>
+MOSInstrCost::getCycleRange(const MCInstrDesc &Desc, const MOSSubtarget &STI) {
+  const MOS::MOSInstrCostEntry *Entry =
+      MOS::getMOSInstrCostEntry(Desc.getOpcode());
+  if (!Entry)
+    return std::nullopt;
+
+  bool HasPagePenalty;
+  int32_t Cycles = MOS::getTableCycles(*Entry, STI, HasPagePenalty);
+  bool IsRelative = any_of(Desc.operands(), [](const MCOperandInfo &Op) {
+    return Op.OperandType == MCOI::OPERAND_PCREL;
+  });
+  if (!IsRelative)
+    return std::make_pair(
+        Cycles, Cycles + (HasPagePenalty && Entry->PageCross ? 1 : 0));
+
+  // The table counts relative branches as taken. A taken branch to another
+  // page costs one more cycle, while a branch that falls through only fetches
+  // its operand.
+  int32_t Taken = Cycles + (HasPagePenalty ? 1 : 0);
+  if (!Desc.isConditionalBranch())
+    return std::make_pair(Cycles, Taken);
+  return std::make_pair(int32_t(Entry->Bytes), Taken);
+}
+
 } // namespace llvm
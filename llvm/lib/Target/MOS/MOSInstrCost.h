@@ -15,9 +15,14 @@
 
 #include "llvm/CodeGen/MachineFunction.h"
 #include <cstdint>
+#include <optional>
+#include <utility>
 
 namespace llvm {
 
+class MCInstrDesc;
+class MOSSubtarget;
+
 class MOSInstrCost {
 public:
   enum class Mode {
@@ -63,9 +68,29 @@ public:
     return MOSInstrCost(Left.Bytes / Right, Left.Cycles / Right, 1);
   }
 
+  int32_t getBytes() const { return Bytes; }
+  int32_t getCycles() const { return Cycles; }
+
   int64_t value(Mode Mode = Mode::Average) const;
 
-  static Mode getModeFor(const MachineFunction &MF);
+  static Mode getModeFor(const Function &F);
+  static Mode getModeFor(const MachineFunction &MF) {
+    return getModeFor(MF.getFunction());
+  }
+
+  /// Returns the size and cycle count of the real instruction Opcode on the
+  /// given subtarget, as recorded in MOSInstrInfoTables.td. If PageCrossed is
+  /// set, includes the cost of forming an indexed address across a page
+  /// boundary.
+  static MOSInstrCost get(unsigned Opcode, const MOSSubtarget &STI,
+                          bool PageCrossed = false);
+
+  /// Returns the fewest and the most cycles that the real instruction Desc
+  /// can take on the given subtarget, or std::nullopt if it has no cost table
+  /// entry. The range spans page crossings and, for conditional branches,
+  /// whether the branch is taken.
+  static std::optional<std::pair<int32_t, int32_t>>
+  getCycleRange(const MCInstrDesc &Desc, const MOSSubtarget &STI);
 
 private:
   MOSInstrCost(int32_t Bytes, int32_t Cycles, int Multiplier)
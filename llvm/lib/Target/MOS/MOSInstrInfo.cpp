@@ -15,11 +15,14 @@
 #include "MCTargetDesc/MOSMCTargetDesc.h"
 #include "MOSFrameLowering.h"
 #include "MOSInstrBuilder.h"
+#include "MOSInstrCost.h"
+#include "MOSMachineFunctionInfo.h"
 #include "MOSRegisterInfo.h"
 
 #include "MOSSubtarget.h"
 #include "llvm/ADT/BitVector.h"
 #include "llvm/ADT/SparseBitVector.h"
+#include "llvm/ADT/StringSwitch.h"
 #include "llvm/CodeGen/GlobalISel/MachineIRBuilder.h"
 #include "llvm/CodeGen/GlobalISel/Utils.h"
 #include "llvm/CodeGen/MachineBasicBlock.h"
@@ -35,7 +38,9 @@
 #include "llvm/CodeGen/TargetInstrInfo.h"
 #include "llvm/CodeGen/TargetRegisterInfo.h"
 #include "llvm/CodeGen/TargetSubtargetInfo.h"
+#include "llvm/IR/Module.h"
 #include "llvm/MC/MCAsmInfo.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Compiler.h"
 #include "llvm/Support/ErrorHandling.h"
 #include "llvm/Target/TargetMachine.h"
@@ -47,6 +52,13 @@ using namespace llvm;
 #define GET_INSTRINFO_CTOR_DTOR
 #include "MOSGenInstrInfo.inc"
 
+static cl::opt<bool> DTVRemap(
+    "mos-dtv-remap",
+    cl::desc("Copy between X and Y on the 65DTV02 by remapping the "
+             "accumulator with SAC when A is live; interrupt handlers must "
+             "not rely on the accumulator mapping"),
+    cl::init(false), cl::Hidden);
+
 MOSInstrInfo::MOSInstrInfo(const MOSSubtarget &STI)
     : MOSGenInstrInfo(STI, *STI.getRegisterInfo(),
                       /*CFSetupOpcode=*/MOS::ADJCALLSTACKDOWN,
@@ -85,6 +97,21 @@ Register MOSInstrInfo::isStoreToStackSlot(const MachineInstr &MI,
   }
 }
 
+bool MOSInstrInfo::isReMaterializableImpl(const MachineInstr &MI) const {
+  switch (MI.getOpcode()) {
+  default:
+    return TargetInstrInfo::isReMaterializableImpl(MI);
+  case MOS::LDImm16: {
+    // The scratch def would otherwise prevent rematerialization, but it's
+    // only needed until expansion; rematerialized copies become LDImm16Remat,
+    // which scavenges its own.
+    const MachineOperand &Val = MI.getOperand(2);
+    return Val.isImm() || Val.isGlobal() || Val.isFI() || Val.isSymbol() ||
+           Val.isBlockAddress() || Val.isTargetIndex() || Val.isMCSymbol();
+  }
+  }
+}
+
 void MOSInstrInfo::reMaterialize(MachineBasicBlock &MBB,
                                  MachineBasicBlock::iterator I,
                                  Register DestReg, unsigned SubIdx,
@@ -214,7 +241,177 @@ unsigned MOSInstrInfo::getInstSizeInBytes(const MachineInstr &MI) const {
   case MOS::INLINEASM:
   case MOS::INLINEASM_BR:
     return getInlineAsmLength(MI.getOperand(0).getSymbolName(), MCAI, STI);
+  case MOS::MemcpyIdx:
+  case MOS::MemsetIdx: {
+    bool IsSet = MI.getOpcode() == MOS::MemsetIdx;
+    uint64_t Length = MI.getOperand(2).getImm();
+    uint64_t Pages = Length / 256;
+    // LDA #value
+    unsigned Size = IsSet ? 2 : 0;
+    // LDX #0; (LDA abs,X); STA abs,X; ...; INX; BNE
+    if (Pages)
+      Size += 5 + (IsSet ? 3 : 6) * Pages;
+    // LDX #n; (LDA abs,X); STA abs,X; DEX; BNE
+    if (Length % 256)
+      Size += IsSet ? 8 : 11;
+    return Size;
+  }
+  }
+}
+
+// Returns the number of bytes emitted by a data directive, or std::nullopt if
+// it isn't one that is understood.
+static std::optional<unsigned> getDataDirectiveLength(StringRef Directive,
+                                                      StringRef Args,
+                                                      StringRef Comment) {
+  // Split the arguments at top-level commas, up to any comment.
+  SmallVector<StringRef> Items;
+  unsigned Depth = 0;
+  bool InString = false;
+  size_t Start = 0;
+  for (size_t I = 0, E = Args.size(); I != E; ++I) {
+    char C = Args[I];
+    if (InString) {
+      if (C == '\\')
+        ++I;
+      else if (C == '"')
+        InString = false;
+    } else if (C == '"') {
+      InString = true;
+    } else if (Args.substr(I).starts_with(Comment)) {
+      Args = Args.take_front(I);
+      break;
+    } else if (C == '(') {
+      ++Depth;
+    } else if (C == ')') {
+      Depth = Depth ? Depth - 1 : 0;
+    } else if (C == ',' && !Depth) {
+      Items.push_back(Args.slice(Start, I).trim());
+      Start = I + 1;
+    }
+  }
+  if (InString)
+    return std::nullopt;
+  if (!Args.trim().empty())
+    Items.push_back(Args.substr(Start).trim());
+
+  std::string Lower = Directive.lower();
+  unsigned ItemSize = StringSwitch<unsigned>(Lower)
+                          .Case(".byte", 1)
+                          .Cases({".word", ".short", ".2byte"}, 2)
+                          .Cases({".long", ".4byte"}, 4)
+                          .Cases({".quad", ".8byte"}, 8)
+                          .Default(0);
+  if (ItemSize) {
+    if (any_of(Items, [](StringRef Item) { return Item.starts_with("\""); }))
+      return std::nullopt;
+    return ItemSize * Items.size();
+  }
+
+  if (Lower == ".ascii" || Lower == ".asciz" || Lower == ".string") {
+    // Escapes only make strings shorter, so counting their characters is an
+    // upper bound.
+    unsigned Length = 0;
+    for (StringRef Item : Items) {
+      if (Item.size() < 2 || !Item.starts_with("\"") || !Item.ends_with("\""))
+        return std::nullopt;
+      Length += Item.size() - 2 + (Lower != ".ascii");
+    }
+    return Length;
+  }
+
+  if (Lower == ".space" || Lower == ".zero" || Lower == ".skip") {
+    unsigned Size;
+    if (Items.empty() || Items.front().getAsInteger(0, Size))
+      return std::nullopt;
+    return Size;
   }
+
+  // Directives that emit nothing.
+  if (is_contained({".globl", ".global", ".local", ".weak", ".hidden", ".type",
+                    ".size", ".set", ".equ", ".file", ".loc"},
+                   Lower))
+    return 0;
+  return std::nullopt;
+}
+
+// Returns an upper bound on the size of a 6502 instruction, judging only from
+// the syntax of its operand. This can't tell zero page operands from absolute
+// ones, since the operand may be an expression or an inline assembly operand.
+static unsigned getInstLengthBound(StringRef Mnemonic, StringRef Operand) {
+  if (Operand.empty() || Operand.equals_insensitive("a"))
+    return 1;
+  if (Operand.starts_with("#"))
+    return 2;
+  std::string Lower = Mnemonic.lower();
+  if (is_contained({"bcc", "bcs", "beq", "bmi", "bne", "bpl", "bvc", "bvs",
+                    "bra"},
+                   Lower))
+    return 2;
+  // (zp,x) and (zp),y. JMP (abs,x) and JMP (abs) take a full address.
+  std::string Op = Operand.lower();
+  StringRef OpRef = Op;
+  OpRef = OpRef.rtrim();
+  if (Lower != "jmp" && OpRef.starts_with("(") &&
+      (OpRef.ends_with(",x)") || OpRef.ends_with("),y")))
+    return 2;
+  return 3;
+}
+
+// The default estimate counts every statement as the longest instruction.
+// Branch relaxation only needs an upper bound, so tighten this where the
+// syntax of a statement makes its size plain.
+unsigned MOSInstrInfo::getInlineAsmLength(const char *Str,
+                                          const MCAsmInfo &MAI,
+                                          const TargetSubtargetInfo *STI) const {
+  unsigned MaxInstLength = MAI.getMaxInstLength(STI);
+  // Only the fixed size instruction sets of the 6502-like processors are
+  // understood by getInstLengthBound.
+  bool KnownInstSizes =
+      STI && MaxInstLength == 3 && !STI->hasFeature(MOS::Feature65CE02) &&
+      !STI->hasFeature(MOS::Feature65EL02) &&
+      !STI->hasFeature(MOS::FeatureSPC700);
+
+  SmallVector<StringRef> Lines;
+  StringRef(Str).split(Lines, '\n');
+  unsigned Length = 0;
+  for (StringRef Line : Lines) {
+    StringRef Stmt = Line.trim();
+
+    // Strip labels.
+    while (true) {
+      size_t End = Stmt.find_first_not_of(
+          "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_.$@");
+      if (End == 0 || End == StringRef::npos || Stmt[End] != ':')
+        break;
+      Stmt = Stmt.substr(End + 1).ltrim();
+    }
+
+    // Directives may contain strings, so they find their own comments.
+    if (Stmt.starts_with(".")) {
+      size_t End = Stmt.find_first_of(" \t");
+      if (std::optional<unsigned> Size =
+              getDataDirectiveLength(Stmt.take_front(End), Stmt.substr(End),
+                                     MAI.getCommentString()))
+        Length += *Size;
+      else
+        Length += MaxInstLength;
+      continue;
+    }
+
+    Stmt = Stmt.split(MAI.getCommentString()).first.rtrim();
+    if (Stmt.empty())
+      continue;
+    size_t End = Stmt.find_first_of(" \t");
+    StringRef Mnemonic = Stmt.take_front(End);
+    StringRef Rest = Stmt.substr(End);
+    if (!KnownInstSizes || Mnemonic.contains('$') || Mnemonic.contains('{')) {
+      Length += MaxInstLength;
+      continue;
+    }
+    Length += getInstLengthBound(Mnemonic, Rest.trim());
+  }
+  return Length;
 }
 
 // 6502 instructions aren't as regular as most commutable instructions, so this
@@ -326,6 +523,9 @@ bool MOSInstrInfo::isBranchOffsetInRange(unsigned BranchOpc,
     // BR range is [-128,127] starting from the PC location after the
     // instruction, which is two bytes after the start of the instruction.
     return -126 <= BrOffset && BrOffset <= 129;
+  case MOS::BRBit:
+    // BBR and BBS are three bytes long, so their range starts one byte later.
+    return -125 <= BrOffset && BrOffset <= 130;
   case MOS::JMP:
     return true;
   }
@@ -339,7 +539,10 @@ MOSInstrInfo::getBranchDestBlock(const MachineInstr &MI) const {
   case MOS::GBR:
   case MOS::BR:
   case MOS::BRA:
+  case MOS::BRBit:
+  case MOS::BITSkip:
   case MOS::JMP:
+  case MOS::BitBrAbs:
   case MOS::CmpBrImm:
   case MOS::CmpBrImag8:
   case MOS::CmpBrZero:
@@ -543,12 +746,24 @@ static bool isTargetCopy(MachineInstr &MI) {
   case MOS::TA:
   case MOS::T_A:
   case MOS::TX:
+  case MOS::TXRemap:
     return true;
   default:
     return false;
   }
 }
 
+// Returns whether A is known to be dead at the insertion point, so that a copy
+// can freely go through it.
+static bool isAcDead(MachineIRBuilder &Builder) {
+  const MachineRegisterInfo &MRI = *Builder.getMRI();
+  if (!MRI.tracksLiveness())
+    return false;
+  return Builder.getMBB().computeRegisterLiveness(
+             MRI.getTargetRegisterInfo(), MOS::A, Builder.getInsertPt()) ==
+         MachineBasicBlock::LQR_Dead;
+}
+
 static bool isCopyRedundant(MachineIRBuilder &Builder, Register Dst,
                             Register Src) {
   if (Dst == Src)
@@ -646,6 +861,12 @@ void MOSInstrInfo::copyPhysRegImpl(MachineIRBuilder &Builder, Register DestReg,
       auto I = Builder.buildInstr(MOS::PL, {DestReg}, {});
       if (!STI->hasSPC700())
         I.addDef(MOS::NZ, RegState::Implicit);
+    } else if (STI->has65DTV02() && DTVRemap && SrcReg.isPhysical() &&
+               DestReg.isPhysical() && !isAcDead(Builder)) {
+      // Going through A would mean saving and restoring it.
+      assert(MOS::XYRegClass.contains(SrcReg));
+      assert(MOS::XYRegClass.contains(DestReg));
+      Builder.buildInstr(MOS::TXRemap).addDef(DestReg).addUse(SrcReg);
     } else {
       copyPhysRegImpl(Builder, DestReg,
                       getRegWithVal(Builder, SrcReg, MOS::AcRegClass));
@@ -1030,6 +1251,7 @@ bool MOSInstrInfo::expandPostRAPseudo(MachineInstr &MI) const {
   case MOS::CmpBrAbsIdx:
   case MOS::CmpBrIndir:
   case MOS::CmpBrIndirIdx:
+  case MOS::BitBrAbs:
     expandCmpBr(Builder);
     break;
 
@@ -1245,6 +1467,30 @@ void MOSInstrInfo::expandIncDecPtr(MachineIRBuilder &Builder) const {
   Register Reg = MI.getOperand(MI.getOpcode() == MOS::IncPtr ? 0 : 1).getReg();
   Register Lo = TRI.getSubReg(Reg, MOS::sublo);
   Register Hi = TRI.getSubReg(Reg, MOS::subhi);
+
+  // The SPC700 can increment or decrement a word in the direct page, so long
+  // as callee-saved registers moved to the zero page stack stayed adjacent.
+  if (STI->hasSPC700() && MI.getOpcode() != MOS::DecDcpPtr) {
+    const auto &MFI = *Builder.getMF().getInfo<MOSFunctionInfo>();
+    auto LoIt = MFI.CSRZPOffsets.find(Lo);
+    auto HiIt = MFI.CSRZPOffsets.find(Hi);
+    bool Adjacent = LoIt == MFI.CSRZPOffsets.end()
+                        ? HiIt == MFI.CSRZPOffsets.end()
+                        : HiIt != MFI.CSRZPOffsets.end() &&
+                              HiIt->second == LoIt->second + 1;
+    if (Adjacent) {
+      Builder
+          .buildInstr(MI.getOpcode() == MOS::IncPtr ? MOS::SPC700_INCW_ZeroPage
+                                                    : MOS::SPC700_DECW_ZeroPage)
+          .addUse(Lo)
+          .addDef(Reg, RegState::Implicit)
+          .addUse(Reg, RegState::Implicit)
+          .addDef(MOS::NZ, RegState::Implicit | RegState::Dead);
+      MI.eraseFromParent();
+      return;
+    }
+  }
+
   auto Op = MI.getOpcode() == MOS::IncPtr
                 ? MOS::IncMB
                 : (MI.getOpcode() == MOS::DecPtr ? MOS::DecMB : MOS::DecDcpMB);
@@ -1322,15 +1568,21 @@ void MOSInstrInfo::expandCmpBr(MachineIRBuilder &Builder) const {
   case MOS::CmpBrIndirIdx:
     CMPOpcode = MOS::CMPIndirIdx;
     break;
+  case MOS::BitBrAbs:
+    CMPOpcode = MOS::BITAbsFlags;
+    break;
   }
 
   auto CMP = Builder.buildInstr(CMPOpcode);
-  if (CMPOpcode != MOS::CmpZero)
+  if (CMPOpcode != MOS::CmpZero && CMPOpcode != MOS::BITAbsFlags)
     CMP.addDef(MOS::C, RegState::Dead);
   for (unsigned I = 3, E = MI.getNumOperands(); I != E; I++)
     CMP.add(MI.getOperand(I));
-  CMP.cloneMemRefs(*CMP);
+  CMP.cloneMemRefs(MI);
   CMP.addDef(Flag, RegState::Implicit);
+  // BIT sets V from bit 6 even when branching on N.
+  if (CMPOpcode == MOS::BITAbsFlags && Flag != MOS::V)
+    CMP.addDef(MOS::V, RegState::Implicit | RegState::Dead);
 
   Builder.buildInstr(MOS::BR)
       .add(MI.getOperand(0))
@@ -1368,6 +1620,163 @@ MOSInstrInfo::getSerializableDirectMachineOperandTargetFlags() const {
       {MOS::MO_LO, "lo"},
       {MOS::MO_HI, "hi"},
       {MOS::MO_HI_JT, "hi-jt"},
-      {MOS::MO_ZEROPAGE, "zeropage"}};
+      {MOS::MO_ZEROPAGE, "zeropage"},
+      {MOS::MO_BANK, "bank"}};
   return Flags;
 }
+
+bool MOSInstrInfo::isFunctionSafeToOutlineFrom(
+    MachineFunction &MF, bool OutlineFromLinkOnceODRs) const {
+  const Function &F = MF.getFunction();
+
+  // Can F be deduplicated by the linker? If it can, don't outline from it.
+  if (!OutlineFromLinkOnceODRs && F.hasLinkOnceODRLinkage())
+    return false;
+
+  // Don't outline from functions with section markings; the program could
+  // expect that all the code is in the named section. This matters all the
+  // more on banked targets, where the outlined function might not be mapped.
+  // Timed functions would no longer have fixed timings.
+  return !F.hasSection() && !F.hasFnAttribute("mos-timed");
+}
+
+// Outlining adds a call and a return, or a jump, to each execution of a
+// sequence. That's only worth it where space matters more than time: in
+// functions optimized for minimum size, and in cold code.
+static bool prefersBytes(const MachineBasicBlock &MBB) {
+  const MachineFunction &MF = *MBB.getParent();
+  const Function &F = MF.getFunction();
+  return MOSInstrCost::getModeFor(MF) == MOSInstrCost::Mode::PreferBytes ||
+         MBB.getSectionID() == MBBSectionID::ColdSectionID ||
+         F.hasFnAttribute(Attribute::Cold) ||
+         F.getSectionPrefix() == "unlikely";
+}
+
+bool MOSInstrInfo::isMBBSafeToOutlineFrom(MachineBasicBlock &MBB,
+                                          unsigned &Flags) const {
+  if (!prefersBytes(MBB))
+    return false;
+  // Static stack references are only rewritten to globals when optimizing;
+  // any left over refer to the frame of the function they're in.
+  for (const MachineInstr &MI : MBB)
+    for (const MachineOperand &MO : MI.operands())
+      if (MO.isTargetIndex())
+        return false;
+  return TargetInstrInfo::isMBBSafeToOutlineFrom(MBB, Flags);
+}
+
+bool MOSInstrInfo::shouldOutlineFromFunctionByDefault(
+    MachineFunction &MF) const {
+  return any_of(MF, prefersBytes);
+}
+
+// Enum values indicating how an outlined call should be constructed.
+enum MachineOutlinerConstructionID {
+  MachineOutlinerTailCall,
+  MachineOutlinerDefault
+};
+
+// Returns whether the hardware stack is left as it was found by the sequence,
+// never popped below that, and never addressed through the stack pointer.
+// Otherwise, the return address pushed by a JSR to the outlined function would
+// get in the way: it shifts the frames that TSX and stack-relative accesses
+// reach by two bytes.
+static bool isHardStackBalanced(outliner::Candidate &C) {
+  int Depth = 0;
+  for (const MachineInstr &MI : C) {
+    switch (MI.getOpcode()) {
+    case MOS::PH:
+      ++Depth;
+      break;
+    case MOS::PL:
+      if (--Depth < 0)
+        return false;
+      break;
+    case MOS::TSX_Implied:
+    case MOS::TXS_Implied:
+    case MOS::TSC_Implied:
+    case MOS::TCS_Implied:
+    case MOS::LDStkRel:
+    case MOS::STStkRel:
+      return false;
+    }
+  }
+  return !Depth;
+}
+
+std::optional<std::unique_ptr<outliner::OutlinedFunction>>
+MOSInstrInfo::getOutliningCandidateInfo(
+    const MachineModuleInfo &MMI,
+    std::vector<outliner::Candidate> &RepeatedSequenceLocs,
+    unsigned MinRepeats) const {
+  // Each RepeatedSequenceLoc is identical.
+  outliner::Candidate &Candidate = RepeatedSequenceLocs[0];
+
+  // A sequence ending in a return is jumped to, and it returns directly to
+  // the caller. Otherwise, it is called with JSR and ends in an RTS. JSR, JMP,
+  // and RTS leave A, X, Y, P, and the imaginary registers alone, so no
+  // register needs to be free around the call, and everything live into or
+  // out of the sequence stays live across it.
+  MachineOutlinerConstructionID MOCI;
+  MOSInstrCost CallCost, FrameCost;
+  if (Candidate.back().isReturn()) {
+    MOCI = MachineOutlinerTailCall;
+    // The return moves from the caller to the outlined function.
+    CallCost = MOSInstrCost::get(MOS::JMP_Absolute, *STI);
+  } else {
+    if (!isHardStackBalanced(Candidate))
+      return std::nullopt;
+    MOCI = MachineOutlinerDefault;
+    CallCost = MOSInstrCost::get(MOS::JSR_Absolute, *STI);
+    FrameCost = MOSInstrCost::get(MOS::RTS_Implied, *STI);
+  }
+
+  // The outliner weighs bytes alone; cycles only matter where outlining is
+  // disallowed.
+  const int32_t Byte = MOSInstrCost(1, 0).getBytes();
+  for (outliner::Candidate &C : RepeatedSequenceLocs)
+    C.setCallInfo(MOCI, CallCost.getBytes() / Byte);
+
+  unsigned SequenceSize = 0;
+  for (const MachineInstr &MI : Candidate)
+    SequenceSize += getInstSizeInBytes(MI);
+
+  return std::make_unique<outliner::OutlinedFunction>(
+      RepeatedSequenceLocs, SequenceSize, FrameCost.getBytes() / Byte, MOCI);
+}
+
+outliner::InstrType
+MOSInstrInfo::getOutliningTypeImpl(const MachineModuleInfo &MMI,
+                                   MachineBasicBlock::iterator &MBBI,
+                                   unsigned Flags) const {
+  switch (MBBI->getOpcode()) {
+  // Interrupt returns restore the flags from the hardware stack, and indirect
+  // jumps through RTS push their own return address. Other returns end their
+  // sequence, which is then jumped to instead of called.
+  case MOS::RTI:
+  case MOS::JMPRTS:
+    return outliner::InstrType::Illegal;
+  default:
+    return outliner::InstrType::Legal;
+  }
+}
+
+void MOSInstrInfo::buildOutlinedFrame(
+    MachineBasicBlock &MBB, MachineFunction &MF,
+    const outliner::OutlinedFunction &OF) const {
+  if (OF.FrameConstructionID == MachineOutlinerTailCall)
+    return;
+  BuildMI(MBB, MBB.end(), DebugLoc(), get(MOS::RTS));
+}
+
+MachineBasicBlock::iterator
+MOSInstrInfo::insertOutlinedCall(Module &M, MachineBasicBlock &MBB,
+                                 MachineBasicBlock::iterator &It,
+                                 MachineFunction &MF,
+                                 outliner::Candidate &C) const {
+  unsigned Opcode =
+      C.CallConstructionID == MachineOutlinerTailCall ? MOS::TailJMP : MOS::JSR;
+  It = MBB.insert(It, BuildMI(MF, DebugLoc(), get(Opcode))
+                          .addGlobalAddress(M.getNamedValue(MF.getName())));
+  return It;
+}
@@ -33,6 +33,8 @@ public:
   Register isStoreToStackSlot(const MachineInstr &MI,
                               int &FrameIndex) const override;
 
+  bool isReMaterializableImpl(const MachineInstr &MI) const override;
+
   void reMaterialize(MachineBasicBlock &MBB, MachineBasicBlock::iterator MI,
                      Register DestReg, unsigned SubIdx,
                      const MachineInstr &Orig) const override;
@@ -43,6 +45,10 @@ public:
 
   unsigned getInstSizeInBytes(const MachineInstr &MI) const override;
 
+  unsigned
+  getInlineAsmLength(const char *Str, const MCAsmInfo &MAI,
+                     const TargetSubtargetInfo *STI = nullptr) const override;
+
   bool findCommutedOpIndices(const MachineInstr &MI, unsigned &SrcOpIdx1,
                              unsigned &SrcOpIdx2) const override;
 
@@ -72,6 +78,13 @@ public:
                             int64_t BrOffset = 0,
                             RegScavenger *RS = nullptr) const override;
 
+  // The generic machine function splitter runs after branch relaxation, which
+  // would leave relative branches between sections. MOSColdSplitting does
+  // this instead.
+  bool isFunctionSafeToSplit(const MachineFunction &MF) const override {
+    return false;
+  }
+
   void copyPhysReg(MachineBasicBlock &MBB, MachineBasicBlock::iterator MI,
                    const DebugLoc &DL, Register DestReg, Register SrcReg,
                    bool KillSrc, bool RenamableDest,
@@ -123,6 +136,32 @@ public:
   unsigned findCustomTiedOperandIdx(const MachineInstr &MI,
                                     unsigned OpIdx) const override;
 
+  bool isFunctionSafeToOutlineFrom(MachineFunction &MF,
+                                   bool OutlineFromLinkOnceODRs) const override;
+
+  bool isMBBSafeToOutlineFrom(MachineBasicBlock &MBB,
+                              unsigned &Flags) const override;
+
+  bool shouldOutlineFromFunctionByDefault(MachineFunction &MF) const override;
+
+  std::optional<std::unique_ptr<outliner::OutlinedFunction>>
+  getOutliningCandidateInfo(
+      const MachineModuleInfo &MMI,
+      std::vector<outliner::Candidate> &RepeatedSequenceLocs,
+      unsigned MinRepeats) const override;
+
+  outliner::InstrType getOutliningTypeImpl(const MachineModuleInfo &MMI,
+                                           MachineBasicBlock::iterator &MBBI,
+                                           unsigned Flags) const override;
+
+  void buildOutlinedFrame(MachineBasicBlock &MBB, MachineFunction &MF,
+                          const outliner::OutlinedFunction &OF) const override;
+
+  MachineBasicBlock::iterator
+  insertOutlinedCall(Module &M, MachineBasicBlock &MBB,
+                     MachineBasicBlock::iterator &It, MachineFunction &MF,
+                     outliner::Candidate &C) const override;
+
 private:
   const MOSSubtarget *STI;
 
@@ -151,7 +190,7 @@ private:
 
 namespace MOS {
 
-enum AddressSpace { AS_Memory, AS_ZeroPage, NumAddrSpaces };
+enum AddressSpace { AS_Memory, AS_ZeroPage, AS_Far, NumAddrSpaces };
 
 enum TargetIndex {
   TI_STATIC_STACK,
@@ -163,6 +202,7 @@ enum TOF {
   MO_HI,
   MO_HI_JT,
   MO_ZEROPAGE,
+  MO_BANK,
 };
 
 } // namespace MOS
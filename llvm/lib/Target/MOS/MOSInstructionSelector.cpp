@@ -16,6 +16,7 @@
 
 #include "MCTargetDesc/MOSMCTargetDesc.h"
 #include "MOS.h"
+#include "MOSCallGraphUtils.h"
 #include "MOSFrameLowering.h"
 #include "MOSInstrBuilder.h"
 #include "MOSRegisterInfo.h"
@@ -41,9 +42,12 @@
 #include "llvm/CodeGen/TargetRegisterInfo.h"
 #include "llvm/CodeGen/TargetSubtargetInfo.h"
 #include "llvm/IR/Constants.h"
+#include "llvm/IR/DiagnosticInfo.h"
+#include "llvm/IR/GlobalVariable.h"
 #include "llvm/IR/InstrTypes.h"
 #include "llvm/IR/Instruction.h"
 #include "llvm/ObjectYAML/MachOYAML.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/ErrorHandling.h"
 
 using namespace llvm;
@@ -51,6 +55,14 @@ using namespace MIPatternMatch;
 
 #define DEBUG_TYPE "mos-isel"
 
+// The PC Engine conventionally maps the I/O page at $0000, which places the
+// VDC's address register at $0000 and its data registers at $0002 and $0003.
+static cl::opt<int> HuCVDCAddress(
+    "mos-huc-vdc-address",
+    cl::desc("Logical address of the HuC6280 VDC ports, where constant stores "
+             "select ST0-ST2 (-1 to disable)"),
+    cl::init(0), cl::Hidden);
+
 namespace {
 
 #define GET_GLOBALISEL_PREDICATE_BITSET
@@ -82,6 +94,7 @@ private:
 
   // Post-tablegen selection functions. If these return false, it is an error.
   bool selectBrCondImm(MachineInstr &MI);
+  bool selectBitBr(MachineInstr &MI);
   bool selectSbc(MachineInstr &MI);
   bool selectFrameIndex(MachineInstr &MI);
   std::pair<Register, Register> selectFrameIndexLoHi(MachineInstr &MI);
@@ -89,10 +102,15 @@ private:
   std::pair<Register, Register> selectAddrLoHi(MachineInstr &MI);
   bool selectStore(MachineInstr &MI);
   bool selectRMW(MachineInstr &MI);
+  bool selectBitSetClear(MachineInstr &MI, MachineInstr &Load,
+                         const MachineOperand &Addr, Register Mask, bool Set);
   bool selectLshrShlE(MachineInstr &MI);
   bool selectMergeValues(MachineInstr &MI);
   bool selectTrunc(MachineInstr &MI);
   bool selectAddE(MachineInstr &MI);
+  bool selectBCDAddSubE(MachineInstr &MI);
+  bool selectUMul8(MachineInstr &MI);
+  bool selectUDivRem8(MachineInstr &MI);
   bool selectIncDecMB(MachineInstr &MI);
   bool selectUnMergeValues(MachineInstr &MI);
   bool selectBrIndirect(MachineInstr &MI);
@@ -185,6 +203,30 @@ static const TargetRegisterClass &getRegClassForType(LLT Ty) {
   }
 }
 
+// Returns whether an operand of MI is the result of a load that selectAddSub or
+// selectLogical might fold into it. Whether a fold is legal depends on alias
+// analysis, which the imported patterns can't express; all other forms of
+// these instructions are selected by the patterns alone.
+static bool hasLoadOperand(const MachineInstr &MI,
+                           const MachineRegisterInfo &MRI) {
+  for (const MachineOperand &MO : MI.explicit_uses()) {
+    if (!MO.isReg())
+      continue;
+    const MachineInstr *Def = getDefIgnoringCopies(MO.getReg(), MRI);
+    if (!Def)
+      continue;
+    switch (Def->getOpcode()) {
+    case MOS::G_LOAD_ZP_IDX:
+    case MOS::G_LOAD_ABS:
+    case MOS::G_LOAD_ABS_IDX:
+    case MOS::G_LOAD_INDIR:
+    case MOS::G_LOAD_INDIR_IDX:
+      return true;
+    }
+  }
+  return false;
+}
+
 bool MOSInstructionSelector::select(MachineInstr &MI) {
   if (!MI.isPreISelOpcode()) {
     // Ensure that target-independent pseudos like COPY have register classes.
@@ -192,16 +234,19 @@ bool MOSInstructionSelector::select(MachineInstr &MI) {
     return true;
   }
 
+  // Most arithmetic and logic has only register and immediate operands, so
+  // the hand-written folds are only tried when there's a load to fold.
+  const MachineRegisterInfo &MRI = MI.getMF()->getRegInfo();
   switch (MI.getOpcode()) {
   case MOS::G_ADD:
   case MOS::G_SUB:
-    if (selectAddSub(MI))
+    if (hasLoadOperand(MI, MRI) && selectAddSub(MI))
       return true;
     break;
   case MOS::G_AND:
   case MOS::G_OR:
   case MOS::G_XOR:
-    if (selectLogical(MI))
+    if (hasLoadOperand(MI, MRI) && selectLogical(MI))
       return true;
     break;
   }
@@ -236,6 +281,13 @@ bool MOSInstructionSelector::select(MachineInstr &MI) {
   case MOS::G_UADDE:
   case MOS::G_SADDE:
     return selectAddE(MI);
+  case MOS::G_BCD_ADDE:
+  case MOS::G_BCD_SUBE:
+    return selectBCDAddSubE(MI);
+  case MOS::G_UMUL8:
+    return selectUMul8(MI);
+  case MOS::G_UDIVREM8:
+    return selectUDivRem8(MI);
   case MOS::G_INC:
   case MOS::G_DEC:
   case MOS::G_INC_TMP:
@@ -257,6 +309,7 @@ bool MOSInstructionSelector::select(MachineInstr &MI) {
   case MOS::G_STORE_INDIR:
   case MOS::G_STORE_INDIR_IDX:
   case MOS::G_BRINDIRECT_IDX:
+  case MOS::G_BRINDIRECT_RTS:
     return selectGeneric(MI);
   }
 }
@@ -974,6 +1027,21 @@ inline CmpNZIndirIdx_match m_CmpNZIndirIdx(Register &LHS, Register &Addr,
   return {LHS, Addr, Idx, Flag, Load, AA};
 }
 
+// Returns whether an absolute address is known to lie within the zero page.
+static bool isZeroPageAddr(const MachineOperand &Addr,
+                           const MOSSubtarget &STI) {
+  if (Addr.getTargetFlags() == MOS::MO_ZEROPAGE)
+    return true;
+  if (Addr.isImm())
+    return Addr.getImm() >= STI.getZeroPageOffset() &&
+           Addr.getImm() < STI.getZeroPageOffset() + 256;
+  if (!Addr.isGlobal() || Addr.getOffset() < 0)
+    return false;
+  const auto *GV =
+      dyn_cast<GlobalVariable>(Addr.getGlobal()->getAliaseeObject());
+  return GV && GV->getAddressSpace() == MOS::AS_ZeroPage;
+}
+
 bool MOSInstructionSelector::selectBrCondImm(MachineInstr &MI) {
   MachineRegisterInfo &MRI = MI.getMF()->getRegInfo();
 
@@ -998,6 +1066,8 @@ bool MOSInstructionSelector::selectBrCondImm(MachineInstr &MI) {
     MI.eraseFromParent();
     return true;
   }
+  if (selectBitBr(MI))
+    return true;
   if (mi_match(CondReg, MRI, m_CmpNZZero(LHS, Flag))) {
     auto Branch = Builder.buildInstr(MOS::CmpBrZero)
                       .addMBB(Tgt)
@@ -1106,6 +1176,99 @@ bool MOSInstructionSelector::selectBrCondImm(MachineInstr &MI) {
   return true;
 }
 
+// Select a branch on one bit of a memory location without loading it into a
+// register: BIT for bits 7 and 6, which land in N and V, and BBR/BBS for any
+// bit of a non-volatile zero page location. BIT reads memory exactly once, so
+// it also serves to poll volatile hardware registers.
+bool MOSInstructionSelector::selectBitBr(MachineInstr &MI) {
+  MachineRegisterInfo &MRI = MI.getMF()->getRegInfo();
+
+  Register CondReg = MI.getOperand(0).getReg();
+  MachineBasicBlock *Tgt = MI.getOperand(1).getMBB();
+  int64_t FlagVal = MI.getOperand(2).getImm();
+
+  Register LHS, Flag;
+  if (!mi_match(CondReg, MRI, m_CmpNZZero(LHS, Flag)))
+    return false;
+
+  // The whole chain from the load to the branch is replaced, so none of it may
+  // have other users.
+  MachineInstr *Cmp = MRI.getVRegDef(CondReg);
+  if (Cmp->getOpcode() != MOS::G_SBC || !MRI.hasOneNonDBGUse(CondReg))
+    return false;
+  for (const MachineOperand &MO : Cmp->defs())
+    if (MO.getReg() != CondReg && !MRI.use_nodbg_empty(MO.getReg()))
+      return false;
+
+  unsigned Bit;
+  bool BranchIfSet;
+  Register Val = LHS;
+  MachineInstr *And = nullptr;
+  if (Flag == MOS::N) {
+    Bit = 7;
+    BranchIfSet = FlagVal;
+  } else {
+    // Z reflects a single bit if the value was masked down to it.
+    int64_t Mask;
+    if (!mi_match(LHS, MRI, m_GAnd(m_Reg(Val), m_ICst(Mask))) ||
+        !MRI.hasOneNonDBGUse(LHS))
+      return false;
+    Mask &= 0xff;
+    if (!isPowerOf2_64(Mask))
+      return false;
+    And = MRI.getVRegDef(LHS);
+    Bit = Log2_64(Mask);
+    BranchIfSet = !FlagVal;
+  }
+
+  MachineInstr *Load = MRI.getVRegDef(Val);
+  if (Load->getOpcode() != MOS::G_LOAD_ABS || !MRI.hasOneNonDBGUse(Val))
+    return false;
+  const MachineOperand &Addr = Load->getOperand(1);
+  bool Volatile = (*Load->memoperands_begin())->isVolatile();
+  if (Volatile) {
+    // The access moves to the branch, so nothing may separate the two.
+    if (Load->getParent() != MI.getParent())
+      return false;
+    for (const MachineInstr &I :
+         make_range(std::next(MachineBasicBlock::const_iterator(*Load)),
+                    MachineBasicBlock::const_iterator(MI)))
+      if (I.mayLoadOrStore() || I.isCall() || I.hasUnmodeledSideEffects())
+        return false;
+  } else if (!shouldFoldMemAccess(MI, *Load, AA)) {
+    return false;
+  }
+
+  MachineIRBuilder Builder(MI);
+  if (Bit == 7 || Bit == 6) {
+    Builder.buildInstr(MOS::BitBrAbs)
+        .addMBB(Tgt)
+        .addUse(Bit == 7 ? MOS::N : MOS::V, RegState::Undef)
+        .addImm(BranchIfSet)
+        .add(Addr)
+        .cloneMemRefs(*Load);
+  } else {
+    // Branch relaxation must be able to analyze BBR/BBS, which it cannot do
+    // for volatile accesses.
+    if (!STI.hasR65C02() || Volatile || !isZeroPageAddr(Addr, STI))
+      return false;
+    Builder.buildInstr(MOS::BRBit)
+        .addMBB(Tgt)
+        .addImm(Bit)
+        .addImm(BranchIfSet)
+        .add(Addr)
+        .cloneMemRefs(*Load);
+  }
+
+  // The load would otherwise remain, since volatile loads are never dead.
+  MI.eraseFromParent();
+  Cmp->eraseFromParent();
+  if (And)
+    And->eraseFromParent();
+  Load->eraseFromParent();
+  return true;
+}
+
 // Although some G_SBC instructions can be folded in to their (branch) uses,
 // others need to be selected directly.
 bool MOSInstructionSelector::selectSbc(MachineInstr &MI) {
@@ -1263,8 +1426,17 @@ bool MOSInstructionSelector::selectSbc(MachineInstr &MI) {
 }
 
 bool MOSInstructionSelector::selectFrameIndex(MachineInstr &MI) {
+  const MachineFunction &MF = *MI.getMF();
+  const MOSFrameLowering &TFL =
+      *MF.getSubtarget<MOSSubtarget>().getFrameLowering();
   Register Dst = MI.getOperand(0).getReg();
 
+  // Static stack addresses are link-time constants. Loading them whole keeps
+  // them rematerializable, so the register allocator need never spill them.
+  if (TFL.usesStaticStack(MF) &&
+      !MF.getFrameInfo().isFixedObjectIndex(MI.getOperand(1).getIndex()))
+    return selectAddr(MI);
+
   std::pair<Register, Register> LoHi = selectFrameIndexLoHi(MI);
 
   MachineIRBuilder Builder(MI);
@@ -1446,6 +1618,22 @@ IncDecMBAbs_match m_IncDecMBAbs(MachineInstr *&IncDec, MachineOperand &Addr,
 bool MOSInstructionSelector::selectStore(MachineInstr &MI) {
   MachineIRBuilder Builder(MI);
 
+  // ST0, ST1, and ST2 write constants to the VDC ports without involving A.
+  if (STI.hasHUC6280() && HuCVDCAddress >= 0 &&
+      MI.getOpcode() == MOS::G_STORE_ABS && MI.getOperand(1).isImm()) {
+    int64_t Port = (MI.getOperand(1).getImm() - HuCVDCAddress) & 0xffff;
+    auto Val = getIConstantVRegValWithLookThrough(MI.getOperand(0).getReg(),
+                                                  *Builder.getMRI());
+    if (Val && (Port == 0 || Port == 2 || Port == 3)) {
+      Builder.buildInstr(MOS::HuCVDCStore)
+          .addImm(Port ? Port - 1 : 0)
+          .addImm(Val->Value.getZExtValue() & 0xff)
+          .cloneMemRefs(MI);
+      MI.eraseFromParent();
+      return true;
+    }
+  }
+
   // Read-modify-write instruction patterns are rooted at store instructions, so
   // select one if possible. This can make an entire instruction sequence dead.
   if (!(*MI.memoperands_begin())->isVolatile())
@@ -1479,9 +1667,29 @@ bool MOSInstructionSelector::selectStore(MachineInstr &MI) {
   return true;
 }
 
+// Matches Val = Op(Op(Src, 0), 0), where Op is G_SHLE or G_LSHRE and the first
+// shift is otherwise unused.
+static bool matchDoubleShift(Register Val, unsigned Opcode, Register &CarryOut,
+                             Register &Src, const MachineRegisterInfo &MRI) {
+  const MachineInstr *Outer = getOpcodeDef(Opcode, Val, MRI);
+  if (!Outer ||
+      !mi_match(Outer->getOperand(3).getReg(), MRI, m_SpecificICst(0)))
+    return false;
+  Register Mid = Outer->getOperand(2).getReg();
+  const MachineInstr *Inner = getOpcodeDef(Opcode, Mid, MRI);
+  if (!Inner || !MRI.hasOneNonDBGUse(Mid) ||
+      !MRI.use_nodbg_empty(Inner->getOperand(1).getReg()) ||
+      !mi_match(Inner->getOperand(3).getReg(), MRI, m_SpecificICst(0)))
+    return false;
+  CarryOut = Outer->getOperand(1).getReg();
+  Src = Inner->getOperand(2).getReg();
+  return true;
+}
+
 bool MOSInstructionSelector::selectRMW(MachineInstr &MI) {
   MachineIRBuilder Builder(MI);
   auto &MRI = *Builder.getMRI();
+  int64_t Step;
 
   Register Val = MI.getOperand(0).getReg();
   MachineInstr *Load;
@@ -1504,6 +1712,35 @@ bool MOSInstructionSelector::selectRMW(MachineInstr &MI) {
       MI.eraseFromParent();
       return true;
     }
+    // Stepping twice in place takes no longer than adding through A, is
+    // shorter, and leaves A free.
+    if (mi_match(Val, MRI,
+                 m_GAdd(m_all_of(m_MInstr(Load), m_FoldedLdAbs(MI, Addr, AA)),
+                        m_ICst(Step))) &&
+        (Step == 2 || Step == -2) && Addr.isIdenticalTo(MI.getOperand(1))) {
+      for (int I = 0; I < 2; ++I)
+        Builder.buildInstr(Step > 0 ? MOS::INCAbs : MOS::DECAbs)
+            .add(Addr)
+            .cloneMergedMemRefs({&MI, Load});
+      MI.eraseFromParent();
+      return true;
+    }
+
+    Register Mask;
+    if (STI.has65C02() &&
+        mi_match(Val, MRI,
+                 m_GOr(m_all_of(m_MInstr(Load), m_FoldedLdAbs(MI, Addr, AA)),
+                       m_Reg(Mask))) &&
+        Addr.isIdenticalTo(MI.getOperand(1)) &&
+        selectBitSetClear(MI, *Load, Addr, Mask, /*Set=*/true))
+      return true;
+    if (STI.has65C02() &&
+        mi_match(Val, MRI,
+                 m_GAnd(m_all_of(m_MInstr(Load), m_FoldedLdAbs(MI, Addr, AA)),
+                        m_Reg(Mask))) &&
+        Addr.isIdenticalTo(MI.getOperand(1)) &&
+        selectBitSetClear(MI, *Load, Addr, Mask, /*Set=*/false))
+      return true;
 
     MachineInstr *IncDec;
     if (mi_match(Val, MRI, m_IncDecMBAbs(IncDec, Addr, Load, AA))) {
@@ -1556,6 +1793,27 @@ bool MOSInstructionSelector::selectRMW(MachineInstr &MI) {
       MI.eraseFromParent();
       return true;
     }
+    // Likewise for shifting twice in place.
+    for (auto [GOpc, Opc] : {std::pair(MOS::G_SHLE, MOS::ASLAbs),
+                             std::pair(MOS::G_LSHRE, MOS::LSRAbs)}) {
+      Register Src;
+      if (!matchDoubleShift(Val, GOpc, CarryOut, Src, MRI) ||
+          !mi_match(Src, MRI,
+                    m_all_of(m_MInstr(Load), m_FoldedLdAbs(MI, Addr, AA))) ||
+          !Addr.isIdenticalTo(MI.getOperand(1)))
+        continue;
+      MachineInstrBuilder Shift;
+      for (int I = 0; I < 2; ++I) {
+        Shift = Builder.buildInstr(Opc, {&MOS::CcRegClass}, {})
+                    .add(Addr)
+                    .cloneMergedMemRefs({&MI, Load});
+        if (!constrainSelectedInstRegOperands(*Shift, TII, TRI, RBI))
+          return false;
+      }
+      replaceUsesAfter(Shift, CarryOut, Shift.getReg(0), MRI);
+      MI.eraseFromParent();
+      return true;
+    }
     Register CarryIn;
     if (mi_match(Val, MRI,
                  m_GShlE(CarryOut,
@@ -1587,7 +1845,8 @@ bool MOSInstructionSelector::selectRMW(MachineInstr &MI) {
       MI.eraseFromParent();
       return true;
     }
-  } else if (MI.getOpcode() == MOS::G_STORE_ABS_IDX) {
+  } else if (MI.getOpcode() == MOS::G_STORE_ABS_IDX ||
+             MI.getOpcode() == MOS::G_STORE_ZP_IDX) {
     MachineOperand Addr = MachineOperand::CreateReg(0, false);
     Register Idx;
     bool ZP = false;
@@ -1621,6 +1880,23 @@ bool MOSInstructionSelector::selectRMW(MachineInstr &MI) {
       MI.eraseFromParent();
       return true;
     }
+    if (mi_match(Val, MRI,
+                 m_GAdd(m_all_of(m_MInstr(Load),
+                                 m_FoldedLdIdx(MI, Addr, Idx, ZP, AA)),
+                        m_ICst(Step))) &&
+        (Step == 2 || Step == -2) && Addr.isIdenticalTo(MI.getOperand(1)) &&
+        Idx == MI.getOperand(2).getReg()) {
+      for (int I = 0; I < 2; ++I) {
+        auto Inc = Builder.buildInstr(Step > 0 ? MOS::INCIdx : MOS::DECIdx)
+                       .add(Addr)
+                       .addUse(Idx)
+                       .cloneMergedMemRefs({&MI, Load});
+        if (!constrainSelectedInstRegOperands(*Inc, TII, TRI, RBI))
+          return false;
+      }
+      MI.eraseFromParent();
+      return true;
+    }
     Register CarryOut;
     if (mi_match(Val, MRI,
                  m_GShlE(CarryOut,
@@ -1656,6 +1932,29 @@ bool MOSInstructionSelector::selectRMW(MachineInstr &MI) {
       MI.eraseFromParent();
       return true;
     }
+    for (auto [GOpc, Opc] : {std::pair(MOS::G_SHLE, MOS::ASLIdx),
+                             std::pair(MOS::G_LSHRE, MOS::LSRIdx)}) {
+      Register Src;
+      if (!matchDoubleShift(Val, GOpc, CarryOut, Src, MRI) ||
+          !mi_match(Src, MRI,
+                    m_all_of(m_MInstr(Load),
+                             m_FoldedLdIdx(MI, Addr, Idx, ZP, AA))) ||
+          !Addr.isIdenticalTo(MI.getOperand(1)) ||
+          Idx != MI.getOperand(2).getReg())
+        continue;
+      MachineInstrBuilder Shift;
+      for (int I = 0; I < 2; ++I) {
+        Shift = Builder.buildInstr(Opc, {&MOS::CcRegClass}, {})
+                    .add(Addr)
+                    .addUse(Idx)
+                    .cloneMergedMemRefs({&MI, Load});
+        if (!constrainSelectedInstRegOperands(*Shift, TII, TRI, RBI))
+          return false;
+      }
+      replaceUsesAfter(Shift, CarryOut, Shift.getReg(0), MRI);
+      MI.eraseFromParent();
+      return true;
+    }
     Register CarryIn;
     if (mi_match(Val, MRI,
                  m_GShlE(CarryOut,
@@ -1697,6 +1996,50 @@ bool MOSInstructionSelector::selectRMW(MachineInstr &MI) {
   return false;
 }
 
+// Select a store of Load | Mask (Set) or Load & Mask back to the loaded
+// address. Single bits of the zero page use SMB/RMB; anything else uses TSB or
+// TRB, which take the bits to set or clear in A.
+bool MOSInstructionSelector::selectBitSetClear(MachineInstr &MI,
+                                               MachineInstr &Load,
+                                               const MachineOperand &Addr,
+                                               Register Mask, bool Set) {
+  MachineIRBuilder Builder(MI);
+  auto &MRI = *Builder.getMRI();
+
+  // TRB clears the bits that are set in A, so clears need the inverted mask.
+  std::optional<int64_t> Bits;
+  Register BitsReg;
+  if (auto C = getIConstantVRegSExtVal(Mask, MRI))
+    Bits = (Set ? *C : ~*C) & 0xff;
+  else if (Set)
+    BitsReg = Mask;
+  else if (!mi_match(Mask, MRI, m_Not(m_Reg(BitsReg))))
+    return false;
+
+  if (Bits && isPowerOf2_64(*Bits) && STI.hasR65C02() &&
+      isZeroPageAddr(Addr, STI)) {
+    Builder.buildInstr(Set ? MOS::SMBZp : MOS::RMBZp)
+        .addImm(Log2_64(*Bits))
+        .add(Addr)
+        .cloneMergedMemRefs({&MI, &Load});
+    MI.eraseFromParent();
+    return true;
+  }
+
+  if (Bits)
+    BitsReg = Builder.buildInstr(MOS::LDImm, {&MOS::AcRegClass}, {})
+                  .addImm(*Bits)
+                  .getReg(0);
+  auto Instr = Builder.buildInstr(Set ? MOS::TSBAbs : MOS::TRBAbs)
+                   .addUse(BitsReg)
+                   .add(Addr)
+                   .cloneMergedMemRefs({&MI, &Load});
+  if (!constrainSelectedInstRegOperands(*Instr, TII, TRI, RBI))
+    return false;
+  MI.eraseFromParent();
+  return true;
+}
+
 bool MOSInstructionSelector::selectMergeValues(MachineInstr &MI) {
   MachineIRBuilder Builder(MI);
   const MachineRegisterInfo &MRI = *Builder.getMRI();
@@ -1856,6 +2199,65 @@ bool MOSInstructionSelector::selectAddE(MachineInstr &MI) {
   return true;
 }
 
+bool MOSInstructionSelector::selectBCDAddSubE(MachineInstr &MI) {
+  Register Result = MI.getOperand(0).getReg();
+  Register CarryOut = MI.getOperand(1).getReg();
+  Register L = MI.getOperand(2).getReg();
+  Register R = MI.getOperand(3).getReg();
+  Register CarryIn = MI.getOperand(4).getReg();
+  bool IsAdd = MI.getOpcode() == MOS::G_BCD_ADDE;
+
+  MachineIRBuilder Builder(MI);
+  auto &MRI = *Builder.getMRI();
+
+  LLT S1 = LLT::scalar(1);
+
+  MachineInstrBuilder Instr = [&]() {
+    if (IsAdd && getIConstantVRegValWithLookThrough(L, MRI))
+      std::swap(L, R);
+    if (auto RConst = getIConstantVRegValWithLookThrough(R, MRI)) {
+      return Builder.buildInstr(IsAdd ? MOS::ADCDecImm : MOS::SBCDecImm,
+                                {Result, CarryOut, S1},
+                                {L, RConst->Value.getZExtValue(), CarryIn});
+    }
+    return Builder.buildInstr(IsAdd ? MOS::ADCDecImag8 : MOS::SBCDecImag8,
+                              {Result, CarryOut, S1}, {L, R, CarryIn});
+  }();
+  if (!constrainSelectedInstRegOperands(*Instr, TII, TRI, RBI))
+    return false;
+
+  MI.eraseFromParent();
+  return true;
+}
+
+bool MOSInstructionSelector::selectUMul8(MachineInstr &MI) {
+  auto [Lo, Hi, L, R] = MI.getFirst4Regs();
+
+  MachineIRBuilder Builder(MI);
+  auto Instr = Builder.buildInstr(MOS::MULYA, {Lo, Hi}, {L, R});
+  if (!constrainSelectedInstRegOperands(*Instr, TII, TRI, RBI))
+    return false;
+
+  MI.eraseFromParent();
+  return true;
+}
+
+bool MOSInstructionSelector::selectUDivRem8(MachineInstr &MI) {
+  auto [Quot, Rem, L, R] = MI.getFirst4Regs();
+
+  MachineIRBuilder Builder(MI);
+  // The dividend is the 16-bit YA, so its high byte is zero.
+  Register Zero = Builder.buildInstr(MOS::LDImm, {&MOS::YcRegClass}, {})
+                      .addImm(0)
+                      .getReg(0);
+  auto Instr = Builder.buildInstr(MOS::DIVYAX, {Quot, Rem}, {L, Zero, R});
+  if (!constrainSelectedInstRegOperands(*Instr, TII, TRI, RBI))
+    return false;
+
+  MI.eraseFromParent();
+  return true;
+}
+
 bool MOSInstructionSelector::selectIncDecMB(MachineInstr &MI) {
   unsigned Opcode;
   switch (MI.getOpcode()) {
@@ -1950,6 +2352,13 @@ bool MOSInstructionSelector::selectUnMergeValues(MachineInstr &MI) {
 }
 
 bool MOSInstructionSelector::selectBrIndirect(MachineInstr &MI) {
+  // JMP (abs) reads the target from the register's zero page address, but a
+  // function with a base page of its own wrote it on that page.
+  const Function &F = MI.getMF()->getFunction();
+  if (!mos::getBasePage(F).empty())
+    F.getContext().diagnose(DiagnosticInfoUnsupported(
+        F, "indirect branch in a function with its own base page",
+        MI.getDebugLoc()));
   if (STI.hasSPC700()) {
     // SPC700 indirect jumps are indexed by X. Since G_BRINDIRECT does not
     // directly support indexed effective addresses, we simply make X zero.
@@ -1972,6 +2381,9 @@ bool MOSInstructionSelector::selectGeneric(MachineInstr &MI) {
   case MOS::G_BRINDIRECT_IDX:
     Opcode = MOS::JMPIdxIndir;
     break;
+  case MOS::G_BRINDIRECT_RTS:
+    Opcode = MOS::JMPRTS;
+    break;
   case MOS::G_IMPLICIT_DEF:
     Opcode = MOS::IMPLICIT_DEF;
     break;
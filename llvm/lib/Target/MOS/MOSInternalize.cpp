@@ -15,25 +15,29 @@
 //
 // Accordingly, this pass runs after legalization and internalizes any library
 // calls that have liveness contingent on a call being emitted by the legalizer,
-// but where no calls were actually emitted. The pass then runs dead code
-// elimination to strip out such functions and cleans up any data structures
-// that refer to them.
+// but where no calls were actually emitted. The libcalls referenced by the
+// machine code are preserved as roots, and the pass then sweeps away any
+// internal globals that are neither preserved nor used by the remaining IR,
+// cleaning up any data structures that refer to them.
 //
 //===----------------------------------------------------------------------===//
 
 #include "MOSInternalize.h"
 
 #include "MOS.h"
+#include "MOSSplitModule.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SetVector.h"
+#include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/CodeGen/MachineBasicBlock.h"
 #include "llvm/CodeGen/MachineFunction.h"
 #include "llvm/CodeGen/MachineInstr.h"
 #include "llvm/CodeGen/MachineModuleInfo.h"
 #include "llvm/CodeGen/MachineOperand.h"
 #include "llvm/IR/GlobalValue.h"
-#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/InstIterator.h"
 #include "llvm/IR/Module.h"
 #include "llvm/Pass.h"
-#include "llvm/Transforms/IPO/GlobalDCE.h"
 
 #define DEBUG_TYPE "mos-internalize"
 
@@ -44,6 +48,12 @@ namespace {
 class MOSInternalize : public ModulePass {
   MachineModuleInfo *MMI;
 
+  /// The contingent libcalls referenced by each function's machine code.
+  DenseMap<Function *, SmallSetVector<GlobalValue *, 4>> LibcallRefs;
+  /// The number of live functions whose machine code references each
+  /// contingent libcall. Libcalls with a nonzero count are preserved.
+  DenseMap<GlobalValue *, unsigned> Preserved;
+
 public:
   static char ID;
 
@@ -55,13 +65,9 @@ public:
 
   bool runOnModule(Module &M) override;
 
-  DenseMap<std::pair<Function *, GlobalValue *>, Instruction *>
-  insertDummyIRLibcalls(Module &M) const;
-
-  void eraseDummyIRLibcalls(
-      DenseMap<std::pair<Function *, GlobalValue *>, Instruction *>
-          DummyIRLibcalls,
-      const DenseSet<Function *> &ErasedFunctions) const;
+private:
+  void collectLibcallRefs(Module &M);
+  void sweep(SmallVectorImpl<GlobalValue *> &Worklist);
 };
 
 } // namespace
@@ -72,13 +78,18 @@ void MOSInternalize::getAnalysisUsage(AnalysisUsage &AU) const {
 }
 
 bool MOSInternalize::runOnModule(Module &M) {
+  // Other partitions of the LTO module, or other ThinLTO backends, may call
+  // the library functions that this one does not.
+  if (mos::isLTOPartition(M) || mos::isThinLTOBackend())
+    return false;
+
   MMI = &getAnalysis<MachineModuleInfoWrapperPass>().getMMI();
 
-  DenseMap<std::pair<Function *, GlobalValue *>, Instruction *>
-      DummyIRLibcalls = insertDummyIRLibcalls(M);
-  if (DummyIRLibcalls.empty())
+  collectLibcallRefs(M);
+  if (LibcallRefs.empty())
     return false;
 
+  SmallVector<GlobalValue *> Worklist;
   for (GlobalValue &GV : M.global_values()) {
     if (GV.getPartition() != "contingent")
       continue;
@@ -88,31 +99,16 @@ bool MOSInternalize::runOnModule(Module &M) {
       continue;
     GV.setPartition("");
     GV.setLinkage(llvm::GlobalValue::InternalLinkage);
+    Worklist.push_back(&GV);
   }
+  sweep(Worklist);
 
-  DenseSet<Function *> ErasedFunctions;
-  for (Function &F : M)
-    ErasedFunctions.insert(&F);
-
-  GlobalDCEPass DCE;
-  ModuleAnalysisManager AM;
-  DCE.run(M, AM);
-
-  for (Function &F : M)
-    ErasedFunctions.erase(&F);
-
-  for (Function *F : ErasedFunctions)
-    MMI->deleteMachineFunctionFor(*F);
-
-  eraseDummyIRLibcalls(std::move(DummyIRLibcalls), ErasedFunctions);
-
+  LibcallRefs.clear();
+  Preserved.clear();
   return true;
 }
 
-DenseMap<std::pair<Function *, GlobalValue *>, Instruction *>
-MOSInternalize::insertDummyIRLibcalls(Module &M) const {
-  DenseMap<std::pair<Function *, GlobalValue *>, Instruction *> DummyIRLibcalls;
-
+void MOSInternalize::collectLibcallRefs(Module &M) {
   for (Function &F : M) {
     const MachineFunction *MF = MMI->getMachineFunction(F);
     if (!MF)
@@ -131,37 +127,74 @@ MOSInternalize::insertDummyIRLibcalls(Module &M) const {
             Callee = M.getNamedAlias(MO.getSymbolName());
           if (!Callee || Callee->getPartition() != "contingent")
             continue;
-
-          IRBuilder<> Builder(&F.getEntryBlock());
-          std::pair<Function *, GlobalValue *> KV = {&F, Callee};
-          if (DummyIRLibcalls.contains(KV))
-            continue;
-          auto Res = DummyIRLibcalls.try_emplace(
-              KV, Builder.CreateCall(
-                      FunctionType::get(Type::getVoidTy(F.getContext()),
-                                        /*isVarArg=*/false),
-                      Callee));
-          (void)Res;
-          assert(Res.second);
+          if (LibcallRefs[&F].insert(Callee))
+            ++Preserved[Callee];
         }
       }
     }
   }
+}
 
-  return DummyIRLibcalls;
+// Adds the globals referenced by the operands of U to Refs, looking through
+// constant expressions and aggregates.
+static void findReferencedGlobals(User &U, SmallPtrSetImpl<Constant *> &Visited,
+                                  SmallVectorImpl<GlobalValue *> &Refs) {
+  for (Value *Op : U.operands()) {
+    if (auto *GV = dyn_cast_or_null<GlobalValue>(Op)) {
+      Refs.push_back(GV);
+      continue;
+    }
+    auto *C = dyn_cast_or_null<Constant>(Op);
+    if (C && Visited.insert(C).second)
+      findReferencedGlobals(*C, Visited, Refs);
+  }
 }
 
-void MOSInternalize::eraseDummyIRLibcalls(
-    DenseMap<std::pair<Function *, GlobalValue *>, Instruction *>
-        DummyIRLibcalls,
-    const DenseSet<Function *> &ErasedFunctions) const {
-  for (const auto &KV : DummyIRLibcalls) {
-    Function *Caller = KV.first.first;
-    Instruction *I = KV.second;
-    if (ErasedFunctions.contains(Caller))
+// Removes the internal globals in the worklist that are used by neither the
+// IR nor the machine code of the rest of the module. Removing a global may
+// make the globals it referenced dead in turn, so these are revisited.
+void MOSInternalize::sweep(SmallVectorImpl<GlobalValue *> &Worklist) {
+  SmallSetVector<GlobalValue *, 8> Dead;
+  while (!Worklist.empty()) {
+    GlobalValue *GV = Worklist.pop_back_val();
+    if (Dead.contains(GV) || !GV->hasLocalLinkage() || Preserved.lookup(GV))
+      continue;
+    GV->removeDeadConstantUsers();
+    // Recursive calls don't keep a function alive.
+    if (any_of(GV->users(), [&](User *U) {
+          auto *I = dyn_cast<Instruction>(U);
+          return !I || I->getFunction() != GV;
+        }))
       continue;
-    I->eraseFromParent();
+
+    LLVM_DEBUG(dbgs() << "Removing dead global: " << GV->getName() << "\n");
+    Dead.insert(GV);
+    SmallPtrSet<Constant *, 8> Visited;
+    size_t Begin = Worklist.size();
+    if (auto *F = dyn_cast<Function>(GV)) {
+      findReferencedGlobals(*F, Visited, Worklist);
+      for (Instruction &I : instructions(*F))
+        findReferencedGlobals(I, Visited, Worklist);
+      auto It = LibcallRefs.find(F);
+      if (It != LibcallRefs.end()) {
+        for (GlobalValue *Callee : It->second) {
+          --Preserved[Callee];
+          Worklist.push_back(Callee);
+        }
+        LibcallRefs.erase(It);
+      }
+      MMI->deleteMachineFunctionFor(*F);
+    } else {
+      findReferencedGlobals(*GV, Visited, Worklist);
+    }
+    // A global may refer to itself, and that use will soon be gone.
+    Worklist.erase(std::remove(Worklist.begin() + Begin, Worklist.end(), GV),
+                   Worklist.end());
+    GV->dropAllReferences();
   }
+
+  for (GlobalValue *GV : Dead)
+    GV->eraseFromParent();
 }
 
 char MOSInternalize::ID = 0;
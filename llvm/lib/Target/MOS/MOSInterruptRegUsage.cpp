@@ -0,0 +1,114 @@
+//===-- MOSInterruptRegUsage.cpp - MOS Interrupt Register Usage -----------===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines the MOS interrupt register usage pass.
+//
+// An interrupt handler must preserve every register, so whatever its callees
+// may clobber, it saves and restores. Judged by the calling convention, that's
+// A, X, Y, and most of the imaginary registers for any handler that makes a
+// call at all. Whether or not interprocedural register allocation is enabled,
+// this pass narrows the register masks of calls made by interrupt handlers to
+// the registers their callees actually clobber, as recorded by the register
+// usage collector. The pass runs after zero page allocation, a module pass, by
+// which point usage has been collected for every function in the module.
+//
+//===----------------------------------------------------------------------===//
+
+#include "MOSInterruptRegUsage.h"
+
+#include "MOS.h"
+#include "MOSFrameLowering.h"
+#include "MOSSubtarget.h"
+
+#include "llvm/CodeGen/MachineFunctionPass.h"
+#include "llvm/CodeGen/RegisterUsageInfo.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/Debug.h"
+
+#define DEBUG_TYPE "mos-interrupt-reg-usage"
+
+using namespace llvm;
+
+namespace {
+
+struct MOSInterruptRegUsage : public MachineFunctionPass {
+  static char ID;
+
+  MOSInterruptRegUsage() : MachineFunctionPass(ID) {
+    llvm::initializeMOSInterruptRegUsagePass(
+        *PassRegistry::getPassRegistry());
+  }
+
+  bool runOnMachineFunction(MachineFunction &MF) override;
+  void getAnalysisUsage(AnalysisUsage &AU) const override;
+};
+
+} // namespace
+
+static const Function *findCalledFunction(const Module &M,
+                                          const MachineInstr &MI) {
+  for (const MachineOperand &MO : MI.operands()) {
+    if (MO.isGlobal())
+      return dyn_cast<const Function>(MO.getGlobal());
+    if (MO.isSymbol())
+      return M.getFunction(MO.getSymbolName());
+  }
+  return nullptr;
+}
+
+bool MOSInterruptRegUsage::runOnMachineFunction(MachineFunction &MF) {
+  const MOSFrameLowering &TFL =
+      *MF.getSubtarget<MOSSubtarget>().getFrameLowering();
+  if (!TFL.isISR(MF) || !MF.getFrameInfo().hasCalls())
+    return false;
+
+  PhysicalRegisterUsageInfo &PRUI =
+      getAnalysis<PhysicalRegisterUsageInfoWrapperLegacy>().getPRUI();
+  const Module &M = *MF.getFunction().getParent();
+
+  bool Changed = false;
+  for (MachineBasicBlock &MBB : MF) {
+    for (MachineInstr &MI : MBB) {
+      if (!MI.isCall())
+        continue;
+      const Function *F = findCalledFunction(M, MI);
+      if (!F || !F->isDefinitionExact())
+        continue;
+      ArrayRef<uint32_t> RegMask = PRUI.getRegUsageInfo(*F);
+      if (RegMask.empty())
+        continue;
+      LLVM_DEBUG(dbgs() << "Narrowing clobbers of call to " << F->getName()
+                        << " in " << MF.getName() << "\n");
+      for (MachineOperand &MO : MI.operands()) {
+        if (MO.isRegMask()) {
+          MO.setRegMask(RegMask.data());
+          Changed = true;
+        }
+      }
+    }
+  }
+  return Changed;
+}
+
+void MOSInterruptRegUsage::getAnalysisUsage(AnalysisUsage &AU) const {
+  AU.addRequired<PhysicalRegisterUsageInfoWrapperLegacy>();
+  AU.setPreservesAll();
+  MachineFunctionPass::getAnalysisUsage(AU);
+}
+
+char MOSInterruptRegUsage::ID = 0;
+
+INITIALIZE_PASS_BEGIN(MOSInterruptRegUsage, DEBUG_TYPE,
+                      "MOS Interrupt Register Usage", false, false)
+INITIALIZE_PASS_DEPENDENCY(PhysicalRegisterUsageInfoWrapperLegacy)
+INITIALIZE_PASS_END(MOSInterruptRegUsage, DEBUG_TYPE,
+                    "MOS Interrupt Register Usage", false, false)
+
+MachineFunctionPass *llvm::createMOSInterruptRegUsagePass() {
+  return new MOSInterruptRegUsage();
+}
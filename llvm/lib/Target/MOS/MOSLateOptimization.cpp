@@ -12,30 +12,121 @@
 // fully lowered. These optimizations might otherwise increase register pressure
 // and cause spills, so they're done opportunistically at the very end.
 //
+// The immediate values of A, X, Y, C, and V are tracked across blocks, so that
+// a value established in every predecessor, or implied by the branch into a
+// block, can replace the block's own loads of it.
+//
+// The values known whenever an internal function returns, and which of A, X,
+// and Y it leaves unchanged, are recorded as its return state. Calls to it
+// then establish these values too. Under optimization, functions are compiled
+// bottom-up through the call graph from zero page allocation onwards, so
+// callees usually have their return states recorded before their callers
+// reach this pass.
+//
+// On the NMOS 6502, a load of A or X copied into the other becomes one LAX,
+// and a subtraction from or addition to X through A becomes SBX.
+//
+// Adjacent and nested critical sections, delimited by SEI and CLI, are merged
+// when the code between them runs within a bounded number of cycles.
+//
 //===----------------------------------------------------------------------===//
 
 #include "MOSLateOptimization.h"
 
 #include "MCTargetDesc/MOSMCTargetDesc.h"
 #include "MOS.h"
+#include "MOSFrameLowering.h"
 #include "MOSInstrBuilder.h"
+#include "MOSMachineFunctionInfo.h"
 #include "MOSRegisterInfo.h"
 #include "MOSSubtarget.h"
 
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/PostOrderIterator.h"
 #include "llvm/ADT/SmallSet.h"
+#include "llvm/ADT/Statistic.h"
 #include "llvm/CodeGen/GlobalISel/MachineIRBuilder.h"
 #include "llvm/CodeGen/LivePhysRegs.h"
 #include "llvm/CodeGen/MachineBasicBlock.h"
 #include "llvm/CodeGen/MachineInstrBuilder.h"
+#include "llvm/CodeGen/MachineModuleInfo.h"
 #include "llvm/CodeGen/TargetInstrInfo.h"
+#include "llvm/CodeGen/TargetSchedule.h"
 #include "llvm/CodeGen/TargetSubtargetInfo.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/TimeProfiler.h"
+#include <optional>
 
 #define DEBUG_TYPE "mos-late-opt"
 
+STATISTIC(NumCmpZerosFolded,
+          "Number of compares with zero folded into earlier instructions");
+STATISTIC(NumCmpZerosLowered, "Number of compares with zero lowered");
+STATISTIC(NumFlagLoadsErased, "Number of redundant flag loads erased");
+STATISTIC(NumImmLoadsErased, "Number of redundant immediate loads erased");
+STATISTIC(NumImmLoadsReplaced,
+          "Number of immediate loads replaced by transfers, increments and "
+          "decrements");
+STATISTIC(NumLAXs, "Number of load and transfer pairs combined into LAX");
+STATISTIC(NumSBXs, "Number of arithmetic sequences on X combined into SBX");
+STATISTIC(NumTailJumps, "Number of JSR/RTS pairs turned into tail jumps");
+STATISTIC(NumCriticalSectionsMerged,
+          "Number of CLI/SEI pairs merged into one critical section");
+STATISTIC(NumInterruptFlagSetsErased,
+          "Number of redundant SEI and CLI instructions erased");
+STATISTIC(NumKnownValueBlocks,
+          "Number of block visits computing known register values");
+STATISTIC(NumReturnStates, "Number of functions with a known return state");
+
 using namespace llvm;
 
+static cl::opt<unsigned> CriticalSectionMergeCycles(
+    "mos-critical-section-merge-cycles",
+    cl::desc("Most cycles by which merging two critical sections may delay "
+             "an interrupt"),
+    cl::init(20), cl::Hidden);
+
 namespace {
 
+// Values known to be held by registers at a point in the function.
+struct KnownValues {
+  std::optional<int64_t> A, X, Y;
+  std::optional<bool> C, V;
+
+  std::optional<int64_t> &reg(Register Reg) {
+    switch (Reg) {
+    default:
+      llvm_unreachable("Not a GPR.");
+    case MOS::A:
+      return A;
+    case MOS::X:
+      return X;
+    case MOS::Y:
+      return Y;
+    }
+  }
+
+  // Keeps only the values that Other agrees with.
+  void meet(const KnownValues &Other) {
+    if (A != Other.A)
+      A.reset();
+    if (X != Other.X)
+      X.reset();
+    if (Y != Other.Y)
+      Y.reset();
+    if (C != Other.C)
+      C.reset();
+    if (V != Other.V)
+      V.reset();
+  }
+
+  bool operator==(const KnownValues &Other) const {
+    return A == Other.A && X == Other.X && Y == Other.Y && C == Other.C &&
+           V == Other.V;
+  }
+};
+
 class MOSLateOptimization : public MachineFunctionPass {
 public:
   static char ID;
@@ -45,22 +136,387 @@ public:
   }
 
   bool runOnMachineFunction(MachineFunction &MF) override;
+  void getAnalysisUsage(AnalysisUsage &AU) const override;
+  bool annotateCalls(MachineFunction &MF) const;
+  bool recordReturnState(MachineFunction &MF) const;
   bool lowerCmpZeros(MachineBasicBlock &MBB) const;
   void lowerCmpZero(MachineInstr &MI) const;
-  bool combineLdImm(MachineBasicBlock &MBB) const;
+  bool combineLdImm(MachineBasicBlock &MBB, const KnownValues &Entry,
+                    bool &NeedsLiveness) const;
+  bool combineLAX(MachineBasicBlock &MBB) const;
+  bool combineSBX(MachineBasicBlock &MBB) const;
   bool tailJMP(MachineBasicBlock &MBB) const;
+  bool mergeCriticalSections(MachineBasicBlock &MBB,
+                             const TargetSchedModel &SchedModel) const;
+
+private:
+  const MachineModuleInfo *MMI;
 };
 
+// Returns the recorded return state of the function called by MI, if any.
+static const MOSReturnState *getReturnState(const MachineInstr &MI,
+                                            const MachineModuleInfo &MMI) {
+  if (!MI.isCall() || MI.isReturn())
+    return nullptr;
+  const Module &M = *MI.getMF()->getFunction().getParent();
+  const Function *F = nullptr;
+  for (const MachineOperand &MO : MI.operands()) {
+    if (MO.isGlobal()) {
+      F = dyn_cast<Function>(MO.getGlobal());
+      break;
+    }
+    if (MO.isSymbol()) {
+      F = M.getFunction(MO.getSymbolName());
+      break;
+    }
+  }
+  if (!F || !F->hasLocalLinkage())
+    return nullptr;
+  const MachineFunction *CalleeMF = MMI.getMachineFunction(*F);
+  if (!CalleeMF)
+    return nullptr;
+  const auto &ReturnState = CalleeMF->getInfo<MOSFunctionInfo>()->ReturnState;
+  return ReturnState ? &*ReturnState : nullptr;
+}
+
+// Returns the value of GPR Reg on return from a call, given its value at the
+// call.
+static std::optional<int64_t> getReturnValue(const MOSReturnState &Ret,
+                                             Register Reg,
+                                             std::optional<int64_t> AtCall) {
+  switch (Reg) {
+  default:
+    llvm_unreachable("Not a GPR.");
+  case MOS::A:
+    return Ret.PreservesA ? AtCall : Ret.A;
+  case MOS::X:
+    return Ret.PreservesX ? AtCall : Ret.X;
+  case MOS::Y:
+    return Ret.PreservesY ? AtCall : Ret.Y;
+  }
+}
+
+static bool preserves(const MOSReturnState &Ret, Register Reg) {
+  return (Reg == MOS::A && Ret.PreservesA) ||
+         (Reg == MOS::X && Ret.PreservesX) || (Reg == MOS::Y && Ret.PreservesY);
+}
+
+// Updates Known to reflect the execution of MI.
+static void step(const MachineInstr &MI, KnownValues &Known,
+                 const MOSSubtarget &STI, const MachineModuleInfo &MMI) {
+  const auto *TRI = STI.getRegisterInfo();
+
+  // Inline assembly may not describe every flag it changes.
+  if (MI.isInlineAsm()) {
+    Known = KnownValues();
+    return;
+  }
+  const MOSReturnState *Ret = getReturnState(MI, MMI);
+  KnownValues AtCall = Known;
+
+  // Compute the new value of the register defined, if any.
+  Register Dst;
+  std::optional<int64_t> Val;
+  switch (MI.getOpcode()) {
+  case MOS::LDImm:
+    Dst = MI.getOperand(0).getReg();
+    if (MI.getOperand(1).isImm())
+      Val = MI.getOperand(1).getImm() & 0xff;
+    break;
+  case MOS::CL:
+    Dst = MI.getOperand(0).getReg();
+    Val = 0;
+    break;
+  case MOS::TA:
+  case MOS::T_A:
+  case MOS::TX:
+  case MOS::TXRemap:
+    Dst = MI.getOperand(0).getReg();
+    Val = Known.reg(MI.getOperand(1).getReg());
+    break;
+  case MOS::INC:
+  case MOS::DEC:
+    if (!MOS::GPRRegClass.contains(MI.getOperand(0).getReg()))
+      break;
+    Dst = MI.getOperand(0).getReg();
+    Val = Known.reg(Dst);
+    if (Val)
+      Val = (*Val + (MI.getOpcode() == MOS::INC ? 1 : -1)) & 0xff;
+    break;
+  }
+
+  for (Register Reg : {MOS::A, MOS::X, MOS::Y})
+    if (MI.modifiesRegister(Reg, TRI))
+      Known.reg(Reg).reset();
+  if (Dst)
+    Known.reg(Dst) = Val;
+
+  if (MI.getOpcode() == MOS::LDCImm)
+    Known.C = MI.getOperand(1).getImm() != 0;
+  else if (MI.modifiesRegister(MOS::C, TRI))
+    Known.C.reset();
+  if (MI.getOpcode() == MOS::CLV)
+    Known.V = false;
+  else if (MI.modifiesRegister(MOS::V, TRI))
+    Known.V.reset();
+
+  if (!Ret)
+    return;
+  for (Register Reg : {MOS::A, MOS::X, MOS::Y})
+    if (MI.modifiesRegister(Reg, TRI))
+      Known.reg(Reg) = getReturnValue(*Ret, Reg, AtCall.reg(Reg));
+  if (MI.modifiesRegister(MOS::C, TRI))
+    Known.C = Ret->C;
+  if (MI.modifiesRegister(MOS::V, TRI))
+    Known.V = Ret->V;
+}
+
+// Returns the values known on the edge from MBB to Succ, given those known on
+// exit from MBB. A conditional branch on C or V fixes that flag on each edge.
+static KnownValues refineForEdge(const MachineBasicBlock &MBB,
+                                 const MachineBasicBlock &Succ,
+                                 KnownValues Known) {
+  if (MBB.succ_size() != 2)
+    return Known;
+  const MachineInstr *Branch = nullptr;
+  for (const MachineInstr &MI : MBB.terminators()) {
+    if (MI.getOpcode() != MOS::BR)
+      continue;
+    if (Branch)
+      return Known;
+    Branch = &MI;
+  }
+  if (!Branch)
+    return Known;
+  Register Flag = Branch->getOperand(1).getReg();
+  bool Val = Branch->getOperand(2).getImm();
+  bool Taken = Branch->getOperand(0).getMBB() == &Succ;
+  if (Flag == MOS::C)
+    Known.C = Taken ? Val : !Val;
+  else if (Flag == MOS::V)
+    Known.V = Taken ? Val : !Val;
+  return Known;
+}
+
+// Computes the values known on entry to each block by forward dataflow.
+static DenseMap<const MachineBasicBlock *, KnownValues>
+computeEntryValues(MachineFunction &MF, const MachineModuleInfo &MMI) {
+  const MOSSubtarget &STI = MF.getSubtarget<MOSSubtarget>();
+  ReversePostOrderTraversal<MachineFunction *> RPOT(&MF);
+
+  DenseMap<const MachineBasicBlock *, KnownValues> Entry, Exit;
+  bool Changed = true;
+  while (Changed) {
+    Changed = false;
+    for (MachineBasicBlock *MBB : RPOT) {
+      // Predecessors not yet visited are ignored; they are only ever refined.
+      std::optional<KnownValues> In;
+      if (MBB != &MF.front() && !MBB->isEHPad() &&
+          !MBB->hasAddressTaken()) {
+        for (const MachineBasicBlock *Pred : MBB->predecessors()) {
+          auto It = Exit.find(Pred);
+          if (It == Exit.end())
+            continue;
+          KnownValues Edge = refineForEdge(*Pred, *MBB, It->second);
+          if (In)
+            In->meet(Edge);
+          else
+            In = Edge;
+        }
+      }
+      if (!In)
+        In = KnownValues();
+
+      auto EntryIt = Entry.find(MBB);
+      if (EntryIt != Entry.end() && EntryIt->second == *In)
+        continue;
+      Changed = true;
+      ++NumKnownValueBlocks;
+      Entry[MBB] = *In;
+      for (const MachineInstr &MI : *MBB)
+        step(MI, *In, STI, MMI);
+      Exit[MBB] = *In;
+    }
+  }
+  return Entry;
+}
+
 bool MOSLateOptimization::runOnMachineFunction(MachineFunction &MF) {
+  TimeTraceScope Scope("MOSLateOptimization", MF.getName());
+  MMI = &getAnalysis<MachineModuleInfoWrapperPass>().getMMI();
   bool Changed = false;
-  for (MachineBasicBlock &MBB : MF) {
+  for (MachineBasicBlock &MBB : MF)
     Changed |= lowerCmpZeros(MBB);
-    Changed |= combineLdImm(MBB);
+
+  const MOSSubtarget &STI = MF.getSubtarget<MOSSubtarget>();
+  if (STI.has6502X() && !MF.getFunction().hasOptNone()) {
+    for (MachineBasicBlock &MBB : MF) {
+      Changed |= combineLAX(MBB);
+      Changed |= combineSBX(MBB);
+    }
+  }
+
+  if (!MF.getFunction().hasOptNone())
+    Changed |= annotateCalls(MF);
+  DenseMap<const MachineBasicBlock *, KnownValues> Entry =
+      computeEntryValues(MF, *MMI);
+  if (!MF.getFunction().hasOptNone() && CriticalSectionMergeCycles) {
+    TargetSchedModel SchedModel;
+    SchedModel.init(&MF.getSubtarget());
+    for (MachineBasicBlock &MBB : MF)
+      Changed |= mergeCriticalSections(MBB, SchedModel);
+  }
+
+  bool NeedsLiveness = false;
+  for (MachineBasicBlock &MBB : MF) {
+    Changed |= combineLdImm(MBB, Entry.lookup(&MBB), NeedsLiveness);
     Changed |= tailJMP(MBB);
   }
+
+  const MOSFrameLowering &TFL = *STI.getFrameLowering();
+  if (!MF.getFunction().hasOptNone() && MF.getFunction().hasLocalLinkage() &&
+      !TFL.isISR(MF) && recordReturnState(MF)) {
+    Changed = true;
+    NeedsLiveness = true;
+  }
+
+  // Values reused from predecessors must now be live into their blocks.
+  if (NeedsLiveness) {
+    SmallVector<MachineBasicBlock *> MBBs;
+    for (MachineBasicBlock &MBB : MF)
+      MBBs.push_back(&MBB);
+    fullyRecomputeLiveIns(MBBs);
+    for (MachineBasicBlock &MBB : MF)
+      recomputeLivenessFlags(MBB);
+  }
+  return Changed;
+}
+
+void MOSLateOptimization::getAnalysisUsage(AnalysisUsage &AU) const {
+  AU.addRequired<MachineModuleInfoWrapperPass>();
+  AU.addPreserved<MachineModuleInfoWrapperPass>();
+  MachineFunctionPass::getAnalysisUsage(AU);
+}
+
+// Gives each call to a function with a recorded return state implicit
+// definitions of the registers whose values it establishes, so that uses of
+// those values after the call have a definition to be live from.
+bool MOSLateOptimization::annotateCalls(MachineFunction &MF) const {
+  const auto *TRI = MF.getSubtarget().getRegisterInfo();
+  bool Changed = false;
+  for (MachineBasicBlock &MBB : MF) {
+    for (MachineInstr &MI : MBB) {
+      const MOSReturnState *Ret = getReturnState(MI, *MMI);
+      if (!Ret)
+        continue;
+      auto Define = [&](Register Reg, bool Known) {
+        if (!Known || !MI.modifiesRegister(Reg, TRI) ||
+            MI.definesRegister(Reg, TRI))
+          return;
+        MI.addOperand(MF, MachineOperand::CreateReg(Reg, /*isDef=*/true,
+                                                    /*isImp=*/true,
+                                                    /*isKill=*/false,
+                                                    /*isDead=*/true));
+        Changed = true;
+      };
+      Define(MOS::A, Ret->A || Ret->PreservesA);
+      Define(MOS::X, Ret->X || Ret->PreservesX);
+      Define(MOS::Y, Ret->Y || Ret->PreservesY);
+      Define(MOS::C, Ret->C.has_value());
+      Define(MOS::V, Ret->V.has_value());
+    }
+  }
   return Changed;
 }
 
+// Records the values known on every return from MF, and whether A, X, and Y
+// are left unchanged, in its return state. Returns whether anything is known.
+bool MOSLateOptimization::recordReturnState(MachineFunction &MF) const {
+  const MOSSubtarget &STI = MF.getSubtarget<MOSSubtarget>();
+  const auto *TRI = STI.getRegisterInfo();
+
+  // A GPR is unchanged if nothing but calls that preserve it modifies it.
+  MOSReturnState State;
+  State.PreservesA = State.PreservesX = State.PreservesY = true;
+  auto ClearPreserves = [&](Register Reg) {
+    switch (Reg) {
+    case MOS::A:
+      State.PreservesA = false;
+      break;
+    case MOS::X:
+      State.PreservesX = false;
+      break;
+    case MOS::Y:
+      State.PreservesY = false;
+      break;
+    }
+  };
+
+  DenseMap<const MachineBasicBlock *, KnownValues> Entry =
+      computeEntryValues(MF, *MMI);
+  std::optional<KnownValues> AtReturn;
+  SmallVector<MachineInstr *> Returns;
+  for (MachineBasicBlock &MBB : MF) {
+    KnownValues Known = Entry.lookup(&MBB);
+    for (MachineInstr &MI : MBB) {
+      if (MI.isInlineAsm()) {
+        State.PreservesA = State.PreservesX = State.PreservesY = false;
+      } else {
+        const MOSReturnState *Ret = getReturnState(MI, *MMI);
+        for (Register Reg : {MOS::A, MOS::X, MOS::Y})
+          if (MI.modifiesRegister(Reg, TRI) && !(Ret && preserves(*Ret, Reg)))
+            ClearPreserves(Reg);
+      }
+
+      if (MI.isReturn()) {
+        // The state on return from a tail call is the callee's.
+        if (MI.isCall())
+          return false;
+        if (AtReturn)
+          AtReturn->meet(Known);
+        else
+          AtReturn = Known;
+        Returns.push_back(&MI);
+      }
+      step(MI, Known, STI, *MMI);
+    }
+  }
+  if (!AtReturn)
+    return false;
+
+  if (!State.PreservesA)
+    State.A = AtReturn->A;
+  if (!State.PreservesX)
+    State.X = AtReturn->X;
+  if (!State.PreservesY)
+    State.Y = AtReturn->Y;
+  State.C = AtReturn->C;
+  State.V = AtReturn->V;
+
+  SmallVector<Register> Used;
+  if (State.A || State.PreservesA)
+    Used.push_back(MOS::A);
+  if (State.X || State.PreservesX)
+    Used.push_back(MOS::X);
+  if (State.Y || State.PreservesY)
+    Used.push_back(MOS::Y);
+  if (State.C)
+    Used.push_back(MOS::C);
+  if (State.V)
+    Used.push_back(MOS::V);
+  if (Used.empty())
+    return false;
+
+  for (MachineInstr *MI : Returns)
+    for (Register Reg : Used)
+      if (!MI->readsRegister(Reg, TRI))
+        MI->addOperand(MF, MachineOperand::CreateReg(Reg, /*isDef=*/false,
+                                                     /*isImp=*/true));
+  MF.getInfo<MOSFunctionInfo>()->ReturnState = State;
+  ++NumReturnStates;
+  return true;
+}
+
 static bool definesNZ(const MachineInstr &MI, Register Val, const MOSSubtarget &STI) {
   if (MI.getOpcode() == MOS::CL)
     return false;
@@ -106,6 +562,7 @@ bool MOSLateOptimization::lowerCmpZeros(MachineBasicBlock &MBB) const {
         break;
       if (definesNZ(J, Val, STI)) {
         Changed = true;
+        ++NumCmpZerosFolded;
         J.addOperand(MachineOperand::CreateReg(MOS::NZ, /*isDef=*/true,
                                                /*isImp=*/true));
         MI.eraseFromParent();
@@ -140,6 +597,7 @@ bool MOSLateOptimization::lowerCmpZeros(MachineBasicBlock &MBB) const {
 
     Changed = true;
     lowerCmpZero(MI);
+    ++NumCmpZerosLowered;
   }
   return Changed;
 }
@@ -251,7 +709,12 @@ void MOSLateOptimization::lowerCmpZero(MachineInstr &MI) const {
 // Replaces immediate register loads with register transfers
 // and increments/decrements.
 // The resulting code is just as fast, but shorter.
-bool MOSLateOptimization::combineLdImm(MachineBasicBlock &MBB) const {
+// Loads of values that a register or flag is already known to hold are
+// removed entirely. Entry gives the values known on entry to the block; if any
+// of them are used, NeedsLiveness is set, since the registers become live-in.
+bool MOSLateOptimization::combineLdImm(MachineBasicBlock &MBB,
+                                       const KnownValues &Entry,
+                                       bool &NeedsLiveness) const {
   const auto &TII = *MBB.getParent()->getSubtarget().getInstrInfo();
   const auto *TRI = MBB.getParent()->getSubtarget().getRegisterInfo();
   const MOSSubtarget &STI = MBB.getParent()->getSubtarget<MOSSubtarget>();
@@ -259,16 +722,62 @@ bool MOSLateOptimization::combineLdImm(MachineBasicBlock &MBB) const {
   bool Changed = false;
 
   struct ImmLoad {
-    // nullptr means exact register value is unknown.
-    // Otherwise, points to the instruction that recently loaded this register.
+    // Whether the exact register value is known.
+    bool Known = false;
+    // Points to the instruction that recently loaded this register, or nullptr
+    // if the value was established before the block.
     MachineInstr *MI = nullptr;
     // Current register value.
     int64_t Val;
   } LoadA, LoadX, LoadY;
 
-  for (MachineInstr &MI : MBB) {
+  const auto Seed = [](ImmLoad &Load, std::optional<int64_t> Val) {
+    Load.Known = Val.has_value();
+    Load.Val = Val.value_or(0);
+  };
+  Seed(LoadA, Entry.A);
+  Seed(LoadX, Entry.X);
+  Seed(LoadY, Entry.Y);
+  std::optional<bool> Carry = Entry.C, Overflow = Entry.V;
+
+  for (MachineInstr &MI : make_early_inc_range(MBB)) {
+    if (MI.isInlineAsm()) {
+      LoadA.Known = LoadX.Known = LoadY.Known = false;
+      Carry.reset();
+      Overflow.reset();
+      continue;
+    }
+
+    // Drop flag loads that would not change the flag.
+    if (MI.getOpcode() == MOS::LDCImm || MI.getOpcode() == MOS::CLV) {
+      std::optional<bool> &Flag =
+          MI.getOpcode() == MOS::LDCImm ? Carry : Overflow;
+      bool Val =
+          MI.getOpcode() == MOS::LDCImm && MI.getOperand(1).getImm() != 0;
+      if (Flag == Val) {
+        MI.eraseFromParent();
+        ++NumFlagLoadsErased;
+        Changed = true;
+        NeedsLiveness = true;
+      } else {
+        Flag = Val;
+      }
+      continue;
+    }
+    if (MI.modifiesRegister(MOS::C, TRI))
+      Carry.reset();
+    if (MI.modifiesRegister(MOS::V, TRI))
+      Overflow.reset();
+    const MOSReturnState *Ret = getReturnState(MI, *MMI);
+    if (Ret) {
+      if (MI.modifiesRegister(MOS::C, TRI))
+        Carry = Ret->C;
+      if (MI.modifiesRegister(MOS::V, TRI))
+        Overflow = Ret->V;
+    }
+
     ImmLoad *Load = nullptr;
-    if (MI.getOpcode() == MOS::TA && LoadA.MI) {
+    if (MI.getOpcode() == MOS::TA && LoadA.Known) {
       // We see a TAX or TAY and know the accumulator value.
       // TODO: handle TXA, TYA, TXY, TYX, maybe INX etc.
       switch (MI.getOperand(0).getReg()) {
@@ -280,6 +789,7 @@ bool MOSLateOptimization::combineLdImm(MachineBasicBlock &MBB) const {
         break;
       }
       // Copy A value to X or Y.
+      Load->Known = true;
       Load->MI = &MI;
       Load->Val = LoadA.Val;
       continue;
@@ -287,30 +797,50 @@ bool MOSLateOptimization::combineLdImm(MachineBasicBlock &MBB) const {
 
     if (MI.getOpcode() != MOS::LDImm || !MI.getOperand(1).isImm()) {
       // If a register is overwritten with an instruction other than
-      // an immediate load, mark register value as unknown.
-      if (MI.modifiesRegister(MOS::A, TRI))
-        LoadA.MI = nullptr;
-      if (MI.modifiesRegister(MOS::X, TRI))
-        LoadX.MI = nullptr;
-      if (MI.modifiesRegister(MOS::Y, TRI))
-        LoadY.MI = nullptr;
+      // an immediate load, mark register value as unknown, unless it's a call
+      // whose return state gives the value.
+      for (auto [Reg, Load] :
+           {std::pair(MOS::A, &LoadA), std::pair(MOS::X, &LoadX),
+            std::pair(MOS::Y, &LoadY)}) {
+        if (!MI.modifiesRegister(Reg, TRI))
+          continue;
+        std::optional<int64_t> Val;
+        if (Ret)
+          Val = getReturnValue(*Ret, Reg,
+                               Load->Known ? std::optional(Load->Val)
+                                           : std::nullopt);
+        Load->Known = Val.has_value();
+        Load->MI = nullptr;
+        Load->Val = Val.value_or(0);
+      }
       continue;
     }
 
     // Process LD_ #.
     Register Dst = MI.getOperand(0).getReg();
-    int64_t Val = MI.getOperand(1).getImm();
+    int64_t Val = MI.getOperand(1).getImm() & 0xff;
+
+    // Drop the load if the register already holds the value, unless a compare
+    // with zero was folded into it.
+    ImmLoad &Cur = Dst == MOS::A ? LoadA : Dst == MOS::X ? LoadX : LoadY;
+    if (Cur.Known && Cur.Val == Val && !MI.definesRegister(MOS::NZ, TRI)) {
+      MI.eraseFromParent();
+      ++NumImmLoadsErased;
+      Changed = true;
+      NeedsLiveness = true;
+      continue;
+    }
 
     // Try to replace with T__.
     switch (Dst) {
     case MOS::A: {
       Register Src;
-      if (LoadX.MI && LoadX.Val == Val) {
+      if (LoadX.Known && LoadX.Val == Val) {
         // LDA #imm -> TXA if X==imm
         Src = MOS::X;
         Load = &LoadX;
       }
-      if (LoadY.MI && LoadY.Val == Val) {
+      if (LoadY.Known && LoadY.Val == Val) {
         // LDA #imm -> TYA if Y==imm
         Src = MOS::Y;
         Load = &LoadY;
@@ -323,17 +853,17 @@ bool MOSLateOptimization::combineLdImm(MachineBasicBlock &MBB) const {
     }
     case MOS::X:
     case MOS::Y:
-      if (LoadA.MI && LoadA.Val == Val) {
+      if (LoadA.Known && LoadA.Val == Val) {
         // LDX/LDY #imm -> TAX/TAY if A==imm
         Load = &LoadA;
         MI.setDesc(TII.get(MOS::TA));
         MI.getOperand(1).ChangeToRegister(MOS::A, /*isDef=*/false);
       } else if (STI.hasW65816Or65EL02()) {
-        if (Dst == MOS::X && LoadY.MI && LoadY.Val == Val) {
+        if (Dst == MOS::X && LoadY.Known && LoadY.Val == Val) {
           // LDX #imm -> TYX if Y==imm
           MI.setDesc(TII.get(MOS::TX));
           MI.getOperand(1).ChangeToRegister(MOS::Y, /*isDef=*/false);
-        } else if (Dst == MOS::Y && LoadX.MI && LoadX.Val == Val) {
+        } else if (Dst == MOS::Y && LoadX.Known && LoadX.Val == Val) {
           // LDY #imm -> TXY if X==imm
           MI.setDesc(TII.get(MOS::TX));
           MI.getOperand(1).ChangeToRegister(MOS::X, /*isDef=*/false);
@@ -347,15 +877,15 @@ bool MOSLateOptimization::combineLdImm(MachineBasicBlock &MBB) const {
       switch (Dst) {
       case MOS::A:
         if (STI.hasGPRIncDec())
-          if (LoadA.MI && std::abs(LoadA.Val - Val) == 1)
+          if (LoadA.Known && std::abs(LoadA.Val - Val) == 1)
             Load = &LoadA; // LDA # -> INA/DEA
         break;
       case MOS::X:
-        if (LoadX.MI && std::abs(LoadX.Val - Val) == 1)
+        if (LoadX.Known && std::abs(LoadX.Val - Val) == 1)
           Load = &LoadX; // LDX # -> INX/DEX
         break;
       case MOS::Y:
-        if (LoadY.MI && std::abs(LoadY.Val - Val) == 1)
+        if (LoadY.Known && std::abs(LoadY.Val - Val) == 1)
           Load = &LoadY; // LDY # -> INY/DEY
         break;
       }
@@ -371,10 +901,16 @@ bool MOSLateOptimization::combineLdImm(MachineBasicBlock &MBB) const {
     if (Load) {
       // Replace LD_ # with T__, IN_ or DE_.
       Changed = true;
-      Load->MI->getOperand(0).setIsDead(false);
-      for (MachineInstr &J : make_range(MachineBasicBlock::iterator(Load->MI),
-                                        MachineBasicBlock::iterator(MI)))
-        J.clearRegisterKills(Load->MI->getOperand(0).getReg(), TRI);
+      ++NumImmLoadsReplaced;
+      if (Load->MI) {
+        Load->MI->getOperand(0).setIsDead(false);
+        for (MachineInstr &J :
+             make_range(MachineBasicBlock::iterator(Load->MI),
+                        MachineBasicBlock::iterator(MI)))
+          J.clearRegisterKills(Load->MI->getOperand(0).getReg(), TRI);
+      } else {
+        NeedsLiveness = true;
+      }
     }
 
     // Store this instruction (changed or not) and the new register value.
@@ -390,12 +926,126 @@ bool MOSLateOptimization::combineLdImm(MachineBasicBlock &MBB) const {
       break;
     }
 
+    Load->Known = true;
     Load->MI = &MI;
     Load->Val = Val;
   }
   return Changed;
 }
 
+// Returns the LAX with the same addressing mode as Load, a load of A or X, or
+// 0 if there is none.
+static unsigned getLAXOpcode(const MachineInstr &Load) {
+  Register Dst = Load.getOperand(0).getReg();
+  if (Dst != MOS::A && Dst != MOS::X)
+    return 0;
+  switch (Load.getOpcode()) {
+  default:
+    return 0;
+  case MOS::LDImag8:
+    return MOS::LAXImag8;
+  case MOS::LDAbs:
+    return MOS::LAXAbs;
+  case MOS::LDAAbsIdx:
+    return Load.getOperand(2).getReg() == MOS::Y ? MOS::LAXIdx : 0;
+  case MOS::LDXIdx:
+    return MOS::LAXIdx;
+  case MOS::LDIndirIdx:
+    return MOS::LAXIndirIdx;
+  }
+}
+
+// Combines LDA followed by TAX, or LDX followed by TXA, into LAX. Both set NZ
+// from the value loaded.
+bool MOSLateOptimization::combineLAX(MachineBasicBlock &MBB) const {
+  const auto &TII = *MBB.getParent()->getSubtarget().getInstrInfo();
+  bool Changed = false;
+  for (auto It = MBB.begin(); It != MBB.end();) {
+    MachineInstr &MI = *It++;
+    unsigned Opcode = getLAXOpcode(MI);
+    if (!Opcode)
+      continue;
+    auto Next = It;
+    if (Next == MBB.end())
+      continue;
+    // The transfer must copy the register just loaded to the other one; TYA
+    // after LDX or TAY after LDA would not leave both holding the load.
+    bool IsA = MI.getOperand(0).getReg() == MOS::A;
+    if (Next->getOpcode() != (IsA ? MOS::TA : MOS::T_A) ||
+        Next->getOperand(0).getReg() != (IsA ? MOS::X : MOS::A) ||
+        Next->getOperand(1).getReg() != (IsA ? MOS::A : MOS::X))
+      continue;
+
+    auto LAX = BuildMI(MBB, MI, MI.getDebugLoc(), TII.get(Opcode))
+                   .addDef(MOS::A)
+                   .addDef(MOS::X);
+    for (unsigned I = 1, E = MI.getNumExplicitOperands(); I != E; ++I)
+      LAX.add(MI.getOperand(I));
+    LAX.cloneMemRefs(MI);
+    ++It;
+    Next->eraseFromParent();
+    MI.eraseFromParent();
+    ++NumLAXs;
+    Changed = true;
+  }
+  return Changed;
+}
+
+// Combines TXA; SEC; SBC #imm; TAX into TXA; SBX #imm, and likewise TXA; CLC;
+// ADC #imm; TAX into TXA; SBX #-imm if the carry out is unused. SBX computes
+// (A & X) - imm, which is X - imm once A holds X, and leaves A with the old
+// value of X and V unchanged, so neither may be used afterwards.
+bool MOSLateOptimization::combineSBX(MachineBasicBlock &MBB) const {
+  const auto &TII = *MBB.getParent()->getSubtarget().getInstrInfo();
+  const auto *TRI = MBB.getParent()->getSubtarget().getRegisterInfo();
+  bool Changed = false;
+  for (auto It = MBB.begin(); It != MBB.end();) {
+    MachineInstr &MI = *It++;
+    if (MI.getOpcode() != MOS::T_A || MI.getOperand(0).getReg() != MOS::A ||
+        MI.getOperand(1).getReg() != MOS::X)
+      continue;
+    auto SetC = It;
+    if (SetC == MBB.end() || SetC->getOpcode() != MOS::LDCImm)
+      continue;
+    auto Op = std::next(SetC);
+    if (Op == MBB.end())
+      continue;
+    bool IsSub = SetC->getOperand(1).getImm() != 0;
+    if (Op->getOpcode() != (IsSub ? MOS::SBCImm : MOS::ADCImm) ||
+        !Op->getOperand(4).isImm())
+      continue;
+    auto TAX = std::next(Op);
+    if (TAX == MBB.end() || TAX->getOpcode() != MOS::TA ||
+        TAX->getOperand(0).getReg() != MOS::X)
+      continue;
+
+    auto After = std::next(TAX);
+    SmallVector<Register, 3> MustBeDead = {MOS::A, MOS::V};
+    if (!IsSub)
+      MustBeDead.push_back(MOS::C);
+    if (any_of(MustBeDead, [&](Register Reg) {
+          return MBB.computeRegisterLiveness(TRI, Reg, After) !=
+                 MachineBasicBlock::LQR_Dead;
+        }))
+      continue;
+
+    int64_t Imm = Op->getOperand(4).getImm();
+    BuildMI(MBB, After, TAX->getDebugLoc(), TII.get(MOS::SBXImm))
+        .addDef(MOS::X)
+        .addDef(MOS::C, getDeadRegState(!IsSub))
+        .addUse(MOS::A)
+        .addUse(MOS::X)
+        .addImm((IsSub ? Imm : -Imm) & 0xff);
+    It = After;
+    TAX->eraseFromParent();
+    Op->eraseFromParent();
+    SetC->eraseFromParent();
+    ++NumSBXs;
+    Changed = true;
+  }
+  return Changed;
+}
+
 bool MOSLateOptimization::tailJMP(MachineBasicBlock &MBB) const {
   if (MBB.size() < 2)
     return false;
@@ -409,15 +1059,99 @@ bool MOSLateOptimization::tailJMP(MachineBasicBlock &MBB) const {
   MachineInstr &JSR = *It;
   RTS.eraseFromParent();
   JSR.setDesc(JSR.getMF()->getSubtarget().getInstrInfo()->get(MOS::TailJMP));
+  ++NumTailJumps;
   return true;
 }
 
+// Returns whether MI may change the interrupt disable flag, or make it matter
+// what the flag's value is.
+static bool mayChangeInterruptFlag(const MachineInstr &MI) {
+  if (MI.isCall() || MI.isReturn() || MI.isInlineAsm())
+    return true;
+  switch (MI.getOpcode()) {
+  default:
+    return false;
+  case MOS::CLI_Implied:
+  case MOS::SEI_Implied:
+  case MOS::PHP_Implied:
+  case MOS::PLP_Implied:
+  case MOS::RTI_Implied:
+    return true;
+  case MOS::PH:
+  case MOS::PL:
+    return MI.getOperand(0).getReg() == MOS::P;
+  }
+}
+
+// A CLI followed closely by an SEI only briefly lets pending interrupts in,
+// so CLI ... SEI becomes SEI ..., delaying them by the code in between. An
+// SEI or CLI that doesn't change the flag is erased.
+bool MOSLateOptimization::mergeCriticalSections(
+    MachineBasicBlock &MBB, const TargetSchedModel &SchedModel) const {
+  const TargetInstrInfo &TII = *MBB.getParent()->getSubtarget().getInstrInfo();
+  bool Changed = false;
+  // Whether interrupts are known to be disabled, if this is known.
+  std::optional<bool> Disabled;
+  for (auto I = MBB.begin(), E = MBB.end(); I != E;) {
+    MachineInstr &MI = *I++;
+    unsigned Opcode = MI.getOpcode();
+    if (Opcode != MOS::SEI_Implied && Opcode != MOS::CLI_Implied) {
+      if (mayChangeInterruptFlag(MI))
+        Disabled.reset();
+      continue;
+    }
+
+    bool IsSEI = Opcode == MOS::SEI_Implied;
+    if (Disabled == IsSEI) {
+      MI.eraseFromParent();
+      ++NumInterruptFlagSetsErased;
+      Changed = true;
+      continue;
+    }
+    bool WasDisabled = Disabled == true;
+    Disabled = IsSEI;
+    if (IsSEI)
+      continue;
+
+    unsigned Cycles = 0;
+    MachineInstr *SEI = nullptr;
+    for (MachineInstr &Next : make_range(I, E)) {
+      if (Next.getOpcode() == MOS::SEI_Implied) {
+        SEI = &Next;
+        break;
+      }
+      if (mayChangeInterruptFlag(Next))
+        break;
+      Cycles += SchedModel.computeInstrLatency(&Next);
+      if (Cycles > CriticalSectionMergeCycles)
+        break;
+    }
+    if (!SEI)
+      continue;
+
+    if (I == SEI->getIterator())
+      ++I;
+    SEI->eraseFromParent();
+    if (WasDisabled)
+      MI.eraseFromParent();
+    else
+      MI.setDesc(TII.get(MOS::SEI_Implied));
+    Disabled = true;
+    ++NumCriticalSectionsMerged;
+    Changed = true;
+  }
+  return Changed;
+}
+
 } // namespace
 
 char MOSLateOptimization::ID = 0;
 
-INITIALIZE_PASS(MOSLateOptimization, DEBUG_TYPE, "MOS Late Optimizations",
-                false, false)
+INITIALIZE_PASS_BEGIN(MOSLateOptimization, DEBUG_TYPE,
+                      "MOS Late Optimizations", false, false)
+INITIALIZE_PASS_DEPENDENCY(MachineModuleInfoWrapperPass)
+INITIALIZE_PASS_END(MOSLateOptimization, DEBUG_TYPE, "MOS Late Optimizations",
+                    false, false)
 
 MachineFunctionPass *llvm::createMOSLateOptimizationPass() {
   return new MOSLateOptimization;
@@ -20,6 +20,7 @@
 #include "MCTargetDesc/MOSMCTargetDesc.h"
 #include "MOS.h"
 #include "MOSFrameLowering.h"
+#include "MOSInstrCost.h"
 #include "MOSInstrInfo.h"
 #include "MOSMachineFunctionInfo.h"
 #include "MOSRegisterInfo.h"
@@ -47,11 +48,14 @@
 #include "llvm/CodeGen/TargetOpcodes.h"
 #include "llvm/CodeGen/TargetRegisterInfo.h"
 #include "llvm/Demangle/Demangle.h"
+#include "llvm/IR/Constants.h"
 #include "llvm/IR/GlobalVariable.h"
 #include "llvm/IR/InstrTypes.h"
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/Intrinsics.h"
+#include "llvm/IR/IntrinsicsMOS.h"
 #include "llvm/IR/RuntimeLibcalls.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/ErrorHandling.h"
 #include "llvm/Support/MathExtras.h"
 
@@ -59,6 +63,25 @@ using namespace llvm;
 using namespace TargetOpcode;
 using namespace MIPatternMatch;
 
+static cl::opt<bool> InlineMulDiv(
+    "mos-inline-mul-div",
+    cl::desc("Expand 8 and 16-bit multiplies and 8-bit unsigned divides inline "
+             "instead of calling the runtime library, unless optimizing for "
+             "size"),
+    cl::init(false), cl::Hidden);
+
+static cl::opt<bool> CompactTraps(
+    "mos-compact-traps",
+    cl::desc("Lower traps to BRK followed by a trap ID instead of calling "
+             "abort; the program must provide a BRK handler"),
+    cl::init(false), cl::Hidden);
+
+static cl::opt<bool> UseMEGA65DMA(
+    "mos-mega65-dma",
+    cl::desc("Allow memory copies and sets to use the MEGA65 DMA controller "
+             "on the 45GS02"),
+    cl::init(false), cl::Hidden);
+
 MOSLegalizerInfo::MOSLegalizerInfo(const MOSSubtarget &STI) {
   using namespace LegalityPredicates;
   using namespace LegalizeMutations;
@@ -162,7 +185,9 @@ MOSLegalizerInfo::MOSLegalizerInfo(const MOSSubtarget &STI) {
       .unsupported();
 
   getActionDefinitionsBuilder(G_MUL)
-      .libcallFor({S8, S16, S32, S64})
+      .customFor({S8, S16})
+      .customFor(STI.hasMEGA65Math(), {S32})
+      .libcallFor({S32, S64})
       .widenScalarToNextPow2(0)
       // Multiplications can only be narrowed to sizes where a multiplication of
       // double that size is legal, since that's the lowered algorithm invokes
@@ -171,7 +196,14 @@ MOSLegalizerInfo::MOSLegalizerInfo(const MOSSubtarget &STI) {
       .clampScalar(0, S8, S32)
       .unsupported();
 
-  getActionDefinitionsBuilder({G_SDIV, G_SREM, G_UDIV, G_UREM})
+  getActionDefinitionsBuilder({G_UDIV, G_UREM})
+      .customFor({S8, S16})
+      .customFor(STI.hasMEGA65Math(), {S32})
+      .clampScalar(0, S8, S64)
+      .widenScalarToNextPow2(0)
+      .libcall();
+
+  getActionDefinitionsBuilder({G_SDIV, G_SREM})
       .clampScalar(0, S8, S64)
       .widenScalarToNextPow2(0)
       .libcall();
@@ -184,6 +216,12 @@ MOSLegalizerInfo::MOSLegalizerInfo(const MOSSubtarget &STI) {
       {G_SADDSAT, G_UADDSAT, G_SSUBSAT, G_USUBSAT, G_SSHLSAT, G_USHLSAT})
       .lower();
 
+  getActionDefinitionsBuilder({G_SMULFIX, G_UMULFIX, G_SMULFIXSAT,
+                               G_UMULFIXSAT, G_SDIVFIX, G_UDIVFIX,
+                               G_SDIVFIXSAT, G_UDIVFIXSAT})
+      .customFor({S8, S16, S32})
+      .unsupported();
+
   getActionDefinitionsBuilder({G_LSHR, G_SHL, G_ASHR})
       .widenScalarToNextMultipleOf(0, 8)
       .maxScalar(1, S8)
@@ -251,11 +289,11 @@ MOSLegalizerInfo::MOSLegalizerInfo(const MOSSubtarget &STI) {
 
   // Floating Point Operations
 
-  getActionDefinitionsBuilder({G_FADD,
-                               G_FSUB,
-                               G_FMUL,
-                               G_FDIV,
-                               G_FMA,
+  getActionDefinitionsBuilder({G_FADD, G_FSUB, G_FMUL, G_FDIV})
+      .customFor({S32})
+      .libcallFor({S64});
+
+  getActionDefinitionsBuilder({G_FMA,
                                G_FREM,
                                G_FPOW,
                                G_FEXP,
@@ -358,6 +396,18 @@ MOSLegalizerInfo::MOSLegalizerInfo(const MOSSubtarget &STI) {
   verify(*STI.getInstrInfo());
 }
 
+// The rules depend only on the features checked here; the custom legalizations
+// query the subtarget of the function being legalized. Function-local statics
+// make building each table lazy and thread-safe.
+const MOSLegalizerInfo &MOSLegalizerInfo::get(const MOSSubtarget &STI) {
+  if (STI.hasMEGA65Math()) {
+    static const MOSLegalizerInfo MEGA65Math(STI);
+    return MEGA65Math;
+  }
+  static const MOSLegalizerInfo Base(STI);
+  return Base;
+}
+
 bool MOSLegalizerInfo::legalizeIntrinsic(LegalizerHelper &Helper,
                                          MachineInstr &MI) const {
   LLT P = LLT::pointer(0, 16);
@@ -409,6 +459,47 @@ bool MOSLegalizerInfo::legalizeIntrinsic(LegalizerHelper &Helper,
     MI.eraseFromParent();
     return true;
   }
+  case Intrinsic::mos_bcd_add:
+  case Intrinsic::mos_bcd_addl:
+  case Intrinsic::mos_bcd_sub:
+  case Intrinsic::mos_bcd_subl: {
+    // Some 6502 derivatives, notably the NES's, lack decimal mode.
+    if (!Builder.getMF().getSubtarget<MOSSubtarget>().has6502BCD())
+      return false;
+
+    LLT S1 = LLT::scalar(1);
+    LLT S8 = LLT::scalar(8);
+    Intrinsic::ID ID = cast<GIntrinsic>(MI).getIntrinsicID();
+    bool IsAdd = ID == Intrinsic::mos_bcd_add || ID == Intrinsic::mos_bcd_addl;
+    auto LHS = Builder.buildUnmerge(S8, MI.getOperand(2));
+    auto RHS = Builder.buildUnmerge(S8, MI.getOperand(3));
+    Register Carry = Builder.buildConstant(S1, !IsAdd).getReg(0);
+    SmallVector<Register> Parts;
+    for (unsigned I = 0, E = LHS->getNumOperands() - 1; I != E; ++I) {
+      auto Op = Builder.buildInstr(IsAdd ? MOS::G_BCD_ADDE : MOS::G_BCD_SUBE,
+                                   {S8, S1},
+                                   {LHS.getReg(I), RHS.getReg(I), Carry});
+      Parts.push_back(Op.getReg(0));
+      Carry = Op.getReg(1);
+    }
+    Builder.buildMergeValues(MI.getOperand(0), Parts);
+    MI.eraseFromParent();
+    return true;
+  }
+  case Intrinsic::mos_sei:
+    Builder.buildInstr(MOS::SEI_Implied);
+    MI.eraseFromParent();
+    return true;
+  case Intrinsic::mos_cli:
+    Builder.buildInstr(MOS::CLI_Implied);
+    MI.eraseFromParent();
+    return true;
+  case Intrinsic::mos_tam:
+    Builder.buildInstr(MOS::HuCMapBank)
+        .addUse(MI.getOperand(1).getReg())
+        .addImm(MI.getOperand(2).getImm());
+    MI.eraseFromParent();
+    return true;
   }
   return false;
 }
@@ -439,6 +530,11 @@ bool MOSLegalizerInfo::legalizeCustom(LegalizerHelper &Helper, MachineInstr &MI,
     return legalizeAddSub(Helper, MRI, MI);
   case G_XOR:
     return legalizeXor(Helper, MRI, MI);
+  case G_MUL:
+    return legalizeMul(Helper, MRI, MI, LocObserver);
+  case G_UDIV:
+  case G_UREM:
+    return legalizeUDivURem(Helper, MRI, MI, LocObserver);
   case G_SDIVREM:
   case G_UDIVREM:
     return legalizeDivRem(Helper, MRI, MI, LocObserver);
@@ -468,6 +564,15 @@ bool MOSLegalizerInfo::legalizeCustom(LegalizerHelper &Helper, MachineInstr &MI,
   case G_USUBE:
   case G_SSUBE:
     return legalizeSubE(Helper, MRI, MI);
+  case G_SMULFIX:
+  case G_UMULFIX:
+  case G_SMULFIXSAT:
+  case G_UMULFIXSAT:
+  case G_SDIVFIX:
+  case G_UDIVFIX:
+  case G_SDIVFIXSAT:
+  case G_UDIVFIXSAT:
+    return legalizeFixedPoint(Helper, MRI, MI);
 
   // Memory Operations
   case G_SEXTLOAD:
@@ -497,6 +602,11 @@ bool MOSLegalizerInfo::legalizeCustom(LegalizerHelper &Helper, MachineInstr &MI,
     return legalizeVAStart(Helper, MRI, MI);
 
   // Floating Point
+  case G_FADD:
+  case G_FSUB:
+  case G_FMUL:
+  case G_FDIV:
+    return legalizeFArith(Helper, MRI, MI, LocObserver);
   case G_FABS:
     return legalizeFAbs(Helper, MRI, MI);
   case G_FCMP:
@@ -609,32 +719,70 @@ bool MOSLegalizerInfo::legalizeAddSub(LegalizerHelper &Helper,
   LLT S8 = LLT::scalar(8);
 
   auto [Dst, Src] = MI.getFirst2Regs();
-  assert(MRI.getType(Dst).isByteSized());
+  LLT Ty = MRI.getType(Dst);
+  assert(Ty.isByteSized());
 
   auto RHSConst =
       getIConstantVRegValWithLookThrough(MI.getOperand(2).getReg(), MRI);
-  if (!RHSConst || std::abs(RHSConst->Value.getSExtValue()) != 1)
+  if (!RHSConst)
     return Helper.narrowScalarAddSub(MI, 0, S8) !=
            LegalizerHelper::UnableToLegalize;
 
-  // Handle multi-byte increments and decrements.
-
   assert(MI.getOpcode() == MOS::G_ADD || MI.getOpcode() == MOS::G_SUB);
-  int64_t Amt = RHSConst->Value.getSExtValue();
+  APInt Amt = RHSConst->Value;
   if (MI.getOpcode() == MOS::G_SUB)
-    Amt = -Amt;
+    Amt.negate();
+  if (Amt.isZero()) {
+    Builder.buildCopy(Dst, Src);
+    MI.eraseFromParent();
+    return true;
+  }
+
+  // The low bytes of the addend that are zero leave the corresponding source
+  // bytes unchanged and produce no carry, so the carry chain begins at the
+  // first nonzero byte.
+  unsigned NumParts = Ty.getSizeInBytes();
+  unsigned Skip = Amt.countr_zero() / 8;
+  APInt High = Amt.lshr(Skip * 8).trunc((NumParts - Skip) * 8);
+  bool IsIncDec = High.isOne() || High.isAllOnes();
+  if (!Skip && !IsIncDec)
+    return Helper.narrowScalarAddSub(MI, 0, S8) !=
+           LegalizerHelper::UnableToLegalize;
 
   auto Unmerge = Builder.buildUnmerge(S8, Src);
-  size_t NumParts = llvm::size(unmergeDefs(Unmerge));
-  auto IncDec = Builder.buildInstr(Amt == 1 ? MOS::G_INC : MOS::G_DEC);
-  SmallVector<Register> DstParts;
-  for (size_t Idx = 0; Idx < NumParts; ++Idx) {
-    Register R = MRI.createGenericVirtualRegister(S8);
-    IncDec.addDef(R);
-    DstParts.push_back(R);
-  }
+  SmallVector<Register> SrcParts;
   for (MachineOperand &MO : unmergeDefs(Unmerge))
-    IncDec.addUse(MO.getReg());
+    SrcParts.push_back(MO.getReg());
+  SmallVector<Register> DstParts(SrcParts.begin(), SrcParts.begin() + Skip);
+  ArrayRef<Register> HighParts = ArrayRef(SrcParts).drop_front(Skip);
+
+  if (IsIncDec) {
+    // Handle multi-byte increments and decrements. These skip the remaining
+    // bytes as soon as one byte doesn't wrap.
+    auto IncDec = Builder.buildInstr(High.isOne() ? MOS::G_INC : MOS::G_DEC);
+    for (size_t Idx = 0; Idx < HighParts.size(); ++Idx) {
+      Register R = MRI.createGenericVirtualRegister(S8);
+      IncDec.addDef(R);
+      DstParts.push_back(R);
+    }
+    for (Register R : HighParts)
+      IncDec.addUse(R);
+  } else {
+    LLT HighTy = LLT::scalar(High.getBitWidth());
+    Register HighSrc = HighParts.size() == 1
+                           ? HighParts.front()
+                           : Builder.buildMergeValues(HighTy, HighParts)
+                                 .getReg(0);
+    auto Sum =
+        Builder.buildAdd(HighTy, HighSrc, Builder.buildConstant(HighTy, High));
+    if (HighParts.size() == 1) {
+      DstParts.push_back(Sum.getReg(0));
+    } else {
+      auto SumUnmerge = Builder.buildUnmerge(S8, Sum);
+      for (MachineOperand &MO : unmergeDefs(SumUnmerge))
+        DstParts.push_back(MO.getReg());
+    }
+  }
   Builder.buildMergeValues(Dst, DstParts);
   MI.eraseFromParent();
   return true;
@@ -708,6 +856,416 @@ bool MOSLegalizerInfo::legalizeXor(LegalizerHelper &Helper,
   return true;
 }
 
+// Whether multiplies and divides should be expanded inline in the current
+// function. The expansions are a good deal larger than the calls they replace.
+static bool shouldInlineMulDiv(const MachineFunction &MF) {
+  return InlineMulDiv &&
+         MOSInstrCost::getModeFor(MF) != MOSInstrCost::Mode::PreferBytes;
+}
+
+// Whether 16 and 32-bit multiplies and unsigned divides should use the MEGA65
+// math unit in the current function. This takes a few more bytes than a
+// libcall, but many fewer cycles.
+static bool useMEGA65Math(const MachineFunction &MF) {
+  return MF.getSubtarget<MOSSubtarget>().hasMEGA65Math() &&
+         MOSInstrCost::getModeFor(MF) != MOSInstrCost::Mode::PreferBytes;
+}
+
+// Multiplies or unsigned divides two 16 or 32-bit values using the MEGA65
+// math unit, returning the low bytes of the product or the quotient. Writing
+// the inputs starts both operations. The product is ready by the time it can
+// be read, but the divider takes several cycles, which MEGA65DivWait waits
+// out.
+static Register buildMEGA65MulDiv(MachineIRBuilder &Builder, bool IsMul,
+                                  Register LHS, Register RHS) {
+  constexpr uint16_t MultInA = 0xD770;
+  constexpr uint16_t MultInB = 0xD774;
+  constexpr uint16_t MultOut = 0xD778;
+  constexpr uint16_t DivOut = 0xD76C;
+
+  LLT S8 = LLT::scalar(8);
+  MachineFunction &MF = Builder.getMF();
+  LLT Ty = Builder.getMRI()->getType(LHS);
+  unsigned Bytes = Ty.getSizeInBytes();
+
+  auto *StoreMMO = MF.getMachineMemOperand(
+      MachinePointerInfo(),
+      MachineMemOperand::MOStore | MachineMemOperand::MOVolatile, S8, Align(1));
+  auto *LoadMMO = MF.getMachineMemOperand(
+      MachinePointerInfo(),
+      MachineMemOperand::MOLoad | MachineMemOperand::MOVolatile, S8, Align(1));
+  auto Store = [&](Register Val, uint16_t Addr) {
+    Builder.buildInstr(MOS::G_STORE_ABS)
+        .addUse(Val)
+        .addImm(Addr)
+        .addMemOperand(StoreMMO);
+  };
+
+  auto L = Builder.buildUnmerge(S8, LHS);
+  auto R = Builder.buildUnmerge(S8, RHS);
+  for (unsigned I = 0; I < Bytes; ++I) {
+    Store(L.getReg(I), MultInA + I);
+    Store(R.getReg(I), MultInB + I);
+  }
+  // The low bytes of a product don't depend on the high bytes of its inputs,
+  // but the quotient does.
+  if (!IsMul) {
+    Register Zero = Builder.buildConstant(S8, 0).getReg(0);
+    for (unsigned I = Bytes; I < 4; ++I) {
+      Store(Zero, MultInA + I);
+      Store(Zero, MultInB + I);
+    }
+    Builder.buildInstr(MOS::MEGA65DivWait);
+  }
+
+  SmallVector<Register> Parts;
+  for (unsigned I = 0; I < Bytes; ++I)
+    Parts.push_back(Builder.buildInstr(MOS::G_LOAD_ABS, {S8}, {})
+                        .addImm((IsMul ? MultOut : DivOut) + I)
+                        .addMemOperand(LoadMMO)
+                        .getReg(0));
+  return Builder.buildMergeValues(Ty, Parts).getReg(0);
+}
+
+// Returns one of the two halves of the table of floor(N^2/4) for N in
+// [0, 512), creating it if necessary. The tables are page aligned, so that
+// indexing them never incurs a page crossing penalty on the low half.
+static GlobalVariable *getQuarterSquareTable(Module &M, bool High) {
+  StringRef Name = High ? "__quarter_square_hi" : "__quarter_square_lo";
+  if (GlobalVariable *GV = M.getNamedGlobal(Name))
+    return GV;
+
+  SmallVector<uint8_t> Bytes;
+  for (unsigned N = 0; N < 512; ++N) {
+    unsigned QuarterSquare = N * N / 4;
+    Bytes.push_back(High ? QuarterSquare >> 8 : QuarterSquare & 0xff);
+  }
+  Constant *Init = ConstantDataArray::get(M.getContext(), Bytes);
+  auto *GV = new GlobalVariable(M, Init->getType(), /*isConstant=*/true,
+                                GlobalValue::LinkOnceODRLinkage, Init, Name);
+  GV->setComdat(M.getOrInsertComdat(Name));
+  GV->setVisibility(GlobalValue::HiddenVisibility);
+  GV->setUnnamedAddr(GlobalValue::UnnamedAddr::Global);
+  GV->setAlignment(Align(256));
+  return GV;
+}
+
+// Multiplies two 8-bit values using a*b = f(a+b) - f(|a-b|), where
+// f(N) = floor(N^2/4). Returns the low byte of the product, or if High, the
+// full 16-bit product.
+static Register buildQuarterSquareMul(MachineIRBuilder &Builder, Register A,
+                                      Register B, bool High) {
+  LLT S1 = LLT::scalar(1);
+  LLT S8 = LLT::scalar(8);
+  LLT S16 = LLT::scalar(16);
+  LLT P = LLT::pointer(0, 16);
+  MachineFunction &MF = Builder.getMF();
+  Module &M = *MF.getFunction().getParent();
+
+  Register Sum = Builder
+                     .buildAdd(S16, Builder.buildZExt(S16, A),
+                               Builder.buildZExt(S16, B))
+                     .getReg(0);
+  auto AGeB = Builder.buildICmp(CmpInst::ICMP_UGE, S1, A, B);
+  auto AbsDiff = Builder.buildSelect(S8, AGeB, Builder.buildSub(S8, A, B),
+                                     Builder.buildSub(S8, B, A));
+  Register Diff = Builder.buildZExt(S16, AbsDiff).getReg(0);
+
+  auto Lookup = [&](bool HighTable, Register Idx) {
+    auto Table =
+        Builder.buildGlobalValue(P, getQuarterSquareTable(M, HighTable));
+    auto *MMO = MF.getMachineMemOperand(
+        MachinePointerInfo(), MachineMemOperand::MOLoad |
+                                  MachineMemOperand::MODereferenceable |
+                                  MachineMemOperand::MOInvariant,
+        S8, Align(1));
+    return Builder.buildLoad(S8, Builder.buildPtrAdd(P, Table, Idx), *MMO)
+        .getReg(0);
+  };
+
+  if (!High)
+    return Builder.buildSub(S8, Lookup(false, Sum), Lookup(false, Diff))
+        .getReg(0);
+  auto SumSquare =
+      Builder.buildMergeValues(S16, {Lookup(false, Sum), Lookup(true, Sum)});
+  auto DiffSquare = Builder.buildMergeValues(
+      S16, {Lookup(false, Diff), Lookup(true, Diff)});
+  return Builder.buildSub(S16, SumSquare, DiffSquare).getReg(0);
+}
+
+// Multiplies two 8-bit values using the SPC700's MUL YA. Returns the low byte
+// of the product, or if High, the full 16-bit product.
+static Register buildHardwareMul(MachineIRBuilder &Builder, Register A,
+                                 Register B, bool High) {
+  LLT S8 = LLT::scalar(8);
+  LLT S16 = LLT::scalar(16);
+  auto Mul = Builder.buildInstr(MOS::G_UMUL8, {S8, S8}, {A, B});
+  if (!High)
+    return Mul.getReg(0);
+  return Builder.buildMergeValues(S16, {Mul.getReg(0), Mul.getReg(1)})
+      .getReg(0);
+}
+
+bool MOSLegalizerInfo::legalizeMul(LegalizerHelper &Helper,
+                                   MachineRegisterInfo &MRI, MachineInstr &MI,
+                                   LostDebugLocObserver &LocObserver) const {
+  MachineIRBuilder &Builder = Helper.MIRBuilder;
+  LLT S8 = LLT::scalar(8);
+  auto [Dst, LHS, RHS] = MI.getFirst3Regs();
+  unsigned Size = MRI.getType(Dst).getSizeInBits();
+
+  if (Size >= 16 && useMEGA65Math(Builder.getMF())) {
+    Register Prod = buildMEGA65MulDiv(Builder, /*IsMul=*/true, LHS, RHS);
+    Builder.buildCopy(Dst, Prod);
+    MI.eraseFromParent();
+    return true;
+  }
+
+  // A hardware multiply is always smaller and faster than the libcall.
+  bool HasMul = Builder.getMF().getSubtarget<MOSSubtarget>().hasSPC700();
+  if (Size > 16 || (!HasMul && !shouldInlineMulDiv(Builder.getMF())))
+    return Helper.libcall(MI, LocObserver) == LegalizerHelper::Legalized;
+  auto BuildMul8 = HasMul ? buildHardwareMul : buildQuarterSquareMul;
+
+  Register Product;
+  Register LHS8, RHS8;
+  if (MRI.getType(Dst) == S8) {
+    Product = BuildMul8(Builder, LHS, RHS, /*High=*/false);
+  } else if (mi_match(LHS, MRI, m_GZExt(m_Reg(LHS8))) &&
+             mi_match(RHS, MRI, m_GZExt(m_Reg(RHS8))) &&
+             MRI.getType(LHS8) == S8 && MRI.getType(RHS8) == S8) {
+    Product = BuildMul8(Builder, LHS8, RHS8, /*High=*/true);
+  } else {
+    // (AH*256 + AL) * (BH*256 + BL) = AL*BL + (AL*BH + AH*BL)*256 (mod 2^16).
+    // The cross products only need their low bytes, which are computed by
+    // custom legalizing the generated 8-bit multiplies.
+    auto L = Builder.buildUnmerge(S8, LHS);
+    auto R = Builder.buildUnmerge(S8, RHS);
+    Register Low = BuildMul8(Builder, L.getReg(0), R.getReg(0), /*High=*/true);
+    auto LowParts = Builder.buildUnmerge(S8, Low);
+    auto Cross =
+        Builder.buildAdd(S8, Builder.buildMul(S8, L.getReg(0), R.getReg(1)),
+                         Builder.buildMul(S8, L.getReg(1), R.getReg(0)));
+    auto High = Builder.buildAdd(S8, LowParts.getReg(1), Cross);
+    Product = Builder
+                  .buildMergeValues(MRI.getType(Dst),
+                                       {LowParts.getReg(0), High.getReg(0)})
+                  .getReg(0);
+  }
+  Builder.buildCopy(Dst, Product);
+  MI.eraseFromParent();
+  return true;
+}
+
+// Divides two 8-bit unsigned values by restoring long division. Each step
+// shifts the next dividend bit into the partial remainder and subtracts the
+// divisor if it fits. A partial remainder with its high bit set always fits,
+// and the 8-bit difference is exact in that case.
+static void buildUDivRem8(MachineIRBuilder &Builder, Register Quot,
+                          Register Rem, Register A, Register B) {
+  LLT S1 = LLT::scalar(1);
+  LLT S8 = LLT::scalar(8);
+
+  // The SPC700 divides in hardware. An 8-bit dividend always gives a quotient
+  // that DIV YA, X can represent.
+  if (Builder.getMF().getSubtarget<MOSSubtarget>().hasSPC700()) {
+    auto DivRem = Builder.buildInstr(MOS::G_UDIVREM8, {S8, S8}, {A, B});
+    if (Quot)
+      Builder.buildCopy(Quot, DivRem.getReg(0));
+    if (Rem)
+      Builder.buildCopy(Rem, DivRem.getReg(1));
+    return;
+  }
+
+  Register N = A;
+  Register R = Builder.buildConstant(S8, 0).getReg(0);
+  Register Q = Builder.buildConstant(S8, 0).getReg(0);
+  auto One = Builder.buildConstant(S8, 1);
+  auto HighBit = Builder.buildConstant(S8, 0x80);
+  for (unsigned I = 0; I < 8; ++I) {
+    auto NextBit = Builder.buildICmp(CmpInst::ICMP_UGE, S1, N, HighBit);
+    N = Builder.buildShl(S8, N, One).getReg(0);
+    auto RHigh = Builder.buildICmp(CmpInst::ICMP_UGE, S1, R, HighBit);
+    auto Shifted = Builder.buildOr(S8, Builder.buildShl(S8, R, One),
+                                   Builder.buildZExt(S8, NextBit));
+    auto Fits = Builder.buildOr(
+        S1, RHigh, Builder.buildICmp(CmpInst::ICMP_UGE, S1, Shifted, B));
+    R = Builder.buildSelect(S8, Fits, Builder.buildSub(S8, Shifted, B), Shifted)
+            .getReg(0);
+    Q = Builder
+            .buildOr(S8, Builder.buildShl(S8, Q, One),
+                     Builder.buildZExt(S8, Fits))
+            .getReg(0);
+  }
+  if (Quot)
+    Builder.buildCopy(Quot, Q);
+  if (Rem)
+    Builder.buildCopy(Rem, R);
+}
+
+// Returns the table of the quotients or remainders of dividing each byte by
+// D, creating it if necessary. Like the quarter square tables, these are page
+// aligned and shared by every function and translation unit that uses them.
+static GlobalVariable *getDivTable(Module &M, unsigned D, bool IsRem) {
+  std::string Name =
+      (Twine(IsRem ? "__urem8_table_" : "__udiv8_table_") + Twine(D)).str();
+  if (GlobalVariable *GV = M.getNamedGlobal(Name))
+    return GV;
+
+  SmallVector<uint8_t> Bytes;
+  for (unsigned N = 0; N < 256; ++N)
+    Bytes.push_back(IsRem ? N % D : N / D);
+  Constant *Init = ConstantDataArray::get(M.getContext(), Bytes);
+  auto *GV = new GlobalVariable(M, Init->getType(), /*isConstant=*/true,
+                                GlobalValue::LinkOnceODRLinkage, Init, Name);
+  GV->setComdat(M.getOrInsertComdat(Name));
+  GV->setVisibility(GlobalValue::HiddenVisibility);
+  GV->setUnnamedAddr(GlobalValue::UnnamedAddr::Global);
+  GV->setAlignment(Align(256));
+  return GV;
+}
+
+// Divides an 8 or 16-bit unsigned value by the constant D, if that can be
+// done better than by the general algorithm. Returns false, having built
+// nothing, otherwise.
+//
+// Restoring long division by a constant needs no step for the leading bits
+// of the dividend that are too few to reach the divisor, and a divisor below
+// 128 keeps the partial remainder within a byte. The dividend is shifted left
+// as its bits are consumed, and the quotient bits are shifted into the bottom
+// of it, so it ends up holding the quotient. When optimizing for speed, bytes
+// are instead divided by lookup into tables of quotients and remainders.
+static bool buildUDivRemByConst(MachineIRBuilder &Builder, Register Quot,
+                                Register Rem, Register A, const APInt &D) {
+  LLT S1 = LLT::scalar(1);
+  LLT S8 = LLT::scalar(8);
+  LLT S16 = LLT::scalar(16);
+  LLT P = LLT::pointer(0, 16);
+  MachineFunction &MF = Builder.getMF();
+  LLT Ty = Builder.getMRI()->getType(A);
+  unsigned Bits = Ty.getSizeInBits();
+
+  if ((Bits != 8 && Bits != 16) || D.isZero())
+    return false;
+
+  if (D.isPowerOf2()) {
+    if (Quot)
+      Builder.buildLShr(Quot, A, Builder.buildConstant(S8, D.logBase2()));
+    if (Rem)
+      Builder.buildAnd(Rem, A, Builder.buildConstant(Ty, D - 1));
+    return true;
+  }
+
+  // The hardware dividers beat any sequence.
+  const auto &STI = MF.getSubtarget<MOSSubtarget>();
+  if (!shouldInlineMulDiv(MF) || (Bits == 8 && STI.hasSPC700()) ||
+      (Bits == 16 && useMEGA65Math(MF)))
+    return false;
+
+  if (D.uge(128)) {
+    // Only a byte can be divided by such a divisor, with a quotient of 0 or 1.
+    if (Bits != 8)
+      return false;
+    auto DReg = Builder.buildConstant(S8, D);
+    auto Fits = Builder.buildICmp(CmpInst::ICMP_UGE, S1, A, DReg);
+    if (Quot)
+      Builder.buildZExt(Quot, Fits);
+    if (Rem)
+      Builder.buildSelect(Rem, Fits, Builder.buildSub(S8, A, DReg), A);
+    return true;
+  }
+
+  if (Bits == 8 &&
+      MOSInstrCost::getModeFor(MF) == MOSInstrCost::Mode::PreferCycles) {
+    Module &M = *MF.getFunction().getParent();
+    Register Idx = Builder.buildZExt(S16, A).getReg(0);
+    auto Lookup = [&](Register Dst, bool IsRem) {
+      auto Table = Builder.buildGlobalValue(
+          P, getDivTable(M, D.getZExtValue(), IsRem));
+      auto *MMO = MF.getMachineMemOperand(
+          MachinePointerInfo(), MachineMemOperand::MOLoad |
+                                    MachineMemOperand::MODereferenceable |
+                                    MachineMemOperand::MOInvariant,
+          S8, Align(1));
+      Builder.buildLoad(Dst, Builder.buildPtrAdd(P, Table, Idx), *MMO);
+    };
+    if (Quot)
+      Lookup(Quot, /*IsRem=*/false);
+    if (Rem)
+      Lookup(Rem, /*IsRem=*/true);
+    return true;
+  }
+
+  unsigned Skip = D.getActiveBits() - 1;
+  auto DReg = Builder.buildConstant(S8, D.trunc(8));
+  auto One = Builder.buildConstant(S8, 1);
+  auto HighBit =
+      Builder.buildConstant(Ty, APInt::getOneBitSet(Bits, Bits - 1));
+  Register R = Builder.buildTrunc(
+      S8, Builder.buildLShr(Ty, A, Builder.buildConstant(S8, Bits - Skip)))
+      .getReg(0);
+  Register N = Builder.buildShl(Ty, A, Builder.buildConstant(S8, Skip))
+      .getReg(0);
+  for (unsigned I = Skip; I < Bits; ++I) {
+    auto NextBit = Builder.buildICmp(CmpInst::ICMP_UGE, S1, N, HighBit);
+    auto Shifted = Builder.buildOr(S8, Builder.buildShl(S8, R, One),
+                                   Builder.buildZExt(S8, NextBit));
+    auto Fits = Builder.buildICmp(CmpInst::ICMP_UGE, S1, Shifted, DReg);
+    R = Builder.buildSelect(S8, Fits, Builder.buildSub(S8, Shifted, DReg),
+                            Shifted)
+            .getReg(0);
+    N = Builder
+            .buildOr(Ty, Builder.buildShl(Ty, N, One),
+                     Builder.buildZExt(Ty, Fits))
+            .getReg(0);
+  }
+  if (Quot)
+    Builder.buildCopy(Quot, N);
+  if (Rem)
+    Builder.buildZExtOrTrunc(Rem, R);
+  return true;
+}
+
+bool MOSLegalizerInfo::legalizeUDivURem(
+    LegalizerHelper &Helper, MachineRegisterInfo &MRI, MachineInstr &MI,
+    LostDebugLocObserver &LocObserver) const {
+  MachineIRBuilder &Builder = Helper.MIRBuilder;
+  auto [Dst, LHS, RHS] = MI.getFirst3Regs();
+  LLT Ty = MRI.getType(Dst);
+
+  if (auto D = getIConstantVRegValWithLookThrough(RHS, MRI)) {
+    bool IsDiv = MI.getOpcode() == G_UDIV;
+    if (buildUDivRemByConst(Builder, IsDiv ? Dst : Register(),
+                            IsDiv ? Register() : Dst, LHS, D->Value)) {
+      MI.eraseFromParent();
+      return true;
+    }
+  }
+
+  if (Ty != LLT::scalar(8)) {
+    if (!useMEGA65Math(Builder.getMF()))
+      return Helper.libcall(MI, LocObserver) == LegalizerHelper::Legalized;
+    Register Quot = buildMEGA65MulDiv(Builder, /*IsMul=*/false, LHS, RHS);
+    if (MI.getOpcode() == G_UDIV)
+      Builder.buildCopy(Dst, Quot);
+    else
+      Builder.buildSub(Dst, LHS, Builder.buildMul(Ty, Quot, RHS));
+    MI.eraseFromParent();
+    return true;
+  }
+
+  if (!Builder.getMF().getSubtarget<MOSSubtarget>().hasSPC700() &&
+      !shouldInlineMulDiv(Builder.getMF()))
+    return Helper.libcall(MI, LocObserver) == LegalizerHelper::Legalized;
+
+  if (MI.getOpcode() == G_UDIV)
+    buildUDivRem8(Builder, Dst, Register(), LHS, RHS);
+  else
+    buildUDivRem8(Builder, Register(), Dst, LHS, RHS);
+  MI.eraseFromParent();
+  return true;
+}
+
 bool MOSLegalizerInfo::legalizeDivRem(LegalizerHelper &Helper,
                                       MachineRegisterInfo &MRI,
                                       MachineInstr &MI,
@@ -715,6 +1273,39 @@ bool MOSLegalizerInfo::legalizeDivRem(LegalizerHelper &Helper,
   LLT Ty = MRI.getType(MI.getOperand(0).getReg());
   auto &Ctx = MI.getMF()->getFunction().getContext();
 
+  // Digit extraction and the like need both results of dividing by a
+  // constant, which one sequence provides.
+  if (MI.getOpcode() == G_UDIVREM) {
+    auto [Quot, Rem, LHS, RHS] = MI.getFirst4Regs();
+    if (auto D = getIConstantVRegValWithLookThrough(RHS, MRI);
+        D && buildUDivRemByConst(Helper.MIRBuilder, Quot, Rem, LHS, D->Value)) {
+      MI.eraseFromParent();
+      return true;
+    }
+  }
+
+  if (MI.getOpcode() == G_UDIVREM && Ty == LLT::scalar(8) &&
+      (MI.getMF()->getSubtarget<MOSSubtarget>().hasSPC700() ||
+       shouldInlineMulDiv(*MI.getMF()))) {
+    buildUDivRem8(Helper.MIRBuilder, MI.getOperand(0).getReg(),
+                  MI.getOperand(1).getReg(), MI.getOperand(2).getReg(),
+                  MI.getOperand(3).getReg());
+    MI.eraseFromParent();
+    return true;
+  }
+
+  if (MI.getOpcode() == G_UDIVREM &&
+      (Ty == LLT::scalar(16) || Ty == LLT::scalar(32)) &&
+      useMEGA65Math(*MI.getMF())) {
+    MachineIRBuilder &Builder = Helper.MIRBuilder;
+    auto [Quot, Rem, LHS, RHS] = MI.getFirst4Regs();
+    Register Q = buildMEGA65MulDiv(Builder, /*IsMul=*/false, LHS, RHS);
+    Builder.buildCopy(Quot, Q);
+    Builder.buildSub(Rem, LHS, Builder.buildMul(Ty, Q, RHS));
+    MI.eraseFromParent();
+    return true;
+  }
+
   auto Libcall = getRTLibDesc(MI.getOpcode(), Ty.getSizeInBits());
 
   Type *HLTy = IntegerType::get(Ctx, Ty.getSizeInBits());
@@ -790,6 +1381,15 @@ bool MOSLegalizerInfo::legalizeShiftRotate(
     LLT AmtTy = MRI.getType(AmtReg);
     if (AmtTy != S8)
       MI.getOperand(2).setReg(Builder.buildTrunc(S8, AmtReg).getReg(0));
+    // A loop of one-bit shifts is only a few bytes longer than setting up the
+    // libcall, and it avoids the call overhead entirely.
+    if (Ty.getSizeInBits() <= 32 && !MI.getMF()->getFunction().hasMinSize()) {
+      Builder.buildInstr(MOS::G_SHIFT_LOOP, {Dst},
+                         {Src, MI.getOperand(2).getReg()})
+          .addImm(MI.getOpcode());
+      MI.eraseFromParent();
+      return true;
+    }
     return shiftRotateLibcall(Helper, MRI, MI, LocObserver);
   }
 
@@ -1536,6 +2136,82 @@ bool MOSLegalizerInfo::legalizeSubE(LegalizerHelper &Helper,
   return true;
 }
 
+// Legalize fixed point multiplication and division by performing them on
+// integers of double width, where they are exact, then scaling, clamping, and
+// truncating the result. As in the SelectionDAG expansions, results round
+// toward negative infinity.
+bool MOSLegalizerInfo::legalizeFixedPoint(LegalizerHelper &Helper,
+                                          MachineRegisterInfo &MRI,
+                                          MachineInstr &MI) const {
+  MachineIRBuilder &Builder = Helper.MIRBuilder;
+  LLT S1 = LLT::scalar(1);
+
+  auto [Dst, LHS, RHS] = MI.getFirst3Regs();
+  unsigned Scale = MI.getOperand(3).getImm();
+  unsigned Bits = MRI.getType(Dst).getSizeInBits();
+  LLT WideTy = LLT::scalar(Bits * 2);
+
+  unsigned Opcode = MI.getOpcode();
+  bool IsSigned = Opcode == G_SMULFIX || Opcode == G_SMULFIXSAT ||
+                  Opcode == G_SDIVFIX || Opcode == G_SDIVFIXSAT;
+  bool IsSaturating = Opcode == G_SMULFIXSAT || Opcode == G_UMULFIXSAT ||
+                      Opcode == G_SDIVFIXSAT || Opcode == G_UDIVFIXSAT;
+  bool IsDiv = Opcode == G_SDIVFIX || Opcode == G_UDIVFIX ||
+               Opcode == G_SDIVFIXSAT || Opcode == G_UDIVFIXSAT;
+
+  auto Extend = [&](Register Reg) {
+    return IsSigned ? Builder.buildSExt(WideTy, Reg)
+                    : Builder.buildZExt(WideTy, Reg);
+  };
+  auto WideLHS = Extend(LHS);
+  auto WideRHS = Extend(RHS);
+  auto ScaleAmt = Builder.buildConstant(WideTy, Scale);
+
+  Register Result;
+  if (!IsDiv) {
+    Result = Builder.buildMul(WideTy, WideLHS, WideRHS).getReg(0);
+    if (Scale)
+      Result = IsSigned ? Builder.buildAShr(WideTy, Result, ScaleAmt).getReg(0)
+                        : Builder.buildLShr(WideTy, Result, ScaleAmt).getReg(0);
+  } else {
+    auto Num = Builder.buildShl(WideTy, WideLHS, ScaleAmt);
+    if (IsSigned) {
+      auto DivRem =
+          Builder.buildInstr(G_SDIVREM, {WideTy, WideTy}, {Num, WideRHS});
+      // Division rounds toward zero, so step inexact negative quotients down.
+      auto Zero = Builder.buildConstant(WideTy, 0);
+      auto Inexact = Builder.buildICmp(CmpInst::ICMP_NE, S1,
+                                       DivRem.getReg(1), Zero);
+      auto Negative = Builder.buildICmp(
+          CmpInst::ICMP_SLT, S1, Builder.buildXor(WideTy, Num, WideRHS), Zero);
+      auto Adjust =
+          Builder.buildZExt(WideTy, Builder.buildAnd(S1, Inexact, Negative));
+      Result = Builder.buildSub(WideTy, DivRem.getReg(0), Adjust).getReg(0);
+    } else {
+      Result = Builder.buildUDiv(WideTy, Num, WideRHS).getReg(0);
+    }
+  }
+
+  if (IsSaturating) {
+    if (IsSigned) {
+      auto Max = Builder.buildConstant(
+          WideTy, APInt::getSignedMaxValue(Bits).sext(Bits * 2));
+      auto Min = Builder.buildConstant(
+          WideTy, APInt::getSignedMinValue(Bits).sext(Bits * 2));
+      Result = Builder.buildSMin(WideTy, Result, Max).getReg(0);
+      Result = Builder.buildSMax(WideTy, Result, Min).getReg(0);
+    } else {
+      auto Max = Builder.buildConstant(
+          WideTy, APInt::getMaxValue(Bits).zext(Bits * 2));
+      Result = Builder.buildUMin(WideTy, Result, Max).getReg(0);
+    }
+  }
+
+  Builder.buildTrunc(Dst, Result);
+  MI.eraseFromParent();
+  return true;
+}
+
 //===----------------------------------------------------------------------===//
 // Memory Operations
 //===----------------------------------------------------------------------===//
@@ -1850,6 +2526,24 @@ bool MOSLegalizerInfo::selectIndirectAddressing(LegalizerHelper &Helper,
         Index = Builder.buildConstant(S8, ConstOffset->Value.getSExtValue())
                     .getReg(0);
         Addr = Base;
+      } else {
+        // Only the high byte of the base need change to reach the offset's
+        // page, with the rest of the offset in the index. Accesses through the
+        // same pointer at nearby offsets then share the adjusted base, and
+        // negative offsets wrap around correctly.
+        LLT S16 = LLT::scalar(16);
+        uint64_t Off = ConstOffset->Value.getZExtValue() & 0xffff;
+        auto Bytes =
+            Builder.buildUnmerge(S8, Builder.buildPtrToInt(S16, Base));
+        auto Hi = Builder.buildAdd(S8, Bytes.getReg(1),
+                                   Builder.buildConstant(S8, Off >> 8));
+        Addr = Builder
+                   .buildIntToPtr(MRI.getType(Base),
+                                  Builder.buildMergeLikeInstr(
+                                      S16, {Bytes.getReg(0), Hi.getReg(0)}))
+                   .getReg(0);
+        if (Off & 0xff)
+          Index = Builder.buildConstant(S8, Off & 0xff).getReg(0);
       }
     } else if (MachineInstr *ZExtOffset = getOpcodeDef(G_ZEXT, Offset, MRI)) {
       Register Src = ZExtOffset->getOperand(1).getReg();
@@ -1890,16 +2584,50 @@ bool MOSLegalizerInfo::selectIndirectAddressing(LegalizerHelper &Helper,
   return true;
 }
 
+static std::optional<uint64_t>
+getUInt64FromConstantOper(const MachineOperand &Operand) {
+  if (Operand.isImm())
+    return Operand.getImm();
+  if (Operand.isCImm())
+    return Operand.getCImm()->getZExtValue();
+  return std::nullopt;
+}
+
+static MachineOperand offsetMachineOperand(MachineOperand &Operand,
+                                           int64_t Offset) {
+  if (Offset == 0)
+    return Operand;
+  if (Operand.isImm())
+    return MachineOperand::CreateImm(Operand.getImm() + Offset);
+  if (Operand.isCImm())
+    return MachineOperand::CreateCImm(Operand.getCImm() + Offset);
+  if (Operand.isGlobal())
+    return MachineOperand::CreateGA(Operand.getGlobal(),
+                                    Operand.getOffset() + Offset);
+  if (Operand.isFI())
+    return MachineOperand::CreateFI(Operand.getIndex(),
+                                    Operand.getOffset() + Offset);
+  llvm_unreachable("Unsupported machine operand type!");
+}
+
+template <typename T> static inline int compareNumbers(T A, T B) {
+  return A < B ? -1 : (A > B ? 1 : 0);
+}
+
+static std::optional<int> compareOperandLocations(const MachineOperand &A,
+                                                  const MachineOperand &B) {
+  if (A.isImm() && B.isImm())
+    return compareNumbers(A.getImm(), B.getImm());
+  if (A.isGlobal() && B.isGlobal())
+    if (A.getGlobal() == B.getGlobal())
+      return compareNumbers(A.getOffset(), B.getOffset());
+  return std::nullopt;
+}
+
 bool MOSLegalizerInfo::legalizeMemOp(LegalizerHelper &Helper,
                                      MachineRegisterInfo &MRI, MachineInstr &MI,
                                      LostDebugLocObserver &LocObserver) const {
   MachineIRBuilder &Builder = Helper.MIRBuilder;
-  const MOSSubtarget &STI = Builder.getMF().getSubtarget<MOSSubtarget>();
-
-  // Special handling for HuC6280 block copy extensions.
-  if (STI.hasHUC6280())
-    if (tryHuCBlockCopy(Helper, MRI, MI))
-      return true;
 
   bool IsSet = MI.getOpcode() == MOS::G_MEMSET;
   bool IsInline = MI.getOpcode() == MOS::G_MEMCPY_INLINE;
@@ -1923,6 +2651,10 @@ bool MOSLegalizerInfo::legalizeMemOp(LegalizerHelper &Helper,
     }
   }
 
+  // Operations on fixed locations have a wider choice of lowerings.
+  if (tryFixedMemOp(Helper, MRI, MI, SizeLimit, LocObserver))
+    return true;
+
   LegalizerHelper::LegalizeResult Result;
 
   // Try lowering, keeping in mind the size limit.
@@ -1935,6 +2667,9 @@ bool MOSLegalizerInfo::legalizeMemOp(LegalizerHelper &Helper,
     return true;
   }
 
+  if (tryShortMemLibcall(Helper, MRI, MI, LocObserver))
+    return true;
+
   // Try emitting a libcall.
   Result = createMemLibcall(Builder, MRI, MI, LocObserver);
   if (Result == LegalizerHelper::Legalized) {
@@ -1945,84 +2680,133 @@ bool MOSLegalizerInfo::legalizeMemOp(LegalizerHelper &Helper,
   return false;
 }
 
-static std::optional<uint64_t>
-getUInt64FromConstantOper(const MachineOperand &Operand) {
-  if (Operand.isImm())
-    return Operand.getImm();
-  if (Operand.isCImm())
-    return Operand.getCImm()->getZExtValue();
-  return std::nullopt;
+bool MOSLegalizerInfo::tryShortMemLibcall(
+    LegalizerHelper &Helper, MachineRegisterInfo &MRI, MachineInstr &MI,
+    LostDebugLocObserver &LocObserver) const {
+  bool IsSet = MI.getOpcode() == MOS::G_MEMSET;
+  if (!IsSet && MI.getOpcode() != MOS::G_MEMCPY)
+    return false;
+
+  // Lengths that fit in a byte can be counted down in Y alone, which saves
+  // the 16-bit counter and its setup in both the caller and the loop.
+  auto [Dst, Src, Len] = MI.getFirst3Regs();
+  if (Helper.getValueTracking()->getKnownBits(Len).countMaxActiveBits() > 8)
+    return false;
+  if (IsSet && MRI.getType(Src) != LLT::scalar(8))
+    return false;
+
+  MachineIRBuilder &Builder = Helper.MIRBuilder;
+  LLVMContext &Ctx = Builder.getMF().getFunction().getContext();
+  Type *I8Ty = Type::getInt8Ty(Ctx);
+  auto PtrTy = [&](Register Reg) {
+    return PointerType::get(Ctx, MRI.getType(Reg).getAddressSpace());
+  };
+  Register ShortLen = Builder.buildTrunc(LLT::scalar(8), Len).getReg(0);
+  // No MI is given, since the tail call check would otherwise take these to
+  // return the destination, as memcpy does.
+  if (createLibcall(Builder, IsSet ? RTLIB::MEMSET_SHORT : RTLIB::MEMCPY_SHORT,
+                    CallLowering::ArgInfo({0}, Type::getVoidTy(Ctx), 0),
+                    {{Dst, PtrTy(Dst), 0},
+                     {Src, IsSet ? I8Ty : PtrTy(Src), 1},
+                     {ShortLen, I8Ty, 2}},
+                    LocObserver) != LegalizerHelper::Legalized)
+    return false;
+  MI.eraseFromParent();
+  return true;
 }
 
-static MachineOperand offsetMachineOperand(MachineOperand &Operand,
-                                           int64_t Offset) {
-  if (Offset == 0)
-    return Operand;
-  if (Operand.isImm())
-    return MachineOperand::CreateImm(Operand.getImm() + Offset);
-  if (Operand.isCImm())
-    return MachineOperand::CreateCImm(Operand.getCImm() + Offset);
-  if (Operand.isGlobal())
-    return MachineOperand::CreateGA(Operand.getGlobal(),
-                                    Operand.getOffset() + Offset);
-  if (Operand.isFI())
-    return MachineOperand::CreateFI(Operand.getIndex(),
-                                    Operand.getOffset() + Offset);
-  llvm_unreachable("Unsupported machine operand type!");
+namespace {
+// The ways a memory operation on fixed locations can be lowered.
+enum class MemOpLowering {
+  Unrolled,
+  Loop,
+  HuCBlockCopy,
+  MEGA65DMA,
+  Libcall,
+};
+} // namespace
+
+// The most pages a block memory loop will unroll its body across.
+static constexpr uint64_t MaxMemLoopPages = 8;
+
+// Returns whether the asm printer can form indexed addresses from MO.
+static bool isMemLoopAddress(const MachineOperand &MO) {
+  if (MO.isImm())
+    return true;
+  if (!MO.isGlobal())
+    return false;
+  const auto *GV = dyn_cast<GlobalVariable>(MO.getGlobal()->getAliaseeObject());
+  return !MOS::isZeroPageSectionName(MO.getGlobal()->getSection()) &&
+         (!GV || GV->getAddressSpace() != MOS::AS_ZeroPage);
 }
 
-template <typename T> static inline int compareNumbers(T A, T B) {
-  return A < B ? -1 : (A > B ? 1 : 0);
+// Returns the cost of Cost executed Times times, where the code itself is only
+// present once.
+static MOSInstrCost repeated(const MOSInstrCost &Cost, int64_t Times) {
+  return MOSInstrCost(Cost.getBytes(), Cost.getCycles() * Times);
 }
 
-static std::optional<int> compareOperandLocations(const MachineOperand &A,
-                                                  const MachineOperand &B) {
-  if (A.isImm() && B.isImm())
-    return compareNumbers(A.getImm(), B.getImm());
-  if (A.isGlobal() && B.isGlobal())
-    if (A.getGlobal() == B.getGlobal())
-      return compareNumbers(A.getOffset(), B.getOffset());
-  return std::nullopt;
+// Returns the cost of a block memory loop, as expanded by the asm printer.
+static MOSInstrCost getMemLoopCost(bool IsSet, uint64_t Length,
+                                   const MOSSubtarget &STI) {
+  auto Get = [&](unsigned Opcode, bool PageCrossed = false) {
+    return MOSInstrCost::get(Opcode, STI, PageCrossed);
+  };
+  uint64_t Pages = Length / 256;
+  uint64_t Rest = Length % 256;
+  MOSInstrCost Cost;
+  if (IsSet)
+    Cost += Get(MOS::LDA_Immediate);
+  // Whole page loads cross a page boundary on all but the first iteration,
+  // unless the source is page aligned, which isn't known here.
+  MOSInstrCost Access = Get(MOS::STA_AbsoluteX);
+  if (!IsSet)
+    Access += Get(MOS::LDA_AbsoluteX, /*PageCrossed=*/true);
+  // The final branch isn't taken, which roughly cancels out with LDX.
+  MOSInstrCost Step = Get(MOS::LDX_Immediate) + Get(MOS::BNE_Relative);
+  if (Pages)
+    Cost += repeated(Access * Pages + Get(MOS::INX_Implied) + Step, 256);
+  if (Rest)
+    Cost += repeated(Access + Get(MOS::DEX_Implied) + Step, Rest);
+  return Cost;
 }
 
-bool MOSLegalizerInfo::tryHuCBlockCopy(LegalizerHelper &Helper,
-                                       MachineRegisterInfo &MRI,
-                                       MachineInstr &MI) const {
+bool MOSLegalizerInfo::tryFixedMemOp(LegalizerHelper &Helper,
+                                     MachineRegisterInfo &MRI, MachineInstr &MI,
+                                     uint32_t SizeLimit,
+                                     LostDebugLocObserver &LocObserver) const {
   MachineIRBuilder &Builder = Helper.MIRBuilder;
   MachineFunction &MF = Builder.getMF();
+  const MOSSubtarget &STI = MF.getSubtarget<MOSSubtarget>();
 
   bool IsSet = MI.getOpcode() == MOS::G_MEMSET;
+  bool IsMove = MI.getOpcode() == MOS::G_MEMMOVE;
   bool IsInline = MI.getOpcode() == MOS::G_MEMCPY_INLINE;
-
-  // Match supported combinations.
-  if (MI.getOpcode() != MOS::G_MEMCPY &&
-      MI.getOpcode() != MOS::G_MEMCPY_INLINE &&
-      MI.getOpcode() != MOS::G_MEMMOVE && MI.getOpcode() != MOS::G_MEMSET) {
+  if (!IsSet && !IsMove && !IsInline && MI.getOpcode() != MOS::G_MEMCPY)
     return false;
-  }
 
   Register DstReg = MI.getOperand(0).getReg();
   auto Dst = matchAbsoluteAddressing(MRI, DstReg);
   Register SrcReg = MI.getOperand(1).getReg();
   auto Src = matchAbsoluteAddressing(MRI, SrcReg);
   auto Len = matchAbsoluteAddressing(MRI, MI.getOperand(2).getReg());
-  bool Descending = false;
   if (!Src.has_value() || !Dst.has_value() || !Len.has_value())
     return false;
-
-  if (IsSet) {
-    // A TII-based memory set is always slower than the alternative.
-    // Skip using it unless -Os, -Oz is set.
-    if (!MF.getFunction().hasOptSize())
+  auto LenValue = getUInt64FromConstantOper(Len.value());
+  if (!LenValue.has_value() || !*LenValue || *LenValue > UINT16_MAX)
+    return false;
+  uint64_t Length = *LenValue;
+  for (const MachineMemOperand *MMO : MI.memoperands())
+    if (MMO->isVolatile())
       return false;
 
-    auto SrcValue = getUInt64FromConstantOper(Src.value());
-    if (!SrcValue.has_value())
-      return false;
-    if (MRI.getType(SrcReg).getSizeInBytes() != 1)
+  if (IsSet) {
+    if (!getUInt64FromConstantOper(Src.value()).has_value() ||
+        MRI.getType(SrcReg).getSizeInBytes() != 1)
       return false;
   }
-  if (MI.getOpcode() == MOS::G_MEMMOVE) {
+  bool Descending = false;
+  if (IsMove) {
     auto OperandOrder = compareOperandLocations(Src.value(), Dst.value());
     // TODO: Handle case when two G_MEMMOVE destinations cannot alias.
     if (!OperandOrder.has_value())
@@ -2031,60 +2815,122 @@ bool MOSLegalizerInfo::tryHuCBlockCopy(LegalizerHelper &Helper,
       Descending = true;
   }
 
-  // On HuC platforms, block copies can be emitted, and sets can be done
-  // with them too. However, some requirements have to be considered:
-  // 1) The source, destination, and length have to be constant; however,
-  //    they can be opaque constants (such as symbols).
-  // 2) A block copy instruction stalls all interrupts until it completes.
-  //    As such, one instruction should only do some amount of transfers,
-  //    to prevent stalling video interrupts mid-execution.
-  // Each transfer is 7 bytes and (17 + 6n) cycles, where n is the length
-  // of the transfer in bytes.
-  bool HuCIrqSafeBlockCopies = true; // TODO
-  uint64_t BytesPerTransfer = HuCIrqSafeBlockCopies ? 16 : UINT16_MAX;
-  uint64_t SizeMin, SizeMax;
-  // Note that non-indexed LDA/STA memory calls are 1 cycle slower on
-  // HuC6280 compared to other 6502 derivatives.
-  if (MF.getFunction().hasMinSize()) {
-    // Copies:
-    // => inline LDA/STA: 6n bytes
-    // => TII: 7 bytes
-    // => memcpy(): ~23 bytes
-    // Sets:
-    // => inline LDA/STA: 2 + 3n bytes
-    // => (LDA/STA|STZ)/TII: 3-5 + 7 bytes
-    // => __memset(): ~21? bytes
-    SizeMin = IsSet ? 5 : 2;
-    SizeMax = IsSet ? (BytesPerTransfer * 2 + 1) : (BytesPerTransfer * 3);
-  } else if (MF.getFunction().hasOptSize()) {
-    // Try to strike a balance.
-    SizeMin = IsSet ? 5 : 4;
-    SizeMax = IsSet ? (BytesPerTransfer * 3 + 1) : (BytesPerTransfer * 4);
-  } else {
-    // Copies:
-    // => inline LDA/STA: 10n cycles
-    // => TII: 17 + 6n cycles
-    // Sets:
-    // => inline LDA/STA: 2 + 5n cycles
-    // => (LDA/STA|STZ)/TII: 22-24 + 6n cycles
-    SizeMin = 5;
-    SizeMax = BytesPerTransfer * 5;
-  }
-  if (IsInline)
-    SizeMax = UINT16_MAX;
-  uint64_t KnownLen = UINT16_MAX;
-
-  // If we require IRQ-safe chunks, the length has to be known.
-  auto LenValue = getUInt64FromConstantOper(Len.value());
-  if (LenValue.has_value()) {
-    KnownLen = LenValue.value();
-    if (KnownLen < SizeMin || KnownLen > SizeMax) {
-      return false;
+  //          bytes       cycles
+  // Unrolled copy:  6n          8n
+  // Unrolled set:   2 + 3n      2 + 4n
+  // memcpy():       ~23         ~50 + 16n
+  // __memset():     ~21         ~40 + 11n
+  // Loops and block transfers are costed by their parts below.
+  SmallVector<std::pair<MemOpLowering, MOSInstrCost>> Candidates;
+  auto Get = [&](unsigned Opcode) { return MOSInstrCost::get(Opcode, STI); };
+  if (Length <= SizeLimit) {
+    MOSInstrCost Cost = IsSet ? Get(MOS::LDA_Immediate) +
+                                    Get(MOS::STA_Absolute) * Length
+                              : (Get(MOS::LDA_Absolute) +
+                                 Get(MOS::STA_Absolute)) *
+                                    Length;
+    Candidates.emplace_back(MemOpLowering::Unrolled, Cost);
+  }
+  // The loops only run descending, and their page loops ascending, which
+  // makes them unsuitable for overlapping moves.
+  if (!STI.hasSPC700() && (IsSet || isMemLoopAddress(Src.value())) &&
+      isMemLoopAddress(Dst.value()) && Length / 256 <= MaxMemLoopPages &&
+      (!IsMove || (Descending && Length < 256)))
+    Candidates.emplace_back(MemOpLowering::Loop,
+                            getMemLoopCost(IsSet, Length, STI));
+  if (STI.hasHUC6280() && (!IsSet || Length >= 2)) {
+    // Each TII transfer is 7 bytes and (17 + 6n) cycles. A set first stores
+    // the value, then propagates it with an overlapping transfer.
+    uint64_t Copied = IsSet ? Length - 1 : Length;
+    uint64_t Transfers = divideCeil(Copied, HuCBytesPerTransfer);
+    MOSInstrCost Cost(7 * Transfers, 17 * Transfers + 6 * Copied);
+    if (IsSet)
+      Cost += Get(MOS::LDA_Immediate) + Get(MOS::STA_Absolute);
+    Candidates.emplace_back(MemOpLowering::HuCBlockCopy, Cost);
+  }
+  // The DMA controller sees bank 0 of physical memory, which this assumes
+  // the 16-bit addresses map to.
+  if (UseMEGA65DMA && STI.has45GS02() && !IsMove &&
+      (IsSet || isMemLoopAddress(Src.value())) &&
+      isMemLoopAddress(Dst.value())) {
+    // STA $D707 plus a 14 byte job, with DMA taking about one cycle per byte
+    // for fills and two for copies.
+    MOSInstrCost Cost = Get(MOS::STA_Absolute) +
+                        MOSInstrCost(14, 14 + (IsSet ? 1 : 2) * Length);
+    Candidates.emplace_back(MemOpLowering::MEGA65DMA, Cost);
+  }
+  if (!IsInline)
+    Candidates.emplace_back(MemOpLowering::Libcall,
+                            IsSet ? MOSInstrCost(21, 40 + 11 * Length)
+                                  : MOSInstrCost(23, 50 + 16 * Length));
+
+  MOSInstrCost::Mode Mode = MOSInstrCost::getModeFor(MF);
+  llvm::stable_sort(Candidates, [&](const auto &A, const auto &B) {
+    return A.second.value(Mode) < B.second.value(Mode);
+  });
+
+  for (const auto &[Lowering, Cost] : Candidates) {
+    switch (Lowering) {
+    case MemOpLowering::Unrolled: {
+      LegalizerHelper::LegalizeResult Result =
+          IsInline ? Helper.lowerMemcpyInline(MI)
+                   : Helper.lowerMemCpyFamily(MI, SizeLimit);
+      if (Result == LegalizerHelper::Legalized)
+        return true;
+      break;
+    }
+    case MemOpLowering::Loop: {
+      MachineInstrBuilder Loop =
+          Builder.buildInstr(IsSet ? MOS::MemsetIdx : MOS::MemcpyIdx);
+      if (IsSet)
+        Loop.addImm(*getUInt64FromConstantOper(Src.value()) & 0xff);
+      else
+        Loop.add(Src.value());
+      Loop.add(Dst.value()).addImm(Length).cloneMemRefs(MI);
+      MI.eraseFromParent();
+      return true;
+    }
+    case MemOpLowering::HuCBlockCopy:
+      buildHuCBlockCopy(Helper, MRI, MI, *Src, *Dst, *Len, Length, Descending);
+      return true;
+    case MemOpLowering::MEGA65DMA: {
+      MachineOperand Source =
+          IsSet ? MachineOperand::CreateImm(
+                      *getUInt64FromConstantOper(Src.value()) & 0xff)
+                : Src.value();
+      Builder.buildInstr(MOS::MEGA65DMA)
+          .add(Source)
+          .add(Dst.value())
+          .addImm(Length)
+          .addImm(IsSet)
+          .cloneMemRefs(MI);
+      MI.eraseFromParent();
+      return true;
+    }
+    case MemOpLowering::Libcall:
+      if (createMemLibcall(Builder, MRI, MI, LocObserver) ==
+          LegalizerHelper::Legalized) {
+        MI.eraseFromParent();
+        return true;
+      }
+      break;
     }
-  } else if (BytesPerTransfer < UINT16_MAX || Descending) {
-    return false;
   }
+  return false;
+}
+
+void MOSLegalizerInfo::buildHuCBlockCopy(
+    LegalizerHelper &Helper, MachineRegisterInfo &MRI, MachineInstr &MI,
+    MachineOperand Src, MachineOperand Dst, MachineOperand Len,
+    uint64_t KnownLen, bool Descending) const {
+  MachineIRBuilder &Builder = Helper.MIRBuilder;
+  MachineFunction &MF = Builder.getMF();
+
+  bool IsSet = MI.getOpcode() == MOS::G_MEMSET;
+  Register DstReg = MI.getOperand(0).getReg();
 
+  // On HuC platforms, block copies can be emitted, and sets can be done
+  // with them too.
   auto DstPointerInfo = MI.memoperands()[0]->getPointerInfo();
   auto SrcPointerInfo = MI.memoperands()[IsSet ? 0 : 1]->getPointerInfo();
 
@@ -2093,26 +2939,26 @@ bool MOSLegalizerInfo::tryHuCBlockCopy(LegalizerHelper &Helper,
     // Emit a G_STORE, then set Src = Dst, Dst = Dst + 1, Len = Len - 1.
     auto StoreReg = MRI.createGenericVirtualRegister(LLT::scalar(8));
     Builder.buildConstant(
-        StoreReg, getUInt64FromConstantOper(Src.value()).value() & 0xFF);
+        StoreReg, *getUInt64FromConstantOper(Src) & 0xFF);
     Builder.buildStore(StoreReg, DstReg,
                        *MF.getMachineMemOperand(SrcPointerInfo,
                                                 MachineMemOperand::MOStore, 1,
                                                 Align(1)));
 
     Src = Dst;
-    Dst = offsetMachineOperand(Dst.value(), 1);
+    Dst = offsetMachineOperand(Dst, 1);
     DstPointerInfo = DstPointerInfo.getWithOffset(1);
-    Len = offsetMachineOperand(Len.value(), -1);
+    Len = offsetMachineOperand(Len, -1);
     KnownLen -= 1;
   }
 
   // Note that Descending transfers must be done in backwards order.
-  if (KnownLen <= BytesPerTransfer) {
+  if (KnownLen <= HuCBytesPerTransfer) {
     uint64_t AdjOfs = Descending ? (KnownLen - 1) : 0;
     Builder.buildInstr(MOS::HuCMemcpy)
-        .add(offsetMachineOperand(Src.value(), AdjOfs))
-        .add(offsetMachineOperand(Dst.value(), AdjOfs))
-        .add(Len.value())
+        .add(offsetMachineOperand(Src, AdjOfs))
+        .add(offsetMachineOperand(Dst, AdjOfs))
+        .add(Len)
         .addImm(Descending)
         .addMemOperand(MF.getMachineMemOperand(
             SrcPointerInfo, MachineMemOperand::MOLoad, 1, Align(1)))
@@ -2120,16 +2966,16 @@ bool MOSLegalizerInfo::tryHuCBlockCopy(LegalizerHelper &Helper,
             DstPointerInfo, MachineMemOperand::MOStore, 1, Align(1)));
   } else {
     // Transfer Offset
-    for (uint64_t TOfs = 0; TOfs < KnownLen; TOfs += BytesPerTransfer) {
+    for (uint64_t TOfs = 0; TOfs < KnownLen; TOfs += HuCBytesPerTransfer) {
       // Transfer Length
-      uint64_t TLen = std::min(KnownLen - TOfs, BytesPerTransfer);
+      uint64_t TLen = std::min(KnownLen - TOfs, HuCBytesPerTransfer);
       // Adjusted Transfer Offset (opcode)
       uint64_t AdjTOfs = Descending ? (KnownLen - TOfs - 1) : TOfs;
       // Adjusted Transfer Offset (memory)
       uint64_t AdjTOfsMO = Descending ? (KnownLen - TOfs - TLen) : TOfs;
       Builder.buildInstr(MOS::HuCMemcpy)
-          .add(offsetMachineOperand(Src.value(), AdjTOfs))
-          .add(offsetMachineOperand(Dst.value(), AdjTOfs))
+          .add(offsetMachineOperand(Src, AdjTOfs))
+          .add(offsetMachineOperand(Dst, AdjTOfs))
           .add(MachineOperand::CreateImm(TLen))
           .addImm(Descending)
           .addMemOperand(
@@ -2142,7 +2988,6 @@ bool MOSLegalizerInfo::tryHuCBlockCopy(LegalizerHelper &Helper,
   }
 
   MI.eraseFromParent();
-  return true;
 }
 
 //===----------------------------------------------------------------------===//
@@ -2169,6 +3014,24 @@ bool MOSLegalizerInfo::legalizeBrCond(LegalizerHelper &Helper,
   return true;
 }
 
+// Whether to dispatch through a split jump table by pushing the target address
+// and returning to it, rather than by jumping through a zero page pointer.
+static bool shouldDispatchViaRTS(const MachineFunction &MF) {
+  const MOSSubtarget &STI = MF.getSubtarget<MOSSubtarget>();
+  // The SPC700's return does not add one to the popped address.
+  if (STI.hasSPC700())
+    return false;
+
+  auto Cost = [&](unsigned Opcode) { return MOSInstrCost::get(Opcode, STI); };
+  MOSInstrCost Loads = Cost(MOS::LDA_AbsoluteX) * 2;
+  MOSInstrCost ViaPointer =
+      Loads + Cost(MOS::STA_ZeroPage) * 2 + Cost(MOS::JMP_Indirect16);
+  MOSInstrCost ViaRTS =
+      Loads + Cost(MOS::PHA_Implied) * 2 + Cost(MOS::RTS_Implied);
+  MOSInstrCost::Mode Mode = MOSInstrCost::getModeFor(MF);
+  return ViaRTS.value(Mode) < ViaPointer.value(Mode);
+}
+
 bool MOSLegalizerInfo::legalizeBrJt(LegalizerHelper &Helper,
                                     MachineRegisterInfo &MRI,
                                     MachineInstr &MI) const {
@@ -2198,6 +3061,12 @@ bool MOSLegalizerInfo::legalizeBrJt(LegalizerHelper &Helper,
     Builder.buildInstr(MOS::G_BRINDIRECT_IDX)
         .add(MI.getOperand(1))
         .addUse(Offset);
+  } else if (shouldDispatchViaRTS(Builder.getMF())) {
+    auto &MFI = *Builder.getMF().getInfo<MOSFunctionInfo>();
+    MFI.RTSJumpTables.insert(MI.getOperand(1).getIndex());
+    Builder.buildInstr(MOS::G_BRINDIRECT_RTS)
+        .add(MI.getOperand(1))
+        .addUse(Offset);
   } else {
     Register LoAddr = MRI.createGenericVirtualRegister(S8);
     Builder.buildInstr(MOS::G_LOAD_ABS_IDX)
@@ -2221,6 +3090,15 @@ bool MOSLegalizerInfo::legalizeBrJt(LegalizerHelper &Helper,
 bool MOSLegalizerInfo::legalizeTrap(LegalizerHelper &Helper,
                                     MachineRegisterInfo &MRI,
                                     MachineInstr &MI) const {
+  // A call of abort says nothing of which trap was hit. The ID of a BRK trap
+  // identifies it, and through the .mos.trap note, its source location, so
+  // failure paths can trap without passing any strings.
+  if (CompactTraps) {
+    Helper.MIRBuilder.buildInstr(MOS::TrapBRK);
+    MI.eraseFromParent();
+    return true;
+  }
+
   auto *RetTy = Type::getVoidTy(MI.getMF()->getFunction().getContext());
   LostDebugLocObserver LocObserver("");
   if (!createLibcall(Helper.MIRBuilder, RTLIB::ABORT, {{}, RetTy, 0}, {},
@@ -2287,6 +3165,44 @@ bool MOSLegalizerInfo::legalizeVAStart(LegalizerHelper &Helper,
   return true;
 }
 
+bool MOSLegalizerInfo::legalizeFArith(LegalizerHelper &Helper,
+                                      MachineRegisterInfo &MRI,
+                                      MachineInstr &MI,
+                                      LostDebugLocObserver &LocObserver) const {
+  // Fast math code can use versions that skip the handling of NaNs,
+  // infinities, and denormals, which dominates the cost of the generic ones.
+  if (!MI.getFlag(MachineInstr::FmAfn) || !MI.getFlag(MachineInstr::FmNoNans) ||
+      !MI.getFlag(MachineInstr::FmNoInfs) || !MI.getFlag(MachineInstr::FmNsz))
+    return Helper.libcall(MI, LocObserver) == LegalizerHelper::Legalized;
+
+  RTLIB::Libcall Libcall;
+  switch (MI.getOpcode()) {
+  default:
+    llvm_unreachable("Unexpected opcode");
+  case G_FADD:
+    Libcall = RTLIB::FAST_ADD_F32;
+    break;
+  case G_FSUB:
+    Libcall = RTLIB::FAST_SUB_F32;
+    break;
+  case G_FMUL:
+    Libcall = RTLIB::FAST_MUL_F32;
+    break;
+  case G_FDIV:
+    Libcall = RTLIB::FAST_DIV_F32;
+    break;
+  }
+
+  auto [Dst, LHS, RHS] = MI.getFirst3Regs();
+  Type *Ty = Type::getFloatTy(MI.getMF()->getFunction().getContext());
+  if (createLibcall(Helper.MIRBuilder, Libcall, {Dst, Ty, 0},
+                    {{LHS, Ty, 0}, {RHS, Ty, 1}}, LocObserver,
+                    &MI) != LegalizerHelper::Legalized)
+    return false;
+  MI.eraseFromParent();
+  return true;
+}
+
 bool MOSLegalizerInfo::legalizeFAbs(LegalizerHelper &Helper,
                                     MachineRegisterInfo &MRI,
                                     MachineInstr &MI) const {
@@ -24,10 +24,18 @@ namespace llvm {
 
 class MOSSubtarget;
 
+/// A HuC6280 block transfer stalls interrupts until it completes, so long
+/// transfers are split into chunks of this many bytes.
+static constexpr uint64_t HuCBytesPerTransfer = 16;
+
 class MOSLegalizerInfo : public LegalizerInfo {
 public:
   MOSLegalizerInfo(const MOSSubtarget &STI);
 
+  /// Returns the rules shared by every subtarget with the same legality-
+  /// relevant features, building them on first use.
+  static const MOSLegalizerInfo &get(const MOSSubtarget &STI);
+
   bool legalizeIntrinsic(LegalizerHelper &Helper,
                          MachineInstr &MI) const override;
 
@@ -49,8 +57,13 @@ private:
   // Integer Operations
   bool legalizeAddSub(LegalizerHelper &Helper, MachineRegisterInfo &MRI,
                       MachineInstr &MI) const;
+  bool legalizeMul(LegalizerHelper &Helper, MachineRegisterInfo &MRI,
+                   MachineInstr &MI, LostDebugLocObserver &LocObserver) const;
   bool legalizeDivRem(LegalizerHelper &Helper, MachineRegisterInfo &MRI,
                       MachineInstr &MI, LostDebugLocObserver &LocObserver) const;
+  bool legalizeUDivURem(LegalizerHelper &Helper, MachineRegisterInfo &MRI,
+                        MachineInstr &MI,
+                        LostDebugLocObserver &LocObserver) const;
   bool legalizeXor(LegalizerHelper &Helper, MachineRegisterInfo &MRI,
                    MachineInstr &MI) const;
   bool legalizeShiftRotate(LegalizerHelper &Helper, MachineRegisterInfo &MRI,
@@ -73,6 +86,8 @@ private:
                        MachineInstr &MI) const;
   bool legalizeSubE(LegalizerHelper &Helper, MachineRegisterInfo &MRI,
                     MachineInstr &MI) const;
+  bool legalizeFixedPoint(LegalizerHelper &Helper, MachineRegisterInfo &MRI,
+                          MachineInstr &MI) const;
 
   // Memory Operations
   bool legalizeLoad(LegalizerHelper &Helper, MachineRegisterInfo &MRI,
@@ -95,8 +110,16 @@ private:
                                    GLoadStore &MI) const;
   bool legalizeMemOp(LegalizerHelper &Helper, MachineRegisterInfo &MRI,
                      MachineInstr &MI, LostDebugLocObserver &LocObserver) const;
-  bool tryHuCBlockCopy(LegalizerHelper &Helper, MachineRegisterInfo &MRI,
-                       MachineInstr &MI) const;
+  bool tryFixedMemOp(LegalizerHelper &Helper, MachineRegisterInfo &MRI,
+                     MachineInstr &MI, uint32_t SizeLimit,
+                     LostDebugLocObserver &LocObserver) const;
+  bool tryShortMemLibcall(LegalizerHelper &Helper, MachineRegisterInfo &MRI,
+                          MachineInstr &MI,
+                          LostDebugLocObserver &LocObserver) const;
+  void buildHuCBlockCopy(LegalizerHelper &Helper, MachineRegisterInfo &MRI,
+                         MachineInstr &MI, MachineOperand Src,
+                         MachineOperand Dst, MachineOperand Len,
+                         uint64_t KnownLen, bool Descending) const;
 
   // Control Flow
   bool legalizeBrCond(LegalizerHelper &Helper, MachineRegisterInfo &MRI,
@@ -115,6 +138,8 @@ private:
                        MachineInstr &MI) const;
 
   // Floating Point Operations
+  bool legalizeFArith(LegalizerHelper &Helper, MachineRegisterInfo &MRI,
+                      MachineInstr &MI, LostDebugLocObserver &LocObserver) const;
   bool legalizeFAbs(LegalizerHelper &Helper, MachineRegisterInfo &MRI,
                     MachineInstr &MI) const;
   bool legalizeFCmp(LegalizerHelper &Helper, MachineRegisterInfo &MRI,
@@ -0,0 +1,226 @@
+//===-- MOSLoopIdiom.cpp - MOS Loop Idiom Recognition ---------------------===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines the MOS loop idiom recognition pass.
+//
+// LoopIdiomRecognize already turns loops that find the end of a string into
+// calls to strlen. This pass does the same for bounded searches for a byte,
+// which become calls to memchr:
+//
+//   for (i = 0; i < n; ++i)
+//     if (p[i] == c)
+//       break;
+//
+// The SDK's memchr scans with (zp),Y a page at a time, bumping only the high
+// byte of the pointer between pages, and takes its arguments in registers.
+// That is both smaller and faster than the loop the code generator would
+// otherwise emit, which must also maintain the count and every other
+// induction variable.
+//
+// The loop must have two exits: one taken once the byte loaded at {p,+,1} is
+// found, and one taken at the latch after a computable number of iterations.
+// It may have no side effects. The index of the found byte then follows from
+// the pointer memchr returns, the values live out of each exit are computed
+// from it or from the iteration count, and each exit branch is made to go
+// where the result of memchr says. The loop no longer iterates, and later
+// passes delete it.
+//
+//===----------------------------------------------------------------------===//
+
+#include "MOSLoopIdiom.h"
+
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/Analysis/ScalarEvolutionExpressions.h"
+#include "llvm/Analysis/TargetLibraryInfo.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/PatternMatch.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Transforms/Utils/BuildLibCalls.h"
+#include "llvm/Transforms/Utils/Local.h"
+#include "llvm/Transforms/Utils/ScalarEvolutionExpander.h"
+
+#define DEBUG_TYPE "mos-loop-idiom"
+
+STATISTIC(NumMemChr, "Number of memchr's formed from search loops");
+
+using namespace llvm;
+using namespace llvm::PatternMatch;
+
+static cl::opt<unsigned> MinSearchLength(
+    "mos-loop-idiom-min-length",
+    cl::desc("Minimum constant length of a search loop to replace with a "
+             "library call"),
+    cl::init(8), cl::Hidden);
+
+// Returns the value of R on the given iteration of its loop.
+static const SCEV *atIteration(const SCEVAddRecExpr *R, const SCEV *It,
+                               ScalarEvolution &SE) {
+  const SCEV *Step = R->getStepRecurrence(SE);
+  return SE.getAddExpr(
+      R->getStart(),
+      SE.getMulExpr(SE.getTruncateOrZeroExtend(It, Step->getType()), Step));
+}
+
+// Returns the AddRec over L given by the value V live out of L, or nullptr if
+// V is loop invariant. Sets Fail if V is neither.
+static const SCEVAddRecExpr *getLiveOutRec(Value *V, Loop &L,
+                                           ScalarEvolution &SE, bool &Fail) {
+  if (L.isLoopInvariant(V))
+    return nullptr;
+  if (!SE.isSCEVable(V->getType())) {
+    Fail = true;
+    return nullptr;
+  }
+  const auto *R = dyn_cast<SCEVAddRecExpr>(SE.getSCEV(V));
+  if (!R || R->getLoop() != &L || !R->isAffine())
+    Fail = true;
+  return R;
+}
+
+PreservedAnalyses MOSLoopIdiom::run(Loop &L, LoopAnalysisManager &AM,
+                                    LoopStandardAnalysisResults &AR,
+                                    LPMUpdater &) {
+  ScalarEvolution &SE = AR.SE;
+
+  if (!L.isInnermost() || !L.isLoopSimplifyForm() || !L.isLCSSAForm(AR.DT))
+    return PreservedAnalyses::all();
+  BasicBlock *Preheader = L.getLoopPreheader();
+  BasicBlock *Latch = L.getLoopLatch();
+  Module &M = *Preheader->getModule();
+  if (!isLibFuncEmittable(&M, &AR.TLI, LibFunc_memchr))
+    return PreservedAnalyses::all();
+
+  // One exit finds the byte, and the other counts the iterations.
+  SmallVector<BasicBlock *> Exiting;
+  L.getExitingBlocks(Exiting);
+  if (Exiting.size() != 2 || !is_contained(Exiting, Latch))
+    return PreservedAnalyses::all();
+  BasicBlock *Search = Exiting[0] == Latch ? Exiting[1] : Exiting[0];
+  if (!AR.DT.dominates(Search, Latch))
+    return PreservedAnalyses::all();
+  auto *SearchBI = dyn_cast<BranchInst>(Search->getTerminator());
+  auto *LatchBI = dyn_cast<BranchInst>(Latch->getTerminator());
+  if (!SearchBI || !SearchBI->isConditional() || !LatchBI ||
+      !LatchBI->isConditional() ||
+      L.contains(SearchBI->getSuccessor(0)) ==
+          L.contains(SearchBI->getSuccessor(1)))
+    return PreservedAnalyses::all();
+  bool ExitOnTrue = !L.contains(SearchBI->getSuccessor(0));
+  BasicBlock *FoundExit = SearchBI->getSuccessor(ExitOnTrue ? 0 : 1);
+  BasicBlock *CountExit =
+      LatchBI->getSuccessor(L.contains(LatchBI->getSuccessor(0)) ? 1 : 0);
+  if (FoundExit == CountExit)
+    return PreservedAnalyses::all();
+
+  CmpPredicate Pred;
+  Value *LHS, *RHS;
+  if (!match(SearchBI->getCondition(),
+             m_ICmp(Pred, m_Value(LHS), m_Value(RHS))) ||
+      !ICmpInst::isEquality(Pred) ||
+      (Pred == ICmpInst::ICMP_EQ) != ExitOnTrue)
+    return PreservedAnalyses::all();
+  if (L.isLoopInvariant(LHS))
+    std::swap(LHS, RHS);
+  auto *Load = dyn_cast<LoadInst>(LHS);
+  if (!Load || !Load->isSimple() || !Load->getType()->isIntegerTy(8) ||
+      Load->getPointerAddressSpace() != 0 || !L.contains(Load) ||
+      !L.isLoopInvariant(RHS))
+    return PreservedAnalyses::all();
+  const auto *Ptr =
+      dyn_cast<SCEVAddRecExpr>(SE.getSCEV(Load->getPointerOperand()));
+  if (!Ptr || Ptr->getLoop() != &L || !Ptr->isAffine() ||
+      !Ptr->getStepRecurrence(SE)->isOne())
+    return PreservedAnalyses::all();
+
+  for (BasicBlock *B : L.blocks())
+    for (Instruction &I : *B)
+      if (I.mayHaveSideEffects())
+        return PreservedAnalyses::all();
+
+  // The search covers one byte more than the number of backedges taken
+  // before the counting exit, which must still fit in a size_t.
+  const DataLayout &DL = M.getDataLayout();
+  Type *SizeTy = IntegerType::get(M.getContext(), AR.TLI.getSizeTSize(M));
+  const SCEV *Count = SE.getExitCount(&L, Latch);
+  if (isa<SCEVCouldNotCompute>(Count) || !SE.isLoopInvariant(Count, &L))
+    return PreservedAnalyses::all();
+  APInt MaxCount = SE.getUnsignedRangeMax(Count);
+  unsigned SizeBits = SizeTy->getIntegerBitWidth();
+  if (MaxCount.getActiveBits() > SizeBits ||
+      MaxCount.getZExtValue() >= maxUIntN(SizeBits))
+    return PreservedAnalyses::all();
+  if (const auto *C = dyn_cast<SCEVConstant>(Count);
+      C && C->getAPInt().getZExtValue() + 1 < MinSearchLength)
+    return PreservedAnalyses::all();
+
+  // Every value live out of the loop must be computable from the iteration
+  // it leaves on.
+  bool Fail = false;
+  SmallVector<std::pair<PHINode *, const SCEVAddRecExpr *>> FoundRecs;
+  SmallVector<std::pair<PHINode *, const SCEVAddRecExpr *>> CountRecs;
+  for (PHINode &PN : FoundExit->phis())
+    if (const auto *R = getLiveOutRec(PN.getIncomingValue(0), L, SE, Fail))
+      FoundRecs.emplace_back(&PN, R);
+  for (PHINode &PN : CountExit->phis())
+    if (const auto *R = getLiveOutRec(PN.getIncomingValue(0), L, SE, Fail))
+      CountRecs.emplace_back(&PN, R);
+  if (Fail)
+    return PreservedAnalyses::all();
+
+  LLVM_DEBUG(dbgs() << "Forming memchr from: " << L);
+
+  IRBuilder<> Builder(Preheader->getTerminator());
+  Builder.SetCurrentDebugLocation(L.getStartLoc());
+  SCEVExpander Expander(SE, DL, "mos-loop-idiom");
+  Value *Base =
+      Expander.expandCodeFor(Ptr->getStart(), Load->getPointerOperandType(),
+                             Builder.GetInsertPoint());
+  Value *Len = Expander.expandCodeFor(
+      SE.getAddExpr(SE.getTruncateOrZeroExtend(Count, SizeTy),
+                    SE.getOne(SizeTy)),
+      SizeTy, Builder.GetInsertPoint());
+  Value *Byte = Builder.CreateZExt(RHS, Builder.getIntNTy(AR.TLI.getIntSize()));
+  Value *Found = emitMemChr(Base, Byte, Len, Builder, DL, &AR.TLI);
+
+  // The index of the byte found is meaningless if there is none, but then
+  // the values computed from it go unused.
+  SmallVector<std::pair<PHINode *, Value *>> Replacements;
+  if (!FoundRecs.empty()) {
+    const SCEV *Index = SE.getSCEV(
+        Builder.CreatePtrDiff(Builder.getInt8Ty(), Found, Base));
+    for (const auto &[PN, R] : FoundRecs)
+      Replacements.emplace_back(
+          PN, Expander.expandCodeFor(atIteration(R, Index, SE), PN->getType(),
+                                     Builder.GetInsertPoint()));
+  }
+  for (const auto &[PN, R] : CountRecs)
+    Replacements.emplace_back(
+        PN, Expander.expandCodeFor(atIteration(R, Count, SE), PN->getType(),
+                                   Builder.GetInsertPoint()));
+  Value *IsFound = Builder.CreateIsNotNull(Found);
+
+  SE.forgetLoop(&L);
+
+  // The first iteration now leaves by whichever exit the search would have.
+  Value *OldSearchCond = SearchBI->getCondition();
+  Value *OldLatchCond = LatchBI->getCondition();
+  SearchBI->setCondition(ExitOnTrue ? IsFound : Builder.CreateNot(IsFound));
+  LatchBI->setCondition(ConstantInt::getBool(
+      M.getContext(), LatchBI->getSuccessor(0) == CountExit));
+  RecursivelyDeleteTriviallyDeadInstructions(OldSearchCond);
+  RecursivelyDeleteTriviallyDeadInstructions(OldLatchCond);
+  for (const auto &[PN, V] : Replacements)
+    PN->setIncomingValue(0, V);
+  ++NumMemChr;
+
+  auto PA = getLoopPassPreservedAnalyses();
+  PA.preserveSet<CFGAnalyses>();
+  return PA;
+}
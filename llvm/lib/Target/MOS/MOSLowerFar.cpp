@@ -0,0 +1,702 @@
+//===-- MOSLowerFar.cpp - MOS Far Pointer Lowering ------------------------===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines the MOS far pointer lowering pass.
+//
+// Far pointers, in address space 2 (__far in C), hold 32-bit linear addresses
+// into a banked physical memory larger than the 64 KiB the processor sees.
+// Physical memory is divided into 8 KiB banks. A far access maps the bank
+// holding its address, along with the bank after it, into a 16 KiB window of
+// the processor's address space, then makes an ordinary load or store through
+// the window. On the HuC6280, the banks are mapped inline, by storing them to
+// a pair of MPRs with TAM. Elsewhere, the SDK supplies __far_map(char bank),
+// which maps the same pair of banks however the platform's mapper requires.
+//
+// The SDK also supplies __far_bank, the bank last mapped into the window, and
+// an access only remaps the window if it holds another bank. A loop walking a
+// large far array thus remaps once per bank, rather than once per access.
+// Accesses at small constant offsets from the same far address share their
+// banks, and those that a forward dataflow over the function finds must be
+// preceded by another, with no call or inline assembly in between, skip the
+// check entirely.
+//
+// The rest of code generation knows nothing of 32-bit pointers, so this pass
+// also rewrites every far pointer in the module to an i32: in signatures, in
+// instructions, and wherever far pointers are themselves loaded or stored.
+// The addresses of far globals, which only the linker knows, are loaded from
+// constants. Memory intrinsics involving far memory are first expanded into
+// loops. Aggregates of far pointers, atomic read-modify-writes of far memory,
+// and casts between far and near pointers aren't supported.
+//
+// This runs just before instruction selection, once the IR optimizations are
+// done. Interrupt handlers must not access far memory, since that would remap
+// the window out from under the code they interrupt.
+//
+//===----------------------------------------------------------------------===//
+
+#include "MOSLowerFar.h"
+
+#include "MOS.h"
+#include "MOSInstrInfo.h"
+#include "MOSSubtarget.h"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/PostOrderIterator.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
+#include "llvm/Analysis/Utils/Local.h"
+#include "llvm/CodeGen/TargetPassConfig.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/DiagnosticInfo.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/IntrinsicsMOS.h"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Target/TargetMachine.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+#include "llvm/Transforms/Utils/Local.h"
+#include "llvm/Transforms/Utils/LowerMemIntrinsics.h"
+
+#define DEBUG_TYPE "mos-lower-far"
+
+STATISTIC(NumFarAccesses, "Number of far loads and stores lowered");
+STATISTIC(NumMapsElided, "Number of far accesses with banks already mapped");
+
+using namespace llvm;
+
+static cl::opt<unsigned> FarWindow(
+    "mos-far-window",
+    cl::desc("Address of the 16 KiB window that far accesses map banks into"),
+    cl::init(0x4000), cl::Hidden);
+
+static constexpr unsigned BankBits = 13;
+static constexpr uint64_t BankSize = uint64_t(1) << BankBits;
+
+namespace {
+
+struct MOSLowerFar : public ModulePass {
+  static char ID; // Pass identification, replacement for typeid
+
+  MOSLowerFar() : ModulePass(ID) {
+    initializeMOSLowerFarPass(*PassRegistry::getPassRegistry());
+  }
+
+  bool runOnModule(Module &M) override;
+  void getAnalysisUsage(AnalysisUsage &AU) const override;
+};
+
+// A far load or store, Offset bytes past the far address Base, whose banks it
+// maps.
+struct FarAccess {
+  Instruction *I;
+  Value *Base;
+  uint64_t Offset;
+  // Whether Base's banks are known to be mapped already.
+  bool Mapped = false;
+};
+
+// Rewrites the far pointers within a function to i32s.
+class FarRewriter {
+  Function &F;
+  const DataLayout &DL;
+  // The functions whose signatures were rewritten, and their replacements.
+  const DenseMap<Function *, Function *> &Clones;
+  // The far arguments of those functions, and their replacements.
+  const DenseMap<Argument *, Argument *> &FarArgs;
+  // The constants holding the addresses of each far pointer constant.
+  DenseMap<Constant *, GlobalVariable *> &Addrs;
+  IntegerType *I32;
+
+  // The i32 that replaces each far pointer.
+  DenseMap<Value *, Value *> Ints;
+  SmallVector<Instruction *> Dead;
+
+public:
+  SmallVector<FarAccess> Accesses;
+
+  FarRewriter(Function &F, const DenseMap<Function *, Function *> &Clones,
+              const DenseMap<Argument *, Argument *> &FarArgs,
+              DenseMap<Constant *, GlobalVariable *> &Addrs)
+      : F(F), DL(F.getDataLayout()), Clones(Clones), FarArgs(FarArgs),
+        Addrs(Addrs), I32(Type::getInt32Ty(F.getContext())) {}
+
+  void run();
+
+private:
+  Value *getInt(Value *V, Instruction *Before);
+  void expandConstants(Instruction &I);
+  void rewrite(Instruction &I);
+  Value *rewriteCall(CallBase &CB);
+  void addAccess(Instruction *I, Value *Addr, Type *Ty);
+  Value *unsupported(Instruction &I, const Twine &What);
+};
+
+} // namespace
+
+static bool isFar(const Type *Ty) {
+  return Ty->isPointerTy() && Ty->getPointerAddressSpace() == MOS::AS_Far;
+}
+
+// Returns whether a far pointer hides within the aggregate or vector Ty, where
+// it can't be rewritten.
+static bool hasNestedFar(const Type *Ty) {
+  return any_of(Ty->subtypes(),
+                [](const Type *T) { return isFar(T) || hasNestedFar(T); });
+}
+
+static Type *mapType(Type *Ty) {
+  return isFar(Ty) ? Type::getInt32Ty(Ty->getContext()) : Ty;
+}
+
+static bool hasFar(const FunctionType *FTy) {
+  return isFar(FTy->getReturnType()) || any_of(FTy->params(), isFar);
+}
+
+static FunctionType *mapFunctionType(FunctionType *FTy) {
+  SmallVector<Type *> Params;
+  for (Type *T : FTy->params())
+    Params.push_back(mapType(T));
+  return FunctionType::get(mapType(FTy->getReturnType()), Params,
+                           FTy->isVarArg());
+}
+
+// Drops the pointer attributes of the far parameters and return value of a
+// function of type FTy, which don't apply to their i32 replacements.
+static AttributeList mapAttributes(LLVMContext &Ctx, AttributeList Attrs,
+                                   const FunctionType *FTy) {
+  Type *I32 = Type::getInt32Ty(Ctx);
+  if (isFar(FTy->getReturnType()))
+    Attrs = Attrs.removeRetAttributes(
+        Ctx, AttributeFuncs::typeIncompatible(I32, Attrs.getRetAttrs()));
+  for (auto [ArgNo, T] : enumerate(FTy->params()))
+    if (isFar(T))
+      Attrs = Attrs.removeParamAttributes(
+          Ctx, ArgNo,
+          AttributeFuncs::typeIncompatible(I32, Attrs.getParamAttrs(ArgNo)));
+  return Attrs;
+}
+
+// Returns whether the constant C is, or is computed from, a far pointer.
+static bool refersToFar(const Constant *C) {
+  if (isFar(C->getType()))
+    return true;
+  const auto *CE = dyn_cast<ConstantExpr>(C);
+  return CE && any_of(CE->operands(), [](const Use &U) {
+           return refersToFar(cast<Constant>(U.get()));
+         });
+}
+
+static bool touchesFar(const Instruction &I) {
+  auto IsFar = [](const Type *T) { return isFar(T) || hasNestedFar(T); };
+  return IsFar(I.getType()) || any_of(I.operands(), [&](const Use &U) {
+           const auto *CE = dyn_cast<ConstantExpr>(U.get());
+           return IsFar(U->getType()) || (CE && refersToFar(CE));
+         });
+}
+
+// Replaces F with a function taking and returning i32s in place of its far
+// pointers, and returns it. F is left an empty husk, to be erased once its
+// callers have been rewritten.
+static Function *rewriteSignature(Function &F,
+                                  DenseMap<Argument *, Argument *> &FarArgs) {
+  FunctionType *FTy = F.getFunctionType();
+  Function *NF = Function::Create(mapFunctionType(FTy), F.getLinkage(),
+                                  F.getAddressSpace());
+  NF->copyAttributesFrom(&F);
+  NF->setAttributes(mapAttributes(F.getContext(), F.getAttributes(), FTy));
+  NF->copyMetadata(&F, 0);
+  F.getParent()->getFunctionList().insert(F.getIterator(), NF);
+  NF->takeName(&F);
+  NF->splice(NF->begin(), &F);
+  for (auto [A, NA] : zip(F.args(), NF->args())) {
+    NA.takeName(&A);
+    if (isFar(A.getType()))
+      FarArgs[&A] = &NA;
+    else
+      A.replaceAllUsesWith(&NA);
+  }
+  return NF;
+}
+
+Value *FarRewriter::unsupported(Instruction &I, const Twine &What) {
+  F.getContext().diagnose(
+      DiagnosticInfoUnsupported(F, What + " far pointers", I.getDebugLoc()));
+  if (I.getType()->isVoidTy())
+    return nullptr;
+  return PoisonValue::get(mapType(I.getType()));
+}
+
+// Returns the i32 that replaces the far pointer V, materializing it before
+// Before if it's a constant.
+Value *FarRewriter::getInt(Value *V, Instruction *Before) {
+  if (Value *Int = Ints.lookup(V))
+    return Int;
+  if (auto *A = dyn_cast<Argument>(V))
+    return FarArgs.lookup(A);
+
+  auto *C = cast<Constant>(V);
+  if (isa<ConstantPointerNull>(C))
+    return ConstantInt::get(I32, 0);
+  if (isa<PoisonValue>(C))
+    return PoisonValue::get(I32);
+  if (isa<UndefValue>(C))
+    return UndefValue::get(I32);
+  if (auto *CE = dyn_cast<ConstantExpr>(C);
+      CE && CE->getOpcode() == Instruction::IntToPtr)
+    if (auto *CI = dyn_cast<ConstantInt>(CE->getOperand(0)))
+      return ConstantInt::get(I32, CI->getValue().zextOrTrunc(32));
+
+  // Anything else refers to a far global.
+  GlobalVariable *&GV = Addrs[C];
+  if (!GV) {
+    GV = new GlobalVariable(*F.getParent(), I32, /*isConstant=*/true,
+                            GlobalValue::PrivateLinkage,
+                            ConstantExpr::getPtrToInt(C, I32), "far.addr");
+    GV->setUnnamedAddr(GlobalValue::UnnamedAddr::Global);
+    GV->setAlignment(Align(1));
+  }
+  IRBuilder<> Builder(Before);
+  LoadInst *Load = Builder.CreateAlignedLoad(I32, GV, Align(1));
+  Load->setMetadata(LLVMContext::MD_invariant_load,
+                    MDNode::get(F.getContext(), {}));
+  return Load;
+}
+
+// Splits the far address Addr into a base and a constant offset, small enough
+// that an access of Size bytes at the address stays within the two banks
+// mapped for the base.
+static std::pair<Value *, uint64_t> splitAddress(Value *Addr, uint64_t Size) {
+  Value *Base = Addr;
+  uint64_t Offset = 0;
+  while (auto *BO = dyn_cast<BinaryOperator>(Base)) {
+    auto *C = dyn_cast<ConstantInt>(BO->getOperand(1));
+    if (BO->getOpcode() != Instruction::Add || !C ||
+        C->getZExtValue() + Offset + Size > BankSize)
+      break;
+    Offset += C->getZExtValue();
+    Base = BO->getOperand(0);
+  }
+  return {Base, Offset};
+}
+
+void FarRewriter::addAccess(Instruction *I, Value *Addr, Type *Ty) {
+  auto [Base, Offset] = splitAddress(Addr, DL.getTypeStoreSize(Ty));
+  Accesses.push_back({I, Base, Offset});
+}
+
+Value *FarRewriter::rewriteCall(CallBase &CB) {
+  const Function *Callee = CB.getCalledFunction();
+  if (Callee && Callee->getIntrinsicID() == Intrinsic::assume)
+    return nullptr;
+  if (CB.isInlineAsm() || isa<CallBrInst>(CB) ||
+      (Callee && Callee->isIntrinsic()))
+    return unsupported(CB, "this use of");
+
+  Value *NewCallee = CB.getCalledOperand();
+  if (auto *F = dyn_cast<Function>(NewCallee))
+    if (Function *NF = Clones.lookup(F))
+      NewCallee = NF;
+  SmallVector<Value *> Args;
+  for (Value *Arg : CB.args())
+    Args.push_back(isFar(Arg->getType()) ? getInt(Arg, &CB) : Arg);
+  SmallVector<OperandBundleDef> Bundles;
+  CB.getOperandBundlesAsDefs(Bundles);
+
+  IRBuilder<> Builder(&CB);
+  FunctionType *FTy = mapFunctionType(CB.getFunctionType());
+  CallBase *NCB;
+  if (auto *II = dyn_cast<InvokeInst>(&CB)) {
+    NCB = Builder.CreateInvoke(FTy, NewCallee, II->getNormalDest(),
+                               II->getUnwindDest(), Args, Bundles);
+  } else {
+    CallInst *CI = Builder.CreateCall(FTy, NewCallee, Args, Bundles);
+    CI->setTailCallKind(cast<CallInst>(CB).getTailCallKind());
+    NCB = CI;
+  }
+  NCB->setCallingConv(CB.getCallingConv());
+  NCB->setAttributes(mapAttributes(CB.getContext(), CB.getAttributes(),
+                                   CB.getFunctionType()));
+  NCB->copyMetadata(CB);
+  NCB->takeName(&CB);
+  return NCB;
+}
+
+// Expands the operands of I that are computed from far pointers without being
+// far pointers themselves, like the ptrtoint of a far global, into
+// instructions, and rewrites those.
+void FarRewriter::expandConstants(Instruction &I) {
+  auto *Phi = dyn_cast<PHINode>(&I);
+  // A phi must receive the same value along each edge from a block.
+  SmallDenseMap<BasicBlock *, Instruction *> Incoming;
+  for (Use &U : I.operands()) {
+    auto *CE = dyn_cast<ConstantExpr>(U.get());
+    if (!CE || isFar(CE->getType()) || !refersToFar(CE))
+      continue;
+    Instruction *Before = &I;
+    Instruction *New = nullptr;
+    if (Phi) {
+      BasicBlock *Pred = Phi->getIncomingBlock(U);
+      Before = Pred->getTerminator();
+      New = Incoming.lookup(Pred);
+    }
+    if (!New) {
+      New = CE->getAsInstruction();
+      New->insertBefore(Before->getIterator());
+      if (Phi)
+        Incoming[Phi->getIncomingBlock(U)] = New;
+    }
+    U.set(New);
+    rewrite(*New);
+  }
+}
+
+void FarRewriter::rewrite(Instruction &I) {
+  expandConstants(I);
+  if (!touchesFar(I))
+    return;
+  if (hasNestedFar(I.getType()) ||
+      any_of(I.operands(),
+             [](const Use &U) { return hasNestedFar(U->getType()); })) {
+    Value *New = unsupported(I, "aggregates and vectors of");
+    if (isFar(I.getType()))
+      Ints[&I] = New;
+    else if (New)
+      I.replaceAllUsesWith(New);
+    Dead.push_back(&I);
+    return;
+  }
+
+  IRBuilder<> Builder(&I);
+  // Far addresses are given a placeholder until their banks are mapped.
+  Value *Placeholder = PoisonValue::get(Builder.getPtrTy());
+  Value *New = nullptr;
+  if (auto *Load = dyn_cast<LoadInst>(&I)) {
+    Value *Addr = isFar(Load->getPointerOperandType())
+                      ? getInt(Load->getPointerOperand(), &I)
+                      : nullptr;
+    LoadInst *NewLoad = Builder.CreateAlignedLoad(
+        mapType(Load->getType()),
+        Addr ? Placeholder : Load->getPointerOperand(), Load->getAlign(),
+        Load->isVolatile());
+    if (Load->isAtomic())
+      NewLoad->setAtomic(Load->getOrdering(), Load->getSyncScopeID());
+    NewLoad->takeName(Load);
+    if (Addr)
+      addAccess(NewLoad, Addr, Load->getType());
+    New = NewLoad;
+  } else if (auto *Store = dyn_cast<StoreInst>(&I)) {
+    Value *Val = Store->getValueOperand();
+    Value *Addr = isFar(Store->getPointerOperandType())
+                      ? getInt(Store->getPointerOperand(), &I)
+                      : nullptr;
+    StoreInst *NewStore = Builder.CreateAlignedStore(
+        isFar(Val->getType()) ? getInt(Val, &I) : Val,
+        Addr ? Placeholder : Store->getPointerOperand(), Store->getAlign(),
+        Store->isVolatile());
+    if (Store->isAtomic())
+      NewStore->setAtomic(Store->getOrdering(), Store->getSyncScopeID());
+    if (Addr)
+      addAccess(NewStore, Addr, Val->getType());
+  } else if (auto *GEP = dyn_cast<GetElementPtrInst>(&I)) {
+    Value *Base = getInt(GEP->getPointerOperand(), &I);
+    New = Builder.CreateAdd(Base, emitGEPOffset(&Builder, DL, GEP),
+                            GEP->getName());
+  } else if (auto *Call = dyn_cast<CallBase>(&I)) {
+    New = rewriteCall(*Call);
+  } else if (auto *Ret = dyn_cast<ReturnInst>(&I)) {
+    Builder.CreateRet(getInt(Ret->getReturnValue(), &I));
+  } else {
+    switch (I.getOpcode()) {
+    default:
+      New = unsupported(I, "this use of");
+      break;
+    case Instruction::PtrToInt:
+      New = Builder.CreateZExtOrTrunc(getInt(I.getOperand(0), &I),
+                                      I.getType());
+      break;
+    case Instruction::IntToPtr:
+      New = Builder.CreateZExtOrTrunc(I.getOperand(0), I32);
+      break;
+    case Instruction::BitCast:
+      New = getInt(I.getOperand(0), &I);
+      break;
+    case Instruction::AddrSpaceCast:
+      New = unsupported(I, "casts between near and");
+      break;
+    case Instruction::ICmp:
+      New = Builder.CreateICmp(cast<ICmpInst>(I).getPredicate(),
+                               getInt(I.getOperand(0), &I),
+                               getInt(I.getOperand(1), &I));
+      break;
+    case Instruction::Select:
+      New = Builder.CreateSelect(I.getOperand(0), getInt(I.getOperand(1), &I),
+                                 getInt(I.getOperand(2), &I));
+      break;
+    case Instruction::Freeze:
+      New = Builder.CreateFreeze(getInt(I.getOperand(0), &I));
+      break;
+    case Instruction::VAArg:
+      New = Builder.CreateVAArg(I.getOperand(0), I32);
+      break;
+    }
+  }
+
+  if (isFar(I.getType()))
+    Ints[&I] = New;
+  else if (New)
+    I.replaceAllUsesWith(New);
+  Dead.push_back(&I);
+}
+
+void FarRewriter::run() {
+  // Phis may use values not yet rewritten, so they're created up front and
+  // filled in last.
+  SmallVector<PHINode *> Phis;
+  for (BasicBlock &BB : F) {
+    for (PHINode &Phi : BB.phis()) {
+      if (!isFar(Phi.getType()))
+        continue;
+      Ints[&Phi] = PHINode::Create(I32, Phi.getNumIncomingValues(),
+                                   Phi.getName(), Phi.getIterator());
+      Phis.push_back(&Phi);
+    }
+  }
+
+  // In reverse post-order, every other value is rewritten before its uses.
+  ReversePostOrderTraversal<Function *> RPOT(&F);
+  for (BasicBlock *BB : RPOT) {
+    for (Instruction &I : make_early_inc_range(*BB)) {
+      if (!isa<PHINode>(I))
+        rewrite(I);
+      else if (!isFar(I.getType()))
+        expandConstants(I);
+    }
+  }
+
+  for (PHINode *Phi : Phis) {
+    auto *New = cast<PHINode>(Ints[Phi]);
+    // A block may reach the phi along several edges, but it must pass the
+    // same value along each.
+    SmallDenseMap<BasicBlock *, Value *> Incoming;
+    for (auto [V, BB] : zip(Phi->incoming_values(), Phi->blocks())) {
+      Value *&Int = Incoming[BB];
+      if (!Int)
+        Int = getInt(V, BB->getTerminator());
+      New->addIncoming(Int, BB);
+    }
+    Dead.push_back(Phi);
+  }
+
+  for (Instruction *I : Dead)
+    if (!I->getType()->isVoidTy())
+      I->replaceAllUsesWith(PoisonValue::get(I->getType()));
+  for (Instruction *I : Dead)
+    I->eraseFromParent();
+}
+
+// Returns whether I may map other banks into the window.
+static bool mayRemap(const Instruction &I) {
+  const auto *CB = dyn_cast<CallBase>(&I);
+  if (!CB)
+    return false;
+  const Function *Callee = CB->getCalledFunction();
+  return CB->isInlineAsm() || !Callee || !Callee->isIntrinsic();
+}
+
+// Marks the accesses whose banks must already have been mapped by another
+// access, along every path through the function.
+static void findMapped(Function &F, MutableArrayRef<FarAccess> Accesses) {
+  DenseMap<const Instruction *, FarAccess *> AccessFor;
+  for (FarAccess &A : Accesses)
+    AccessFor[A.I] = &A;
+
+  // The base whose banks are mapped on exit from each block visited, or null
+  // if that isn't known.
+  DenseMap<const BasicBlock *, Value *> Out;
+  auto GetIn = [&](const BasicBlock &BB) -> Value * {
+    if (BB.isEntryBlock())
+      return nullptr;
+    Value *In = nullptr;
+    bool Seen = false;
+    for (const BasicBlock *Pred : predecessors(&BB)) {
+      auto It = Out.find(Pred);
+      if (It == Out.end())
+        continue;
+      if (!Seen)
+        In = It->second;
+      else if (In != It->second)
+        In = nullptr;
+      Seen = true;
+    }
+    return In;
+  };
+  auto Transfer = [&](const BasicBlock &BB, Value *Mapped, bool Mark) {
+    for (const Instruction &I : BB) {
+      if (FarAccess *A = AccessFor.lookup(&I)) {
+        if (Mark)
+          A->Mapped = A->Base == Mapped;
+        Mapped = A->Base;
+      } else if (&I == Mapped || mayRemap(I)) {
+        // A base that's redefined, as by the next iteration of a loop, may
+        // lie within other banks.
+        Mapped = nullptr;
+      }
+    }
+    return Mapped;
+  };
+
+  ReversePostOrderTraversal<Function *> RPOT(&F);
+  bool Changed = true;
+  while (Changed) {
+    Changed = false;
+    for (const BasicBlock *BB : RPOT) {
+      Value *NewOut = Transfer(*BB, GetIn(*BB), /*Mark=*/false);
+      auto [It, Inserted] = Out.try_emplace(BB, NewOut);
+      if (Inserted || It->second != NewOut) {
+        It->second = NewOut;
+        Changed = true;
+      }
+    }
+  }
+  for (const BasicBlock *BB : RPOT)
+    Transfer(*BB, GetIn(*BB), /*Mark=*/true);
+}
+
+// Maps the banks holding Base into the window before I, unless __far_bank
+// says that they are there already.
+static void emitMap(Instruction *I, Value *Base, const MOSSubtarget &STI) {
+  Module &M = *I->getModule();
+  IRBuilder<> Builder(I);
+  Type *I8 = Builder.getInt8Ty();
+  Constant *Cur = M.getOrInsertGlobal("__far_bank", I8);
+  Value *Bank = Builder.CreateTrunc(Builder.CreateLShr(Base, BankBits), I8,
+                                    "far.bank");
+  Value *Stale = Builder.CreateICmpNE(Builder.CreateLoad(I8, Cur), Bank);
+  Instruction *Then = SplitBlockAndInsertIfThen(
+      Stale, I, /*Unreachable=*/false,
+      MDBuilder(M.getContext()).createUnlikelyBranchWeights());
+
+  Builder.SetInsertPoint(Then);
+  if (STI.hasHUC6280()) {
+    unsigned MPR = FarWindow >> BankBits;
+    Function *TAM = Intrinsic::getOrInsertDeclaration(&M, Intrinsic::mos_tam);
+    Builder.CreateCall(TAM, {Bank, Builder.getInt8(1 << MPR)});
+    Builder.CreateCall(TAM, {Builder.CreateAdd(Bank, Builder.getInt8(1)),
+                             Builder.getInt8(1 << (MPR + 1))});
+  } else {
+    FunctionCallee Map =
+        M.getOrInsertFunction("__far_map", Builder.getVoidTy(), I8);
+    Builder.CreateCall(Map, Bank);
+  }
+  Builder.CreateStore(Bank, Cur);
+}
+
+// Points the access through the window, at the bytes of its far address.
+static void lowerAccess(const FarAccess &A) {
+  IRBuilder<> Builder(A.I);
+  Value *Low = Builder.CreateTrunc(Builder.CreateAnd(A.Base, BankSize - 1),
+                                   Builder.getInt16Ty());
+  Constant *Window = ConstantExpr::getIntToPtr(
+      Builder.getInt16(FarWindow + A.Offset), Builder.getPtrTy());
+  Value *Ptr = Builder.CreateGEP(Builder.getInt8Ty(), Window, Low, "far.ptr");
+  if (isa<LoadInst>(A.I))
+    A.I->setOperand(LoadInst::getPointerOperandIndex(), Ptr);
+  else
+    A.I->setOperand(StoreInst::getPointerOperandIndex(), Ptr);
+}
+
+// Expands the memory intrinsics in F that involve far memory into loops of
+// far loads and stores. Any that can't be are diagnosed later.
+static void expandFarMemIntrinsics(Function &F,
+                                   const TargetTransformInfo &TTI) {
+  SmallVector<MemIntrinsic *> MemOps;
+  for (Instruction &I : instructions(F))
+    if (auto *MI = dyn_cast<MemIntrinsic>(&I);
+        MI && any_of(MI->args(),
+                     [](const Value *V) { return isFar(V->getType()); }))
+      MemOps.push_back(MI);
+
+  for (MemIntrinsic *MI : MemOps) {
+    if (auto *Cpy = dyn_cast<MemCpyInst>(MI))
+      expandMemCpyAsLoop(Cpy, TTI);
+    else if (auto *Move = dyn_cast<MemMoveInst>(MI)) {
+      if (!expandMemMoveAsLoop(Move, TTI))
+        continue;
+    } else if (auto *Set = dyn_cast<MemSetInst>(MI))
+      expandMemSetAsLoop(Set);
+    else
+      continue;
+    MI->eraseFromParent();
+  }
+}
+
+bool MOSLowerFar::runOnModule(Module &M) {
+  if (FarWindow % BankSize || FarWindow + 2 * BankSize > 0x10000)
+    report_fatal_error("invalid -mos-far-window: " + Twine(FarWindow));
+  const TargetMachine &TM =
+      getAnalysis<TargetPassConfig>().getTM<TargetMachine>();
+
+  DenseMap<Function *, Function *> Clones;
+  DenseMap<Argument *, Argument *> FarArgs;
+  for (Function &F : make_early_inc_range(M))
+    if (!F.isIntrinsic() && hasFar(F.getFunctionType()))
+      Clones[&F] = rewriteSignature(F, FarArgs);
+
+  bool Changed = !Clones.empty();
+  DenseMap<Constant *, GlobalVariable *> Addrs;
+  for (Function &F : M) {
+    if (F.isDeclaration() || none_of(instructions(F), touchesFar))
+      continue;
+    Changed = true;
+    removeUnreachableBlocks(F);
+    expandFarMemIntrinsics(
+        F, getAnalysis<TargetTransformInfoWrapperPass>().getTTI(F));
+
+    FarRewriter Rewriter(F, Clones, FarArgs, Addrs);
+    Rewriter.run();
+    findMapped(F, Rewriter.Accesses);
+    const auto &STI = TM.getSubtarget<MOSSubtarget>(F);
+    for (const FarAccess &A : Rewriter.Accesses) {
+      LLVM_DEBUG(dbgs() << "Lowering far access " << *A.I << "\n");
+      if (A.Mapped)
+        ++NumMapsElided;
+      else
+        emitMap(A.I, A.Base, STI);
+      lowerAccess(A);
+      ++NumFarAccesses;
+    }
+  }
+
+  for (auto [F, NF] : Clones) {
+    for (Argument &A : F->args())
+      A.replaceAllUsesWith(PoisonValue::get(A.getType()));
+    F->replaceAllUsesWith(NF);
+    F->eraseFromParent();
+  }
+  return Changed;
+}
+
+void MOSLowerFar::getAnalysisUsage(AnalysisUsage &AU) const {
+  AU.addRequired<TargetPassConfig>();
+  AU.addRequired<TargetTransformInfoWrapperPass>();
+}
+
+char MOSLowerFar::ID = 0;
+
+INITIALIZE_PASS_BEGIN(MOSLowerFar, DEBUG_TYPE, "Lower MOS far pointers", false,
+                      false)
+INITIALIZE_PASS_DEPENDENCY(TargetPassConfig)
+INITIALIZE_PASS_DEPENDENCY(TargetTransformInfoWrapperPass)
+INITIALIZE_PASS_END(MOSLowerFar, DEBUG_TYPE, "Lower MOS far pointers", false,
+                    false)
+
+ModulePass *llvm::createMOSLowerFarPass() { return new MOSLowerFar(); }
@@ -0,0 +1,24 @@
+//===-- MOSLowerFar.h - MOS Far Pointer Lowering ----------------*- C++ -*-===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares the MOS far pointer lowering pass.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_LIB_TARGET_MOS_MOSLOWERFAR_H
+#define LLVM_LIB_TARGET_MOS_MOSLOWERFAR_H
+
+#include "llvm/Pass.h"
+
+namespace llvm {
+
+ModulePass *createMOSLowerFarPass();
+
+} // namespace llvm
+
+#endif // not LLVM_LIB_TARGET_MOS_MOSLOWERFAR_H
@@ -0,0 +1,141 @@
+//===-- MOSLowerPortIO.cpp - MOS Port I/O Lowering ------------------------===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines the MOS port I/O lowering pass.
+//
+// The llvm.mos.port.* intrinsics transfer blocks of bytes to or from a single
+// hardware register. This pass lowers them to volatile loads and stores of the
+// port, before the IR optimizations that run during code generation. Short
+// blocks of constant size are unrolled, so each byte becomes an absolute load
+// and store. Anything else becomes a counted loop, which the loop passes and
+// the indexed addressing modes then handle as usual.
+//
+//===----------------------------------------------------------------------===//
+
+#include "MOSLowerPortIO.h"
+
+#include "MOS.h"
+
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/IntrinsicsMOS.h"
+#include "llvm/Support/CommandLine.h"
+
+#define DEBUG_TYPE "mos-lower-port-io"
+
+using namespace llvm;
+
+static cl::opt<unsigned> UnrollLimit(
+    "mos-port-io-unroll-limit",
+    cl::desc("Unroll port block transfers of at most this many bytes"),
+    cl::init(8), cl::Hidden);
+
+namespace {
+
+struct MOSLowerPortIO : public FunctionPass {
+  static char ID; // Pass identification, replacement for typeid
+
+  MOSLowerPortIO() : FunctionPass(ID) {
+    initializeMOSLowerPortIOPass(*PassRegistry::getPassRegistry());
+  }
+
+  bool runOnFunction(Function &F) override;
+};
+
+} // namespace
+
+// Emits the transfer of the byte at Index.
+static void emitTransfer(IRBuilder<> &Builder, IntrinsicInst &II,
+                         Value *Index) {
+  Type *I8 = Builder.getInt8Ty();
+  switch (II.getIntrinsicID()) {
+  default:
+    llvm_unreachable("Unexpected intrinsic");
+  case Intrinsic::mos_port_write_block: {
+    Value *Src = Builder.CreateGEP(I8, II.getArgOperand(1), Index);
+    Builder.CreateStore(Builder.CreateLoad(I8, Src), II.getArgOperand(0),
+                        /*isVolatile=*/true);
+    break;
+  }
+  case Intrinsic::mos_port_read_block: {
+    Value *Dst = Builder.CreateGEP(I8, II.getArgOperand(0), Index);
+    Builder.CreateStore(
+        Builder.CreateLoad(I8, II.getArgOperand(1), /*isVolatile=*/true), Dst);
+    break;
+  }
+  case Intrinsic::mos_port_fill:
+    Builder.CreateStore(II.getArgOperand(1), II.getArgOperand(0),
+                        /*isVolatile=*/true);
+    break;
+  }
+}
+
+static void lowerPortIO(IntrinsicInst &II) {
+  Value *Count = II.getArgOperand(2);
+  Type *CountTy = Count->getType();
+  IRBuilder<> Builder(&II);
+
+  if (const auto *C = dyn_cast<ConstantInt>(Count);
+      C && C->getZExtValue() <= UnrollLimit) {
+    for (uint64_t I = 0, E = C->getZExtValue(); I != E; ++I)
+      emitTransfer(Builder, II, ConstantInt::get(CountTy, I));
+    II.eraseFromParent();
+    return;
+  }
+
+  BasicBlock *Preheader = II.getParent();
+  BasicBlock *Exit = Preheader->splitBasicBlock(&II, "port.exit");
+  BasicBlock *Loop = BasicBlock::Create(II.getContext(), "port.loop",
+                                        Preheader->getParent(), Exit);
+  Preheader->getTerminator()->eraseFromParent();
+
+  Builder.SetInsertPoint(Preheader);
+  Value *Zero = ConstantInt::get(CountTy, 0);
+  Builder.CreateCondBr(Builder.CreateICmpEQ(Count, Zero), Exit, Loop);
+
+  Builder.SetInsertPoint(Loop);
+  PHINode *Index = Builder.CreatePHI(CountTy, 2, "port.index");
+  Index->addIncoming(Zero, Preheader);
+  emitTransfer(Builder, II, Index);
+  Value *Next = Builder.CreateAdd(Index, ConstantInt::get(CountTy, 1));
+  Index->addIncoming(Next, Loop);
+  Builder.CreateCondBr(Builder.CreateICmpNE(Next, Count), Loop, Exit);
+
+  II.eraseFromParent();
+}
+
+bool MOSLowerPortIO::runOnFunction(Function &F) {
+  SmallVector<IntrinsicInst *> Worklist;
+  for (Instruction &I : instructions(F)) {
+    auto *II = dyn_cast<IntrinsicInst>(&I);
+    if (!II)
+      continue;
+    switch (II->getIntrinsicID()) {
+    case Intrinsic::mos_port_write_block:
+    case Intrinsic::mos_port_read_block:
+    case Intrinsic::mos_port_fill:
+      Worklist.push_back(II);
+      break;
+    default:
+      break;
+    }
+  }
+
+  for (IntrinsicInst *II : Worklist)
+    lowerPortIO(*II);
+  return !Worklist.empty();
+}
+
+char MOSLowerPortIO::ID = 0;
+
+INITIALIZE_PASS(MOSLowerPortIO, DEBUG_TYPE,
+                "Lower MOS port block transfers", false, false)
+
+FunctionPass *llvm::createMOSLowerPortIOPass() { return new MOSLowerPortIO(); }
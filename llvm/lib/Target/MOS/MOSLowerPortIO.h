@@ -0,0 +1,24 @@
+//===-- MOSLowerPortIO.h - MOS Port I/O Lowering ----------------*- C++ -*-===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares the MOS port I/O lowering pass.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_LIB_TARGET_MOS_MOSLOWERPORTIO_H
+#define LLVM_LIB_TARGET_MOS_MOSLOWERPORTIO_H
+
+#include "llvm/Pass.h"
+
+namespace llvm {
+
+FunctionPass *createMOSLowerPortIOPass();
+
+} // namespace llvm
+
+#endif // not LLVM_LIB_TARGET_MOS_MOSLOWERPORTIO_H
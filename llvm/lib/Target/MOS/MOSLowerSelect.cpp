@@ -8,23 +8,55 @@
 //
 // This file defines the MOS select pseudo lowering pass.
 //
+// Selects are generally lowered to a diamond of basic blocks. Selects of bytes
+// controlled directly by the carry flag can instead often be computed with a
+// short straight-line carry sequence, e.g., c ? 1 : 0 is ADC #0 from zero, and
+// c ? 0 : 0xff is SBC #0 from zero. These are used whenever they cost no more
+// than the branches they replace.
+//
+// Selects of the same condition share a single diamond, with one phi each.
+// Values wider than a byte are selected a byte at a time, so this saves a
+// branch and a test of the condition for every byte past the first. To find
+// them, each select is first moved up to the previous select of its condition
+// in the same block, wherever its operands are already available there. Tests
+// are compared through copies.
+//
+// This pass also lowers G_SHIFT_LOOP, for the same reason: the legalizer
+// cannot introduce control flow.
+//
+// Each select gets an optimization remark (-Rpass=mos-lower-select) saying
+// whether it became branches or a carry sequence.
+//
 //===----------------------------------------------------------------------===//
 
 #include "MOSLowerSelect.h"
 
 #include "MCTargetDesc/MOSMCTargetDesc.h"
 #include "MOS.h"
+#include "MOSInstrCost.h"
+#include "MOSSubtarget.h"
 #include "llvm/ADT/SmallSet.h"
+#include "llvm/ADT/Statistic.h"
 #include "llvm/CodeGen/GlobalISel/GenericMachineInstrs.h"
 #include "llvm/CodeGen/GlobalISel/MachineIRBuilder.h"
 #include "llvm/CodeGen/GlobalISel/Utils.h"
 #include "llvm/CodeGen/MachineBasicBlock.h"
 #include "llvm/CodeGen/MachineOperand.h"
+#include "llvm/CodeGen/MachineOptimizationRemarkEmitter.h"
 #include "llvm/CodeGen/MachineRegisterInfo.h"
 #include "llvm/CodeGen/TargetInstrInfo.h"
+#include "llvm/Support/TimeProfiler.h"
 
 #define DEBUG_TYPE "mos-lower-select"
 
+STATISTIC(NumBranchlessSelects, "Number of selects lowered without branches");
+STATISTIC(NumBranchSelects, "Number of selects lowered to branches");
+STATISTIC(NumSelectsMerged,
+          "Number of selects merged into another with the same test");
+STATISTIC(NumSelectsGrouped,
+          "Number of selects moved next to another with the same test");
+STATISTIC(NumShiftLoops, "Number of shift loops lowered");
+
 using namespace llvm;
 
 namespace {
@@ -50,16 +82,33 @@ public:
 
   bool runOnMachineFunction(MachineFunction &MF) override;
   void sinkSelectsToBranchUses(MachineFunction &MF);
+  bool groupSelects(MachineFunction &MF);
   MachineFunction::reverse_iterator lowerSelect(GSelect &MI);
+  bool lowerSelectBranchless(GSelect &MI);
+  MachineFunction::reverse_iterator lowerShiftLoop(MachineInstr &MI);
   void moveAwayFromCalls(MachineFunction &MF);
+
+private:
+  MachineOptimizationRemarkEmitter *ORE;
 };
 
 bool MOSLowerSelect::runOnMachineFunction(MachineFunction &MF) {
   LLVM_DEBUG(dbgs() << "\n\nHandling G_SELECTs in: " << MF.getName() << "\n\n");
+  TimeTraceScope Scope("MOSLowerSelect", MF.getName());
+  MachineOptimizationRemarkEmitter MORE(MF, /*MBFI=*/nullptr);
+  ORE = &MORE;
   moveAwayFromCalls(MF);
   sinkSelectsToBranchUses(MF);
 
   bool Changed = false;
+  if (!MF.getFunction().hasOptNone())
+    Changed |= groupSelects(MF);
+  if (!MF.getFunction().hasOptNone())
+    for (MachineBasicBlock &MBB : MF)
+      for (MachineInstr &MI : make_early_inc_range(MBB))
+        if (auto *S = dyn_cast<GSelect>(&MI))
+          Changed |= lowerSelectBranchless(*S);
+
   for (auto I = MF.rbegin(), E = MF.rend(); I != E; ++I) {
     for (MachineInstr &MBBI : mbb_reverse(*I)) {
       if (auto *S = dyn_cast<GSelect>(&MBBI)) {
@@ -68,11 +117,23 @@ bool MOSLowerSelect::runOnMachineFunction(MachineFunction &MF) {
         I = lowerSelect(*S);
         break;
       }
+      if (MBBI.getOpcode() == MOS::G_SHIFT_LOOP) {
+        LLVM_DEBUG(dbgs() << "Lowering: " << MBBI);
+        Changed = true;
+        I = lowerShiftLoop(MBBI);
+        break;
+      }
     }
   }
   return Changed;
 }
 
+// Returns the register holding the condition tested by S, looking through
+// copies.
+static Register getTest(const GSelect &S, const MachineRegisterInfo &MRI) {
+  return getSrcRegIgnoringCopies(S.getCondReg(), MRI);
+}
+
 Register getPhiValue(const MachineInstr &Phi, const MachineBasicBlock *MBB) {
   assert(Phi.getOpcode() == MOS::G_PHI);
   for (unsigned Idx = 1, End = Phi.getNumOperands(); Idx != End; Idx += 2)
@@ -101,7 +162,179 @@ void removePredecessorFromPhis(MachineBasicBlock *MBB,
         Idx += 2;
 }
 
+// Returns whether the carry flag is certain to survive from From until To.
+// This is a conservative list of generic operations that never lower to
+// anything that touches the carry.
+static bool preservesCarry(MachineBasicBlock::iterator From,
+                           MachineBasicBlock::iterator To) {
+  for (const MachineInstr &MI : make_range(From, To)) {
+    switch (MI.getOpcode()) {
+    default:
+      return false;
+    case MOS::COPY:
+    case MOS::G_CONSTANT:
+    case MOS::G_IMPLICIT_DEF:
+    case MOS::G_GLOBAL_VALUE:
+    case MOS::G_LOAD_ABS:
+      break;
+    }
+  }
+  return true;
+}
+
+// Finds the instruction that computes the carry flag tested by Tst, looking
+// through copies and negations. Returns the carry register, or an invalid
+// register if the test isn't a carry used only by this select.
+static Register findCarry(Register Tst, const MachineRegisterInfo &MRI,
+                          bool &Inverted, MachineInstr *&CarryMI) {
+  Inverted = false;
+  for (Register Reg = Tst;;) {
+    if (!Reg.isVirtual() || !MRI.hasOneNonDBGUse(Reg))
+      return Register();
+    MachineInstr *Def = MRI.getVRegDef(Reg);
+    switch (Def->getOpcode()) {
+    default:
+      return Register();
+    case MOS::COPY:
+      Reg = Def->getOperand(1).getReg();
+      continue;
+    case MOS::G_XOR: {
+      auto C = getIConstantVRegValWithLookThrough(Def->getOperand(2).getReg(),
+                                                  MRI);
+      if (!C || !C->Value.isOne())
+        return Register();
+      Inverted = !Inverted;
+      Reg = Def->getOperand(1).getReg();
+      continue;
+    }
+    case MOS::G_SBC:
+    case MOS::G_UADDE:
+      // The carry out is the second def of both.
+      if (Def->getOperand(1).getReg() != Reg)
+        return Register();
+      CarryMI = Def;
+      return Reg;
+    }
+  }
+}
+
+bool MOSLowerSelect::lowerSelectBranchless(GSelect &MI) {
+  MachineIRBuilder Builder(MI);
+  MachineFunction &MF = Builder.getMF();
+  MachineRegisterInfo &MRI = *Builder.getMRI();
+  const MOSSubtarget &STI = MF.getSubtarget<MOSSubtarget>();
+  const LLT S1 = LLT::scalar(1);
+  const LLT S8 = LLT::scalar(8);
+
+  Register Dst = MI.getOperand(0).getReg();
+  if (MRI.getType(Dst) != S8)
+    return false;
+  // Selects that feed branches are better folded into them.
+  if (MRI.hasOneNonDBGUse(Dst) &&
+      MRI.use_instr_nodbg_begin(Dst)->getOpcode() == MOS::G_BRCOND_IMM)
+    return false;
+
+  bool Inverted;
+  MachineInstr *CarryMI;
+  Register Carry = findCarry(MI.getCondReg(), MRI, Inverted, CarryMI);
+  if (!Carry || CarryMI->getParent() != MI.getParent() ||
+      !preservesCarry(std::next(CarryMI->getIterator()), MI.getIterator()))
+    return false;
+
+  Register TrueValue = MI.getTrueReg();
+  Register FalseValue = MI.getFalseReg();
+  if (Inverted)
+    std::swap(TrueValue, FalseValue);
+  auto TrueConst = getIConstantVRegValWithLookThrough(TrueValue, MRI);
+  auto FalseConst = getIConstantVRegValWithLookThrough(FalseValue, MRI);
+
+  // Each form below is a short sequence of operations on A, priced as that
+  // many immediate ORAs. The diamond is a branch, a load on each side, and a
+  // jump over one of them.
+  unsigned NumOps;
+  uint8_t T = 0, F = 0;
+  if (TrueConst && FalseConst) {
+    T = TrueConst->Value.getZExtValue();
+    F = FalseConst->Value.getZExtValue();
+    if (T == F)
+      return false;
+    if (static_cast<uint8_t>(T - F) == 1)
+      NumOps = 2;
+    else
+      NumOps = 2 + ((T ^ F) != 0xff) + (T != 0);
+  } else if (TrueConst && TrueConst->Value.isZero()) {
+    NumOps = 3;
+  } else if (FalseConst && FalseConst->Value.isZero()) {
+    NumOps = 4;
+  } else {
+    return false;
+  }
+
+  MOSInstrCost::Mode Mode = MOSInstrCost::getModeFor(MF);
+  MOSInstrCost Branchless = MOSInstrCost::get(MOS::ORA_Immediate, STI) * NumOps;
+  MOSInstrCost Diamond = MOSInstrCost::get(MOS::BNE_Relative, STI) +
+                         MOSInstrCost::get(MOS::LDA_Immediate, STI) * 2 +
+                         MOSInstrCost::get(MOS::JMP_Absolute, STI);
+  if (Branchless.value(Mode) > Diamond.value(Mode)) {
+    ORE->emit([&]() {
+      return MachineOptimizationRemarkMissed(DEBUG_TYPE, "BranchlessSelect",
+                                             MI.getDebugLoc(), MI.getParent())
+             << "select kept as branches: its carry sequence of "
+             << ore::NV("Ops", NumOps) << " operations costs more";
+    });
+    return false;
+  }
+
+  LLVM_DEBUG(dbgs() << "Lowering without branches: " << MI);
+  ++NumBranchlessSelects;
+  ORE->emit([&]() {
+    return MachineOptimizationRemark(DEBUG_TYPE, "BranchlessSelect",
+                                     MI.getDebugLoc(), MI.getParent())
+           << "select lowered to a carry sequence of "
+           << ore::NV("Ops", NumOps) << " operations instead of branches";
+  });
+  auto Zero = Builder.buildConstant(S8, 0);
+  // Mask = c ? 0 : 0xff
+  const auto BuildMask = [&]() {
+    return Builder
+        .buildInstr(MOS::G_SBC, {S8, S1, S1, S1, S1}, {Zero, Zero, Carry})
+        .getReg(0);
+  };
+
+  Register Result;
+  if (TrueConst && FalseConst) {
+    if (static_cast<uint8_t>(T - F) == 1) {
+      // F + c
+      Result = Builder.buildUAdde(S8, S1, Builder.buildConstant(S8, F), Zero,
+                                  Carry)
+                   .getReg(0);
+    } else {
+      // T ^ ((T ^ F) & Mask)
+      Result = BuildMask();
+      if ((T ^ F) != 0xff)
+        Result = Builder.buildAnd(S8, Result, Builder.buildConstant(S8, T ^ F))
+                     .getReg(0);
+      if (T != 0)
+        Result = Builder.buildXor(S8, Result, Builder.buildConstant(S8, T))
+                     .getReg(0);
+    }
+  } else if (TrueConst) {
+    // c ? 0 : F
+    Result = Builder.buildAnd(S8, FalseValue, BuildMask()).getReg(0);
+  } else {
+    // c ? T : 0
+    auto InvMask = Builder.buildXor(S8, BuildMask(),
+                                    Builder.buildConstant(S8, 0xff));
+    Result = Builder.buildAnd(S8, TrueValue, InvMask).getReg(0);
+  }
+  Builder.buildCopy(Dst, Result);
+  MI.eraseFromParent();
+  return true;
+}
+
 MachineFunction::reverse_iterator MOSLowerSelect::lowerSelect(GSelect &MI) {
+  TimeTraceScope Scope("MOSLowerSelect::lowerSelect");
+  ++NumBranchSelects;
   Register Dst = MI.getOperand(0).getReg();
   Register Tst = MI.getCondReg();
   Register TrueValue = MI.getTrueReg();
@@ -129,9 +362,10 @@ MachineFunction::reverse_iterator MOSLowerSelect::lowerSelect(GSelect &MI) {
     const auto *S = dyn_cast<GSelect>(&MBBI);
     if (!S)
       continue;
-    if (S->getCondReg() == Tst &&
+    if (getTest(*S, MRI) == getTest(MI, MRI) &&
         !UsedRegs.contains(MBBI.getOperand(0).getReg())) {
       LLVM_DEBUG(dbgs() << "Absorbing select with same test: " << MBBI);
+      ++NumSelectsMerged;
       Dsts.push_back(MBBI.getOperand(0).getReg());
       TrueValues.push_back(S->getTrueReg());
       FalseValues.push_back(S->getFalseReg());
@@ -140,6 +374,13 @@ MachineFunction::reverse_iterator MOSLowerSelect::lowerSelect(GSelect &MI) {
   }
   assert(Dsts.size() == TrueValues.size());
   assert(TrueValues.size() == FalseValues.size());
+  ORE->emit([&]() {
+    return MachineOptimizationRemarkAnalysis(DEBUG_TYPE, "SelectBranch",
+                                             MI.getDebugLoc(), &MBB)
+           << "select lowered to branches, along with "
+           << ore::NV("Merged", unsigned(Dsts.size() - 1))
+           << " other selects of the same condition";
+  });
 
   // To lower a G_SELECT instruction, we actually have to insert the diamond
   // control-flow pattern. The incoming instruction knows the destination
@@ -329,6 +570,161 @@ MachineFunction::reverse_iterator MOSLowerSelect::lowerSelect(GSelect &MI) {
   return MachineFunction::reverse_iterator(*SinkMBB);
 }
 
+MachineFunction::reverse_iterator
+MOSLowerSelect::lowerShiftLoop(MachineInstr &MI) {
+  ++NumShiftLoops;
+  Register Dst = MI.getOperand(0).getReg();
+  Register Src = MI.getOperand(1).getReg();
+  Register Amt = MI.getOperand(2).getReg();
+  unsigned Opcode = MI.getOperand(3).getImm();
+
+  MachineIRBuilder Builder(MI);
+  MachineBasicBlock &MBB = Builder.getMBB();
+  MachineFunction &MF = Builder.getMF();
+  MachineRegisterInfo &MRI = *Builder.getMRI();
+  const LLT S1 = LLT::scalar(1);
+  const LLT S8 = LLT::scalar(8);
+  const LLT Ty = MRI.getType(Dst);
+
+  // Each byte of the value is carried around the loop separately, since only
+  // 8-bit G_PHIs are legal.
+  //
+  //  thisMBB:
+  //   ...
+  //   %Src0, ..., %SrcN = G_UNMERGE_VALUES %Src
+  //   G_BRCOND_IMM (%Amt == 0), %TailMBB, 1
+  //   G_BR --> %LoopMBB
+  //  LoopMBB:
+  //   %Count = G_PHI [ %Amt, thisMBB ], [ %NextCount, LoopMBB ]
+  //   %ValI = G_PHI [ %SrcI, thisMBB ], [ %NextI, LoopMBB ]
+  //   %Next0, ..., %NextN = <%Val0, ..., %ValN shifted by one bit>
+  //   %NextCount = G_DEC %Count
+  //   G_BRCOND_IMM (%NextCount == 0), %LoopMBB, 0
+  //   G_BR --> %TailMBB
+  //  TailMBB:
+  //   %DstI = G_PHI [ %SrcI, thisMBB ], [ %NextI, LoopMBB ]
+  //   %Dst = G_MERGE_VALUES %Dst0, ..., %DstN
+  //   ...
+  const BasicBlock *LLVM_BB = MBB.getBasicBlock();
+  MachineFunction::iterator It = std::next(MBB.getIterator());
+  MachineBasicBlock *LoopMBB = MF.CreateMachineBasicBlock(LLVM_BB);
+  MachineBasicBlock *TailMBB = MF.CreateMachineBasicBlock(LLVM_BB);
+  MF.insert(It, LoopMBB);
+  MF.insert(It, TailMBB);
+
+  TailMBB->splice(TailMBB->begin(), &MBB, std::next(MI.getIterator()),
+                  MBB.end());
+  TailMBB->transferSuccessorsAndUpdatePHIs(&MBB);
+  MBB.addSuccessor(LoopMBB);
+  MBB.addSuccessor(TailMBB);
+  LoopMBB->addSuccessor(LoopMBB);
+  LoopMBB->addSuccessor(TailMBB);
+
+  SmallVector<Register> SrcBytes;
+  if (Ty == S8) {
+    SrcBytes.push_back(Src);
+  } else {
+    auto Unmerge = Builder.buildUnmerge(S8, Src);
+    for (MachineOperand &MO : Unmerge->defs())
+      SrcBytes.push_back(MO.getReg());
+  }
+  auto Zero = Builder.buildConstant(S8, 0);
+  auto True = Builder.buildConstant(S1, 1);
+  // Once selected, this is a comparison against zero, bundled into the branch.
+  const auto BuildIsZero = [&](Register Val) {
+    return Builder
+        .buildInstr(MOS::G_SBC, {S8, S1, S1, S1, S1}, {Val, Zero, True})
+        .getReg(4);
+  };
+  Builder.buildInstr(MOS::G_BRCOND_IMM, {}, {BuildIsZero(Amt)})
+      .addMBB(TailMBB)
+      .addImm(1);
+  Builder.buildInstr(MOS::G_BR).addMBB(LoopMBB);
+
+  Builder.setInsertPt(*LoopMBB, LoopMBB->begin());
+  SmallVector<Register> Bytes;
+  for (unsigned I = 0, E = SrcBytes.size(); I != E; ++I)
+    Bytes.push_back(MRI.createGenericVirtualRegister(S8));
+
+  Register Carry;
+  switch (Opcode) {
+  default:
+    llvm_unreachable("Invalid opcode.");
+  case MOS::G_SHL:
+  case MOS::G_LSHR:
+    Carry = Builder.buildConstant(S1, 0).getReg(0);
+    break;
+  case MOS::G_ASHR:
+  case MOS::G_ROTL:
+    // Once selected, this places the high bit in the carry flag.
+    Carry = Builder
+                .buildInstr(MOS::G_SBC, {S8, S1, S1, S1, S1},
+                            {Bytes.back(), Builder.buildConstant(S8, 0x80),
+                             True})
+                .getReg(1);
+    break;
+  case MOS::G_ROTR:
+    // Once selected, this places the low bit in the carry flag.
+    Carry = Builder
+                .buildInstr(MOS::G_LSHRE, {S8, S1},
+                            {Bytes.front(), Builder.buildUndef(S1)})
+                .getReg(1);
+    break;
+  }
+
+  bool IsLeft = Opcode == MOS::G_SHL || Opcode == MOS::G_ROTL;
+  SmallVector<Register> NextBytes(Bytes.size());
+  for (unsigned I = 0, E = Bytes.size(); I != E; ++I) {
+    unsigned Idx = IsLeft ? I : E - 1 - I;
+    auto Shift = Builder.buildInstr(IsLeft ? MOS::G_SHLE : MOS::G_LSHRE,
+                                    {S8, S1}, {Bytes[Idx], Carry});
+    NextBytes[Idx] = Shift.getReg(0);
+    Carry = Shift.getReg(1);
+  }
+
+  Register Count = MRI.createGenericVirtualRegister(S8);
+  Register NextCount = MRI.createGenericVirtualRegister(S8);
+  Builder.buildInstr(MOS::G_DEC).addDef(NextCount).addUse(Count);
+  Builder.buildInstr(MOS::G_BRCOND_IMM, {}, {BuildIsZero(NextCount)})
+      .addMBB(LoopMBB)
+      .addImm(0);
+  Builder.buildInstr(MOS::G_BR).addMBB(TailMBB);
+
+  Builder.setInsertPt(*LoopMBB, LoopMBB->begin());
+  Builder.buildInstr(MOS::G_PHI)
+      .addDef(Count)
+      .addUse(Amt)
+      .addMBB(&MBB)
+      .addUse(NextCount)
+      .addMBB(LoopMBB);
+  for (unsigned I = 0, E = Bytes.size(); I != E; ++I) {
+    Builder.buildInstr(MOS::G_PHI)
+        .addDef(Bytes[I])
+        .addUse(SrcBytes[I])
+        .addMBB(&MBB)
+        .addUse(NextBytes[I])
+        .addMBB(LoopMBB);
+  }
+
+  Builder.setInsertPt(*TailMBB, TailMBB->begin());
+  SmallVector<Register> DstBytes;
+  for (unsigned I = 0, E = Bytes.size(); I != E; ++I) {
+    Register DstByte = Ty == S8 ? Dst : MRI.createGenericVirtualRegister(S8);
+    Builder.buildInstr(MOS::G_PHI)
+        .addDef(DstByte)
+        .addUse(SrcBytes[I])
+        .addMBB(&MBB)
+        .addUse(NextBytes[I])
+        .addMBB(LoopMBB);
+    DstBytes.push_back(DstByte);
+  }
+  if (Ty != S8)
+    Builder.buildMergeValues(Dst, DstBytes);
+
+  MI.eraseFromParent();
+  return MachineFunction::reverse_iterator(*TailMBB);
+}
+
 // Before lowering selects, they and all attached instructions need to be
 // moved outside of call regions. Otherwise, they can create live physical
 // registers in basic blocks that are not entries, which is illegal in SSA
@@ -336,7 +732,8 @@ MachineFunction::reverse_iterator MOSLowerSelect::lowerSelect(GSelect &MI) {
 void MOSLowerSelect::moveAwayFromCalls(MachineFunction &MF) {
   for (MachineBasicBlock &MBB : MF) {
     for (auto I = MBB.begin(), E = MBB.end(); I != E; ++I) {
-      if (I->getOpcode() != MOS::JSR)
+      if (I->getOpcode() != MOS::JSR && I->getOpcode() != MOS::JSRIndir &&
+          I->getOpcode() != MOS::JSRIdxIndir)
         continue;
 
       SmallVector<MachineInstr *> PushedMIs;
@@ -359,7 +756,8 @@ void MOSLowerSelect::moveAwayFromCalls(MachineFunction &MF) {
 
       auto J = std::prev(I);
       for (; J->getOpcode() != MOS::ADJCALLSTACKDOWN; --J) {
-        if (J->getOpcode() == MOS::G_SELECT || DefinesUsedReg(*J)) {
+        if (J->getOpcode() == MOS::G_SELECT ||
+            J->getOpcode() == MOS::G_SHIFT_LOOP || DefinesUsedReg(*J)) {
           // Conservatively assume there was a store.
 #ifndef NDEBUG
           bool SawStore = true;
@@ -380,12 +778,59 @@ void MOSLowerSelect::moveAwayFromCalls(MachineFunction &MF) {
 // they're used for extensions, not truncations.
 #ifndef NDEBUG
       for (auto J = std::next(I); J->getOpcode() != MOS::ADJCALLSTACKUP; ++J)
-        assert(J->getOpcode() != MOS::G_SELECT);
+        assert(J->getOpcode() != MOS::G_SELECT &&
+               J->getOpcode() != MOS::G_SHIFT_LOOP);
 #endif
     }
   }
 }
 
+// Moves each select up to just after the latest earlier select in its block
+// with the same test, so that lowerSelect can merge the two. A select can only
+// be moved above instructions that don't define its operands, and not into a
+// call sequence.
+bool MOSLowerSelect::groupSelects(MachineFunction &MF) {
+  const auto &MRI = MF.getRegInfo();
+  bool Changed = false;
+  for (MachineBasicBlock &MBB : MF) {
+    for (MachineInstr &MI : MBB) {
+      const auto *S = dyn_cast<GSelect>(&MI);
+      if (!S)
+        continue;
+      Register Tst = getTest(*S, MRI);
+
+      // The registers defined between the group and the candidate select.
+      SmallSet<Register, 8> DefinedRegs;
+      MachineBasicBlock::iterator InsertPt = std::next(MI.getIterator());
+      for (MachineInstr &J : make_early_inc_range(
+               make_range(InsertPt, MBB.getFirstTerminator()))) {
+        if (J.isCall() || J.getOpcode() == MOS::ADJCALLSTACKDOWN ||
+            J.getOpcode() == MOS::ADJCALLSTACKUP)
+          break;
+        const auto *JS = dyn_cast<GSelect>(&J);
+        if (JS && getTest(*JS, MRI) == Tst &&
+            none_of(J.all_uses(), [&](const MachineOperand &MO) {
+              return DefinedRegs.contains(MO.getReg());
+            })) {
+          if (J.getIterator() != InsertPt) {
+            LLVM_DEBUG(dbgs() << "Grouping select with same test: " << J);
+            ++NumSelectsGrouped;
+            J.removeFromParent();
+            MBB.insert(InsertPt, &J);
+            Changed = true;
+          } else {
+            ++InsertPt;
+          }
+          continue;
+        }
+        for (const MachineOperand &MO : J.all_defs())
+          DefinedRegs.insert(MO.getReg());
+      }
+    }
+  }
+  return Changed;
+}
+
 void MOSLowerSelect::sinkSelectsToBranchUses(MachineFunction &MF) {
   const auto &MRI = MF.getRegInfo();
   for (MachineBasicBlock &MBB : MF) {
@@ -284,6 +284,19 @@ void MOSMCInstLower::lower(const MachineInstr *MI, MCInst &OutMI) {
     OutMI.addOperand(Tgt);
     return;
   }
+  case MOS::BRBit: {
+    OutMI.setOpcode(MI->getOperand(2).getImm() ? MOS::BBS_ZeroPage
+                                               : MOS::BBR_ZeroPage);
+    MCOperand Bit, Addr, Tgt;
+    if (!lowerOperand(MI->getOperand(1), Bit) ||
+        !lowerOperand(MI->getOperand(3), Addr) ||
+        !lowerOperand(MI->getOperand(0), Tgt))
+      llvm_unreachable("Failed to lower operand");
+    OutMI.addOperand(Bit);
+    OutMI.addOperand(Addr);
+    OutMI.addOperand(Tgt);
+    return;
+  }
   case MOS::BRA: {
     const auto &STI = MI->getMF()->getSubtarget<MOSSubtarget>();
     if (STI.has65C02() || STI.hasSPC700())
@@ -476,8 +489,10 @@ void MOSMCInstLower::lower(const MachineInstr *MI, MCInst &OutMI) {
     return;
   }
   case MOS::LDXIdx:
-  case MOS::LDYIdx: {
-    bool ZP = canUseZeroPageIdx(MI->getOperand(1));
+  case MOS::LDYIdx:
+  case MOS::LAXIdx: {
+    unsigned AddrIdx = MI->getOpcode() == MOS::LAXIdx ? 2 : 1;
+    bool ZP = canUseZeroPageIdx(MI->getOperand(AddrIdx));
     switch (MI->getOpcode()) {
     default:
       llvm_unreachable("Unexpected LDAbsIdx register.");
@@ -487,9 +502,12 @@ void MOSMCInstLower::lower(const MachineInstr *MI, MCInst &OutMI) {
     case MOS::LDYIdx:
       OutMI.setOpcode(ZP ? MOS::LDY_ZeroPageX : MOS::LDY_AbsoluteX);
       break;
+    case MOS::LAXIdx:
+      OutMI.setOpcode(ZP ? MOS::LAX_ZeroPageY : MOS::LAX_AbsoluteY);
+      break;
     }
     MCOperand Val;
-    if (!lowerOperand(MI->getOperand(1), Val))
+    if (!lowerOperand(MI->getOperand(AddrIdx), Val))
       llvm_unreachable("Failed to lower operand");
     if (!ZP)
       Val = wrapAbsoluteIdxBase(MI, Val, Ctx);
@@ -713,6 +731,28 @@ void MOSMCInstLower::lower(const MachineInstr *MI, MCInst &OutMI) {
     }
     return;
   }
+  case MOS::HuCPortCopy: {
+    bool Alternate = MI->getOperand(3).getImm();
+    OutMI.setOpcode(Alternate ? MOS::TIA_HuCBlockMove : MOS::TIN_HuCBlockMove);
+    for (auto I = 0; I < 3; I++) {
+      MCOperand Val;
+      if (!lowerOperand(MI->getOperand(I), Val))
+        llvm_unreachable("Failed to lower operand");
+      OutMI.addOperand(Val);
+    }
+    return;
+  }
+  case MOS::HuCMapBank:
+    OutMI.setOpcode(MOS::TAM_Immediate);
+    OutMI.addOperand(MCOperand::createImm(MI->getOperand(1).getImm()));
+    return;
+  case MOS::HuCVDCStore: {
+    static const unsigned Opcodes[] = {MOS::ST0_Immediate, MOS::ST1_Immediate,
+                                       MOS::ST2_Immediate};
+    OutMI.setOpcode(Opcodes[MI->getOperand(0).getImm()]);
+    OutMI.addOperand(MCOperand::createImm(MI->getOperand(1).getImm()));
+    return;
+  }
   case MOS::CL: {
     switch (MI->getOperand(0).getReg()) {
     default:
@@ -728,6 +768,20 @@ void MOSMCInstLower::lower(const MachineInstr *MI, MCInst &OutMI) {
       return;
     }
   }
+  case MOS::ADC_Immediate16:
+  case MOS::AND_Immediate16:
+  case MOS::EOR_Immediate16:
+  case MOS::LDA_Immediate16:
+  case MOS::ORA_Immediate16:
+  case MOS::SBC_Immediate16:
+    // Wrap the immediate in mos16, so that if the assembly were later parsed,
+    // the 16-bit form would be selected regardless of its value.
+    OutMI.setOpcode(MI->getOpcode());
+    OutMI.addOperand(MCOperand::createExpr(MOSMCExpr::create(
+        MOSMCExpr::VK_IMM16,
+        MCConstantExpr::create(MI->getOperand(0).getImm() & 0xffff, Ctx),
+        /*isNegated=*/false, Ctx)));
+    return;
   }
 
   // Handle any real instructions that weren't generated from a pseudo.
@@ -781,13 +835,14 @@ bool MOSMCInstLower::lowerOperand(const MachineOperand &MO, MCOperand &MCOp) {
     if ((MOS::isZeroPageSectionName(GV->getSection()) ||
          (GVar && GVar->getAddressSpace() == MOS::AS_ZeroPage)) &&
         MO.getOffset() >= -128) {
-      const MOSMCExpr *Expr =
-          MOSMCExpr::create(MOSMCExpr::VK_ADDR8, MCOp.getExpr(),
-                            /*isNegated=*/false, Ctx);
-      MCOp = MCOperand::createExpr(Expr);
+      MCOp = MCOperand::createExpr(
+          getModifierExpr(MOSMCExpr::VK_ADDR8, MCOp.getExpr()));
     }
     break;
   }
+  case MachineOperand::MO_MCSymbol:
+    MCOp = lowerSymbolOperand(MO, MO.getMCSymbol());
+    break;
   case MachineOperand::MO_JumpTableIndex: {
     MCOp = lowerSymbolOperand(MO, AP.GetJTISymbol(MO.getIndex()));
     break;
@@ -840,22 +895,16 @@ bool MOSMCInstLower::lowerOperand(const MachineOperand &MO, MCOperand &MCOp) {
     // these are imaginary registers, so they are rewritten as late as possible.
     auto It = FuncInfo.CSRZPOffsets.find(Reg);
     if (It != FuncInfo.CSRZPOffsets.end()) {
-      const MCExpr *Expr = MCSymbolRefExpr::create(
-          AP.getSymbol(FuncInfo.ZeroPageStackValue), Ctx);
-      size_t Offset = It->second;
-      if (Offset)
-        Expr = MCBinaryExpr::createAdd(
-            Expr, MCConstantExpr::create(Offset, Ctx), Ctx);
-      Expr = MOSMCExpr::create(MOSMCExpr::VK_ADDR8, Expr,
-                               /*isNegated=*/false, Ctx);
-      MCOp = MCOperand::createExpr(Expr);
+      const MCExpr *Expr = getSymbolExpr(
+          AP.getSymbol(FuncInfo.ZeroPageStackValue), It->second);
+      MCOp = MCOperand::createExpr(
+          getModifierExpr(MOSMCExpr::VK_ADDR8, Expr));
       break;
     }
 
     if (MOS::Imag16RegClass.contains(Reg) || MOS::Imag8RegClass.contains(Reg)) {
-      const MCExpr *Expr = MCSymbolRefExpr::create(
-          Ctx.getOrCreateSymbol(TRI.getImag8SymbolName(Reg)), Ctx);
-      MCOp = MCOperand::createExpr(Expr);
+      MCOp = MCOperand::createExpr(getSymbolExpr(
+          Ctx.getOrCreateSymbol(TRI.getImag8SymbolName(Reg)), 0));
     } else
       MCOp = MCOperand::createReg(MO.getReg());
     break;
@@ -877,10 +926,7 @@ MCOperand MOSMCInstLower::lowerSymbolOperand(const MachineOperand &MO,
     ZP = false;
   }
 
-  const MCExpr *Expr = MCSymbolRefExpr::create(Sym, Ctx);
-  if (!MO.isJTI() && MO.getOffset() != 0)
-    Expr = MCBinaryExpr::createAdd(
-        Expr, MCConstantExpr::create(MO.getOffset(), Ctx), Ctx);
+  const MCExpr *Expr = getSymbolExpr(Sym, MO.isJTI() ? 0 : MO.getOffset());
   switch (MO.getTargetFlags()) {
   default:
     llvm_unreachable("Invalid target operand flags.");
@@ -888,19 +934,19 @@ MCOperand MOSMCInstLower::lowerSymbolOperand(const MachineOperand &MO,
   case MOS::MO_ZEROPAGE:
     break;
   case MOS::MO_LO:
-    if (!ZP) {
-      Expr = MOSMCExpr::create(MOSMCExpr::VK_ADDR16_LO, Expr,
-                               /*isNegated=*/false, Ctx);
-    }
+    if (!ZP)
+      Expr = getModifierExpr(MOSMCExpr::VK_ADDR16_LO, Expr);
     break;
   case MOS::MO_HI:
     if (ZP) {
       Expr = MCConstantExpr::create(0, Ctx);
     } else {
-      Expr = MOSMCExpr::create(MOSMCExpr::VK_ADDR16_HI, Expr,
-                               /*isNegated=*/false, Ctx);
+      Expr = getModifierExpr(MOSMCExpr::VK_ADDR16_HI, Expr);
     }
     break;
+  case MOS::MO_BANK:
+    Expr = getModifierExpr(MOSMCExpr::VK_ADDR24_BANK, Expr);
+    break;
   case MOS::MO_HI_JT: {
     // Jump tables are partitioned in two arrays: first all the low bytes,
     // then all the high bytes. This index referes to the high byte array, so
@@ -917,3 +963,23 @@ MCOperand MOSMCInstLower::lowerSymbolOperand(const MachineOperand &MO,
   }
   return MCOperand::createExpr(Expr);
 }
+
+const MCExpr *MOSMCInstLower::getSymbolExpr(const MCSymbol *Sym,
+                                            int64_t Offset) {
+  const MCExpr *&Expr = SymbolExprs[{Sym, Offset}];
+  if (!Expr) {
+    Expr = MCSymbolRefExpr::create(Sym, Ctx);
+    if (Offset)
+      Expr = MCBinaryExpr::createAdd(
+          Expr, MCConstantExpr::create(Offset, Ctx), Ctx);
+  }
+  return Expr;
+}
+
+const MCExpr *MOSMCInstLower::getModifierExpr(MOSMCExpr::VariantKind Kind,
+                                              const MCExpr *Expr) {
+  const MCExpr *&Modified = ModifierExprs[{Kind, Expr}];
+  if (!Modified)
+    Modified = MOSMCExpr::createOrFold(Kind, Expr, /*isNegated=*/false, Ctx);
+  return Modified;
+}
@@ -8,6 +8,9 @@
 #ifndef LLVM_LIB_TARGET_MOS_MOSMCINSTLOWER_H
 #define LLVM_LIB_TARGET_MOS_MOSMCINSTLOWER_H
 
+#include "MCTargetDesc/MOSMCExpr.h"
+
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/CodeGen/AsmPrinter.h"
 #include "llvm/CodeGen/MachineInstr.h"
 #include "llvm/MC/MCContext.h"
@@ -18,6 +21,12 @@ class MOSMCInstLower {
   MCContext &Ctx;
   const AsmPrinter &AP;
 
+  // Lowered symbol references and the modifiers applied to them. Large
+  // modules refer to the same symbols over and over, and the expressions are
+  // immutable, so each distinct one is only created once.
+  DenseMap<std::pair<const MCSymbol *, int64_t>, const MCExpr *> SymbolExprs;
+  DenseMap<std::pair<unsigned, const MCExpr *>, const MCExpr *> ModifierExprs;
+
 public:
   MOSMCInstLower(MCContext &Ctx, const AsmPrinter &AP) : Ctx(Ctx), AP(AP) {}
 
@@ -26,6 +35,9 @@ public:
 
 private:
   MCOperand lowerSymbolOperand(const MachineOperand &MO, const MCSymbol *Sym);
+  const MCExpr *getSymbolExpr(const MCSymbol *Sym, int64_t Offset);
+  const MCExpr *getModifierExpr(MOSMCExpr::VariantKind Kind,
+                                const MCExpr *Expr);
 };
 
 } // namespace llvm
@@ -13,19 +13,45 @@
 #ifndef LLVM_LIB_TARGET_MOS_MOSMACHINEFUNCTIONINFO_H
 #define LLVM_LIB_TARGET_MOS_MOSMACHINEFUNCTIONINFO_H
 
+#include "llvm/ADT/DenseSet.h"
 #include "llvm/CodeGen/MachineFunction.h"
+#include <optional>
 
 namespace llvm {
 
 class MOSSubtarget;
 
+// What is known of A, X, Y, C, and V whenever a function returns.
+struct MOSReturnState {
+  std::optional<int64_t> A, X, Y;
+  std::optional<bool> C, V;
+  // Whether A, X, and Y keep the values they had on entry.
+  bool PreservesA = false;
+  bool PreservesX = false;
+  bool PreservesY = false;
+};
+
 struct MOSFunctionInfo : public MachineFunctionInfo {
   MOSFunctionInfo(const Function &F, const MOSSubtarget *STI) {}
 
   int VarArgsStackIndex = -1;
+  // Bytes of incoming arguments passed on the soft stack. Tail calls may reuse
+  // these slots for their own arguments.
+  uint64_t ArgsStackSize = 0;
   const GlobalValue *StaticStackValue = nullptr;
   const GlobalValue *ZeroPageStackValue = nullptr;
   DenseMap<Register, size_t> CSRZPOffsets;
+  // Bytes of the frame kept on the hardware stack, and the register the
+  // epilogue discards them through.
+  unsigned HardStackSize = 0;
+  Register HardStackReleaseReg;
+  // Jump tables dispatched by JMPRTS, whose entries hold each target address
+  // less one.
+  DenseSet<unsigned> RTSJumpTables;
+  // Recorded by MOSLateOptimization for internal functions, for use at their
+  // call sites. The registers known are implicitly used by each return, which
+  // keeps later passes from changing them.
+  std::optional<MOSReturnState> ReturnState;
 };
 
 } // namespace llvm
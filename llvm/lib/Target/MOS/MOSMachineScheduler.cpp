@@ -25,6 +25,22 @@
 // Thus, the MOS scheduling strategy more or less copies just the register
 // pressure parts of the standard Machine Scheduler.
 //
+// The same concern applies, in the extreme, to the carry flag. Multi-byte
+// arithmetic is a chain of ADC or SBC instructions, each consuming the carry
+// produced by the last. There is only one carry flag, so interleaving two such
+// chains forces one carry to be saved and restored around the other. The
+// strategy thus finishes a carry chain before starting anything else that could
+// produce a carry of its own. The same goes for the overflow flag.
+//
+// The flags also decide whether a branch on a value's zeroness needs a compare.
+// MOSLateOptimization deletes the compare if the last instruction to set N and
+// Z before it computed the value, so the value's definition is scheduled last
+// in the block, after nothing but stores.
+//
+// Finally, accesses through the same pointer with (zp),Y each load Y with
+// their offset. Visiting them in order of offset lets MOSLateOptimization
+// replace most of those loads with INY or DEY, so ties are broken that way.
+//
 //===----------------------------------------------------------------------===//
 
 #include "MOSMachineScheduler.h"
@@ -32,6 +48,7 @@
 #include "MOSRegisterInfo.h"
 #include "llvm/CodeGen/MachineInstr.h"
 #include "llvm/CodeGen/MachineOperand.h"
+#include "llvm/CodeGen/MachineRegisterInfo.h"
 #include "llvm/CodeGen/MachineScheduler.h"
 
 using namespace llvm;
@@ -49,6 +66,15 @@ bool MOSSchedStrategy::tryCandidate(SchedCandidate &Cand,
     return true;
   }
 
+  if (tryGreater(continuesCarryChain(TryCand.SU, TryCand.AtTop),
+                 continuesCarryChain(Cand.SU, Cand.AtTop), TryCand, Cand,
+                 PhysReg))
+    return TryCand.Reason != NoCand;
+
+  if (tryGreater(feedsZeroBranch(TryCand.SU, TryCand.AtTop),
+                 feedsZeroBranch(Cand.SU, Cand.AtTop), TryCand, Cand, PhysReg))
+    return TryCand.Reason != NoCand;
+
   if (tryLess(
           registerClassPressureDiff(MOS::AcRegClass, TryCand.SU, TryCand.AtTop),
           registerClassPressureDiff(MOS::AcRegClass, Cand.SU, Cand.AtTop),
@@ -93,6 +119,18 @@ bool MOSSchedStrategy::tryCandidate(SchedCandidate &Cand,
   // "tie-breaking" in nature.
   bool SameBoundary = Zone != nullptr;
   if (SameBoundary) {
+    std::optional<std::pair<Register, int64_t>> TryAccess =
+        getIndirIdxAccess(TryCand.SU);
+    std::optional<std::pair<Register, int64_t>> CandAccess =
+        getIndirIdxAccess(Cand.SU);
+    if (TryAccess && CandAccess && TryAccess->first == CandAccess->first) {
+      if (Zone->isTop() ? tryLess(TryAccess->second, CandAccess->second,
+                                  TryCand, Cand, Cluster)
+                        : tryGreater(TryAccess->second, CandAccess->second,
+                                     TryCand, Cand, Cluster))
+        return TryCand.Reason != NoCand;
+    }
+
     // Fall through to original instruction order.
     if ((Zone->isTop() && TryCand.SU->NodeNum < Cand.SU->NodeNum) ||
         (!Zone->isTop() && TryCand.SU->NodeNum > Cand.SU->NodeNum)) {
@@ -122,3 +160,68 @@ int MOSSchedStrategy::registerClassPressureDiff(const TargetRegisterClass &RC,
   }
   return PressureDiff;
 }
+
+// Returns the pointer and constant Y offset of a (zp),Y access, or of the
+// immediate load of Y that feeds one.
+std::optional<std::pair<Register, int64_t>>
+MOSSchedStrategy::getIndirIdxAccess(const SUnit *SU) const {
+  const MachineRegisterInfo &MRI = DAG->MRI;
+  const MachineInstr *MI = SU->getInstr();
+  if (MI->getOpcode() == MOS::LDImm) {
+    Register Dst = MI->getOperand(0).getReg();
+    if (!Dst.isVirtual() || !MRI.hasOneNonDBGUse(Dst))
+      return std::nullopt;
+    MI = &*MRI.use_instr_nodbg_begin(Dst);
+  }
+
+  // Both take the pointer and then Y after their first operand.
+  if (MI->getOpcode() != MOS::LDIndirIdx && MI->getOpcode() != MOS::STIndirIdx)
+    return std::nullopt;
+  Register Addr = MI->getOperand(1).getReg();
+  Register Offset = MI->getOperand(2).getReg();
+  if (!Offset.isVirtual())
+    return std::nullopt;
+  const MachineInstr *Def = MRI.getVRegDef(Offset);
+  while (Def && Def->isCopy() && Def->getOperand(1).getReg().isVirtual())
+    Def = MRI.getVRegDef(Def->getOperand(1).getReg());
+  if (!Def || Def->getOpcode() != MOS::LDImm || !Def->getOperand(1).isImm())
+    return std::nullopt;
+  return std::make_pair(Addr, Def->getOperand(1).getImm());
+}
+
+// Returns whether SU continues a carry chain that is already partially
+// scheduled: top-down, whether it consumes a carry whose producer has been
+// scheduled; bottom-up, whether it produces a carry whose consumer has been.
+// Chains through the overflow flag count too.
+bool MOSSchedStrategy::continuesCarryChain(const SUnit *SU, bool IsTop) const {
+  const MachineRegisterInfo &MRI = DAG->MRI;
+  for (const SDep &Dep : IsTop ? SU->Preds : SU->Succs) {
+    if (Dep.getKind() != SDep::Data || !Dep.getReg().isVirtual())
+      continue;
+    const TargetRegisterClass *RC = MRI.getRegClassOrNull(Dep.getReg());
+    if (RC != &MOS::CcRegClass && RC != &MOS::VcRegClass)
+      continue;
+    if (Dep.getSUnit()->isScheduled)
+      return true;
+  }
+  return false;
+}
+
+// Returns whether SU, scheduled bottom-up, would be the last instruction to set
+// N and Z before the region's closing branch on whether the value SU defines is
+// zero.
+bool MOSSchedStrategy::feedsZeroBranch(const SUnit *SU, bool IsTop) const {
+  if (IsTop)
+    return false;
+  const MachineInstr *Branch = DAG->ExitSU.getInstr();
+  if (!Branch || Branch->getOpcode() != MOS::CmpBrZero)
+    return false;
+  Register Val = Branch->getOperand(3).getReg();
+  if (!SU->getInstr()->definesRegister(Val, /*TRI=*/nullptr))
+    return false;
+  // Stores leave N and Z alone.
+  return all_of(make_range(DAG->bottom(), DAG->end()),
+                [](const MachineInstr &MI) {
+                  return MI.isDebugInstr() || (MI.mayStore() && !MI.mayLoad());
+                });
+}
@@ -14,6 +14,8 @@
 #define LLVM_LIB_TARGET_MOS_MOS_MACHINESCHEDULER_H
 
 #include "llvm/CodeGen/MachineScheduler.h"
+#include <optional>
+#include <utility>
 
 namespace llvm {
 
@@ -26,6 +28,13 @@ public:
 
   int registerClassPressureDiff(const TargetRegisterClass &RC, const SUnit *SU,
                                 bool IsTop) const;
+
+  bool continuesCarryChain(const SUnit *SU, bool IsTop) const;
+
+  bool feedsZeroBranch(const SUnit *SU, bool IsTop) const;
+
+  std::optional<std::pair<Register, int64_t>>
+  getIndirIdxAccess(const SUnit *SU) const;
 };
 
 } // namespace llvm
@@ -0,0 +1,294 @@
+//===-- MOSNarrowInt.cpp - MOS Integer Narrowing --------------------------===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines the MOS integer narrowing pass.
+//
+// C's integer promotions turn most byte arithmetic into int arithmetic, and
+// InstCombine can only shrink it back where the extensions and truncations
+// are syntactically visible. Every 16-bit operation costs the 6502 twice what
+// an 8-bit one does, so this pass narrows integer operations to i8 wherever
+// their bytes above the lowest are provably just an extension of it:
+//
+//  - Additions, subtractions, multiplications, logic operations and left
+//    shifts produce a low byte that depends only on the low bytes of their
+//    operands. They are narrowed if their result lies within the range of a
+//    zero or sign extended byte, or if only its low byte is demanded.
+//  - Right shifts, unsigned divisions and remainders are narrowed if their
+//    operands lie within such a range.
+//  - Comparisons are narrowed if both of their operands do.
+//  - Phis, including loop induction variables, are narrowed if their value
+//    does.
+//
+// Ranges come from LazyValueInfo, falling back to ScalarEvolution, which can
+// bound induction variables by their loop's trip count. The narrowed value is
+// extended back to the original type for its users, and the extensions and
+// truncations left over are cleaned up by the InstCombine run that follows.
+//
+// This runs late in the function simplification pipeline, so that callees
+// are narrowed before the inliner weighs their cost within their callers.
+//
+//===----------------------------------------------------------------------===//
+
+#include "MOSNarrowInt.h"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/DemandedBits.h"
+#include "llvm/Analysis/LazyValueInfo.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/PatternMatch.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+
+#define DEBUG_TYPE "mos-narrow-int"
+
+STATISTIC(NumNarrowedOps, "Number of integer operations narrowed to i8");
+STATISTIC(NumNarrowedCmps, "Number of comparisons narrowed to i8");
+STATISTIC(NumNarrowedPhis, "Number of phis narrowed to i8");
+
+using namespace llvm;
+using namespace llvm::PatternMatch;
+
+static cl::opt<bool>
+    NarrowInt("mos-narrow-int",
+              cl::desc("Narrow integer operations to 8 bits where their "
+                       "value ranges allow"),
+              cl::init(true), cl::Hidden);
+
+namespace {
+
+// How a value narrowed to i8 is extended back to its original type.
+enum class Ext { None, Zero, Sign };
+
+// Whether a value is the zero or sign extension of its low byte.
+struct Fit {
+  bool Zero = false;
+  bool Sign = false;
+};
+
+class Narrower {
+  LazyValueInfo &LVI;
+  ScalarEvolution &SE;
+  DemandedBits &DB;
+
+public:
+  Narrower(LazyValueInfo &LVI, ScalarEvolution &SE, DemandedBits &DB)
+      : LVI(LVI), SE(SE), DB(DB) {}
+
+  Ext getBinOpExt(BinaryOperator &BO);
+  Ext getICmpExt(ICmpInst &Cmp);
+  Ext getPhiExt(PHINode &Phi);
+
+private:
+  Fit getFit(Value *V, Instruction *CxtI);
+  bool isShiftInRange(BinaryOperator &BO);
+};
+
+} // namespace
+
+static bool isWideInt(const Type *Ty) {
+  return Ty->isIntegerTy() && Ty->getIntegerBitWidth() > 8;
+}
+
+Fit Narrower::getFit(Value *V, Instruction *CxtI) {
+  ConstantRange Range =
+      LVI.getConstantRange(V, CxtI, /*UndefAllowed=*/false);
+  Fit F = {Range.getActiveBits() <= 8, Range.getMinSignedBits() <= 8};
+  if (F.Zero && F.Sign)
+    return F;
+
+  // SCEV knows nothing of the context, but it can bound the recurrences in
+  // loops by their trip counts, which LVI cannot.
+  const SCEV *S = SE.getSCEV(V);
+  F.Zero |= SE.getUnsignedRange(S).getActiveBits() <= 8;
+  F.Sign |= SE.getSignedRange(S).getMinSignedBits() <= 8;
+  return F;
+}
+
+// Returns whether the shift amount of BO is always less than 8, as shifts of
+// i8 by more are poison.
+bool Narrower::isShiftInRange(BinaryOperator &BO) {
+  return LVI.getConstantRange(BO.getOperand(1), &BO, /*UndefAllowed=*/false)
+      .getUnsignedMax()
+      .ult(8);
+}
+
+Ext Narrower::getBinOpExt(BinaryOperator &BO) {
+  switch (BO.getOpcode()) {
+  default:
+    return Ext::None;
+  case Instruction::Shl:
+    if (!isShiftInRange(BO))
+      return Ext::None;
+    [[fallthrough]];
+  case Instruction::Add:
+  case Instruction::Sub:
+  case Instruction::Mul:
+  case Instruction::And:
+  case Instruction::Or:
+  case Instruction::Xor: {
+    // Masking with a byte constant already leaves a zero high byte.
+    const APInt *C;
+    if (BO.getOpcode() == Instruction::And &&
+        match(BO.getOperand(1), m_APInt(C)) && C->getActiveBits() <= 8)
+      return Ext::None;
+    Fit F = getFit(&BO, &BO);
+    if (F.Zero)
+      return Ext::Zero;
+    if (F.Sign)
+      return Ext::Sign;
+    // Nothing reads the high bytes, so they may as well be zero.
+    if (DB.getDemandedBits(&BO).getActiveBits() <= 8)
+      return Ext::Zero;
+    return Ext::None;
+  }
+  case Instruction::LShr:
+    return isShiftInRange(BO) && getFit(BO.getOperand(0), &BO).Zero
+               ? Ext::Zero
+               : Ext::None;
+  case Instruction::AShr:
+    return isShiftInRange(BO) && getFit(BO.getOperand(0), &BO).Sign
+               ? Ext::Sign
+               : Ext::None;
+  case Instruction::UDiv:
+  case Instruction::URem:
+    return getFit(BO.getOperand(0), &BO).Zero &&
+                   getFit(BO.getOperand(1), &BO).Zero
+               ? Ext::Zero
+               : Ext::None;
+  }
+}
+
+// Returns how the operands of Cmp can be extended from their low bytes. Zero
+// extended operands are compared unsigned, but sign extended operands keep
+// their relative order under either signedness.
+Ext Narrower::getICmpExt(ICmpInst &Cmp) {
+  Fit LHS = getFit(Cmp.getOperand(0), &Cmp);
+  Fit RHS = getFit(Cmp.getOperand(1), &Cmp);
+  if (LHS.Zero && RHS.Zero)
+    return Ext::Zero;
+  if (LHS.Sign && RHS.Sign)
+    return Ext::Sign;
+  return Ext::None;
+}
+
+Ext Narrower::getPhiExt(PHINode &Phi) {
+  // The incoming values are truncated at the end of their blocks, which isn't
+  // possible for values defined by the terminators themselves.
+  if (Phi.getParent()->isEHPad() ||
+      any_of(Phi.incoming_values(), [](const Value *V) {
+        const auto *I = dyn_cast<Instruction>(V);
+        return I && I->isTerminator();
+      }))
+    return Ext::None;
+  Fit F = getFit(&Phi, &Phi);
+  if (F.Zero)
+    return Ext::Zero;
+  if (F.Sign)
+    return Ext::Sign;
+  return Ext::None;
+}
+
+static Value *extend(IRBuilder<> &B, Value *V, Type *Ty, Ext E) {
+  return E == Ext::Sign ? B.CreateSExt(V, Ty) : B.CreateZExt(V, Ty);
+}
+
+static void narrowBinOp(BinaryOperator &BO, Ext E) {
+  IRBuilder<> B(&BO);
+  Type *I8 = B.getInt8Ty();
+  Value *New = B.CreateBinOp(BO.getOpcode(),
+                             B.CreateTrunc(BO.getOperand(0), I8),
+                             B.CreateTrunc(BO.getOperand(1), I8),
+                             BO.getName() + ".narrow");
+  BO.replaceAllUsesWith(extend(B, New, BO.getType(), E));
+  BO.eraseFromParent();
+  ++NumNarrowedOps;
+}
+
+static void narrowICmp(ICmpInst &Cmp, Ext E) {
+  IRBuilder<> B(&Cmp);
+  Type *I8 = B.getInt8Ty();
+  CmpInst::Predicate Pred = E == Ext::Zero ? Cmp.getUnsignedPredicate()
+                                           : Cmp.getPredicate();
+  Value *New = B.CreateICmp(Pred, B.CreateTrunc(Cmp.getOperand(0), I8),
+                            B.CreateTrunc(Cmp.getOperand(1), I8),
+                            Cmp.getName() + ".narrow");
+  Cmp.replaceAllUsesWith(New);
+  Cmp.eraseFromParent();
+  ++NumNarrowedCmps;
+}
+
+static void narrowPhi(PHINode &Phi, Ext E) {
+  IRBuilder<> B(Phi.getContext());
+  Type *I8 = B.getInt8Ty();
+  PHINode *New = PHINode::Create(I8, Phi.getNumIncomingValues(),
+                                 Phi.getName() + ".narrow", Phi.getIterator());
+
+  // A block may reach the phi along several edges, but it must pass the same
+  // value along each.
+  SmallDenseMap<BasicBlock *, Value *> Truncs;
+  for (unsigned I = 0, N = Phi.getNumIncomingValues(); I != N; ++I) {
+    BasicBlock *Pred = Phi.getIncomingBlock(I);
+    Value *&Trunc = Truncs[Pred];
+    if (!Trunc) {
+      B.SetInsertPoint(Pred->getTerminator());
+      Trunc = B.CreateTrunc(Phi.getIncomingValue(I), I8);
+    }
+    New->addIncoming(Trunc, Pred);
+  }
+
+  BasicBlock *BB = Phi.getParent();
+  B.SetInsertPoint(BB, BB->getFirstInsertionPt());
+  Phi.replaceAllUsesWith(extend(B, New, Phi.getType(), E));
+  Phi.eraseFromParent();
+  ++NumNarrowedPhis;
+}
+
+PreservedAnalyses MOSNarrowIntPass::run(Function &F,
+                                        FunctionAnalysisManager &AM) {
+  if (!NarrowInt)
+    return PreservedAnalyses::all();
+
+  Narrower N(AM.getResult<LazyValueAnalysis>(F),
+             AM.getResult<ScalarEvolutionAnalysis>(F),
+             AM.getResult<DemandedBitsAnalysis>(F));
+
+  // Decide everything up front, since the analyses don't see the rewrites.
+  SmallVector<std::pair<Instruction *, Ext>> Narrowings;
+  for (Instruction &I : instructions(F)) {
+    Ext E = Ext::None;
+    if (auto *BO = dyn_cast<BinaryOperator>(&I); BO && isWideInt(I.getType()))
+      E = N.getBinOpExt(*BO);
+    else if (auto *Cmp = dyn_cast<ICmpInst>(&I);
+             Cmp && isWideInt(Cmp->getOperand(0)->getType()))
+      E = N.getICmpExt(*Cmp);
+    else if (auto *Phi = dyn_cast<PHINode>(&I); Phi && isWideInt(I.getType()))
+      E = N.getPhiExt(*Phi);
+    if (E != Ext::None)
+      Narrowings.push_back({&I, E});
+  }
+  if (Narrowings.empty())
+    return PreservedAnalyses::all();
+
+  for (auto [I, E] : Narrowings) {
+    LLVM_DEBUG(dbgs() << "Narrowing " << *I << "\n");
+    if (auto *BO = dyn_cast<BinaryOperator>(I))
+      narrowBinOp(*BO, E);
+    else if (auto *Cmp = dyn_cast<ICmpInst>(I))
+      narrowICmp(*Cmp, E);
+    else
+      narrowPhi(cast<PHINode>(*I), E);
+  }
+
+  PreservedAnalyses PA;
+  PA.preserveSet<CFGAnalyses>();
+  return PA;
+}
@@ -15,24 +15,93 @@
 // because such functions can have at most one invocation active at any given
 // time. Along the way, this pass performs a norecurse analysis as well.
 //
+// With -mos-static-stack=report or strict, the pass also explains why each
+// remaining function might be reentrant, and thus needs a dynamic stack: the
+// call graph cycle it is part of, or the path by which an interrupt reaches
+// it. Under strict, these are errors, so that a program that must fit without
+// the soft stack can be held to it. The same explanations, and the functions
+// found to be nonreentrant, are emitted as optimization remarks
+// (-Rpass=mos-nonreentrant, -Rpass-missed=mos-nonreentrant).
+//
+// A function that calls itself, but never more than N deep, may say so with
+// __attribute__((mos_max_depth(N))). Before the analysis, such a function is
+// copied once for each depth beyond the first, and the calls it makes of
+// itself are redirected to the copy for the next depth. The copy for the
+// deepest level traps instead. None of the copies then recurse, so each gets
+// a static frame of its own, and the static stack allocator keeps those
+// frames apart, since each copy calls the next.
+//
+// With -mos-masked-interrupts, interrupt_norecurse handlers are taken to be
+// masked by the I flag, as IRQ handlers are, and a function reachable from
+// more than one of main and those handlers is only reentrant if one of them
+// may reach it with interrupts enabled. Calls made with interrupts disabled
+// are found by dataflow over the SEI and CLI intrinsics within each function,
+// with each handler entered with interrupts disabled. A call of a function
+// that may enable interrupts, or an indirect, external or inline assembly
+// call, ends the masked region. This is not the default, since nothing masks
+// an NMI handler.
+//
 //===----------------------------------------------------------------------===//
 
 #include "MOSNonReentrant.h"
 
 #include "MOS.h"
+#include "MOSCallGraphUtils.h"
+#include "MOSSplitModule.h"
+#include "llvm/ADT/PostOrderIterator.h"
 #include "llvm/ADT/SCCIterator.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/ADT/StringExtras.h"
 #include "llvm/Analysis/CallGraph.h"
 #include "llvm/Analysis/CallGraphSCCPass.h"
+#include "llvm/Analysis/OptimizationRemarkEmitter.h"
+#include "llvm/IR/DiagnosticInfo.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/IntrinsicsMOS.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/PassManager.h"
 #include "llvm/LTO/LTO.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/TimeProfiler.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/Local.h"
 
 #define DEBUG_TYPE "mos-nonreentrant"
 
+STATISTIC(NumNonReentrant, "Number of functions marked nonreentrant");
+STATISTIC(NumDepthCopies, "Number of copies made of bounded recursions");
+STATISTIC(NumMaskedCalls, "Number of calls made with interrupts disabled");
+
 using namespace llvm;
 
+namespace {
+enum class StaticStackDiag { None, Report, Strict };
+} // namespace
+
+static cl::opt<StaticStackDiag> StaticStackMode(
+    "mos-static-stack", cl::desc("Diagnose functions needing a dynamic stack"),
+    cl::init(StaticStackDiag::None),
+    cl::values(clEnumValN(StaticStackDiag::Report, "report",
+                          "Warn about each such function"),
+               clEnumValN(StaticStackDiag::Strict, "strict",
+                          "Reject each such function")));
+
+static cl::opt<unsigned> MaxDepthLimit(
+    "mos-max-depth-limit",
+    cl::desc("Largest mos_max_depth for which a function is copied per depth "
+             "of its recursion"),
+    cl::init(16), cl::Hidden);
+
+static cl::opt<bool> MaskedInterrupts(
+    "mos-masked-interrupts",
+    cl::desc("Assume that disabling interrupts masks every "
+             "interrupt_norecurse handler"),
+    cl::init(false), cl::Hidden);
+
 namespace {
 
 struct MOSNonReentrantImpl {
@@ -40,17 +109,36 @@ struct MOSNonReentrantImpl {
   SmallPtrSet<const CallGraphNode *, 8> Reentrant;
   SmallPtrSet<const CallGraphNode *, 8> ReachableFromCurrentNorecurseInterrupt;
   SmallPtrSet<const CallGraphNode *, 8> ReachableFromOtherNorecurseInterrupt;
+  // The subsets of the above reachable with interrupts enabled.
+  SmallPtrSet<const CallGraphNode *, 8> UnmaskedFromCurrentNorecurseInterrupt;
+  SmallPtrSet<const CallGraphNode *, 8> UnmaskedFromOtherNorecurseInterrupt;
+  // Nodes that may enable interrupts, and calls made with them disabled.
+  SmallPtrSet<const CallGraphNode *, 8> EnablesInterrupts;
+  SmallPtrSet<const CallBase *, 8> MaskedCalls;
   bool HasInterrupts = false;
 
+  // How each reentrant node came to be so, for diagnostics. Nodes reached
+  // from an interrupt map to the caller they were first reached through;
+  // nodes reached from multiple norecurse interrupts map to the interrupt
+  // that reached them first, and the one that reached them again.
+  DenseMap<const CallGraphNode *, const CallGraphNode *> InterruptCaller;
+  DenseMap<const CallGraphNode *, const Function *> NorecurseRoot;
+  DenseMap<const CallGraphNode *, const Function *> OtherNorecurseRoot;
+  const Function *CurrentNorecurseRoot = nullptr;
+
   MOSNonReentrantImpl(CallGraph &CG) : CG(CG) {
     initializeMOSNonReentrantPass(*PassRegistry::getPassRegistry());
   }
 
   bool run(Module &M);
 
+  bool expandBoundedRecursion(Module &M);
+  void findMaskedCalls(Module &M);
+  bool isMaskedCall(const CallGraphNode::CallRecord &CR) const;
   bool runOnSCC(CallGraphSCC &SCC);
-  void markReentrant(const CallGraphNode &CGN);
-  void visitNorecurseInterrupt(const CallGraphNode &CGN);
+  void markReentrant(const CallGraphNode &CGN, const CallGraphNode *Caller);
+  void visitNorecurseInterrupt(const CallGraphNode &CGN, bool Masked);
+  void diagnoseReentrant(Module &M);
 };
 
 } // namespace
@@ -64,6 +152,12 @@ static bool callsSelf(const CallGraphNode &N) {
 
 bool MOSNonReentrantImpl::run(Module &M) {
   LLVM_DEBUG(dbgs() << "**** MOS NonReentrant Pass ****\n");
+  TimeTraceScope Scope("MOSNonReentrant");
+
+  bool Changed = expandBoundedRecursion(M);
+  mos::resolveIndirectCalls(CG);
+  if (MaskedInterrupts)
+    findMaskedCalls(M);
 
   // For the conservative recursion analysis, any external call may call any
   // externally-callable function so add an edge from the calls-external node
@@ -75,7 +169,6 @@ bool MOSNonReentrantImpl::run(Module &M) {
   // Walk the callgraph in bottom-up SCC order.
   scc_iterator<CallGraph *> CGI = scc_begin(&CG);
   CallGraphSCC CurSCC(CG, &CGI);
-  bool Changed = false;
   for (; !CGI.isAtEnd(); ++CGI) {
     CurSCC.initialize(*CGI);
     Changed |= runOnSCC(CurSCC);
@@ -85,7 +178,7 @@ bool MOSNonReentrantImpl::run(Module &M) {
   for (Function &F : M.functions()) {
     if (F.hasFnAttribute("interrupt")) {
       HasInterrupts = true;
-      markReentrant(*CG[&F]);
+      markReentrant(*CG[&F], nullptr);
     }
   }
 
@@ -95,10 +188,14 @@ bool MOSNonReentrantImpl::run(Module &M) {
     if (F.hasFnAttribute("interrupt-norecurse") || F.getName() == "main") {
       if (F.hasFnAttribute("interrupt-norecurse"))
         HasInterrupts = true;
-      visitNorecurseInterrupt(*CG[&F]);
+      CurrentNorecurseRoot = &F;
+      visitNorecurseInterrupt(*CG[&F], /*Masked=*/false);
       for (const auto *CGN : ReachableFromCurrentNorecurseInterrupt)
         ReachableFromOtherNorecurseInterrupt.insert(CGN);
+      for (const auto *CGN : UnmaskedFromCurrentNorecurseInterrupt)
+        UnmaskedFromOtherNorecurseInterrupt.insert(CGN);
       ReachableFromCurrentNorecurseInterrupt.clear();
+      UnmaskedFromCurrentNorecurseInterrupt.clear();
     }
   }
 
@@ -123,15 +220,222 @@ bool MOSNonReentrantImpl::run(Module &M) {
 
   // Make all norecurse functions that were not determined to be reentrant as
   // nonreentrant.
-  for (Function &F : M.functions())
-    if (F.doesNotRecurse() && !Reentrant.contains(CG[&F]))
-      F.addFnAttr("nonreentrant");
+  for (Function &F : M.functions()) {
+    if (!F.doesNotRecurse() || Reentrant.contains(CG[&F]))
+      continue;
+    F.addFnAttr("nonreentrant");
+    ++NumNonReentrant;
+    if (F.isDeclaration())
+      continue;
+    OptimizationRemarkEmitter ORE(&F);
+    ORE.emit([&]() {
+      return OptimizationRemark(DEBUG_TYPE, "NonReentrant", &F)
+             << "function cannot be reentered, so its frame can be static";
+    });
+  }
+
+  if (StaticStackMode != StaticStackDiag::None ||
+      OptimizationRemarkEmitter::allowExtraAnalysis(M.getContext(),
+                                                    DEBUG_TYPE))
+    diagnoseReentrant(M);
 
   // Remove the artificial edge.
   CG.getCallsExternalNode()->removeAllCalledFunctions();
   return Changed;
 }
 
+bool MOSNonReentrantImpl::expandBoundedRecursion(Module &M) {
+  SmallVector<std::pair<Function *, unsigned>> Bounded;
+  for (Function &F : M) {
+    unsigned Depth;
+    if (F.isDeclaration() ||
+        F.getFnAttribute("mos-max-depth").getValueAsString().getAsInteger(
+            10, Depth))
+      continue;
+    OptimizationRemarkEmitter ORE(&F);
+    // Clang rejects a depth of zero, but the IR may still carry one.
+    if (!Depth) {
+      F.getContext().diagnose(DiagnosticInfoUnsupported(
+          F, "ignoring mos-max-depth of zero", DiagnosticLocation(),
+          DS_Warning));
+      continue;
+    }
+    if (!callsSelf(*CG[&F])) {
+      ORE.emit([&]() {
+        return OptimizationRemarkMissed(DEBUG_TYPE, "MaxDepthUnused", &F)
+               << "mos_max_depth has no effect, since the function does not "
+                  "call itself directly";
+      });
+      continue;
+    }
+    if (Depth > MaxDepthLimit) {
+      ORE.emit([&]() {
+        return OptimizationRemarkMissed(DEBUG_TYPE, "MaxDepthTooLarge", &F)
+               << "function not copied for each depth of its recursion, "
+                  "since its mos_max_depth of "
+               << ore::NV("Depth", Depth) << " exceeds the limit of "
+               << ore::NV("Limit", unsigned(MaxDepthLimit));
+      });
+      continue;
+    }
+    Bounded.push_back({&F, Depth});
+  }
+
+  for (auto [F, Depth] : Bounded) {
+    // Copy the function before any of its calls are redirected, so that each
+    // copy still calls the original. At a depth of one there are no copies,
+    // and the function's calls of itself just trap.
+    SmallVector<Function *> Levels = {F};
+    for (unsigned Level = 1; Level < Depth; ++Level) {
+      ValueToValueMapTy VMap;
+      Function *Copy = CloneFunction(F, VMap);
+      Copy->setName(F->getName() + ".depth" + Twine(Level + 1));
+      Copy->setLinkage(GlobalValue::InternalLinkage);
+      Copy->setComdat(nullptr);
+      Copy->removeFnAttr("mos-max-depth");
+      Levels.push_back(Copy);
+    }
+
+    for (auto [Level, Fn] : enumerate(Levels)) {
+      SmallVector<CallBase *> SelfCalls;
+      for (Instruction &I : instructions(*Fn))
+        if (auto *CB = dyn_cast<CallBase>(&I);
+            CB && CB->getCalledFunction() == F)
+          SelfCalls.push_back(CB);
+      // Trapping removes the rest of the block, so go backwards.
+      for (CallBase *CB : reverse(SelfCalls)) {
+        if (Level + 1 != Levels.size()) {
+          CB->setCalledFunction(Levels[Level + 1]);
+          continue;
+        }
+        // The function has gone deeper than it promised it would.
+        IRBuilder<> B(CB);
+        B.CreateIntrinsic(Intrinsic::trap, {});
+        changeToUnreachable(CB);
+      }
+    }
+
+    CallGraphNode *Node = CG[F];
+    Node->removeAllCalledFunctions();
+    CG.populateCallGraphNode(Node);
+    for (Function *Copy : drop_begin(Levels))
+      CG.addToCallGraph(Copy);
+    NumDepthCopies += Depth - 1;
+
+    OptimizationRemarkEmitter ORE(F);
+    ORE.emit([&]() {
+      return OptimizationRemark(DEBUG_TYPE, "MaxDepth", F)
+             << "function copied for each of the " << ore::NV("Depth", Depth)
+             << " depths of its recursion, so that each can have a static "
+                "frame";
+    });
+  }
+  return !Bounded.empty();
+}
+
+// Returns whether a call graph node may enable interrupts, given the nodes
+// already found to.
+static bool mayEnableInterrupts(
+    const CallGraphNode &N,
+    const SmallPtrSetImpl<const CallGraphNode *> &EnablesInterrupts) {
+  const Function *F = N.getFunction();
+  if (!F)
+    return true;
+  if (F->isIntrinsic())
+    return F->getIntrinsicID() == Intrinsic::mos_cli;
+  if (F->isDeclaration())
+    return true;
+  for (const Instruction &I : instructions(*F))
+    if (const auto *CB = dyn_cast<CallBase>(&I); CB && CB->isInlineAsm())
+      return true;
+  return any_of(N, [&](const CallGraphNode::CallRecord &CR) {
+    return EnablesInterrupts.contains(CR.second);
+  });
+}
+
+void MOSNonReentrantImpl::findMaskedCalls(Module &M) {
+  // Every function in a cycle reaches every other, so if one may enable
+  // interrupts, they all may.
+  for (scc_iterator<CallGraph *> I = scc_begin(&CG); !I.isAtEnd(); ++I) {
+    if (any_of(*I, [&](const CallGraphNode *N) {
+          return mayEnableInterrupts(*N, EnablesInterrupts);
+        }))
+      EnablesInterrupts.insert_range(*I);
+  }
+
+  // Returns whether interrupts are disabled after I, given whether they were
+  // before it.
+  const auto Transfer = [&](const Instruction &I, bool Masked) {
+    const auto *CB = dyn_cast<CallBase>(&I);
+    if (!CB)
+      return Masked;
+    if (const auto *II = dyn_cast<IntrinsicInst>(CB)) {
+      if (II->getIntrinsicID() == Intrinsic::mos_sei)
+        return true;
+      if (II->getIntrinsicID() == Intrinsic::mos_cli)
+        return false;
+      return Masked;
+    }
+    const Function *Callee = CB->getCalledFunction();
+    if (CB->isInlineAsm() || !Callee ||
+        EnablesInterrupts.contains(CG[Callee]))
+      return false;
+    return Masked;
+  };
+
+  for (Function &F : M) {
+    if (F.isDeclaration())
+      continue;
+    // Interrupts are disabled at the entry of each block iff they are at the
+    // exit of each of its predecessors. Handlers are entered with them
+    // disabled.
+    bool EntryMasked = F.hasFnAttribute("interrupt-norecurse");
+    ReversePostOrderTraversal<Function *> RPOT(&F);
+    DenseMap<const BasicBlock *, bool> ExitMasked;
+    for (const BasicBlock &BB : F)
+      ExitMasked[&BB] = true;
+    const auto EntryState = [&](const BasicBlock &BB) {
+      if (BB.isEntryBlock())
+        return EntryMasked;
+      return all_of(predecessors(&BB), [&](const BasicBlock *Pred) {
+        return ExitMasked[Pred];
+      });
+    };
+    for (bool Changed = true; Changed;) {
+      Changed = false;
+      for (const BasicBlock *BB : RPOT) {
+        bool Masked = EntryState(*BB);
+        for (const Instruction &I : *BB)
+          Masked = Transfer(I, Masked);
+        if (ExitMasked[BB] != Masked) {
+          ExitMasked[BB] = Masked;
+          Changed = true;
+        }
+      }
+    }
+
+    for (const BasicBlock *BB : RPOT) {
+      bool Masked = EntryState(*BB);
+      for (const Instruction &I : *BB) {
+        bool After = Transfer(I, Masked);
+        if (Masked && After && isa<CallBase>(I) && !isa<IntrinsicInst>(I)) {
+          MaskedCalls.insert(cast<CallBase>(&I));
+          ++NumMaskedCalls;
+        }
+        Masked = After;
+      }
+    }
+  }
+}
+
+bool MOSNonReentrantImpl::isMaskedCall(
+    const CallGraphNode::CallRecord &CR) const {
+  if (!CR.first)
+    return false;
+  const auto *CB = dyn_cast_or_null<CallBase>(static_cast<Value *>(*CR.first));
+  return CB && MaskedCalls.contains(CB);
+}
+
 bool MOSNonReentrantImpl::runOnSCC(CallGraphSCC &SCC) {
   // All nodes in SCCs with more than one node may be recursive. It's not
   // certain since CFG analysis is conservative, but there's no more
@@ -162,32 +466,124 @@ bool MOSNonReentrantImpl::runOnSCC(CallGraphSCC &SCC) {
   return true;
 }
 
-void MOSNonReentrantImpl::markReentrant(const CallGraphNode &CGN) {
+void MOSNonReentrantImpl::markReentrant(const CallGraphNode &CGN,
+                                        const CallGraphNode *Caller) {
   if (Reentrant.contains(&CGN))
     return;
   Reentrant.insert(&CGN);
+  InterruptCaller[&CGN] = Caller;
 
   for (const auto &CallRecord : CGN)
-    markReentrant(*CallRecord.second);
+    markReentrant(*CallRecord.second, &CGN);
 }
 
-void MOSNonReentrantImpl::visitNorecurseInterrupt(const CallGraphNode &CGN) {
+void MOSNonReentrantImpl::visitNorecurseInterrupt(const CallGraphNode &CGN,
+                                                  bool Masked) {
   if (Reentrant.contains(&CGN))
     return;
-  if (ReachableFromCurrentNorecurseInterrupt.contains(&CGN))
+  // A visit with interrupts enabled covers one with them disabled.
+  bool NewReach = ReachableFromCurrentNorecurseInterrupt.insert(&CGN).second;
+  bool NewUnmasked =
+      !Masked && UnmaskedFromCurrentNorecurseInterrupt.insert(&CGN).second;
+  if (!NewReach && !NewUnmasked)
     return;
-  ReachableFromCurrentNorecurseInterrupt.insert(&CGN);
+  const Function *&Root = NorecurseRoot[&CGN];
 
+  // Another root may preempt this one within the function, or this one the
+  // other, unless interrupts are disabled throughout the preempted call.
   Function *F = CGN.getFunction();
   if (F && !F->isDeclaration() &&
-      ReachableFromOtherNorecurseInterrupt.contains(&CGN)) {
+      ReachableFromOtherNorecurseInterrupt.contains(&CGN) &&
+      (!Masked || UnmaskedFromOtherNorecurseInterrupt.contains(&CGN))) {
     LLVM_DEBUG(
         dbgs() << "Marking reachable from multiple norecurse interrupts: "
                << F->getName() << "\n");
     Reentrant.insert(&CGN);
+    OtherNorecurseRoot[&CGN] = CurrentNorecurseRoot;
   }
+  if (!Root)
+    Root = CurrentNorecurseRoot;
   for (const auto &CallRecord : CGN)
-    visitNorecurseInterrupt(*CallRecord.second);
+    visitNorecurseInterrupt(*CallRecord.second,
+                            Masked || isMaskedCall(CallRecord));
+}
+
+static StringRef nodeName(const CallGraphNode &CGN) {
+  return CGN.getFunction() ? CGN.getFunction()->getName()
+                           : "<external or indirect call>";
+}
+
+void MOSNonReentrantImpl::diagnoseReentrant(Module &M) {
+  DiagnosticSeverity Severity =
+      StaticStackMode == StaticStackDiag::Strict ? DS_Error : DS_Warning;
+  auto Diagnose = [&](const Function &F, const Twine &Why) {
+    if (StaticStackMode != StaticStackDiag::None) {
+      std::string Msg =
+          ("'" + F.getName() + "' needs a dynamic stack: " + Why).str();
+      M.getContext().diagnose(DiagnosticInfoGeneric(Msg, Severity));
+    }
+    OptimizationRemarkEmitter ORE(&F);
+    ORE.emit([&]() {
+      return OptimizationRemarkMissed(DEBUG_TYPE, "Reentrant", &F)
+             << "function needs a dynamic stack: " << Why.str();
+    });
+  };
+
+  // Functions that may recurse. The artificial edge from the calls-external
+  // node is still in place, so any cycle through an external or indirect call
+  // shows up as an SCC containing it.
+  for (scc_iterator<CallGraph *> I = scc_begin(&CG); !I.isAtEnd(); ++I) {
+    const std::vector<CallGraphNode *> &Nodes = *I;
+    if (Nodes.size() == 1 && !callsSelf(*Nodes.front()))
+      continue;
+    bool ThroughExternal = is_contained(Nodes, CG.getCallsExternalNode());
+    SmallVector<StringRef> Names;
+    for (const CallGraphNode *N : Nodes)
+      if (N->getFunction())
+        Names.push_back(N->getFunction()->getName());
+    std::string Cycle = join(Names, ", ");
+    for (const CallGraphNode *N : Nodes) {
+      const Function *F = N->getFunction();
+      if (!F || F->isDeclaration() || F->doesNotRecurse())
+        continue;
+      if (Nodes.size() == 1)
+        Diagnose(*F, "it calls itself");
+      else if (ThroughExternal)
+        Diagnose(*F, "it may recurse through an external or indirect call, "
+                     "in the call graph cycle {" +
+                         Cycle + "}");
+      else
+        Diagnose(*F, "it may recurse, in the call graph cycle {" + Cycle +
+                         "}");
+    }
+  }
+
+  // Functions that cannot recurse, but may be reentered by an interrupt.
+  for (const Function &F : M) {
+    if (F.isDeclaration() || !F.doesNotRecurse() ||
+        F.hasFnAttribute("nonreentrant"))
+      continue;
+    const CallGraphNode *N = CG[&F];
+    if (auto It = InterruptCaller.find(N); It != InterruptCaller.end()) {
+      SmallVector<StringRef> Path = {F.getName()};
+      for (const CallGraphNode *C = It->second; C; C = InterruptCaller[C])
+        if (C->getFunction() || Path.back() != nodeName(*C))
+          Path.push_back(nodeName(*C));
+      if (Path.size() == 1)
+        Diagnose(F, "it is an interrupt that may interrupt itself");
+      else
+        Diagnose(F, "it is reachable from interrupt '" + Path.back() +
+                        "', via " + join(reverse(Path), " -> "));
+    } else if (auto It = OtherNorecurseRoot.find(N);
+               It != OtherNorecurseRoot.end()) {
+      Diagnose(F, "it is reachable from both '" +
+                      NorecurseRoot.lookup(N)->getName() + "' and '" +
+                      It->second->getName() + "'");
+    } else {
+      Diagnose(F, "it is a runtime library function, and the program has "
+                  "interrupts");
+    }
+  }
 }
 
 namespace {
@@ -208,6 +604,11 @@ struct MOSNonReentrant : public ModulePass {
 bool MOSNonReentrant::runOnModule(Module &M) {
   LLVM_DEBUG(dbgs() << "**** MOS NonReentrant Pass ****\n");
 
+  // The whole module was analyzed before it was split, and a partition sees
+  // only some of the callers of its functions.
+  if (mos::isLTOPartition(M))
+    return false;
+
   CallGraph &CG = getAnalysis<CallGraphWrapperPass>().getCallGraph();
   return MOSNonReentrantImpl(CG).run(M);
 }
@@ -226,6 +627,10 @@ PreservedAnalyses MOSNonReentrantPass::run(Module &M,
   return Changed ? PreservedAnalyses::none() : PreservedAnalyses::all();
 }
 
+bool mos::runNonReentrant(Module &M, CallGraph &CG) {
+  return MOSNonReentrantImpl(CG).run(M);
+}
+
 char MOSNonReentrant::ID = 0;
 
 INITIALIZE_PASS(
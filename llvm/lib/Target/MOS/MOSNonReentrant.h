@@ -19,8 +19,17 @@
 
 namespace llvm {
 
+class CallGraph;
+
 ModulePass *createMOSNonReentrantPass();
 
+namespace mos {
+
+// Runs the analysis on M, whose call graph is CG, outside of a pass manager.
+bool runNonReentrant(Module &M, CallGraph &CG);
+
+} // namespace mos
+
 struct MOSNonReentrantPass : PassInfoMixin<MOSNonReentrantPass> {
   PreservedAnalyses run(Module &M, ModuleAnalysisManager &AM);
 };
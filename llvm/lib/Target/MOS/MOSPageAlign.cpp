@@ -0,0 +1,105 @@
+//===-- MOSPageAlign.cpp - MOS Page Alignment -----------------------------===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines the MOS page alignment pass.
+//
+// Absolute indexed accesses take an extra cycle whenever the indexed address
+// lies in a different 256-byte page than the base address. This pass raises
+// the alignment of arrays of up to a page that are accessed with a variable
+// index to the next power of two of their size, which keeps each of them
+// within a single page. Clusters formed by -mos-global-merge are arrays like
+// any other here, so each of them is kept within a page too, but only when
+// this pass is enabled by -mos-page-align. Loops are handled
+// separately, by the loop alignment hooks in MOSTargetLowering.
+//
+// Since alignment raises the alignment of the containing section, the linker
+// honors it without further cooperation.
+//
+//===----------------------------------------------------------------------===//
+
+#include "MOSPageAlign.h"
+
+#include "MOS.h"
+
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Operator.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+
+#define DEBUG_TYPE "mos-page-align"
+
+using namespace llvm;
+
+static cl::opt<bool> PageAlign(
+    "mos-page-align",
+    cl::desc("Lay out indexed arrays and loops so that they don't cross page "
+             "boundaries"),
+    cl::init(false), cl::Hidden);
+
+bool mos::avoidPageCrossings() { return PageAlign; }
+
+namespace {
+
+struct MOSPageAlign : public ModulePass {
+  static char ID; // Pass identification, replacement for typeid
+
+  MOSPageAlign() : ModulePass(ID) {
+    initializeMOSPageAlignPass(*PassRegistry::getPassRegistry());
+  }
+
+  bool runOnModule(Module &M) override;
+};
+
+} // namespace
+
+// Returns whether any access to V is made with a variable index.
+static bool hasVariableIndex(const Value &V) {
+  for (const User *U : V.users()) {
+    if (const auto *GEP = dyn_cast<GEPOperator>(U)) {
+      if (!GEP->hasAllConstantIndices())
+        return true;
+      if (hasVariableIndex(*GEP))
+        return true;
+    } else if (isa<ConstantExpr>(U) && hasVariableIndex(*U)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool MOSPageAlign::runOnModule(Module &M) {
+  if (!PageAlign)
+    return false;
+
+  const DataLayout &DL = M.getDataLayout();
+  bool Changed = false;
+  for (GlobalVariable &GV : M.globals()) {
+    if (GV.getAddressSpace() == MOS::AS_ZeroPage || !GV.canIncreaseAlignment())
+      continue;
+    uint64_t Size = DL.getTypeAllocSize(GV.getValueType());
+    if (Size < 2 || Size > 256 || !hasVariableIndex(GV))
+      continue;
+    Align PageAlignment(PowerOf2Ceil(Size));
+    if (GV.getPointerAlignment(DL) >= PageAlignment)
+      continue;
+    LLVM_DEBUG(dbgs() << "Aligning " << GV.getName() << " to "
+                      << PageAlignment.value() << "\n");
+    GV.setAlignment(PageAlignment);
+    Changed = true;
+  }
+  return Changed;
+}
+
+char MOSPageAlign::ID = 0;
+
+INITIALIZE_PASS(MOSPageAlign, DEBUG_TYPE,
+                "Keep indexed arrays within a single page", false, false)
+
+ModulePass *llvm::createMOSPageAlignPass() { return new MOSPageAlign(); }
@@ -0,0 +1,31 @@
+//===-- MOSPageAlign.h - MOS Page Alignment ---------------------*- C++ -*-===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares the MOS page alignment pass.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_LIB_TARGET_MOS_MOSPAGEALIGN_H
+#define LLVM_LIB_TARGET_MOS_MOSPAGEALIGN_H
+
+#include "llvm/Pass.h"
+
+namespace llvm {
+
+ModulePass *createMOSPageAlignPass();
+
+namespace mos {
+
+// Returns whether indexed arrays and loops should be laid out so that they
+// don't cross 256-byte page boundaries.
+bool avoidPageCrossings();
+
+} // namespace mos
+} // namespace llvm
+
+#endif // not LLVM_LIB_TARGET_MOS_MOSPAGEALIGN_H
@@ -0,0 +1,291 @@
+//===-- MOSPointerArgs.cpp - MOS Pointer Argument Placement ---------------===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines the MOS pointer argument placement pass.
+//
+// The C calling convention assigns pointer arguments to RS1-RS7 in order. When
+// a caller forwards one of its own incoming pointers to a callee, but in a
+// different position, the pointer must be copied between imaginary registers
+// around the call. For functions whose every caller is visible and direct,
+// this pass instead picks the register of each pointer parameter to match the
+// register that its most frequent callers already hold it in. The choice is
+// recorded in the "mos-pointer-arg-regs" function attribute, which call
+// lowering consults for both the function's formal arguments and all calls to
+// it. Other functions keep the regular calling convention.
+//
+// Callers are visited before callees, so that a caller's own placement is known
+// when voting on its callees'.
+//
+//===----------------------------------------------------------------------===//
+
+#include "MOSPointerArgs.h"
+
+#include "MOS.h"
+#include "MOSCallingConv.h"
+
+#include "llvm/ADT/SCCIterator.h"
+#include "llvm/Analysis/BlockFrequencyInfo.h"
+#include "llvm/Analysis/CallGraph.h"
+#include "llvm/IR/InstrTypes.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/Debug.h"
+#include <bitset>
+
+#define DEBUG_TYPE "mos-pointer-args"
+
+using namespace llvm;
+
+namespace {
+
+struct MOSPointerArgs : public ModulePass {
+  static char ID; // Pass identification, replacement for typeid
+
+  MOSPointerArgs() : ModulePass(ID) {
+    initializeMOSPointerArgsPass(*PassRegistry::getPassRegistry());
+  }
+
+  bool runOnModule(Module &M) override;
+  void getAnalysisUsage(AnalysisUsage &AU) const override;
+
+private:
+  // The imaginary pointer register (1-7) each pointer parameter of a function
+  // arrives in, or 0 if it arrives elsewhere.
+  DenseMap<const Function *, SmallVector<unsigned>> Layouts;
+
+  const SmallVector<unsigned> &getLayout(const Function &F);
+  bool place(Function &F);
+};
+
+} // namespace
+
+static bool isPlaceable(const Function &F) {
+  if (F.isDeclaration() || !F.hasLocalLinkage() || F.isVarArg() ||
+      F.getCallingConv() != CallingConv::C || F.hasFnAttribute("interrupt") ||
+      F.hasFnAttribute("interrupt-norecurse"))
+    return false;
+
+  bool HasPointer = false;
+  for (const Argument &A : F.args()) {
+    if (A.hasByValAttr() || A.hasInAllocaAttr() || A.hasPreallocatedAttr())
+      return false;
+    Type *T = A.getType();
+    if (T->isPointerTy()) {
+      // Zero page pointers are left to the regular calling convention.
+      if (T->getPointerAddressSpace())
+        return false;
+      HasPointer = true;
+    } else if (!T->isIntegerTy() && !T->isFloatingPointTy()) {
+      return false;
+    }
+  }
+  if (!HasPointer)
+    return false;
+
+  // All uses must be direct calls, so that every caller can be made to agree.
+  for (const Use &U : F.uses()) {
+    const auto *CB = dyn_cast<CallBase>(U.getUser());
+    if (!CB || !CB->isCallee(&U) ||
+        CB->getFunctionType() != F.getFunctionType())
+      return false;
+  }
+  return true;
+}
+
+// Mirror the register assignment of CC_MOS for the arguments of F, given the
+// registers requested for its leading pointer arguments.
+static SmallVector<unsigned> computeLayout(const Function &F,
+                                           ArrayRef<unsigned> Requested) {
+  const DataLayout &DL = F.getDataLayout();
+  bool AUsed = false, XUsed = false;
+  // Indexed by RC number; RSn consists of RC(2n) and RC(2n+1).
+  std::bitset<16> RCUsed;
+  auto RSFree = [&](unsigned RS) {
+    return !RCUsed[2 * RS] && !RCUsed[2 * RS + 1];
+  };
+
+  SmallVector<unsigned> Layout;
+  for (const Argument &A : F.args()) {
+    Type *T = A.getType();
+    if (T->isPointerTy()) {
+      unsigned RS = 0;
+      if (Layout.size() < Requested.size() && RSFree(Requested[Layout.size()]))
+        RS = Requested[Layout.size()];
+      for (unsigned I = 1; !RS && I <= 7; ++I)
+        if (RSFree(I))
+          RS = I;
+      if (RS)
+        RCUsed[2 * RS] = RCUsed[2 * RS + 1] = true;
+      Layout.push_back(RS);
+      continue;
+    }
+    uint64_t Bytes = std::max<uint64_t>(DL.getTypeStoreSize(T), 1);
+    for (uint64_t I = 0; I < Bytes; ++I) {
+      if (!AUsed) {
+        AUsed = true;
+        continue;
+      }
+      if (!XUsed) {
+        XUsed = true;
+        continue;
+      }
+      for (unsigned RC = 2; RC < 16; ++RC) {
+        if (!RCUsed[RC]) {
+          RCUsed[RC] = true;
+          break;
+        }
+      }
+    }
+  }
+  return Layout;
+}
+
+const SmallVector<unsigned> &MOSPointerArgs::getLayout(const Function &F) {
+  auto It = Layouts.find(&F);
+  if (It != Layouts.end())
+    return It->second;
+  SmallVector<Register> Regs;
+  getPointerArgRegs(F, Regs);
+  SmallVector<unsigned> Requested;
+  for (Register R : Regs)
+    Requested.push_back(R - MOS::RS0);
+  return Layouts[&F] = computeLayout(F, Requested);
+}
+
+bool MOSPointerArgs::place(Function &F) {
+  const SmallVector<unsigned> Default = computeLayout(F, {});
+
+  // Map each pointer parameter to its position among the pointer parameters.
+  SmallVector<unsigned> PtrArgNos;
+  for (const Argument &A : F.args())
+    if (A.getType()->isPointerTy())
+      PtrArgNos.push_back(A.getArgNo());
+
+  // Tally how often each pointer parameter is passed a value that the caller
+  // already holds in a given imaginary register.
+  using Vote = std::tuple<double, unsigned, unsigned>; // Freq, Param, RS
+  DenseMap<std::pair<unsigned, unsigned>, double> Tally;
+  for (const Use &U : F.uses()) {
+    auto *CB = cast<CallBase>(U.getUser());
+    Function &Caller = *CB->getFunction();
+    BlockFrequencyInfo &BFI =
+        getAnalysis<BlockFrequencyInfoWrapperPass>(Caller).getBFI();
+    double Freq = BFI.getBlockFreqRelativeToEntryBlock(CB->getParent());
+    const SmallVector<unsigned> &CallerLayout = getLayout(Caller);
+
+    for (auto [Param, ArgNo] : enumerate(PtrArgNos)) {
+      if (Param >= 7)
+        break;
+      const auto *CallerArg = dyn_cast<Argument>(CB->getArgOperand(ArgNo));
+      if (!CallerArg || !CallerArg->getType()->isPointerTy())
+        continue;
+      unsigned CallerParam = 0;
+      for (const Argument &A : Caller.args()) {
+        if (&A == CallerArg)
+          break;
+        if (A.getType()->isPointerTy())
+          ++CallerParam;
+      }
+      if (CallerParam >= CallerLayout.size() || !CallerLayout[CallerParam])
+        continue;
+      Tally[{Param, CallerLayout[CallerParam]}] += Freq;
+    }
+  }
+  if (Tally.empty())
+    return false;
+
+  SmallVector<Vote> Votes;
+  for (const auto &[Key, Freq] : Tally)
+    Votes.emplace_back(Freq, Key.first, Key.second);
+  llvm::sort(Votes, [](const Vote &A, const Vote &B) {
+    return std::get<0>(A) > std::get<0>(B) ||
+           (std::get<0>(A) == std::get<0>(B) &&
+            std::make_pair(std::get<1>(A), std::get<2>(A)) <
+                std::make_pair(std::get<1>(B), std::get<2>(B)));
+  });
+
+  // Greedily honor the heaviest votes, then hand out the remaining registers
+  // in order.
+  unsigned NumRegParams = std::min<size_t>(PtrArgNos.size(), 7);
+  SmallVector<unsigned> Requested(NumRegParams);
+  std::bitset<8> Taken;
+  for (const auto &[Freq, Param, RS] : Votes) {
+    if (Param >= NumRegParams || Requested[Param] || Taken[RS])
+      continue;
+    Requested[Param] = RS;
+    Taken[RS] = true;
+  }
+  for (unsigned &RS : Requested) {
+    if (RS)
+      continue;
+    for (unsigned I = 1; I <= 7; ++I) {
+      if (!Taken[I]) {
+        RS = I;
+        Taken[I] = true;
+        break;
+      }
+    }
+  }
+
+  SmallVector<unsigned> Layout = computeLayout(F, Requested);
+  if (Layout == Default)
+    return false;
+
+  // Only record the registers that are actually granted, so call lowering
+  // never needs to fall back.
+  std::string Attr;
+  for (unsigned RS : Layout) {
+    if (!RS)
+      break;
+    if (!Attr.empty())
+      Attr += ',';
+    Attr += std::to_string(RS);
+  }
+  LLVM_DEBUG(dbgs() << "Placing pointer arguments of " << F.getName() << ": "
+                    << Attr << "\n");
+  F.addFnAttr("mos-pointer-arg-regs", Attr);
+  Layouts[&F] = std::move(Layout);
+  return true;
+}
+
+bool MOSPointerArgs::runOnModule(Module &M) {
+  LLVM_DEBUG(dbgs() << "**** MOS Pointer Argument Placement Pass ****\n");
+  CallGraph &CG = getAnalysis<CallGraphWrapperPass>().getCallGraph();
+
+  // Visit callers before callees.
+  SmallVector<Function *> Order;
+  for (scc_iterator<CallGraph *> I = scc_begin(&CG); !I.isAtEnd(); ++I)
+    for (const CallGraphNode *N : *I)
+      if (Function *F = N->getFunction())
+        Order.push_back(F);
+
+  bool Changed = false;
+  for (Function *F : reverse(Order))
+    if (isPlaceable(*F))
+      Changed |= place(*F);
+  Layouts.clear();
+  return Changed;
+}
+
+void MOSPointerArgs::getAnalysisUsage(AnalysisUsage &AU) const {
+  AU.addRequired<BlockFrequencyInfoWrapperPass>();
+  AU.addRequired<CallGraphWrapperPass>();
+  AU.setPreservesAll();
+}
+
+char MOSPointerArgs::ID = 0;
+
+INITIALIZE_PASS_BEGIN(MOSPointerArgs, DEBUG_TYPE,
+                      "Place pointer arguments in callers' registers", false,
+                      false)
+INITIALIZE_PASS_DEPENDENCY(BlockFrequencyInfoWrapperPass)
+INITIALIZE_PASS_DEPENDENCY(CallGraphWrapperPass)
+INITIALIZE_PASS_END(MOSPointerArgs, DEBUG_TYPE,
+                    "Place pointer arguments in callers' registers", false,
+                    false)
+
+ModulePass *llvm::createMOSPointerArgsPass() { return new MOSPointerArgs(); }
@@ -0,0 +1,24 @@
+//===-- MOSPointerArgs.h - MOS Pointer Argument Placement -------*- C++ -*-===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares the MOS pointer argument placement pass.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_LIB_TARGET_MOS_MOSPOINTERARGS_H
+#define LLVM_LIB_TARGET_MOS_MOSPOINTERARGS_H
+
+#include "llvm/Pass.h"
+
+namespace llvm {
+
+ModulePass *createMOSPointerArgsPass();
+
+} // namespace llvm
+
+#endif // not LLVM_LIB_TARGET_MOS_MOSPOINTERARGS_H
@@ -0,0 +1,312 @@
+//===-- MOSRedundantTransfers.cpp - MOS Redundant Transfers ---------------===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines the MOS redundant transfer elimination pass.
+//
+// Once copies are lowered, values move between A, X, Y, and the imaginary
+// registers through loads, stores, and transfers. Register allocation decides
+// each copy on its own, so the result often contains a STA rc2 followed later
+// by a LDA rc2 with A unchanged in between, or a value stored again to where
+// it already is.
+//
+// This pass tracks which of these registers are known to hold equal values,
+// by forward dataflow across blocks; at a join, only the equalities that hold
+// on every incoming edge survive. A load, store, or transfer between two
+// registers already known to be equal is erased, and a load into one GPR of a
+// value another GPR already holds becomes a one-byte transfer.
+//
+// Instructions that a compare with zero was folded into are kept, since they
+// also set N and Z.
+//
+//===----------------------------------------------------------------------===//
+
+#include "MOSRedundantTransfers.h"
+
+#include "MCTargetDesc/MOSMCTargetDesc.h"
+#include "MOS.h"
+#include "MOSRegisterInfo.h"
+#include "MOSSubtarget.h"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/PostOrderIterator.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/CodeGen/LivePhysRegs.h"
+#include "llvm/CodeGen/MachineFunctionPass.h"
+#include "llvm/CodeGen/MachineInstrBuilder.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/TimeProfiler.h"
+#include <optional>
+
+#define DEBUG_TYPE "mos-redundant-transfers"
+
+STATISTIC(NumLoadsErased,
+          "Number of redundant imaginary register loads erased");
+STATISTIC(NumStoresErased,
+          "Number of redundant imaginary register stores erased");
+STATISTIC(NumTransfersErased, "Number of redundant GPR transfers erased");
+STATISTIC(NumLoadsReplaced,
+          "Number of imaginary register loads replaced by transfers");
+
+using namespace llvm;
+
+namespace {
+
+// The pairs of registers known to hold equal values at a point in the
+// function, each with the lesser register first, in sorted order.
+struct Equalities {
+  SmallVector<std::pair<Register, Register>, 8> Pairs;
+
+  static std::pair<Register, Register> pair(Register A, Register B) {
+    return A < B ? std::make_pair(A, B) : std::make_pair(B, A);
+  }
+
+  bool holds(Register A, Register B) const {
+    return std::binary_search(Pairs.begin(), Pairs.end(), pair(A, B));
+  }
+
+  // Forgets every equality involving a register that MI changes.
+  void clobber(const MachineInstr &MI, const TargetRegisterInfo *TRI) {
+    erase_if(Pairs, [&](const std::pair<Register, Register> &P) {
+      return MI.modifiesRegister(P.first, TRI) ||
+             MI.modifiesRegister(P.second, TRI);
+    });
+  }
+
+  // Records that Dst was just copied from Src, and so equals whatever Src
+  // equals.
+  void copy(Register Dst, Register Src) {
+    SmallVector<std::pair<Register, Register>, 8> New = {pair(Dst, Src)};
+    for (const auto &[A, B] : Pairs) {
+      if (A == Src && B != Dst)
+        New.push_back(pair(Dst, B));
+      else if (B == Src && A != Dst)
+        New.push_back(pair(Dst, A));
+    }
+    append_range(Pairs, New);
+    sort(Pairs);
+    Pairs.erase(llvm::unique(Pairs), Pairs.end());
+  }
+
+  // Keeps only the equalities that Other also knows.
+  void meet(const Equalities &Other) {
+    erase_if(Pairs, [&](const std::pair<Register, Register> &P) {
+      return !std::binary_search(Other.Pairs.begin(), Other.Pairs.end(), P);
+    });
+  }
+
+  bool operator==(const Equalities &Other) const {
+    return Pairs == Other.Pairs;
+  }
+};
+
+struct MOSRedundantTransfers : public MachineFunctionPass {
+  static char ID;
+
+  MOSRedundantTransfers() : MachineFunctionPass(ID) {
+    llvm::initializeMOSRedundantTransfersPass(
+        *PassRegistry::getPassRegistry());
+  }
+
+  bool runOnMachineFunction(MachineFunction &MF) override;
+
+private:
+  const MOSSubtarget *STI;
+  const MOSRegisterInfo *TRI;
+
+  void step(const MachineInstr &MI, Equalities &Eq) const;
+  DenseMap<const MachineBasicBlock *, Equalities>
+  computeEntryEqualities(MachineFunction &MF) const;
+  bool optimizeBlock(MachineBasicBlock &MBB, Equalities Eq) const;
+  unsigned getTransferOpcode(Register Dst, Register Src) const;
+};
+
+} // namespace
+
+static bool isTracked(Register Reg) {
+  return MOS::GPRRegClass.contains(Reg) || MOS::Imag8RegClass.contains(Reg);
+}
+
+// Returns the destination and source of an instruction that copies one
+// tracked register into another.
+static std::optional<std::pair<Register, Register>>
+getTransfer(const MachineInstr &MI) {
+  switch (MI.getOpcode()) {
+  default:
+    return std::nullopt;
+  case MOS::LDImag8:
+  case MOS::STImag8:
+  case MOS::MOVImag8:
+  case MOS::TA:
+  case MOS::T_A:
+  case MOS::TX:
+    break;
+  }
+  Register Dst = MI.getOperand(0).getReg();
+  Register Src = MI.getOperand(1).getReg();
+  if (!isTracked(Dst) || !isTracked(Src))
+    return std::nullopt;
+  return std::make_pair(Dst, Src);
+}
+
+// Updates Eq to reflect the execution of MI.
+void MOSRedundantTransfers::step(const MachineInstr &MI,
+                                 Equalities &Eq) const {
+  // Inline assembly may not describe every register it changes.
+  if (MI.isInlineAsm()) {
+    Eq = Equalities();
+    return;
+  }
+  Eq.clobber(MI, TRI);
+  if (auto Transfer = getTransfer(MI))
+    if (Transfer->first != Transfer->second)
+      Eq.copy(Transfer->first, Transfer->second);
+}
+
+// Computes the equalities known on entry to each block by forward dataflow.
+DenseMap<const MachineBasicBlock *, Equalities>
+MOSRedundantTransfers::computeEntryEqualities(MachineFunction &MF) const {
+  ReversePostOrderTraversal<MachineFunction *> RPOT(&MF);
+
+  DenseMap<const MachineBasicBlock *, Equalities> Entry, Exit;
+  bool Changed = true;
+  while (Changed) {
+    Changed = false;
+    for (MachineBasicBlock *MBB : RPOT) {
+      // Predecessors not yet visited are ignored; they are only ever refined.
+      std::optional<Equalities> In;
+      if (MBB != &MF.front() && !MBB->isEHPad() &&
+          !MBB->hasAddressTaken()) {
+        for (const MachineBasicBlock *Pred : MBB->predecessors()) {
+          auto It = Exit.find(Pred);
+          if (It == Exit.end())
+            continue;
+          if (In)
+            In->meet(It->second);
+          else
+            In = It->second;
+        }
+      }
+      if (!In)
+        In = Equalities();
+
+      auto EntryIt = Entry.find(MBB);
+      if (EntryIt != Entry.end() && EntryIt->second == *In)
+        continue;
+      Changed = true;
+      Entry[MBB] = *In;
+      for (const MachineInstr &MI : *MBB)
+        step(MI, *In);
+      Exit[MBB] = *In;
+    }
+  }
+  return Entry;
+}
+
+// Returns the opcode of a transfer from GPR Src to GPR Dst, or 0 if there is
+// none.
+unsigned MOSRedundantTransfers::getTransferOpcode(Register Dst,
+                                                  Register Src) const {
+  if (!MOS::GPRRegClass.contains(Dst) || !MOS::GPRRegClass.contains(Src) ||
+      Dst == Src)
+    return 0;
+  if (Src == MOS::A)
+    return MOS::TA;
+  if (Dst == MOS::A)
+    return MOS::T_A;
+  return STI->hasW65816Or65EL02() ? MOS::TX : 0;
+}
+
+bool MOSRedundantTransfers::optimizeBlock(MachineBasicBlock &MBB,
+                                          Equalities Eq) const {
+  const auto &TII = *STI->getInstrInfo();
+  bool Changed = false;
+  for (MachineInstr &MI : make_early_inc_range(MBB)) {
+    auto Transfer = getTransfer(MI);
+    if (!Transfer || MI.definesRegister(MOS::NZ, TRI)) {
+      step(MI, Eq);
+      continue;
+    }
+    auto [Dst, Src] = *Transfer;
+
+    if (Dst == Src || Eq.holds(Dst, Src)) {
+      LLVM_DEBUG(dbgs() << "Erasing redundant " << MI);
+      switch (MI.getOpcode()) {
+      case MOS::LDImag8:
+        ++NumLoadsErased;
+        break;
+      case MOS::STImag8:
+      case MOS::MOVImag8:
+        ++NumStoresErased;
+        break;
+      default:
+        ++NumTransfersErased;
+        break;
+      }
+      MI.eraseFromParent();
+      Changed = true;
+      continue;
+    }
+
+    // Another GPR may already hold the loaded value.
+    MachineInstr *New = nullptr;
+    if (MI.getOpcode() == MOS::LDImag8) {
+      for (Register GPR : {MOS::A, MOS::X, MOS::Y}) {
+        unsigned Opcode = getTransferOpcode(Dst, GPR);
+        if (!Opcode || !Eq.holds(GPR, Src))
+          continue;
+        LLVM_DEBUG(dbgs() << "Replacing with transfer from "
+                          << printReg(GPR, TRI) << ": " << MI);
+        New = BuildMI(MBB, MI, MI.getDebugLoc(), TII.get(Opcode), Dst)
+                  .addUse(GPR);
+        MI.eraseFromParent();
+        ++NumLoadsReplaced;
+        Changed = true;
+        break;
+      }
+    }
+    step(New ? *New : MI, Eq);
+  }
+  return Changed;
+}
+
+bool MOSRedundantTransfers::runOnMachineFunction(MachineFunction &MF) {
+  if (skipFunction(MF.getFunction()))
+    return false;
+  TimeTraceScope Scope("MOSRedundantTransfers", MF.getName());
+
+  STI = &MF.getSubtarget<MOSSubtarget>();
+  TRI = STI->getRegisterInfo();
+
+  DenseMap<const MachineBasicBlock *, Equalities> Entry =
+      computeEntryEqualities(MF);
+  bool Changed = false;
+  for (MachineBasicBlock &MBB : MF)
+    Changed |= optimizeBlock(MBB, Entry.lookup(&MBB));
+
+  // Registers whose values were reused may now be live further, or into their
+  // blocks.
+  if (Changed) {
+    SmallVector<MachineBasicBlock *> MBBs;
+    for (MachineBasicBlock &MBB : MF)
+      MBBs.push_back(&MBB);
+    fullyRecomputeLiveIns(MBBs);
+    for (MachineBasicBlock &MBB : MF)
+      recomputeLivenessFlags(MBB);
+  }
+  return Changed;
+}
+
+char MOSRedundantTransfers::ID = 0;
+
+INITIALIZE_PASS(MOSRedundantTransfers, DEBUG_TYPE,
+                "MOS Redundant Transfer Elimination", false, false)
+
+MachineFunctionPass *llvm::createMOSRedundantTransfersPass() {
+  return new MOSRedundantTransfers();
+}
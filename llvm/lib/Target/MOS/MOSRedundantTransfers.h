@@ -0,0 +1,24 @@
+//===-- MOSRedundantTransfers.h - MOS Redundant Transfers -------*- C++ -*-===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares the MOS redundant transfer elimination pass.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_LIB_TARGET_MOS_MOSREDUNDANTTRANSFERS_H
+#define LLVM_LIB_TARGET_MOS_MOSREDUNDANTTRANSFERS_H
+
+#include "llvm/CodeGen/MachineFunctionPass.h"
+
+namespace llvm {
+
+MachineFunctionPass *createMOSRedundantTransfersPass();
+
+} // namespace llvm
+
+#endif // not LLVM_LIB_TARGET_MOS_MOSREDUNDANTTRANSFERS_H
@@ -0,0 +1,438 @@
+//===-- MOSRegPlacement.cpp - MOS Register Placement ----------------------===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines the MOS register placement pass.
+//
+// The allocation hints in MOSRegisterInfo only see the copies next to a single
+// virtual register, and they weigh every copy the same. Values that flow
+// through chains of copies and PHIs thus often end up in a different register
+// in each block, and the transfers between A, X, Y, and the imaginary
+// registers pile up in loops.
+//
+// This pass groups 8-bit virtual registers connected by copies and PHIs into
+// webs, then prices placing each web entirely in A, X, Y, or the zero page,
+// using MOSRegisterInfo::copyCost for every copy touching the web, weighted by
+// block frequency. Members whose classes cannot hold the chosen location keep
+// their own copies, which splits the web around the instructions that need
+// them. Webs placed in a hardware register get that register as an allocation
+// hint; webs placed in the zero page are constrained to imaginary registers,
+// which keeps them from competing for A, X, and Y.
+//
+// Pricing each web on its own puts both counters of a nested loop, say over
+// the rows and columns of a tile map, in the same index register, and the
+// allocator evicts one of them to the zero page. So the counters of nested
+// loops that both index memory are instead placed together: the inner counter
+// and its nearest enclosing one take X and Y in whichever order is cheaper,
+// which honors (zp),Y needing Y and zp,X needing X, and otherwise leaves the
+// outer loop in X. Counters of loops further out, with both index registers
+// taken inside them, are placed in the zero page.
+//
+//===----------------------------------------------------------------------===//
+
+#include "MOSRegPlacement.h"
+
+#include "MCTargetDesc/MOSMCTargetDesc.h"
+#include "MOS.h"
+#include "MOSInstrCost.h"
+#include "MOSRegisterInfo.h"
+#include "MOSSubtarget.h"
+
+#include "llvm/ADT/IntEqClasses.h"
+#include "llvm/CodeGen/MachineBlockFrequencyInfo.h"
+#include "llvm/CodeGen/MachineFunctionPass.h"
+#include "llvm/CodeGen/MachineLoopInfo.h"
+#include "llvm/CodeGen/MachineRegisterInfo.h"
+#include "llvm/Support/Debug.h"
+#include <array>
+#include <optional>
+
+#define DEBUG_TYPE "mos-reg-placement"
+
+using namespace llvm;
+
+namespace {
+
+// The locations a web may be placed in. Any imaginary register stands in for
+// the zero page, since copies between two of them cost the same.
+constexpr unsigned NumLocs = 4;
+const Register Locs[NumLocs] = {MOS::A, MOS::X, MOS::Y, MOS::RC2};
+constexpr unsigned XLoc = 1;
+constexpr unsigned YLoc = 2;
+constexpr unsigned ZPLoc = 3;
+
+struct MOSRegPlacement : public MachineFunctionPass {
+  static char ID;
+
+  MOSRegPlacement() : MachineFunctionPass(ID) {
+    llvm::initializeMOSRegPlacementPass(*PassRegistry::getPassRegistry());
+  }
+
+  bool runOnMachineFunction(MachineFunction &MF) override;
+  void getAnalysisUsage(AnalysisUsage &AU) const override;
+
+private:
+  const MOSSubtarget *STI;
+  const MOSRegisterInfo *TRI;
+  MachineRegisterInfo *MRI;
+  MOSInstrCost::Mode CostMode;
+
+  bool isCandidate(Register Reg) const;
+  Register locate(Register Reg, Register Loc) const;
+  int64_t copyCost(Register Dst, Register Src) const;
+  SmallVector<std::optional<unsigned>>
+  placeLoopCounters(MachineFunction &MF, const IntEqClasses &Webs,
+                    ArrayRef<std::array<double, NumLocs>> Costs,
+                    ArrayRef<std::array<bool, NumLocs>> Allowed) const;
+};
+
+} // namespace
+
+bool MOSRegPlacement::isCandidate(Register Reg) const {
+  return Reg.isVirtual() &&
+         MOS::Anyi8RegClass.hasSubClassEq(MRI->getRegClass(Reg));
+}
+
+// Returns the register that Reg would occupy if its web were placed in Loc: Loc
+// itself if Reg's class allows it, otherwise the location in Reg's class
+// cheapest to copy to and from Loc.
+Register MOSRegPlacement::locate(Register Reg, Register Loc) const {
+  if (Reg.isPhysical())
+    return MOS::Anyi8RegClass.contains(Reg) ? Reg : Register();
+  const TargetRegisterClass *RC = MRI->getRegClass(Reg);
+  if (RC->contains(Loc))
+    return Loc;
+  Register Best;
+  int64_t BestCost = 0;
+  for (Register L : Locs) {
+    if (!RC->contains(L))
+      continue;
+    int64_t Cost = copyCost(L, Loc) + copyCost(Loc, L);
+    if (!Best || Cost < BestCost) {
+      Best = L;
+      BestCost = Cost;
+    }
+  }
+  return Best;
+}
+
+int64_t MOSRegPlacement::copyCost(Register Dst, Register Src) const {
+  return TRI->copyCost(Dst, Src, *STI).value(CostMode);
+}
+
+bool MOSRegPlacement::runOnMachineFunction(MachineFunction &MF) {
+  if (skipFunction(MF.getFunction()))
+    return false;
+
+  STI = &MF.getSubtarget<MOSSubtarget>();
+  TRI = STI->getRegisterInfo();
+  MRI = &MF.getRegInfo();
+  CostMode = MOSInstrCost::getModeFor(MF);
+  const MachineBlockFrequencyInfo &MBFI =
+      getAnalysis<MachineBlockFrequencyInfoWrapperPass>().getMBFI();
+
+  // Copies are counted once each when optimizing for size, and by how often
+  // they execute otherwise.
+  auto Weight = [&](const MachineBasicBlock &MBB) {
+    if (CostMode == MOSInstrCost::Mode::PreferBytes)
+      return 1.0;
+    return MBFI.getBlockFreqRelativeToEntryBlock(&MBB);
+  };
+
+  // A copy or PHI edge, executed in a given block.
+  struct Edge {
+    Register Dst, Src;
+    const MachineBasicBlock *MBB;
+  };
+  SmallVector<Edge> Edges;
+  for (const MachineBasicBlock &MBB : MF) {
+    for (const MachineInstr &MI : MBB) {
+      if (MI.isCopy()) {
+        const MachineOperand &Dst = MI.getOperand(0);
+        const MachineOperand &Src = MI.getOperand(1);
+        if (Dst.getSubReg() || Src.getSubReg() ||
+            (!isCandidate(Dst.getReg()) && !isCandidate(Src.getReg())))
+          continue;
+        Edges.push_back({Dst.getReg(), Src.getReg(), &MBB});
+      } else if (MI.isPHI()) {
+        Register Dst = MI.getOperand(0).getReg();
+        if (!isCandidate(Dst))
+          continue;
+        for (unsigned I = 1, E = MI.getNumOperands(); I != E; I += 2)
+          if (!MI.getOperand(I).getSubReg())
+            Edges.push_back({Dst, MI.getOperand(I).getReg(),
+                             MI.getOperand(I + 1).getMBB()});
+      }
+    }
+  }
+
+  // Join registers into webs wherever the coalescer could merge them.
+  IntEqClasses Webs(MRI->getNumVirtRegs());
+  for (const Edge &E : Edges) {
+    if (!isCandidate(E.Dst) || !isCandidate(E.Src))
+      continue;
+    if (TRI->getCommonSubClass(MRI->getRegClass(E.Dst),
+                               MRI->getRegClass(E.Src)))
+      Webs.join(E.Dst.virtRegIndex(), E.Src.virtRegIndex());
+  }
+  Webs.compress();
+
+  SmallVector<std::array<double, NumLocs>> Costs(Webs.getNumClasses());
+  auto WebOf = [&](Register Reg) { return Webs[Reg.virtRegIndex()]; };
+
+  for (const Edge &E : Edges) {
+    double W = Weight(*E.MBB);
+    bool SameWeb = isCandidate(E.Dst) && isCandidate(E.Src) &&
+                   WebOf(E.Dst) == WebOf(E.Src);
+    for (unsigned L = 0; L < NumLocs; ++L) {
+      Register Dst = locate(E.Dst, Locs[L]);
+      Register Src = locate(E.Src, Locs[L]);
+      if (!Dst || !Src)
+        continue;
+      if (SameWeb) {
+        Costs[WebOf(E.Dst)][L] += W * copyCost(Dst, Src);
+        continue;
+      }
+      // The other side belongs to another web, whose placement is unknown;
+      // assume it cooperates as far as its class allows.
+      if (isCandidate(E.Dst)) {
+        Register Other = E.Src.isPhysical() ? Src : locate(E.Src, Dst);
+        Costs[WebOf(E.Dst)][L] += W * copyCost(Dst, Other);
+      }
+      if (isCandidate(E.Src)) {
+        Register Other = E.Dst.isPhysical() ? Dst : locate(E.Dst, Src);
+        Costs[WebOf(E.Src)][L] += W * copyCost(Other, Src);
+      }
+    }
+  }
+
+  // Instructions that are cheaper on a hardware register than on the zero
+  // page, as also scored by MOSRegisterInfo::getRegAllocationHints.
+  int64_t ZPShiftPenalty =
+      (MOSInstrCost::get(MOS::ASL_ZeroPage, *STI) -
+       MOSInstrCost::get(MOS::ASL_Accumulator, *STI))
+          .value(CostMode);
+  int64_t ZPIncDecPenalty = (MOSInstrCost::get(MOS::INC_ZeroPage, *STI) -
+                             MOSInstrCost::get(MOS::INX_Implied, *STI))
+                                .value(CostMode);
+  for (const MachineBasicBlock &MBB : MF) {
+    for (const MachineInstr &MI : MBB) {
+      int64_t Penalty;
+      switch (MI.getOpcode()) {
+      default:
+        continue;
+      case MOS::ASL:
+      case MOS::LSR:
+      case MOS::ROL:
+      case MOS::ROR:
+        Penalty = ZPShiftPenalty;
+        break;
+      case MOS::INC:
+      case MOS::DEC:
+        Penalty = ZPIncDecPenalty;
+        break;
+      }
+      Register Reg = MI.getOperand(0).getReg();
+      if (isCandidate(Reg))
+        Costs[WebOf(Reg)][ZPLoc] += Weight(MBB) * Penalty;
+    }
+  }
+
+  // A location is only a choice if some member of the web can hold it.
+  SmallVector<std::array<bool, NumLocs>> Allowed(Webs.getNumClasses());
+  SmallVector<SmallVector<Register>> Members(Webs.getNumClasses());
+  for (unsigned I = 0, E = MRI->getNumVirtRegs(); I != E; ++I) {
+    Register Reg = Register::index2VirtReg(I);
+    if (!isCandidate(Reg) || MRI->reg_nodbg_empty(Reg))
+      continue;
+    Members[WebOf(Reg)].push_back(Reg);
+    for (unsigned L = 0; L < NumLocs; ++L)
+      Allowed[WebOf(Reg)][L] |= MRI->getRegClass(Reg)->contains(Locs[L]);
+  }
+
+  SmallVector<std::optional<unsigned>> Nested =
+      placeLoopCounters(MF, Webs, Costs, Allowed);
+
+  bool Changed = false;
+  for (unsigned Web = 0, E = Webs.getNumClasses(); Web != E; ++Web) {
+    if (Members[Web].empty())
+      continue;
+    std::optional<unsigned> Best = Nested[Web];
+    bool Tie = false;
+    for (unsigned L = 0; !Nested[Web] && L < NumLocs; ++L) {
+      if (!Allowed[Web][L])
+        continue;
+      if (!Best || Costs[Web][L] < Costs[Web][*Best]) {
+        Best = L;
+        Tie = false;
+      } else if (Costs[Web][L] == Costs[Web][*Best]) {
+        Tie = true;
+      }
+    }
+    // Leave the allocator's own heuristics alone when nothing distinguishes
+    // the choices.
+    if (!Best || Tie)
+      continue;
+
+    LLVM_DEBUG(dbgs() << "Placing web of " << printReg(Members[Web].front())
+                      << " in " << printReg(Locs[*Best], TRI) << "\n");
+    for (Register Reg : Members[Web]) {
+      const TargetRegisterClass *RC = MRI->getRegClass(Reg);
+      if (!RC->contains(Locs[*Best]))
+        continue;
+      if (*Best == ZPLoc) {
+        if (RC != &MOS::Imag8RegClass &&
+            MRI->constrainRegClass(Reg, &MOS::Imag8RegClass))
+          Changed = true;
+      } else if (RC->getNumRegs() > 1 &&
+                 MRI->getSimpleHint(Reg) != Locs[*Best]) {
+        MRI->setSimpleHint(Reg, Locs[*Best]);
+        Changed = true;
+      }
+    }
+  }
+  return Changed;
+}
+
+// Returns the locations of the counters of nested loops that index memory,
+// indexed by web.
+SmallVector<std::optional<unsigned>> MOSRegPlacement::placeLoopCounters(
+    MachineFunction &MF, const IntEqClasses &Webs,
+    ArrayRef<std::array<double, NumLocs>> Costs,
+    ArrayRef<std::array<bool, NumLocs>> Allowed) const {
+  const MachineLoopInfo &MLI =
+      getAnalysis<MachineLoopInfoWrapperPass>().getLI();
+  const TargetInstrInfo &TII = *STI->getInstrInfo();
+  auto WebOf = [&](Register Reg) { return Webs[Reg.virtRegIndex()]; };
+
+  // How often each web is used where only X or Y will do.
+  SmallVector<unsigned> IndexUses(Webs.getNumClasses());
+  for (const MachineBasicBlock &MBB : MF) {
+    for (const MachineInstr &MI : MBB) {
+      for (const MachineOperand &MO : MI.explicit_uses()) {
+        if (!MO.isReg() || !isCandidate(MO.getReg()))
+          continue;
+        const TargetRegisterClass *RC =
+            MI.getRegClassConstraint(MI.getOperandNo(&MO), &TII, TRI);
+        if (RC && MOS::XYRegClass.hasSubClassEq(RC))
+          ++IndexUses[WebOf(MO.getReg())];
+      }
+    }
+  }
+
+  // The counter of a loop is the index web with a PHI in its header that is
+  // used the most as an index.
+  DenseMap<const MachineLoop *, unsigned> Counters;
+  for (const MachineLoop *L : MLI.getLoopsInPreorder()) {
+    std::optional<unsigned> Counter;
+    for (const MachineInstr &MI : L->getHeader()->phis()) {
+      Register Reg = MI.getOperand(0).getReg();
+      if (!isCandidate(Reg) || !IndexUses[WebOf(Reg)])
+        continue;
+      if (!Counter || IndexUses[WebOf(Reg)] > IndexUses[*Counter])
+        Counter = WebOf(Reg);
+    }
+    if (Counter)
+      Counters[L] = *Counter;
+  }
+
+  // Whether the cheapest place for a web is an index register.
+  auto WantsIndex = [&](unsigned Web) {
+    std::optional<double> Min, MinIndex;
+    for (unsigned L = 0; L < NumLocs; ++L) {
+      if (!Allowed[Web][L])
+        continue;
+      if (!Min || Costs[Web][L] < *Min)
+        Min = Costs[Web][L];
+      if ((L == XLoc || L == YLoc) && (!MinIndex || Costs[Web][L] < *MinIndex))
+        MinIndex = Costs[Web][L];
+    }
+    return MinIndex && *MinIndex == *Min;
+  };
+
+  SmallVector<std::optional<unsigned>> Placed(Webs.getNumClasses());
+  // Inner loops come before the loops containing them.
+  for (const MachineLoop *L : reverse(MLI.getLoopsInPreorder())) {
+    auto It = Counters.find(L);
+    if (It == Counters.end())
+      continue;
+    unsigned Inner = It->second;
+    const MachineLoop *P = L->getParentLoop();
+    while (P && (!Counters.count(P) || Counters[P] == Inner))
+      P = P->getParentLoop();
+    if (!P)
+      continue;
+    unsigned Outer = Counters[P];
+
+    // The inner counter was placed as the outer counter of a deeper loop, so
+    // both index registers are taken inside this one.
+    if (Placed[Inner]) {
+      if (!Placed[Outer] && WantsIndex(Outer) && Allowed[Outer][ZPLoc]) {
+        LLVM_DEBUG(dbgs() << "Loop counter web " << Outer
+                          << " yields the index registers\n");
+        Placed[Outer] = ZPLoc;
+      }
+      continue;
+    }
+    if (!WantsIndex(Inner))
+      continue;
+
+    // Another loop in the outer one was placed first; take the other register.
+    if (Placed[Outer]) {
+      unsigned Other = *Placed[Outer] == XLoc ? YLoc : XLoc;
+      if (*Placed[Outer] != ZPLoc && Allowed[Inner][Other])
+        Placed[Inner] = Other;
+      continue;
+    }
+    if (!WantsIndex(Outer))
+      continue;
+
+    // Try the outer loop in X first, so that it wins ties.
+    std::optional<std::pair<unsigned, unsigned>> Best;
+    double BestCost = 0;
+    for (auto [O, I] : {std::pair(XLoc, YLoc), std::pair(YLoc, XLoc)}) {
+      if (!Allowed[Outer][O] || !Allowed[Inner][I])
+        continue;
+      double Cost = Costs[Outer][O] + Costs[Inner][I];
+      if (!Best || Cost < BestCost) {
+        Best = {O, I};
+        BestCost = Cost;
+      }
+    }
+    if (!Best)
+      continue;
+    LLVM_DEBUG(dbgs() << "Loop counter webs " << Outer << " and " << Inner
+                      << " placed in " << printReg(Locs[Best->first], TRI)
+                      << " and " << printReg(Locs[Best->second], TRI)
+                      << "\n");
+    Placed[Outer] = Best->first;
+    Placed[Inner] = Best->second;
+  }
+  return Placed;
+}
+
+void MOSRegPlacement::getAnalysisUsage(AnalysisUsage &AU) const {
+  AU.addRequired<MachineBlockFrequencyInfoWrapperPass>();
+  AU.addPreserved<MachineBlockFrequencyInfoWrapperPass>();
+  AU.addRequired<MachineLoopInfoWrapperPass>();
+  AU.addPreserved<MachineLoopInfoWrapperPass>();
+  AU.setPreservesCFG();
+  MachineFunctionPass::getAnalysisUsage(AU);
+}
+
+char MOSRegPlacement::ID = 0;
+
+INITIALIZE_PASS_BEGIN(MOSRegPlacement, DEBUG_TYPE, "MOS Register Placement",
+                      false, false)
+INITIALIZE_PASS_DEPENDENCY(MachineBlockFrequencyInfoWrapperPass)
+INITIALIZE_PASS_DEPENDENCY(MachineLoopInfoWrapperPass)
+INITIALIZE_PASS_END(MOSRegPlacement, DEBUG_TYPE, "MOS Register Placement",
+                    false, false)
+
+MachineFunctionPass *llvm::createMOSRegPlacementPass() {
+  return new MOSRegPlacement();
+}
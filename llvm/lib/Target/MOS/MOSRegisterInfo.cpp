@@ -14,6 +14,7 @@
 
 #include "MCTargetDesc/MOSMCTargetDesc.h"
 #include "MOS.h"
+#include "MOSCallGraphUtils.h"
 #include "MOSFrameLowering.h"
 #include "MOSInstrBuilder.h"
 #include "MOSInstrCost.h"
@@ -23,6 +24,7 @@
 #include "llvm/ADT/SmallSet.h"
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/CodeGen/LivePhysRegs.h"
+#include "llvm/CodeGen/LiveRegUnits.h"
 #include "llvm/CodeGen/MachineBasicBlock.h"
 #include "llvm/CodeGen/MachineFrameInfo.h"
 #include "llvm/CodeGen/MachineFunction.h"
@@ -35,6 +37,7 @@
 #include "llvm/CodeGen/VirtRegMap.h"
 #include "llvm/IR/CallingConv.h"
 #include "llvm/MC/MCRegisterInfo.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/ErrorHandling.h"
 
 #define DEBUG_TYPE "mos-reginfo"
@@ -44,6 +47,13 @@
 
 using namespace llvm;
 
+static cl::list<std::string> LibcallClobbers(
+    "mos-libcall-clobbers", cl::CommaSeparated,
+    cl::desc("Registers clobbered by runtime helpers, each as "
+             "<symbol>:<reg>+<reg>..., usually recorded by the SDK when "
+             "building its runtime"),
+    cl::Hidden);
+
 MOSRegisterInfo::MOSRegisterInfo()
     : MOSGenRegisterInfo(/*RA=*/0, /*DwarfFlavor=*/0, /*EHFlavor=*/0,
                          /*PC=*/0, /*HwMode=*/0),
@@ -71,11 +81,36 @@ MOSRegisterInfo::MOSRegisterInfo()
 
   // Reserve one temporary register for use by register scavenger.
   reserveAllSubregs(&Reserved, MOS::RS8);
+
+  // A helper preserves everything but the registers it lists and the flags.
+  StringMap<unsigned> RegsByName;
+  for (unsigned Reg : seq(1u, getNumRegs()))
+    RegsByName[getName(Reg)] = Reg;
+  for (StringRef Entry : LibcallClobbers) {
+    auto [Name, Regs] = Entry.split(':');
+    SmallVector<uint32_t> &Mask = LibcallMasks[Name.trim()];
+    Mask.assign(MachineOperand::getRegMaskSize(getNumRegs()), ~0u);
+    SmallVector<StringRef> RegNames;
+    Regs.split(RegNames, '+', /*MaxSplit=*/-1, /*KeepEmpty=*/false);
+    RegNames.push_back("P");
+    for (StringRef RegName : RegNames) {
+      unsigned Reg = RegsByName.lookup(RegName.trim().upper());
+      if (!Reg)
+        report_fatal_error("invalid -mos-libcall-clobbers register: " +
+                           Entry);
+      for (MCRegAliasIterator R(Reg, this, /*IncludeSelf=*/true); R.isValid();
+           ++R)
+        Mask[*R / 32] &= ~(1u << *R % 32);
+    }
+  }
 }
 
 const MCPhysReg *
 MOSRegisterInfo::getCalleeSavedRegs(const MachineFunction *MF) const {
   const MOSFrameLowering &TFI = *getFrameLowering(*MF);
+  if (!mos::getBasePage(MF->getFunction()).empty())
+    return TFI.isISR(*MF) ? MOS_BasePage_Interrupt_CSR_SaveList
+                          : MOS_BasePage_CSR_SaveList;
   return TFI.isISR(*MF) ? MOS_Interrupt_CSR_SaveList : MOS_CSR_SaveList;
 }
 
@@ -85,6 +120,12 @@ MOSRegisterInfo::getCallPreservedMask(const MachineFunction &MF,
   return MOS_CSR_RegMask;
 }
 
+const uint32_t *
+MOSRegisterInfo::getLibcallPreservedMask(StringRef Symbol) const {
+  auto It = LibcallMasks.find(Symbol);
+  return It == LibcallMasks.end() ? nullptr : It->second.data();
+}
+
 BitVector MOSRegisterInfo::getReservedRegs(const MachineFunction &MF) const {
   const TargetFrameLowering *TFI = getFrameLowering(MF);
   BitVector Reserved = this->Reserved;
@@ -93,6 +134,24 @@ BitVector MOSRegisterInfo::getReservedRegs(const MachineFunction &MF) const {
   return Reserved;
 }
 
+// Register usage is collected for IPRA before prolog/epilog insertion and the
+// post-RA lowering passes, which may use any free GPR, the scavenger's reserved
+// pointer, and to access the soft stack, any free imaginary pointer. These must
+// be presumed clobbered.
+ArrayRef<MCPhysReg>
+MOSRegisterInfo::getIntraCallClobberedRegs(const MachineFunction *MF) const {
+  static const MCPhysReg GPRs[] = {MOS::A, MOS::X, MOS::Y, MOS::P, MOS::RS8};
+  static const MCPhysReg GPRsAndPtrs[] = {
+      MOS::A,    MOS::X,    MOS::Y,    MOS::P,    MOS::RS1,
+      MOS::RS2,  MOS::RS3,  MOS::RS4,  MOS::RS5,  MOS::RS6,
+      MOS::RS7,  MOS::RS8,  MOS::RS9,  MOS::RS10, MOS::RS11,
+      MOS::RS12, MOS::RS13, MOS::RS14, MOS::RS15};
+  const MOSFrameLowering &TFL = *getFrameLowering(*MF);
+  if (TFL.usesStaticStack(*MF))
+    return GPRs;
+  return GPRsAndPtrs;
+}
+
 const TargetRegisterClass *
 MOSRegisterInfo::getLargestLegalSuperClass(const TargetRegisterClass *RC,
                                            const MachineFunction &) const {
@@ -160,6 +219,137 @@ static void assertNZDeadAt(MachineBasicBlock &MBB,
 #endif
 }
 
+// Returns the live-in registers of Pos, or the live-outs of the block at its
+// end.
+static LiveRegUnits getLiveRegsBefore(const MOSRegisterInfo &TRI,
+                                      MachineBasicBlock &MBB,
+                                      MachineBasicBlock::iterator Pos) {
+  LiveRegUnits Live(TRI);
+  Live.addLiveOuts(MBB);
+  for (MachineBasicBlock::iterator J = MBB.end(); J != Pos;)
+    Live.stepBackward(*--J);
+  return Live;
+}
+
+namespace {
+// How to free a register for the scavenger from before I to before UseMI.
+struct ScavengerSave {
+  // Whether the register is pushed to the hardware stack.
+  bool UseHardStack = false;
+  // The imaginary registers holding the bytes of the register otherwise.
+  SmallVector<Register, 2> Slots;
+  // The GPRs that carry an imaginary register to and from its save location
+  // at I and UseMI, if one is needed.
+  Register SaveTemp;
+  Register RestoreTemp;
+};
+} // namespace
+
+// Finds a way to save Reg from before I and restore it before UseMI.
+//
+// Imaginary registers make the cheapest save locations; a store and load take
+// six cycles, against seven for a push and pull, and leave stack-relative
+// frame accesses alone. The scavenger runs twice, and a save location may
+// already hold a register saved by the first run, so locations are found by
+// liveness rather than fixed in advance. RS8 is reserved for the purpose, but
+// any other imaginary register that is dead throughout will do, so long as
+// the function may clobber it without anyone else noticing: the function
+// already modifies it, or it is clobbered within calls anyway. Its own
+// register usage, collected before frame lowering, then remains accurate.
+static std::optional<ScavengerSave>
+planScavengerSave(const MOSRegisterInfo &TRI, Register Reg,
+                  MachineBasicBlock::iterator I,
+                  MachineBasicBlock::iterator UseMI) {
+  MachineBasicBlock &MBB = *I->getParent();
+  MachineFunction &MF = *MBB.getParent();
+  const MOSSubtarget &STI = MF.getSubtarget<MOSSubtarget>();
+  const MachineRegisterInfo &MRI = MF.getRegInfo();
+
+  SmallVector<Register, 2> Bytes;
+  if (MOS::Imag16RegClass.contains(Reg)) {
+    Bytes.push_back(TRI.getSubReg(Reg, MOS::sublo));
+    Bytes.push_back(TRI.getSubReg(Reg, MOS::subhi));
+  } else if (Reg != MOS::P) {
+    Bytes.push_back(Reg);
+  }
+  bool IsGPR = MOS::GPRRegClass.contains(Reg);
+
+  ScavengerSave Save;
+  bool Balanced = pushPullBalanced(I, UseMI);
+  bool CanPush = Reg == MOS::A || Reg == MOS::P ||
+                 (IsGPR && STI.hasGPRStackRegs());
+  // P can only be saved to the hard stack, and pushing is smaller than a
+  // store and load.
+  if (Balanced && CanPush &&
+      (Reg == MOS::P || MF.getFunction().hasOptSize())) {
+    Save.UseHardStack = true;
+    return Save;
+  }
+  if (Reg == MOS::P)
+    return std::nullopt;
+
+  // Imaginary registers need a GPR to pass through, except on the SPC700.
+  if (!IsGPR && !STI.hasSPC700()) {
+    auto FindTemp = [&](MachineBasicBlock::iterator Pos) -> Register {
+      LiveRegUnits Live = getLiveRegsBefore(TRI, MBB, Pos);
+      for (Register R : {MOS::A, MOS::X, MOS::Y})
+        if (Live.available(R))
+          return R;
+      return Register();
+    };
+    Save.SaveTemp = FindTemp(I);
+    Save.RestoreTemp = FindTemp(UseMI);
+    if (!Save.SaveTemp || !Save.RestoreTemp)
+      return std::nullopt;
+  }
+
+  // The registers live or referenced anywhere in the region.
+  LiveRegUnits Busy(TRI);
+  LiveRegUnits Live = getLiveRegsBefore(TRI, MBB, UseMI);
+  Busy.addUnits(Live.getBitVector());
+  for (MachineBasicBlock::iterator J = UseMI; J != I;) {
+    --J;
+    Live.stepBackward(*J);
+    Busy.addUnits(Live.getBitVector());
+    Busy.accumulate(*J);
+  }
+
+  BitVector IntraCallClobbered(TRI.getNumRegs());
+  for (MCPhysReg R : TRI.getIntraCallClobberedRegs(&MF))
+    for (MCRegAliasIterator A(R, &TRI, /*IncludeSelf=*/true); A.isValid(); ++A)
+      IntraCallClobbered.set(*A);
+  auto TryAdd = [&](Register R) {
+    if (Save.Slots.size() == Bytes.size() || !Busy.available(R) ||
+        is_contained(Save.Slots, R))
+      return;
+    if (R != MOS::RC16 && R != MOS::RC17 &&
+        (MRI.isReserved(R) ||
+         (!MRI.isPhysRegModified(R) && !IntraCallClobbered.test(R))))
+      return;
+    Save.Slots.push_back(R);
+  };
+  TryAdd(MOS::RC16);
+  TryAdd(MOS::RC17);
+  for (Register R : MOS::Imag8RegClass)
+    TryAdd(R);
+  if (Save.Slots.size() == Bytes.size())
+    return Save;
+
+  // Fall back to pushing a GPR, or an imaginary register by way of A.
+  if (Balanced && CanPush) {
+    Save.Slots.clear();
+    Save.UseHardStack = true;
+    return Save;
+  }
+  if (Balanced && Bytes.size() == 1 && !IsGPR && Save.SaveTemp == MOS::A &&
+      Save.RestoreTemp == MOS::A) {
+    Save.Slots.clear();
+    Save.UseHardStack = true;
+    return Save;
+  }
+  return std::nullopt;
+}
+
 bool MOSRegisterInfo::saveScavengerRegister(MachineBasicBlock &MBB,
                                             MachineBasicBlock::iterator I,
                                             MachineBasicBlock::iterator &UseMI,
@@ -178,79 +368,68 @@ bool MOSRegisterInfo::saveScavengerRegister(MachineBasicBlock &MBB,
   // This means that a save/restore pair for that physical register cannot
   // overlap with any other save/restore pair for the same physical register.
 
+  std::optional<ScavengerSave> Save = planScavengerSave(*this, Reg, I, UseMI);
+  if (!Save)
+    return false;
+
   MachineIRBuilder Builder(MBB, I);
   const MOSSubtarget &STI = Builder.getMF().getSubtarget<MOSSubtarget>();
+  bool IsGPR = Reg == MOS::P || MOS::GPRRegClass.contains(Reg);
 
-  switch (Reg) {
-  default:
-    errs() << "Register: " << getName(Reg) << "\n";
-    report_fatal_error("Scavenger spill for register not yet implemented.");
-  case MOS::A:
-  case MOS::Y:
-  case MOS::P: {
-    // RS8 is reserved to save A and Y if necessary, but pushing is still
-    // preferred.
-    Register Save = Reg == MOS::A ? MOS::RC16 : MOS::RC17;
-    bool UseHardStack =
-        (Reg == MOS::A || Reg == MOS::P || STI.hasGPRStackRegs()) &&
-        pushPullBalanced(I, UseMI);
-
-    // P can only be efficiently saved to the hard stack.
-    assert(!(Reg == MOS::P && !UseHardStack) &&
-           "expected P live range to fully contain all overlapping vreg live "
-           "ranges");
-
-    if (UseHardStack)
+  if (Save->UseHardStack) {
+    if (IsGPR) {
       Builder.buildInstr(MOS::PH, {}, {Reg});
-    else
-      Builder.buildInstr(MOS::STImag8, {Save}, {Reg});
+    } else {
+      Builder.buildInstr(MOS::LDImag8, {MOS::A}, {Reg});
+      Builder.buildInstr(MOS::PH, {}, {MOS::A});
+    }
+    // The push moves stack-relative frame accesses one byte further away.
+    for (MachineInstr &MI : make_range(I, UseMI))
+      if (MI.getOpcode() == MOS::LDStkRel || MI.getOpcode() == MOS::STStkRel)
+        MI.getOperand(1).setImm(MI.getOperand(1).getImm() + 1);
 
     Builder.setInsertPt(MBB, UseMI);
-
-    if (UseHardStack)
+    if (IsGPR) {
       Builder.buildInstr(MOS::PL, {Reg}, {});
-    else
-      Builder.buildInstr(MOS::LDImag8, {Reg}, {Save});
-    break;
+    } else {
+      Builder.buildInstr(MOS::PL, {MOS::A}, {});
+      Builder.buildInstr(MOS::STImag8, {Reg}, {MOS::A});
+    }
+    return true;
   }
+
+  SmallVector<Register, 2> Bytes;
+  if (MOS::Imag16RegClass.contains(Reg)) {
+    Bytes.push_back(getSubReg(Reg, MOS::sublo));
+    Bytes.push_back(getSubReg(Reg, MOS::subhi));
+  } else {
+    Bytes.push_back(Reg);
   }
+  // Copies an imaginary register or GPR to an imaginary register.
+  auto BuildCopy = [&](Register Dst, Register Src, Register Temp) {
+    if (MOS::GPRRegClass.contains(Src)) {
+      Builder.buildInstr(MOS::STImag8, {Dst}, {Src});
+    } else if (MOS::GPRRegClass.contains(Dst)) {
+      Builder.buildInstr(MOS::LDImag8, {Dst}, {Src});
+    } else if (STI.hasSPC700()) {
+      Builder.buildInstr(MOS::MOVImag8, {Dst}, {Src});
+    } else {
+      Builder.buildInstr(MOS::LDImag8, {Temp}, {Src});
+      Builder.buildInstr(MOS::STImag8, {Dst}, {Temp});
+    }
+  };
+  for (auto [Byte, Slot] : zip(Bytes, Save->Slots))
+    BuildCopy(Slot, Byte, Save->SaveTemp);
+  Builder.setInsertPt(MBB, UseMI);
+  for (auto [Byte, Slot] : zip(Bytes, Save->Slots))
+    BuildCopy(Byte, Slot, Save->RestoreTemp);
   return true;
 }
 
 bool MOSRegisterInfo::canSaveScavengerRegister(
     Register Reg, MachineBasicBlock::iterator I,
     MachineBasicBlock::iterator UseMI) const {
-  // Easy cases
-  switch (Reg) {
-  case MOS::X:
-    return false;
-  case MOS::P:
-    return pushPullBalanced(I, UseMI);
-  default:
-    break;
-  }
-
-  const MOSSubtarget &STI = I->getMF()->getSubtarget<MOSSubtarget>();
-
-  bool UseHardStack =
-      (Reg == MOS::A || STI.hasGPRStackRegs()) && pushPullBalanced(I, UseMI);
-  if (UseHardStack)
-    return true;
-
-  // Because the scavenger may run more than once, the reserved register may
-  // already be in use. In such cases, it's not safe to save it, and a
-  // different register must be used.
-  Register Save = Reg == MOS::A ? MOS::RC16 : MOS::RC17;
-  LivePhysRegs LPR(*STI.getRegisterInfo());
-  LPR.addLiveOuts(*I->getParent());
-  for (MachineBasicBlock::iterator J = std::prev(I->getParent()->end()); J != I;
-       --J) {
-    LPR.stepBackward(*J);
-    if (J == UseMI && LPR.contains(Save))
-      return false;
-  }
-  LPR.stepBackward(*I);
-  return !LPR.contains(Save);
+  return planScavengerSave(*this, Reg, I, UseMI).has_value();
 }
 
 bool MOSRegisterInfo::eliminateFrameIndex(MachineBasicBlock::iterator MI,
@@ -307,6 +486,26 @@ bool MOSRegisterInfo::eliminateFrameIndex(MachineBasicBlock::iterator MI,
   case MOS::AddrHistk:
   case MOS::LDStk:
   case MOS::STStk: {
+    if (MFI.getStackID(Idx) == TargetStackID::MosHardStack &&
+        MF.getSubtarget<MOSSubtarget>().hasW65816Or65EL02()) {
+      // The frame is addressed relative to the hardware stack pointer, which
+      // points just below it.
+      MI->getOperand(FIOperandNum).ChangeToRegister(MOS::S, /*isDef=*/false);
+      MI->getOperand(FIOperandNum + 1).setImm(1 + Offset);
+      break;
+    }
+    if (MFI.getStackID(Idx) == TargetStackID::MosHardStack) {
+      // The hardware stack pointer points just below the frame. Capture it
+      // before anything else the access needs, since the scavenger may save A
+      // by pushing it.
+      BuildMI(*MI->getParent(), MI, MI->getDebugLoc(),
+              MF.getSubtarget().getInstrInfo()->get(MOS::TSX_Implied))
+          .addDef(MOS::X, RegState::Implicit)
+          .addDef(MOS::NZ, RegState::Implicit | RegState::Dead);
+      MI->getOperand(FIOperandNum).ChangeToRegister(MOS::X, /*isDef=*/false);
+      MI->getOperand(FIOperandNum + 1).setImm(0x101 + Offset);
+      break;
+    }
     // During frame setup or teardown, FP is not valid, so SP instead plays the
     // role of the frame pointer.
     Register FP = (MI->getFlags() &
@@ -426,8 +625,12 @@ void MOSRegisterInfo::expandLDSTStk(MachineBasicBlock::iterator MI) const {
   Register Loc =
       IsLoad ? MI->getOperand(0).getReg() : MI->getOperand(1).getReg();
   int64_t Offset = MI->getOperand(3).getImm();
+  // Hardware stack accesses are indexed by X from an absolute address in the
+  // stack page, or relative to the stack pointer where that's available.
+  const bool IsHardStack = MI->getOperand(2).getReg() == MOS::X;
+  const bool IsStackRel = MI->getOperand(2).getReg() == MOS::S;
 
-  if (Offset >= 256) {
+  if (Offset >= 256 && !IsHardStack && !IsStackRel) {
     Register P = MRI.createVirtualRegister(&MOS::PcRegClass);
     // Far stack accesses need a virtual base register, so materialize one
     // here using the pointer provided.
@@ -518,15 +721,29 @@ void MOSRegisterInfo::expandLDSTStk(MachineBasicBlock::iterator MI) const {
     }
   }
 
-  // This needs to occur after the above copy since the source may be Y.
-  Register Y =
-      Builder.buildInstr(MOS::LDImm, {&MOS::YcRegClass}, {Offset}).getReg(0);
-
-  Builder.buildInstr(IsLoad ? MOS::LDIndirIdx : MOS::STIndirIdx)
-      .addReg(A, getDefRegState(IsLoad))
-      .add(MI->getOperand(2))
-      .addUse(Y)
-      .addMemOperand(*MI->memoperands_begin());
+  if (IsStackRel) {
+    assert(Offset < 256 && "stack-relative offset out of range");
+    Builder.buildInstr(IsLoad ? MOS::LDStkRel : MOS::STStkRel)
+        .addReg(A, getDefRegState(IsLoad))
+        .addImm(Offset)
+        .addMemOperand(*MI->memoperands_begin());
+  } else if (IsHardStack) {
+    Builder.buildInstr(IsLoad ? MOS::LDAAbsIdx : MOS::STAbsIdx)
+        .addReg(A, getDefRegState(IsLoad))
+        .addImm(Offset)
+        .addUse(MOS::X)
+        .addMemOperand(*MI->memoperands_begin());
+  } else {
+    // This needs to occur after the above copy since the source may be Y.
+    Register Y =
+        Builder.buildInstr(MOS::LDImm, {&MOS::YcRegClass}, {Offset}).getReg(0);
+
+    Builder.buildInstr(IsLoad ? MOS::LDIndirIdx : MOS::STIndirIdx)
+        .addReg(A, getDefRegState(IsLoad))
+        .add(MI->getOperand(2))
+        .addUse(Y)
+        .addMemOperand(*MI->memoperands_begin());
+  }
 
   // Transfer the loaded value out of A (if applicable).
   if (IsLoad && Loc != A) {
@@ -705,22 +922,16 @@ bool MOSRegisterInfo::getRegAllocationHints(Register VirtReg,
     return true;
   }
 
-  MOSInstrCost INCzp = MOSInstrCost(2, 5);
-  MOSInstrCost INCxy = MOSInstrCost(1, 2);
-  MOSInstrCost ASLzp = MOSInstrCost(2, 5);
-  MOSInstrCost ASLa = MOSInstrCost(1, 2);
-  if (STI.hasHUC6280()) {
-    INCzp = MOSInstrCost(2, 6);
-    ASLzp = MOSInstrCost(2, 6);
-  }
-  if (STI.has65CE02() || STI.hasSPC700()) {
-    INCzp = MOSInstrCost(2, 4);
-    ASLzp = MOSInstrCost(2, 4);
-  }
-  if (STI.has65CE02()) {
-    INCxy = MOSInstrCost(1, 1);
-    ASLa = MOSInstrCost(1, 1);
-  }
+  // MOSRegPlacement weighs every copy in the register's web by block
+  // frequency, so its choice outranks the local scores below.
+  Register Placed = MRI.getSimpleHint(VirtReg);
+  if (Placed.isPhysical() && is_contained(Order, Placed))
+    Hints.push_back(Placed);
+
+  MOSInstrCost INCzp = MOSInstrCost::get(MOS::INC_ZeroPage, STI);
+  MOSInstrCost INCxy = MOSInstrCost::get(MOS::INX_Implied, STI);
+  MOSInstrCost ASLzp = MOSInstrCost::get(MOS::ASL_ZeroPage, STI);
+  MOSInstrCost ASLa = MOSInstrCost::get(MOS::ASL_Accumulator, STI);
 
   SmallSet<const MachineInstr *, 32> Visited;
   for (MachineInstr &MI : MRI.reg_nodbg_instructions(VirtReg)) {
@@ -776,7 +987,7 @@ bool MOSRegisterInfo::getRegAllocationHints(Register VirtReg,
       // CmpZero GPR best case: 0 (TAX)
       // CmpZero GPR worst case: 4 (CMP #0)
       // Splitting the difference: 2
-      MOSInstrCost CmpZeroGPR = MOSInstrCost(2, 2) / 2;
+      MOSInstrCost CmpZeroGPR = MOSInstrCost::get(MOS::CMP_Immediate, STI) / 2;
       // CmpZero ZP best case: 0 (elided)
       // CmpZero ZP worst case: 14 (INC DEC)
       // Splitting the difference: 7
@@ -825,7 +1036,9 @@ bool MOSRegisterInfo::getRegAllocationHints(Register VirtReg,
       return false;
     return OriginalIndex[A.first] < OriginalIndex[B.first];
   });
-  append_range(Hints, make_first_range(RegsAndScores));
+  for (Register R : make_first_range(RegsAndScores))
+    if (R != Placed)
+      Hints.push_back(R);
   return false;
 }
 
@@ -900,14 +1113,14 @@ MOSInstrCost MOSRegisterInfo::copyCost(Register DestReg, Register SrcReg,
     return Dest.contains(DestReg) && Src.contains(SrcReg);
   };
 
-  auto TransferCost = MOSInstrCost(1, STI.has65CE02() ? 1 : 2);
-  auto PushCost = MOSInstrCost(1, STI.hasSPC700() ? 4 : 3);
-  auto PopCost = MOSInstrCost(1, STI.has65CE02() ? 3 : 4);
-  auto ClvCost = MOSInstrCost(1, STI.has65CE02() ? 1 : 2);
-  auto JumpCost = MOSInstrCost(3, 3);
-  auto BranchCost = MOSInstrCost(2, 3);
-  auto LoadImmCost = MOSInstrCost(2, 2);
-  auto AluImmCost = MOSInstrCost(2, 2);
+  auto TransferCost = MOSInstrCost::get(MOS::TAX_Implied, STI);
+  auto PushCost = MOSInstrCost::get(MOS::PHA_Implied, STI);
+  auto PopCost = MOSInstrCost::get(MOS::PLA_Implied, STI);
+  auto ClvCost = MOSInstrCost::get(MOS::CLV_Implied, STI);
+  auto JumpCost = MOSInstrCost::get(MOS::JMP_Absolute, STI);
+  auto BranchCost = MOSInstrCost::get(MOS::BNE_Relative, STI);
+  auto LoadImmCost = MOSInstrCost::get(MOS::LDA_Immediate, STI);
+  auto AluImmCost = MOSInstrCost::get(MOS::ORA_Immediate, STI);
 
   if (AreClasses(MOS::GPRRegClass, MOS::GPRRegClass)) {
     if (MOS::AcRegClass.contains(SrcReg)) {
@@ -937,22 +1150,23 @@ MOSInstrCost MOSRegisterInfo::copyCost(Register DestReg, Register SrcReg,
     if (STI.hasHUC6280()) {
       // SXY can be used, but only if the source register is killed. As such,
       // average the cost.
-      XYCopyCost = (XYCopyCost + MOSInstrCost(1, 3)) / 2;
+      XYCopyCost =
+          (XYCopyCost + MOSInstrCost::get(MOS::SXY_Implied, STI)) / 2;
     }
     return XYCopyCost;
   }
   if (AreClasses(MOS::Imag8RegClass, MOS::GPRRegClass)) {
     // STImag8
-    return MOSInstrCost(2, (STI.hasHUC6280() || STI.hasSPC700()) ? 4 : 3);
+    return MOSInstrCost::get(MOS::STA_ZeroPage, STI);
   }
   if (AreClasses(MOS::GPRRegClass, MOS::Imag8RegClass)) {
     // LDImag8
-    return MOSInstrCost(2, (STI.hasHUC6280() || STI.hasSPC700()) ? 4 : 3);
+    return MOSInstrCost::get(MOS::LDA_ZeroPage, STI);
   }
   if (AreClasses(MOS::Imag8RegClass, MOS::Imag8RegClass)) {
     // MOV dp, dp
     if (STI.hasSPC700())
-      return MOSInstrCost(3, 5);
+      return MOSInstrCost::get(MOS::SPC700_MOV_ZeroPageZeroPage, STI);
     // May need to PHA/PLA around.
     return (PushCost + PopCost) / 2 + copyCost(DestReg, MOS::A, STI) +
            copyCost(MOS::A, SrcReg, STI);
@@ -966,9 +1180,8 @@ MOSInstrCost MOSRegisterInfo::copyCost(Register DestReg, Register SrcReg,
     Register DestReg8 =
         getMatchingSuperReg(DestReg, MOS::sublsb, &MOS::Anyi8RegClass);
     // BIT imm (HUC6280), BIT abs
-    auto BitCost = STI.hasHUC6280()  ? MOSInstrCost(2, 2)
-                   : STI.has65CE02() ? MOSInstrCost(3, 5)
-                                     : MOSInstrCost(3, 4);
+    auto BitCost = MOSInstrCost::get(
+        STI.hasHUC6280() ? MOS::BIT_Immediate : MOS::BIT_Absolute, STI);
 
     if (SrcReg8) {
       SrcReg = SrcReg8;
@@ -16,6 +16,8 @@
 #include "MOSInstrCost.h"
 
 #include "llvm/ADT/BitVector.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringMap.h"
 #include "llvm/CodeGen/MachineOperand.h"
 #include "llvm/CodeGen/TargetRegisterInfo.h"
 
@@ -29,6 +31,8 @@ class MOSSubtarget;
 class MOSRegisterInfo : public MOSGenRegisterInfo {
   std::unique_ptr<std::string[]> Imag8SymbolNames;
   BitVector Reserved;
+  // The registers preserved by each runtime helper with a known clobber set.
+  StringMap<SmallVector<uint32_t>> LibcallMasks;
 
 public:
   MOSRegisterInfo();
@@ -38,8 +42,15 @@ public:
   const uint32_t *getCallPreservedMask(const MachineFunction &MF,
                                        CallingConv::ID) const override;
 
+  /// Returns the mask of registers preserved by a call to the runtime helper
+  /// Symbol, or nullptr if its clobbers are unknown.
+  const uint32_t *getLibcallPreservedMask(StringRef Symbol) const;
+
   BitVector getReservedRegs(const MachineFunction &MF) const override;
 
+  ArrayRef<MCPhysReg>
+  getIntraCallClobberedRegs(const MachineFunction *MF) const override;
+
   const TargetRegisterClass *
   getLargestLegalSuperClass(const TargetRegisterClass *RC,
                             const MachineFunction &) const override;
@@ -0,0 +1,201 @@
+//===-- MOSSelfModify.cpp - MOS Self-Modifying Code -----------------------===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines the MOS self-modifying code pass.
+//
+// In functions that execute from RAM, an LDA/STA (zp),Y through a pointer that
+// doesn't change within a loop can instead patch the pointer into the operand
+// of an LDA/STA abs,Y once, before the loop is entered. This saves a cycle on
+// each iteration of the loop. Functions opt into this by either carrying the
+// "mos-ram-resident" attribute or being placed in a ".ram_text" section.
+//
+// Patching is only sound if no other activation of the function can run while
+// a loop is executing, so the function must be nonreentrant, and the loop must
+// not contain calls.
+//
+// The patched operand bytes are addressed by a temporary label placed on the
+// instruction, plus one or two. These are plain 16-bit absolute references with
+// an addend, so neither the MC layer nor the linker need any special support.
+//
+//===----------------------------------------------------------------------===//
+
+#include "MOSSelfModify.h"
+
+#include "MCTargetDesc/MOSMCTargetDesc.h"
+#include "MOS.h"
+#include "MOSInstrCost.h"
+#include "MOSRegisterInfo.h"
+#include "MOSSubtarget.h"
+
+#include "llvm/CodeGen/LivePhysRegs.h"
+#include "llvm/CodeGen/MachineInstrBuilder.h"
+#include "llvm/CodeGen/MachineLoopInfo.h"
+#include "llvm/CodeGen/MachineRegisterInfo.h"
+#include "llvm/MC/MCContext.h"
+#include "llvm/Support/Debug.h"
+
+#define DEBUG_TYPE "mos-self-modify"
+
+using namespace llvm;
+
+namespace {
+
+struct MOSSelfModify : public MachineFunctionPass {
+  static char ID;
+
+  MOSSelfModify() : MachineFunctionPass(ID) {
+    initializeMOSSelfModifyPass(*PassRegistry::getPassRegistry());
+  }
+
+  bool runOnMachineFunction(MachineFunction &MF) override;
+  void getAnalysisUsage(AnalysisUsage &AU) const override;
+
+private:
+  bool patchLoop(MachineLoop &ML) const;
+};
+
+} // namespace
+
+static bool isRAMResident(const Function &F) {
+  return F.hasFnAttribute("mos-ram-resident") ||
+         F.getSection().starts_with(".ram_text");
+}
+
+bool MOSSelfModify::runOnMachineFunction(MachineFunction &MF) {
+  const Function &F = MF.getFunction();
+  const MOSSubtarget &STI = MF.getSubtarget<MOSSubtarget>();
+  if (!isRAMResident(F) || !F.hasFnAttribute("nonreentrant") ||
+      STI.hasSPC700())
+    return false;
+  // Each patch costs ten bytes up front, and abs,Y is a byte longer than
+  // (zp),Y.
+  if (MOSInstrCost::getModeFor(MF) == MOSInstrCost::Mode::PreferBytes)
+    return false;
+
+  MachineLoopInfo &MLI = getAnalysis<MachineLoopInfoWrapperPass>().getLI();
+  bool Changed = false;
+  for (MachineLoop *ML : MLI.getLoopsInPreorder())
+    if (ML->isInnermost())
+      Changed |= patchLoop(*ML);
+  return Changed;
+}
+
+bool MOSSelfModify::patchLoop(MachineLoop &ML) const {
+  MachineBasicBlock *Preheader = ML.getLoopPreheader();
+  if (!Preheader)
+    return false;
+  MachineFunction &MF = *Preheader->getParent();
+  const MachineRegisterInfo &MRI = MF.getRegInfo();
+  const MOSRegisterInfo &TRI =
+      *MF.getSubtarget<MOSSubtarget>().getRegisterInfo();
+  const TargetInstrInfo &TII = *MF.getSubtarget().getInstrInfo();
+
+  SmallVector<MachineInstr *> Candidates;
+  for (MachineBasicBlock *MBB : ML.blocks()) {
+    for (MachineInstr &MI : *MBB) {
+      if (MI.isCall())
+        return false;
+      if (MI.getOpcode() == MOS::LDIndirIdx ||
+          MI.getOpcode() == MOS::STIndirIdx)
+        Candidates.push_back(&MI);
+    }
+  }
+  // The pointer must hold the same value throughout the loop.
+  llvm::erase_if(Candidates, [&](const MachineInstr *Candidate) {
+    Register Ptr = Candidate->getOperand(1).getReg();
+    for (MachineBasicBlock *MBB : ML.blocks())
+      for (const MachineInstr &MI : *MBB)
+        if (MI.modifiesRegister(Ptr, &TRI))
+          return true;
+    return false;
+  });
+  if (Candidates.empty())
+    return false;
+
+  // The patch is written just before the preheader branches into the loop. It
+  // needs a free GPR for the copy, and LDA clobbers NZ.
+  MachineBasicBlock::iterator InsertPt = Preheader->getFirstTerminator();
+  LivePhysRegs LiveRegs(TRI);
+  LiveRegs.addLiveOuts(*Preheader);
+  for (MachineInstr &MI :
+       make_range(Preheader->rbegin(), MachineBasicBlock::reverse_iterator(
+                                           InsertPt)))
+    LiveRegs.stepBackward(MI);
+  if (!LiveRegs.available(MRI, MOS::NZ))
+    return false;
+  Register Tmp = 0;
+  for (Register Reg : {MOS::A, MOS::X, MOS::Y}) {
+    if (LiveRegs.available(MRI, Reg)) {
+      Tmp = Reg;
+      break;
+    }
+  }
+  if (!Tmp)
+    return false;
+
+  DebugLoc DL = InsertPt == Preheader->end() ? DebugLoc()
+                                             : InsertPt->getDebugLoc();
+  for (MachineInstr *MI : Candidates) {
+    Register Ptr = MI->getOperand(1).getReg();
+    MCSymbol *Sym = MF.getContext().createTempSymbol("smc");
+    LLVM_DEBUG(dbgs() << "Patching " << *MI << " at " << Sym->getName()
+                      << "\n");
+
+    for (const auto &[Idx, Offset] :
+         {std::make_pair(MOS::sublo, 1), std::make_pair(MOS::subhi, 2)}) {
+      BuildMI(*Preheader, InsertPt, DL, TII.get(MOS::LDImag8), Tmp)
+          .addReg(TRI.getSubReg(Ptr, Idx));
+      MachineOperand Operand = MachineOperand::CreateMCSymbol(Sym);
+      Operand.setOffset(Offset);
+      BuildMI(*Preheader, InsertPt, DL, TII.get(MOS::STAbs))
+          .addReg(Tmp)
+          .add(Operand);
+    }
+
+    // The address operand is a placeholder; the patch overwrites it. The index
+    // is always Y, so abs,Y is the only encoding available.
+    MachineInstrBuilder New;
+    if (MI->getOpcode() == MOS::LDIndirIdx) {
+      New = BuildMI(*MI->getParent(), MI, MI->getDebugLoc(),
+                    TII.get(MOS::LDAAbsIdx), MI->getOperand(0).getReg())
+                .addImm(0)
+                .add(MI->getOperand(2));
+    } else {
+      New = BuildMI(*MI->getParent(), MI, MI->getDebugLoc(),
+                    TII.get(MOS::STAbsIdx))
+                .add(MI->getOperand(0))
+                .addImm(0)
+                .add(MI->getOperand(2));
+    }
+    New.cloneMemRefs(*MI);
+    New->setPreInstrSymbol(MF, Sym);
+    MI->eraseFromParent();
+  }
+  return true;
+}
+
+void MOSSelfModify::getAnalysisUsage(AnalysisUsage &AU) const {
+  AU.addRequired<MachineLoopInfoWrapperPass>();
+  AU.addPreserved<MachineLoopInfoWrapperPass>();
+  AU.setPreservesCFG();
+  MachineFunctionPass::getAnalysisUsage(AU);
+}
+
+char MOSSelfModify::ID = 0;
+
+INITIALIZE_PASS_BEGIN(MOSSelfModify, DEBUG_TYPE,
+                      "Patch loop-invariant pointers into RAM-resident code",
+                      false, false)
+INITIALIZE_PASS_DEPENDENCY(MachineLoopInfoWrapperPass)
+INITIALIZE_PASS_END(MOSSelfModify, DEBUG_TYPE,
+                    "Patch loop-invariant pointers into RAM-resident code",
+                    false, false)
+
+MachineFunctionPass *llvm::createMOSSelfModifyPass() {
+  return new MOSSelfModify();
+}
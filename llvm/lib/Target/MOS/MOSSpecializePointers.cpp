@@ -0,0 +1,226 @@
+//===-- MOSSpecializePointers.cpp - MOS Pointer Specialization ------------===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines the MOS pointer argument specialization pass.
+//
+// A pointer argument must be passed in an imaginary register pair, and memory
+// accesses through it use the (zp),Y addressing mode. When a call passes the
+// address of a global, a copy of the callee with the address folded in can
+// instead use absolute and absolute indexed addressing, which are a cycle
+// faster and free X or Y from holding a constant offset, and the call no
+// longer needs to set up the argument at all.
+//
+// For each function, this pass picks the first pointer parameter that is used
+// as the base of a memory access and is passed the address of a global at any
+// direct call site. It then clones the function with that parameter removed
+// for each distinct global address, those passed at the most call sites
+// first, as long as the number of clones and the growth in code size, as
+// measured by TTI, stay within a budget. A clone that takes over every
+// remaining call of an internal function makes the original dead, which
+// refunds its size; it is left for GlobalDCE to remove. The clones are
+// themselves revisited, so that further pointer parameters can be specialized
+// in turn. Recursive functions are left alone, since their clones would still
+// call the original.
+//
+// This is most effective under LTO, where every call site of a function is
+// visible, and is run there.
+//
+//===----------------------------------------------------------------------===//
+
+#include "MOSSpecializePointers.h"
+
+#include "llvm/ADT/MapVector.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+
+#define DEBUG_TYPE "mos-specialize-pointers"
+
+STATISTIC(NumSpecializations, "Number of pointer argument specializations");
+STATISTIC(NumCallsSpecialized, "Number of calls to specializations");
+
+using namespace llvm;
+
+static cl::opt<bool> SpecializePointers(
+    "mos-specialize-pointers",
+    cl::desc("Clone functions for the global addresses passed to their "
+             "pointer parameters"),
+    cl::init(true), cl::Hidden);
+
+static cl::opt<unsigned> MaxClones(
+    "mos-specialize-pointers-max-clones",
+    cl::desc("Maximum number of specializations of each pointer parameter"),
+    cl::init(4), cl::Hidden);
+
+static cl::opt<unsigned> MaxGrowth(
+    "mos-specialize-pointers-max-growth",
+    cl::desc("Maximum code size, in TTI units, that the specializations of "
+             "each pointer parameter may add"),
+    cl::init(40), cl::Hidden);
+
+// The code size saved at each call by no longer passing the pointer: loading
+// and storing each of its two bytes, in TTI units of roughly one byte
+// operation.
+static constexpr int64_t ArgSetupSize = 2;
+
+// Returns whether V is the base of a load or store, maybe through GEPs.
+static bool isAccessBase(const Value &V) {
+  for (const User *U : V.users()) {
+    if (isa<LoadInst>(U))
+      return true;
+    if (const auto *SI = dyn_cast<StoreInst>(U);
+        SI && SI->getPointerOperand() == &V)
+      return true;
+    if (isa<GetElementPtrInst>(U) && isAccessBase(*U))
+      return true;
+  }
+  return false;
+}
+
+static int64_t getCodeSize(const Function &F, const TargetTransformInfo &TTI) {
+  InstructionCost Size = 0;
+  for (const Instruction &I : instructions(F))
+    Size += TTI.getInstructionCost(&I, TargetTransformInfo::TCK_CodeSize);
+  return Size.isValid() ? Size.getValue() : INT64_MAX / 2;
+}
+
+// Replaces Call with a call to Clone, which lacks the parameter ArgNo.
+static void redirectCall(CallInst &Call, Function &Clone, unsigned ArgNo) {
+  SmallVector<Value *> Args;
+  SmallVector<AttributeSet> ArgAttrs;
+  AttributeList Attrs = Call.getAttributes();
+  for (unsigned I = 0, E = Call.arg_size(); I != E; ++I) {
+    if (I == ArgNo)
+      continue;
+    Args.push_back(Call.getArgOperand(I));
+    ArgAttrs.push_back(Attrs.getParamAttrs(I));
+  }
+  SmallVector<OperandBundleDef> Bundles;
+  Call.getOperandBundlesAsDefs(Bundles);
+
+  CallInst *New =
+      CallInst::Create(&Clone, Args, Bundles, "", Call.getIterator());
+  New->setAttributes(AttributeList::get(Call.getContext(), Attrs.getFnAttrs(),
+                                        Attrs.getRetAttrs(), ArgAttrs));
+  New->setCallingConv(Call.getCallingConv());
+  New->setTailCallKind(Call.getTailCallKind());
+  New->copyMetadata(Call);
+  New->setDebugLoc(Call.getDebugLoc());
+  New->takeName(&Call);
+  Call.replaceAllUsesWith(New);
+  Call.eraseFromParent();
+}
+
+// Specializes a pointer parameter of F, adding the clones made to Worklist.
+static bool specialize(Function &F, const TargetTransformInfo &TTI,
+                       int64_t Budget, SmallVectorImpl<Function *> &Worklist) {
+  if (any_of(F.users(), [&](const User *U) {
+        const auto *I = dyn_cast<Instruction>(U);
+        return I && I->getFunction() == &F;
+      }))
+    return false;
+
+  for (Argument &Arg : F.args()) {
+    if (!Arg.getType()->isPointerTy() || Arg.hasPassPointeeByValueCopyAttr() ||
+        Arg.hasSwiftErrorAttr() || !isAccessBase(Arg))
+      continue;
+
+    // Group the direct calls by the global address they pass.
+    MapVector<Constant *, SmallVector<CallInst *>> Sites;
+    for (Use &U : F.uses()) {
+      auto *Call = dyn_cast<CallInst>(U.getUser());
+      if (!Call || !Call->isCallee(&U) ||
+          Call->getFunctionType() != F.getFunctionType() ||
+          Call->isMustTailCall())
+        continue;
+      auto *C = dyn_cast<Constant>(Call->getArgOperand(Arg.getArgNo()));
+      if (!C || !isa<GlobalVariable>(getUnderlyingObject(C)))
+        continue;
+      Sites[C].push_back(Call);
+    }
+    if (Sites.empty())
+      continue;
+
+    SmallVector<std::pair<Constant *, SmallVector<CallInst *>>> Order(
+        Sites.takeVector());
+    llvm::stable_sort(Order, [](const auto &A, const auto &B) {
+      return A.second.size() > B.second.size();
+    });
+
+    int64_t Size = getCodeSize(F, TTI);
+    unsigned RemainingUses = F.getNumUses();
+    int64_t Growth = 0;
+    unsigned NumClones = 0;
+    for (auto &[C, Calls] : Order) {
+      if (NumClones == MaxClones)
+        break;
+      int64_t Cost = Size - int64_t(Calls.size()) * ArgSetupSize;
+      if (RemainingUses == Calls.size() && F.hasLocalLinkage())
+        Cost -= Size;
+      if (Growth + Cost > Budget)
+        break;
+      Growth += Cost;
+      RemainingUses -= Calls.size();
+
+      ValueToValueMapTy VMap;
+      VMap[&Arg] = C;
+      Function *Clone = CloneFunction(&F, VMap);
+      Clone->setName(F.getName() + ".mos.spec." +
+                     getUnderlyingObject(C)->getName());
+      Clone->setLinkage(GlobalValue::InternalLinkage);
+      Clone->setVisibility(GlobalValue::DefaultVisibility);
+      Clone->setComdat(nullptr);
+      Clone->setUnnamedAddr(GlobalValue::UnnamedAddr::Global);
+      LLVM_DEBUG(dbgs() << "Specialized " << F.getName() << " as "
+                        << Clone->getName() << " for " << Calls.size()
+                        << " calls\n");
+      for (CallInst *Call : Calls)
+        redirectCall(*Call, *Clone, Arg.getArgNo());
+      ++NumSpecializations;
+      NumCallsSpecialized += Calls.size();
+      ++NumClones;
+      Worklist.push_back(Clone);
+    }
+    return NumClones;
+  }
+  return false;
+}
+
+PreservedAnalyses MOSSpecializePointersPass::run(Module &M,
+                                                 ModuleAnalysisManager &AM) {
+  if (!SpecializePointers)
+    return PreservedAnalyses::all();
+
+  FunctionAnalysisManager &FAM =
+      AM.getResult<FunctionAnalysisManagerModuleProxy>(M).getManager();
+  int64_t Budget = OptSize ? 0 : int64_t(MaxGrowth);
+
+  SmallVector<Function *> Worklist;
+  for (Function &F : M) {
+    if (F.isDeclaration() || F.isVarArg() || F.hasOptNone() ||
+        F.hasFnAttribute(Attribute::Naked) || F.isPresplitCoroutine())
+      continue;
+    Worklist.push_back(&F);
+  }
+  // Oldest first, so that the clones are visited after all of the original
+  // functions' calls have been redirected.
+  bool Changed = false;
+  for (size_t I = 0; I < Worklist.size(); ++I) {
+    Function &F = *Worklist[I];
+    if (specialize(F, FAM.getResult<TargetIRAnalysis>(F), Budget, Worklist))
+      Changed = true;
+  }
+  return Changed ? PreservedAnalyses::none() : PreservedAnalyses::all();
+}
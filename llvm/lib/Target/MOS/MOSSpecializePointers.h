@@ -0,0 +1,34 @@
+//===-- MOSSpecializePointers.h - MOS Pointer Specialization ----*- C++ -*-===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares the MOS pointer argument specialization pass.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_LIB_TARGET_MOS_MOSSPECIALIZEPOINTERS_H
+#define LLVM_LIB_TARGET_MOS_MOSSPECIALIZEPOINTERS_H
+
+#include "llvm/IR/Module.h"
+#include "llvm/IR/PassManager.h"
+
+namespace llvm {
+
+struct MOSSpecializePointersPass : PassInfoMixin<MOSSpecializePointersPass> {
+  // Whether code size is being optimized for, in which case no
+  // specialization may grow the program.
+  bool OptSize;
+
+  explicit MOSSpecializePointersPass(bool OptSize = false)
+      : OptSize(OptSize) {}
+
+  PreservedAnalyses run(Module &M, ModuleAnalysisManager &AM);
+};
+
+} // end namespace llvm
+
+#endif // not LLVM_LIB_TARGET_MOS_MOSSPECIALIZEPOINTERS_H
@@ -0,0 +1,304 @@
+//===-- MOSSpecializePrintf.cpp - MOS printf Specialization ---------------===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines the MOS printf specialization pass.
+//
+// The SDK's printf parses its format string at runtime, which costs on the
+// order of a thousand cycles per conversion, and links in the code for every
+// conversion whether it's used or not. This pass splits calls of printf and
+// sprintf with constant format strings into sequences of calls of the SDK's
+// printing primitives, each specialized to a single conversion:
+//
+//  - __put_char(char) and __put_str(const char *) print characters and
+//    strings, including the literal text of the format string.
+//  - __put_<t>_dec(<t>), __put_<t>_hex(<t>) and __put_<t>_HEX(<t>) print
+//    integers, with <t> one of u8, u16 or u32, or i8, i16 or i32 for decimal.
+//  - __sput_str(char *, const char *) and __sput_<t>_<base>(char *, <t>)
+//    write the same into a buffer for sprintf, returning the end of what they
+//    wrote. Literal text and characters are stored directly.
+//
+// Integers are printed with the narrowest primitive that holds their value,
+// so a promoted char goes to the 8-bit primitives. Only the conversions c, s,
+// d, i, u, x and X are specialized, with hh, h or l as length modifiers, and
+// with no flags, field widths or precisions. Calls using anything else are
+// left alone, as are calls of printf whose result is used.
+//
+// The primitives are not part of LLVM. The SDK's C library must define each
+// of them, for every <t> and base above, or specialized programs won't link,
+// so the pass only runs when -mos-specialize-printf is given.
+//
+//===----------------------------------------------------------------------===//
+
+#include "MOSSpecializePrintf.h"
+
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/TargetLibraryInfo.h"
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/KnownBits.h"
+#include <optional>
+
+#define DEBUG_TYPE "mos-specialize-printf"
+
+STATISTIC(NumSpecialized, "Number of printf-style calls specialized");
+STATISTIC(NumConversions, "Number of conversions specialized");
+
+using namespace llvm;
+
+static cl::opt<bool> SpecializePrintf(
+    "mos-specialize-printf",
+    cl::desc("Split printf and sprintf calls with constant format strings "
+             "into calls of specialized printing primitives, which the C "
+             "library must provide"),
+    cl::init(false), cl::Hidden);
+
+namespace {
+
+// A piece of a format string, printed in turn.
+struct Piece {
+  enum Kind { Literal, Char, Str, Int } K;
+  std::string Text;
+  Value *Arg = nullptr;
+  // For integers, the conversion (d, x or X), whether it's signed, and the
+  // number of bits printed.
+  char Conv = 0;
+  bool Signed = false;
+  unsigned Bits = 0;
+};
+
+} // namespace
+
+// Returns the fewest bits, of 8, 16 or 32, that hold the printed value of V,
+// which is the low Bits bits of it.
+static unsigned getPrintedBits(Value *V, unsigned Bits, bool Signed,
+                               const DataLayout &DL) {
+  unsigned Width = V->getType()->getIntegerBitWidth();
+  for (unsigned B = 8; B < Bits; B *= 2) {
+    if (Signed ? ComputeNumSignBits(V, DL) > Width - B
+               : computeKnownBits(V, DL).countMinLeadingZeros() >= Width - B)
+      return B;
+  }
+  return Bits;
+}
+
+// Splits Fmt into the pieces printed for the given arguments, or returns
+// nullopt if it uses anything the primitives cannot print.
+static std::optional<SmallVector<Piece>> parse(StringRef Fmt,
+                                               ArrayRef<Value *> Args,
+                                               unsigned IntBits,
+                                               const DataLayout &DL) {
+  SmallVector<Piece> Pieces;
+  auto AddText = [&](StringRef Text) {
+    if (Text.empty())
+      return;
+    if (Pieces.empty() || Pieces.back().K != Piece::Literal)
+      Pieces.push_back({Piece::Literal});
+    Pieces.back().Text += Text;
+  };
+
+  unsigned NextArg = 0;
+  while (!Fmt.empty()) {
+    size_t Pct = Fmt.find('%');
+    AddText(Fmt.take_front(Pct));
+    if (Pct == StringRef::npos)
+      break;
+    Fmt = Fmt.drop_front(Pct + 1);
+    if (Fmt.consume_front("%")) {
+      AddText("%");
+      continue;
+    }
+
+    // The printed width, if given by a length modifier.
+    unsigned Bits = 0;
+    if (Fmt.consume_front("hh"))
+      Bits = 8;
+    else if (Fmt.consume_front("h"))
+      Bits = 16;
+    else if (Fmt.consume_front("l"))
+      Bits = 32;
+    if (Fmt.empty() || NextArg == Args.size())
+      return std::nullopt;
+    char Conv = Fmt.front();
+    Fmt = Fmt.drop_front();
+
+    Piece P;
+    P.Arg = Args[NextArg++];
+    Type *Ty = P.Arg->getType();
+    switch (Conv) {
+    default:
+      return std::nullopt;
+    case 'c':
+      if (Bits || !Ty->isIntegerTy(IntBits))
+        return std::nullopt;
+      P.K = Piece::Char;
+      break;
+    case 's':
+      if (Bits || !Ty->isPointerTy())
+        return std::nullopt;
+      P.K = Piece::Str;
+      break;
+    case 'd':
+    case 'i':
+    case 'u':
+    case 'x':
+    case 'X':
+      if (!Ty->isIntegerTy(Bits == 32 ? 32 : IntBits))
+        return std::nullopt;
+      P.K = Piece::Int;
+      P.Conv = Conv == 'i' || Conv == 'u' ? 'd' : Conv;
+      P.Signed = Conv == 'd' || Conv == 'i';
+      P.Bits = getPrintedBits(P.Arg, Bits ? Bits : IntBits, P.Signed, DL);
+      break;
+    }
+    Pieces.push_back(std::move(P));
+  }
+  return Pieces;
+}
+
+static Value *emitPrimitive(IRBuilder<> &B, const Twine &Name, Type *RetTy,
+                            ArrayRef<Value *> Args) {
+  SmallVector<Type *, 2> ArgTys;
+  for (Value *Arg : Args)
+    ArgTys.push_back(Arg->getType());
+  Module &M = *B.GetInsertBlock()->getModule();
+  FunctionCallee Callee = M.getOrInsertFunction(
+      Name.str(), FunctionType::get(RetTy, ArgTys, /*isVarArg=*/false));
+  return B.CreateCall(Callee, Args);
+}
+
+static std::string getIntName(StringRef Prefix, const Piece &P) {
+  StringRef Base = P.Conv == 'd' ? "dec" : P.Conv == 'x' ? "hex" : "HEX";
+  return (Prefix + (P.Signed ? "i" : "u") + Twine(P.Bits) + "_" + Base).str();
+}
+
+static Value *truncToPrinted(IRBuilder<> &B, const Piece &P) {
+  return B.CreateTrunc(P.Arg, B.getIntNTy(P.K == Piece::Char ? 8 : P.Bits));
+}
+
+static void specializePrintf(CallInst &CI, ArrayRef<Piece> Pieces) {
+  IRBuilder<> B(&CI);
+  Type *VoidTy = B.getVoidTy();
+  for (const Piece &P : Pieces) {
+    switch (P.K) {
+    case Piece::Literal:
+      if (P.Text.size() == 1)
+        emitPrimitive(B, "__put_char", VoidTy, B.getInt8(P.Text.front()));
+      else
+        emitPrimitive(B, "__put_str", VoidTy,
+                      B.CreateGlobalString(P.Text, "str"));
+      break;
+    case Piece::Char:
+      emitPrimitive(B, "__put_char", VoidTy, truncToPrinted(B, P));
+      break;
+    case Piece::Str:
+      emitPrimitive(B, "__put_str", VoidTy, P.Arg);
+      break;
+    case Piece::Int:
+      emitPrimitive(B, getIntName("__put_", P), VoidTy, truncToPrinted(B, P));
+      break;
+    }
+  }
+  CI.eraseFromParent();
+}
+
+static void specializeSprintf(CallInst &CI, ArrayRef<Piece> Pieces) {
+  IRBuilder<> B(&CI);
+  Type *PtrTy = CI.getArgOperand(0)->getType();
+  Value *Dst = CI.getArgOperand(0);
+  Value *Cur = Dst;
+  for (const Piece &P : Pieces) {
+    switch (P.K) {
+    case Piece::Literal:
+      if (P.Text.size() == 1)
+        B.CreateStore(B.getInt8(P.Text.front()), Cur);
+      else
+        B.CreateMemCpy(Cur, Align(1), B.CreateGlobalString(P.Text, "str"),
+                       Align(1), P.Text.size());
+      Cur = B.CreatePtrAdd(Cur, B.getInt16(P.Text.size()));
+      break;
+    case Piece::Char:
+      B.CreateStore(truncToPrinted(B, P), Cur);
+      Cur = B.CreatePtrAdd(Cur, B.getInt16(1));
+      break;
+    case Piece::Str:
+      Cur = emitPrimitive(B, "__sput_str", PtrTy, {Cur, P.Arg});
+      break;
+    case Piece::Int:
+      Cur = emitPrimitive(B, getIntName("__sput_", P), PtrTy,
+                          {Cur, truncToPrinted(B, P)});
+      break;
+    }
+  }
+  B.CreateStore(B.getInt8(0), Cur);
+
+  // sprintf returns the number of characters written, less the terminator.
+  if (!CI.use_empty()) {
+    Value *Len = B.CreatePtrDiff(B.getInt8Ty(), Cur, Dst);
+    CI.replaceAllUsesWith(B.CreateSExtOrTrunc(Len, CI.getType()));
+  }
+  CI.eraseFromParent();
+}
+
+PreservedAnalyses MOSSpecializePrintfPass::run(Function &F,
+                                               FunctionAnalysisManager &AM) {
+  if (!SpecializePrintf)
+    return PreservedAnalyses::all();
+
+  const TargetLibraryInfo &TLI = AM.getResult<TargetLibraryAnalysis>(F);
+  const DataLayout &DL = F.getDataLayout();
+
+  SmallVector<std::tuple<CallInst *, LibFunc, SmallVector<Piece>>> Calls;
+  for (Instruction &I : instructions(F)) {
+    auto *CI = dyn_cast<CallInst>(&I);
+    LibFunc Func;
+    if (!CI || !TLI.getLibFunc(*CI, Func) || !TLI.has(Func))
+      continue;
+
+    unsigned NumFixed;
+    if (Func == LibFunc_printf && CI->use_empty())
+      NumFixed = 1;
+    else if (Func == LibFunc_sprintf)
+      NumFixed = 2;
+    else
+      continue;
+
+    StringRef Fmt;
+    if (!getConstantStringInfo(CI->getArgOperand(NumFixed - 1), Fmt))
+      continue;
+    SmallVector<Value *> Args(drop_begin(CI->args(), NumFixed));
+    std::optional<SmallVector<Piece>> Pieces =
+        parse(Fmt, Args, TLI.getIntSize(), DL);
+    if (!Pieces) {
+      LLVM_DEBUG(dbgs() << "Could not specialize " << *CI << "\n");
+      continue;
+    }
+    Calls.push_back({CI, Func, std::move(*Pieces)});
+  }
+  if (Calls.empty())
+    return PreservedAnalyses::all();
+
+  for (auto &[CI, Func, Pieces] : Calls) {
+    LLVM_DEBUG(dbgs() << "Specializing " << *CI << "\n");
+    ++NumSpecialized;
+    NumConversions += count_if(
+        Pieces, [](const Piece &P) { return P.K != Piece::Literal; });
+    if (Func == LibFunc_sprintf)
+      specializeSprintf(*CI, Pieces);
+    else
+      specializePrintf(*CI, Pieces);
+  }
+
+  PreservedAnalyses PA;
+  PA.preserveSet<CFGAnalyses>();
+  return PA;
+}
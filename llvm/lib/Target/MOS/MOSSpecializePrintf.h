@@ -0,0 +1,27 @@
+//===-- MOSSpecializePrintf.h - MOS printf Specialization -------*- C++ -*-===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares the MOS printf specialization pass.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_LIB_TARGET_MOS_MOSSPECIALIZEPRINTF_H
+#define LLVM_LIB_TARGET_MOS_MOSSPECIALIZEPRINTF_H
+
+#include "llvm/IR/Function.h"
+#include "llvm/IR/PassManager.h"
+
+namespace llvm {
+
+struct MOSSpecializePrintfPass : PassInfoMixin<MOSSpecializePrintfPass> {
+  PreservedAnalyses run(Function &F, FunctionAnalysisManager &AM);
+};
+
+} // end namespace llvm
+
+#endif // not LLVM_LIB_TARGET_MOS_MOSSPECIALIZEPRINTF_H
@@ -0,0 +1,220 @@
+//===-- MOSSplitModule.cpp - MOS LTO Module Splitting ---------------------===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines the splitting of the LTO module into partitions that can
+// be code generated in parallel, as with --lto-partitions.
+//
+// The zero page and static stack allocators are module passes that need the
+// whole call graph, and the generic splitter would hand each just a piece of
+// it. Instead, the whole module is first analyzed serially, then split so that
+// each allocator can run on its partition alone:
+//
+// - The nonreentrancy analysis runs on the whole module before splitting, and
+//   its results carry over to the partitions as function attributes.
+// - The zero page budget is divided among the partitions in proportion to
+//   their size, and each partition's share is recorded in a module flag.
+// - Local symbols stay with all of their users, so nothing needs to be
+//   externalized, and the passes that rewrite internal functions' calling
+//   conventions still see every caller.
+// - Everything reachable from an interrupt stays with it, since only there do
+//   the allocators learn that it may run in the interrupt's context. Library
+//   functions, whose calls only appear during code generation, stay together,
+//   and with the interrupts if there are any.
+//
+// Each partition allocates its own zero page and static stack, so a call
+// from one partition into another simply reaches memory the caller never
+// uses. Within a partition, such calls are covered by the allocators'
+// existing assumptions about external calls. The cost is that regions of
+// different partitions never share memory, even if they could.
+//
+//===----------------------------------------------------------------------===//
+
+#include "MOSSplitModule.h"
+
+#include "MOSNonReentrant.h"
+#include "MOSZeroPageAlloc.h"
+
+#include "llvm/ADT/DepthFirstIterator.h"
+#include "llvm/ADT/EquivalenceClasses.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/Sequence.h"
+#include "llvm/Analysis/CallGraph.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Module.h"
+#include "llvm/LTO/LTO.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/ValueMapper.h"
+#include <numeric>
+
+#define DEBUG_TYPE "mos-split-module"
+
+using namespace llvm;
+
+static cl::opt<bool>
+    ThinLTOBackend("mos-thinlto", cl::Hidden,
+                   cl::desc("Code is being generated for ThinLTO backends, "
+                            "each of which sees only part of the program"));
+
+using ClusterMap = EquivalenceClasses<const GlobalValue *>;
+
+// Places every global value that uses V in the same cluster as GV.
+static void clusterUsers(ClusterMap &Clusters, const GlobalValue *GV,
+                         const Value *V) {
+  SmallVector<const User *> Worklist(V->users());
+  while (!Worklist.empty()) {
+    const User *U = Worklist.pop_back_val();
+    if (const auto *I = dyn_cast<Instruction>(U))
+      Clusters.unionSets(GV, I->getFunction());
+    else if (const auto *GVU = dyn_cast<GlobalValue>(U))
+      Clusters.unionSets(GV, GVU);
+    else
+      Worklist.append(U->user_begin(), U->user_end());
+  }
+}
+
+bool mos::splitModule(
+    Module &M, unsigned NumParts,
+    function_ref<void(std::unique_ptr<Module> MPart)> ModuleCallback) {
+  if (NumParts < 2)
+    return false;
+
+  CallGraph CG(M);
+  mos::runNonReentrant(M, CG);
+
+  ClusterMap Clusters;
+  DenseMap<const Comdat *, const GlobalValue *> ComdatMembers;
+  for (GlobalValue &GV : M.global_values()) {
+    if (GV.isDeclaration())
+      continue;
+    if (!GV.hasName())
+      GV.setName("__llvmsplit_unnamed");
+    Clusters.insert(&GV);
+    if (const Comdat *C = GV.getComdat()) {
+      auto [It, Inserted] = ComdatMembers.try_emplace(C, &GV);
+      if (!Inserted)
+        Clusters.unionSets(It->second, &GV);
+    }
+    if (const GlobalObject *Root = GV.getAliaseeObject())
+      if (Root != &GV)
+        Clusters.unionSets(&GV, Root);
+    if (const auto *F = dyn_cast<Function>(&GV))
+      for (const BasicBlock &BB : *F)
+        if (BlockAddress *BA = BlockAddress::lookup(&BB))
+          clusterUsers(Clusters, F, BA);
+    if (GV.hasLocalLinkage())
+      clusterUsers(Clusters, &GV, &GV);
+  }
+
+  const GlobalValue *Libcalls = nullptr;
+  const auto AddLibcall = [&](const GlobalValue *GV) {
+    if (!GV || GV->isDeclaration())
+      return;
+    if (Libcalls)
+      Clusters.unionSets(Libcalls, GV);
+    else
+      Libcalls = GV;
+  };
+  for (const char *Name :
+       lto::LTO::getRuntimeLibcallSymbols(Triple(M.getTargetTriple())))
+    AddLibcall(M.getNamedValue(Name));
+  for (const GlobalValue &GV : M.global_values())
+    if (GV.getPartition() == "contingent")
+      AddLibcall(&GV);
+
+  // The nonreentrancy analysis has resolved the indirect calls in CG.
+  for (Function &F : M) {
+    if (F.isDeclaration() || (!F.hasFnAttribute("interrupt") &&
+                              !F.hasFnAttribute("interrupt-norecurse")))
+      continue;
+    for (CallGraphNode *CGN : depth_first(CG[&F]))
+      if (const Function *Callee = CGN->getFunction())
+        if (!Callee->isDeclaration())
+          Clusters.unionSets(&F, Callee);
+    if (Libcalls)
+      Clusters.unionSets(&F, Libcalls);
+  }
+
+  // Balance the clusters over the partitions by instruction count, assigning
+  // the largest first to the lightest partition.
+  struct Cluster {
+    const GlobalValue *Leader;
+    uint64_t Weight = 0;
+  };
+  SmallVector<Cluster> Sorted;
+  for (const auto *C : Clusters) {
+    if (!C->isLeader())
+      continue;
+    Cluster &Cl = Sorted.emplace_back();
+    Cl.Leader = C->getData();
+    for (const GlobalValue *GV : Clusters.members(*C)) {
+      ++Cl.Weight;
+      if (const auto *F = dyn_cast<Function>(GV))
+        Cl.Weight += F->getInstructionCount();
+    }
+  }
+  if (Sorted.size() < 2)
+    return false;
+  sort(Sorted, [](const Cluster &A, const Cluster &B) {
+    if (A.Weight != B.Weight)
+      return A.Weight > B.Weight;
+    return A.Leader->getName() < B.Leader->getName();
+  });
+
+  NumParts = std::min<size_t>(NumParts, Sorted.size());
+  SmallVector<uint64_t> Weights(NumParts);
+  DenseMap<const GlobalValue *, unsigned> PartOf;
+  for (const Cluster &Cl : Sorted) {
+    unsigned Part = std::min_element(Weights.begin(), Weights.end()) -
+                    Weights.begin();
+    Weights[Part] += Cl.Weight;
+    PartOf[Cl.Leader] = Part;
+  }
+
+  // Divide the zero page in proportion to size, giving what rounding leaves
+  // over to the heaviest partitions.
+  const uint64_t ZPBudget = mos::getZeroPageBudget(M);
+  const uint64_t Total = std::accumulate(Weights.begin(), Weights.end(),
+                                         uint64_t(0));
+  SmallVector<uint64_t> ZPShares(NumParts);
+  uint64_t ZPLeft = ZPBudget;
+  for (auto [Share, Weight] : zip(ZPShares, Weights)) {
+    Share = ZPBudget * Weight / Total;
+    ZPLeft -= Share;
+  }
+  SmallVector<unsigned> ByWeight(seq<unsigned>(0, NumParts));
+  stable_sort(ByWeight,
+              [&](unsigned A, unsigned B) { return Weights[A] > Weights[B]; });
+  for (unsigned Part : ByWeight) {
+    if (!ZPLeft)
+      break;
+    ++ZPShares[Part];
+    --ZPLeft;
+  }
+
+  for (unsigned Part = 0; Part != NumParts; ++Part) {
+    LLVM_DEBUG(dbgs() << "Partition " << Part << ": weight " << Weights[Part]
+                      << ", zero page " << ZPShares[Part] << "\n");
+    ValueToValueMapTy VMap;
+    std::unique_ptr<Module> MPart =
+        CloneModule(M, VMap, [&](const GlobalValue *GV) {
+          return PartOf.lookup(Clusters.getLeaderValue(GV)) == Part;
+        });
+    MPart->addModuleFlag(Module::Error, "mos-lto-partition", 1);
+    MPart->addModuleFlag(Module::Error, "mos-zp-avail", ZPShares[Part]);
+    ModuleCallback(std::move(MPart));
+  }
+  return true;
+}
+
+bool mos::isLTOPartition(const Module &M) {
+  return M.getModuleFlag("mos-lto-partition");
+}
+
+bool mos::isThinLTOBackend() { return ThinLTOBackend; }
@@ -0,0 +1,45 @@
+//===-- MOSSplitModule.h - MOS LTO Module Splitting -------------*- C++ -*-===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares the splitting of the LTO module into partitions that can
+// be code generated in parallel.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_LIB_TARGET_MOS_MOSSPLITMODULE_H
+#define LLVM_LIB_TARGET_MOS_MOSSPLITMODULE_H
+
+#include "llvm/ADT/STLFunctionExtras.h"
+#include <memory>
+
+namespace llvm {
+
+class Module;
+
+namespace mos {
+
+// Splits M into at most NumParts partitions, each passed to ModuleCallback,
+// such that the whole-program static stack and zero page allocations remain
+// sound when run on each partition alone. Returns false if M should not be
+// split.
+bool splitModule(Module &M, unsigned NumParts,
+                 function_ref<void(std::unique_ptr<Module> MPart)>
+                     ModuleCallback);
+
+// Returns whether M is one of the partitions made by splitModule.
+bool isLTOPartition(const Module &M);
+
+// Returns whether code is being generated for ThinLTO backends. Like
+// separately compiled translation units, these see only part of the program,
+// so the library functions one defines may be called from any of the others.
+bool isThinLTOBackend();
+
+} // namespace mos
+} // namespace llvm
+
+#endif // not LLVM_LIB_TARGET_MOS_MOSSPLITMODULE_H
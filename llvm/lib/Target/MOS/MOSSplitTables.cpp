@@ -0,0 +1,300 @@
+//===-- MOSSplitTables.cpp - MOS Table Splitting --------------------------===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines the MOS table splitting pass.
+//
+// Indexing an array of multi-byte elements requires scaling the index and
+// 16-bit pointer arithmetic, while an array of bytes can be indexed directly
+// with an absolute indexed addressing mode. This pass splits internal global
+// arrays of multi-byte elements into one byte array per byte of the element,
+// so that, for example, the low and high bytes of an array of pointers, or
+// each field of an array of structs, live in separate tables indexed by the
+// element number.
+//
+// A global is only split if every use is a simple load or store through a
+// chain of GEPs, with at most one variable index that scales by a multiple of
+// the element size. Loads and stores are rewritten into one byte access per
+// byte, which is what the 6502 would do anyway.
+//
+//===----------------------------------------------------------------------===//
+
+#include "MOSSplitTables.h"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/MapVector.h"
+#include "llvm/Analysis/ConstantFolding.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Operator.h"
+#include "llvm/IR/PatternMatch.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/MathExtras.h"
+
+#define DEBUG_TYPE "mos-split-tables"
+
+using namespace llvm;
+using namespace llvm::PatternMatch;
+
+static cl::opt<bool>
+    SplitTables("mos-split-tables",
+                cl::desc("Split internal arrays of multi-byte elements into "
+                         "one byte array per byte of the element"),
+                cl::init(true), cl::Hidden);
+
+namespace {
+
+// A load or store of the array, at Var * Scale elements plus Offset bytes
+// from its start.
+struct Access {
+  Instruction *I;
+  Value *Var;
+  int64_t Scale;
+  int64_t Offset;
+};
+
+class TableSplitter {
+  GlobalVariable &GV;
+  const DataLayout &DL;
+  uint64_t NumElements;
+  int64_t ElemSize;
+
+  SmallVector<Access> Accesses;
+  SmallVector<Instruction *> GEPs;
+  bool HasVariableIndex = false;
+
+public:
+  TableSplitter(GlobalVariable &GV, uint64_t NumElements, int64_t ElemSize)
+      : GV(GV), DL(GV.getDataLayout()), NumElements(NumElements),
+        ElemSize(ElemSize) {}
+
+  bool analyze() { return collectAccesses(&GV, nullptr, 0, 0); }
+  bool run();
+
+private:
+  bool collectAccesses(Value *Ptr, Value *Var, int64_t Scale, int64_t Offset);
+  bool isSupportedType(Type *Ty) const;
+};
+
+} // namespace
+
+// Loads and stores are split bytewise through an integer of the same size.
+bool TableSplitter::isSupportedType(Type *Ty) const {
+  if (!Ty->isIntegerTy() && !Ty->isPointerTy() && !Ty->isFloatingPointTy())
+    return false;
+  return DL.getTypeSizeInBits(Ty) == DL.getTypeStoreSizeInBits(Ty);
+}
+
+bool TableSplitter::collectAccesses(Value *Ptr, Value *Var, int64_t Scale,
+                                    int64_t Offset) {
+  for (User *U : Ptr->users()) {
+    if (auto *GEP = dyn_cast<GEPOperator>(U)) {
+      if (GEP->getPointerOperand() != Ptr)
+        return false;
+      unsigned BitWidth = DL.getIndexTypeSizeInBits(GEP->getType());
+      SmallMapVector<Value *, APInt, 4> VariableOffsets;
+      APInt ConstantOffset(BitWidth, 0);
+      if (!GEP->collectOffset(DL, BitWidth, VariableOffsets, ConstantOffset))
+        return false;
+
+      Value *NewVar = Var;
+      int64_t NewScale = Scale;
+      for (auto [V, Multiple] : VariableOffsets) {
+        if (NewVar || !GEP->isInBounds())
+          return false;
+        int64_t Mul = Multiple.getSExtValue();
+        // Byte GEPs scale the index by hand. Look through that, so long as
+        // the scaling can't have wrapped before the GEP extended it.
+        Value *X;
+        const APInt *C;
+        while (Mul % ElemSize &&
+               V->getType()->getScalarSizeInBits() >= BitWidth) {
+          if (match(V, m_NSWShl(m_Value(X), m_APInt(C))) &&
+              C->ult(BitWidth - 1))
+            Mul <<= C->getZExtValue();
+          else if (match(V, m_NSWMul(m_Value(X), m_APInt(C))))
+            Mul *= C->getSExtValue();
+          else
+            break;
+          V = X;
+        }
+        if (Mul % ElemSize)
+          return false;
+        NewVar = V;
+        NewScale = Mul / ElemSize;
+        HasVariableIndex = true;
+      }
+
+      if (auto *I = dyn_cast<Instruction>(GEP))
+        GEPs.push_back(I);
+      if (!collectAccesses(GEP, NewVar, NewScale,
+                           Offset + ConstantOffset.getSExtValue()))
+        return false;
+      continue;
+    }
+
+    Type *Ty;
+    if (auto *LI = dyn_cast<LoadInst>(U)) {
+      if (!LI->isSimple())
+        return false;
+      Ty = LI->getType();
+    } else if (auto *SI = dyn_cast<StoreInst>(U)) {
+      if (!SI->isSimple() || SI->getValueOperand() == Ptr)
+        return false;
+      Ty = SI->getValueOperand()->getType();
+    } else {
+      return false;
+    }
+    if (!isSupportedType(Ty))
+      return false;
+    // Constant accesses must stay within the array, since there is no longer
+    // a single object to go past the end of.
+    if (!Var) {
+      int64_t End = Offset + DL.getTypeStoreSize(Ty);
+      if (Offset < 0 || End > static_cast<int64_t>(NumElements) * ElemSize)
+        return false;
+    }
+    Accesses.push_back({cast<Instruction>(U), Var, Scale, Offset});
+  }
+  return true;
+}
+
+bool TableSplitter::run() {
+  if (!HasVariableIndex)
+    return false;
+
+  // Split the initializer bytewise. This fails for bytes of addresses, which
+  // cannot be expressed as constants.
+  LLVMContext &Ctx = GV.getContext();
+  Type *Int8Ty = Type::getInt8Ty(Ctx);
+  unsigned IdxBits = DL.getIndexTypeSizeInBits(GV.getType());
+  SmallVector<SmallVector<Constant *>> LaneInits(ElemSize);
+  for (uint64_t E = 0; E < NumElements; ++E) {
+    for (int64_t L = 0; L < ElemSize; ++L) {
+      Constant *C = ConstantFoldLoadFromConst(
+          GV.getInitializer(), Int8Ty, APInt(IdxBits, E * ElemSize + L), DL);
+      if (!C)
+        return false;
+      LaneInits[L].push_back(C);
+    }
+  }
+
+  LLVM_DEBUG(dbgs() << "Splitting " << GV.getName() << " into " << ElemSize
+                    << " tables\n");
+  ArrayType *LaneTy = ArrayType::get(Int8Ty, NumElements);
+  SmallVector<GlobalVariable *> Lanes;
+  for (int64_t L = 0; L < ElemSize; ++L) {
+    auto *Lane = new GlobalVariable(
+        *GV.getParent(), LaneTy, GV.isConstant(), GV.getLinkage(),
+        ConstantArray::get(LaneTy, LaneInits[L]), GV.getName() + "." + Twine(L),
+        &GV, GV.getThreadLocalMode(), GV.getAddressSpace());
+    Lane->setUnnamedAddr(GV.getUnnamedAddr());
+    if (GV.hasSection())
+      Lane->setSection(GV.getSection());
+    Lanes.push_back(Lane);
+  }
+
+  IntegerType *IdxTy = IntegerType::get(Ctx, IdxBits);
+  for (const Access &A : Accesses) {
+    IRBuilder<> Builder(A.I);
+    DenseMap<int64_t, Value *> Indices;
+    auto LanePtr = [&](int64_t Byte) {
+      int64_t L = mod(Byte, ElemSize);
+      int64_t E = divideFloorSigned(Byte, ElemSize);
+      Value *&Idx = Indices[E];
+      if (!Idx) {
+        Idx = ConstantInt::get(IdxTy, E);
+        if (A.Var) {
+          Value *V = Builder.CreateSExtOrTrunc(A.Var, IdxTy);
+          if (A.Scale != 1)
+            V = Builder.CreateMul(V, ConstantInt::get(IdxTy, A.Scale));
+          Idx = E ? Builder.CreateAdd(V, Idx) : V;
+        }
+      }
+      return Builder.CreateInBoundsGEP(Int8Ty, Lanes[L], Idx);
+    };
+
+    if (auto *LI = dyn_cast<LoadInst>(A.I)) {
+      Type *Ty = LI->getType();
+      unsigned Size = DL.getTypeStoreSize(Ty);
+      IntegerType *IntTy = IntegerType::get(Ctx, Size * 8);
+      Value *Val = nullptr;
+      for (unsigned B = 0; B < Size; ++B) {
+        Value *Byte = Builder.CreateZExt(
+            Builder.CreateAlignedLoad(Int8Ty, LanePtr(A.Offset + B), Align(1)),
+            IntTy);
+        if (B)
+          Byte = Builder.CreateShl(Byte, B * 8);
+        Val = Val ? Builder.CreateOr(Val, Byte) : Byte;
+      }
+      if (Ty->isPointerTy())
+        Val = Builder.CreateIntToPtr(Val, Ty);
+      else
+        Val = Builder.CreateBitCast(Val, Ty);
+      Val->takeName(LI);
+      LI->replaceAllUsesWith(Val);
+    } else {
+      auto *SI = cast<StoreInst>(A.I);
+      Value *Val = SI->getValueOperand();
+      unsigned Size = DL.getTypeStoreSize(Val->getType());
+      IntegerType *IntTy = IntegerType::get(Ctx, Size * 8);
+      if (Val->getType()->isPointerTy())
+        Val = Builder.CreatePtrToInt(Val, IntTy);
+      else
+        Val = Builder.CreateBitCast(Val, IntTy);
+      for (unsigned B = 0; B < Size; ++B) {
+        Value *Byte = B ? Builder.CreateLShr(Val, B * 8) : Val;
+        Builder.CreateAlignedStore(Builder.CreateTrunc(Byte, Int8Ty),
+                                   LanePtr(A.Offset + B), Align(1),
+                                   SI->isVolatile());
+      }
+    }
+    A.I->eraseFromParent();
+  }
+
+  // GEPs were collected outermost first.
+  for (Instruction *I : reverse(GEPs))
+    if (I->use_empty())
+      I->eraseFromParent();
+  GV.removeDeadConstantUsers();
+  assert(GV.use_empty() && "all uses of a split table should be rewritten");
+  GV.eraseFromParent();
+  return true;
+}
+
+PreservedAnalyses MOSSplitTablesPass::run(Module &M,
+                                          ModuleAnalysisManager &AM) {
+  if (!SplitTables)
+    return PreservedAnalyses::all();
+
+  bool Changed = false;
+  for (GlobalVariable &GV : make_early_inc_range(M.globals())) {
+    if (!GV.hasLocalLinkage() || !GV.hasInitializer() ||
+        GV.isExternallyInitialized() || GV.isThreadLocal() || GV.hasComdat())
+      continue;
+    // Byte tables can't carry over a larger alignment.
+    if (GV.getAlign() && *GV.getAlign() > 1)
+      continue;
+    auto *ArrTy = dyn_cast<ArrayType>(GV.getValueType());
+    if (!ArrTy || ArrTy->getNumElements() < 2 ||
+        !ArrTy->getElementType()->isSized())
+      continue;
+    TypeSize ElemSize = GV.getDataLayout().getTypeAllocSize(
+        ArrTy->getElementType());
+    if (ElemSize.isScalable() || ElemSize.getFixedValue() < 2)
+      continue;
+
+    TableSplitter Splitter(GV, ArrTy->getNumElements(),
+                           ElemSize.getFixedValue());
+    if (Splitter.analyze())
+      Changed |= Splitter.run();
+  }
+  return Changed ? PreservedAnalyses::none() : PreservedAnalyses::all();
+}
@@ -0,0 +1,274 @@
+//===-- MOSStaticArgs.cpp - MOS Static Argument Passing -------------------===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines the MOS static argument passing pass.
+//
+// Past A and X, the C calling convention passes arguments in imaginary
+// registers. A callee that makes calls of its own must then copy each such
+// argument to its frame to keep it alive, and a callee with a static stack
+// frame could just as well have received it there.
+//
+// Only one invocation of a nonreentrant function can be active at a time, so
+// for those whose every caller is visible and direct, this pass removes the
+// non-pointer arguments that would arrive in imaginary registers or on the
+// soft stack. Callers store them into a block of memory owned by the callee
+// instead, and the callee loads them from there wherever needed. The loads
+// are invariant, since nothing else can write the block until the callee
+// returns. MOSStaticStackAlloc later places the block right after the
+// callee's static stack frame, unless zero page allocation has taken it
+// first.
+//
+// Pointer arguments stay in registers, since they are usually dereferenced
+// through the zero page. Leaf functions are left alone, since they have
+// nothing to keep their arguments alive across.
+//
+//===----------------------------------------------------------------------===//
+
+#include "MOSStaticArgs.h"
+
+#include "MOS.h"
+#include "MOSSubtarget.h"
+
+#include "llvm/CodeGen/TargetPassConfig.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Metadata.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Target/TargetMachine.h"
+
+#define DEBUG_TYPE "mos-static-args"
+
+using namespace llvm;
+
+static cl::opt<bool>
+    StaticArgs("mos-static-args",
+               cl::desc("Pass arguments of nonreentrant functions in static "
+                        "memory"),
+               cl::init(true), cl::Hidden);
+
+// The metadata linking a function to its static argument block.
+static constexpr const char *StaticArgsMD = "mos.static_args";
+
+namespace {
+
+struct MOSStaticArgs : public ModulePass {
+  static char ID; // Pass identification, replacement for typeid
+
+  MOSStaticArgs() : ModulePass(ID) {
+    initializeMOSStaticArgsPass(*PassRegistry::getPassRegistry());
+  }
+
+  bool runOnModule(Module &M) override;
+  void getAnalysisUsage(AnalysisUsage &AU) const override;
+
+private:
+  bool isCandidate(const Function &F, const TargetMachine &TM) const;
+  void transform(Function &F, ArrayRef<unsigned> Static);
+};
+
+} // namespace
+
+GlobalVariable *mos::getStaticArgs(const Function &F) {
+  const MDNode *MD = F.getMetadata(StaticArgsMD);
+  if (!MD || !MD->getNumOperands())
+    return nullptr;
+  // Zero page allocation replaces the global with an address space cast of
+  // itself, which no longer matches here.
+  return mdconst::dyn_extract_or_null<GlobalVariable>(MD->getOperand(0));
+}
+
+static bool makesCalls(const Function &F) {
+  for (const Instruction &I : instructions(F)) {
+    const auto *CB = dyn_cast<CallBase>(&I);
+    if (CB && !isa<IntrinsicInst>(CB) && !CB->isInlineAsm())
+      return true;
+  }
+  return false;
+}
+
+bool MOSStaticArgs::isCandidate(const Function &F,
+                                const TargetMachine &TM) const {
+  if (F.isDeclaration() || !F.hasLocalLinkage() || F.isVarArg() ||
+      F.getCallingConv() != CallingConv::C ||
+      !F.hasFnAttribute("nonreentrant") || F.hasOptNone() ||
+      F.hasFnAttribute("interrupt") ||
+      F.hasFnAttribute("interrupt-norecurse") || F.arg_empty())
+    return false;
+  if (!TM.getSubtarget<MOSSubtarget>(F).staticStack())
+    return false;
+
+  for (const Argument &A : F.args())
+    if (A.hasByValAttr() || A.hasInAllocaAttr() || A.hasPreallocatedAttr() ||
+        A.hasStructRetAttr() || A.hasNestAttr() || A.hasSwiftErrorAttr())
+      return false;
+
+  // All uses must be direct calls, so that every caller can be rewritten.
+  for (const Use &U : F.uses()) {
+    const auto *CB = dyn_cast<CallBase>(U.getUser());
+    if (!CB || !CB->isCallee(&U) || isa<CallBrInst>(CB) ||
+        CB->getFunctionType() != F.getFunctionType() ||
+        CB->isMustTailCall() || CB->hasOperandBundles())
+      return false;
+  }
+  return makesCalls(F);
+}
+
+void MOSStaticArgs::transform(Function &F, ArrayRef<unsigned> Static) {
+  Module &M = *F.getParent();
+  LLVMContext &Ctx = M.getContext();
+  const DataLayout &DL = M.getDataLayout();
+  Type *Int8Ty = Type::getInt8Ty(Ctx);
+
+  SmallVector<uint64_t> Offsets(F.arg_size());
+  uint64_t Size = 0;
+  for (unsigned ArgNo : Static) {
+    Offsets[ArgNo] = Size;
+    Size += DL.getTypeStoreSize(F.getArg(ArgNo)->getType());
+  }
+
+  auto *Ty = ArrayType::get(Int8Ty, Size);
+  auto *GV = new GlobalVariable(M, Ty, /*isConstant=*/false,
+                                GlobalValue::PrivateLinkage,
+                                UndefValue::get(Ty), F.getName() + "_sarg");
+  LLVM_DEBUG(dbgs() << "Passing " << Static.size() << " arguments of "
+                    << F.getName() << " in " << *GV << "\n");
+  auto ArgPtr = [&](IRBuilder<> &Builder, unsigned ArgNo) -> Value * {
+    if (!Offsets[ArgNo])
+      return GV;
+    return Builder.CreateConstInBoundsGEP1_64(Int8Ty, GV, Offsets[ArgNo]);
+  };
+
+  // Load the static arguments at the callee's entry.
+  BasicBlock &Entry = F.getEntryBlock();
+  IRBuilder<> Builder(&Entry, Entry.getFirstInsertionPt());
+  MDNode *Invariant = MDNode::get(Ctx, {});
+  for (unsigned ArgNo : Static) {
+    Argument *A = F.getArg(ArgNo);
+    LoadInst *Load =
+        Builder.CreateAlignedLoad(A->getType(), ArgPtr(Builder, ArgNo),
+                                  Align(1), A->getName());
+    Load->setMetadata(LLVMContext::MD_invariant_load, Invariant);
+    A->replaceAllUsesWith(Load);
+  }
+
+  SmallVector<Type *> Params;
+  SmallVector<unsigned> Kept;
+  for (const Argument &A : F.args()) {
+    if (is_contained(Static, A.getArgNo()))
+      continue;
+    Params.push_back(A.getType());
+    Kept.push_back(A.getArgNo());
+  }
+  auto KeepAttrs = [&](const AttributeList &PAL) {
+    SmallVector<AttributeSet> ArgAttrs;
+    for (unsigned ArgNo : Kept)
+      ArgAttrs.push_back(PAL.getParamAttrs(ArgNo));
+    return AttributeList::get(Ctx, PAL.getFnAttrs(), PAL.getRetAttrs(),
+                              ArgAttrs);
+  };
+
+  auto *NFTy = FunctionType::get(F.getReturnType(), Params, /*isVarArg=*/false);
+  Function *NF = Function::Create(NFTy, F.getLinkage(), F.getAddressSpace());
+  NF->copyAttributesFrom(&F);
+  NF->setAttributes(KeepAttrs(F.getAttributes()));
+  NF->copyMetadata(&F, 0);
+  M.getFunctionList().insert(F.getIterator(), NF);
+  NF->takeName(&F);
+  NF->splice(NF->begin(), &F);
+  for (auto [ArgNo, NA] : zip(Kept, NF->args())) {
+    F.getArg(ArgNo)->replaceAllUsesWith(&NA);
+    NA.takeName(F.getArg(ArgNo));
+  }
+  NF->setMetadata(StaticArgsMD,
+                  MDNode::get(Ctx, ValueAsMetadata::get(GV)));
+
+  // Have each caller store the static arguments right before the call.
+  for (Use &U : make_early_inc_range(F.uses())) {
+    auto *CB = cast<CallBase>(U.getUser());
+    IRBuilder<> Builder(CB);
+    SmallVector<Value *> Args;
+    for (unsigned ArgNo : Static)
+      Builder.CreateAlignedStore(CB->getArgOperand(ArgNo),
+                                 ArgPtr(Builder, ArgNo), Align(1));
+    for (unsigned ArgNo : Kept)
+      Args.push_back(CB->getArgOperand(ArgNo));
+
+    CallBase *NCB;
+    if (auto *II = dyn_cast<InvokeInst>(CB)) {
+      NCB = Builder.CreateInvoke(NF, II->getNormalDest(), II->getUnwindDest(),
+                                 Args);
+    } else {
+      auto *CI = Builder.CreateCall(NF, Args);
+      CI->setTailCallKind(cast<CallInst>(CB)->getTailCallKind());
+      NCB = CI;
+    }
+    NCB->setCallingConv(CB->getCallingConv());
+    NCB->setAttributes(KeepAttrs(CB->getAttributes()));
+    NCB->copyMetadata(*CB);
+    NCB->takeName(CB);
+    CB->replaceAllUsesWith(NCB);
+    CB->eraseFromParent();
+  }
+  F.eraseFromParent();
+}
+
+bool MOSStaticArgs::runOnModule(Module &M) {
+  if (!StaticArgs)
+    return false;
+  const TargetMachine &TM =
+      getAnalysis<TargetPassConfig>().getTM<TargetMachine>();
+  const DataLayout &DL = M.getDataLayout();
+
+  SmallVector<std::pair<Function *, SmallVector<unsigned>>> Work;
+  for (Function &F : M) {
+    if (!isCandidate(F, TM))
+      continue;
+    // Leave the arguments that CC_MOS would place in A and X, as well as
+    // pointers, in registers.
+    SmallVector<unsigned> Static;
+    uint64_t Bytes = 0;
+    for (const Argument &A : F.args()) {
+      Type *T = A.getType();
+      if (T->isPointerTy() || (!T->isIntegerTy() && !T->isFloatingPointTy()))
+        continue;
+      uint64_t Size = DL.getTypeStoreSize(T);
+      if (!Size)
+        continue;
+      Bytes += Size;
+      if (Bytes > 2)
+        Static.push_back(A.getArgNo());
+    }
+    if (!Static.empty())
+      Work.emplace_back(&F, std::move(Static));
+  }
+
+  for (auto &[F, Static] : Work)
+    transform(*F, Static);
+  return !Work.empty();
+}
+
+void MOSStaticArgs::getAnalysisUsage(AnalysisUsage &AU) const {
+  AU.addRequired<TargetPassConfig>();
+}
+
+char MOSStaticArgs::ID = 0;
+
+INITIALIZE_PASS_BEGIN(MOSStaticArgs, DEBUG_TYPE,
+                      "Pass arguments of nonreentrant functions statically",
+                      false, false)
+INITIALIZE_PASS_DEPENDENCY(TargetPassConfig)
+INITIALIZE_PASS_END(MOSStaticArgs, DEBUG_TYPE,
+                    "Pass arguments of nonreentrant functions statically",
+                    false, false)
+
+ModulePass *llvm::createMOSStaticArgsPass() { return new MOSStaticArgs(); }
@@ -0,0 +1,34 @@
+//===-- MOSStaticArgs.h - MOS Static Argument Passing -----------*- C++ -*-===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares the MOS static argument passing pass.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_LIB_TARGET_MOS_MOSSTATICARGS_H
+#define LLVM_LIB_TARGET_MOS_MOSSTATICARGS_H
+
+#include "llvm/Pass.h"
+
+namespace llvm {
+
+class Function;
+class GlobalVariable;
+
+ModulePass *createMOSStaticArgsPass();
+
+namespace mos {
+
+// Returns the global that the static arguments of F are passed in, if it
+// still lies outside the zero page.
+GlobalVariable *getStaticArgs(const Function &F);
+
+} // namespace mos
+} // namespace llvm
+
+#endif // not LLVM_LIB_TARGET_MOS_MOSSTATICARGS_H
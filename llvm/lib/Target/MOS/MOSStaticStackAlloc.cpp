@@ -13,6 +13,14 @@
 // a global variable for the static stack, then the target-specific indices in a
 // function with references to the corresponding offset within that global.
 //
+// Regions of functions that can never be live at the same time share memory.
+// The offsets are found by first-fit coloring of an interference graph over the
+// call graph's SCCs.
+//
+// The static arguments of a function, which its callers write before calling
+// it, are placed right after its frame. This is safe because a caller's region
+// never overlaps its callees'.
+//
 //===----------------------------------------------------------------------===//
 
 #include "MOSStaticStackAlloc.h"
@@ -22,10 +30,14 @@
 #include "MOSCallGraphUtils.h"
 #include "MOSFrameLowering.h"
 #include "MOSMachineFunctionInfo.h"
+#include "MOSStaticArgs.h"
 #include "MOSSubtarget.h"
 
+#include "llvm/ADT/BitVector.h"
 #include "llvm/ADT/SCCIterator.h"
+#include "llvm/ADT/Statistic.h"
 #include "llvm/Analysis/CallGraph.h"
+#include "llvm/Analysis/OptimizationRemarkEmitter.h"
 #include "llvm/CodeGen/MachineBasicBlock.h"
 #include "llvm/CodeGen/MachineFrameInfo.h"
 #include "llvm/CodeGen/MachineFunction.h"
@@ -36,11 +48,27 @@
 #include "llvm/IR/Module.h"
 #include "llvm/PassRegistry.h"
 #include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/TimeProfiler.h"
 
 #define DEBUG_TYPE "mos-static-stack-alloc"
 
+STATISTIC(NumStaticFrames, "Number of static stack frames placed");
+STATISTIC(NumStaticFrameBytes, "Number of bytes of static stack frames");
+STATISTIC(NumStaticArgs, "Number of static argument regions folded");
+
 using namespace llvm;
 
+// Returns the size of the static region of F: its frame, then its static
+// arguments.
+static uint64_t staticRegionSize(const Function &F, const MachineFunction &MF) {
+  const MOSFrameLowering &TFL =
+      *MF.getSubtarget<MOSSubtarget>().getFrameLowering();
+  uint64_t Size = TFL.staticSize(MF.getFrameInfo());
+  if (const GlobalVariable *Args = mos::getStaticArgs(F))
+    Size += F.getDataLayout().getTypeAllocSize(Args->getValueType());
+  return Size;
+}
+
 namespace {
 
 class MOSStaticStackAlloc : public ModulePass {
@@ -62,21 +90,28 @@ void MOSStaticStackAlloc::getAnalysisUsage(AnalysisUsage &AU) const {
 }
 
 bool MOSStaticStackAlloc::runOnModule(Module &M) {
+  TimeTraceScope Scope("MOSStaticStackAlloc");
   auto &MMI = getAnalysis<MachineModuleInfoWrapperPass>().getMMI();
   auto &CG = getAnalysis<CallGraphWrapperPass>().getCallGraph();
 
   mos::addLibcallEdges(CG, MMI);
+  mos::resolveIndirectCalls(CG);
   mos::addExternalEdges(CG);
 
   // Extract the list of strongly-connected components from the call graph, and
-  // make a note of which SCC contains each node.
+  // make a note of which SCC contains each node. SCCs are produced callees
+  // first, so callers always have higher indices than their callees.
   DenseMap<CallGraphNode *, uint64_t> SCCID;
   struct SCC {
     SmallVector<CallGraphNode *, 1> Nodes;
+    SmallVector<unsigned, 4> Callers;
+    // The contexts that this SCC may run in. Zero is the regular context; each
+    // other value is an interrupt-norecurse entry point or overlay group.
+    SmallVector<unsigned, 1> Contexts;
     uint64_t Offset = 0;
+    uint64_t Size = 0;
   };
   std::vector<SCC> SCCs;
-  std::vector<uint64_t> SCCOffsets;
   for (auto I = scc_begin(&CG), E = scc_end(&CG); I != E; ++I) {
     SCCs.emplace_back();
     for (CallGraphNode *CGN : *I) {
@@ -85,112 +120,128 @@ bool MOSStaticStackAlloc::runOnModule(Module &M) {
     }
   }
 
-  // For each SCC, determine the set of calling SCCs, that is, those containing
-  // at least one node that calls at least one node in the SCC. The calling SCCs
-  // must be placed higher on the static stack than the called SCC; otherwise,
-  // their stack would conflict.
-  std::map<SCC *, SmallPtrSet<SCC *, 4>> CallerSCCs;
-  for (const auto &KV : enumerate(SCCs)) {
-    auto &CallerSCC = KV.value();
-    for (CallGraphNode *CGN : CallerSCC.Nodes) {
-      for (const auto &KV : *CGN) {
+  for (auto [Idx, Comp] : enumerate(SCCs)) {
+    for (CallGraphNode *Node : Comp.Nodes) {
+      for (const auto &KV : *Node) {
         SCC &CalleeSCC = SCCs[SCCID[KV.second]];
-        if (&CalleeSCC != &CallerSCC)
-          CallerSCCs[&CalleeSCC].insert(&CallerSCC);
+        if (&CalleeSCC != &Comp && !is_contained(CalleeSCC.Callers, Idx))
+          CalleeSCC.Callers.push_back(Idx);
       }
+      Function *F = Node->getFunction();
+      if (!F)
+        continue;
+      MachineFunction *MF = MMI.getMachineFunction(*F);
+      if (!MF)
+        continue;
+      Comp.Size += staticRegionSize(*F, *MF);
     }
   }
 
-  // Collect the set of SCCs that have no callers. There must always be at least
-  // one, since the SCC graph is acyclic.
-  std::vector<SCC *> RootSCCs;
-  for (SCC &SCC : SCCs)
-    if (CallerSCCs.find(&SCC) == CallerSCCs.end())
-      RootSCCs.push_back(&SCC);
+  // Determine the contexts and the transitive callers of each SCC. Two SCCs
+  // can be live at the same time if one transitively calls the other, or if one
+  // can interrupt the other. Otherwise, their static stack regions may overlap.
+  const auto IsInterruptNorecurse = [](const SCC &Comp) {
+    return Comp.Nodes.size() == 1 && Comp.Nodes.front()->getFunction() &&
+           Comp.Nodes.front()->getFunction()->hasFnAttribute(
+               "interrupt-norecurse");
+  };
+  DenseMap<unsigned, unsigned> GroupContexts;
+  unsigned NumContexts = 1;
+  std::vector<BitVector> Ancestors(SCCs.size(), BitVector(SCCs.size()));
+  for (size_t Idx = SCCs.size(); Idx--;) {
+    SCC &Comp = SCCs[Idx];
+    for (unsigned Caller : Comp.Callers) {
+      Ancestors[Idx] |= Ancestors[Caller];
+      Ancestors[Idx].set(Caller);
+    }
 
-  // Handle each root discovered in turn.
-  uint64_t StackSize = 0;
-  std::vector<SCC *> InterruptNorecurseSCCs;
-  bool ToInterruptNorecurse = false;
-  while (!RootSCCs.empty() || !InterruptNorecurseSCCs.empty()) {
-    // If only INR's are left, then handle one. This will cause all its
-    // descendants to be scheduled. Start its offset at the end of the current
-    // stack, since it and its descendants might interrupt anything seen so far.
-    if (RootSCCs.empty()) {
-      ToInterruptNorecurse = true;
-      RootSCCs.push_back(InterruptNorecurseSCCs.back());
-      RootSCCs.back()->Offset = StackSize;
-      InterruptNorecurseSCCs.pop_back();
+    if (IsInterruptNorecurse(Comp)) {
+      // Only the hardware calls an interrupt; the edge from the external node
+      // does not place it in the regular context.
+      unsigned Group =
+          mos::getInterruptOverlayGroup(*Comp.Nodes.front()->getFunction());
+      if (!Group)
+        Comp.Contexts.push_back(NumContexts++);
+      else {
+        auto It = GroupContexts.try_emplace(Group, NumContexts).first;
+        if (It->second == NumContexts)
+          ++NumContexts;
+        Comp.Contexts.push_back(It->second);
+      }
       continue;
     }
+    if (Comp.Callers.empty())
+      Comp.Contexts.push_back(0);
+    for (unsigned Caller : Comp.Callers)
+      for (unsigned Context : SCCs[Caller].Contexts)
+        if (!is_contained(Comp.Contexts, Context))
+          Comp.Contexts.push_back(Context);
+  }
 
-    // For each reached root, it's certain that all calling SCCs have already
-    // been assigned offsets. Accordingly, the current offset for this SCC can
-    // be taken as its final position in the static stack.
-    SCC &RootSCC = *RootSCCs.back();
-    RootSCCs.pop_back();
-
-    // Defer interrupt-norecurse SCCs and their descendants until later, since
-    // they conflict with all other nodes.
-    if (!ToInterruptNorecurse && RootSCC.Nodes.size() == 1 &&
-        RootSCC.Nodes.front()->getFunction() &&
-        RootSCC.Nodes.front()->getFunction()->hasFnAttribute(
-            "interrupt-norecurse")) {
-      InterruptNorecurseSCCs.push_back(&RootSCC);
+  const auto Interferes = [&](size_t A, size_t B) {
+    if (Ancestors[A].test(B) || Ancestors[B].test(A))
+      return true;
+    // An interrupt may preempt code running in any other context.
+    for (unsigned CA : SCCs[A].Contexts)
+      for (unsigned CB : SCCs[B].Contexts)
+        if (CA != CB && (CA || CB))
+          return true;
+    return false;
+  };
+
+  // Color the interference graph first-fit, visiting callers before callees.
+  // Each SCC takes the lowest offset that overlaps no interfering SCC placed so
+  // far.
+  uint64_t StackSize = 0;
+  std::vector<size_t> Placed;
+  for (size_t Idx = SCCs.size(); Idx--;) {
+    SCC &Comp = SCCs[Idx];
+    if (!Comp.Size)
       continue;
+
+    SmallVector<std::pair<uint64_t, uint64_t>> Busy;
+    for (size_t Other : Placed) {
+      const SCC &O = SCCs[Other];
+      if (Interferes(Idx, Other))
+        Busy.push_back({O.Offset, O.Offset + O.Size});
     }
+    sort(Busy);
+
+    uint64_t Offset = 0;
+    for (const auto &[Begin, End] : Busy) {
+      if (Offset + Comp.Size <= Begin)
+        break;
+      Offset = std::max(Offset, End);
+    }
+    Comp.Offset = Offset;
+    Placed.push_back(Idx);
+    StackSize = std::max(StackSize, Offset + Comp.Size);
 
     LLVM_DEBUG({
       dbgs() << "\nSCC:\n";
-      for (CallGraphNode *CGN : RootSCC.Nodes)
+      for (CallGraphNode *CGN : Comp.Nodes)
         CGN->dump();
-      dbgs() << "Offset: " << RootSCC.Offset << "\n";
+      dbgs() << "Offset: " << Comp.Offset << "\n";
+      dbgs() << "Size: " << Comp.Size << "\n";
     });
+  }
 
-    // Any callee SCCs need to be placed below the end of this SCC's static
-    // stack region. Note that this is true even if the SCC is internally
-    // recursive; the SCCs above and below may not be.
-    const auto &GetStaticStackSize = [&]() -> uint64_t {
-      size_t Size = 0;
-      for (CallGraphNode *Node : RootSCC.Nodes) {
-        Function *F = Node->getFunction();
-        if (!F)
-          continue;
-        MachineFunction *MF = MMI.getMachineFunction(*F);
-        if (!MF)
-          continue;
-        const MOSFrameLowering &TFL =
-            *MF->getSubtarget<MOSSubtarget>().getFrameLowering();
-        Size += TFL.staticSize(MF->getFrameInfo());
-      }
-      return Size;
-    };
-    uint64_t Size = GetStaticStackSize();
-    LLVM_DEBUG(dbgs() << "Size: " << Size << "\n");
-
-    // Determine the new offset to propagate to callee SCCs, and note if this
-    // increased the overall stack size.
-    uint64_t Offset = RootSCC.Offset + Size;
-    StackSize = std::max(StackSize, Offset);
-
-    // For each callee SCC, propagate the offset and ensure that each occupies a
-    // position in the static stack below the end of the current SCC.
-    for (CallGraphNode *CGN : RootSCC.Nodes) {
-      for (const auto &KV : *CGN) {
-        SCC &CalleeSCC = SCCs[SCCID[KV.second]];
-        if (&CalleeSCC != &RootSCC &&
-            CallerSCCs[&CalleeSCC].contains(&RootSCC)) {
-          CalleeSCC.Offset = std::max(CalleeSCC.Offset, Offset);
-          CallerSCCs[&CalleeSCC].erase(&RootSCC);
-          // If there are no longer any caller SCCs for a SCC, then that SCC is
-          // a newly-discovered root, so schedule it for placement. Since the
-          // SCC graph is acyclic, every SCC must eventually become a root via
-          // this process.
-          if (CallerSCCs[&CalleeSCC].empty())
-            RootSCCs.push_back(&CalleeSCC);
-        }
-      }
-    }
+  // Report the peak static stack usage of each entry point.
+  for (const auto &KV : *CG.getExternalCallingNode()) {
+    Function *F = KV.second->getFunction();
+    if (!F || F->isDeclaration())
+      continue;
+    OptimizationRemarkEmitter ORE(F);
+    ORE.emit([&]() {
+      size_t EntryIdx = SCCID[KV.second];
+      uint64_t Peak = 0;
+      for (auto [Idx, Comp] : enumerate(SCCs))
+        if (Comp.Size && (Idx == EntryIdx || Ancestors[Idx].test(EntryIdx)))
+          Peak = std::max(Peak, Comp.Offset + Comp.Size);
+      return OptimizationRemarkAnalysis(DEBUG_TYPE, "StaticStackPeak", F)
+             << "static stack extends to " << ore::NV("Bytes", Peak)
+             << " bytes while running this entry point";
+    });
   }
 
   if (!StackSize)
@@ -204,7 +255,10 @@ bool MOSStaticStackAlloc::runOnModule(Module &M) {
   LLVM_DEBUG(dbgs() << *Stack << "\n");
 
   // Create an alias for each SCC's static stack region and rewrite instructions
-  // to reference it.
+  // to reference it. The aliases are local symbols, rather than private ones,
+  // so that each function's frame and its size show up in the symbol table for
+  // the linker's memory report.
+  DenseMap<const GlobalValue *, std::pair<GlobalAlias *, uint64_t>> ArgsMap;
   for (const SCC &SCC : SCCs) {
     size_t Offset = SCC.Offset;
     for (CallGraphNode *Node : SCC.Nodes) {
@@ -214,9 +268,7 @@ bool MOSStaticStackAlloc::runOnModule(Module &M) {
       MachineFunction *MF = MMI.getMachineFunction(*F);
       if (!MF)
         continue;
-      const MOSFrameLowering &TFL =
-          *MF->getSubtarget<MOSSubtarget>().getFrameLowering();
-      uint64_t Size = TFL.staticSize(MF->getFrameInfo());
+      uint64_t Size = staticRegionSize(*F, *MF);
       if (!Size)
         continue;
 
@@ -232,12 +284,28 @@ bool MOSStaticStackAlloc::runOnModule(Module &M) {
       }
       Offset += Size;
       auto *Alias = GlobalAlias::create(
-          Typ, Stack->getAddressSpace(), Stack->getLinkage(),
+          Typ, Stack->getAddressSpace(), GlobalValue::InternalLinkage,
           Twine(F->getName()) + "_sstk", Aliasee, Stack->getParent());
       LLVM_DEBUG(dbgs() << *Alias << "\n");
+      ++NumStaticFrames;
+      NumStaticFrameBytes += Size;
+      OptimizationRemarkEmitter ORE(F);
+      ORE.emit([&]() {
+        return OptimizationRemarkAnalysis(DEBUG_TYPE, "StaticFrame", F)
+               << "static region of " << ore::NV("Bytes", Size)
+               << " bytes placed at offset "
+               << ore::NV("Offset", uint64_t(Offset - Size))
+               << " of the static stack";
+      });
 
       MOSFunctionInfo &MFI = *MF->getInfo<MOSFunctionInfo>();
       MFI.StaticStackValue = Alias;
+      if (GlobalVariable *Args = mos::getStaticArgs(*F)) {
+        const MOSFrameLowering &TFL =
+            *MF->getSubtarget<MOSSubtarget>().getFrameLowering();
+        ArgsMap[Args] = {Alias, TFL.staticSize(MF->getFrameInfo())};
+        ++NumStaticArgs;
+      }
 
       for (MachineBasicBlock &MBB : *MF) {
         for (MachineInstr &MI : MBB) {
@@ -250,6 +318,37 @@ bool MOSStaticStackAlloc::runOnModule(Module &M) {
       }
     }
   }
+
+  if (ArgsMap.empty())
+    return true;
+
+  // Callers reference static arguments too, so look for them everywhere.
+  for (Function &F : M) {
+    MachineFunction *MF = MMI.getMachineFunction(F);
+    if (!MF)
+      continue;
+    for (MachineBasicBlock &MBB : *MF) {
+      for (MachineInstr &MI : MBB) {
+        for (MachineOperand &MO : MI.operands()) {
+          if (!MO.isGlobal())
+            continue;
+          auto It = ArgsMap.find(MO.getGlobal());
+          if (It == ArgsMap.end())
+            continue;
+          auto [Alias, Offset] = It->second;
+          MO.ChangeToGA(Alias, Offset + MO.getOffset(), MO.getTargetFlags());
+        }
+      }
+    }
+  }
+  for (auto &[GV, Loc] : ArgsMap) {
+    auto *Args = const_cast<GlobalVariable *>(cast<GlobalVariable>(GV));
+    auto [Alias, Offset] = Loc;
+    Args->replaceAllUsesWith(ConstantExpr::getInBoundsGetElementPtr(
+        Type::getInt8Ty(M.getContext()), Alias,
+        ConstantInt::get(Type::getInt16Ty(M.getContext()), Offset)));
+    Args->eraseFromParent();
+  }
   return true;
 }
 
@@ -59,7 +59,7 @@ public:
     return &CallLoweringInfo;
   }
 
-  const LegalizerInfo *getLegalizerInfo() const override { return &Legalizer; }
+  const LegalizerInfo *getLegalizerInfo() const override { return Legalizer; }
 
   const RegisterBankInfo *getRegBankInfo() const override {
     return &RegBankInfo;
@@ -98,6 +98,7 @@ public:
 
   bool has6502() const { return Has6502Insns; }
   bool has6502X() const { return Has6502XInsns; }
+  bool has6502BCD() const { return Has6502BCDInsns; }
   bool has65C02() const { return Has65C02Insns; }
   bool hasR65C02() const { return HasR65C02Insns; }
   bool hasW65C02() const { return HasW65C02Insns; }
@@ -114,6 +115,8 @@ public:
   bool hasBRA() const { return has65C02() || has65DTV02() || hasSPC700(); }
   bool hasJMPIdxIndir() const { return has65C02() || hasSPC700(); }
   bool staticStack() const { return StaticStack; }
+  bool hasW65816Native() const { return W65816Native; }
+  bool hasMEGA65Math() const { return HasMEGA65Math; }
 
   bool hasW65816Or65EL02() const { return HasW65816Insns || Has65EL02Insns; }
 
@@ -140,6 +143,10 @@ private:
 
   bool LongRegisterNames = false;
   bool StaticStack = false;
+  bool Int8 = false;
+  bool W65816Native = false;
+  bool HasMEGA65Math = false;
+  bool DTVSkipCycles = false;
 
   // Dummy member, used by FeatureSet's. We cannot have a SubtargetFeature with
   // no variable, so we instead bind pseudo features to this variable.
@@ -150,7 +157,7 @@ private:
   MOSFrameLowering FrameLowering;
   MOSTargetLowering TLInfo;
   MOSCallLowering CallLoweringInfo;
-  MOSLegalizerInfo Legalizer;
+  const MOSLegalizerInfo *Legalizer;
   MOSRegisterBankInfo RegBankInfo;
   std::unique_ptr<InstructionSelector> InstSelector;
   MOSInlineAsmLowering InlineAsmLoweringInfo;
@@ -0,0 +1,236 @@
+//===-- MOSSwitchTables.cpp - MOS Switch Lookup Tables --------------------===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines the MOS switch lookup table pass.
+//
+// Switches whose cases span at most a page of values but lead to only a few
+// destinations, like the character class tests of a tokenizer, are lowered
+// generically to trees of compares or to bit tests. Both are costly on the
+// 6502: each compare of a 16-bit value is a chain of two, and a bit test needs
+// a variable shift. This pass instead classifies the value with a byte table,
+// indexed by its offset from the lowest case with one LDA abs,X, and switches
+// on the class read. Class zero is the default, and the others are dense and
+// few, so that switch lowers to a CMP or two. A byte per value is used rather
+// than a bit, since picking out a bit would need a shift.
+//
+// The transformation is only made when MOSInstrCost prefers it to a binary
+// tree of compares over the switch's clusters of cases.
+//
+//===----------------------------------------------------------------------===//
+
+#include "MOSSwitchTables.h"
+
+#include "MCTargetDesc/MOSMCTargetDesc.h"
+#include "MOS.h"
+#include "MOSInstrCost.h"
+#include "MOSSubtarget.h"
+
+#include "llvm/ADT/MapVector.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SetVector.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/CodeGen/TargetPassConfig.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Target/TargetMachine.h"
+
+#define DEBUG_TYPE "mos-switch-tables"
+
+using namespace llvm;
+
+STATISTIC(NumSwitchTables, "Number of switches lowered to lookup tables");
+
+// More destinations than this would need a jump table to dispatch the class.
+static constexpr unsigned MaxTableDests = 3;
+
+namespace {
+
+struct MOSSwitchTables : public FunctionPass {
+  static char ID; // Pass identification, replacement for typeid
+
+  MOSSwitchTables() : FunctionPass(ID) {
+    initializeMOSSwitchTablesPass(*PassRegistry::getPassRegistry());
+  }
+
+  bool runOnFunction(Function &F) override;
+  void getAnalysisUsage(AnalysisUsage &AU) const override;
+};
+
+} // namespace
+
+// Returns whether the switch is cheaper lowered through a table of Range
+// bytes.
+static bool isTableProfitable(const SwitchInst &SI, uint64_t Range,
+                              unsigned NumDests, bool RangeCheck,
+                              const MOSSubtarget &STI) {
+  auto Get = [&](unsigned Opcode) { return MOSInstrCost::get(Opcode, STI); };
+  unsigned Bytes = SI.getCondition()->getType()->getIntegerBitWidth() / 8;
+
+  // Clusters of consecutive cases with the same destination take one compare
+  // if a single value, and two if a range. A balanced tree of them executes
+  // about log2 of them.
+  SmallVector<std::pair<APInt, const BasicBlock *>> Cases;
+  for (const auto &Case : SI.cases())
+    Cases.push_back({Case.getCaseValue()->getValue(), Case.getCaseSuccessor()});
+  llvm::sort(Cases, [](const auto &A, const auto &B) {
+    return A.first.ult(B.first);
+  });
+  unsigned Compares = 0;
+  for (size_t I = 0, E = Cases.size(); I != E;) {
+    size_t J = I + 1;
+    while (J != E && Cases[J].second == Cases[I].second &&
+           Cases[J].first == Cases[J - 1].first + 1)
+      ++J;
+    Compares += J - I == 1 ? 1 : 2;
+    I = J;
+  }
+  MOSInstrCost Compare =
+      (Get(MOS::CMP_Immediate) + Get(MOS::BNE_Relative)) * Bytes;
+  MOSInstrCost Tree(Compare.getBytes() * Compares,
+                    Compare.getCycles() * Log2_32_Ceil(Compares + 1));
+
+  // The table lookup: an offset and range check if needed, an index transfer,
+  // and LDA abs,X, which also tests for class zero. Each other class but the
+  // last then takes a compare.
+  MOSInstrCost Table(Range, 0);
+  if (RangeCheck)
+    Table += (Get(MOS::SBC_Immediate) + Get(MOS::CMP_Immediate)) * Bytes +
+             Get(MOS::BCS_Relative);
+  Table += Get(MOS::TAX_Implied) + Get(MOS::LDA_AbsoluteX) +
+           Get(MOS::BEQ_Relative);
+  Table += (Get(MOS::CMP_Immediate) + Get(MOS::BEQ_Relative)) * (NumDests - 1);
+
+  MOSInstrCost::Mode Mode = MOSInstrCost::getModeFor(*SI.getFunction());
+  return Table.value(Mode) < Tree.value(Mode);
+}
+
+static bool lowerToTable(SwitchInst &SI, const MOSSubtarget &STI) {
+  auto *Ty = dyn_cast<IntegerType>(SI.getCondition()->getType());
+  if (!Ty || (Ty->getBitWidth() != 8 && Ty->getBitWidth() != 16) ||
+      SI.getNumCases() < 2)
+    return false;
+
+  BasicBlock *Default = SI.getDefaultDest();
+  APInt Low = SI.case_begin()->getCaseValue()->getValue();
+  APInt High = Low;
+  // The classes of the destinations, in order of appearance.
+  MapVector<BasicBlock *, unsigned> Classes;
+  for (const auto &Case : SI.cases()) {
+    const APInt &Val = Case.getCaseValue()->getValue();
+    if (Val.ult(Low))
+      Low = Val;
+    if (Val.ugt(High))
+      High = Val;
+    if (Case.getCaseSuccessor() != Default)
+      Classes.insert({Case.getCaseSuccessor(), Classes.size() + 1});
+  }
+  uint64_t Range = (High - Low).getZExtValue() + 1;
+  if (Range > 256 || Classes.empty() || Classes.size() > MaxTableDests)
+    return false;
+  bool RangeCheck = !SI.defaultDestUnreachable() &&
+                    Range < (UINT64_C(1) << Ty->getBitWidth());
+  if (!isTableProfitable(SI, Range, Classes.size(), RangeCheck, STI))
+    return false;
+
+  LLVMContext &Ctx = SI.getContext();
+  Type *I8 = Type::getInt8Ty(Ctx);
+  SmallVector<uint8_t> Contents(Range);
+  for (const auto &Case : SI.cases())
+    if (Case.getCaseSuccessor() != Default)
+      Contents[(Case.getCaseValue()->getValue() - Low).getZExtValue()] =
+          Classes.lookup(Case.getCaseSuccessor());
+  Module &M = *SI.getModule();
+  auto *Table = new GlobalVariable(
+      M, ArrayType::get(I8, Range), /*isConstant=*/true,
+      GlobalValue::PrivateLinkage, ConstantDataArray::get(Ctx, Contents),
+      "switch.table." + SI.getFunction()->getName());
+  Table->setUnnamedAddr(GlobalValue::UnnamedAddr::Global);
+  Table->setAlignment(Align(1));
+
+  // Every edge out of the block is replaced, so the destinations' phis take
+  // their values from the new edges instead.
+  BasicBlock *BB = SI.getParent();
+  BasicBlock *Lookup = BasicBlock::Create(Ctx, "switch.lookup",
+                                          BB->getParent(), BB->getNextNode());
+  SmallSetVector<BasicBlock *, 4> Succs(succ_begin(BB), succ_end(BB));
+  for (BasicBlock *Succ : Succs) {
+    for (PHINode &Phi : Succ->phis()) {
+      Value *V = Phi.getIncomingValueForBlock(BB);
+      while (Phi.getBasicBlockIndex(BB) >= 0)
+        Phi.removeIncomingValue(BB, /*DeletePHIIfEmpty=*/false);
+      if (Succ == Default && RangeCheck)
+        Phi.addIncoming(V, BB);
+      Phi.addIncoming(V, Lookup);
+    }
+  }
+
+  IRBuilder<> Builder(&SI);
+  Value *Offset = SI.getCondition();
+  if (!Low.isZero())
+    Offset = Builder.CreateSub(Offset, ConstantInt::get(Ty, Low));
+  if (RangeCheck)
+    Builder.CreateCondBr(
+        Builder.CreateICmpULT(Offset, ConstantInt::get(Ty, Range)), Lookup,
+        Default);
+  else
+    Builder.CreateBr(Lookup);
+
+  Builder.SetInsertPoint(Lookup);
+  Value *Index = Builder.CreateZExt(Builder.CreateZExtOrTrunc(Offset, I8),
+                                    Builder.getInt16Ty());
+  Value *Class = Builder.CreateLoad(
+      I8,
+      Builder.CreateInBoundsGEP(Table->getValueType(), Table,
+                                {Builder.getInt16(0), Index}),
+      "switch.class");
+  SwitchInst *Dispatch = Builder.CreateSwitch(Class, Default, Classes.size());
+  for (const auto &[Dest, C] : Classes)
+    Dispatch->addCase(Builder.getInt8(C), Dest);
+
+  SI.eraseFromParent();
+  ++NumSwitchTables;
+  return true;
+}
+
+bool MOSSwitchTables::runOnFunction(Function &F) {
+  if (skipFunction(F))
+    return false;
+  const TargetMachine &TM =
+      getAnalysis<TargetPassConfig>().getTM<TargetMachine>();
+  const MOSSubtarget &STI = TM.getSubtarget<MOSSubtarget>(F);
+
+  SmallVector<SwitchInst *> Switches;
+  for (BasicBlock &BB : F)
+    if (auto *SI = dyn_cast<SwitchInst>(BB.getTerminator()))
+      Switches.push_back(SI);
+
+  bool Changed = false;
+  for (SwitchInst *SI : Switches)
+    Changed |= lowerToTable(*SI, STI);
+  return Changed;
+}
+
+void MOSSwitchTables::getAnalysisUsage(AnalysisUsage &AU) const {
+  AU.addRequired<TargetPassConfig>();
+}
+
+char MOSSwitchTables::ID = 0;
+
+INITIALIZE_PASS_BEGIN(MOSSwitchTables, DEBUG_TYPE,
+                      "Lower MOS switches to lookup tables", false, false)
+INITIALIZE_PASS_DEPENDENCY(TargetPassConfig)
+INITIALIZE_PASS_END(MOSSwitchTables, DEBUG_TYPE,
+                    "Lower MOS switches to lookup tables", false, false)
+
+FunctionPass *llvm::createMOSSwitchTablesPass() {
+  return new MOSSwitchTables();
+}
@@ -0,0 +1,24 @@
+//===-- MOSSwitchTables.h - MOS Switch Lookup Tables ------------*- C++ -*-===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares the MOS switch lookup table pass.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_LIB_TARGET_MOS_MOSSWITCHTABLES_H
+#define LLVM_LIB_TARGET_MOS_MOSSWITCHTABLES_H
+
+#include "llvm/Pass.h"
+
+namespace llvm {
+
+FunctionPass *createMOSSwitchTablesPass();
+
+} // namespace llvm
+
+#endif // not LLVM_LIB_TARGET_MOS_MOSSWITCHTABLES_H
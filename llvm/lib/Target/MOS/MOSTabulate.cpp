@@ -0,0 +1,206 @@
+//===-- MOSTabulate.cpp - MOS Function Tabulation -------------------------===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines the MOS function tabulation pass.
+//
+// Pure functions from a byte to a byte, like bit reversals, population counts
+// or approximations of sines, often take dozens or hundreds of cycles to
+// compute what a 256-byte table could hold outright. This pass evaluates each
+// such function over every input at link time and replaces its direct calls
+// with loads from the resulting table. The table is page aligned, so that an
+// absolute indexed load from it never pays for crossing a page.
+//
+// A function is tabulated if it accesses no memory, besides constants, and the
+// evaluator can run it to completion for every input. It must also cost more
+// than a table lookup by MOS TTI's estimate of its latency, and the table must
+// fit within the ROM budget, less the size of the function if no other uses
+// of it remain. When optimizing for size, no table may grow the program.
+//
+// This runs early in LTO, where every call site is visible, and before the
+// inliner has had a chance to copy the function's body into its callers. Each
+// table is reported with an optimization remark (-Rpass=mos-tabulate) giving
+// its size, as is each candidate left out for want of budget.
+//
+//===----------------------------------------------------------------------===//
+
+#include "MOSTabulate.h"
+
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/OptimizationRemarkEmitter.h"
+#include "llvm/Analysis/TargetLibraryInfo.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Transforms/Utils/Evaluator.h"
+#include <optional>
+
+#define DEBUG_TYPE "mos-tabulate"
+
+STATISTIC(NumTabulated, "Number of functions tabulated");
+STATISTIC(NumCallsTabulated, "Number of calls replaced by table lookups");
+
+using namespace llvm;
+
+static cl::opt<bool>
+    Tabulate("mos-tabulate",
+             cl::desc("Replace calls of pure byte-to-byte functions with "
+                      "lookups into tables of their results"),
+             cl::init(true), cl::Hidden);
+
+static cl::opt<unsigned> RomBudget(
+    "mos-tabulate-rom-budget",
+    cl::desc("Maximum number of bytes that tabulation may add to the program"),
+    cl::init(1024), cl::Hidden);
+
+static cl::opt<unsigned> MinLatency(
+    "mos-tabulate-min-latency",
+    cl::desc("Minimum latency, in TTI units, of a function to be tabulated"),
+    cl::init(8), cl::Hidden);
+
+static constexpr unsigned TableSize = 256;
+
+// Returns whether F has the form of a pure function from a byte to a byte.
+static bool isCandidate(const Function &F) {
+  const FunctionType *FTy = F.getFunctionType();
+  return !F.isDeclaration() && !F.isVarArg() && !F.hasOptNone() &&
+         !F.hasFnAttribute(Attribute::Naked) && !F.isPresplitCoroutine() &&
+         F.doesNotAccessMemory() && FTy->getNumParams() == 1 &&
+         FTy->getParamType(0)->isIntegerTy(8) &&
+         FTy->getReturnType()->isIntegerTy(8);
+}
+
+static InstructionCost getCost(const Function &F,
+                               const TargetTransformInfo &TTI,
+                               TargetTransformInfo::TargetCostKind Kind) {
+  InstructionCost Cost = 0;
+  for (const Instruction &I : instructions(F))
+    Cost += TTI.getInstructionCost(&I, Kind);
+  return Cost;
+}
+
+// Evaluates F over every input, returning the table of its results.
+static std::optional<SmallVector<uint8_t>>
+evaluate(Function &F, const DataLayout &DL, const TargetLibraryInfo &TLI) {
+  SmallVector<uint8_t> Results;
+  for (unsigned I = 0; I != TableSize; ++I) {
+    Evaluator Eval(DL, &TLI);
+    Constant *RetVal;
+    SmallVector<Constant *, 1> Args = {
+        ConstantInt::get(F.getFunctionType()->getParamType(0), I)};
+    if (!Eval.EvaluateFunction(&F, RetVal, Args) ||
+        !Eval.getMutatedInitializers().empty())
+      return std::nullopt;
+    // Any value will do for an undefined result.
+    if (isa<UndefValue>(RetVal)) {
+      Results.push_back(0);
+      continue;
+    }
+    auto *CI = dyn_cast<ConstantInt>(RetVal);
+    if (!CI)
+      return std::nullopt;
+    Results.push_back(CI->getZExtValue());
+  }
+  return Results;
+}
+
+PreservedAnalyses MOSTabulatePass::run(Module &M, ModuleAnalysisManager &AM) {
+  if (!Tabulate)
+    return PreservedAnalyses::all();
+
+  FunctionAnalysisManager &FAM =
+      AM.getResult<FunctionAnalysisManagerModuleProxy>(M).getManager();
+  const DataLayout &DL = M.getDataLayout();
+  int64_t Budget = OptSize ? 0 : int64_t(RomBudget);
+  int64_t Growth = 0;
+
+  bool Changed = false;
+  for (Function &F : M) {
+    if (!isCandidate(F))
+      continue;
+
+    SmallVector<CallInst *> Calls;
+    for (Use &U : F.uses()) {
+      auto *Call = dyn_cast<CallInst>(U.getUser());
+      if (Call && Call->isCallee(&U) &&
+          Call->getFunctionType() == F.getFunctionType() &&
+          !Call->isMustTailCall())
+        Calls.push_back(Call);
+    }
+    if (Calls.empty())
+      continue;
+
+    const TargetTransformInfo &TTI = FAM.getResult<TargetIRAnalysis>(F);
+    InstructionCost Latency =
+        getCost(F, TTI, TargetTransformInfo::TCK_Latency);
+    if (!Latency.isValid() || Latency < int64_t(MinLatency))
+      continue;
+
+    // A function left without uses is removed by GlobalDCE, which refunds
+    // its size.
+    int64_t Cost = TableSize;
+    if (F.hasLocalLinkage() && Calls.size() == F.getNumUses()) {
+      InstructionCost Size =
+          getCost(F, TTI, TargetTransformInfo::TCK_CodeSize);
+      if (Size.isValid())
+        Cost -= Size.getValue();
+    }
+    OptimizationRemarkEmitter ORE(&F);
+    if (Cost > 0 && (F.hasOptSize() || Growth + Cost > Budget)) {
+      ORE.emit([&]() {
+        return OptimizationRemarkMissed(DEBUG_TYPE, "TableOverBudget", &F)
+               << "function " << ore::NV("Function", &F)
+               << " not tabulated, since its table would add "
+               << ore::NV("Bytes", Cost) << " bytes to the program";
+      });
+      continue;
+    }
+
+    std::optional<SmallVector<uint8_t>> Results =
+        evaluate(F, DL, FAM.getResult<TargetLibraryAnalysis>(F));
+    if (!Results) {
+      LLVM_DEBUG(dbgs() << "Could not evaluate " << F.getName() << "\n");
+      continue;
+    }
+    Growth += Cost;
+
+    Type *Ty = ArrayType::get(Type::getInt8Ty(M.getContext()), TableSize);
+    auto *Table = new GlobalVariable(
+        M, Ty, /*isConstant=*/true, GlobalValue::InternalLinkage,
+        ConstantDataArray::get(M.getContext(), *Results),
+        F.getName() + ".table");
+    Table->setUnnamedAddr(GlobalValue::UnnamedAddr::Global);
+    Table->setAlignment(Align(TableSize));
+    LLVM_DEBUG(dbgs() << "Tabulated " << F.getName() << " for "
+                      << Calls.size() << " calls\n");
+
+    for (CallInst *Call : Calls) {
+      IRBuilder<> B(Call);
+      Value *Index =
+          B.CreateZExt(Call->getArgOperand(0), B.getInt16Ty(), "index");
+      Value *Elt = B.CreateInBoundsGEP(Ty, Table, {B.getInt16(0), Index});
+      Value *Load = B.CreateLoad(B.getInt8Ty(), Elt, Call->getName());
+      Call->replaceAllUsesWith(Load);
+      Call->eraseFromParent();
+    }
+    ++NumTabulated;
+    NumCallsTabulated += Calls.size();
+    ORE.emit([&]() {
+      return OptimizationRemark(DEBUG_TYPE, "Tabulated", &F)
+             << "function " << ore::NV("Function", &F) << " tabulated into a "
+             << ore::NV("Bytes", TableSize) << "-byte table for "
+             << ore::NV("NumCalls", unsigned(Calls.size())) << " calls";
+    });
+    Changed = true;
+  }
+  return Changed ? PreservedAnalyses::none() : PreservedAnalyses::all();
+}
@@ -0,0 +1,33 @@
+//===-- MOSTabulate.h - MOS Function Tabulation -----------------*- C++ -*-===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares the MOS function tabulation pass.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_LIB_TARGET_MOS_MOSTABULATE_H
+#define LLVM_LIB_TARGET_MOS_MOSTABULATE_H
+
+#include "llvm/IR/Module.h"
+#include "llvm/IR/PassManager.h"
+
+namespace llvm {
+
+struct MOSTabulatePass : PassInfoMixin<MOSTabulatePass> {
+  // Whether code size is being optimized for, in which case no table may
+  // grow the program.
+  bool OptSize;
+
+  explicit MOSTabulatePass(bool OptSize = false) : OptSize(OptSize) {}
+
+  PreservedAnalyses run(Module &M, ModuleAnalysisManager &AM);
+};
+
+} // end namespace llvm
+
+#endif // not LLVM_LIB_TARGET_MOS_MOSTABULATE_H
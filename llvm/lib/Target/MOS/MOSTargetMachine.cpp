@@ -12,6 +12,8 @@
 
 #include "MOSTargetMachine.h"
 
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Analysis/CallGraphSCCPass.h"
 #include "llvm/CodeGen/CodeGenTargetMachineImpl.h"
 #include "llvm/CodeGen/GlobalISel/CSEInfo.h"
 #include "llvm/CodeGen/GlobalISel/IRTranslator.h"
@@ -28,52 +30,111 @@
 #include "llvm/MC/TargetRegistry.h"
 #include "llvm/Passes/PassBuilder.h"
 #include "llvm/Support/CodeGen.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Transforms/InstCombine/InstCombine.h"
 #include "llvm/Transforms/Scalar/IndVarSimplify.h"
 #include "llvm/Transforms/Utils.h"
 
 #include "MCTargetDesc/MOSMCTargetDesc.h"
 #include "MOS.h"
+#include "MOSAliasAnalysis.h"
+#include "MOSBitSkip.h"
+#include "MOSBranchIslands.h"
+#include "MOSCPUClones.h"
+#include "MOSColdSplitting.h"
 #include "MOSCombiner.h"
 #include "MOSCopyOpt.h"
+#include "MOSCoroFrames.h"
+#include "MOSCountDown.h"
+#include "MOSEvalCtors.h"
+#include "MOSFunctionDirectives.h"
 #include "MOSIndexIV.h"
 #include "MOSInsertCopies.h"
 #include "MOSInternalize.h"
+#include "MOSInterruptRegUsage.h"
 #include "MOSLateOptimization.h"
+#include "MOSLoopIdiom.h"
+#include "MOSLowerFar.h"
+#include "MOSLowerPortIO.h"
 #include "MOSLowerSelect.h"
 #include "MOSMachineFunctionInfo.h"
 #include "MOSMachineScheduler.h"
+#include "MOSNarrowInt.h"
 #include "MOSNonReentrant.h"
+#include "MOSPageAlign.h"
+#include "MOSPointerArgs.h"
 #include "MOSPostRAScavenging.h"
+#include "MOSRedundantTransfers.h"
+#include "MOSRegPlacement.h"
+#include "MOSSelfModify.h"
 #include "MOSShiftRotateChain.h"
+#include "MOSSpecializePointers.h"
+#include "MOSSpecializePrintf.h"
+#include "MOSSplitModule.h"
+#include "MOSSplitTables.h"
+#include "MOSStaticArgs.h"
 #include "MOSStaticStackAlloc.h"
+#include "MOSSwitchTables.h"
+#include "MOSTabulate.h"
 #include "MOSTargetObjectFile.h"
 #include "MOSTargetTransformInfo.h"
+#include "MOSTraceHooks.h"
+#include "MOSWideAccumulator.h"
 #include "MOSZeroPageAlloc.h"
 
 using namespace llvm;
 
+static cl::opt<bool>
+    EnableMOSIPRA("mos-ipra",
+                  cl::desc("Use the registers actually clobbered by internal "
+                           "callees instead of the calling convention's"),
+                  cl::init(false), cl::Hidden);
+
+static cl::opt<bool> EnableGlobalMerge(
+    "mos-global-merge",
+    cl::desc("Merge globals used together into clusters of up to a page; "
+             "these are only page aligned under -mos-page-align"),
+    cl::init(false), cl::Hidden);
+
 extern "C" LLVM_EXTERNAL_VISIBILITY void LLVMInitializeMOSTarget() {
   // Register the target.
   RegisterTargetMachine<MOSTargetMachine> X(getTheMOSTarget());
 
   PassRegistry &PR = *PassRegistry::getPassRegistry();
   initializeGlobalISel(PR);
+  initializeMOSAAWrapperPassPass(PR);
+  initializeMOSBitSkipPass(PR);
+  initializeMOSBranchIslandsPass(PR);
+  initializeMOSColdSplittingPass(PR);
   initializeMOSCombinerPass(PR);
   initializeMOSCopyOptPass(PR);
+  initializeMOSCoroFramesPass(PR);
+  initializeMOSExternalAAWrapperPass(PR);
   initializeMOSInsertCopiesPass(PR);
   initializeMOSInternalizePass(PR);
+  initializeMOSInterruptRegUsagePass(PR);
   initializeMOSLateOptimizationPass(PR);
+  initializeMOSLowerFarPass(PR);
+  initializeMOSLowerPortIOPass(PR);
   initializeMOSLowerSelectPass(PR);
   initializeMOSNonReentrantPass(PR);
+  initializeMOSPageAlignPass(PR);
+  initializeMOSPointerArgsPass(PR);
   initializeMOSPostRAScavengingPass(PR);
+  initializeMOSRedundantTransfersPass(PR);
+  initializeMOSRegPlacementPass(PR);
+  initializeMOSSelfModifyPass(PR);
   initializeMOSShiftRotateChainPass(PR);
+  initializeMOSStaticArgsPass(PR);
   initializeMOSStaticStackAllocPass(PR);
+  initializeMOSSwitchTablesPass(PR);
+  initializeMOSTraceHooksPass(PR);
+  initializeMOSWideAccumulatorPass(PR);
   initializeMOSZeroPageAllocPass(PR);
 }
 
 static const char *MOSDataLayout =
-    "e-m:e-p:16:8-p1:8:8-i16:8-i32:8-i64:8-f32:8-f64:8-a:8-Fi8-n8";
+    "e-m:e-p:16:8-p1:8:8-p2:32:8-i16:8-i32:8-i64:8-f32:8-f64:8-a:8-Fi8-n8";
 
 /// Processes a CPU name.
 static StringRef getCPU(StringRef CPU) {
@@ -101,6 +162,11 @@ MOSTargetMachine::MOSTargetMachine(const Target &T, const Triple &TT,
   setGlobalISel(true);
   // Prevents fallback to SelectionDAG by allowing direct aborts.
   setGlobalISelAbort(GlobalISelAbortMode::Enable);
+
+  // Outline repeated sequences from functions optimized for minimum size and
+  // from cold code, since ROM is often as tight as cycles.
+  setMachineOutliner(true);
+  setSupportsDefaultOutlining(true);
 }
 
 const MOSSubtarget *
@@ -108,18 +174,32 @@ MOSTargetMachine::getSubtargetImpl(const Function &F) const {
   Attribute CPUAttr = F.getFnAttribute("target-cpu");
   Attribute FSAttr = F.getFnAttribute("target-features");
 
-  auto CPU = CPUAttr.isValid() ? CPUAttr.getValueAsString().str() : TargetCPU;
-  auto FS = FSAttr.isValid() ? FSAttr.getValueAsString().str() : TargetFS;
-
-  auto &I = SubtargetMap[CPU + FS];
-  if (!I) {
+  StringRef CPU =
+      CPUAttr.isValid() ? CPUAttr.getValueAsString() : StringRef(TargetCPU);
+  StringRef FS =
+      FSAttr.isValid() ? FSAttr.getValueAsString() : StringRef(TargetFS);
+
+  // Attributes are uniqued, so the pair finds the subtarget without building
+  // and hashing a key. The key is still checked, since a new context may reuse
+  // the storage of attributes from a destroyed one.
+  auto *&Entry = AttrSubtargets[{CPUAttr, FSAttr}];
+  if (Entry && Entry->first().starts_with(CPU) &&
+      Entry->first().drop_front(CPU.size()) == FS)
+    return Entry->second.get();
+
+  SmallString<128> Key(CPU);
+  Key += FS;
+  auto It = SubtargetMap.try_emplace(Key).first;
+  if (!It->second) {
     // This needs to be done before we create a new subtarget since any
     // creation will depend on the TM and the code generation flags on the
     // function that reside in TargetOptions.
     resetTargetOptions(F);
-    I = std::make_unique<MOSSubtarget>(TargetTriple, CPU, FS, *this);
+    It->second =
+        std::make_unique<MOSSubtarget>(TargetTriple, CPU.str(), FS.str(), *this);
   }
-  return I.get();
+  Entry = &*It;
+  return It->second.get();
 }
 
 TargetTransformInfo
@@ -128,9 +208,30 @@ MOSTargetMachine::getTargetTransformInfo(const Function &F) const {
 }
 
 void MOSTargetMachine::registerPassBuilderCallbacks(PassBuilder &PB) {
+  PB.registerAnalysisRegistrationCallback([](FunctionAnalysisManager &FAM) {
+    FAM.registerPass([] { return MOSAA(); });
+  });
+  PB.registerParseAACallback([](StringRef Name, AAManager &AAM) {
+    if (Name == "mos-aa") {
+      AAM.registerFunctionAnalysis<MOSAA>();
+      return true;
+    }
+    return false;
+  });
+
   PB.registerPipelineParsingCallback(
       [](StringRef Name, LoopPassManager &PM,
          ArrayRef<PassBuilder::PipelineElement>) {
+        if (Name == "mos-count-down") {
+          // Reverse loops to count down to zero where the order is moot.
+          PM.addPass(MOSCountDown());
+          return true;
+        }
+        if (Name == "mos-loop-idiom") {
+          // Replace search loops with calls to library routines.
+          PM.addPass(MOSLoopIdiom());
+          return true;
+        }
         if (Name == "mos-indexiv") {
           // Rewrite pointer artithmetic in loops to use 8-bit IV offsets.
           PM.addPass(MOSIndexIV());
@@ -139,19 +240,111 @@ void MOSTargetMachine::registerPassBuilderCallbacks(PassBuilder &PB) {
         return false;
       });
 
+  PB.registerPipelineParsingCallback(
+      [](StringRef Name, FunctionPassManager &PM,
+         ArrayRef<PassBuilder::PipelineElement>) {
+        if (Name == "mos-narrow-int") {
+          // Narrow integer operations to 8 bits where their ranges allow.
+          PM.addPass(MOSNarrowIntPass());
+          return true;
+        }
+        if (Name == "mos-specialize-printf") {
+          // Split printf calls into calls of specialized primitives.
+          PM.addPass(MOSSpecializePrintfPass());
+          return true;
+        }
+        return false;
+      });
+
   PB.registerPipelineParsingCallback(
       [](StringRef Name, ModulePassManager &PM,
          ArrayRef<PassBuilder::PipelineElement>) {
+        if (Name == "mos-cpu-clones") {
+          PM.addPass(MOSCPUClonesPass());
+          return true;
+        }
+        if (Name == "mos-eval-ctors") {
+          PM.addPass(MOSEvalCtorsPass());
+          return true;
+        }
+        if (Name == "mos-function-directives") {
+          PM.addPass(MOSFunctionDirectivesPass());
+          return true;
+        }
+        if (Name == "mos-mark-coro-frames") {
+          PM.addPass(MOSMarkCoroFramesPass());
+          return true;
+        }
         if (Name == "mos-nonreentrant") {
           PM.addPass(MOSNonReentrantPass());
           return true;
         }
+        if (Name == "mos-specialize-pointers") {
+          PM.addPass(MOSSpecializePointersPass());
+          return true;
+        }
+        if (Name == "mos-split-tables") {
+          PM.addPass(MOSSplitTablesPass());
+          return true;
+        }
+        if (Name == "mos-tabulate") {
+          PM.addPass(MOSTabulatePass());
+          return true;
+        }
         return false;
       });
 
+  // Directives from a file choose how each function is optimized, so they
+  // come first. Processor family clones must be made before they're
+  // optimized, and coroutine frame allocations must be found before CoroSplit
+  // lowers them.
+  PB.registerPipelineStartEPCallback(
+      [](ModulePassManager &PM, OptimizationLevel Level) {
+        PM.addPass(MOSFunctionDirectivesPass());
+        PM.addPass(MOSCPUClonesPass());
+        PM.addPass(MOSMarkCoroFramesPass());
+      });
+
+  // Split tables once the accesses to them have been simplified, both for
+  // static arrays in each module and for arrays internalized by LTO.
+  PB.registerOptimizerEarlyEPCallback(
+      [](ModulePassManager &PM, OptimizationLevel Level, ThinOrFullLTOPhase) {
+        if (Level != OptimizationLevel::O0)
+          PM.addPass(MOSSplitTablesPass());
+      });
+  // LTO sees every call of a function, so it can also clone functions for
+  // the global addresses passed to them, which exposes more tables to split,
+  // and replace the calls of pure byte functions with tables of their results.
+  PB.registerFullLinkTimeOptimizationEarlyEPCallback(
+      [](ModulePassManager &PM, OptimizationLevel Level) {
+        if (Level != OptimizationLevel::O0) {
+          PM.addPass(MOSTabulatePass(Level.getSizeLevel() > 0));
+          PM.addPass(MOSSpecializePointersPass(Level.getSizeLevel() > 0));
+          PM.addPass(MOSSplitTablesPass());
+        }
+      });
+  // Narrow the integer promotions of each function while it's simplified, so
+  // that its callers see the narrowed cost when considering inlining it. The
+  // format strings of printf calls have been propagated into them by then.
+  PB.registerScalarOptimizerLateEPCallback(
+      [](FunctionPassManager &PM, OptimizationLevel Level) {
+        PM.addPass(MOSNarrowIntPass());
+        PM.addPass(MOSSpecializePrintfPass());
+      });
+  // Static constructors are evaluated once LTO has finished simplifying them.
+  PB.registerFullLinkTimeOptimizationLastEPCallback(
+      [](ModulePassManager &PM, OptimizationLevel Level) {
+        if (Level != OptimizationLevel::O0)
+          PM.addPass(MOSEvalCtorsPass());
+      });
+
+  // The loop rewrites are left out of the quicker -O1 and -Og pipelines.
   PB.registerLateLoopOptimizationsEPCallback(
       [](LoopPassManager &PM, OptimizationLevel Level) {
-        if (Level != OptimizationLevel::O0) {
+        if (Level.getSpeedupLevel() > 1) {
+          // Search loops are recognized before they're reversed.
+          PM.addPass(MOSLoopIdiom());
+          PM.addPass(MOSCountDown());
           PM.addPass(MOSIndexIV());
 
           // New induction variables may have been added.
@@ -160,6 +353,18 @@ void MOSTargetMachine::registerPassBuilderCallbacks(PassBuilder &PB) {
       });
 }
 
+void MOSTargetMachine::registerDefaultAliasAnalyses(AAManager &AAM) {
+  AAM.registerFunctionAnalysis<MOSAA>();
+}
+
+bool MOSTargetMachine::splitModule(
+    Module &M, unsigned NumParts,
+    function_ref<void(std::unique_ptr<Module> MPart)> ModuleCallback) {
+  return mos::splitModule(M, NumParts, ModuleCallback);
+}
+
+bool MOSTargetMachine::useIPRA() const { return EnableMOSIPRA; }
+
 StringRef MOSTargetMachine::getSectionPrefix(const GlobalObject *GO) const {
   return GO->getAddressSpace() == MOS::AS_ZeroPage ? ".zp" : "";
 }
@@ -217,6 +422,7 @@ public:
   void addPrePEI() override;
   void addPreSched2() override;
   void addPreEmitPass() override;
+  void addPreEmitPass2() override;
 
   std::unique_ptr<CSEConfigBase> getCSEConfig() const override;
 };
@@ -227,15 +433,39 @@ TargetPassConfig *MOSTargetMachine::createPassConfig(PassManagerBase &PM) {
 }
 
 void MOSPassConfig::addIRPasses() {
-  if (getOptLevel() != CodeGenOptLevel::None)
+  addPass(createMOSAAWrapperPass());
+  addPass(createMOSExternalAAWrapperPass());
+  addPass(createMOSLowerPortIOPass());
+  // This removes calls to the allocator, so it precedes the call graph
+  // analyses.
+  addPass(createMOSCoroFramesPass());
+  if (getOptLevel() != CodeGenOptLevel::None) {
     addPass(createMOSNonReentrantPass());
+    addPass(createMOSStaticArgsPass());
+    addPass(createMOSPointerArgsPass());
+    // The legacy GlobalMerge merges in doInitialization, so the clusters are
+    // formed before any pass here runs, wherever it's added. Under
+    // -mos-page-align, one indexed by a variable is then kept within a page as
+    // a whole; otherwise clusters are not page aligned. Either way, each is
+    // placed in the zero page as a whole, or not at all.
+    if (EnableGlobalMerge)
+      addPass(createGlobalMergePass(TM, /*MaximalOffset=*/256));
+    addPass(createMOSPageAlignPass());
+  }
   TargetPassConfig::addIRPasses();
   // Clean up after LSR in particular.
-  if (getOptLevel() != CodeGenOptLevel::None)
+  if (getOptLevel() != CodeGenOptLevel::None) {
     addPass(createInstructionCombiningPass());
+    addPass(createMOSSwitchTablesPass());
+  }
+  addPass(createMOSTraceHooksPass());
 }
 
-bool MOSPassConfig::addPreISel() { return false; }
+bool MOSPassConfig::addPreISel() {
+  // Far pointers must be gone before the IR translator sees them.
+  addPass(createMOSLowerFarPass());
+  return false;
+}
 
 bool MOSPassConfig::addIRTranslator() {
   addPass(new IRTranslator(getOptLevel()));
@@ -243,7 +473,9 @@ bool MOSPassConfig::addIRTranslator() {
 }
 
 void MOSPassConfig::addPreLegalizeMachineIR() {
-  if (getOptLevel() != CodeGenOptLevel::None) {
+  // -O1 and -Og keep only the combine after legalization, which cleans up the
+  // legalizer's artifacts, and skip the search for shift and rotate chains.
+  if (getOptLevel() > CodeGenOptLevel::Less) {
     addPass(createMOSCombiner());
     addPass(createMOSShiftRotateChainPass());
   }
@@ -252,6 +484,11 @@ void MOSPassConfig::addPreLegalizeMachineIR() {
 bool MOSPassConfig::addLegalizeMachineIR() {
   addPass(new Legalizer());
   addPass(createMOSInternalizePass());
+  // The internalize pass is a module pass, which ends the bottom-up call graph
+  // traversal that IPRA needs. Restart it, so that callees are register
+  // allocated before their callers.
+  if (TM->Options.EnableIPRA)
+    addPass(new DummyCGSCCPass);
   return false;
 }
 
@@ -269,7 +506,8 @@ bool MOSPassConfig::addRegBankSelect() {
 void MOSPassConfig::addPreGlobalInstructionSelect() {
   // This pass helps reduce the live ranges of constants to within a basic
   // block, which can greatly improve machine scheduling, as they can now be
-  // moved around to keep register pressure low.
+  // moved around to keep register pressure low. Which constants are localized
+  // is decided by MOSTargetLowering::shouldLocalize.
   addPass(new Localizer());
 }
 
@@ -280,8 +518,10 @@ bool MOSPassConfig::addGlobalInstructionSelect() {
 
 void MOSPassConfig::addMachineSSAOptimization() {
   TargetPassConfig::addMachineSSAOptimization();
-  if (getOptLevel() != CodeGenOptLevel::None)
+  if (getOptLevel() != CodeGenOptLevel::None) {
     addPass(createMOSInsertCopiesPass());
+    addPass(createMOSRegPlacementPass());
+  }
 }
 
 void MOSPassConfig::addOptimizedRegAlloc() {
@@ -304,8 +544,25 @@ void MOSPassConfig::addMachineLateOptimization() {
 }
 
 void MOSPassConfig::addPrePEI() {
-  if (getOptLevel() != CodeGenOptLevel::None)
+  // Zero page allocation is a module pass, and it would otherwise separate
+  // each function's register allocation from the collection of its register
+  // usage at the end of the pipeline. Collect usage here instead; anything
+  // later passes may still clobber is reported by getIntraCallClobberedRegs.
+  //
+  // Without IPRA, usage is still collected when optimizing, so that interrupt
+  // handlers need only save what their callees actually clobber. Zero page
+  // allocation also ensures every function's usage is known by then.
+  bool Optimize = getOptLevel() != CodeGenOptLevel::None;
+  if (TM->Options.EnableIPRA || Optimize)
+    addPass(createRegUsageInfoCollector());
+  if (Optimize) {
     addPass(createMOSZeroPageAllocPass());
+    addPass(createMOSInterruptRegUsagePass());
+    // Zero page allocation also ends the bottom-up traversal; restart it, so
+    // that late optimization records a callee's return state before its
+    // callers use it.
+    addPass(new DummyCGSCCPass);
+  }
 }
 
 void MOSPassConfig::addPreSched2() {
@@ -318,11 +575,29 @@ void MOSPassConfig::addPreSched2() {
 
   // This is currently mandatory, since it lowers CMPTermZ.
   addPass(createMOSLateOptimizationPass());
-  if (getOptLevel() != CodeGenOptLevel::None)
+  if (getOptLevel() != CodeGenOptLevel::None) {
+    addPass(createMOSRedundantTransfersPass());
     addPass(createMOSStaticStackAllocPass());
+  }
+}
+
+void MOSPassConfig::addPreEmitPass() {
+  if (getOptLevel() != CodeGenOptLevel::None) {
+    addPass(createMOSSelfModifyPass());
+    addPass(createMOSWideAccumulatorPass());
+    // Runs just before branch relaxation, so block sizes are final.
+    addPass(createMOSColdSplittingPass());
+    // Shares jumps between the branches that relaxation would expand.
+    addPass(createMOSBranchIslandsPass());
+  }
+  addPass(&BranchRelaxationPassID);
 }
 
-void MOSPassConfig::addPreEmitPass() { addPass(&BranchRelaxationPassID); }
+void MOSPassConfig::addPreEmitPass2() {
+  // Runs after everything that could change the layout of blocks.
+  if (getOptLevel() != CodeGenOptLevel::None)
+    addPass(createMOSBitSkipPass());
+}
 
 namespace {
 
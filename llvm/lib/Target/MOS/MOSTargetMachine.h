@@ -13,7 +13,9 @@
 #ifndef LLVM_MOS_TARGET_MACHINE_H
 #define LLVM_MOS_TARGET_MACHINE_H
 
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/CodeGen/CodeGenTargetMachineImpl.h"
+#include "llvm/IR/Attributes.h"
 #include "llvm/IR/DataLayout.h"
 #include "llvm/Target/TargetMachine.h"
 
@@ -45,13 +47,20 @@ public:
   bool hasNoInitSection() const override { return true; }
 
   void registerPassBuilderCallbacks(PassBuilder &) override;
+  void registerDefaultAliasAnalyses(AAManager &) override;
 
   TargetPassConfig *createPassConfig(PassManagerBase &PM) override;
 
+  bool splitModule(Module &M, unsigned NumParts,
+                   function_ref<void(std::unique_ptr<Module> MPart)>
+                       ModuleCallback) override;
+
   // The 6502 has only register-related scheduling concerns, so disable PostRA
   // scheduling by claiming to emit it ourselves, then never doing so.
   bool targetSchedulesPostRAScheduling() const override { return true; };
 
+  bool useIPRA() const override;
+
   StringRef getSectionPrefix(const GlobalObject *GO) const override;
 
   MachineFunctionInfo *
@@ -65,6 +74,11 @@ private:
   std::unique_ptr<TargetLoweringObjectFile> TLOF;
   MOSSubtarget SubTarget;
   mutable StringMap<std::unique_ptr<MOSSubtarget>> SubtargetMap;
+  // The SubtargetMap entries by the functions' uniqued target-cpu and
+  // target-features attributes, to avoid building a key for each query.
+  mutable DenseMap<std::pair<Attribute, Attribute>,
+                   StringMapEntry<std::unique_ptr<MOSSubtarget>> *>
+      AttrSubtargets;
 };
 
 } // end namespace llvm
@@ -7,10 +7,14 @@
 //===----------------------------------------------------------------------===//
 
 #include "MOSTargetObjectFile.h"
+#include "MCTargetDesc/MOSMCTargetDesc.h"
 #include "MOS.h"
 #include "MOSTargetMachine.h"
+#include "llvm/ADT/SmallString.h"
 #include "llvm/BinaryFormat/ELF.h"
 #include "llvm/CodeGen/TargetLoweringObjectFileImpl.h"
+#include "llvm/IR/Comdat.h"
+#include "llvm/IR/Function.h"
 #include "llvm/IR/GlobalObject.h"
 #include "llvm/MC/MCContext.h"
 #include "llvm/MC/MCSectionELF.h"
@@ -37,15 +41,72 @@ template <typename T> MOS::AddressSpace getAddressSpace(T *V) {
   return MOS::NumAddrSpaces;
 }
 
+// Returns the unique section for GO within the section named Prefix, or
+// nullptr if GO shares the common section.
+MCSection *MOSTargetObjectFile::getUniqueSection(const GlobalObject *GO,
+                                                 StringRef Prefix,
+                                                 unsigned Type,
+                                                 const TargetMachine &TM) const {
+  bool Unique = isa<Function>(GO) ? TM.getFunctionSections()
+                                  : TM.getDataSections();
+  if (!Unique && !GO->hasComdat())
+    return nullptr;
+
+  SmallString<128> Name = Prefix;
+  Name += '.';
+  TM.getNameWithPrefix(Name, GO, getMangler(), /*MayAlwaysUsePrivate=*/true);
+  unsigned Flags = isa<Function>(GO) ? ELF::SHF_ALLOC | ELF::SHF_EXECINSTR
+                                     : ELF::SHF_ALLOC | ELF::SHF_WRITE;
+  StringRef Group;
+  if (const Comdat *C = GO->getComdat()) {
+    Flags |= ELF::SHF_GROUP;
+    Group = C->getName();
+  }
+  return getContext().getELFSection(Name, Type, Flags, /*EntrySize=*/0, Group,
+                                    GO->hasComdat());
+}
+
 MCSection *MOSTargetObjectFile::SelectSectionForGlobal(
     const GlobalObject *GO, SectionKind Kind, const TargetMachine &TM) const {
-  // Place zero page variables in the .zp sections by default.
+  // Place zero page variables in the .zp sections by default. These are given
+  // a section apiece like any other data, so that the linker can discard the
+  // unused ones; the zero page is the scarcest memory there is.
   if (getAddressSpace(GO) == MOS::AS_ZeroPage && !GO->hasSection()) {
-    if (Kind.isNoInit())
-      return ZpNoinitSection;
-    if (Kind.isBSS())
-      return ZpBssSection;
-    return ZpDataSection;
+    MCSection *Common = ZpDataSection;
+    unsigned Type = ELF::SHT_PROGBITS;
+    if (Kind.isNoInit() || Kind.isBSS()) {
+      Common = Kind.isNoInit() ? ZpNoinitSection : ZpBssSection;
+      Type = ELF::SHT_NOBITS;
+    }
+    if (MCSection *S = getUniqueSection(GO, Common->getName(), Type, TM))
+      return S;
+    return Common;
+  }
+
+  // Functions marked hot or cold in the source are grouped like those the
+  // profile marks, so that the linker script can lay them out together. The
+  // profile takes precedence when present. Timed functions are grouped so
+  // that their page alignment padding can be filled by other code.
+  if (const auto *F = dyn_cast<Function>(GO)) {
+    if (F->hasFnAttribute("mos-timed") && !F->hasComdat()) {
+      if (MCSection *S =
+              getUniqueSection(GO, ".text.timed", ELF::SHT_PROGBITS, TM))
+        return S;
+      return getContext().getELFSection(".text.timed.", ELF::SHT_PROGBITS,
+                                        ELF::SHF_ALLOC | ELF::SHF_EXECINSTR);
+    }
+    if (!F->getSectionPrefix() && !F->hasComdat() &&
+        (F->hasFnAttribute(Attribute::Hot) ||
+         F->hasFnAttribute(Attribute::Cold))) {
+      StringRef Prefix = F->hasFnAttribute(Attribute::Hot) ? ".text.hot"
+                                                           : ".text.unlikely";
+      if (MCSection *S =
+              getUniqueSection(GO, Prefix, ELF::SHT_PROGBITS, TM))
+        return S;
+      return getContext().getELFSection(Prefix + Twine('.'),
+                                        ELF::SHT_PROGBITS,
+                                        ELF::SHF_ALLOC | ELF::SHF_EXECINSTR);
+    }
   }
 
   // Use default ELF handling for all other cases.
@@ -60,6 +121,7 @@ MCSection *MOSTargetObjectFile::getExplicitSectionGlobal(
   else if (SectionName == ".zp.data" || SectionName.starts_with(".zp.data."))
     SK = SectionKind::getData();
   else if (SectionName == ".zp" || SectionName.starts_with(".zp.") ||
+           MOS::isBasePageSectionName(SectionName) ||
            SectionName.ends_with(".noinit") || SectionName.contains(".noinit."))
     SK = SectionKind::getNoInit();
   return TargetLoweringObjectFileELF::getExplicitSectionGlobal(GO, SK, TM);
@@ -19,6 +19,9 @@ class MOSTargetObjectFile : public TargetLoweringObjectFileELF {
   MCSection *ZpBssSection;
   MCSection *ZpNoinitSection;
 
+  MCSection *getUniqueSection(const GlobalObject *GO, StringRef Prefix,
+                              unsigned Type, const TargetMachine &TM) const;
+
 public:
   void Initialize(MCContext &ctx, const TargetMachine &TM) override;
   MCSection *SelectSectionForGlobal(const GlobalObject *GO, SectionKind Kind,
@@ -0,0 +1,279 @@
+//===- MOSTargetTransformInfo.cpp - MOS specific TTI ----------------------===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements the MOS TargetTransformInfo hooks that tune the middle
+// end's cost model to an 8-bit accumulator machine.
+//
+// Costs are measured in units of one byte of a typical ALU operation: loading
+// a byte from the zero page, combining it with another, and storing it back.
+// The size and cycle counts of that sequence come from the instruction cost
+// tables of the subtarget, so that an i8 add costs one unit, an i32 add four,
+// and a multiply or divide libcall many more.
+//
+// A function's static stack frame competes for the zero page as a whole, so
+// inlining a callee with locals into a caller may leave the merged frame too
+// large for what is left of the zero page budget, pushing the caller's own
+// working set out to absolute memory. Such inlines are charged for each byte
+// that would lose its place in the zero page.
+//
+//===----------------------------------------------------------------------===//
+
+#include "MOSTargetTransformInfo.h"
+
+#include "MCTargetDesc/MOSMCTargetDesc.h"
+#include "MOSZeroPageAlloc.h"
+#include "llvm/Analysis/InlineCost.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/InstrTypes.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/MathExtras.h"
+
+using namespace llvm;
+
+static cl::opt<unsigned> InlineZPSpillCost(
+    "mos-inline-zp-spill-cost",
+    cl::desc("Inlining cost, in instructions, of each byte of a static frame "
+             "pushed out of the zero page by the inline (0 to disable)"),
+    cl::init(2), cl::Hidden);
+
+static MOSInstrCost getByteOpCost(const MOSSubtarget &ST) {
+  return MOSInstrCost::get(MOS::LDA_ZeroPage, ST) +
+         MOSInstrCost::get(MOS::ADC_ZeroPage, ST) +
+         MOSInstrCost::get(MOS::STA_ZeroPage, ST);
+}
+
+static unsigned getNumBytes(Type *Ty) {
+  return divideCeil(Ty->getIntegerBitWidth(), 8);
+}
+
+InstructionCost MOSTTIImpl::getCost(MOSInstrCost Cost,
+                                    TTI::TargetCostKind CostKind) const {
+  MOSInstrCost Unit = getByteOpCost(*ST);
+  uint32_t Num, Denom;
+  switch (CostKind) {
+  case TTI::TCK_CodeSize:
+    Num = Cost.getBytes();
+    Denom = Unit.getBytes();
+    break;
+  case TTI::TCK_RecipThroughput:
+  case TTI::TCK_Latency:
+    Num = Cost.getCycles();
+    Denom = Unit.getCycles();
+    break;
+  case TTI::TCK_SizeAndLatency:
+    Num = Cost.getBytes() + Cost.getCycles();
+    Denom = Unit.getBytes() + Unit.getCycles();
+    break;
+  }
+  return divideCeil(Num, Denom);
+}
+
+// Returns the cost of a libcall taking ArgBytes bytes of arguments and
+// results, whose body performs BodyOps units of work. Only the call sequence
+// counts towards code size, since the body is shared.
+InstructionCost
+MOSTTIImpl::getLibcallCost(unsigned ArgBytes, unsigned BodyOps,
+                           TTI::TargetCostKind CostKind) const {
+  MOSInstrCost Call = MOSInstrCost::get(MOS::JSR_Absolute, *ST);
+  if (CostKind != TTI::TCK_CodeSize)
+    Call += MOSInstrCost::get(MOS::RTS_Implied, *ST);
+  InstructionCost Cost = getCost(Call, CostKind) + ArgBytes;
+  if (CostKind != TTI::TCK_CodeSize)
+    Cost += BodyOps;
+  return Cost;
+}
+
+unsigned MOSTTIImpl::adjustInliningThreshold(const CallBase *CB) const {
+  // Each byte of arguments and results must be copied into and out of the
+  // calling convention's registers; inlining folds these copies away.
+  const DataLayout &DL = CB->getDataLayout();
+  unsigned ArgBytes = 0;
+  for (const Value *Arg : CB->args())
+    ArgBytes += DL.getTypeStoreSize(Arg->getType());
+  if (!CB->getType()->isVoidTy())
+    ArgBytes += DL.getTypeStoreSize(CB->getType());
+  return ArgBytes * InlineConstants::getInstrCost();
+}
+
+// Returns the bytes of the fixed-size locals of F, which will make up its
+// stack frame.
+static uint64_t getFrameBytes(const Function &F) {
+  const DataLayout &DL = F.getDataLayout();
+  uint64_t Bytes = 0;
+  for (const Instruction &I : F.getEntryBlock())
+    if (const auto *AI = dyn_cast<AllocaInst>(&I))
+      if (std::optional<TypeSize> Size = AI->getAllocationSize(DL))
+        if (!Size->isScalable())
+          Bytes += Size->getFixedValue();
+  return Bytes;
+}
+
+unsigned MOSTTIImpl::getInliningPressureCost(const CallBase *CB) const {
+  const Function *Caller = CB->getCaller();
+  const Function *Callee = CB->getCalledFunction();
+  // Which functions are nonreentrant, and so get static frames, is only known
+  // during code generation; assume that any caller not calling itself will.
+  if (!InlineZPSpillCost || !Callee || Callee == Caller ||
+      !ST->staticStack() || Caller->hasOptNone())
+    return 0;
+
+  uint64_t CalleeBytes = getFrameBytes(*Callee);
+  if (!CalleeBytes)
+    return 0;
+  if (!ZPBudget)
+    ZPBudget = mos::getZeroPageBudget(*Caller->getParent());
+  uint64_t CallerBytes = getFrameBytes(*Caller);
+  if (CallerBytes + CalleeBytes <= *ZPBudget)
+    return 0;
+
+  // Frames are placed in the zero page all or nothing. Each frame that would
+  // fit on its own loses its place once merged.
+  uint64_t Spilled = 0;
+  if (CallerBytes <= *ZPBudget)
+    Spilled += CallerBytes;
+  if (CalleeBytes <= *ZPBudget)
+    Spilled += CalleeBytes;
+  return Spilled * InlineZPSpillCost * InlineConstants::getInstrCost();
+}
+
+void MOSTTIImpl::getUnrollingPreferences(
+    Loop *L, ScalarEvolution &SE, TTI::UnrollingPreferences &UP,
+    OptimizationRemarkEmitter *ORE) const {
+  BaseT::getUnrollingPreferences(L, SE, UP, ORE);
+
+  // Thresholds are in units of byte operations, each several instructions
+  // long, so the generic thresholds would allow enormous unrolled bodies.
+  UP.Threshold = 60;
+  UP.PartialThreshold = 30;
+  UP.OptSizeThreshold = 0;
+  UP.PartialOptSizeThreshold = 0;
+
+  // A loop that runs at most 256 times can count and index with 8-bit
+  // registers, so fully unrolling it further buys nothing but size.
+  UP.FullUnrollMaxCount = 256;
+
+  // Runtime unrolling needs a remainder loop, and partially unrolled bodies
+  // must keep their offsets within the reach of an 8-bit index.
+  UP.Runtime = false;
+  UP.Partial = !L->getHeader()->getParent()->hasOptSize();
+  UP.MaxCount = 4;
+
+  // A function directive may keep the loops rolled outright.
+  if (L->getHeader()->getParent()->hasFnAttribute("mos-no-unroll")) {
+    UP.Threshold = UP.PartialThreshold = 0;
+    UP.FullUnrollMaxCount = 0;
+    UP.Partial = false;
+  }
+}
+
+void MOSTTIImpl::getPeelingPreferences(Loop *L, ScalarEvolution &SE,
+                                       TTI::PeelingPreferences &PP) const {
+  BaseT::getPeelingPreferences(L, SE, PP);
+  // Peeling duplicates the loop body, which is rarely worth it for size.
+  const Function &F = *L->getHeader()->getParent();
+  PP.AllowPeeling = !F.hasOptSize() && !F.hasFnAttribute("mos-no-unroll");
+}
+
+InstructionCost MOSTTIImpl::getArithmeticInstrCost(
+    unsigned Opcode, Type *Ty, TTI::TargetCostKind CostKind,
+    TTI::OperandValueInfo Opd1Info, TTI::OperandValueInfo Opd2Info,
+    ArrayRef<const Value *> Args, const Instruction *CxtI) const {
+  if (!Ty->isIntegerTy())
+    return BaseT::getArithmeticInstrCost(Opcode, Ty, CostKind, Opd1Info,
+                                         Opd2Info, Args, CxtI);
+
+  unsigned Bits = Ty->getIntegerBitWidth();
+  unsigned Bytes = getNumBytes(Ty);
+  switch (Opcode) {
+  default:
+    break;
+  case Instruction::Add:
+  case Instruction::Sub:
+  case Instruction::And:
+  case Instruction::Or:
+  case Instruction::Xor:
+    return Bytes;
+  case Instruction::Shl:
+  case Instruction::LShr:
+  case Instruction::AShr: {
+    // Whole bytes shift by moving them; the rest take one pass over every
+    // byte per bit. Variable shifts loop, half of the width on average.
+    if (Opd2Info.isConstant() && Args.size() == 2)
+      if (const auto *Amt = dyn_cast<ConstantInt>(Args[1])) {
+        uint64_t N = Amt->getLimitedValue(Bits);
+        return Bytes * (N % 8 + (N >= 8));
+      }
+    return Bytes * (Bits / 2 + 1);
+  }
+  case Instruction::Mul:
+    // The MEGA65 multiplier takes 32-bit operands directly.
+    if (ST->hasMEGA65Math() && Bits <= 32)
+      return 3 * Bytes;
+    // Shift and add, once per bit of the multiplier.
+    return getLibcallCost(3 * Bytes, 3 * Bits * Bytes, CostKind);
+  case Instruction::UDiv:
+  case Instruction::URem:
+    if (ST->hasMEGA65Math() && Bits >= 16 && Bits <= 32)
+      return 3 * Bytes;
+    [[fallthrough]];
+  case Instruction::SDiv:
+  case Instruction::SRem:
+    // Shift and subtract, once per bit of the quotient.
+    return getLibcallCost(3 * Bytes, 4 * Bits * Bytes, CostKind);
+  }
+  return BaseT::getArithmeticInstrCost(Opcode, Ty, CostKind, Opd1Info,
+                                       Opd2Info, Args, CxtI);
+}
+
+InstructionCost MOSTTIImpl::getCastInstrCost(unsigned Opcode, Type *Dst,
+                                             Type *Src,
+                                             TTI::CastContextHint CCH,
+                                             TTI::TargetCostKind CostKind,
+                                             const Instruction *I) const {
+  if (!Dst->isIntegerTy() || !Src->isIntegerTy())
+    return BaseT::getCastInstrCost(Opcode, Dst, Src, CCH, CostKind, I);
+
+  unsigned NewBytes = getNumBytes(Dst) - std::min(getNumBytes(Dst),
+                                                  getNumBytes(Src));
+  switch (Opcode) {
+  case Instruction::Trunc:
+    // The low bytes are used in place.
+    return 0;
+  case Instruction::ZExt:
+    // Each new byte is a store of zero.
+    return NewBytes;
+  case Instruction::SExt:
+    // The sign is tested once, then each new byte is stored.
+    return NewBytes + 2;
+  default:
+    break;
+  }
+  return BaseT::getCastInstrCost(Opcode, Dst, Src, CCH, CostKind, I);
+}
+
+InstructionCost MOSTTIImpl::getCmpSelInstrCost(
+    unsigned Opcode, Type *ValTy, Type *CondTy, CmpInst::Predicate VecPred,
+    TTI::TargetCostKind CostKind, TTI::OperandValueInfo Op1Info,
+    TTI::OperandValueInfo Op2Info, const Instruction *I) const {
+  if (!ValTy->isIntegerTy() && !ValTy->isPointerTy())
+    return BaseT::getCmpSelInstrCost(Opcode, ValTy, CondTy, VecPred, CostKind,
+                                     Op1Info, Op2Info, I);
+
+  unsigned Bytes = ValTy->isPointerTy()
+                       ? DL.getPointerTypeSize(ValTy).getFixedValue()
+                       : getNumBytes(ValTy);
+  // Comparisons compare a byte at a time; selects branch around copying one
+  // operand over the other.
+  if (Opcode == Instruction::ICmp)
+    return Bytes;
+  if (Opcode == Instruction::Select)
+    return Bytes + 1;
+  return BaseT::getCmpSelInstrCost(Opcode, ValTy, CondTy, VecPred, CostKind,
+                                   Op1Info, Op2Info, I);
+}
@@ -16,9 +16,11 @@
 #ifndef LLVM_LIB_TARGET_MOS_MOSTARGETTRANSFORMINFO_H
 #define LLVM_LIB_TARGET_MOS_MOSTARGETTRANSFORMINFO_H
 
+#include "MOSInstrCost.h"
 #include "MOSTargetMachine.h"
 #include "llvm/CodeGen/BasicTTIImpl.h"
 #include "llvm/Support/BranchProbability.h"
+#include <optional>
 
 namespace llvm {
 
@@ -30,6 +32,9 @@ class MOSTTIImpl : public BasicTTIImplBase<MOSTTIImpl> {
   const MOSSubtarget *ST;
   const MOSTargetLowering *TLI;
 
+  // The zero page left to the compiler for the module, once computed.
+  mutable std::optional<uint64_t> ZPBudget;
+
   const MOSSubtarget *getST() const { return ST; }
   const MOSTargetLowering *getTLI() const { return TLI; }
 
@@ -46,6 +51,13 @@ public:
 
   bool allowIllegalIntegerIV() const override { return true; }
 
+  // There are no threads, only interrupts, and memory shared with those must
+  // be volatile anyway. This lets LICM keep a global in a register across a
+  // loop and store it once at the exits, even if the loop might not have
+  // stored to it at all. The register is just another zero page byte, so this
+  // is profitable whenever the global is accessed in the loop.
+  bool isSingleThreaded() const override { return true; }
+
   bool isLSRCostLess(const TargetTransformInfo::LSRCost &C1,
                      const TargetTransformInfo::LSRCost &C2) const override {
     // Prefer instruction count to the other metrics.
@@ -60,10 +72,46 @@ public:
   }
 
   bool isValidAddrSpaceCast(unsigned FromAS, unsigned ToAS) const override {
-    return true;
+    // Far pointers have no near equivalent.
+    return FromAS != MOS::AS_Far && ToAS != MOS::AS_Far;
   }
 
   bool strictInliningCosts() const override { return true; }
+
+  unsigned adjustInliningThreshold(const CallBase *CB) const override;
+  unsigned getInliningPressureCost(const CallBase *CB) const override;
+
+  void getUnrollingPreferences(Loop *L, ScalarEvolution &SE,
+                               TTI::UnrollingPreferences &UP,
+                               OptimizationRemarkEmitter *ORE) const override;
+
+  void getPeelingPreferences(Loop *L, ScalarEvolution &SE,
+                             TTI::PeelingPreferences &PP) const override;
+
+  InstructionCost getArithmeticInstrCost(
+      unsigned Opcode, Type *Ty, TTI::TargetCostKind CostKind,
+      TTI::OperandValueInfo Opd1Info = {TTI::OK_AnyValue, TTI::OP_None},
+      TTI::OperandValueInfo Opd2Info = {TTI::OK_AnyValue, TTI::OP_None},
+      ArrayRef<const Value *> Args = {},
+      const Instruction *CxtI = nullptr) const override;
+
+  InstructionCost
+  getCastInstrCost(unsigned Opcode, Type *Dst, Type *Src,
+                   TTI::CastContextHint CCH, TTI::TargetCostKind CostKind,
+                   const Instruction *I = nullptr) const override;
+
+  InstructionCost getCmpSelInstrCost(
+      unsigned Opcode, Type *ValTy, Type *CondTy, CmpInst::Predicate VecPred,
+      TTI::TargetCostKind CostKind,
+      TTI::OperandValueInfo Op1Info = {TTI::OK_AnyValue, TTI::OP_None},
+      TTI::OperandValueInfo Op2Info = {TTI::OK_AnyValue, TTI::OP_None},
+      const Instruction *I = nullptr) const override;
+
+private:
+  InstructionCost getCost(MOSInstrCost Cost,
+                          TTI::TargetCostKind CostKind) const;
+  InstructionCost getLibcallCost(unsigned ArgBytes, unsigned BodyOps,
+                                 TTI::TargetCostKind CostKind) const;
 };
 
 } // end namespace llvm
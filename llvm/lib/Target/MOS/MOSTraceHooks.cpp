@@ -0,0 +1,140 @@
+//===-- MOSTraceHooks.cpp - MOS Trace Port Instrumentation ----------------===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines the MOS trace port instrumentation pass.
+//
+// Emulators like Mesen, VICE, and MAME can run a script whenever the program
+// writes to an address, so a write to an otherwise unused address makes an
+// event that costs the emulated machine only the write itself. With
+// -mos-trace-port=<addr>, this pass writes a 16-bit trace ID to the port on
+// entry to each function, and to port+2 just before it returns. With
+// -mos-trace-blocks, each other basic block writes an ID of its own to
+// port+4. Each ID is written low byte first, so a script should latch the
+// low byte and log the event on the write of the high byte.
+//
+// A function's IDs are consecutive: the first marks its entry and exit, and
+// the rest mark its blocks in order. IDs are only unique within the module,
+// so a whole program's traces should be built with LTO. The AsmPrinter
+// records each function's IDs in a .mos.trace note, which llvm-mlb turns
+// into a table for the emulator script.
+//
+// The instrumentation is added after the IR optimizations, so that it
+// follows the functions that are actually emitted, inlining included.
+// Functions marked noprofile or naked are left alone.
+//
+//===----------------------------------------------------------------------===//
+
+#include "MOSTraceHooks.h"
+
+#include "MOS.h"
+
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Metadata.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CommandLine.h"
+
+#define DEBUG_TYPE "mos-trace-hooks"
+
+using namespace llvm;
+
+static cl::opt<unsigned>
+    TracePort("mos-trace-port",
+              cl::desc("Write function entry and exit trace events to the "
+                       "given address"),
+              cl::Hidden);
+
+static cl::opt<bool>
+    TraceBlocks("mos-trace-blocks",
+                cl::desc("Also write trace events for basic blocks"),
+                cl::Hidden);
+
+namespace {
+
+struct MOSTraceHooks : public ModulePass {
+  static char ID; // Pass identification, replacement for typeid
+
+  MOSTraceHooks() : ModulePass(ID) {
+    initializeMOSTraceHooksPass(*PassRegistry::getPassRegistry());
+  }
+
+  bool runOnModule(Module &M) override;
+};
+
+} // namespace
+
+// Writes the trace ID to the port at Offset from the base.
+static void emitEvent(IRBuilder<> &Builder, unsigned Offset, uint64_t ID) {
+  for (unsigned I = 0; I < 2; ++I) {
+    Value *Addr = ConstantExpr::getIntToPtr(
+        Builder.getInt16((TracePort + Offset + I) & 0xffff),
+        Builder.getPtrTy());
+    Builder.CreateStore(Builder.getInt8(ID >> (I * 8)), Addr,
+                        /*isVolatile=*/true);
+  }
+}
+
+bool MOSTraceHooks::runOnModule(Module &M) {
+  if (!TracePort.getNumOccurrences())
+    return false;
+
+  LLVMContext &Ctx = M.getContext();
+  uint64_t NextID = 0;
+  bool Changed = false;
+  for (Function &F : M) {
+    if (F.isDeclaration() || F.hasFnAttribute(Attribute::NoProfile) ||
+        F.hasFnAttribute(Attribute::Naked))
+      continue;
+    uint64_t NumIDs = TraceBlocks ? F.size() : 1;
+    if (NextID + NumIDs > 0x10000) {
+      Ctx.emitError("too many functions and blocks to trace in module '" +
+                    M.getName() + "'");
+      return Changed;
+    }
+    uint64_t FirstID = NextID;
+    NextID += NumIDs;
+
+    IRBuilder<> Builder(&*F.getEntryBlock().getFirstInsertionPt());
+    emitEvent(Builder, 0, FirstID);
+    uint64_t BlockID = FirstID;
+    for (BasicBlock &BB : F) {
+      if (TraceBlocks && &BB != &F.getEntryBlock()) {
+        ++BlockID;
+        BasicBlock::iterator InsertPt = BB.getFirstInsertionPt();
+        if (InsertPt != BB.end()) {
+          Builder.SetInsertPoint(&*InsertPt);
+          emitEvent(Builder, 4, BlockID);
+        }
+      }
+      auto *Ret = dyn_cast<ReturnInst>(BB.getTerminator());
+      if (!Ret)
+        continue;
+      // Nothing may come between a musttail call and its return.
+      CallInst *Call = BB.getTerminatingMustTailCall();
+      Builder.SetInsertPoint(Call ? static_cast<Instruction *>(Call) : Ret);
+      emitEvent(Builder, 2, FirstID);
+    }
+
+    Type *I16 = Type::getInt16Ty(Ctx);
+    F.setMetadata(MOSTraceMD,
+                  MDNode::get(Ctx, {ConstantAsMetadata::get(
+                                        ConstantInt::get(I16, FirstID)),
+                                    ConstantAsMetadata::get(
+                                        ConstantInt::get(I16, NumIDs))}));
+    Changed = true;
+  }
+  return Changed;
+}
+
+char MOSTraceHooks::ID = 0;
+
+INITIALIZE_PASS(MOSTraceHooks, DEBUG_TYPE,
+                "Instrument functions with trace port writes", false, false)
+
+ModulePass *llvm::createMOSTraceHooksPass() { return new MOSTraceHooks(); }
@@ -0,0 +1,28 @@
+//===-- MOSTraceHooks.h - MOS Trace Port Instrumentation --------*- C++ -*-===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares the MOS trace port instrumentation pass.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_LIB_TARGET_MOS_MOSTRACEHOOKS_H
+#define LLVM_LIB_TARGET_MOS_MOSTRACEHOOKS_H
+
+#include "llvm/Pass.h"
+
+namespace llvm {
+
+// The function metadata giving the first trace ID of a function and the
+// number of IDs it uses.
+inline constexpr char MOSTraceMD[] = "mos.trace";
+
+ModulePass *createMOSTraceHooksPass();
+
+} // namespace llvm
+
+#endif // not LLVM_LIB_TARGET_MOS_MOSTRACEHOOKS_H
@@ -0,0 +1,521 @@
+//===-- MOSWideAccumulator.cpp - MOS Wide Accumulator ---------------------===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines the MOS wide accumulator pass.
+//
+// Code generation treats every target as an 8-bit processor, so wider values
+// are loaded, combined, and stored one byte at a time through A. This pass
+// finds sequences that perform the same accumulator operations on each byte
+// of adjacent locations in turn, and replaces them with a single sequence on
+// a wider accumulator where the processor has one. Consecutive sequences
+// share the setup and teardown of the wider accumulator, and these are only
+// emitted if they are cheaper than the byte-wise code they replace.
+//
+// On the 65816 in native mode, clearing the M flag with REP makes A and memory
+// accesses through it 16 bits wide, which does the work of two bytes for one
+// extra cycle. The sequences are bracketed by REP #$20 and SEP #$20. Outside
+// of the brackets, M is always set, so the rest of the compiler's 8-bit
+// assumptions continue to hold. Interrupt handlers set M on entry, since they
+// may interrupt a bracketed sequence.
+//
+// On the 45GS02, the NEG NEG prefixed quad instructions treat A, X, Y, and Z
+// as one 32-bit register Q, and do the work of four bytes. The rest of the
+// compiler assumes that Z is zero, so Z is cleared after the sequences, and
+// interrupt handlers save and clear Z on entry. The quad instructions have no
+// immediate forms, and only distinct pairs of imaginary registers are known to
+// be adjacent, so only memory operands are widened there.
+//
+//===----------------------------------------------------------------------===//
+
+#include "MOSWideAccumulator.h"
+
+#include "MCTargetDesc/MOSMCTargetDesc.h"
+#include "MOS.h"
+#include "MOSInstrCost.h"
+#include "MOSInstrInfo.h"
+#include "MOSMachineFunctionInfo.h"
+#include "MOSRegisterInfo.h"
+#include "MOSSubtarget.h"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/CodeGen/LivePhysRegs.h"
+#include "llvm/CodeGen/MachineFunctionPass.h"
+#include "llvm/CodeGen/MachineInstrBuilder.h"
+#include "llvm/Support/Debug.h"
+#include <optional>
+
+#define DEBUG_TYPE "mos-wide-accumulator"
+
+using namespace llvm;
+
+namespace {
+
+// The role of an instruction in a byte-wise sequence.
+enum class Kind { Load, Op, Store };
+
+// An accumulator instruction that may be widened, and where its memory or
+// immediate operand is.
+struct ByteInstr {
+  MachineInstr *MI;
+  Kind K;
+  unsigned OpIdx;
+  bool IsImm = false;
+};
+
+// The same sequence repeated on each byte of a wide value, lowest byte first.
+struct Group {
+  SmallVector<SmallVector<ByteInstr>, 4> Lanes;
+};
+
+struct MOSWideAccumulator : public MachineFunctionPass {
+  static char ID;
+
+  MOSWideAccumulator() : MachineFunctionPass(ID) {
+    llvm::initializeMOSWideAccumulatorPass(*PassRegistry::getPassRegistry());
+  }
+
+  bool runOnMachineFunction(MachineFunction &MF) override;
+
+private:
+  const MOSSubtarget *STI;
+  const MOSInstrInfo *TII;
+  const MOSRegisterInfo *TRI;
+  const MOSFunctionInfo *MFI;
+  MOSInstrCost::Mode CostMode;
+
+  // The number of bytes in the wide accumulator: 2 for the 65816, 4 for the
+  // 45GS02.
+  unsigned Width;
+
+  // Whether any register clobbered by the wide sequences is live after each
+  // instruction of the current block.
+  DenseMap<const MachineInstr *, bool> ClobberedLiveAfter;
+
+  std::optional<ByteInstr> classify(MachineInstr &MI) const;
+  bool isNextByte(const MachineOperand &Lo, const MachineOperand &Hi,
+                  bool IsImm) const;
+  std::optional<Group> matchGroup(MachineBasicBlock::iterator &I,
+                                  MachineBasicBlock::iterator E) const;
+  MOSInstrCost savings(const Group &G) const;
+  MOSInstrCost setupCost() const;
+  void widen(const Group &G) const;
+  bool runOnBasicBlock(MachineBasicBlock &MBB);
+};
+
+} // namespace
+
+std::optional<ByteInstr> MOSWideAccumulator::classify(MachineInstr &MI) const {
+  // Volatile and ordered accesses, such as those of I/O registers, must keep
+  // their width and order, so they can't be fused into a wide access.
+  if (MI.hasOrderedMemoryRef() ||
+      any_of(MI.memoperands(),
+             [](const MachineMemOperand *MMO) { return MMO->isVolatile(); }))
+    return std::nullopt;
+  switch (MI.getOpcode()) {
+  default:
+    return std::nullopt;
+  case MOS::LDImm:
+  case MOS::LDImag8:
+  case MOS::LDAbs:
+    if (MI.getOperand(0).getReg() != MOS::A)
+      return std::nullopt;
+    return ByteInstr{&MI, Kind::Load, 1, MI.getOpcode() == MOS::LDImm};
+  case MOS::STImag8:
+    if (MI.getOperand(1).getReg() != MOS::A)
+      return std::nullopt;
+    return ByteInstr{&MI, Kind::Store, 0};
+  case MOS::STAbs:
+    if (MI.getOperand(0).getReg() != MOS::A)
+      return std::nullopt;
+    return ByteInstr{&MI, Kind::Store, 1};
+  case MOS::ADCImm:
+  case MOS::SBCImm:
+    return ByteInstr{&MI, Kind::Op, 4, true};
+  case MOS::ADCImag8:
+  case MOS::ADCAbs:
+  case MOS::SBCImag8:
+  case MOS::SBCAbs:
+    return ByteInstr{&MI, Kind::Op, 4};
+  case MOS::ANDImm:
+  case MOS::EORImm:
+  case MOS::ORAImm:
+    return ByteInstr{&MI, Kind::Op, 2, true};
+  case MOS::ANDImag8:
+  case MOS::ANDAbs:
+  case MOS::EORImag8:
+  case MOS::EORAbs:
+  case MOS::ORAImag8:
+  case MOS::ORAAbs:
+    return ByteInstr{&MI, Kind::Op, 2};
+  }
+}
+
+// Returns whether Hi refers to the byte after Lo. Constant immediates always
+// pair up, since the bytes are combined into one wide immediate.
+bool MOSWideAccumulator::isNextByte(const MachineOperand &Lo,
+                                    const MachineOperand &Hi,
+                                    bool IsImm) const {
+  if (IsImm)
+    return Lo.isImm() && Hi.isImm();
+  if (Lo.getType() != Hi.getType() || Lo.getTargetFlags() ||
+      Hi.getTargetFlags())
+    return false;
+  switch (Lo.getType()) {
+  default:
+    return false;
+  case MachineOperand::MO_Immediate:
+    return Lo.getImm() + 1 == Hi.getImm();
+  case MachineOperand::MO_Register: {
+    // Only the two halves of an imaginary pointer are known to be adjacent.
+    // Callee-saved registers may also have been moved to the zero page stack.
+    if (MFI->CSRZPOffsets.count(Lo.getReg()) ||
+        MFI->CSRZPOffsets.count(Hi.getReg()))
+      return false;
+    Register Ptr =
+        TRI->getMatchingSuperReg(Lo.getReg(), MOS::sublo, &MOS::Imag16RegClass);
+    return Ptr && TRI->getSubReg(Ptr, MOS::subhi) == Hi.getReg();
+  }
+  case MachineOperand::MO_GlobalAddress:
+    return Lo.getGlobal() == Hi.getGlobal() &&
+           Lo.getOffset() + 1 == Hi.getOffset();
+  case MachineOperand::MO_ExternalSymbol:
+    return StringRef(Lo.getSymbolName()) == Hi.getSymbolName() &&
+           Lo.getOffset() + 1 == Hi.getOffset();
+  case MachineOperand::MO_TargetIndex:
+    return Lo.getIndex() == Hi.getIndex() &&
+           Lo.getOffset() + 1 == Hi.getOffset();
+  }
+}
+
+// Returns whether two memory operands may refer to the same byte.
+static bool mayAlias(const MachineOperand &A, const MachineOperand &B) {
+  if (A.isImm() && B.isImm())
+    return A.getImm() == B.getImm();
+  if (A.isReg() && B.isReg())
+    return A.getReg() == B.getReg();
+  if (A.isGlobal() && B.isGlobal())
+    return A.getGlobal() == B.getGlobal() && A.getOffset() == B.getOffset();
+  if (A.isSymbol() && B.isSymbol())
+    return StringRef(A.getSymbolName()) == B.getSymbolName() &&
+           A.getOffset() == B.getOffset();
+  if (A.isTargetIndex() && B.isTargetIndex())
+    return A.getIndex() == B.getIndex() && A.getOffset() == B.getOffset();
+  // Imaginary registers are never globals or stack slots.
+  if (A.isReg() || B.isReg())
+    return A.isImm() || B.isImm();
+  return true;
+}
+
+// Matches a group starting at I. On success, I is left just past the group.
+std::optional<Group>
+MOSWideAccumulator::matchGroup(MachineBasicBlock::iterator &I,
+                               MachineBasicBlock::iterator E) const {
+  MachineBasicBlock::iterator J = I;
+  auto Next = [&]() -> std::optional<ByteInstr> {
+    J = skipDebugInstructionsForward(J, E);
+    if (J == E)
+      return std::nullopt;
+    std::optional<ByteInstr> BI = classify(*J);
+    if (BI)
+      ++J;
+    return BI;
+  };
+
+  // Each lane is a load, any number of operations, and a store.
+  auto MatchLane = [&](SmallVectorImpl<ByteInstr> &Lane) {
+    std::optional<ByteInstr> BI = Next();
+    if (!BI || BI->K != Kind::Load)
+      return false;
+    Lane.push_back(*BI);
+    while ((BI = Next())) {
+      Lane.push_back(*BI);
+      if (BI->K == Kind::Store)
+        return true;
+      if (BI->K != Kind::Op)
+        return false;
+    }
+    return false;
+  };
+
+  Group G;
+  G.Lanes.resize(Width);
+  for (SmallVectorImpl<ByteInstr> &Lane : G.Lanes)
+    if (!MatchLane(Lane) || Lane.size() != G.Lanes.front().size())
+      return std::nullopt;
+
+  for (unsigned L = 1; L < Width; ++L) {
+    for (auto [Lo, Hi] : zip(G.Lanes[L - 1], G.Lanes[L])) {
+      if (Lo.MI->getOpcode() != Hi.MI->getOpcode() ||
+          !isNextByte(Lo.MI->getOperand(Lo.OpIdx),
+                      Hi.MI->getOperand(Hi.OpIdx), Lo.IsImm))
+        return std::nullopt;
+    }
+  }
+
+  // A carry into each byte must come from the previous byte's only carrying
+  // operation, or the wide operations would chain the carries differently.
+  unsigned NumCarrying = 0;
+  for (const ByteInstr &BI : G.Lanes.front()) {
+    switch (BI.MI->getOpcode()) {
+    case MOS::ADCImm:
+    case MOS::ADCImag8:
+    case MOS::ADCAbs:
+    case MOS::SBCImm:
+    case MOS::SBCImag8:
+    case MOS::SBCAbs:
+      ++NumCarrying;
+      break;
+    }
+    // The quad instructions only take memory operands.
+    if (Width == 4 && (BI.IsImm || BI.MI->getOperand(BI.OpIdx).isReg()))
+      return std::nullopt;
+  }
+  if (NumCarrying > 1)
+    return std::nullopt;
+
+  // The wide sequence reads every byte before storing any of them, so no
+  // store may feed a later lane.
+  for (unsigned L = 0; L + 1 < Width; ++L) {
+    const ByteInstr &St = G.Lanes[L].back();
+    const MachineOperand &Dst = St.MI->getOperand(St.OpIdx);
+    for (unsigned M = L + 1; M < Width; ++M)
+      for (const ByteInstr &BI : G.Lanes[M])
+        if (BI.K != Kind::Store && !BI.IsImm &&
+            mayAlias(Dst, BI.MI->getOperand(BI.OpIdx)))
+          return std::nullopt;
+  }
+
+  // Z and the contents of A differ between the byte-wise and wide results,
+  // and the quad instructions also overwrite X and Y.
+  if (ClobberedLiveAfter.lookup(G.Lanes.back().back().MI))
+    return std::nullopt;
+
+  I = J;
+  return G;
+}
+
+// Returns how much cheaper the wide form of G is, not counting the setup and
+// teardown around it.
+MOSInstrCost MOSWideAccumulator::savings(const Group &G) const {
+  MOSInstrCost ImmCost = MOSInstrCost::get(MOS::LDA_Immediate, *STI);
+  MOSInstrCost ZPCost = MOSInstrCost::get(MOS::LDA_ZeroPage, *STI);
+  MOSInstrCost AbsCost = MOSInstrCost::get(MOS::LDA_Absolute, *STI);
+
+  MOSInstrCost Savings;
+  if (Width == 4) {
+    // Memory operands are all laid out alike, so whether they end up in the
+    // zero page affects both forms the same way.
+    MOSInstrCost QuadCost = MOSInstrCost::get(MOS::LDQ_Absolute, *STI);
+    for (unsigned I = 0, E = G.Lanes.front().size(); I != E; ++I)
+      Savings += AbsCost * 4 - QuadCost;
+    return Savings;
+  }
+
+  MOSInstrCost Imm16Cost = MOSInstrCost::get(MOS::LDA_Immediate16, *STI);
+  // Every 16-bit memory access takes one more cycle.
+  MOSInstrCost WideAccess = MOSInstrCost(0, 1);
+  for (auto [Lo, Hi] : zip(G.Lanes[0], G.Lanes[1])) {
+    if (Lo.IsImm) {
+      Savings += ImmCost + ImmCost - Imm16Cost;
+      continue;
+    }
+    Savings += Hi.MI->getOperand(Hi.OpIdx).isReg() ? ZPCost : AbsCost;
+    Savings -= WideAccess;
+  }
+  return Savings;
+}
+
+// Returns the cost of making the accumulator wide and back again.
+MOSInstrCost MOSWideAccumulator::setupCost() const {
+  if (Width == 4)
+    return MOSInstrCost::get(MOS::LDZ_Immediate, *STI);
+  return MOSInstrCost::get(MOS::REP_Immediate, *STI) +
+         MOSInstrCost::get(MOS::SEP_Immediate, *STI);
+}
+
+static unsigned getImmediate16Opcode(unsigned Opcode) {
+  switch (Opcode) {
+  default:
+    llvm_unreachable("Unexpected opcode.");
+  case MOS::LDImm:
+    return MOS::LDA_Immediate16;
+  case MOS::ADCImm:
+    return MOS::ADC_Immediate16;
+  case MOS::SBCImm:
+    return MOS::SBC_Immediate16;
+  case MOS::ANDImm:
+    return MOS::AND_Immediate16;
+  case MOS::EORImm:
+    return MOS::EOR_Immediate16;
+  case MOS::ORAImm:
+    return MOS::ORA_Immediate16;
+  }
+}
+
+// The base page forms are relaxed to absolute ones when the operand doesn't
+// end up in the zero page, just like the byte-wise instructions.
+static unsigned getQuadOpcode(unsigned Opcode) {
+  switch (Opcode) {
+  default:
+    llvm_unreachable("Unexpected opcode.");
+  case MOS::LDAbs:
+    return MOS::LDQ_BasePage;
+  case MOS::STAbs:
+    return MOS::STQ_BasePage;
+  case MOS::ADCAbs:
+    return MOS::ADCQ_BasePage;
+  case MOS::SBCAbs:
+    return MOS::SBCQ_BasePage;
+  case MOS::ANDAbs:
+    return MOS::ANDQ_BasePage;
+  case MOS::EORAbs:
+    return MOS::EORQ_BasePage;
+  case MOS::ORAAbs:
+    return MOS::ORQ_BasePage;
+  }
+}
+
+// Replaces MI with the real instruction Opcode on Op, which carries the
+// registers of the logical instruction as implicit operands.
+static MachineInstrBuilder replaceWithReal(const MOSInstrInfo &TII,
+                                           MachineInstr &MI, unsigned Opcode,
+                                           const MachineOperand &Op) {
+  auto Real = BuildMI(*MI.getParent(), MI, MI.getDebugLoc(), TII.get(Opcode))
+                  .add(Op);
+  for (const MachineOperand &MO : MI.operands()) {
+    if (!MO.isReg())
+      continue;
+    Real.addReg(MO.getReg(), getDefRegState(MO.isDef()) | RegState::Implicit |
+                                 getDeadRegState(MO.isDead()) |
+                                 getKillRegState(MO.isKill()));
+  }
+  MI.eraseFromParent();
+  return Real;
+}
+
+// Rewrites G to operate on all bytes at once. On the 65816, memory forms keep
+// their low-byte instructions, which access 16 bits once M is clear, and
+// immediates become real 16-bit immediate instructions. On the 45GS02, every
+// low-byte instruction becomes the corresponding quad instruction.
+void MOSWideAccumulator::widen(const Group &G) const {
+  for (unsigned I = 0, E = G.Lanes.front().size(); I != E; ++I) {
+    const ByteInstr &Lo = G.Lanes.front()[I];
+    MachineInstr &MI = *Lo.MI;
+    if (Width == 4) {
+      MachineOperand Op = MI.getOperand(Lo.OpIdx);
+      auto Quad = replaceWithReal(*TII, MI, getQuadOpcode(MI.getOpcode()), Op);
+      // X and Y hold the upper bytes of Q throughout the sequence.
+      if (Lo.K != Kind::Load)
+        Quad.addReg(MOS::X, RegState::Implicit)
+            .addReg(MOS::Y, RegState::Implicit);
+      if (Lo.K != Kind::Store)
+        Quad.addReg(MOS::X, RegState::ImplicitDefine)
+            .addReg(MOS::Y, RegState::ImplicitDefine);
+    } else if (Lo.IsImm) {
+      const ByteInstr &Hi = G.Lanes[1][I];
+      int64_t Val = (MI.getOperand(Lo.OpIdx).getImm() & 0xff) |
+                    (Hi.MI->getOperand(Hi.OpIdx).getImm() & 0xff) << 8;
+      replaceWithReal(*TII, MI, getImmediate16Opcode(MI.getOpcode()),
+                      MachineOperand::CreateImm(Val));
+    }
+    for (unsigned L = 1; L < Width; ++L)
+      G.Lanes[L][I].MI->eraseFromParent();
+  }
+}
+
+bool MOSWideAccumulator::runOnBasicBlock(MachineBasicBlock &MBB) {
+  const MachineRegisterInfo &MRI = MBB.getParent()->getRegInfo();
+  SmallVector<Register, 4> Clobbered = {MOS::NZ, MOS::A};
+  if (Width == 4)
+    Clobbered.append({MOS::X, MOS::Y});
+  ClobberedLiveAfter.clear();
+  LivePhysRegs LiveRegs(*TRI);
+  LiveRegs.addLiveOuts(MBB);
+  for (MachineInstr &MI : reverse(MBB)) {
+    ClobberedLiveAfter[&MI] = any_of(
+        Clobbered, [&](Register Reg) { return !LiveRegs.available(MRI, Reg); });
+    LiveRegs.stepBackward(MI);
+  }
+
+  bool Changed = false;
+  for (MachineBasicBlock::iterator I = MBB.begin(), E = MBB.end(); I != E;) {
+    MachineBasicBlock::iterator Begin = I;
+    std::optional<Group> G = matchGroup(I, E);
+    if (!G) {
+      ++I;
+      continue;
+    }
+
+    // Gather the groups that can share a setup. Setting or clearing the
+    // carry between them is unaffected by the width of A.
+    SmallVector<Group> Groups;
+    Groups.push_back(std::move(*G));
+    MachineBasicBlock::iterator End = I;
+    while (true) {
+      MachineBasicBlock::iterator J = skipDebugInstructionsForward(I, E);
+      while (J != E && J->getOpcode() == MOS::LDCImm)
+        J = skipDebugInstructionsForward(std::next(J), E);
+      std::optional<Group> Next = matchGroup(J, E);
+      if (!Next)
+        break;
+      Groups.push_back(std::move(*Next));
+      I = End = J;
+    }
+
+    MOSInstrCost Savings = MOSInstrCost() - setupCost();
+    for (const Group &G : Groups)
+      Savings += savings(G);
+    if (Savings.value(CostMode) <= 0)
+      continue;
+
+    LLVM_DEBUG(dbgs() << "Widening " << Groups.size() << " sequences at "
+                      << *Begin);
+    DebugLoc DL = Begin->getDebugLoc();
+    if (Width == 4) {
+      BuildMI(MBB, End, DL, TII->get(MOS::LDZ_Immediate)).addImm(0);
+    } else {
+      BuildMI(MBB, Begin, DL, TII->get(MOS::REP_Immediate)).addImm(0x20);
+      BuildMI(MBB, End, DL, TII->get(MOS::SEP_Immediate)).addImm(0x20);
+    }
+    for (const Group &G : Groups)
+      widen(G);
+    Changed = true;
+  }
+  return Changed;
+}
+
+bool MOSWideAccumulator::runOnMachineFunction(MachineFunction &MF) {
+  STI = &MF.getSubtarget<MOSSubtarget>();
+  if (STI->hasW65816Native())
+    Width = 2;
+  else if (STI->has45GS02())
+    Width = 4;
+  else
+    return false;
+  if (skipFunction(MF.getFunction()))
+    return false;
+
+  TII = STI->getInstrInfo();
+  TRI = STI->getRegisterInfo();
+  MFI = MF.getInfo<MOSFunctionInfo>();
+  CostMode = MOSInstrCost::getModeFor(MF);
+
+  bool Changed = false;
+  for (MachineBasicBlock &MBB : MF)
+    Changed |= runOnBasicBlock(MBB);
+  return Changed;
+}
+
+char MOSWideAccumulator::ID = 0;
+
+INITIALIZE_PASS(MOSWideAccumulator, DEBUG_TYPE, "MOS Wide Accumulator", false,
+                false)
+
+MachineFunctionPass *llvm::createMOSWideAccumulatorPass() {
+  return new MOSWideAccumulator();
+}
@@ -9,6 +9,12 @@
 /// \file
 /// This file defines the MOS zero page allocation pass.
 ///
+/// Candidates are assigned greedily, by benefit per byte. Since large
+/// candidates can crowd out several smaller ones that would be worth more
+/// together, the assignment is then refined: each round reruns it with the
+/// multi-byte candidate worth the least in total excluded, and keeps the
+/// exclusion if the total benefit grows.
+///
 //===----------------------------------------------------------------------===//
 
 #include "MOSZeroPageAlloc.h"
@@ -20,8 +26,11 @@
 #include "MOSMachineFunctionInfo.h"
 #include "MOSRegisterInfo.h"
 #include "MOSSubtarget.h"
+#include "llvm/ADT/MapVector.h"
 #include "llvm/ADT/PostOrderIterator.h"
 #include "llvm/ADT/SCCIterator.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/Statistic.h"
 #include "llvm/Analysis/BasicAliasAnalysis.h"
 #include "llvm/Analysis/BlockFrequencyInfo.h"
 #include "llvm/Analysis/CallGraph.h"
@@ -30,6 +39,8 @@
 #include "llvm/Analysis/IVUsers.h"
 #include "llvm/Analysis/LoopInfo.h"
 #include "llvm/Analysis/MemoryDependenceAnalysis.h"
+#include "llvm/Analysis/OptimizationRemarkEmitter.h"
+#include "llvm/Analysis/ProfileSummaryInfo.h"
 #include "llvm/Analysis/ScalarEvolution.h"
 #include "llvm/Analysis/ScalarEvolutionAliasAnalysis.h"
 #include "llvm/CodeGen/LazyMachineBlockFrequencyInfo.h"
@@ -42,17 +53,36 @@
 #include "llvm/CodeGen/TargetFrameLowering.h"
 #include "llvm/CodeGen/TargetRegisterInfo.h"
 #include "llvm/CodeGen/TargetSubtargetInfo.h"
+#include "llvm/IR/Constants.h"
 #include "llvm/IR/Dominators.h"
+#include "llvm/IR/Module.h"
 #include "llvm/Support/BlockFrequency.h"
 #include "llvm/Support/Casting.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/TimeProfiler.h"
 #include <algorithm>
 #include <memory>
+#include <optional>
 #include <utility>
 
 #define DEBUG_TYPE "mos-zero-page-alloc"
 
 using namespace llvm;
 
+STATISTIC(NumCandidates, "Number of zero page candidates");
+STATISTIC(NumAssignSteps, "Number of zero page assignment steps");
+STATISTIC(NumUnassigned,
+          "Number of partial assignments undone for no longer fitting");
+STATISTIC(NumGlobalsAssigned, "Number of globals moved to the zero page");
+STATISTIC(NumGlobalBytesAssigned, "Number of zero page bytes given to globals");
+STATISTIC(NumFrameBytesAssigned,
+          "Number of zero page bytes given to frames and callee-saved "
+          "registers");
+STATISTIC(NumLinkCandidates,
+          "Number of globals left for the linker to place in the zero page");
+STATISTIC(NumRefinements,
+          "Number of candidates excluded to improve the zero page assignment");
+
 namespace {
 
 cl::opt<uint64_t> ZPAvail("zp-avail",
@@ -60,6 +90,24 @@ cl::opt<uint64_t> ZPAvail("zp-avail",
                                    "the compiler in the current TU"),
                           cl::value_desc("bytes"));
 
+cl::opt<bool> ZPLinkCandidates(
+    "mos-zp-link-candidates",
+    cl::desc("Leave the global zero page candidates that don't fit in the "
+             "current TU for the linker to place; the linker script must "
+             "place the .zp_candidate.* sections"),
+    cl::init(false), cl::Hidden);
+
+cl::opt<unsigned> ZPRefineRounds(
+    "mos-zp-refine-rounds",
+    cl::desc("Number of times to rerun zero page assignment with a large "
+             "candidate excluded, looking for a better total benefit"),
+    cl::init(8), cl::Hidden);
+
+cl::opt<bool> ZPUseProfile(
+    "mos-zp-use-profile",
+    cl::desc("Weigh zero page candidates by profile counts when available"),
+    cl::init(true), cl::Hidden);
+
 struct SCC;
 
 struct Candidate {
@@ -144,6 +192,11 @@ struct SCC {
   // is within an interrupt-norecurse call, only considers the contents of the
   // call.
   size_t MaxZPSize = 0;
+
+  // The base page that this SCC's frame is placed in, if it's only reachable
+  // from entry points that run on that page. Offsets are then relative to the
+  // start of the page's stack.
+  StringRef BasePage;
 };
 
 // A view of the SCC graph rooted at an externally callable node. Since we can't
@@ -157,6 +210,15 @@ struct EntryGraph {
 
   bool IsINR = false;
 
+  // Interrupt-norecurse entry graphs in the same nonzero overlay group are
+  // mutually exclusive, so their zero page areas start at the same offset.
+  unsigned OverlayGroup = 0;
+
+  // The base page this entry point switches to, if any. Its frames have the
+  // page to themselves, so they neither compete with nor follow the others.
+  // Entry points that share a base page must not preempt one another.
+  StringRef BasePage;
+
   size_t NextCand = 0;
 };
 
@@ -172,6 +234,10 @@ struct SCCGraph {
   size_t RegularZPSize = 0;
   DenseMap<const MachineFunction *, size_t> MFZPSizes =
       DenseMap<const MachineFunction *, size_t>();
+  // The largest interrupt ZP size of any entry graph in each overlay group.
+  DenseMap<unsigned, size_t> OverlayZPSizes = DenseMap<unsigned, size_t>();
+  // The largest ZP size of any entry graph on each base page.
+  MapVector<StringRef, size_t> BasePageZPSizes = MapVector<StringRef, size_t>();
 };
 
 } // namespace
@@ -223,6 +289,26 @@ public:
 private:
   MachineModuleInfo *MMI;
   unsigned ModuleZPAvail;
+  // Whether candidate benefits are measured in absolute profile counts,
+  // rather than relative to the entry of each entry graph.
+  bool UseProfile;
+  // Globals already reported as ineligible for the zero page.
+  SmallPtrSet<const GlobalVariable *, 8> ReportedIneligible;
+  // Candidates excluded from assignment by refinement.
+  SmallPtrSet<const Candidate *, 4> Excluded;
+  // The block frequencies of each function, by block number. A module pass
+  // gets a fresh BlockFrequencyInfo on every request, so these are computed
+  // at most once per function, and only for those that need them.
+  DenseMap<const MachineFunction *, SmallVector<float>> BlockFreqs;
+  // The summed frequencies of each function's calls, by callee.
+  DenseMap<const MachineFunction *,
+           std::vector<std::pair<const Function *, float>>>
+      CallFreqs;
+
+  float getBlockFreq(MachineBasicBlock &MBB);
+  ArrayRef<std::pair<const Function *, float>>
+  getCallFreqs(Module &M, MachineFunction &MF);
+
   SCCGraph buildSCCGraph(Module &M);
 
   void collectCandidates(MachineFunction &MF,
@@ -231,9 +317,17 @@ private:
                          DenseMap<GlobalVariable *, Candidate *> &GVCandidates);
 
   std::vector<EntryGraph> buildEntryGraphs(Module &M, SCCGraph &SCCGraph);
+  void partitionBasePages(std::vector<EntryGraph> &EntryGraphs);
+  float assignAll(SCCGraph &SCCGraph, std::vector<EntryGraph> &EntryGraphs,
+                  std::vector<EntryGraph>::iterator RegularEGBegin);
+  void refineAssignment(SCCGraph &SCCGraph,
+                        std::vector<EntryGraph> &EntryGraphs,
+                        std::vector<EntryGraph>::iterator RegularEGBegin);
   bool assignZPs(SCCGraph &SCCGraph, std::vector<EntryGraph>::iterator Begin,
                  std::vector<EntryGraph>::iterator End);
   bool assignZP(SCCGraph &SCCGraph, EntryGraph &EG);
+  bool nominateLinkCandidates(ArrayRef<EntryGraph> EntryGraphs);
+  void emitRemarks(const SCCGraph &SCCGraph, ArrayRef<EntryGraph> EntryGraphs);
 };
 
 void MOSZeroPageAlloc::getAnalysisUsage(AnalysisUsage &AU) const {
@@ -242,6 +336,7 @@ void MOSZeroPageAlloc::getAnalysisUsage(AnalysisUsage &AU) const {
   AU.addPreserved<MachineModuleInfoWrapperPass>();
   AU.addRequired<BlockFrequencyInfoWrapperPass>();
   AU.addRequired<CallGraphWrapperPass>();
+  AU.addRequired<ProfileSummaryInfoWrapperPass>();
 
   AU.addPreserved<BasicAAWrapperPass>();
   AU.addPreserved<DominanceFrontierWrapperPass>();
@@ -257,32 +352,67 @@ void MOSZeroPageAlloc::getAnalysisUsage(AnalysisUsage &AU) const {
 
 } // namespace
 
-static float getFreq(const BlockFrequencyInfo &BFI, MachineBasicBlock &MBB);
-
-bool MOSZeroPageAlloc::runOnModule(Module &M) {
-  if (!ZPAvail)
-    return false;
+static float getFreq(const BlockFrequencyInfo &BFI, MachineBasicBlock &MBB,
+                     bool UseProfile);
 
+// Returns the zero page left for the compiler once the globals that the user
+// placed there are accounted for, or std::nullopt if those alone don't fit.
+static std::optional<uint64_t> getZPLeft(const Module &M) {
   // The frontend should report this error on the corresponding option.
   assert(ZPAvail <= 256 - 32 &&
          "There must be room for the imaginary registers.");
 
-  ModuleZPAvail = ZPAvail;
-  for (GlobalVariable &GV : M.globals()) {
+  uint64_t Left = ZPAvail;
+  for (const GlobalVariable &GV : M.globals()) {
     StringRef SecName = GV.getSection();
     if (MOS::isZeroPageSectionName(SecName) ||
         GV.getAddressSpace() == MOS::AS_ZeroPage) {
-      size_t Size = (GV.getParent()->getDataLayout().getTypeSizeInBits(
-                         GV.getValueType()) +
-                     7) /
-                    8;
-      if (Size >= ModuleZPAvail)
-        return false;
-      ModuleZPAvail -= Size;
+      size_t Size =
+          (M.getDataLayout().getTypeSizeInBits(GV.getValueType()) + 7) / 8;
+      if (Size >= Left)
+        return std::nullopt;
+      Left -= Size;
     }
   }
+  return Left;
+}
+
+uint64_t mos::getZeroPageBudget(const Module &M) {
+  return getZPLeft(M).value_or(0);
+}
+
+// Returns the total benefit of the candidates assigned within an entry graph.
+static float getAssignedBenefit(const EntryGraph &EG) {
+  float Benefit = 0;
+  for (const EntryCandidate &EC : EG.Candidates)
+    if (EC.LC->Cand->AssignedSize == EC.LC->Cand->Size)
+      Benefit += EC.Benefit * EC.LC->Cand->Size;
+  return Benefit;
+}
+
+bool MOSZeroPageAlloc::runOnModule(Module &M) {
+  if (!ZPAvail && !ZPLinkCandidates)
+    return false;
+
+  // A partition of the LTO module gets the share of the whole module's zero
+  // page that was set aside for it when the module was split.
+  if (auto *Share = mdconst::extract_or_null<ConstantInt>(
+          M.getModuleFlag("mos-zp-avail")))
+    ModuleZPAvail = Share->getZExtValue();
+  else if (std::optional<uint64_t> Left = getZPLeft(M))
+    ModuleZPAvail = *Left;
+  // The linker may still find room for the candidates elsewhere in the
+  // program.
+  else if (ZPLinkCandidates)
+    ModuleZPAvail = 0;
+  else
+    return false;
 
   MMI = &getAnalysis<MachineModuleInfoWrapperPass>().getMMI();
+  ReportedIneligible.clear();
+  UseProfile =
+      ZPUseProfile &&
+      getAnalysis<ProfileSummaryInfoWrapperPass>().getPSI().hasProfileSummary();
 
   LLVM_DEBUG(dbgs() << "*******************************************************"
                        "*************************\n");
@@ -291,29 +421,41 @@ bool MOSZeroPageAlloc::runOnModule(Module &M) {
                        "*************************\n");
 
   SCCGraph SCCGraph = buildSCCGraph(M);
+  NumCandidates += SCCGraph.Candidates.size();
 
   std::vector<EntryGraph> EntryGraphs = buildEntryGraphs(M, SCCGraph);
+  partitionBasePages(EntryGraphs);
 
   // Interrupt-norecurse functions get absolute priority, since they're almost
   // always time-sensitive, and they have an abnormally high number of CSRs.
   const auto RegularEGBegin =
       partition(EntryGraphs, [](EntryGraph &EG) { return !EG.IsINR; });
 
-  // Assign ZP locations to entry graphs round-robin until no candidates remain.
   LLVM_DEBUG(dbgs() << "Assigning ZP to candidates:\n");
-  while (assignZPs(SCCGraph, EntryGraphs.begin(), RegularEGBegin))
-    ;
-  while (assignZPs(SCCGraph, RegularEGBegin, EntryGraphs.end()))
-    ;
+  {
+    TimeTraceScope Scope("MOSZeroPageAlloc::assignZPs");
+    Excluded.clear();
+    assignAll(SCCGraph, EntryGraphs, RegularEGBegin);
+    refineAssignment(SCCGraph, EntryGraphs, RegularEGBegin);
+  }
 
   // Move the offsets of the interrupts after everything else and after one
   // another.
   size_t InterruptOffset = SCCGraph.GlobalZPSize + SCCGraph.RegularZPSize;
+  DenseMap<unsigned, size_t> OverlayOffsets;
   for (EntryGraph &EG : EntryGraphs) {
     if (!EG.IsINR)
       continue;
-    EG.Entry->ZPOffset = InterruptOffset;
-    InterruptOffset += EG.Entry->MaxZPSize;
+    if (EG.OverlayGroup) {
+      auto [It, Inserted] =
+          OverlayOffsets.try_emplace(EG.OverlayGroup, InterruptOffset);
+      EG.Entry->ZPOffset = It->second;
+      if (Inserted)
+        InterruptOffset += SCCGraph.OverlayZPSizes[EG.OverlayGroup];
+    } else {
+      EG.Entry->ZPOffset = InterruptOffset;
+      InterruptOffset += EG.Entry->MaxZPSize;
+    }
     for (SCC *Comp : ReversePostOrderTraversal<SCC>(*EG.Entry)) {
       size_t EndOffset = Comp->ZPOffset + Comp->ZPSize;
       for (struct SCC *Callee : Comp->Callees)
@@ -336,6 +478,20 @@ bool MOSZeroPageAlloc::runOnModule(Module &M) {
     LLVM_DEBUG(dbgs() << "  " << *Stack << '\n');
   }
 
+  // Each base page gets a stack of its own in its .bp.<page> section.
+  DenseMap<StringRef, GlobalVariable *> PageStacks;
+  for (const auto &[Page, Size] : SCCGraph.BasePageZPSizes) {
+    Type *Typ = ArrayType::get(Type::getInt8Ty(M.getContext()), Size);
+    auto *PageStack = new GlobalVariable(
+        M, Typ, /*IsConstant=*/false, GlobalValue::PrivateLinkage,
+        UndefValue::get(Typ), Twine(Page) + "_bp_stack",
+        /*InsertBefore=*/nullptr, GlobalValue::NotThreadLocal,
+        MOS::AS_ZeroPage);
+    PageStack->setSection((".bp." + Page).str());
+    PageStacks[Page] = PageStack;
+    LLVM_DEBUG(dbgs() << "  " << *PageStack << '\n');
+  }
+
   bool Changed = false;
   DenseMap<const MachineFunction *, size_t> NextOffsets;
   for (std::unique_ptr<Candidate> &Cand : SCCGraph.Candidates) {
@@ -343,6 +499,8 @@ bool MOSZeroPageAlloc::runOnModule(Module &M) {
       continue;
     Changed = true;
     if (Cand->GV) {
+      ++NumGlobalsAssigned;
+      NumGlobalBytesAssigned += Cand->Size;
       // The dance here with Tmp avoids an infinite recursion in
       // replaceAllUsesWith().
       auto *Tmp = new GlobalVariable(
@@ -355,16 +513,20 @@ bool MOSZeroPageAlloc::runOnModule(Module &M) {
       Tmp->eraseFromParent();
       LLVM_DEBUG(dbgs() << "  " << *Cand->GV << '\n');
     } else {
+      NumFrameBytesAssigned += Cand->Size;
       MachineFunction &MF = *Cand->MF;
       MachineFrameInfo &MFI = MF.getFrameInfo();
       auto Res = NextOffsets.try_emplace(&MF, 0);
       size_t &Offset = Res.first->second;
       if (Res.second) {
-        Constant *Aliasee = Stack;
+        GlobalVariable *Base = Cand->Comp->BasePage.empty()
+                                   ? Stack
+                                   : PageStacks.lookup(Cand->Comp->BasePage);
+        Constant *Aliasee = Base;
         if (Cand->Comp->ZPOffset) {
-          Type *I16 = Type::getInt16Ty(Stack->getContext());
+          Type *I16 = Type::getInt16Ty(Base->getContext());
           Aliasee = ConstantExpr::getGetElementPtr(
-              Stack->getValueType(), Stack,
+              Base->getValueType(), Base,
               SmallVector<Constant *>{
                   ConstantInt::get(I16, 0),
                   ConstantInt::get(I16, Cand->Comp->ZPOffset)},
@@ -374,8 +536,8 @@ bool MOSZeroPageAlloc::runOnModule(Module &M) {
         Type *Typ =
             ArrayType::get(Type::getInt8Ty(M.getContext()), Cand->Comp->ZPSize);
         auto *Alias = GlobalAlias::create(
-            Typ, Stack->getAddressSpace(), Stack->getLinkage(),
-            Twine(MF.getName()) + "_zp_stk", Aliasee, Stack->getParent());
+            Typ, Base->getAddressSpace(), Base->getLinkage(),
+            Twine(MF.getName()) + "_zp_stk", Aliasee, Base->getParent());
         LLVM_DEBUG(dbgs() << "  " << *Alias);
         MF.getInfo<MOSFunctionInfo>()->ZeroPageStackValue = Alias;
       }
@@ -401,15 +563,152 @@ bool MOSZeroPageAlloc::runOnModule(Module &M) {
     }
   }
 
+  if (ZPLinkCandidates)
+    Changed |= nominateLinkCandidates(EntryGraphs);
+
+  emitRemarks(SCCGraph, EntryGraphs);
+  BlockFreqs.clear();
+  CallFreqs.clear();
+  return Changed;
+}
+
+// Reports the fate of each candidate: which globals got the zero page and why
+// the others didn't, and how much of each function's frame and callee-saved
+// registers moved there.
+void MOSZeroPageAlloc::emitRemarks(const SCCGraph &SCCGraph,
+                                   ArrayRef<EntryGraph> EntryGraphs) {
+  // Globals are reported at the first function to reference them.
+  DenseMap<const Candidate *, Function *> GVFunctions;
+  for (const SCC &Component : SCCGraph.SCCs)
+    for (const LocalCandidate &LC : Component.Candidates)
+      if (LC.Cand->GV && !Component.Funcs.empty())
+        GVFunctions.try_emplace(LC.Cand, Component.Funcs.front());
+  SmallPtrSet<const Candidate *, 8> Scored;
+  for (const EntryGraph &EG : EntryGraphs)
+    for (const EntryCandidate &EC : EG.Candidates)
+      Scored.insert(EC.LC->Cand);
+
+  MapVector<const MachineFunction *, std::pair<size_t, size_t>> FrameSizes;
+  for (const std::unique_ptr<Candidate> &Cand : SCCGraph.Candidates) {
+    bool Assigned = Cand->AssignedSize == Cand->Size;
+    if (!Cand->GV) {
+      auto &[AssignedSize, Size] = FrameSizes[Cand->MF];
+      Size += Cand->Size;
+      if (Assigned)
+        AssignedSize += Cand->Size;
+      continue;
+    }
+
+    Function *F = GVFunctions.lookup(Cand.get());
+    if (!F)
+      continue;
+    OptimizationRemarkEmitter ORE(F);
+    if (Assigned) {
+      ORE.emit([&]() {
+        return OptimizationRemark(DEBUG_TYPE, "GlobalZeroPage", F)
+               << "moved global " << ore::NV("Global", Cand->GV) << " ("
+               << ore::NV("Bytes", Cand->Size) << " bytes) to the zero page";
+      });
+      continue;
+    }
+    ORE.emit([&]() {
+      OptimizationRemarkMissed R(DEBUG_TYPE, "GlobalNoZeroPage", F);
+      R << "global " << ore::NV("Global", Cand->GV) << " ("
+        << ore::NV("Bytes", Cand->Size) << " bytes) ";
+      if (!Scored.contains(Cand.get()))
+        R << "was not worth the cost of initializing in the zero page";
+      else if (Cand->GV->getSection().starts_with(".zp_candidate."))
+        R << "did not fit in the zero page; left for the linker to place";
+      else
+        R << "did not fit in the " << ore::NV("Available", ModuleZPAvail)
+          << " bytes of zero page available";
+      return R;
+    });
+  }
+
+  // The benefit is in cycles and bytes saved together, for each call of the
+  // entry point, or in total with a profile.
+  for (const EntryGraph &EG : EntryGraphs) {
+    float Benefit = getAssignedBenefit(EG);
+    Function *F = EG.Entry->Funcs.empty() ? nullptr : EG.Entry->Funcs.front();
+    if (!F || F->isDeclaration() || !Benefit)
+      continue;
+    OptimizationRemarkEmitter ORE(F);
+    ORE.emit([&]() {
+      return OptimizationRemarkAnalysis(DEBUG_TYPE, "ZeroPageBenefit", F)
+             << "zero page assignments reachable from this entry point save "
+             << ore::NV("Benefit", uint64_t(Benefit)) << " cycles and bytes "
+             << (UseProfile ? "in total" : "per call");
+    });
+  }
+
+  for (const auto &[MF, Sizes] : FrameSizes) {
+    const Function &F = MF->getFunction();
+    OptimizationRemarkEmitter ORE(&F);
+    ORE.emit([&]() {
+      return OptimizationRemarkAnalysis(DEBUG_TYPE, "FrameZeroPage", &F)
+             << "placed " << ore::NV("AssignedBytes", Sizes.first) << " of "
+             << ore::NV("CandidateBytes", Sizes.second)
+             << " bytes of static frame and callee-saved registers in the "
+                "zero page";
+    });
+  }
+}
+
+// Places the global candidates that didn't fit in this TU's share of the zero
+// page in sections of their own, so that the linker can give them whatever
+// zero page the whole program leaves over. The sections are named
+// .zp_candidate.<key>.<name>, where the keys count down with benefit, so that
+// sorting by name puts the most beneficial first. A linker script lists them
+// in the zero page region, then again in RAM, and lets the rest spill there;
+// with linker relaxation, the references to those that land in the zero page
+// then shrink to zero page addressing.
+//
+// Only zero and undefined initializers are supported, since either region's
+// CRT zeroing applies to them.
+bool MOSZeroPageAlloc::nominateLinkCandidates(
+    ArrayRef<EntryGraph> EntryGraphs) {
+  MapVector<GlobalVariable *, float> Benefits;
+  for (const EntryGraph &EG : EntryGraphs) {
+    for (const EntryCandidate &EC : EG.Candidates) {
+      const Candidate &Cand = *EC.LC->Cand;
+      if (!Cand.GV || Cand.AssignedSize == Cand.Size)
+        continue;
+      float &Benefit = Benefits[Cand.GV];
+      Benefit = std::max(Benefit, EC.Benefit);
+    }
+  }
+
+  bool Changed = false;
+  for (auto [GV, Benefit] : Benefits) {
+    const Constant *Init = GV->getInitializer();
+    if (GV->isConstant() || GV->hasComdat() || GV->isThreadLocal() ||
+        !(Init->isNullValue() || isa<UndefValue>(Init)))
+      continue;
+    // Keys are in units of 1/16 of the benefit.
+    constexpr uint64_t MaxKey = 99999999;
+    uint64_t Key = MaxKey - std::min<uint64_t>(Benefit * 16, MaxKey);
+    std::string Section;
+    raw_string_ostream(Section)
+        << ".zp_candidate." << format("%08" PRIu64, Key) << '.'
+        << GV->getName();
+    LLVM_DEBUG(dbgs() << "Nominating " << GV->getName() << " as " << Section
+                      << '\n');
+    GV->setSection(Section);
+    ++NumLinkCandidates;
+    Changed = true;
+  }
   return Changed;
 }
 
 // Contract the call graph into its strongly-connect components, then build a
 // SCC DAG out of the results.
 SCCGraph MOSZeroPageAlloc::buildSCCGraph(Module &M) {
+  TimeTraceScope Scope("MOSZeroPageAlloc::buildSCCGraph");
   auto &CG = getAnalysis<CallGraphWrapperPass>().getCallGraph();
 
   mos::addLibcallEdges(CG, *MMI);
+  mos::resolveIndirectCalls(CG);
   mos::addExternalEdges(CG);
   LLVM_DEBUG(CG.dump());
 
@@ -436,7 +735,14 @@ SCCGraph MOSZeroPageAlloc::buildSCCGraph(Module &M) {
       MachineFunction *MF = MMI->getMachineFunction(*F);
       if (!MF)
         continue;
+      size_t Begin = SCC.Candidates.size();
       collectCandidates(*MF, Candidates, SCC.Candidates, GVCandidates);
+      // A function directive may weigh the function's candidates up or down.
+      uint64_t Priority =
+          F->getFnAttributeAsParsedInteger("mos-zp-priority", 1);
+      if (Priority != 1)
+        for (LocalCandidate &LC : drop_begin(SCC.Candidates, Begin))
+          LC.Benefit *= Priority;
     }
   }
   for (const auto &KV : enumerate(SCCCallees)) {
@@ -479,8 +785,6 @@ void MOSZeroPageAlloc::collectCandidates(
     SmallVectorImpl<LocalCandidate> &LocalCandidates,
     DenseMap<GlobalVariable *, Candidate *> &GVCandidates) {
   const MachineFrameInfo &MFI = MF.getFrameInfo();
-  auto &BFI =
-      getAnalysis<BlockFrequencyInfoWrapperPass>(MF.getFunction()).getBFI();
 
   DenseMap<GlobalVariable *, float> GlobalBenefit;
   for (MachineBasicBlock &MBB : MF) {
@@ -492,15 +796,30 @@ void MOSZeroPageAlloc::collectCandidates(
           if (!GO)
             continue;
           const auto *GV = dyn_cast<GlobalVariable>(GO);
-          if (!GV || GV->isDeclaration() || GV->getAlign().valueOrOne() != 1 ||
-              GV->hasSection() || GV->hasImplicitSection() ||
+          if (!GV || GV->isDeclaration() ||
               GV->getAddressSpace() == MOS::AS_ZeroPage)
             continue;
+          if (GV->getAlign().valueOrOne() != 1 || GV->hasSection() ||
+              GV->hasImplicitSection()) {
+            if (ReportedIneligible.insert(GV).second) {
+              OptimizationRemarkEmitter ORE(&MF.getFunction());
+              ORE.emit([&]() {
+                return OptimizationRemarkMissed(DEBUG_TYPE, "GlobalIneligible",
+                                                &MF.getFunction())
+                       << "global " << ore::NV("Global", GV)
+                       << " cannot move to the zero page, since it "
+                       << (GV->getAlign().valueOrOne() != 1
+                               ? "is overaligned"
+                               : "is placed in a section");
+              });
+            }
+            continue;
+          }
 
           // Generally moving an absolute reference to the zero page saves one
           // cycle and one byte.
           GlobalBenefit[const_cast<GlobalVariable *>(GV)] +=
-              2 * getFreq(BFI, MBB);
+              2 * getBlockFreq(MBB);
         }
       }
     }
@@ -535,21 +854,21 @@ void MOSZeroPageAlloc::collectCandidates(
   float SaveFreq = 0;
   float RestoreFreq = 0;
   if (MFI.getSavePoints().empty()) {
-    SaveFreq = getFreq(BFI, *MF.begin());
+    SaveFreq = getBlockFreq(*MF.begin());
     for (MachineBasicBlock &MBB : MF) {
       if (MBB.isReturnBlock())
-        RestoreFreq += getFreq(BFI, MBB);
+        RestoreFreq += getBlockFreq(MBB);
     }
   } else {
     for (const auto &[SavePoint, _] : MFI.getSavePoints())
-      SaveFreq += getFreq(BFI, *SavePoint);
+      SaveFreq += getBlockFreq(*SavePoint);
     for (const auto &[RestorePoint, _] : MFI.getRestorePoints()) {
       // If block does not have any successor and is not a return block
       // then the end point is unreachable and we do not need to insert any
       // epilogue.
       if (RestorePoint->succ_empty() && RestorePoint->isReturnBlock())
         continue;
-      RestoreFreq += getFreq(BFI, *RestorePoint);
+      RestoreFreq += getBlockFreq(*RestorePoint);
     }
   }
 
@@ -625,7 +944,7 @@ void MOSZeroPageAlloc::collectCandidates(
     for (MachineInstr *MI : FIMIs[I]) {
       // Generally moving an absolute reference to the zero page saves one
       // cycle and one byte.
-      Benefit += 2 * getFreq(BFI, *MI->getParent());
+      Benefit += 2 * getBlockFreq(*MI->getParent());
     }
     auto Size = static_cast<size_t>(MFI.getObjectSize(I));
     Benefit /= Size;
@@ -668,12 +987,28 @@ static bool isSuitableForNoInit(const GlobalVariable *GV) {
 // point.
 std::vector<EntryGraph> MOSZeroPageAlloc::buildEntryGraphs(Module &M,
                                                            SCCGraph &SCCGraph) {
+  TimeTraceScope Scope("MOSZeroPageAlloc::buildEntryGraphs");
   std::vector<EntryGraph> EntryGraphs;
   for (SCC *Entry : SCCGraph.ExternalCallingSCC->Callees) {
     EntryGraphs.push_back(EntryGraph{Entry});
-    EntryGraphs.back().IsINR = any_of(Entry->Funcs, [](Function *F) {
-      return F->hasFnAttribute("interrupt-norecurse");
-    });
+    EntryGraph &EG = EntryGraphs.back();
+    for (Function *F : Entry->Funcs) {
+      EG.BasePage = mos::getBasePage(*F);
+      if (!EG.BasePage.empty())
+        break;
+    }
+    // An interrupt on a base page of its own needn't stay clear of the zero
+    // page areas of the others.
+    EG.IsINR = EG.BasePage.empty() && any_of(Entry->Funcs, [](Function *F) {
+                 return F->hasFnAttribute("interrupt-norecurse");
+               });
+    if (!EG.IsINR)
+      continue;
+    for (Function *F : Entry->Funcs) {
+      EG.OverlayGroup = mos::getInterruptOverlayGroup(*F);
+      if (EG.OverlayGroup)
+        break;
+    }
   }
   for (EntryGraph &EG : EntryGraphs) {
     LLVM_DEBUG({
@@ -708,46 +1043,33 @@ std::vector<EntryGraph> MOSZeroPageAlloc::buildEntryGraphs(Module &M,
         if (!MF)
           continue;
 
-        auto &BFI = getAnalysis<BlockFrequencyInfoWrapperPass>(*F).getBFI();
-        for (MachineBasicBlock &MBB : *MF) {
-          for (const MachineInstr &MI : MBB) {
-            if (!MI.isCall())
-              continue;
-            for (const MachineOperand &MO : MI.operands()) {
-              const Function *Callee = nullptr;
-              if (MO.isGlobal())
-                Callee = dyn_cast<Function>(MO.getGlobal());
-              else if (MO.isSymbol())
-                Callee = mos::getSymbolFunction(M, MO.getSymbolName());
-              if (!Callee)
-                continue;
-              float Freq = getFreq(BFI, MBB);
-              if (is_contained(Component->Funcs, Callee)) {
-                LLVM_DEBUG(dbgs() << "      Recursively calls "
-                                  << Callee->getName() << " " << Freq << '\n');
-                // Recursive calls are another way to enter the given SCC, so
-                // increase the Entry frequency. Don't compound the increases
-                // though; it's not worth risking overflowing the entry counts,
-                // especially since possible recursion paths may be accidental.
-                EntryFreq += OldEntryFreq * Freq;
-                LLVM_DEBUG(dbgs() << "    SCC freq += " << OldEntryFreq * Freq
-                                  << '\n');
-              }
-              // Defer handling normal calls until after the loop; the final
-              // entry frequency won't be known until afterwards.
-              LLVM_DEBUG(dbgs() << "      Calls " << Callee->getName() << ' '
-                                << Freq << '\n');
-              CalleeFreqs[Callee] += Freq;
-            }
+        for (const auto &[Callee, Freq] : getCallFreqs(M, *MF)) {
+          if (is_contained(Component->Funcs, Callee)) {
+            LLVM_DEBUG(dbgs() << "      Recursively calls " << Callee->getName()
+                              << " " << Freq << '\n');
+            // Recursive calls are another way to enter the given SCC, so
+            // increase the Entry frequency. Don't compound the increases
+            // though; it's not worth risking overflowing the entry counts,
+            // especially since possible recursion paths may be accidental.
+            EntryFreq += OldEntryFreq * Freq;
+            LLVM_DEBUG(dbgs() << "    SCC freq += " << OldEntryFreq * Freq
+                              << '\n');
           }
+          // Defer handling normal calls until after the loop; the final
+          // entry frequency won't be known until afterwards.
+          LLVM_DEBUG(dbgs() << "      Calls " << Callee->getName() << ' '
+                            << Freq << '\n');
+          CalleeFreqs[Callee] += Freq;
         }
       }
       // Now that recursion has been handled, the final entry frequency is known
       // for the component.
 
-      // Apply the final entry frequency to the candidates.
+      // Apply the final entry frequency to the candidates. Profile counts are
+      // already absolute, so they need no scaling.
       for (LocalCandidate &LC : Component->Candidates) {
-        EntryCandidate EC{&LC, EntryFreq * LC.Benefit};
+        EntryCandidate EC{&LC,
+                          UseProfile ? LC.Benefit : EntryFreq * LC.Benefit};
         if (LC.Cand->GV && LC.Cand->GV->hasInitializer() &&
             !isSuitableForNoInit(LC.Cand->GV)) {
           // Pessimistically assume that initializing the global variable costs
@@ -787,6 +1109,123 @@ std::vector<EntryGraph> MOSZeroPageAlloc::buildEntryGraphs(Module &M,
   return EntryGraphs;
 }
 
+// Code reached from an entry point on a base page addresses the zero page
+// relative to that page. Its frames can only be placed there if no entry point
+// on any other page reaches them too, and the globals it refers to can't be
+// placed in the zero page at all, since it wouldn't find them there. Such
+// candidates are dropped from every entry graph.
+void MOSZeroPageAlloc::partitionBasePages(
+    std::vector<EntryGraph> &EntryGraphs) {
+  if (all_of(EntryGraphs,
+             [](const EntryGraph &EG) { return EG.BasePage.empty(); }))
+    return;
+
+  DenseMap<SCC *, StringRef> Pages;
+  SmallPtrSet<SCC *, 8> Shared;
+  SmallPtrSet<SCC *, 8> OnBasePage;
+  for (EntryGraph &EG : EntryGraphs) {
+    for (SCC *Comp : ReversePostOrderTraversal<EntryGraph>(EG)) {
+      auto [It, Inserted] = Pages.try_emplace(Comp, EG.BasePage);
+      if (!Inserted && It->second != EG.BasePage)
+        Shared.insert(Comp);
+      if (!EG.BasePage.empty())
+        OnBasePage.insert(Comp);
+    }
+  }
+
+  SmallPtrSet<const Candidate *, 8> Dropped;
+  for (SCC *Comp : OnBasePage) {
+    bool IsShared = Shared.contains(Comp);
+    if (!IsShared)
+      Comp->BasePage = Pages.lookup(Comp);
+    for (const LocalCandidate &LC : Comp->Candidates)
+      if (LC.Cand->GV || IsShared)
+        Dropped.insert(LC.Cand);
+  }
+  LLVM_DEBUG(dbgs() << "Dropped " << Dropped.size()
+                    << " candidates unplaceable from base pages\n");
+  for (EntryGraph &EG : EntryGraphs)
+    erase_if(EG.Candidates, [&](const EntryCandidate &EC) {
+      return Dropped.contains(EC.LC->Cand);
+    });
+}
+
+// Assigns ZP locations to entry graphs round-robin until no candidates remain,
+// starting from scratch. Returns the total benefit of the assignment.
+float MOSZeroPageAlloc::assignAll(
+    SCCGraph &SCCGraph, std::vector<EntryGraph> &EntryGraphs,
+    std::vector<EntryGraph>::iterator RegularEGBegin) {
+  for (std::unique_ptr<Candidate> &Cand : SCCGraph.Candidates)
+    Cand->AssignedSize = 0;
+  for (SCC &Comp : SCCGraph.SCCs)
+    Comp.ZPOffset = Comp.ZPSize = Comp.MaxZPSize = 0;
+  SCCGraph.GlobalZPSize = SCCGraph.InterruptZPSize = SCCGraph.RegularZPSize =
+      0;
+  SCCGraph.MFZPSizes.clear();
+  SCCGraph.OverlayZPSizes.clear();
+  SCCGraph.BasePageZPSizes.clear();
+  for (EntryGraph &EG : EntryGraphs)
+    EG.NextCand = 0;
+
+  while (assignZPs(SCCGraph, EntryGraphs.begin(), RegularEGBegin))
+    ;
+  while (assignZPs(SCCGraph, RegularEGBegin, EntryGraphs.end()))
+    ;
+
+  float Benefit = 0;
+  for (const EntryGraph &EG : EntryGraphs)
+    Benefit += getAssignedBenefit(EG);
+  return Benefit;
+}
+
+// Greedy assignment by benefit per byte can give a large candidate the room
+// that several smaller ones would have made better use of. Try excluding the
+// assigned multi-byte candidates worth the least in total, one at a time,
+// keeping each exclusion that improves the total benefit.
+void MOSZeroPageAlloc::refineAssignment(
+    SCCGraph &SCCGraph, std::vector<EntryGraph> &EntryGraphs,
+    std::vector<EntryGraph>::iterator RegularEGBegin) {
+  if (!ZPRefineRounds)
+    return;
+
+  float Best = 0;
+  DenseMap<const Candidate *, float> Worth;
+  for (const EntryGraph &EG : EntryGraphs) {
+    Best += getAssignedBenefit(EG);
+    for (const EntryCandidate &EC : EG.Candidates)
+      Worth[EC.LC->Cand] += EC.Benefit * EC.LC->Cand->Size;
+  }
+  SmallVector<const Candidate *> Trials;
+  for (const std::unique_ptr<Candidate> &Cand : SCCGraph.Candidates)
+    if (Cand->Size > 1 && Cand->AssignedSize == Cand->Size)
+      Trials.push_back(Cand.get());
+  // Members of the same SCC tie in frequency; break ties by order of
+  // collection, so that the result doesn't depend on pointer values.
+  stable_sort(Trials, [&](const Candidate *A, const Candidate *B) {
+    return Worth.lookup(A) < Worth.lookup(B);
+  });
+  if (Trials.size() > ZPRefineRounds)
+    Trials.resize(ZPRefineRounds);
+
+  bool BestIsCurrent = true;
+  for (const Candidate *Trial : Trials) {
+    Excluded.insert(Trial);
+    float Benefit = assignAll(SCCGraph, EntryGraphs, RegularEGBegin);
+    LLVM_DEBUG(dbgs() << "Excluding " << *Trial << ": benefit " << Benefit
+                      << " vs. " << Best << '\n');
+    if (Benefit > Best) {
+      Best = Benefit;
+      BestIsCurrent = true;
+      ++NumRefinements;
+      continue;
+    }
+    Excluded.erase(Trial);
+    BestIsCurrent = false;
+  }
+  if (!BestIsCurrent)
+    assignAll(SCCGraph, EntryGraphs, RegularEGBegin);
+}
+
 bool MOSZeroPageAlloc::assignZPs(SCCGraph &SCCGraph,
                                  std::vector<EntryGraph>::iterator Begin,
                                  std::vector<EntryGraph>::iterator End) {
@@ -797,7 +1236,22 @@ bool MOSZeroPageAlloc::assignZPs(SCCGraph &SCCGraph,
 }
 
 bool MOSZeroPageAlloc::assignZP(SCCGraph &SCCGraph, EntryGraph &EG) {
+  // The space an interrupt-norecurse entry graph currently reserves; this is
+  // shared by all graphs in its overlay group.
+  const auto InterruptSize = [&]() -> size_t & {
+    return EG.OverlayGroup ? SCCGraph.OverlayZPSizes[EG.OverlayGroup]
+                           : EG.Entry->MaxZPSize;
+  };
+
+  // A base page holds only the frames of its own entry graphs, and it has as
+  // much room as the zero page would without globals of its own.
+  const size_t Avail =
+      EG.BasePage.empty() ? ModuleZPAvail : static_cast<size_t>(ZPAvail);
+
   const auto NewZPSize = [&](Candidate &Cand, size_t Size) {
+    if (!EG.BasePage.empty())
+      return std::max(SCCGraph.BasePageZPSizes.lookup(EG.BasePage),
+                      Size + Cand.Comp->MaxZPSize);
     size_t NewGlobalSize = SCCGraph.GlobalZPSize;
     size_t NewRegularSize = SCCGraph.RegularZPSize;
     size_t NewInterruptSize = SCCGraph.InterruptZPSize;
@@ -805,9 +1259,9 @@ bool MOSZeroPageAlloc::assignZP(SCCGraph &SCCGraph, EntryGraph &EG) {
       NewGlobalSize += Size;
     } else {
       if (EG.IsINR) {
-        NewInterruptSize -= EG.Entry->MaxZPSize;
+        NewInterruptSize -= InterruptSize();
         NewInterruptSize +=
-            std::max(EG.Entry->MaxZPSize, Size + Cand.Comp->MaxZPSize);
+            std::max(InterruptSize(), Size + Cand.Comp->MaxZPSize);
       } else {
         NewRegularSize = std::max(NewRegularSize, Size + Cand.Comp->MaxZPSize);
       }
@@ -821,12 +1275,13 @@ bool MOSZeroPageAlloc::assignZP(SCCGraph &SCCGraph, EntryGraph &EG) {
       return false;
     EntryCandidate &EC = EG.Candidates[EG.NextCand];
     Candidate &Cand = *EC.LC->Cand;
-    // Another entry path may have already assigned the candidate.
-    if (Cand.AssignedSize == Cand.Size)
+    // Another entry path may have already assigned the candidate, or
+    // refinement may have excluded it.
+    if (Cand.AssignedSize == Cand.Size || Excluded.contains(&Cand))
       continue;
     // If the candidate is too big to fit, no reason to start allocating bytes
     // to it.
-    if (!Cand.AssignedSize && NewZPSize(Cand, Cand.Size) > ModuleZPAvail)
+    if (!Cand.AssignedSize && NewZPSize(Cand, Cand.Size) > Avail)
       continue;
     break;
   }
@@ -834,12 +1289,14 @@ bool MOSZeroPageAlloc::assignZP(SCCGraph &SCCGraph, EntryGraph &EG) {
   Candidate &Cand = *EC.LC->Cand;
 
   ++Cand.AssignedSize;
+  ++NumAssignSteps;
 
   LLVM_DEBUG(dbgs() << "Entry " << EG.Entry->Funcs.front()->getName()
                     << ", Func " << Cand << '\n';);
 
-  if (NewZPSize(Cand, Cand.AssignedSize) > ModuleZPAvail) {
+  if (NewZPSize(Cand, Cand.AssignedSize) > Avail) {
     LLVM_DEBUG(dbgs() << "No longer fits; unassigning.\n");
+    ++NumUnassigned;
     size_t NumToReassign = Cand.AssignedSize;
     Cand.AssignedSize = 0;
     bool AssignedAny = false;
@@ -860,10 +1317,16 @@ bool MOSZeroPageAlloc::assignZP(SCCGraph &SCCGraph, EntryGraph &EG) {
   Cand.Comp->ZPSize += Cand.AssignedSize;
   SCCGraph.MFZPSizes[Cand.MF] += Cand.AssignedSize;
 
-  if (EG.IsINR) {
-    SCCGraph.InterruptZPSize -= EG.Entry->MaxZPSize;
-    SCCGraph.InterruptZPSize +=
-        std::max(EG.Entry->MaxZPSize, Cand.Size + Cand.Comp->MaxZPSize);
+  if (!EG.BasePage.empty()) {
+    size_t &PageSize = SCCGraph.BasePageZPSizes[EG.BasePage];
+    PageSize = std::max(PageSize, Cand.Size + Cand.Comp->MaxZPSize);
+  } else if (EG.IsINR) {
+    size_t NewSize =
+        std::max(InterruptSize(), Cand.Size + Cand.Comp->MaxZPSize);
+    SCCGraph.InterruptZPSize -= InterruptSize();
+    SCCGraph.InterruptZPSize += NewSize;
+    if (EG.OverlayGroup)
+      InterruptSize() = NewSize;
   } else {
     SCCGraph.RegularZPSize =
         std::max(SCCGraph.RegularZPSize, Cand.Size + Cand.Comp->MaxZPSize);
@@ -894,14 +1357,69 @@ bool MOSZeroPageAlloc::assignZP(SCCGraph &SCCGraph, EntryGraph &EG) {
 }
 
 // We can't use machine block frequency due to a pass scheduling SNAFU, so
-// approximate with the IR block frequencies.
-static float getFreq(const BlockFrequencyInfo &BFI, MachineBasicBlock &MBB) {
+// approximate with the IR block frequencies. With profile data, these are
+// absolute execution counts, which makes blocks in different functions and
+// entry graphs directly comparable. Functions without a profiled entry count
+// fall back to a frequency relative to their entry, as if called once.
+static float getFreq(const BlockFrequencyInfo &BFI, MachineBasicBlock &MBB,
+                     bool UseProfile) {
   if (!MBB.getBasicBlock())
     return 1;
+  if (UseProfile) {
+    if (std::optional<uint64_t> Count =
+            BFI.getBlockProfileCount(MBB.getBasicBlock()))
+      return (float)*Count;
+  }
   return (float)BFI.getBlockFreq(MBB.getBasicBlock()).getFrequency() /
          (float)BFI.getEntryFreq().getFrequency();
 }
 
+float MOSZeroPageAlloc::getBlockFreq(MachineBasicBlock &MBB) {
+  if (!MBB.getBasicBlock())
+    return 1;
+  MachineFunction &MF = *MBB.getParent();
+  auto [It, Inserted] = BlockFreqs.try_emplace(&MF);
+  SmallVector<float> &Freqs = It->second;
+  if (Inserted) {
+    auto &BFI =
+        getAnalysis<BlockFrequencyInfoWrapperPass>(MF.getFunction()).getBFI();
+    Freqs.resize(MF.getNumBlockIDs(), 1);
+    for (MachineBasicBlock &B : MF)
+      if (B.getNumber() >= 0)
+        Freqs[B.getNumber()] = getFreq(BFI, B, UseProfile);
+  }
+  return Freqs[MBB.getNumber()];
+}
+
+// Returns the frequency of the calls from the function to each callee, summed
+// over its call sites.
+ArrayRef<std::pair<const Function *, float>>
+MOSZeroPageAlloc::getCallFreqs(Module &M, MachineFunction &MF) {
+  auto [It, Inserted] = CallFreqs.try_emplace(&MF);
+  if (!Inserted)
+    return It->second;
+
+  MapVector<const Function *, float> Freqs;
+  for (MachineBasicBlock &MBB : MF) {
+    for (const MachineInstr &MI : MBB) {
+      if (!MI.isCall())
+        continue;
+      for (const MachineOperand &MO : MI.operands()) {
+        const Function *Callee = nullptr;
+        if (MO.isGlobal())
+          Callee = dyn_cast<Function>(MO.getGlobal());
+        else if (MO.isSymbol())
+          Callee = mos::getSymbolFunction(M, MO.getSymbolName());
+        if (Callee)
+          Freqs[Callee] += getBlockFreq(MBB);
+      }
+    }
+  }
+  // Computing the frequencies didn't touch CallFreqs, so It is still valid.
+  It->second = Freqs.takeVector();
+  return It->second;
+}
+
 char MOSZeroPageAlloc::ID = 0;
 
 INITIALIZE_PASS(MOSZeroPageAlloc, DEBUG_TYPE, "Allocate zero page", false,
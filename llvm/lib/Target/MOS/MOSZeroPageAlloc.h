@@ -19,6 +19,14 @@ namespace llvm {
 
 ModulePass *createMOSZeroPageAllocPass();
 
+namespace mos {
+
+// Returns the zero page available to the compiler for M as a whole, after the
+// globals that the user placed there.
+uint64_t getZeroPageBudget(const Module &M);
+
+} // namespace mos
+
 } // namespace llvm
 
 #endif // not LLVM_LIB_TARGET_MOS_MOSZEROPAGEALLOC_H
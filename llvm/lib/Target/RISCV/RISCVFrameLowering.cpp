@@ -2398,6 +2398,7 @@ bool RISCVFrameLowering::isSupportedStackID(TargetStackID::Value ID) const {
   case TargetStackID::ScalablePredicateVector:
   case TargetStackID::MosStatic:
   case TargetStackID::MosZeroPage:
+  case TargetStackID::MosHardStack:
     return false;
   }
   llvm_unreachable("Invalid TargetStackID::Value");
@@ -569,7 +569,8 @@ std::string Triple::computeDataLayout(StringRef ABIName) const {
   case Triple::mips64el:
     return computeMipsDataLayout(*this, ABIName);
   case Triple::mos:
-    return "e-m:e-p:16:8-p1:8:8-i16:8-i32:8-i64:8-f32:8-f64:8-a:8-Fi8-n8";
+    return "e-m:e-p:16:8-p1:8:8-p2:32:8-i16:8-i32:8-i64:8-f32:8-f64:8-a:8-"
+           "Fi8-n8";
   case Triple::msp430:
     return "e-m:e-p:16:16-i32:16-i64:16-f32:16-f64:16-a:8-n8:16-S16";
   case Triple::ppc:
@@ -50,6 +50,7 @@
 #include "llvm/Support/Compiler.h"
 #include "llvm/Support/Error.h"
 #include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/MathExtras.h"
 #include "llvm/TargetParser/Triple.h"
 #include "llvm/Transforms/Instrumentation/PGOInstrumentation.h"
 #include "llvm/Transforms/Utils/BasicBlockUtils.h"
@@ -168,6 +169,13 @@ cl::opt<bool> SkipRetExitBlock(
     "skip-ret-exit-block", cl::init(true),
     cl::desc("Suppress counter promotion if exit blocks contain ret."));
 
+static cl::opt<unsigned> CounterBits(
+    "instrprof-counter-bits",
+    cl::desc("Width in bits of the profile counters: 64, or 8 or 16 for "
+             "narrow counters that saturate instead of wrapping (defaults to "
+             "16 on MOS and 64 elsewhere)"),
+    cl::Hidden);
+
 static cl::opt<bool> SampledInstr("sampled-instrumentation", cl::ZeroOrMore,
                                   cl::init(false),
                                   cl::desc("Do PGO instrumentation sampling"));
@@ -309,6 +317,9 @@ private:
   /// Return true if profile sampling is enabled.
   bool isSamplingEnabled() const;
 
+  /// Returns the width in bits of the counters updated by increments.
+  unsigned getCounterBits() const;
+
   /// Count the number of instrumented value sites for the function.
   void computeNumValueSiteCounts(InstrProfValueProfileInst *Ins);
 
@@ -859,6 +870,18 @@ bool InstrLowerer::isSamplingEnabled() const {
   return Options.Sampling;
 }
 
+unsigned InstrLowerer::getCounterBits() const {
+  if (CounterBits.getNumOccurrences() > 0) {
+    if (CounterBits != 8 && CounterBits != 16 && CounterBits != 64)
+      report_fatal_error("instrprof-counter-bits must be 8, 16, or 64");
+    return CounterBits;
+  }
+  // 64-bit counters are slow to update and costly in RAM on the 6502, and
+  // programs run briefly enough under profiling that 16 bits suffice for all
+  // but the hottest blocks, which saturate.
+  return TT.isMOS() ? 16 : 64;
+}
+
 bool InstrLowerer::isCounterPromotionEnabled() const {
   if (DoCounterPromotion.getNumOccurrences() > 0)
     return DoCounterPromotion;
@@ -1178,6 +1201,8 @@ void InstrLowerer::lowerTimestamp(
     InstrProfTimestampInst *TimestampInstruction) {
   assert(TimestampInstruction->getIndex()->isZeroValue() &&
          "timestamp probes are always the first probe for a function");
+  if (getCounterBits() < 64)
+    report_fatal_error("temporal profiling requires 64-bit counters");
   auto &Ctx = M.getContext();
   auto *TimestampAddr = getCounterAddress(TimestampInstruction);
   IRBuilder<> Builder(TimestampInstruction);
@@ -1193,7 +1218,22 @@ void InstrLowerer::lowerIncrement(InstrProfIncrementInst *Inc) {
   auto *Addr = getCounterAddress(Inc);
 
   IRBuilder<> Builder(Inc);
-  if (Options.Atomic || AtomicCounterUpdateAll ||
+  unsigned Bits = getCounterBits();
+  if (Bits < 64) {
+    // Narrow counters saturate, so that a hot block still reads as hot. The
+    // step is clamped to the counter's range first. Neither atomic updates
+    // nor promotion are supported, since promotion sums the steps in a
+    // register and adds them to the counter without saturating.
+    auto *CounterTy = Builder.getIntNTy(Bits);
+    Value *Step = Inc->getStep();
+    Value *Max = ConstantInt::get(Step->getType(), maxUIntN(Bits));
+    Step = Builder.CreateTrunc(
+        Builder.CreateBinaryIntrinsic(Intrinsic::umin, Step, Max), CounterTy);
+    Value *Load = Builder.CreateLoad(CounterTy, Addr, "pgocount");
+    Value *Count = Builder.CreateBinaryIntrinsic(Intrinsic::uadd_sat, Load,
+                                                 Step);
+    Builder.CreateStore(Count, Addr);
+  } else if (Options.Atomic || AtomicCounterUpdateAll ||
       (Inc->getIndex()->isZeroValue() && AtomicFirstCounter)) {
     Builder.CreateAtomicRMW(AtomicRMWInst::Add, Addr, Inc->getStep(),
                             MaybeAlign(), AtomicOrdering::Monotonic);
@@ -1662,10 +1702,11 @@ InstrLowerer::createRegionCounters(InstrProfCntrInstBase *Inc, StringRef Name,
                             Name);
     GV->setAlignment(Align(1));
   } else {
-    auto *CounterTy = ArrayType::get(Type::getInt64Ty(Ctx), NumCounters);
+    unsigned Bits = getCounterBits();
+    auto *CounterTy = ArrayType::get(Type::getIntNTy(Ctx, Bits), NumCounters);
     GV = new GlobalVariable(M, CounterTy, false, Linkage,
                             Constant::getNullValue(CounterTy), Name);
-    GV->setAlignment(Align(8));
+    GV->setAlignment(Align(Bits / 8));
   }
   return GV;
 }
@@ -275,6 +275,7 @@ bool Evaluator::EvaluateBlock(BasicBlock::iterator CurInst, BasicBlock *&NextBB,
   // This is the main evaluation loop.
   while (true) {
     Constant *InstResult = nullptr;
+    LastInst = &*CurInst;
 
     LLVM_DEBUG(dbgs() << "Evaluating Instruction: " << *CurInst << "\n");
 
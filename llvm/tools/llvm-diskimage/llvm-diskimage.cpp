@@ -0,0 +1,823 @@
+//===-- llvm-diskimage.cpp - Floppy disk image writer ---------------------===//
+//
+// Part of the LLVM-MOS Project, under the Apache License v2.0 with LLVM
+// Exceptions. See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This program writes the ELF output of LLVM-MOS-SDK builds into floppy disk
+// images: D64 for the Commodore 1541, ATR with an Atari DOS 2.0 file system, or
+// DSK and PO with an Apple DOS 3.3 file system.
+//
+// Each input becomes a program file, holding its resident sections, and one
+// file for each of its overlays, named after the overlay's output section. An
+// overlay is found as an output section whose addresses are shared with another
+// one, as in an OVERLAY statement; they are numbered from zero in section
+// order, as for the overlay stubs of lld. Files are written in the native load
+// format of the platform: PRG for the C64, binary load files for the Atari
+// (with the program's entry point in RUNAD), and B files for the Apple II.
+//
+// Loading from floppy is dominated by seeks and by waiting for sectors to come
+// around. Files are placed one after another in load order, beginning on the
+// tracks next to the directory, where the head rests after looking a file up,
+// and sweeping outward. The order can be given with -load-order, as recorded by
+// an overlay loader, one file name or overlay number per line; other files
+// follow in input order. Within a track, the consecutive sectors of a file are
+// -interleave sectors apart, to match the time a drive or fast loader takes to
+// handle a sector before it's ready for the next.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/ADT/StringSwitch.h"
+#include "llvm/BinaryFormat/ELF.h"
+#include "llvm/Object/ELFObjectFile.h"
+#include "llvm/Object/ObjectFile.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/LineIterator.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/WithColor.h"
+#include "llvm/Support/raw_ostream.h"
+#include <memory>
+#include <optional>
+#include <system_error>
+
+using namespace llvm;
+using namespace llvm::object;
+
+namespace {
+static cl::OptionCategory DiskCategory("Disk Image Options");
+
+enum class DiskFormat { Auto, D64, ATR, DSK, PO };
+
+cl::opt<DiskFormat> ImageFormat(
+    "format", cl::desc("Disk image format"), cl::init(DiskFormat::Auto),
+    cl::values(
+        clEnumValN(DiskFormat::Auto, "auto",
+                   "Detect from the output filename extension"),
+        clEnumValN(DiskFormat::D64, "d64", "Commodore 1541 disk image"),
+        clEnumValN(DiskFormat::ATR, "atr",
+                   "Atari single density disk with DOS 2.0 file system"),
+        clEnumValN(DiskFormat::DSK, "dsk",
+                   "Apple II DOS 3.3 disk in DOS sector order"),
+        clEnumValN(DiskFormat::PO, "po",
+                   "Apple II DOS 3.3 disk in ProDOS sector order")),
+    cl::cat(DiskCategory));
+
+cl::list<std::string> ClInputFilenames(cl::Positional, cl::OneOrMore,
+                                       cl::desc("<input ELF files>"),
+                                       cl::cat(DiskCategory));
+
+cl::opt<std::string> ClOutputFilename("o", cl::Required,
+                                      cl::desc("Output disk image"),
+                                      cl::value_desc("filename"),
+                                      cl::cat(DiskCategory));
+
+cl::opt<std::string>
+    DiskName("name", cl::desc("Disk name (default: the output filename)"),
+             cl::cat(DiskCategory));
+
+cl::opt<unsigned> SectorInterleave(
+    "interleave",
+    cl::desc("Distance between the consecutive sectors of a file on a track "
+             "(default: 10 for d64, 1 for atr, 15 for dsk and po)"),
+    cl::cat(DiskCategory));
+
+cl::opt<std::string> LoadOrder(
+    "load-order",
+    cl::desc("File listing the files in the order they are loaded, one name "
+             "or overlay number per line"),
+    cl::value_desc("filename"), cl::cat(DiskCategory));
+
+// A file to write to the disk, in the native load format of the platform.
+struct DiskFile {
+  std::string Name;
+  // The overlay number, if the file holds an overlay.
+  std::optional<unsigned> Overlay;
+  // Runs of contents, each loaded at the address given.
+  SmallVector<std::pair<uint16_t, std::vector<uint8_t>>, 1> Runs;
+  uint16_t Entry = 0;
+};
+
+// A sector of a disk, by track and sector within the track, both numbered
+// from zero.
+struct Location {
+  unsigned Track;
+  unsigned Sector;
+};
+
+// A disk image, as an array of equally sized sectors, with an allocator that
+// places the sectors of files for fast loading.
+class DiskImage {
+public:
+  virtual ~DiskImage() = default;
+
+  // Adds a file to the image, returning false if it is full.
+  virtual bool addFile(const DiskFile &File) = 0;
+  // Writes the directory and returns the contents of the image.
+  virtual std::vector<uint8_t> finish() = 0;
+
+protected:
+  // The number of sectors on each track.
+  SmallVector<unsigned> TrackSizes;
+  unsigned SectorSize;
+  // The order in which tracks are filled.
+  SmallVector<unsigned> TrackOrder;
+  unsigned Interleave;
+
+  std::vector<uint8_t> Image;
+  std::vector<bool> Used;
+
+  DiskImage(ArrayRef<unsigned> TrackSizes, unsigned SectorSize,
+            ArrayRef<unsigned> TrackOrder, unsigned Interleave)
+      : TrackSizes(TrackSizes), SectorSize(SectorSize), TrackOrder(TrackOrder),
+        Interleave(Interleave) {
+    unsigned NumSectors = 0;
+    for (unsigned Size : TrackSizes)
+      NumSectors += Size;
+    Image.resize(NumSectors * SectorSize);
+    Used.resize(NumSectors);
+  }
+
+  unsigned getIndex(Location L) const {
+    unsigned Index = L.Sector;
+    for (unsigned T = 0; T != L.Track; ++T)
+      Index += TrackSizes[T];
+    return Index;
+  }
+  MutableArrayRef<uint8_t> getSector(Location L) {
+    return MutableArrayRef<uint8_t>(Image).slice(getIndex(L) * SectorSize,
+                                                 SectorSize);
+  }
+  bool isUsed(Location L) const { return Used[getIndex(L)]; }
+  void markUsed(Location L) { Used[getIndex(L)] = true; }
+
+  // Allocates the next sector in load order, or returns std::nullopt if the
+  // disk is full.
+  std::optional<Location> allocate();
+  // Allocates NumSectors sectors in load order, or returns false if the disk
+  // is full.
+  bool allocate(unsigned NumSectors, SmallVectorImpl<Location> &Sectors);
+
+private:
+  // The position in TrackOrder of the track last allocated from.
+  unsigned OrderPos = 0;
+  // The sector last allocated, if any.
+  std::optional<unsigned> Last;
+};
+
+// A Commodore 1541 disk of 35 tracks. The BAM and directory occupy track 18,
+// in the middle of the disk; files fill the tracks below it from 17 down,
+// then the tracks above it from 19 up.
+class D64Image : public DiskImage {
+public:
+  D64Image(unsigned Interleave, StringRef Name);
+  bool addFile(const DiskFile &File) override;
+  std::vector<uint8_t> finish() override;
+
+private:
+  // Track 18, as DOS numbers them from one.
+  static constexpr unsigned DirTrack = 17;
+  std::string Name;
+  // The directory entries: the file's first sector, name and size.
+  struct Entry {
+    Location First;
+    std::string Name;
+    unsigned NumSectors;
+  };
+  std::vector<Entry> Entries;
+};
+
+// An Atari 810 single density disk of 720 sectors with a DOS 2.0 file
+// system. The drive formats its tracks with a skew of its own, so sectors are
+// best read in sequence. The VTOC and directory occupy sectors 360 to 368;
+// files fill the sectors after them, then those from 4 up to them.
+class ATRImage : public DiskImage {
+public:
+  ATRImage(unsigned Interleave);
+  bool addFile(const DiskFile &File) override;
+  std::vector<uint8_t> finish() override;
+
+private:
+  // DOS sectors are numbered from 1, in 40 tracks of 18.
+  static Location getLocation(unsigned Sector) {
+    return {(Sector - 1) / 18, (Sector - 1) % 18};
+  }
+  static unsigned getNumber(Location L) { return L.Track * 18 + L.Sector + 1; }
+
+  struct Entry {
+    unsigned First;
+    std::string Name;
+    unsigned NumSectors;
+  };
+  std::vector<Entry> Entries;
+};
+
+// An Apple II disk of 35 tracks of 16 sectors with a DOS 3.3 file system.
+// Sectors are numbered as DOS does, which reads the consecutive sectors of a
+// file best in descending order. The VTOC and catalog occupy track 17, and
+// tracks 0 to 2 are left for DOS itself; files fill the tracks from 18 up,
+// then those from 16 down.
+class AppleDOSImage : public DiskImage {
+public:
+  AppleDOSImage(unsigned Interleave, bool ProDOSOrder);
+  bool addFile(const DiskFile &File) override;
+  std::vector<uint8_t> finish() override;
+
+private:
+  static constexpr unsigned CatalogTrack = 17;
+  bool ProDOSOrder;
+
+  struct Entry {
+    Location TSList;
+    std::string Name;
+    unsigned NumSectors;
+  };
+  std::vector<Entry> Entries;
+};
+} // namespace
+
+[[noreturn]] static void reportError(StringRef File, const Twine &Message) {
+  outs().flush();
+  WithColor::error(errs(), "llvm-diskimage")
+      << "'" << File << "': " << Message << "\n";
+  exit(1);
+}
+
+[[noreturn]] static void reportError(Error E, StringRef File) {
+  outs().flush();
+  WithColor::error(errs(), "llvm-diskimage")
+      << "'" << File << "': " << std::move(E) << "\n";
+  exit(1);
+}
+
+template <typename T, typename... Ts>
+static T unwrapOrError(Expected<T> EO, Ts &&...Args) {
+  if (EO)
+    return std::move(*EO);
+  reportError(EO.takeError(), std::forward<Ts>(Args)...);
+}
+
+std::optional<Location> DiskImage::allocate() {
+  for (; OrderPos != TrackOrder.size(); ++OrderPos) {
+    unsigned Track = TrackOrder[OrderPos];
+    unsigned Size = TrackSizes[Track];
+    // Moving to the next track takes about as long as a sector passing, so
+    // its first sector follows on from the last of the previous track.
+    unsigned Start = Last ? (*Last + Interleave) % Size : 0;
+    for (unsigned I = 0; I != Size; ++I) {
+      Location L = {Track, (Start + I) % Size};
+      if (isUsed(L))
+        continue;
+      markUsed(L);
+      Last = L.Sector;
+      return L;
+    }
+  }
+  return std::nullopt;
+}
+
+bool DiskImage::allocate(unsigned NumSectors,
+                         SmallVectorImpl<Location> &Sectors) {
+  for (unsigned I = 0; I != NumSectors; ++I) {
+    std::optional<Location> L = allocate();
+    if (!L)
+      return false;
+    Sectors.push_back(*L);
+  }
+  return true;
+}
+
+static std::string getUpperName(StringRef Name, size_t MaxLen) {
+  std::string Upper;
+  for (char C : Name) {
+    if (Upper.size() == MaxLen)
+      break;
+    Upper.push_back(isAlnum(C) ? toUpper(C) : '-');
+  }
+  return Upper;
+}
+
+static void appendLE16(std::vector<uint8_t> &Out, uint16_t Val) {
+  Out.push_back(Val & 0xff);
+  Out.push_back(Val >> 8);
+}
+
+static const unsigned D64TrackSizes[] = {
+    21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 19,
+    19, 19, 19, 19, 19, 19, 18, 18, 18, 18, 18, 18, 17, 17, 17, 17, 17};
+
+static SmallVector<unsigned> getD64TrackOrder() {
+  SmallVector<unsigned> Order;
+  for (unsigned T = 17; T-- != 0;)
+    Order.push_back(T);
+  for (unsigned T = 18; T != 35; ++T)
+    Order.push_back(T);
+  return Order;
+}
+
+D64Image::D64Image(unsigned Interleave, StringRef Name)
+    : DiskImage(D64TrackSizes, 256, getD64TrackOrder(), Interleave),
+      Name(getUpperName(Name, 16)) {
+  for (unsigned S = 0; S != TrackSizes[DirTrack]; ++S)
+    markUsed({DirTrack, S});
+}
+
+bool D64Image::addFile(const DiskFile &File) {
+  // A PRG file begins with its load address, and does not hold the gaps
+  // between its runs.
+  std::vector<uint8_t> Data;
+  if (!File.Runs.empty()) {
+    appendLE16(Data, File.Runs.front().first);
+    uint32_t Addr = File.Runs.front().first;
+    for (const auto &[Start, Contents] : File.Runs) {
+      Data.resize(Data.size() + (Start - Addr));
+      Data.insert(Data.end(), Contents.begin(), Contents.end());
+      Addr = Start + Contents.size();
+    }
+  }
+
+  // Each sector holds a link to the next, then 254 bytes of the file. The
+  // last links to track 0, and its sector field gives the offset of its last
+  // byte.
+  unsigned NumSectors = std::max<size_t>(divideCeil(Data.size(), 254), 1);
+  SmallVector<Location> Sectors;
+  if (Entries.size() == 144 || !allocate(NumSectors, Sectors))
+    return false;
+  for (unsigned I = 0; I != NumSectors; ++I) {
+    MutableArrayRef<uint8_t> Sector = getSector(Sectors[I]);
+    ArrayRef<uint8_t> Chunk =
+        ArrayRef(Data).drop_front(I * 254).take_front(254);
+    if (I + 1 != NumSectors) {
+      Sector[0] = Sectors[I + 1].Track + 1;
+      Sector[1] = Sectors[I + 1].Sector;
+    } else {
+      Sector[0] = 0;
+      Sector[1] = Chunk.size() + 1;
+    }
+    llvm::copy(Chunk, Sector.begin() + 2);
+  }
+  Entries.push_back({Sectors.front(), getUpperName(File.Name, 16), NumSectors});
+  return true;
+}
+
+std::vector<uint8_t> D64Image::finish() {
+  // Directory sectors follow each other three apart, as DOS writes them.
+  static const unsigned DirSectors[] = {1, 4, 7,  10, 13, 16, 2,  5,  8,
+                                        11, 14, 17, 3, 6, 9,  12, 15, 18};
+  unsigned NumDirSectors = std::max<size_t>(divideCeil(Entries.size(), 8), 1);
+  for (unsigned I = 0; I != NumDirSectors; ++I) {
+    MutableArrayRef<uint8_t> Sector = getSector({DirTrack, DirSectors[I]});
+    Sector[0] = I + 1 != NumDirSectors ? DirTrack + 1 : 0;
+    Sector[1] = I + 1 != NumDirSectors ? DirSectors[I + 1] : 0xff;
+    for (unsigned J = 0; J != 8 && I * 8 + J != Entries.size(); ++J) {
+      const Entry &E = Entries[I * 8 + J];
+      MutableArrayRef<uint8_t> Slot = Sector.slice(J * 32, 32);
+      // A closed PRG file.
+      Slot[2] = 0x82;
+      Slot[3] = E.First.Track + 1;
+      Slot[4] = E.First.Sector;
+      std::fill(Slot.begin() + 5, Slot.begin() + 21, 0xa0);
+      llvm::copy(E.Name, Slot.begin() + 5);
+      Slot[30] = E.NumSectors & 0xff;
+      Slot[31] = E.NumSectors >> 8;
+    }
+  }
+
+  // The BAM takes a byte of free sectors and a bitmap of three bytes for each
+  // track, where a set bit marks a free sector.
+  MutableArrayRef<uint8_t> BAM = getSector({DirTrack, 0});
+  BAM[0] = DirTrack + 1;
+  BAM[1] = 1;
+  BAM[2] = 'A';
+  for (Location L = {0, 0}; L.Track != 35; ++L.Track) {
+    unsigned Free = 0;
+    for (L.Sector = 0; L.Sector != TrackSizes[L.Track]; ++L.Sector) {
+      bool IsDir = L.Track == DirTrack &&
+                   (!L.Sector || is_contained(ArrayRef(DirSectors).take_front(
+                                                  NumDirSectors),
+                                              L.Sector));
+      bool IsFile = L.Track != DirTrack && isUsed(L);
+      if (IsDir || IsFile)
+        continue;
+      ++Free;
+      BAM[5 + L.Track * 4 + L.Sector / 8] |= 1 << (L.Sector % 8);
+    }
+    BAM[4 + L.Track * 4] = Free;
+  }
+  std::fill(BAM.begin() + 0x90, BAM.begin() + 0xab, 0xa0);
+  llvm::copy(Name, BAM.begin() + 0x90);
+  BAM[0xa2] = BAM[0xa3] = '0';
+  BAM[0xa5] = '2';
+  BAM[0xa6] = 'A';
+  return std::move(Image);
+}
+
+static SmallVector<unsigned> getATRTrackOrder() {
+  SmallVector<unsigned> Order;
+  for (unsigned T = 20; T != 40; ++T)
+    Order.push_back(T);
+  for (unsigned T = 0; T != 20; ++T)
+    Order.push_back(T);
+  return Order;
+}
+
+static const unsigned ATRTrackSizes[] = {
+    18, 18, 18, 18, 18, 18, 18, 18, 18, 18, 18, 18, 18, 18,
+    18, 18, 18, 18, 18, 18, 18, 18, 18, 18, 18, 18, 18, 18,
+    18, 18, 18, 18, 18, 18, 18, 18, 18, 18, 18, 18};
+
+ATRImage::ATRImage(unsigned Interleave)
+    : DiskImage(ATRTrackSizes, 128, getATRTrackOrder(), Interleave) {
+  // The boot sectors, the VTOC, the directory, and the last sector, which DOS
+  // 2.0 cannot address.
+  for (unsigned S : {1, 2, 3, 720})
+    markUsed(getLocation(S));
+  for (unsigned S = 360; S != 369; ++S)
+    markUsed(getLocation(S));
+}
+
+bool ATRImage::addFile(const DiskFile &File) {
+  // A binary load file holds a segment for each run, each with its first and
+  // last address. The program's entry point is loaded into RUNAD.
+  std::vector<uint8_t> Data = {0xff, 0xff};
+  auto AddSegment = [&](uint16_t Start, ArrayRef<uint8_t> Contents) {
+    appendLE16(Data, Start);
+    appendLE16(Data, Start + Contents.size() - 1);
+    Data.insert(Data.end(), Contents.begin(), Contents.end());
+  };
+  for (const auto &[Start, Contents] : File.Runs)
+    AddSegment(Start, Contents);
+  if (!File.Overlay && File.Entry) {
+    uint8_t RunAddr[] = {uint8_t(File.Entry & 0xff), uint8_t(File.Entry >> 8)};
+    AddSegment(0x2e0, RunAddr);
+  }
+
+  // Each sector holds 125 bytes, then the file number and the number of the
+  // next sector, then the count of bytes it holds.
+  unsigned NumSectors = divideCeil(Data.size(), 125);
+  SmallVector<Location> Sectors;
+  if (Entries.size() == 64 || !allocate(NumSectors, Sectors))
+    return false;
+  unsigned FileNum = Entries.size();
+  for (unsigned I = 0; I != NumSectors; ++I) {
+    MutableArrayRef<uint8_t> Sector = getSector(Sectors[I]);
+    ArrayRef<uint8_t> Chunk =
+        ArrayRef(Data).drop_front(I * 125).take_front(125);
+    unsigned Next = I + 1 != NumSectors ? getNumber(Sectors[I + 1]) : 0;
+    llvm::copy(Chunk, Sector.begin());
+    Sector[125] = FileNum << 2 | Next >> 8;
+    Sector[126] = Next & 0xff;
+    Sector[127] = Chunk.size();
+  }
+
+  // Names are eight characters and an extension of three.
+  std::string Name = getUpperName(File.Name, 8);
+  Name.resize(8, ' ');
+  Name += File.Overlay ? "OVL" : "XEX";
+  Entries.push_back({getNumber(Sectors.front()), Name, NumSectors});
+  return true;
+}
+
+std::vector<uint8_t> ATRImage::finish() {
+  for (unsigned I = 0; I != Entries.size(); ++I) {
+    const Entry &E = Entries[I];
+    MutableArrayRef<uint8_t> Slot =
+        getSector(getLocation(361 + I / 8)).slice(I % 8 * 16, 16);
+    // In use, and created by DOS 2.0.
+    Slot[0] = 0x42;
+    Slot[1] = E.NumSectors & 0xff;
+    Slot[2] = E.NumSectors >> 8;
+    Slot[3] = E.First & 0xff;
+    Slot[4] = E.First >> 8;
+    llvm::copy(E.Name, Slot.begin() + 5);
+  }
+
+  // The VTOC has a bitmap of the sectors, where a set bit marks a free one.
+  MutableArrayRef<uint8_t> VTOC = getSector(getLocation(360));
+  const unsigned NumSectors = 707;
+  unsigned Free = 0;
+  for (unsigned S = 1; S != 720; ++S) {
+    if (isUsed(getLocation(S)))
+      continue;
+    ++Free;
+    VTOC[10 + S / 8] |= 0x80 >> (S % 8);
+  }
+  VTOC[0] = 2;
+  VTOC[1] = NumSectors & 0xff;
+  VTOC[2] = NumSectors >> 8;
+  VTOC[3] = Free & 0xff;
+  VTOC[4] = Free >> 8;
+
+  // The header gives the size of the image in 16-byte paragraphs.
+  unsigned Paragraphs = Image.size() / 16;
+  std::vector<uint8_t> ATR = {0x96,
+                              0x02,
+                              uint8_t(Paragraphs & 0xff),
+                              uint8_t(Paragraphs >> 8),
+                              128,
+                              0,
+                              uint8_t(Paragraphs >> 16)};
+  ATR.resize(16);
+  ATR.insert(ATR.end(), Image.begin(), Image.end());
+  return ATR;
+}
+
+static SmallVector<unsigned> getAppleTrackOrder() {
+  SmallVector<unsigned> Order;
+  for (unsigned T = 18; T != 35; ++T)
+    Order.push_back(T);
+  for (unsigned T = 17; T-- != 3;)
+    Order.push_back(T);
+  return Order;
+}
+
+static const unsigned AppleTrackSizes[] = {
+    16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,
+    16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16};
+
+AppleDOSImage::AppleDOSImage(unsigned Interleave, bool ProDOSOrder)
+    : DiskImage(AppleTrackSizes, 256, getAppleTrackOrder(), Interleave),
+      ProDOSOrder(ProDOSOrder) {
+  for (unsigned T : {0, 1, 2, 17})
+    for (unsigned S = 0; S != 16; ++S)
+      markUsed({T, S});
+}
+
+bool AppleDOSImage::addFile(const DiskFile &File) {
+  // A B file begins with its load address and length, and does not hold the
+  // gaps between its runs.
+  std::vector<uint8_t> Data;
+  if (!File.Runs.empty()) {
+    uint32_t Addr = File.Runs.front().first;
+    for (const auto &[Start, Contents] : File.Runs) {
+      Data.resize(Data.size() + (Start - Addr));
+      Data.insert(Data.end(), Contents.begin(), Contents.end());
+      Addr = Start + Contents.size();
+    }
+    std::vector<uint8_t> Header;
+    appendLE16(Header, File.Runs.front().first);
+    appendLE16(Header, Data.size());
+    Data.insert(Data.begin(), Header.begin(), Header.end());
+  }
+
+  // Each track/sector list gives the sectors of up to 122 of the file's
+  // sectors, and precedes them on the disk.
+  unsigned NumData = divideCeil(Data.size(), 256);
+  unsigned NumLists = std::max<unsigned>(divideCeil(NumData, 122), 1);
+  if (Entries.size() == 15 * 7)
+    return false;
+  SmallVector<Location> Lists;
+  SmallVector<Location> Sectors;
+  for (unsigned I = 0; I != NumLists; ++I) {
+    if (!allocate(1, Lists) ||
+        !allocate(std::min(NumData - I * 122, 122u), Sectors))
+      return false;
+  }
+  for (unsigned I = 0; I != NumLists; ++I) {
+    MutableArrayRef<uint8_t> List = getSector(Lists[I]);
+    if (I + 1 != NumLists) {
+      List[1] = Lists[I + 1].Track;
+      List[2] = Lists[I + 1].Sector;
+    }
+    List[5] = I * 122 & 0xff;
+    List[6] = I * 122 >> 8;
+    for (unsigned J = 0; J != 122 && I * 122 + J != NumData; ++J) {
+      List[0x0c + J * 2] = Sectors[I * 122 + J].Track;
+      List[0x0d + J * 2] = Sectors[I * 122 + J].Sector;
+    }
+  }
+  for (unsigned I = 0; I != NumData; ++I)
+    llvm::copy(ArrayRef(Data).drop_front(I * 256).take_front(256),
+               getSector(Sectors[I]).begin());
+  Entries.push_back(
+      {Lists.front(), getUpperName(File.Name, 30), NumLists + NumData});
+  return true;
+}
+
+std::vector<uint8_t> AppleDOSImage::finish() {
+  // The catalog runs down track 17 from sector 15, with 7 entries a sector.
+  for (unsigned S = 15; S != 0; --S) {
+    MutableArrayRef<uint8_t> Sector = getSector({CatalogTrack, S});
+    if (S != 1) {
+      Sector[1] = CatalogTrack;
+      Sector[2] = S - 1;
+    }
+  }
+  for (unsigned I = 0; I != Entries.size(); ++I) {
+    const Entry &E = Entries[I];
+    MutableArrayRef<uint8_t> Slot =
+        getSector({CatalogTrack, 15 - I / 7}).slice(0x0b + I % 7 * 35, 35);
+    Slot[0] = E.TSList.Track;
+    Slot[1] = E.TSList.Sector;
+    // A B file.
+    Slot[2] = 0x04;
+    // Names are in ASCII with the high bit set, padded with spaces.
+    std::fill(Slot.begin() + 3, Slot.begin() + 33, 0xa0);
+    for (unsigned C = 0; C != E.Name.size(); ++C)
+      Slot[3 + C] = E.Name[C] | 0x80;
+    Slot[33] = E.NumSectors & 0xff;
+    Slot[34] = E.NumSectors >> 8;
+  }
+
+  // The VTOC has a bitmap of four bytes a track, of which the first two mark
+  // sectors 15 down to 0 with a set bit when free.
+  MutableArrayRef<uint8_t> VTOC = getSector({CatalogTrack, 0});
+  VTOC[0x01] = CatalogTrack;
+  VTOC[0x02] = 15;
+  VTOC[0x03] = 3;
+  VTOC[0x06] = 254;
+  VTOC[0x27] = 122;
+  VTOC[0x30] = CatalogTrack + 1;
+  VTOC[0x31] = 1;
+  VTOC[0x34] = 35;
+  VTOC[0x35] = 16;
+  VTOC[0x37] = 1;
+  for (Location L = {0, 0}; L.Track != 35; ++L.Track)
+    for (L.Sector = 0; L.Sector != 16; ++L.Sector)
+      if (!isUsed(L))
+        VTOC[0x38 + L.Track * 4 + (L.Sector < 8)] |= 1 << (L.Sector % 8);
+
+  if (!ProDOSOrder)
+    return std::move(Image);
+
+  // Both orders skew their sectors around the track. A DOS sector is at the
+  // physical position of DOSToPhys; in ProDOS order, the sectors of a track
+  // are stored in the order of their physical positions under ProDOS.
+  static const unsigned DOSToPhys[] = {0, 13, 11, 9, 7, 5, 3, 1,
+                                       14, 12, 10, 8, 6, 4, 2, 15};
+  static const unsigned PhysToProDOS[] = {0, 8, 1, 9,  2, 10, 3, 11,
+                                          4, 12, 5, 13, 6, 14, 7, 15};
+  std::vector<uint8_t> PO(Image.size());
+  for (Location L = {0, 0}; L.Track != 35; ++L.Track)
+    for (L.Sector = 0; L.Sector != 16; ++L.Sector)
+      llvm::copy(getSector(L),
+                 PO.begin() + (L.Track * 16 +
+                               PhysToProDOS[DOSToPhys[L.Sector]]) *
+                                  256);
+  return PO;
+}
+
+// Splits the sections of an ELF file into its resident program and its
+// overlays.
+static void addFiles(StringRef InputFilename, std::vector<DiskFile> &Files) {
+  OwningBinary<Binary> OBinary =
+      unwrapOrError(createBinary(InputFilename), InputFilename);
+  auto *O = dyn_cast<ELF32LEObjectFile>(OBinary.getBinary());
+  if (!O)
+    reportError(InputFilename, "expected an ELF object file");
+
+  struct Sec {
+    StringRef Name;
+    uint64_t Addr;
+    ArrayRef<uint8_t> Contents;
+    bool IsOverlay = false;
+  };
+  std::vector<Sec> Secs;
+  for (const ELFSectionRef S : O->sections()) {
+    if (!(S.getFlags() & ELF::SHF_ALLOC) || S.getType() == ELF::SHT_NOBITS ||
+        !S.getSize())
+      continue;
+    Sec &New = Secs.emplace_back();
+    New.Name = unwrapOrError(S.getName(), InputFilename);
+    New.Addr = S.getAddress();
+    StringRef Contents = unwrapOrError(S.getContents(), InputFilename);
+    New.Contents = arrayRefFromStringRef(Contents);
+    if (New.Addr + New.Contents.size() > 0x10000)
+      reportError(InputFilename,
+                  formatv("section '{0}' is not in the 64 KiB address space",
+                          New.Name));
+  }
+  for (Sec &A : Secs)
+    for (const Sec &B : Secs)
+      if (&A != &B && A.Addr < B.Addr + B.Contents.size() &&
+          B.Addr < A.Addr + A.Contents.size())
+        A.IsOverlay = true;
+
+  size_t ProgIndex = Files.size();
+  DiskFile &Program = Files.emplace_back();
+  Program.Name = sys::path::stem(InputFilename);
+  Program.Entry = O->getELFFile().getHeader().e_entry;
+  std::vector<const Sec *> Resident;
+  unsigned NumOverlays = 0;
+  for (const Sec &S : Secs) {
+    if (!S.IsOverlay) {
+      Resident.push_back(&S);
+      continue;
+    }
+    DiskFile &Overlay = Files.emplace_back();
+    Overlay.Name = S.Name.ltrim('.');
+    Overlay.Overlay = NumOverlays++;
+    Overlay.Runs.push_back(
+        {uint16_t(S.Addr), std::vector<uint8_t>(S.Contents.begin(), S.Contents.end())});
+  }
+
+  // Resident sections next to one another form a single run.
+  llvm::sort(Resident,
+             [](const Sec *A, const Sec *B) { return A->Addr < B->Addr; });
+  DiskFile &Prog = Files[ProgIndex];
+  for (const Sec *S : Resident) {
+    if (Prog.Runs.empty() ||
+        Prog.Runs.back().first + Prog.Runs.back().second.size() != S->Addr)
+      Prog.Runs.push_back({uint16_t(S->Addr), {}});
+    std::vector<uint8_t> &Run = Prog.Runs.back().second;
+    Run.insert(Run.end(), S->Contents.begin(), S->Contents.end());
+  }
+}
+
+// Moves the files named in the load order to the front, in that order.
+static void applyLoadOrder(std::vector<DiskFile> &Files) {
+  ErrorOr<std::unique_ptr<MemoryBuffer>> Buf =
+      MemoryBuffer::getFile(LoadOrder, /*IsText=*/true);
+  if (!Buf)
+    reportError(LoadOrder, Buf.getError().message());
+
+  std::vector<bool> Placed(Files.size());
+  std::vector<DiskFile> Ordered;
+  for (line_iterator Line(**Buf, /*SkipBlanks=*/true, '#'); !Line.is_at_eof();
+       ++Line) {
+    StringRef Name = Line->trim();
+    unsigned Number;
+    bool IsNumber = to_integer(Name, Number);
+    auto It = find_if(Files, [&](const DiskFile &F) {
+      return IsNumber ? F.Overlay == Number : F.Name == Name;
+    });
+    if (It == Files.end())
+      reportError(LoadOrder, formatv("no file or overlay '{0}'", Name));
+    if (Placed[It - Files.begin()])
+      continue;
+    Placed[It - Files.begin()] = true;
+    Ordered.push_back(*It);
+  }
+  for (unsigned I = 0; I != Files.size(); ++I)
+    if (!Placed[I])
+      Ordered.push_back(std::move(Files[I]));
+  Files = std::move(Ordered);
+}
+
+int main(int argc, char **argv) {
+  InitLLVM X(argc, argv);
+
+  cl::HideUnrelatedOptions({&DiskCategory, &getColorCategory()});
+  cl::ParseCommandLineOptions(argc, argv, "floppy disk image writer\n");
+
+  if (ImageFormat == DiskFormat::Auto) {
+    std::string Ext = sys::path::extension(ClOutputFilename).lower();
+    ImageFormat = StringSwitch<DiskFormat>(Ext)
+                 .Case(".d64", DiskFormat::D64)
+                 .Case(".atr", DiskFormat::ATR)
+                 .Cases({".dsk", ".do"}, DiskFormat::DSK)
+                 .Case(".po", DiskFormat::PO)
+                 .Default(DiskFormat::Auto);
+    if (ImageFormat == DiskFormat::Auto)
+      reportError(ClOutputFilename,
+                  "cannot detect the disk image format; use -format");
+  }
+
+  std::vector<DiskFile> Files;
+  for (const std::string &InputFilename : ClInputFilenames)
+    addFiles(InputFilename, Files);
+  if (!LoadOrder.empty())
+    applyLoadOrder(Files);
+
+  StringRef Name =
+      DiskName.empty() ? sys::path::stem(ClOutputFilename) : DiskName;
+  std::unique_ptr<DiskImage> Disk;
+  switch (ImageFormat) {
+  case DiskFormat::D64:
+    Disk = std::make_unique<D64Image>(
+        SectorInterleave.getNumOccurrences() ? SectorInterleave : 10, Name);
+    break;
+  case DiskFormat::ATR:
+    Disk = std::make_unique<ATRImage>(
+        SectorInterleave.getNumOccurrences() ? SectorInterleave : 1);
+    break;
+  case DiskFormat::DSK:
+  case DiskFormat::PO:
+    Disk = std::make_unique<AppleDOSImage>(
+        SectorInterleave.getNumOccurrences() ? SectorInterleave : 15,
+        ImageFormat == DiskFormat::PO);
+    break;
+  case DiskFormat::Auto:
+    llvm_unreachable("format should have been detected");
+  }
+
+  for (const DiskFile &File : Files)
+    if (!Disk->addFile(File))
+      reportError(ClOutputFilename,
+                  formatv("disk full; cannot add file '{0}'", File.Name));
+  std::vector<uint8_t> Image = Disk->finish();
+
+  std::error_code EC;
+  raw_fd_ostream OS(ClOutputFilename, EC, sys::fs::OF_None);
+  if (EC)
+    reportError(ClOutputFilename, Twine("cannot open: ") + EC.message());
+  OS.write(reinterpret_cast<const char *>(Image.data()), Image.size());
+}
@@ -6,22 +6,51 @@
 //
 //===----------------------------------------------------------------------===//
 //
-// This program is a utility that generates a Mesen label file (.lbl) from the
-// ELF output of a LLVM-MOS-SDK NES target build.
+// This program is a utility that generates a Mesen label file (.mlb) from the
+// ELF output of a LLVM-MOS-SDK NES or PCE target build, or a VICE monitor
+// label file for targets with a flat 64 KiB address space.
+//
+// Labels come from the symbol table. With -source-lines, the DWARF line table
+// also gives each code address that begins a source line a Mesen comment
+// naming the file and line. With -dwarf-variables, statically allocated
+// variables local to a function, which have no symbols of their own, are
+// labeled as <function>@<variable>.
+//
+// With -trace-ids, the trace IDs recorded by -mos-trace-port are also written
+// to a .trace file, one per line as a hexadecimal ID and a name, for emulator
+// scripts to log trace port writes by. A function's first ID is named after
+// it, and marks both its entry and exit; the IDs of its basic blocks follow,
+// as <function>#<block>.
+//
+// With -trap-ids, the BRK traps compiled with -mos-compact-traps are written to
+// a .traps file, one per line as a hexadecimal ID, the address of the BRK, the
+// function containing it, and its source location, for BRK handlers and
+// emulator scripts to report failures by.
 //
 //===----------------------------------------------------------------------===//
 
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringExtras.h"
 #include "llvm/ADT/StringRef.h"
+#include "llvm/BinaryFormat/Dwarf.h"
 #include "llvm/BinaryFormat/ELF.h"
+#include "llvm/DebugInfo/DWARF/DWARFContext.h"
+#include "llvm/DebugInfo/DWARF/DWARFDie.h"
+#include "llvm/DebugInfo/DWARF/DWARFUnit.h"
+#include "llvm/DebugInfo/DWARF/LowLevel/DWARFExpression.h"
 #include "llvm/Object/ELFObjectFile.h"
 #include "llvm/Object/ELFTypes.h"
 #include "llvm/Object/ObjectFile.h"
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/FormatVariadic.h"
 #include "llvm/Support/InitLLVM.h"
 #include "llvm/Support/Path.h"
 #include "llvm/Support/Regex.h"
 #include "llvm/Support/WithColor.h"
+#include <map>
 #include <system_error>
 
 using namespace llvm;
@@ -30,15 +59,17 @@ using namespace llvm::object;
 namespace {
 static cl::OptionCategory MLBCategory("MLB Options");
 
-enum class MLBPlatform { Auto, NES, PCE };
+enum class MLBPlatform { Auto, NES, PCE, VICE };
 
-cl::opt<MLBPlatform>
-    Platform("platform", cl::desc(""), cl::init(MLBPlatform::Auto),
-             cl::values(clEnumValN(MLBPlatform::Auto, "Auto",
-                                   "Detect automatically based on filename."),
-                        clEnumValN(MLBPlatform::NES, "NES", "NES"),
-                        clEnumValN(MLBPlatform::PCE, "PCE", "PCE")),
-             cl::NotHidden, cl::cat(MLBCategory));
+cl::opt<MLBPlatform> Platform(
+    "platform", cl::desc(""), cl::init(MLBPlatform::Auto),
+    cl::values(clEnumValN(MLBPlatform::Auto, "Auto",
+                          "Detect automatically based on filename."),
+               clEnumValN(MLBPlatform::NES, "NES", "NES"),
+               clEnumValN(MLBPlatform::PCE, "PCE", "PCE"),
+               clEnumValN(MLBPlatform::VICE, "VICE",
+                          "VICE monitor labels for a 64 KiB address space")),
+    cl::NotHidden, cl::cat(MLBCategory));
 
 cl::list<std::string> ClInputFilenames(cl::Positional, cl::OneOrMore,
                                        cl::desc("<input ELF files>"),
@@ -48,6 +79,37 @@ cl::opt<std::string> ClOutputFilename("o", cl::init(""),
                                       cl::desc("Override output filename"),
                                       cl::value_desc("filename"),
                                       cl::cat(MLBCategory));
+
+cl::opt<bool>
+    SourceLines("source-lines",
+                cl::desc("Comment the start of each source line with its "
+                         "file and line number (Mesen only)"),
+                cl::cat(MLBCategory));
+
+cl::opt<bool> DwarfVariables(
+    "dwarf-variables",
+    cl::desc("Label the statically allocated local variables of functions"),
+    cl::cat(MLBCategory));
+
+cl::opt<bool>
+    TraceIDs("trace-ids",
+             cl::desc("Write the trace IDs of instrumented functions to a "
+                      ".trace file"),
+             cl::cat(MLBCategory));
+
+cl::opt<bool> TrapIDs("trap-ids",
+                      cl::desc("Write the IDs and source locations of compact "
+                               "traps to a .traps file"),
+                      cl::cat(MLBCategory));
+
+// A label to export, at an address in the ELF's address space.
+struct Label {
+  uint64_t Address;
+  uint64_t Size;
+  std::string Name;
+  std::string Comment;
+  bool IsFunction = false;
+};
 } // namespace
 
 static void reportWarning(StringRef File, const Twine &Message) {
@@ -80,6 +142,431 @@ static T unwrapOrError(Expected<T> EO, Ts &&...Args) {
 static Regex PRGROMRegex("^__prg_rom(.*)_(lma|offset)$");
 static Regex VBankRegex("^__(.*_vbank.*)_(lma|offset)$");
 
+// Writes the address range of a Mesen label.
+static void writeBounds(raw_ostream &OS, uint64_t Address, uint64_t Size) {
+  OS << format_hex_no_prefix(Address, 1);
+  if (Size > 1)
+    OS << '-' << format_hex_no_prefix(Address + Size - 1, 1);
+}
+
+static void writeMesenLabel(raw_ostream &OS, StringRef Type, uint64_t Address,
+                            const Label &L) {
+  OS << Type << ':';
+  writeBounds(OS, Address, L.Size);
+  OS << ':' << L.Name;
+  if (!L.Comment.empty())
+    OS << ':' << L.Comment;
+  OS << '\n';
+}
+
+// Returns the address of a variable whose location is fixed, if it is.
+static std::optional<uint64_t> getStaticAddress(DWARFDie Die) {
+  std::optional<DWARFFormValue> Loc = Die.find(dwarf::DW_AT_location);
+  if (!Loc)
+    return std::nullopt;
+  std::optional<ArrayRef<uint8_t>> Block = Loc->getAsBlock();
+  if (!Block)
+    return std::nullopt;
+  DWARFUnit *U = Die.getDwarfUnit();
+  DataExtractor Data(toStringRef(*Block), U->isLittleEndian(),
+                     U->getAddressByteSize());
+  DWARFExpression Expr(Data, U->getAddressByteSize(), U->getFormat());
+  std::optional<uint64_t> Address;
+  for (const DWARFExpression::Operation &Op : Expr) {
+    if (Op.isError())
+      return std::nullopt;
+    switch (Op.getCode()) {
+    case dwarf::DW_OP_addr:
+      if (Address)
+        return std::nullopt;
+      Address = Op.getRawOperand(0);
+      break;
+    case dwarf::DW_OP_addrx:
+    case dwarf::DW_OP_GNU_addr_index: {
+      if (Address)
+        return std::nullopt;
+      std::optional<SectionedAddress> SA =
+          U->getAddrOffsetSectionItem(Op.getRawOperand(0));
+      if (!SA)
+        return std::nullopt;
+      Address = SA->Address;
+      break;
+    }
+    case dwarf::DW_OP_plus_uconst:
+      if (!Address)
+        return std::nullopt;
+      *Address += Op.getRawOperand(0);
+      break;
+    default:
+      return std::nullopt;
+    }
+  }
+  return Address;
+}
+
+// Adds labels for the variables with fixed addresses within functions.
+static void addDwarfVariables(DWARFDie Die, StringRef Function,
+                              std::vector<Label> &Labels, uint8_t AddrSize) {
+  for (DWARFDie Child : Die.children()) {
+    switch (Child.getTag()) {
+    case dwarf::DW_TAG_subprogram:
+      if (const char *Name = Child.getShortName())
+        addDwarfVariables(Child, Name, Labels, AddrSize);
+      break;
+    case dwarf::DW_TAG_lexical_block:
+      addDwarfVariables(Child, Function, Labels, AddrSize);
+      break;
+    case dwarf::DW_TAG_variable:
+    case dwarf::DW_TAG_formal_parameter: {
+      const char *Name = Child.getShortName();
+      if (Function.empty() || !Name)
+        break;
+      std::optional<uint64_t> Address = getStaticAddress(Child);
+      if (!Address)
+        break;
+      Label &L = Labels.emplace_back();
+      L.Address = *Address;
+      L.Size = Child.getTypeSize(AddrSize).value_or(1);
+      L.Name = (Function + "@" + Name).str();
+      break;
+    }
+    default:
+      break;
+    }
+  }
+}
+
+// Attaches the start of each source line in the line tables to the label at
+// its address, or to a new unnamed label.
+static void addSourceLines(DWARFContext &DICtx, std::vector<Label> &Labels) {
+  DenseMap<uint64_t, size_t> CodeLabels;
+  for (size_t I = 0; I < Labels.size(); ++I)
+    if (Labels[I].IsFunction)
+      CodeLabels.try_emplace(Labels[I].Address, I);
+
+  for (const auto &CU : DICtx.compile_units()) {
+    const DWARFDebugLine::LineTable *LT = DICtx.getLineTableForUnit(CU.get());
+    if (!LT)
+      continue;
+    StringRef CompDir = CU->getCompilationDir();
+    // The file and line of the last row, to skip rows that don't start a
+    // line.
+    uint64_t LastFile = 0;
+    uint32_t LastLine = 0;
+    std::string FileName;
+    for (const DWARFDebugLine::Row &Row : LT->Rows) {
+      if (Row.EndSequence) {
+        LastLine = 0;
+        continue;
+      }
+      if (!Row.IsStmt || !Row.Line ||
+          (Row.File == LastFile && Row.Line == LastLine))
+        continue;
+      LastFile = Row.File;
+      LastLine = Row.Line;
+      if (!LT->getFileNameByIndex(
+              Row.File, CompDir,
+              DILineInfoSpecifier::FileLineInfoKind::BaseNameOnly, FileName))
+        continue;
+
+      std::string Comment = FileName + ":" + std::to_string(Row.Line);
+      auto [It, Inserted] =
+          CodeLabels.try_emplace(Row.Address.Address, Labels.size());
+      if (Inserted) {
+        Label &L = Labels.emplace_back();
+        L.Address = Row.Address.Address;
+        L.Size = 1;
+        L.IsFunction = true;
+      }
+      std::string &Existing = Labels[It->second].Comment;
+      if (!Existing.empty())
+        Existing += "\\n";
+      Existing += Comment;
+    }
+  }
+}
+
+// Writes the trace IDs in the .mos.trace notes of O to a file alongside the
+// label file.
+static void writeTraceIDs(const ELF32LEObjectFile &O, ArrayRef<Label> Labels,
+                          StringRef OutputBase, StringRef InputFilename) {
+  const ELFFile<ELF32LE> &Obj = O.getELFFile();
+  DenseMap<uint64_t, StringRef> Functions;
+  for (const Label &L : Labels)
+    if (L.IsFunction && !L.Name.empty())
+      Functions.try_emplace(L.Address, L.Name);
+
+  // The name of each ID, by ID.
+  std::map<uint16_t, std::string> Names;
+  for (const ELFFile<ELF32LE>::Elf_Shdr &Sec :
+       unwrapOrError(Obj.sections(), InputFilename)) {
+    if (Sec.sh_type != ELF::SHT_NOTE ||
+        unwrapOrError(Obj.getSectionName(Sec), InputFilename) != ".mos.trace")
+      continue;
+    Error Err = Error::success();
+    for (const ELFFile<ELF32LE>::Elf_Note &Note : Obj.notes(Sec, Err)) {
+      if (Note.getName() != "MOS" || Note.getType() != ELF::NT_MOS_TRACE)
+        continue;
+      ArrayRef<uint8_t> Desc = Note.getDesc(Sec.sh_addralign);
+      for (size_t I = 0; I + 8 <= Desc.size(); I += 8) {
+        const uint8_t *Entry = Desc.data() + I;
+        uint32_t Address = support::endian::read32le(Entry);
+        uint16_t First = support::endian::read16le(Entry + 4);
+        uint16_t Count = support::endian::read16le(Entry + 6);
+        StringRef Function = Functions.lookup(Address);
+        std::string Name = Function.empty()
+                               ? formatv("${0:x-}", Address).str()
+                               : Function.str();
+        for (uint32_t J = 0; J < Count && First + J <= UINT16_MAX; ++J) {
+          std::string IDName = J ? formatv("{0}#{1}", Name, J).str() : Name;
+          auto [It, Inserted] = Names.try_emplace(First + J, IDName);
+          if (!Inserted && It->second != IDName)
+            reportWarning(InputFilename,
+                          formatv("trace ID {0:x-4} is used by both '{1}' "
+                                  "and '{2}'; link with LTO to make IDs "
+                                  "unique",
+                                  First + J, It->second, IDName));
+        }
+      }
+    }
+    if (Err)
+      reportError(std::move(Err), InputFilename);
+  }
+  if (Names.empty()) {
+    reportWarning(InputFilename, "no trace IDs found");
+    return;
+  }
+
+  std::string Filename = (OutputBase + ".trace").str();
+  std::error_code EC;
+  raw_fd_ostream OS(Filename, EC);
+  if (EC)
+    reportError(Filename, Twine("cannot open: ") + EC.message());
+  for (const auto &[ID, Name] : Names)
+    OS << format_hex_no_prefix(ID, 4) << ' ' << Name << '\n';
+}
+
+// Writes the trap sites in the .mos.trap notes of O to a file alongside the
+// label file.
+static void writeTrapIDs(const ELF32LEObjectFile &O, ArrayRef<Label> Labels,
+                         StringRef OutputBase, StringRef InputFilename) {
+  const ELFFile<ELF32LE> &Obj = O.getELFFile();
+  // The functions by their start addresses, to find the one containing a trap.
+  std::map<uint64_t, const Label *> Functions;
+  for (const Label &L : Labels)
+    if (L.IsFunction && !L.Name.empty() && L.Size)
+      Functions.try_emplace(L.Address, &L);
+
+  std::string Filename = (OutputBase + ".traps").str();
+  std::error_code EC;
+  raw_fd_ostream OS(Filename, EC);
+  if (EC)
+    reportError(Filename, Twine("cannot open: ") + EC.message());
+
+  bool Found = false;
+  for (const ELFFile<ELF32LE>::Elf_Shdr &Sec :
+       unwrapOrError(Obj.sections(), InputFilename)) {
+    if (Sec.sh_type != ELF::SHT_NOTE ||
+        unwrapOrError(Obj.getSectionName(Sec), InputFilename) != ".mos.trap")
+      continue;
+    Error Err = Error::success();
+    for (const ELFFile<ELF32LE>::Elf_Note &Note : Obj.notes(Sec, Err)) {
+      if (Note.getName() != "MOS" || Note.getType() != ELF::NT_MOS_TRAP)
+        continue;
+      ArrayRef<uint8_t> Desc = Note.getDesc(Sec.sh_addralign);
+      size_t I = 0;
+      while (I + 8 < Desc.size()) {
+        const uint8_t *Entry = Desc.data() + I;
+        uint32_t Address = support::endian::read32le(Entry);
+        uint16_t ID = support::endian::read16le(Entry + 4);
+        uint16_t Line = support::endian::read16le(Entry + 6);
+        StringRef File(reinterpret_cast<const char *>(Entry + 8),
+                       Desc.size() - I - 8);
+        File = File.take_until([](char C) { return !C; });
+        I += alignTo(8 + File.size() + 1, 4);
+
+        std::string Function = formatv("${0:x-}", Address).str();
+        auto It = Functions.upper_bound(Address);
+        if (It != Functions.begin()) {
+          const Label &F = *std::prev(It)->second;
+          if (Address < F.Address + F.Size)
+            Function = F.Name;
+        }
+        OS << format_hex_no_prefix(ID, 4) << ' '
+           << format_hex_no_prefix(Address, 4) << ' ' << Function;
+        if (!File.empty())
+          OS << ' ' << File << ':' << Line;
+        OS << '\n';
+        Found = true;
+      }
+    }
+    if (Err)
+      reportError(std::move(Err), InputFilename);
+  }
+  if (!Found)
+    reportWarning(InputFilename, "no traps found");
+}
+
+static void writeNES(raw_ostream &OS, ArrayRef<Label> Labels,
+                     bool HasPRGNVRAM,
+                     const std::map<uint32_t, StringRef> &PRGROMLMABanks,
+                     const DenseMap<StringRef, uint32_t> &PRGROMBankOffsets) {
+  const char *PRGRAMType = HasPRGNVRAM ? "S" : "W";
+  for (Label L : Labels) {
+    uint64_t Address = L.Address;
+
+    // Mesen 2 incorrectly displays executable symbols with a size attached.
+    if (L.IsFunction)
+      L.Size = 1;
+
+    const auto TryPRGRom = [&]() {
+      if ((Address & 0xffff) < 0x8000)
+        return false;
+      auto UB = PRGROMLMABanks.upper_bound(Address);
+      if (UB == PRGROMLMABanks.begin())
+        return false;
+      --UB;
+      uint32_t BankLMA = UB->first;
+      StringRef Bank = UB->second;
+      const auto OffsetIt = PRGROMBankOffsets.find(Bank);
+      if (OffsetIt == PRGROMBankOffsets.end())
+        return false;
+      uint32_t Offset = OffsetIt->second;
+      writeMesenLabel(OS, "P", Address - BankLMA + Offset, L);
+      return true;
+    };
+    if (TryPRGRom())
+      continue;
+    if (Address < 0x2000) {
+      writeMesenLabel(OS, "R", Address, L);
+      continue;
+    }
+    if ((Address & 0xffff) >= 0x6000 && (Address & 0xffff) < 0x8000) {
+      uint8_t Bank = Address >> 16;
+      // NOTE: This assumes 8K PRG-RAM banks. Once a mapper is added with
+      // variable PRG-RAM banking, add a symbol to declare the bank size.
+      writeMesenLabel(OS, PRGRAMType,
+                      (Address & 0xffff) - 0x6000 + Bank * 0x2000, L);
+      continue;
+    }
+
+    writeMesenLabel(OS, "G", Address, L);
+  }
+}
+
+static void writePCE(raw_ostream &OS, ArrayRef<Label> Labels,
+                     const std::map<uint32_t, StringRef> &VBankLMABanks,
+                     const DenseMap<StringRef, uint32_t> &VBankBankOffsets,
+                     StringRef InputFilename) {
+  for (const Label &L : Labels) {
+    uint64_t Address = L.Address;
+
+    const auto TryCard = [&]() {
+      uint8_t Group = Address >> 24;
+      uint8_t Bank = (Address >> 16) & 0xFF;
+      int32_t DefaultOffset = -1; // Default offset.
+      SmallString<32> Type;
+
+      if (Group == 0x00) {
+        // 0x00XXXXXX - base PC Engine bank addresses
+        if (Bank >= 0x00 && Bank <= 0x7F) {
+          Type = "PcePrgRom";
+          DefaultOffset = Bank * 0x2000;
+        } else if (Bank >= 0xF8 && Bank <= 0xFB) {
+          Type = "PceWorkRam";
+          DefaultOffset = (Bank - 0xF8) * 0x2000;
+        } else {
+          return false;
+        }
+      } else if (Group == 0x01) {
+        // 0x01XXXXXX - card/CD-ROM RAM bank addresses
+        if (Bank >= 0x80 && Bank <= 0x87) {
+          Type = "PceCdromRam";
+          DefaultOffset = (Bank - 0x80) * 0x2000;
+        } else if (Bank >= 0x68 && Bank <= 0x7F) {
+          Type = "PceCardRam";
+          DefaultOffset = (Bank - 0x68) * 0x2000;
+        } else if (Bank >= 0x40 && Bank <= 0x5F) {
+          Type = "PceCardRam";
+          DefaultOffset = (Bank - 0x40) * 0x2000;
+        } else {
+          return false;
+        }
+      } else if (Group <= 0x11) {
+        // (0x02-0x11)XXXXXX, bank 40-7F - card ROM bank address (SF2
+        // mapper)
+        if (Bank < 0x40 || Bank >= 0x80)
+          return false;
+        Type = "PcePrgRom";
+        DefaultOffset = (Group * 64 + (Bank - 0x40)) * 0x2000;
+      } else {
+        return false;
+      }
+
+      // Convert LMA to ROM position.
+      uint32_t BankLMA;
+      uint32_t Offset;
+      auto UB = VBankLMABanks.upper_bound(Address);
+      bool UBValid = false;
+      if (UB != VBankLMABanks.begin()) {
+        --UB;
+        BankLMA = UB->first;
+        UBValid = (BankLMA & 0xFFFF0000) == (Address & 0xFFFF0000);
+      }
+      if (UBValid) {
+        StringRef Bank = UB->second;
+        const auto OffsetIt = VBankBankOffsets.find(Bank);
+        if (OffsetIt == VBankBankOffsets.end())
+          return false;
+        Offset = OffsetIt->second;
+      } else {
+        // VBanks not used; guess the LMA and offset.
+        if (DefaultOffset < 0)
+          return false;
+        BankLMA = Address & 0xFFFFE000;
+        Offset = DefaultOffset;
+      }
+
+      writeMesenLabel(OS, Type, Address - BankLMA + Offset, L);
+      return true;
+    };
+    if (TryCard())
+      continue;
+
+    // 0x00F7XXXX - CD backup RAM bank address
+    if ((Address & 0xFFFF0000) == 0x00F70000) {
+      writeMesenLabel(OS, "PceSaveRam", Address & 0x1FFF, L);
+      continue;
+    }
+    // 0x00FFXXXX - I/O address
+    if ((Address & 0xFFFF0000) == 0x00FF0000) {
+      writeMesenLabel(OS, "PceMemory", Address & 0x1FFF, L);
+      continue;
+    }
+
+    // Unknown address
+    if (!L.Name.empty())
+      reportWarning(InputFilename,
+                    formatv("Could not map symbol '{0}'", L.Name));
+  }
+}
+
+static void writeVICE(raw_ostream &OS, ArrayRef<Label> Labels,
+                      StringRef InputFilename) {
+  for (const Label &L : Labels) {
+    // VICE labels are bare names in the CPU's address space.
+    if (L.Name.empty())
+      continue;
+    if (L.Address > 0xffff) {
+      reportWarning(InputFilename,
+                    formatv("Could not map symbol '{0}'", L.Name));
+      continue;
+    }
+    OS << "al C:" << format_hex_no_prefix(L.Address, 4) << " ." << L.Name
+       << '\n';
+  }
+}
+
 int main(int argc, char **argv) {
   InitLLVM X(argc, argv);
 
@@ -94,7 +581,6 @@ int main(int argc, char **argv) {
     auto *O = dyn_cast<ELF32LEObjectFile>(&Binary);
     if (!O)
       reportError(InputFilename, "expected an ELF object file");
-    const ELFFile<ELF32LE> &ELFFile = O->getELFFile();
 
     StringRef OutputBase = InputFilename;
     OutputBase.consume_back(".elf");
@@ -114,217 +600,85 @@ int main(int argc, char **argv) {
     std::string OutputFilename = ClOutputFilename;
     if (OutputFilename.empty()) {
       OutputFilename = OutputBase;
-      OutputFilename += ".mlb";
+      OutputFilename += Platform == MLBPlatform::VICE ? ".lbl" : ".mlb";
     }
     std::error_code EC;
     raw_fd_ostream OS(OutputFilename, EC);
     if (EC)
       reportError(OutputFilename, Twine("cannot open: ") + EC.message());
 
-    const auto BoundsStr = [](uint64_t Address, uint16_t Size) {
-      auto UpperBoundStr =
-          Size > 1 ? formatv("-{0:x-}", Address + Size - 1) : SmallString<10>();
-      return formatv("{0:x-}{1}", Address, UpperBoundStr).sstr<10>();
-    };
-
-    if (Platform == MLBPlatform::NES) {
-      DenseMap<uint64_t, SmallVector<const ELF32LE::Phdr *>> PRGSegsByOffset;
-      for (const auto &Seg :
-           unwrapOrError(ELFFile.program_headers(), InputFilename))
-        if (Seg.p_paddr >= 0x03000000 && Seg.p_paddr < 0x04000000)
-          PRGSegsByOffset[Seg.p_offset].push_back(&Seg);
-
-      char PRGRAMType = 'W';
-      std::map<uint32_t, StringRef> PRGROMLMABanks;
-      DenseMap<StringRef, uint32_t> PRGROMBankOffsets;
-      SmallVector<StringRef> Matches;
-      for (const ELFSymbolRef Sym : O->symbols()) {
-        StringRef Name = unwrapOrError(Sym.getName(), O->getFileName());
-        if (Name == "__prg_nvram_size") {
-          if (unwrapOrError(Sym.getValue(), O->getFileName()))
-            PRGRAMType = 'S';
-        } else if (PRGROMRegex.match(Name, &Matches)) {
-          uint32_t Value = unwrapOrError(Sym.getValue(), O->getFileName());
-          if (Matches[2] == "lma") {
-            PRGROMLMABanks[Value] = Matches[1];
-          } else {
-            assert(Matches[2] == "offset");
-            PRGROMBankOffsets[Matches[1]] = Value;
-          }
+    // Gather the labels and the bank layout in a single pass over the symbol
+    // table.
+    std::vector<Label> Labels;
+    bool HasPRGNVRAM = false;
+    std::map<uint32_t, StringRef> LMABanks;
+    DenseMap<StringRef, uint32_t> BankOffsets;
+    Regex &BankRegex =
+        Platform == MLBPlatform::PCE ? VBankRegex : PRGROMRegex;
+    SmallVector<StringRef> Matches;
+    for (const ELFSymbolRef Sym : O->symbols()) {
+      SymbolRef::Type Type = unwrapOrError(Sym.getType(), InputFilename);
+      StringRef Name = unwrapOrError(Sym.getName(), InputFilename);
+
+      if (Name == "__prg_nvram_size") {
+        if (unwrapOrError(Sym.getValue(), InputFilename))
+          HasPRGNVRAM = true;
+      } else if (Platform != MLBPlatform::VICE &&
+                 BankRegex.match(Name, &Matches)) {
+        uint32_t Value = unwrapOrError(Sym.getValue(), InputFilename);
+        if (Matches[2] == "lma") {
+          LMABanks[Value] = Matches[1];
+        } else {
+          assert(Matches[2] == "offset");
+          BankOffsets[Matches[1]] = Value;
         }
       }
 
-      for (const ELFSymbolRef Sym : O->symbols()) {
-        SymbolRef::Type Type = unwrapOrError(Sym.getType(), InputFilename);
-        uint64_t Address = unwrapOrError(Sym.getAddress(), InputFilename);
-        StringRef Name = unwrapOrError(Sym.getName(), InputFilename);
-        uint64_t Size = Sym.getSize();
-
-        if (Type == SymbolRef::ST_File)
-          continue;
-        if (Type == SymbolRef::ST_Unknown)
-          if (Name.starts_with("__") && !Name.starts_with("__rc"))
-            continue;
-
-        // Mesen 2 incorrectly displays executable symbols with a size attached.
-        if (Type == SymbolRef::ST_Function)
-          Size = 1;
-
-        const auto TryPRGRom = [&]() {
-          if ((Address & 0xffff) < 0x8000)
-            return false;
-          auto UB = PRGROMLMABanks.upper_bound(Address);
-          if (UB == PRGROMLMABanks.begin())
-            return false;
-          --UB;
-          uint32_t BankLMA = UB->first;
-          StringRef Bank = UB->second;
-          const auto OffsetIt = PRGROMBankOffsets.find(Bank);
-          if (OffsetIt == PRGROMBankOffsets.end())
-            return false;
-          uint32_t Offset = OffsetIt->second;
-          OS << formatv("P:{0}:{1}\n",
-                        BoundsStr(Address - BankLMA + Offset, Size), Name);
-          return true;
-        };
-        if (TryPRGRom())
-          continue;
-        if (Address < 0x2000) {
-          OS << formatv("R:{0}:{1}\n", BoundsStr(Address, Size), Name);
-          continue;
-        }
-        if ((Address & 0xffff) >= 0x6000 && (Address & 0xffff) < 0x8000) {
-          uint8_t Bank = Address >> 16;
-          // NOTE: This assumes 8K PRG-RAM banks. Once a mapper is added with
-          // variable PRG-RAM banking, add a symbol to declare the bank size.
-          OS << formatv(
-              "{0}:{1}:{2}\n", PRGRAMType,
-              BoundsStr((Address & 0xffff) - 0x6000 + Bank * 0x2000, Size),
-              Name);
-          continue;
-        }
-
-        OS << formatv("G:{0}:{1}\n", BoundsStr(Address, Size), Name);
-      }
-    } else if (Platform == MLBPlatform::PCE) {
-      std::map<uint32_t, StringRef> VBankLMABanks;
-      DenseMap<StringRef, uint32_t> VBankBankOffsets;
-      SmallVector<StringRef> Matches;
-      for (const ELFSymbolRef Sym : O->symbols()) {
-        StringRef Name = unwrapOrError(Sym.getName(), O->getFileName());
-        if (VBankRegex.match(Name, &Matches)) {
-          uint32_t Value = unwrapOrError(Sym.getValue(), O->getFileName());
-          if (Matches[2] == "lma") {
-            VBankLMABanks[Value] = Matches[1];
-          } else {
-            assert(Matches[2] == "offset");
-            VBankBankOffsets[Matches[1]] = Value;
-          }
-        }
-      }
-
-      for (const ELFSymbolRef Sym : O->symbols()) {
-        SymbolRef::Type Type = unwrapOrError(Sym.getType(), InputFilename);
-        uint64_t Address = unwrapOrError(Sym.getAddress(), InputFilename);
-        StringRef Name = unwrapOrError(Sym.getName(), InputFilename);
-        uint64_t Size = Sym.getSize();
-
-        if (Type == SymbolRef::ST_File)
-          continue;
-        if (Type == SymbolRef::ST_Unknown)
-          if (Name.starts_with("__") && !Name.starts_with("__rc"))
-            continue;
-
-        const auto TryCard = [&]() {
-          uint8_t Group = Address >> 24;
-          uint8_t Bank = (Address >> 16) & 0xFF;
-          int32_t DefaultOffset = -1; // Default offset.
-          SmallString<32> Type;
-
-          if (Group == 0x00) {
-            // 0x00XXXXXX - base PC Engine bank addresses
-            if (Bank >= 0x00 && Bank <= 0x7F) {
-              Type = "PcePrgRom";
-              DefaultOffset = Bank * 0x2000;
-            } else if (Bank >= 0xF8 && Bank <= 0xFB) {
-              Type = "PceWorkRam";
-              DefaultOffset = (Bank - 0xF8) * 0x2000;
-            } else {
-              return false;
-            }
-          } else if (Group == 0x01) {
-            // 0x01XXXXXX - card/CD-ROM RAM bank addresses
-            if (Bank >= 0x80 && Bank <= 0x87) {
-              Type = "PceCdromRam";
-              DefaultOffset = (Bank - 0x80) * 0x2000;
-            } else if (Bank >= 0x68 && Bank <= 0x7F) {
-              Type = "PceCardRam";
-              DefaultOffset = (Bank - 0x68) * 0x2000;
-            } else if (Bank >= 0x40 && Bank <= 0x5F) {
-              Type = "PceCardRam";
-              DefaultOffset = (Bank - 0x40) * 0x2000;
-            } else {
-              return false;
-            }
-          } else if (Group <= 0x11) {
-            // (0x02-0x11)XXXXXX, bank 40-7F - card ROM bank address (SF2
-            // mapper)
-            if (Bank < 0x40 || Bank >= 0x80)
-              return false;
-            Type = "PcePrgRom";
-            DefaultOffset = (Group * 64 + (Bank - 0x40)) * 0x2000;
-          } else {
-            return false;
-          }
-
-          // Convert LMA to ROM position.
-          uint32_t BankLMA;
-          uint32_t Offset;
-          auto UB = VBankLMABanks.upper_bound(Address);
-          bool UBValid = false;
-          if (UB != VBankLMABanks.begin()) {
-            --UB;
-            BankLMA = UB->first;
-            UBValid = (BankLMA & 0xFFFF0000) == (Address & 0xFFFF0000);
-          }
-          if (UBValid) {
-            StringRef Bank = UB->second;
-            const auto OffsetIt = VBankBankOffsets.find(Bank);
-            if (OffsetIt == VBankBankOffsets.end())
-              return false;
-            Offset = OffsetIt->second;
-          } else {
-            // VBanks not used; guess the LMA and offset.
-            if (DefaultOffset < 0)
-              return false;
-            BankLMA = Address & 0xFFFFE000;
-            Offset = DefaultOffset;
-          }
-
-          OS << formatv("{0}:{1}:{2}\n", Type,
-                        BoundsStr(Address - BankLMA + Offset, Size), Name);
-          return true;
-        };
-        if (TryCard())
+      if (Type == SymbolRef::ST_File)
+        continue;
+      if (Type == SymbolRef::ST_Unknown)
+        if (Name.starts_with("__") && !Name.starts_with("__rc"))
           continue;
 
-        // 0x00F7XXXX - CD backup RAM bank address
-        if ((Address & 0xFFFF0000) == 0x00F70000) {
-          OS << formatv("PceSaveRam:{0}:{1}\n",
-                        BoundsStr(Address & 0x1FFF, Size), Name);
-          continue;
-        }
-        // 0x00FFXXXX - I/O address
-        if ((Address & 0xFFFF0000) == 0x00FF0000) {
-          OS << formatv("PceMemory:{0}:{1}\n",
-                        BoundsStr(Address & 0x1FFF, Size), Name);
-          continue;
-        }
+      Label &L = Labels.emplace_back();
+      L.Address = unwrapOrError(Sym.getAddress(), InputFilename);
+      L.Size = Sym.getSize();
+      L.Name = Name.str();
+      L.IsFunction = Type == SymbolRef::ST_Function;
+    }
 
-        // Unknown address
+    if (SourceLines || DwarfVariables) {
+      std::unique_ptr<DWARFContext> DICtx = DWARFContext::create(*O);
+      if (!DICtx->getNumCompileUnits())
+        reportWarning(InputFilename, "no DWARF debug information found");
+      if (DwarfVariables)
+        for (const auto &CU : DICtx->compile_units())
+          addDwarfVariables(CU->getUnitDIE(/*ExtractUnitDIEOnly=*/false), "",
+                            Labels, CU->getAddressByteSize());
+      if (SourceLines && Platform == MLBPlatform::VICE)
         reportWarning(InputFilename,
-                      formatv("Could not map symbol '{0}'", Name));
-      }
+                      "VICE labels cannot carry source line comments");
+      else if (SourceLines)
+        addSourceLines(*DICtx, Labels);
+    }
+
+    if (TraceIDs)
+      writeTraceIDs(*O, Labels, OutputBase, InputFilename);
+    if (TrapIDs)
+      writeTrapIDs(*O, Labels, OutputBase, InputFilename);
+
+    switch (Platform) {
+    case MLBPlatform::NES:
+      writeNES(OS, Labels, HasPRGNVRAM, LMABanks, BankOffsets);
+      break;
+    case MLBPlatform::PCE:
+      writePCE(OS, Labels, LMABanks, BankOffsets, InputFilename);
+      break;
+    case MLBPlatform::VICE:
+      writeVICE(OS, Labels, InputFilename);
+      break;
+    case MLBPlatform::Auto:
+      llvm_unreachable("platform should have been detected");
     }
   }
 }
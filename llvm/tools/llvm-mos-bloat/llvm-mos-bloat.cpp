@@ -0,0 +1,607 @@
+//===-- llvm-mos-bloat.cpp - MOS size attribution tool --------------------===//
+//
+// Part of the LLVM-MOS Project, under the Apache License v2.0 with LLVM
+// Exceptions. See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This program attributes the zero page, RAM, and ROM bytes of a MOS ELF file
+// to the sections, symbols, source files, inlined call sites, or template
+// families that occupy them, and optionally diffs them against a baseline
+// build.
+//
+// Every byte of every allocated section is painted with a label. Broad ranges
+// are painted first and narrow ones over them, so a byte ends up with its most
+// specific label; bytes nothing claims keep the name of their section. Source
+// files and inlined call sites come from DWARF, which is walked one compile
+// unit per thread.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/BinaryFormat/Dwarf.h"
+#include "llvm/BinaryFormat/ELF.h"
+#include "llvm/BinaryFormat/MOSFlags.h"
+#include "llvm/DebugInfo/DWARF/DWARFContext.h"
+#include "llvm/DebugInfo/DWARF/DWARFDie.h"
+#include "llvm/DebugInfo/DWARF/DWARFUnit.h"
+#include "llvm/DebugInfo/DWARF/LowLevel/DWARFExpression.h"
+#include "llvm/Demangle/Demangle.h"
+#include "llvm/Object/ELFObjectFile.h"
+#include "llvm/Object/ObjectFile.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/Parallel.h"
+#include "llvm/Support/Regex.h"
+#include "llvm/Support/Threading.h"
+#include "llvm/Support/WithColor.h"
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+using namespace llvm;
+using namespace llvm::object;
+
+namespace {
+static cl::OptionCategory BloatCategory("llvm-mos-bloat Options");
+
+enum class Dimension { Section, Symbol, File, Inline, Template };
+
+cl::opt<Dimension> ClDimension(
+    "d", cl::desc("What to attribute the bytes to"),
+    cl::init(Dimension::Symbol),
+    cl::values(
+        clEnumValN(Dimension::Section, "section", "The ELF section"),
+        clEnumValN(Dimension::Symbol, "symbol", "The symbol (default)"),
+        clEnumValN(Dimension::File, "file",
+                   "The source file of the compile unit (needs DWARF)"),
+        clEnumValN(Dimension::Inline, "inline",
+                   "The innermost inlined call site, or else the symbol "
+                   "(needs DWARF)"),
+        clEnumValN(Dimension::Template, "template",
+                   "The symbol, with template arguments elided")),
+    cl::cat(BloatCategory));
+
+enum class SortKey { ZP, RAM, ROM };
+
+cl::opt<SortKey> ClSort("sort", cl::desc("The column to sort by"),
+                        cl::init(SortKey::ROM),
+                        cl::values(clEnumValN(SortKey::ZP, "zp", "Zero page"),
+                                   clEnumValN(SortKey::RAM, "ram", "RAM"),
+                                   clEnumValN(SortKey::ROM, "rom",
+                                              "ROM (default)")),
+                        cl::cat(BloatCategory));
+
+cl::opt<std::string> ClInputFilename(cl::Positional, cl::Required,
+                                     cl::desc("<input ELF file>"),
+                                     cl::cat(BloatCategory));
+
+cl::opt<std::string>
+    ClDiff("diff",
+           cl::desc("Print the change in each row from a baseline ELF file"),
+           cl::value_desc("baseline"), cl::cat(BloatCategory));
+
+cl::opt<unsigned> ClMaxRows("n",
+                            cl::desc("The number of rows to print; the rest "
+                                     "are summed into one (0 = all)"),
+                            cl::init(20), cl::cat(BloatCategory));
+
+cl::opt<std::string>
+    ClSectionFilter("section-filter",
+                    cl::desc("Only count sections whose name matches this "
+                             "regular expression"),
+                    cl::value_desc("regex"), cl::cat(BloatCategory));
+
+cl::opt<unsigned> ClThreads("j",
+                            cl::desc("The number of threads that walk DWARF "
+                                     "(0 = all cores)"),
+                            cl::init(0), cl::cat(BloatCategory));
+
+// The bytes attributed to a label.
+struct Sizes {
+  int64_t ZP = 0;
+  int64_t RAM = 0;
+  int64_t ROM = 0;
+
+  int64_t get(SortKey Key) const {
+    switch (Key) {
+    case SortKey::ZP:
+      return ZP;
+    case SortKey::RAM:
+      return RAM;
+    case SortKey::ROM:
+      return ROM;
+    }
+    llvm_unreachable("unknown sort key");
+  }
+  Sizes &operator+=(const Sizes &Other) {
+    ZP += Other.ZP;
+    RAM += Other.RAM;
+    ROM += Other.ROM;
+    return *this;
+  }
+  bool isZero() const { return !ZP && !RAM && !ROM; }
+};
+
+// A range of addresses to paint with a label. Higher layers are painted over
+// lower ones. In relocatable files, addresses are offsets into the given
+// section; in linked ones, the section may be unknown.
+struct PaintRange {
+  uint64_t SectionIndex = SectionedAddress::UndefSection;
+  uint64_t Begin;
+  uint64_t End;
+  unsigned Layer;
+  std::string Label;
+};
+
+struct AllocSection {
+  uint64_t Index;
+  uint64_t Address;
+  uint64_t Size;
+  StringRef Name;
+  bool ZP;
+  bool RAM;
+  bool ROM;
+  // The label of each byte, as an index into the labels, or zero for none.
+  std::vector<unsigned> Painted;
+};
+
+// The sized symbols of a file.
+struct SizedSymbol {
+  uint64_t SectionIndex;
+  uint64_t Address;
+  uint64_t Size;
+  StringRef Name;
+  bool IsFunction;
+};
+} // namespace
+
+[[noreturn]] static void reportError(StringRef File, const Twine &Message) {
+  outs().flush();
+  WithColor::error(errs(), "llvm-mos-bloat")
+      << "'" << File << "': " << Message << "\n";
+  exit(1);
+}
+
+[[noreturn]] static void reportError(Error E, StringRef File) {
+  outs().flush();
+  WithColor::error(errs(), "llvm-mos-bloat")
+      << "'" << File << "': " << std::move(E) << "\n";
+  exit(1);
+}
+
+static void reportWarning(StringRef File, const Twine &Message) {
+  outs().flush();
+  WithColor::warning(errs(), "llvm-mos-bloat")
+      << "'" << File << "': " << Message << "\n";
+}
+
+template <typename T, typename... Ts>
+static T unwrapOrError(Expected<T> EO, Ts &&...Args) {
+  if (EO)
+    return std::move(*EO);
+  reportError(EO.takeError(), std::forward<Ts>(Args)...);
+}
+
+// Elides the template arguments of a demangled name, so that the
+// instantiations of a template share a row.
+static std::string elideTemplateArgs(StringRef Name) {
+  std::string Result;
+  unsigned Depth = 0;
+  for (size_t I = 0; I < Name.size(); ++I) {
+    char C = Name[I];
+    // The less-than operators are not argument lists.
+    if (!Depth && C == '<' && StringRef(Result).ends_with("operator")) {
+      size_t Length = std::min(Name.substr(I).find_first_not_of("<="),
+                               Name.size() - I);
+      Result += Name.substr(I, Length);
+      I += Length - 1;
+      continue;
+    }
+    if (C == '<') {
+      if (!Depth++)
+        Result += "<>";
+      continue;
+    }
+    if (C == '>' && Depth) {
+      --Depth;
+      continue;
+    }
+    if (!Depth)
+      Result += C;
+  }
+  return Result;
+}
+
+// Returns the address of a variable whose location is fixed, if it is.
+static std::optional<uint64_t> getStaticAddress(DWARFDie Die) {
+  std::optional<DWARFFormValue> Loc = Die.find(dwarf::DW_AT_location);
+  if (!Loc)
+    return std::nullopt;
+  std::optional<ArrayRef<uint8_t>> Block = Loc->getAsBlock();
+  if (!Block)
+    return std::nullopt;
+  DWARFUnit *U = Die.getDwarfUnit();
+  DataExtractor Data(toStringRef(*Block), U->isLittleEndian(),
+                     U->getAddressByteSize());
+  DWARFExpression Expr(Data, U->getAddressByteSize(), U->getFormat());
+  std::optional<uint64_t> Address;
+  for (const DWARFExpression::Operation &Op : Expr) {
+    if (Op.isError())
+      return std::nullopt;
+    switch (Op.getCode()) {
+    case dwarf::DW_OP_addr:
+      if (Address)
+        return std::nullopt;
+      Address = Op.getRawOperand(0);
+      break;
+    case dwarf::DW_OP_addrx:
+    case dwarf::DW_OP_GNU_addr_index: {
+      if (Address)
+        return std::nullopt;
+      std::optional<SectionedAddress> SA =
+          U->getAddrOffsetSectionItem(Op.getRawOperand(0));
+      if (!SA)
+        return std::nullopt;
+      Address = SA->Address;
+      break;
+    }
+    case dwarf::DW_OP_plus_uconst:
+      if (!Address)
+        return std::nullopt;
+      *Address += Op.getRawOperand(0);
+      break;
+    default:
+      return std::nullopt;
+    }
+  }
+  return Address;
+}
+
+static void addDieRanges(DWARFDie Die, unsigned Layer, const std::string &Label,
+                         std::vector<PaintRange> &Ranges) {
+  Expected<DWARFAddressRangesVector> DieRanges = Die.getAddressRanges();
+  if (!DieRanges) {
+    consumeError(DieRanges.takeError());
+    return;
+  }
+  for (const DWARFAddressRange &R : *DieRanges)
+    if (R.LowPC < R.HighPC)
+      Ranges.push_back({R.SectionIndex, R.LowPC, R.HighPC, Layer, Label});
+}
+
+// Collects the statically allocated variables beneath a DIE, painted with the
+// name of the compile unit.
+static void addFileVariables(DWARFDie Die, const std::string &File,
+                             std::vector<PaintRange> &Ranges) {
+  for (DWARFDie Child : Die.children()) {
+    switch (Child.getTag()) {
+    case dwarf::DW_TAG_subprogram:
+    case dwarf::DW_TAG_lexical_block:
+      addFileVariables(Child, File, Ranges);
+      break;
+    case dwarf::DW_TAG_variable: {
+      std::optional<uint64_t> Address = getStaticAddress(Child);
+      if (!Address)
+        break;
+      uint64_t Size =
+          Child.getTypeSize(Die.getDwarfUnit()->getAddressByteSize())
+              .value_or(1);
+      if (Size)
+        Ranges.push_back({SectionedAddress::UndefSection, *Address,
+                          *Address + Size, /*Layer=*/2, File});
+      break;
+    }
+    default:
+      break;
+    }
+  }
+}
+
+// Collects the inlined call sites beneath a DIE, each painted over its
+// caller.
+static void addInlinedCalls(DWARFContext &DICtx, DWARFDie Die, unsigned Depth,
+                            std::vector<PaintRange> &Ranges) {
+  for (DWARFDie Child : Die.children()) {
+    if (Child.getTag() != dwarf::DW_TAG_inlined_subroutine) {
+      if (Child.hasChildren())
+        addInlinedCalls(DICtx, Child, Depth, Ranges);
+      continue;
+    }
+
+    const char *Callee = Child.getSubroutineName(DINameKind::ShortName);
+    std::string Label = Callee ? demangle(Callee) : "<unknown>";
+    uint32_t CallFile, CallLine, CallColumn, CallDiscriminator;
+    Child.getCallerFrame(CallFile, CallLine, CallColumn, CallDiscriminator);
+    DWARFUnit *U = Child.getDwarfUnit();
+    std::string FileName;
+    const DWARFDebugLine::LineTable *LT = DICtx.getLineTableForUnit(U);
+    if (LT && LT->getFileNameByIndex(
+                  CallFile, U->getCompilationDir(),
+                  DILineInfoSpecifier::FileLineInfoKind::RelativeFilePath,
+                  FileName))
+      Label += " inlined at " + FileName + ":" + std::to_string(CallLine);
+    addDieRanges(Child, Depth, Label, Ranges);
+    addInlinedCalls(DICtx, Child, Depth + 1, Ranges);
+  }
+}
+
+// Walks the compile units in parallel, collecting the ranges they describe.
+static void addDwarfRanges(const ObjectFile &Obj, Dimension Dim,
+                           std::vector<PaintRange> &Ranges) {
+  std::unique_ptr<DWARFContext> DICtx = DWARFContext::create(
+      Obj, DWARFContext::ProcessDebugRelocations::Process, nullptr, "",
+      WithColor::defaultErrorHandler, WithColor::defaultWarningHandler,
+      /*ThreadSafe=*/true);
+  if (!DICtx->getNumCompileUnits()) {
+    reportWarning(Obj.getFileName(), "no DWARF debug information found");
+    return;
+  }
+
+  SmallVector<DWARFUnit *> Units;
+  for (const auto &CU : DICtx->compile_units())
+    Units.push_back(CU.get());
+  std::vector<std::vector<PaintRange>> UnitRanges(Units.size());
+  parallelFor(0, Units.size(), [&](size_t I) {
+    DWARFUnit *U = Units[I];
+    DWARFDie UnitDie = U->getUnitDIE(/*ExtractUnitDIEOnly=*/false);
+    if (Dim == Dimension::File) {
+      const char *Name = UnitDie.getShortName();
+      std::string File = Name ? Name : "<unknown>";
+      addDieRanges(UnitDie, /*Layer=*/1, File, UnitRanges[I]);
+      addFileVariables(UnitDie, File, UnitRanges[I]);
+    } else {
+      // Call sites are painted over the symbols of their callers.
+      addInlinedCalls(*DICtx, UnitDie, /*Depth=*/2, UnitRanges[I]);
+    }
+  });
+  for (std::vector<PaintRange> &R : UnitRanges)
+    llvm::append_range(Ranges, std::move(R));
+}
+
+static bool isZeroPage(uint64_t Flags, StringRef Name) {
+  return (Flags & ELF::SHF_MOS_ZEROPAGE) || MOS::isZeroPageSectionName(Name);
+}
+
+// Attributes the allocated bytes of a file to labels of a dimension.
+static StringMap<Sizes> attribute(const ELF32LEObjectFile &Obj,
+                                  Dimension Dim) {
+  StringRef File = Obj.getFileName();
+  std::optional<Regex> Filter;
+  if (!ClSectionFilter.empty()) {
+    Filter.emplace(ClSectionFilter);
+    std::string Err;
+    if (!Filter->isValid(Err))
+      reportError(File, "invalid section filter: " + Err);
+  }
+
+  std::vector<AllocSection> Sections;
+  for (const ELFSectionRef Sec : Obj.sections()) {
+    if (!(Sec.getFlags() & ELF::SHF_ALLOC) || !Sec.getSize())
+      continue;
+    StringRef Name = unwrapOrError(Sec.getName(), File);
+    if (Filter && !Filter->match(Name))
+      continue;
+    AllocSection &S = Sections.emplace_back();
+    S.Index = Sec.getIndex();
+    S.Address = Sec.getAddress();
+    S.Size = Sec.getSize();
+    S.Name = Name;
+    S.ZP = isZeroPage(Sec.getFlags(), Name);
+    S.RAM = !S.ZP && (Sec.getFlags() & ELF::SHF_WRITE);
+    S.ROM = Sec.getType() != ELF::SHT_NOBITS;
+    S.Painted.assign(S.Size, 0);
+  }
+
+  std::vector<SizedSymbol> Symbols;
+  for (const ELFSymbolRef Sym : Obj.symbols()) {
+    uint8_t Type = Sym.getELFType();
+    if (!Sym.getSize() || Type == ELF::STT_SECTION || Type == ELF::STT_FILE)
+      continue;
+    section_iterator SecI = unwrapOrError(Sym.getSection(), File);
+    if (SecI == Obj.section_end())
+      continue;
+    Symbols.push_back({SecI->getIndex(), unwrapOrError(Sym.getAddress(), File),
+                       Sym.getSize(), unwrapOrError(Sym.getName(), File),
+                       Type == ELF::STT_FUNC});
+  }
+
+  // Lay down the ranges of the dimension.
+  std::vector<PaintRange> Ranges;
+  switch (Dim) {
+  case Dimension::Section:
+    break;
+  case Dimension::Inline:
+  case Dimension::Symbol:
+  case Dimension::Template:
+    // Larger symbols are painted first, so that symbols nested within them
+    // keep their own bytes.
+    for (const SizedSymbol &Sym : Symbols) {
+      std::string Label = demangle(Sym.Name);
+      if (Dim == Dimension::Template)
+        Label = elideTemplateArgs(Label);
+      Ranges.push_back({Sym.SectionIndex, Sym.Address, Sym.Address + Sym.Size,
+                        /*Layer=*/0, std::move(Label)});
+    }
+    llvm::stable_sort(Ranges, [](const PaintRange &A, const PaintRange &B) {
+      return A.End - A.Begin > B.End - B.Begin;
+    });
+    if (Dim == Dimension::Inline)
+      addDwarfRanges(Obj, Dim, Ranges);
+    break;
+  case Dimension::File:
+    addDwarfRanges(Obj, Dim, Ranges);
+    break;
+  }
+  llvm::stable_sort(Ranges, [](const PaintRange &A, const PaintRange &B) {
+    return A.Layer < B.Layer;
+  });
+
+  std::vector<std::string> Labels = {""};
+  StringMap<unsigned> LabelIDs;
+  auto GetLabelID = [&](const std::string &Label) {
+    auto [It, Inserted] = LabelIDs.try_emplace(Label, Labels.size());
+    if (Inserted)
+      Labels.push_back(Label);
+    return It->second;
+  };
+  auto Paint = [&](uint64_t SectionIndex, uint64_t Begin, uint64_t End,
+                   unsigned ID) {
+    for (AllocSection &S : Sections) {
+      if (SectionIndex != SectionedAddress::UndefSection &&
+          SectionIndex != S.Index)
+        continue;
+      uint64_t From = std::max(Begin, S.Address);
+      uint64_t To = std::min(End, S.Address + S.Size);
+      if (From < To)
+        std::fill(S.Painted.begin() + (From - S.Address),
+                  S.Painted.begin() + (To - S.Address), ID);
+    }
+  };
+  for (const PaintRange &R : Ranges)
+    Paint(R.SectionIndex, R.Begin, R.End, GetLabelID(R.Label));
+
+  // Static stack frames have no DWARF of their own; they belong to the file
+  // of their function.
+  if (Dim == Dimension::File) {
+    StringMap<const SizedSymbol *> Functions;
+    for (const SizedSymbol &Sym : Symbols)
+      if (Sym.IsFunction)
+        Functions[Sym.Name] = &Sym;
+    for (const SizedSymbol &Sym : Symbols) {
+      if (!Sym.Name.ends_with("_sstk"))
+        continue;
+      const SizedSymbol *Fn = Functions.lookup(Sym.Name.drop_back(5));
+      if (!Fn)
+        continue;
+      for (const AllocSection &S : Sections) {
+        if (S.Index != Fn->SectionIndex || Fn->Address < S.Address ||
+            Fn->Address >= S.Address + S.Size)
+          continue;
+        if (unsigned ID = S.Painted[Fn->Address - S.Address])
+          Paint(Sym.SectionIndex, Sym.Address, Sym.Address + Sym.Size, ID);
+      }
+    }
+  }
+
+  StringMap<Sizes> Result;
+  for (const AllocSection &S : Sections) {
+    DenseMap<unsigned, int64_t> Counts;
+    for (unsigned ID : S.Painted)
+      ++Counts[ID];
+    for (const auto &[ID, Count] : Counts) {
+      std::string Label = ID && Dim != Dimension::Section
+                              ? Labels[ID]
+                              : ("[section " + S.Name + "]").str();
+      Sizes &L = Result[Label];
+      if (S.ZP)
+        L.ZP += Count;
+      if (S.RAM)
+        L.RAM += Count;
+      if (S.ROM)
+        L.ROM += Count;
+    }
+  }
+  return Result;
+}
+
+static StringMap<Sizes> attributeFile(StringRef Filename,
+                                      OwningBinary<Binary> &OBinary) {
+  OBinary = unwrapOrError(createBinary(Filename), Filename);
+  auto *Obj = dyn_cast<ELF32LEObjectFile>(OBinary.getBinary());
+  if (!Obj || Obj->getELFFile().getHeader().e_machine != ELF::EM_MOS)
+    reportError(Filename, "expected a MOS ELF file");
+  return attribute(*Obj, ClDimension);
+}
+
+static void printRow(raw_ostream &OS, const Sizes &S, StringRef Label,
+                     bool Signed) {
+  auto PrintColumn = [&](int64_t Value) {
+    std::string Text = std::to_string(Value);
+    if (Signed && Value > 0)
+      Text = "+" + Text;
+    OS << right_justify(Text, 8);
+  };
+  PrintColumn(S.ZP);
+  PrintColumn(S.RAM);
+  PrintColumn(S.ROM);
+  OS << "  " << Label << '\n';
+}
+
+static StringRef getDimensionName(Dimension Dim) {
+  switch (Dim) {
+  case Dimension::Section:
+    return "SECTION";
+  case Dimension::Symbol:
+    return "SYMBOL";
+  case Dimension::File:
+    return "FILE";
+  case Dimension::Inline:
+    return "INLINE";
+  case Dimension::Template:
+    return "TEMPLATE";
+  }
+  llvm_unreachable("unknown dimension");
+}
+
+int main(int argc, char **argv) {
+  InitLLVM X(argc, argv);
+
+  cl::HideUnrelatedOptions({&BloatCategory, &getColorCategory()});
+  cl::ParseCommandLineOptions(argc, argv, "MOS size attribution tool\n");
+  parallel::strategy = hardware_concurrency(ClThreads);
+
+  OwningBinary<Binary> New, Old;
+  StringMap<Sizes> Rows = attributeFile(ClInputFilename, New);
+  const bool Diff = !ClDiff.empty();
+  if (Diff) {
+    for (auto &[Label, S] : attributeFile(ClDiff, Old)) {
+      Sizes &Row = Rows[Label];
+      Row.ZP -= S.ZP;
+      Row.RAM -= S.RAM;
+      Row.ROM -= S.ROM;
+    }
+  }
+
+  std::vector<std::pair<StringRef, Sizes>> Sorted;
+  Sizes Total;
+  for (const auto &Row : Rows) {
+    Total += Row.second;
+    if (!Row.second.isZero())
+      Sorted.push_back({Row.first(), Row.second});
+  }
+  // Diffs put the largest changes either way first.
+  llvm::sort(Sorted, [&](const auto &A, const auto &B) {
+    int64_t KeyA = A.second.get(ClSort), KeyB = B.second.get(ClSort);
+    if (Diff) {
+      KeyA = std::abs(KeyA);
+      KeyB = std::abs(KeyB);
+    }
+    if (KeyA != KeyB)
+      return KeyA > KeyB;
+    return A.first < B.first;
+  });
+
+  raw_ostream &OS = outs();
+  OS << right_justify("ZP", 8) << right_justify("RAM", 8)
+     << right_justify("ROM", 8) << "  " << getDimensionName(ClDimension)
+     << '\n';
+  Sizes Others;
+  size_t NumOthers = 0;
+  for (size_t I = 0; I < Sorted.size(); ++I) {
+    if (ClMaxRows && I >= ClMaxRows) {
+      Others += Sorted[I].second;
+      ++NumOthers;
+      continue;
+    }
+    printRow(OS, Sorted[I].second, Sorted[I].first, Diff);
+  }
+  if (NumOthers)
+    printRow(OS, Others, "[" + std::to_string(NumOthers) + " others]", Diff);
+  printRow(OS, Total, "TOTAL", Diff);
+  return 0;
+}
@@ -0,0 +1,1132 @@
+//===-- llvm-mos-sim.cpp - Simulator for MOS executables ------------------===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// This program runs a MOS ELF executable on a cycle-exact simulation of a
+// 6502 or 65C02, for benchmarking the code the backend generates.
+//
+// Instructions are decoded with the MOS disassembler the first time they are
+// reached, and each address caches its decoded form: a pointer to the handler
+// for the operation, the operand, and the base cycle count. Execution then
+// dispatches straight through the cache. Writes invalidate the cached forms
+// that they overlap, so self-modifying code works as on hardware.
+//
+// A few memory-mapped registers let programs talk to the host:
+//
+//   -clock-addr    four bytes: the cycle count so far, little-endian
+//   -exit-addr     writing exits with the value written as the status
+//   -putchar-addr  writing prints the byte to standard output
+//   -getchar-addr  reading returns a byte from standard input, or 0xff at EOF
+//
+// The program also stops when it returns from its entry point, with the
+// value of A as the status.
+//
+// With -profile, the cycles, instructions and calls of each function are
+// written as a table. With -sample-profile, execution counts are mapped back
+// to source lines through the DWARF line table and written in the text sample
+// profile format that llvm-profdata reads. With -trace, the address of each
+// instruction executed is written, which llvm-profgen --instruction-trace
+// turns into a sample profile as well.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringSwitch.h"
+#include "llvm/BinaryFormat/ELF.h"
+#include "llvm/BinaryFormat/MOSFlags.h"
+#include "llvm/DebugInfo/DIContext.h"
+#include "llvm/DebugInfo/DWARF/DWARFContext.h"
+#include "llvm/MC/MCAsmInfo.h"
+#include "llvm/MC/MCContext.h"
+#include "llvm/MC/MCDisassembler/MCDisassembler.h"
+#include "llvm/MC/MCInst.h"
+#include "llvm/MC/MCInstrInfo.h"
+#include "llvm/MC/MCRegisterInfo.h"
+#include "llvm/MC/MCSubtargetInfo.h"
+#include "llvm/MC/MCTargetOptions.h"
+#include "llvm/MC/TargetRegistry.h"
+#include "llvm/Object/ELFObjectFile.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/ToolOutputFile.h"
+#include "llvm/Support/WithColor.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/TargetParser/Triple.h"
+#include <cstdio>
+#include <map>
+#include <memory>
+
+using namespace llvm;
+using namespace llvm::object;
+
+static cl::OptionCategory SimCategory("llvm-mos-sim Options");
+
+static cl::opt<std::string> InputFilename(cl::Positional, cl::Required,
+                                          cl::desc("<input ELF file>"),
+                                          cl::cat(SimCategory));
+
+static cl::opt<std::string>
+    MCPU("mcpu",
+         cl::desc("Processor to simulate (default: from the ELF e_flags)"),
+         cl::value_desc("cpu-name"), cl::cat(SimCategory));
+
+static cl::opt<uint64_t>
+    MaxCycles("max-cycles",
+              cl::desc("Stop after this many cycles (default: no limit)"),
+              cl::init(0), cl::cat(SimCategory));
+
+static cl::opt<bool>
+    PrintCycles("print-cycles",
+                cl::desc("Print the cycle and instruction counts on exit"),
+                cl::cat(SimCategory));
+
+static cl::opt<std::string>
+    ProfileFilename("profile",
+                    cl::desc("Write a per-function cycle profile to <file>"),
+                    cl::value_desc("file"), cl::cat(SimCategory));
+
+static cl::opt<std::string> SampleProfileFilename(
+    "sample-profile",
+    cl::desc("Write a text sample profile for llvm-profdata to <file>"),
+    cl::value_desc("file"), cl::cat(SimCategory));
+
+static cl::opt<std::string>
+    TraceFilename("trace",
+                  cl::desc("Write the address of each instruction executed "
+                           "to <file>"),
+                  cl::value_desc("file"), cl::cat(SimCategory));
+
+static cl::opt<unsigned>
+    ClockAddr("clock-addr", cl::desc("Address of the cycle counter register"),
+              cl::init(0xfff0), cl::cat(SimCategory));
+
+static cl::opt<unsigned>
+    ExitAddr("exit-addr", cl::desc("Address of the exit register"),
+             cl::init(0xfff8), cl::cat(SimCategory));
+
+static cl::opt<unsigned>
+    PutcharAddr("putchar-addr", cl::desc("Address of the output register"),
+                cl::init(0xfff9), cl::cat(SimCategory));
+
+static cl::opt<unsigned>
+    GetcharAddr("getchar-addr", cl::desc("Address of the input register"),
+                cl::init(0xfffa), cl::cat(SimCategory));
+
+static StringRef ToolName;
+
+[[noreturn]] static void reportError(const Twine &Message) {
+  WithColor::error(errs(), ToolName) << Message << "\n";
+  exit(1);
+}
+
+[[noreturn]] static void reportError(Error E) {
+  reportError(toString(std::move(E)));
+}
+
+namespace {
+
+enum class Mode : uint8_t {
+  Implied,
+  Accumulator,
+  Immediate,
+  ZeroPage,
+  ZeroPageX,
+  ZeroPageY,
+  Relative,
+  Absolute,
+  AbsoluteX,
+  AbsoluteY,
+  Indirect,
+  Indirect16,
+  IndexedIndirect,
+  IndexedIndirect16,
+  IndirectIndexed,
+};
+
+// How an operation uses its operand, which determines its timing.
+enum class Access : uint8_t { None, Read, Write, Modify };
+
+class Simulator;
+struct Decoded;
+using Handler = void (*)(Simulator &S, const Decoded &D);
+
+// The cached decoding of the instruction at an address.
+struct Decoded {
+  Handler Exec = nullptr;
+  Mode AddrMode = Mode::Implied;
+  uint8_t Size = 1;
+  uint8_t Cycles = 0;
+  uint8_t Opcode = 0;
+  uint16_t Operand = 0;
+  // The relative offset of the branch-on-bit instructions.
+  uint8_t Operand2 = 0;
+};
+
+enum : uint8_t {
+  FlagC = 1 << 0,
+  FlagZ = 1 << 1,
+  FlagI = 1 << 2,
+  FlagD = 1 << 3,
+  FlagB = 1 << 4,
+  Flag1 = 1 << 5,
+  FlagV = 1 << 6,
+  FlagN = 1 << 7,
+};
+
+class Simulator {
+public:
+  uint8_t A = 0, X = 0, Y = 0, S = 0xff, P = Flag1 | FlagI;
+  uint16_t PC = 0;
+  bool CMOS = false;
+
+  uint64_t Cycles = 0;
+  uint64_t Instructions = 0;
+  bool Running = true;
+  int ExitStatus = 0;
+  std::string StopReason;
+
+  // Per-address execution counts and cycles, and per-address counts of calls
+  // made to that address, kept only when profiling.
+  bool Profiling = false;
+  std::vector<uint64_t> ExecCounts;
+  std::vector<uint64_t> CycleCounts;
+  std::vector<uint64_t> CallCounts;
+
+  // Where to write the address of each instruction executed, if anywhere.
+  raw_ostream *Trace = nullptr;
+
+  Simulator(const MCDisassembler &DisAsm, const MCInstrInfo &MII, bool CMOS)
+      : CMOS(CMOS), Mem(0x10000), Cache(0x10000), DisAsm(DisAsm), MII(MII) {}
+
+  void load(uint16_t Addr, ArrayRef<uint8_t> Bytes) {
+    for (uint8_t B : Bytes)
+      Mem[Addr++] = B;
+  }
+
+  uint16_t peek16(uint16_t Addr) const {
+    return Mem[Addr] | Mem[uint16_t(Addr + 1)] << 8;
+  }
+
+  void enableProfiling() {
+    Profiling = true;
+    ExecCounts.assign(0x10000, 0);
+    CycleCounts.assign(0x10000, 0);
+    CallCounts.assign(0x10000, 0);
+  }
+
+  void mapIO(uint16_t Addr) { IOPages[Addr >> 8] = true; }
+
+  void run();
+
+  // Memory access, with the memory-mapped registers.
+  uint8_t read(uint16_t Addr) {
+    if (IOPages[Addr >> 8]) {
+      if (Addr >= ClockAddr && Addr < ClockAddr + 4)
+        return Cycles >> (Addr - ClockAddr) * 8;
+      if (Addr == GetcharAddr) {
+        int C = std::getchar();
+        return C == EOF ? 0xff : C;
+      }
+    }
+    return Mem[Addr];
+  }
+
+  void write(uint16_t Addr, uint8_t Val) {
+    if (IOPages[Addr >> 8]) {
+      if (Addr == ExitAddr) {
+        stop(Val, "");
+        return;
+      }
+      if (Addr == PutcharAddr) {
+        outs() << char(Val);
+        return;
+      }
+    }
+    Mem[Addr] = Val;
+    // Instructions are at most three bytes long.
+    Cache[Addr].Exec = nullptr;
+    Cache[uint16_t(Addr - 1)].Exec = nullptr;
+    Cache[uint16_t(Addr - 2)].Exec = nullptr;
+  }
+
+  uint16_t readZP16(uint8_t Addr) {
+    return Mem[Addr] | Mem[uint8_t(Addr + 1)] << 8;
+  }
+
+  void push(uint8_t Val) { Mem[0x100 | S--] = Val; }
+  uint8_t pull() { return Mem[0x100 | ++S]; }
+  void push16(uint16_t Val) {
+    push(Val >> 8);
+    push(Val);
+  }
+  uint16_t pull16() {
+    uint16_t Lo = pull();
+    return Lo | pull() << 8;
+  }
+
+  void setFlag(uint8_t Flag, bool Set) { P = Set ? P | Flag : P & ~Flag; }
+  bool flag(uint8_t Flag) const { return P & Flag; }
+  uint8_t setNZ(uint8_t Val) {
+    setFlag(FlagZ, !Val);
+    setFlag(FlagN, Val & 0x80);
+    return Val;
+  }
+
+  void stop(int Status, StringRef Reason) {
+    Running = false;
+    ExitStatus = Status;
+    StopReason = Reason.str();
+  }
+
+  // Returns the effective address of D. Indexing that crosses a page costs a
+  // cycle if ChargePageCross is set.
+  uint16_t address(const Decoded &D, bool ChargePageCross) {
+    auto Indexed = [&](uint16_t Base, uint8_t Index) {
+      uint16_t Addr = Base + Index;
+      if (ChargePageCross && (Addr ^ Base) & 0xff00)
+        ++Cycles;
+      return Addr;
+    };
+    switch (D.AddrMode) {
+    case Mode::ZeroPage:
+      return D.Operand & 0xff;
+    case Mode::ZeroPageX:
+      return uint8_t(D.Operand + X);
+    case Mode::ZeroPageY:
+      return uint8_t(D.Operand + Y);
+    case Mode::Absolute:
+      return D.Operand;
+    case Mode::AbsoluteX:
+      return Indexed(D.Operand, X);
+    case Mode::AbsoluteY:
+      return Indexed(D.Operand, Y);
+    case Mode::Indirect:
+      return readZP16(D.Operand);
+    case Mode::IndexedIndirect:
+      return readZP16(D.Operand + X);
+    case Mode::IndirectIndexed:
+      return Indexed(readZP16(D.Operand), Y);
+    default:
+      llvm_unreachable("instruction has no memory operand");
+    }
+  }
+
+  // Returns the operand value that D reads.
+  uint8_t operand(const Decoded &D) {
+    if (D.AddrMode == Mode::Immediate)
+      return D.Operand;
+    return read(address(D, /*ChargePageCross=*/true));
+  }
+
+  // Applies Op to the operand of the read-modify-write D.
+  template <typename Fn> void modify(const Decoded &D, Fn Op) {
+    if (D.AddrMode == Mode::Accumulator) {
+      A = Op(A);
+      return;
+    }
+    // The 65C02 skips the extra cycle of indexed shifts within a page.
+    uint16_t Addr = address(D, CMOS && D.Cycles == 6 &&
+                                   D.AddrMode == Mode::AbsoluteX);
+    write(Addr, Op(read(Addr)));
+  }
+
+  void branch(const Decoded &D, bool Taken, uint8_t Offset) {
+    if (!Taken)
+      return;
+    uint16_t Target = PC + int8_t(Offset);
+    Cycles += (Target ^ PC) & 0xff00 ? 2 : 1;
+    PC = Target;
+  }
+
+  void compare(uint8_t Reg, uint8_t Val) {
+    setFlag(FlagC, Reg >= Val);
+    setNZ(Reg - Val);
+  }
+
+  void adc(uint8_t Val);
+  void sbc(uint8_t Val);
+
+private:
+  std::vector<uint8_t> Mem;
+  std::vector<Decoded> Cache;
+  bool IOPages[0x100] = {};
+  const MCDisassembler &DisAsm;
+  const MCInstrInfo &MII;
+
+  const Decoded &decode(uint16_t Addr);
+};
+
+void Simulator::adc(uint8_t Val) {
+  unsigned C = flag(FlagC);
+  unsigned Bin = A + Val + C;
+  if (!flag(FlagD)) {
+    setFlag(FlagC, Bin > 0xff);
+    setFlag(FlagV, ~(A ^ Val) & (A ^ Bin) & 0x80);
+    A = setNZ(Bin);
+    return;
+  }
+
+  unsigned Lo = (A & 0x0f) + (Val & 0x0f) + C;
+  if (Lo > 9)
+    Lo += 6;
+  unsigned Hi = (A >> 4) + (Val >> 4) + (Lo > 0x0f);
+  // The NMOS 6502 sets N, V and Z from intermediate results, the 65C02 sets
+  // N and Z from the decimal result at the cost of a cycle.
+  setFlag(FlagZ, !(Bin & 0xff));
+  setFlag(FlagN, Hi & 0x08);
+  setFlag(FlagV, ~(A ^ Val) & (A ^ (Hi << 4)) & 0x80);
+  if (Hi > 9)
+    Hi += 6;
+  setFlag(FlagC, Hi > 0x0f);
+  A = Hi << 4 | (Lo & 0x0f);
+  if (CMOS) {
+    setNZ(A);
+    ++Cycles;
+  }
+}
+
+void Simulator::sbc(uint8_t Val) {
+  unsigned Borrow = !flag(FlagC);
+  unsigned Bin = A - Val - Borrow;
+  uint8_t Old = A;
+  setFlag(FlagC, Bin < 0x100);
+  setFlag(FlagV, (A ^ Val) & (A ^ Bin) & 0x80);
+  A = setNZ(Bin);
+  if (!flag(FlagD))
+    return;
+
+  int Lo = (Old & 0x0f) - (Val & 0x0f) - Borrow;
+  int Hi = (Old >> 4) - (Val >> 4);
+  if (Lo < 0) {
+    Lo -= 6;
+    --Hi;
+  }
+  if (Hi < 0)
+    Hi -= 6;
+  A = (Hi << 4 | (Lo & 0x0f)) & 0xff;
+  if (CMOS) {
+    setNZ(A);
+    ++Cycles;
+  }
+}
+
+//===----------------------------------------------------------------------===//
+// Operations
+//===----------------------------------------------------------------------===//
+
+#define OP(Name) static void op##Name(Simulator &S, const Decoded &D)
+
+OP(Illegal) {
+  S.PC -= D.Size;
+  S.stop(1, "unsupported instruction");
+}
+
+OP(LDA) { S.A = S.setNZ(S.operand(D)); }
+OP(LDX) { S.X = S.setNZ(S.operand(D)); }
+OP(LDY) { S.Y = S.setNZ(S.operand(D)); }
+OP(STA) { S.write(S.address(D, false), S.A); }
+OP(STX) { S.write(S.address(D, false), S.X); }
+OP(STY) { S.write(S.address(D, false), S.Y); }
+OP(STZ) { S.write(S.address(D, false), 0); }
+
+OP(ADC) { S.adc(S.operand(D)); }
+OP(SBC) { S.sbc(S.operand(D)); }
+OP(AND) { S.A = S.setNZ(S.A & S.operand(D)); }
+OP(ORA) { S.A = S.setNZ(S.A | S.operand(D)); }
+OP(EOR) { S.A = S.setNZ(S.A ^ S.operand(D)); }
+OP(CMP) { S.compare(S.A, S.operand(D)); }
+OP(CPX) { S.compare(S.X, S.operand(D)); }
+OP(CPY) { S.compare(S.Y, S.operand(D)); }
+OP(BIT) {
+  uint8_t Val = S.operand(D);
+  S.setFlag(FlagZ, !(S.A & Val));
+  if (D.AddrMode == Mode::Immediate)
+    return;
+  S.setFlag(FlagN, Val & 0x80);
+  S.setFlag(FlagV, Val & 0x40);
+}
+OP(NOP) {
+  if (D.AddrMode != Mode::Implied)
+    S.operand(D);
+}
+
+OP(ASL) {
+  S.modify(D, [&](uint8_t V) {
+    S.setFlag(FlagC, V & 0x80);
+    return S.setNZ(V << 1);
+  });
+}
+OP(LSR) {
+  S.modify(D, [&](uint8_t V) {
+    S.setFlag(FlagC, V & 1);
+    return S.setNZ(V >> 1);
+  });
+}
+OP(ROL) {
+  S.modify(D, [&](uint8_t V) {
+    uint8_t C = S.flag(FlagC);
+    S.setFlag(FlagC, V & 0x80);
+    return S.setNZ(V << 1 | C);
+  });
+}
+OP(ROR) {
+  S.modify(D, [&](uint8_t V) {
+    uint8_t C = S.flag(FlagC);
+    S.setFlag(FlagC, V & 1);
+    return S.setNZ(V >> 1 | C << 7);
+  });
+}
+OP(INC) {
+  S.modify(D, [&](uint8_t V) { return S.setNZ(V + 1); });
+}
+OP(DEC) {
+  S.modify(D, [&](uint8_t V) { return S.setNZ(V - 1); });
+}
+OP(TSB) {
+  S.modify(D, [&](uint8_t V) {
+    S.setFlag(FlagZ, !(S.A & V));
+    return uint8_t(V | S.A);
+  });
+}
+OP(TRB) {
+  S.modify(D, [&](uint8_t V) {
+    S.setFlag(FlagZ, !(S.A & V));
+    return uint8_t(V & ~S.A);
+  });
+}
+OP(RMB) {
+  uint8_t Bit = 1 << (D.Opcode >> 4 & 7);
+  S.modify(D, [&](uint8_t V) { return uint8_t(V & ~Bit); });
+}
+OP(SMB) {
+  uint8_t Bit = 1 << (D.Opcode >> 4 & 7);
+  S.modify(D, [&](uint8_t V) { return uint8_t(V | Bit); });
+}
+
+OP(INX) { S.X = S.setNZ(S.X + 1); }
+OP(INY) { S.Y = S.setNZ(S.Y + 1); }
+OP(DEX) { S.X = S.setNZ(S.X - 1); }
+OP(DEY) { S.Y = S.setNZ(S.Y - 1); }
+OP(TAX) { S.X = S.setNZ(S.A); }
+OP(TAY) { S.Y = S.setNZ(S.A); }
+OP(TXA) { S.A = S.setNZ(S.X); }
+OP(TYA) { S.A = S.setNZ(S.Y); }
+OP(TSX) { S.X = S.setNZ(S.S); }
+OP(TXS) { S.S = S.X; }
+
+OP(CLC) { S.setFlag(FlagC, false); }
+OP(SEC) { S.setFlag(FlagC, true); }
+OP(CLI) { S.setFlag(FlagI, false); }
+OP(SEI) { S.setFlag(FlagI, true); }
+OP(CLD) { S.setFlag(FlagD, false); }
+OP(SED) { S.setFlag(FlagD, true); }
+OP(CLV) { S.setFlag(FlagV, false); }
+
+OP(PHA) { S.push(S.A); }
+OP(PHX) { S.push(S.X); }
+OP(PHY) { S.push(S.Y); }
+OP(PHP) { S.push(S.P | FlagB | Flag1); }
+OP(PLA) { S.A = S.setNZ(S.pull()); }
+OP(PLX) { S.X = S.setNZ(S.pull()); }
+OP(PLY) { S.Y = S.setNZ(S.pull()); }
+OP(PLP) { S.P = (S.pull() & ~FlagB) | Flag1; }
+
+OP(BPL) { S.branch(D, !S.flag(FlagN), D.Operand); }
+OP(BMI) { S.branch(D, S.flag(FlagN), D.Operand); }
+OP(BVC) { S.branch(D, !S.flag(FlagV), D.Operand); }
+OP(BVS) { S.branch(D, S.flag(FlagV), D.Operand); }
+OP(BCC) { S.branch(D, !S.flag(FlagC), D.Operand); }
+OP(BCS) { S.branch(D, S.flag(FlagC), D.Operand); }
+OP(BNE) { S.branch(D, !S.flag(FlagZ), D.Operand); }
+OP(BEQ) { S.branch(D, S.flag(FlagZ), D.Operand); }
+OP(BRA) { S.branch(D, true, D.Operand); }
+OP(BBR) {
+  uint8_t Bit = 1 << (D.Opcode >> 4 & 7);
+  S.branch(D, !(S.read(D.Operand & 0xff) & Bit), D.Operand2);
+}
+OP(BBS) {
+  uint8_t Bit = 1 << (D.Opcode >> 4 & 7);
+  S.branch(D, S.read(D.Operand & 0xff) & Bit, D.Operand2);
+}
+
+OP(JMP) {
+  switch (D.AddrMode) {
+  case Mode::Absolute:
+    S.PC = D.Operand;
+    return;
+  case Mode::Indirect16: {
+    // The NMOS 6502 doesn't carry into the high byte of the pointer.
+    uint16_t Hi = S.CMOS ? D.Operand + 1
+                         : (D.Operand & 0xff00) | uint8_t(D.Operand + 1);
+    S.PC = S.read(D.Operand) | S.read(Hi) << 8;
+    return;
+  }
+  case Mode::IndexedIndirect16: {
+    uint16_t Ptr = D.Operand + S.X;
+    S.PC = S.read(Ptr) | S.read(Ptr + 1) << 8;
+    return;
+  }
+  default:
+    opIllegal(S, D);
+    return;
+  }
+}
+OP(JSR) {
+  S.push16(S.PC - 1);
+  S.PC = D.Operand;
+  if (S.Profiling)
+    ++S.CallCounts[S.PC];
+}
+OP(RTS) {
+  // Returning with an empty stack returns from the entry point.
+  if (S.S == 0xff) {
+    S.stop(S.A, "");
+    return;
+  }
+  S.PC = S.pull16() + 1;
+}
+OP(RTI) {
+  S.P = (S.pull() & ~FlagB) | Flag1;
+  S.PC = S.pull16();
+}
+OP(BRK) {
+  S.push16(S.PC + 1);
+  S.push(S.P | FlagB | Flag1);
+  S.setFlag(FlagI, true);
+  if (S.CMOS)
+    S.setFlag(FlagD, false);
+  S.PC = S.peek16(0xfffe);
+}
+OP(WAI) { S.stop(1, "wait for interrupt with no interrupt source"); }
+OP(STP) { S.stop(1, "processor stopped"); }
+
+#undef OP
+
+struct OpInfo {
+  Handler Exec;
+  Access Acc;
+};
+
+static OpInfo getOpInfo(StringRef Mnemonic) {
+  return StringSwitch<OpInfo>(Mnemonic)
+      .Case("LDA", {opLDA, Access::Read})
+      .Case("LDX", {opLDX, Access::Read})
+      .Case("LDY", {opLDY, Access::Read})
+      .Case("STA", {opSTA, Access::Write})
+      .Case("STX", {opSTX, Access::Write})
+      .Case("STY", {opSTY, Access::Write})
+      .Case("STZ", {opSTZ, Access::Write})
+      .Case("ADC", {opADC, Access::Read})
+      .Case("SBC", {opSBC, Access::Read})
+      .Case("AND", {opAND, Access::Read})
+      .Case("ORA", {opORA, Access::Read})
+      .Case("EOR", {opEOR, Access::Read})
+      .Case("CMP", {opCMP, Access::Read})
+      .Case("CPX", {opCPX, Access::Read})
+      .Case("CPY", {opCPY, Access::Read})
+      .Case("BIT", {opBIT, Access::Read})
+      .Case("NOP", {opNOP, Access::Read})
+      .Case("ASL", {opASL, Access::Modify})
+      .Case("LSR", {opLSR, Access::Modify})
+      .Case("ROL", {opROL, Access::Modify})
+      .Case("ROR", {opROR, Access::Modify})
+      .Case("INC", {opINC, Access::Modify})
+      .Case("DEC", {opDEC, Access::Modify})
+      .Case("TSB", {opTSB, Access::Modify})
+      .Case("TRB", {opTRB, Access::Modify})
+      .Case("RMB", {opRMB, Access::Modify})
+      .Case("SMB", {opSMB, Access::Modify})
+      .Case("INX", {opINX, Access::None})
+      .Case("INY", {opINY, Access::None})
+      .Case("DEX", {opDEX, Access::None})
+      .Case("DEY", {opDEY, Access::None})
+      .Case("TAX", {opTAX, Access::None})
+      .Case("TAY", {opTAY, Access::None})
+      .Case("TXA", {opTXA, Access::None})
+      .Case("TYA", {opTYA, Access::None})
+      .Case("TSX", {opTSX, Access::None})
+      .Case("TXS", {opTXS, Access::None})
+      .Case("CLC", {opCLC, Access::None})
+      .Case("SEC", {opSEC, Access::None})
+      .Case("CLI", {opCLI, Access::None})
+      .Case("SEI", {opSEI, Access::None})
+      .Case("CLD", {opCLD, Access::None})
+      .Case("SED", {opSED, Access::None})
+      .Case("CLV", {opCLV, Access::None})
+      .Case("PHA", {opPHA, Access::None})
+      .Case("PHX", {opPHX, Access::None})
+      .Case("PHY", {opPHY, Access::None})
+      .Case("PHP", {opPHP, Access::None})
+      .Case("PLA", {opPLA, Access::None})
+      .Case("PLX", {opPLX, Access::None})
+      .Case("PLY", {opPLY, Access::None})
+      .Case("PLP", {opPLP, Access::None})
+      .Case("BPL", {opBPL, Access::None})
+      .Case("BMI", {opBMI, Access::None})
+      .Case("BVC", {opBVC, Access::None})
+      .Case("BVS", {opBVS, Access::None})
+      .Case("BCC", {opBCC, Access::None})
+      .Case("BCS", {opBCS, Access::None})
+      .Case("BNE", {opBNE, Access::None})
+      .Case("BEQ", {opBEQ, Access::None})
+      .Case("BRA", {opBRA, Access::None})
+      .Case("BBR", {opBBR, Access::None})
+      .Case("BBS", {opBBS, Access::None})
+      .Case("JMP", {opJMP, Access::None})
+      .Case("JSR", {opJSR, Access::None})
+      .Case("RTS", {opRTS, Access::None})
+      .Case("RTI", {opRTI, Access::None})
+      .Case("BRK", {opBRK, Access::None})
+      .Case("WAI", {opWAI, Access::None})
+      .Case("STP", {opSTP, Access::None})
+      .Default({opIllegal, Access::None});
+}
+
+static std::optional<Mode> getMode(StringRef Name) {
+  return StringSwitch<std::optional<Mode>>(Name)
+      .Case("Implied", Mode::Implied)
+      .Case("Accumulator", Mode::Accumulator)
+      .Case("Immediate", Mode::Immediate)
+      .Case("ZeroPage", Mode::ZeroPage)
+      .Case("ZeroPageX", Mode::ZeroPageX)
+      .Case("ZeroPageY", Mode::ZeroPageY)
+      .Case("Relative", Mode::Relative)
+      .Case("Absolute", Mode::Absolute)
+      .Case("AbsoluteX", Mode::AbsoluteX)
+      .Case("AbsoluteY", Mode::AbsoluteY)
+      .Case("Indirect", Mode::Indirect)
+      .Case("Indirect16", Mode::Indirect16)
+      .Case("IndexedIndirect", Mode::IndexedIndirect)
+      .Case("IndexedIndirect16", Mode::IndexedIndirect16)
+      .Case("IndirectIndexed", Mode::IndirectIndexed)
+      .Default(std::nullopt);
+}
+
+// Returns the cycles an instruction takes before any page crossing, taken
+// branch, or decimal mode penalty.
+static uint8_t getBaseCycles(StringRef Mnemonic, Access Acc, Mode M,
+                             bool CMOS) {
+  switch (M) {
+  case Mode::Implied:
+    return StringSwitch<uint8_t>(Mnemonic)
+        .Cases("PHA", "PHP", "PHX", "PHY", 3)
+        .Cases("PLA", "PLP", "PLX", "PLY", 4)
+        .Cases("RTS", "RTI", 6)
+        .Case("BRK", 7)
+        .Cases("WAI", "STP", 3)
+        .Default(2);
+  case Mode::Accumulator:
+  case Mode::Immediate:
+  case Mode::Relative:
+    return 2;
+  case Mode::ZeroPage:
+    if (Mnemonic == "BBR" || Mnemonic == "BBS")
+      return 5;
+    return Acc == Access::Modify ? 5 : 3;
+  case Mode::ZeroPageX:
+  case Mode::ZeroPageY:
+    return Acc == Access::Modify ? 6 : 4;
+  case Mode::Absolute:
+    if (Mnemonic == "JMP")
+      return 3;
+    if (Mnemonic == "JSR")
+      return 6;
+    return Acc == Access::Modify ? 6 : 4;
+  case Mode::AbsoluteX:
+  case Mode::AbsoluteY:
+    if (Acc == Access::Modify) {
+      bool IsShift = is_contained({"ASL", "LSR", "ROL", "ROR"}, Mnemonic);
+      return CMOS && IsShift ? 6 : 7;
+    }
+    return Acc == Access::Write ? 5 : 4;
+  case Mode::Indirect:
+    return 5;
+  case Mode::Indirect16:
+    return CMOS ? 6 : 5;
+  case Mode::IndexedIndirect:
+  case Mode::IndexedIndirect16:
+    return 6;
+  case Mode::IndirectIndexed:
+    return Acc == Access::Write ? 6 : 5;
+  }
+  llvm_unreachable("unknown addressing mode");
+}
+
+const Decoded &Simulator::decode(uint16_t Addr) {
+  Decoded &D = Cache[Addr];
+  uint8_t Bytes[3] = {Mem[Addr], Mem[uint16_t(Addr + 1)],
+                      Mem[uint16_t(Addr + 2)]};
+  D = Decoded();
+  D.Exec = opIllegal;
+  D.Opcode = Bytes[0];
+
+  MCInst Inst;
+  uint64_t Size;
+  if (DisAsm.getInstruction(Inst, Size, Bytes, Addr, nulls()) !=
+      MCDisassembler::Success)
+    return D;
+  D.Size = Size;
+
+  // Real instructions are named for their mnemonic and addressing mode.
+  auto [Mnemonic, Rest] = MII.getName(Inst.getOpcode()).split('_');
+  std::optional<Mode> M = getMode(Rest.split('_').first);
+  if (!M)
+    return D;
+  // JMP (abs,X) is named for the zero page form of its addressing mode.
+  if (*M == Mode::IndexedIndirect && Size == 3)
+    M = Mode::IndexedIndirect16;
+  OpInfo Info = getOpInfo(Mnemonic);
+  if (Info.Exec == opIllegal)
+    return D;
+
+  D.AddrMode = *M;
+  D.Operand = Size > 1 ? Bytes[1] : 0;
+  if (Size > 2) {
+    if (Mnemonic == "BBR" || Mnemonic == "BBS")
+      D.Operand2 = Bytes[2];
+    else
+      D.Operand |= Bytes[2] << 8;
+  }
+  D.Cycles = getBaseCycles(Mnemonic, Info.Acc, *M, CMOS);
+  D.Exec = Info.Exec;
+  return D;
+}
+
+void Simulator::run() {
+  while (Running) {
+    const Decoded *D = &Cache[PC];
+    if (!D->Exec)
+      D = &decode(PC);
+    uint16_t At = PC;
+    uint64_t Before = Cycles;
+    if (Trace)
+      *Trace << format_hex_no_prefix(At, 4) << '\n';
+    PC += D->Size;
+    Cycles += D->Cycles;
+    D->Exec(*this, *D);
+    ++Instructions;
+    if (Profiling) {
+      ++ExecCounts[At];
+      CycleCounts[At] += Cycles - Before;
+    }
+    if (MaxCycles && Cycles >= MaxCycles)
+      stop(1, "cycle limit reached");
+  }
+}
+
+} // namespace
+
+//===----------------------------------------------------------------------===//
+// Loading and profiles
+//===----------------------------------------------------------------------===//
+
+// Returns the CPU that produced an executable with the given e_flags, or an
+// empty string if it isn't one that can be simulated.
+static StringRef getCPUForEFlags(unsigned EFlags) {
+  const unsigned Unsupported =
+      ELF::EF_MOS_ARCH_W65816 | ELF::EF_MOS_ARCH_65EL02 |
+      ELF::EF_MOS_ARCH_65CE02 | ELF::EF_MOS_ARCH_HUC6280 |
+      ELF::EF_MOS_ARCH_65DTV02 | ELF::EF_MOS_ARCH_4510 |
+      ELF::EF_MOS_ARCH_45GS02 | ELF::EF_MOS_ARCH_SWEET16 |
+      ELF::EF_MOS_ARCH_SPC700;
+  if (EFlags & Unsupported)
+    return "";
+  if (EFlags & ELF::EF_MOS_ARCH_W65C02)
+    return "mosw65c02";
+  if (EFlags & ELF::EF_MOS_ARCH_R65C02)
+    return "mosr65c02";
+  if (EFlags & ELF::EF_MOS_ARCH_65C02)
+    return "mos65c02";
+  if (EFlags & ELF::EF_MOS_ARCH_6502X)
+    return "mos6502x";
+  return "mos6502";
+}
+
+static bool isSupportedCPU(StringRef CPU) {
+  return is_contained({"mos6502", "mos6502x", "mos65c02", "mosr65c02",
+                       "mosw65c02"},
+                      CPU);
+}
+
+static bool isCMOS(StringRef CPU) {
+  return StringSwitch<bool>(CPU)
+      .Cases("mos65c02", "mosr65c02", "mosw65c02", true)
+      .Default(false);
+}
+
+static void loadSegments(Simulator &Sim, const ELF32LEObjectFile &Obj) {
+  const ELF32LEFile &ELF = Obj.getELFFile();
+  auto PhdrsOrErr = ELF.program_headers();
+  if (!PhdrsOrErr)
+    reportError(PhdrsOrErr.takeError());
+  for (const ELF32LE::Phdr &Phdr : *PhdrsOrErr) {
+    if (Phdr.p_type != ELF::PT_LOAD || !Phdr.p_memsz)
+      continue;
+    // Banked segments above 64 KiB aren't visible to the processor.
+    if (Phdr.p_vaddr + Phdr.p_memsz > 0x10000)
+      continue;
+    if (Phdr.p_offset + Phdr.p_filesz > ELF.getBufSize())
+      reportError("segment extends past the end of the file");
+    Sim.load(Phdr.p_vaddr,
+             ArrayRef(ELF.base() + Phdr.p_offset, Phdr.p_filesz));
+    SmallVector<uint8_t> Zeros(Phdr.p_memsz - Phdr.p_filesz);
+    Sim.load(Phdr.p_vaddr + Phdr.p_filesz, Zeros);
+  }
+}
+
+namespace {
+struct Function {
+  StringRef Name;
+  uint16_t Begin;
+  uint32_t Size;
+};
+} // namespace
+
+static std::vector<Function> getFunctions(const ObjectFile &Obj) {
+  std::vector<Function> Functions;
+  for (const SymbolRef &Sym : Obj.symbols()) {
+    Expected<SymbolRef::Type> Type = Sym.getType();
+    Expected<uint64_t> Addr = Sym.getAddress();
+    Expected<StringRef> Name = Sym.getName();
+    if (!Type || !Addr || !Name) {
+      consumeError(Type.takeError());
+      consumeError(Addr.takeError());
+      consumeError(Name.takeError());
+      continue;
+    }
+    uint64_t Size = ELFSymbolRef(Sym).getSize();
+    if (*Type != SymbolRef::ST_Function || !Size || *Addr + Size > 0x10000)
+      continue;
+    Functions.push_back({*Name, uint16_t(*Addr), uint32_t(Size)});
+  }
+  sort(Functions, [](const Function &L, const Function &R) {
+    return L.Begin < R.Begin;
+  });
+  return Functions;
+}
+
+static void writeProfile(const Simulator &Sim,
+                         ArrayRef<Function> Functions) {
+  std::error_code EC;
+  ToolOutputFile Out(ProfileFilename, EC, sys::fs::OF_TextWithCRLF);
+  if (EC)
+    reportError(ProfileFilename + ": " + EC.message());
+
+  struct Entry {
+    StringRef Name;
+    uint64_t Cycles = 0;
+    uint64_t Instructions = 0;
+    uint64_t Calls = 0;
+  };
+  std::vector<Entry> Entries;
+  std::vector<bool> Covered(0x10000);
+  uint64_t Total = 0;
+  for (const Function &F : Functions) {
+    Entry E{F.Name};
+    E.Calls = Sim.CallCounts[F.Begin];
+    for (uint32_t Addr = F.Begin; Addr < F.Begin + F.Size; ++Addr) {
+      if (Covered[Addr])
+        continue;
+      Covered[Addr] = true;
+      E.Cycles += Sim.CycleCounts[Addr];
+      E.Instructions += Sim.ExecCounts[Addr];
+    }
+    Total += E.Cycles;
+    if (E.Instructions)
+      Entries.push_back(E);
+  }
+  Entry Unknown{"<unknown>"};
+  for (uint32_t Addr = 0; Addr < 0x10000; ++Addr) {
+    if (Covered[Addr])
+      continue;
+    Unknown.Cycles += Sim.CycleCounts[Addr];
+    Unknown.Instructions += Sim.ExecCounts[Addr];
+  }
+  Total += Unknown.Cycles;
+  if (Unknown.Instructions)
+    Entries.push_back(Unknown);
+  stable_sort(Entries, [](const Entry &L, const Entry &R) {
+    return L.Cycles > R.Cycles;
+  });
+
+  raw_ostream &OS = Out.os();
+  OS << format("%14s %7s %14s %10s  %s\n", "cycles", "%", "instructions",
+               "calls", "function");
+  for (const Entry &E : Entries)
+    OS << format("%14llu %6.2f%% %14llu %10llu  ", E.Cycles,
+                 Total ? 100.0 * E.Cycles / Total : 0.0, E.Instructions,
+                 E.Calls)
+       << E.Name << "\n";
+  Out.keep();
+}
+
+// Writes the execution counts in the text sample profile format, keyed as
+// llvm-profdata and the sample profile loader expect: by line offset from the
+// start of the enclosing (not inlined) function, and discriminator.
+static void writeSampleProfile(const Simulator &Sim, const ObjectFile &Obj,
+                               ArrayRef<Function> Functions) {
+  std::unique_ptr<DWARFContext> DICtx = DWARFContext::create(Obj);
+  if (!DICtx->getNumCompileUnits())
+    reportError("-sample-profile needs DWARF line tables in " + InputFilename);
+
+  std::error_code EC;
+  ToolOutputFile Out(SampleProfileFilename, EC, sys::fs::OF_TextWithCRLF);
+  if (EC)
+    reportError(SampleProfileFilename + ": " + EC.message());
+
+  struct FunctionSamples {
+    uint64_t Head = 0;
+    std::map<std::pair<uint32_t, uint32_t>, uint64_t> Lines;
+  };
+  std::map<std::string, FunctionSamples> Profiles;
+  StringMap<uint64_t> Calls;
+  for (const Function &F : Functions)
+    Calls[F.Name] += Sim.CallCounts[F.Begin];
+
+  DILineInfoSpecifier Spec(DILineInfoSpecifier::FileLineInfoKind::None,
+                           DINameKind::LinkageName);
+  for (uint32_t Addr = 0; Addr < 0x10000; ++Addr) {
+    uint64_t Count = Sim.ExecCounts[Addr];
+    if (!Count)
+      continue;
+    DIInliningInfo Inlining = DICtx->getInliningInfoForAddress(
+        {Addr, SectionedAddress::UndefSection}, Spec);
+    if (!Inlining.getNumberOfFrames())
+      continue;
+    const DILineInfo &Outer =
+        Inlining.getFrame(Inlining.getNumberOfFrames() - 1);
+    if (Outer.FunctionName == DILineInfo::BadString || !Outer.Line)
+      continue;
+    FunctionSamples &FS = Profiles[Outer.FunctionName];
+    uint32_t Offset =
+        Outer.Line >= Outer.StartLine ? Outer.Line - Outer.StartLine : 0;
+    // Every instruction on a line runs as often as the line does.
+    uint64_t &LineCount = FS.Lines[{Offset, Outer.Discriminator}];
+    LineCount = std::max(LineCount, Count);
+  }
+
+  raw_ostream &OS = Out.os();
+  for (auto &[Name, FS] : Profiles) {
+    uint64_t Total = 0;
+    for (const auto &[Loc, Count] : FS.Lines)
+      Total += Count;
+    OS << Name << ":" << Total << ":" << Calls.lookup(Name) << "\n";
+    for (const auto &[Loc, Count] : FS.Lines) {
+      OS << " " << Loc.first;
+      if (Loc.second)
+        OS << "." << Loc.second;
+      OS << ": " << Count << "\n";
+    }
+  }
+  Out.keep();
+}
+
+int main(int argc, char **argv) {
+  InitLLVM X(argc, argv);
+  ToolName = argv[0];
+  cl::HideUnrelatedOptions(SimCategory);
+  cl::ParseCommandLineOptions(argc, argv, "MOS executable simulator\n");
+
+  InitializeAllTargetInfos();
+  InitializeAllTargetMCs();
+  InitializeAllDisassemblers();
+
+  Expected<OwningBinary<ObjectFile>> BinOrErr =
+      ObjectFile::createObjectFile(InputFilename);
+  if (!BinOrErr)
+    reportError(BinOrErr.takeError());
+  const auto *Obj = dyn_cast<ELF32LEObjectFile>(BinOrErr->getBinary());
+  if (!Obj || Obj->getArch() != Triple::mos)
+    reportError(InputFilename + ": not a MOS ELF executable");
+
+  std::string CPU = MCPU;
+  if (CPU.empty()) {
+    CPU = getCPUForEFlags(Obj->getPlatformFlags()).str();
+    if (CPU.empty())
+      reportError(InputFilename + ": simulating " +
+                  MOS::makeEFlagsString(Obj->getPlatformFlags()) +
+                  " is not supported");
+  } else if (!isSupportedCPU(CPU)) {
+    reportError("simulating " + CPU + " is not supported");
+  }
+
+  Triple TheTriple("mos");
+  std::string Err;
+  const Target *T = TargetRegistry::lookupTarget(TheTriple, Err);
+  if (!T)
+    reportError(Err);
+  std::unique_ptr<MCRegisterInfo> MRI(T->createMCRegInfo(TheTriple));
+  MCTargetOptions MCOptions;
+  std::unique_ptr<MCAsmInfo> MAI(
+      T->createMCAsmInfo(*MRI, TheTriple, MCOptions));
+  std::unique_ptr<MCSubtargetInfo> STI(
+      T->createMCSubtargetInfo(TheTriple, CPU, ""));
+  std::unique_ptr<MCInstrInfo> MII(T->createMCInstrInfo());
+  if (!MRI || !MAI || !STI || !MII)
+    reportError("unable to create the MOS target description");
+  MCContext Ctx(TheTriple, MAI.get(), MRI.get(), STI.get());
+  std::unique_ptr<MCDisassembler> DisAsm(T->createMCDisassembler(*STI, Ctx));
+  if (!DisAsm)
+    reportError("unable to create the MOS disassembler");
+
+  Simulator Sim(*DisAsm, *MII, isCMOS(CPU));
+  loadSegments(Sim, *Obj);
+  for (unsigned Addr : {unsigned(ClockAddr), unsigned(ExitAddr),
+                        unsigned(PutcharAddr), unsigned(GetcharAddr)}) {
+    if (Addr > 0xffff)
+      reportError("register address " + Twine(Addr) + " is out of range");
+    Sim.mapIO(Addr);
+  }
+  Sim.mapIO(ClockAddr + 3);
+
+  Expected<uint64_t> Entry = Obj->getStartAddress();
+  if (!Entry)
+    reportError(Entry.takeError());
+  Sim.PC = *Entry ? uint16_t(*Entry) : Sim.peek16(0xfffc);
+
+  const bool Profiling =
+      !ProfileFilename.empty() || !SampleProfileFilename.empty();
+  if (Profiling)
+    Sim.enableProfiling();
+
+  std::unique_ptr<ToolOutputFile> TraceOut;
+  if (!TraceFilename.empty()) {
+    std::error_code EC;
+    TraceOut = std::make_unique<ToolOutputFile>(TraceFilename, EC,
+                                                sys::fs::OF_TextWithCRLF);
+    if (EC)
+      reportError(TraceFilename + ": " + EC.message());
+    Sim.Trace = &TraceOut->os();
+  }
+
+  Sim.run();
+  if (TraceOut)
+    TraceOut->keep();
+  outs().flush();
+
+  if (!Sim.StopReason.empty())
+    WithColor::warning(errs(), ToolName)
+        << Sim.StopReason << " at $" << format_hex_no_prefix(Sim.PC, 4)
+        << "\n";
+  if (PrintCycles)
+    errs() << "cycles: " << Sim.Cycles
+           << "\ninstructions: " << Sim.Instructions << "\n";
+
+  if (Profiling) {
+    std::vector<Function> Functions = getFunctions(*Obj);
+    if (!ProfileFilename.empty())
+      writeProfile(Sim, Functions);
+    if (!SampleProfileFilename.empty())
+      writeSampleProfile(Sim, *Obj, Functions);
+  }
+  return Sim.ExitStatus;
+}
@@ -850,6 +850,11 @@ objcopy::parseObjcopyOptions(ArrayRef<const char *> ArgsArr,
                             .Case("binary", FileFormat::Binary)
                             .Case("ihex", FileFormat::IHex)
                             .Case("srec", FileFormat::SREC)
+                            .Case("ines", FileFormat::INES)
+                            .Case("pce", FileFormat::PCE)
+                            .Case("prg", FileFormat::PRG)
+                            .Case("crt", FileFormat::CRT)
+                            .Case("xex", FileFormat::XEX)
                             .Default(FileFormat::Unspecified);
   if (Config.OutputFormat == FileFormat::Unspecified) {
     if (OutputFormat.empty()) {
@@ -941,10 +946,13 @@ objcopy::parseObjcopyOptions(ArrayRef<const char *> ArgsArr,
     Config.ExtractPartition = Arg->getValue();
 
   if (const auto *A = InputArgs.getLastArg(OBJCOPY_gap_fill)) {
-    if (Config.OutputFormat != FileFormat::Binary)
+    if (Config.OutputFormat == FileFormat::Unspecified ||
+        Config.OutputFormat == FileFormat::ELF ||
+        Config.OutputFormat == FileFormat::IHex ||
+        Config.OutputFormat == FileFormat::SREC)
       return createStringError(
           errc::invalid_argument,
-          "'--gap-fill' is only supported for binary output");
+          "'--gap-fill' is only supported for binary and MOS image output");
     ErrorOr<uint64_t> Val = getAsInteger<uint64_t>(A->getValue());
     if (!Val)
       return createStringError(Val.getError(), "--gap-fill: bad number: %s",
@@ -108,6 +108,11 @@ static Error executeObjcopyOnRawBinary(ConfigManager &ConfigMgr,
   case FileFormat::IHex:
   case FileFormat::Unspecified:
   case FileFormat::SREC:
+  case FileFormat::INES:
+  case FileFormat::PCE:
+  case FileFormat::PRG:
+  case FileFormat::CRT:
+  case FileFormat::XEX:
     Expected<const ELFConfig &> ELFConfig = ConfigMgr.getELFConfig();
     if (!ELFConfig)
       return ELFConfig.takeError();
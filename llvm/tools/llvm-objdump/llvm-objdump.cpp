@@ -319,12 +319,14 @@ bool objdump::SectionContents;
 static std::vector<std::string> InputFilenames;
 bool objdump::PrintLines;
 static bool MachOOpt;
+static bool MOSCycles;
 std::string objdump::MCPU;
 std::vector<std::string> objdump::MAttrs;
 bool objdump::ShowRawInsn;
 bool objdump::LeadingAddr;
 static bool Offloading;
 static bool RawClangAST;
+static bool RecursiveDescent;
 bool objdump::Relocations;
 bool objdump::PrintImmHex;
 bool objdump::PrivateHeaders;
@@ -1455,6 +1457,139 @@ static uint64_t dumpARMELFData(uint64_t SectionAddr, uint64_t Index,
   return 1;
 }
 
+// 65816 code records the widths of its accumulator and index registers with
+// the mapping symbols $ml, $mh, $xl and $xh.
+typedef std::pair<uint64_t, StringRef> MOSWidthSymbol;
+
+// The disassembler only sees the mapping symbols heading the ranges it is
+// asked to disassemble, so ranges skipped by --disassemble-symbols or
+// --start-address, or those of other sections, would leave it with stale
+// register widths. Replays the widths in effect at Index instead.
+static void setMOSRegisterWidths(MCDisassembler &DisAsm,
+                                 ArrayRef<MOSWidthSymbol> WidthSymbols,
+                                 uint64_t SectionAddr, uint64_t Index,
+                                 ArrayRef<uint8_t> Bytes) {
+  // Code starts out with 8-bit registers.
+  StringRef M = "$mh", X = "$xh";
+  for (auto [Offset, Name] : WidthSymbols) {
+    if (Offset > Index)
+      break;
+    if (Name.starts_with("$m"))
+      M = Name;
+    else if (Name.starts_with("$x"))
+      X = Name;
+  }
+  for (StringRef Name : {M, X}) {
+    SymbolInfoTy Symbol(SectionAddr + Index, Name, ELF::STT_NOTYPE,
+                        /*IsMappingSymbol=*/true);
+    uint64_t Size;
+    Expected<bool> RespondedOrErr =
+        DisAsm.onSymbolStart(Symbol, Size, Bytes, SectionAddr + Index);
+    if (!RespondedOrErr)
+      consumeError(RespondedOrErr.takeError());
+  }
+}
+
+// A data object, for --mos-cycles to tell whether indexing into it can cross
+// a page.
+struct MOSDataObject {
+  uint64_t Addr;
+  uint64_t Size;
+  StringRef Name;
+  bool operator<(const MOSDataObject &Other) const {
+    return Addr < Other.Addr;
+  }
+};
+
+// The cycle counts of the basic block and function being disassembled, for
+// --mos-cycles. A block is untimed if any of its instructions has no known
+// cycle count.
+struct MOSCycleCounter {
+  uint64_t BlockBest = 0;
+  uint64_t BlockWorst = 0;
+  bool BlockTimed = true;
+  unsigned BlockInstrs = 0;
+  unsigned Blocks = 0;
+  unsigned TimedBlocks = 0;
+  uint64_t Best = 0;
+  uint64_t Worst = 0;
+
+  // Counts the instruction at Addr, and describes its timing in the comments.
+  void count(const MCInst *Inst, const MCInstrAnalysis &MIA,
+             const MCSubtargetInfo &STI, uint64_t Addr, uint64_t Size,
+             ArrayRef<MOSDataObject> Objects, raw_ostream &Comments) {
+    ++BlockInstrs;
+    std::optional<MCInstrAnalysis::InstrTiming> Timing;
+    if (Inst)
+      Timing = MIA.getTiming(*Inst, STI, Addr, Size);
+    if (!Timing) {
+      BlockTimed = false;
+      return;
+    }
+
+    unsigned Best = std::min(Timing->Cycles, Timing->NotTakenCycles);
+    unsigned Worst = std::max(Timing->Cycles, Timing->NotTakenCycles);
+    Comments << "cycles: ";
+    if (Timing->NotTakenCycles != Timing->Cycles)
+      Comments << Timing->NotTakenCycles << '/' << Timing->Cycles;
+    else
+      Comments << Timing->Cycles;
+
+    if (Timing->IndexPagePenalty) {
+      // An index of up to 255 can carry into the next page, unless the base
+      // is a known object that ends on its own page.
+      bool MayCross = true;
+      const MOSDataObject *Object = nullptr;
+      if (Timing->IndexBase) {
+        uint64_t Base = *Timing->IndexBase;
+        auto It = llvm::upper_bound(Objects, MOSDataObject{Base, 0, ""});
+        if (It != Objects.begin() && Base < std::prev(It)->Addr +
+                                                std::prev(It)->Size) {
+          Object = &*std::prev(It);
+          MayCross = (Base >> 8) != ((Object->Addr + Object->Size - 1) >> 8);
+        }
+      }
+      if (MayCross) {
+        Comments << "+1";
+        ++Worst;
+      }
+      if (Object && MayCross)
+        Comments << ", indexing " << Object->Name << " can cross a page";
+    }
+    Comments << '\n';
+    BlockBest += Best;
+    BlockWorst += Worst;
+  }
+
+  void endBlock(formatted_raw_ostream &OS, const MCAsmInfo &MAI) {
+    if (!BlockInstrs)
+      return;
+    ++Blocks;
+    OS << MAI.getCommentString() << " block cycles: ";
+    if (BlockTimed) {
+      OS << BlockBest << '-' << BlockWorst << '\n';
+      ++TimedBlocks;
+      Best += BlockBest;
+      Worst += BlockWorst;
+    } else {
+      OS << "unknown\n";
+    }
+    BlockBest = BlockWorst = 0;
+    BlockTimed = true;
+    BlockInstrs = 0;
+  }
+
+  void endFunction(formatted_raw_ostream &OS, const MCAsmInfo &MAI,
+                   StringRef Name) {
+    endBlock(OS, MAI);
+    if (!Blocks)
+      return;
+    OS << MAI.getCommentString() << ' ' << Name << ": " << Best << '-'
+       << Worst << " cycles running each of " << TimedBlocks << " timed of "
+       << Blocks << " blocks once\n";
+  }
+};
+
 static void dumpELFData(uint64_t SectionAddr, uint64_t Index, uint64_t End,
                         ArrayRef<uint8_t> Bytes, raw_ostream &OS) {
   // print out data up to 8 bytes at a time in hex and ascii
@@ -1623,6 +1758,42 @@ collectLocalBranchTargets(ArrayRef<uint8_t> Bytes, MCInstrAnalysis *MIA,
     Labels[Target] = ("L" + Twine(Idx)).str();
 }
 
+// Collects the section offsets of the instructions reachable from Start by
+// following fall-through and known branch targets within [Start, End).
+static void
+collectReachableInstructions(ArrayRef<uint8_t> Bytes, MCInstrAnalysis *MIA,
+                             MCDisassembler *DisAsm, uint64_t SectionAddr,
+                             uint64_t Start, uint64_t End,
+                             std::set<uint64_t> &Reachable) {
+  Reachable.clear();
+  SmallVector<uint64_t> Worklist = {Start};
+  while (!Worklist.empty()) {
+    uint64_t Index = Worklist.pop_back_val();
+    while (Index < End && Reachable.insert(Index).second) {
+      MCInst Inst;
+      uint64_t Size;
+      if (!DisAsm->getInstruction(Inst, Size, Bytes.slice(Index),
+                                  SectionAddr + Index, nulls()) ||
+          Index + Size > End) {
+        // Leave undecodable bytes to be dumped as data.
+        Reachable.erase(Index);
+        break;
+      }
+      if (!MIA)
+        break;
+
+      uint64_t Target;
+      if (MIA->evaluateBranch(Inst, SectionAddr + Index, Size, Target) &&
+          Target >= SectionAddr + Start && Target < SectionAddr + End)
+        Worklist.push_back(Target - SectionAddr);
+      if (MIA->isReturn(Inst) || MIA->isUnconditionalBranch(Inst) ||
+          MIA->isIndirectBranch(Inst))
+        break;
+      Index += Size;
+    }
+  }
+}
+
 // Create an MCSymbolizer for the target and add it to the MCDisassembler.
 // This is currently only used on AMDGPU, and assumes the format of the
 // void * argument passed to AMDGPU's createMCSymbolizer.
@@ -1764,6 +1935,8 @@ disassembleObject(ObjectFile &Obj, const ObjectFile &DbgObj,
   // pretty print the symbols while disassembling.
   std::map<SectionRef, SectionSymbolsTy> AllSymbols;
   std::map<SectionRef, SmallVector<MappingSymbolPair, 0>> AllMappingSymbols;
+  std::map<SectionRef, SmallVector<MOSWidthSymbol, 0>> AllMOSWidthSymbols;
+  std::vector<MOSDataObject> MOSDataObjects;
   SectionSymbolsTy AbsoluteSymbols;
   const StringRef FileName = Obj.getFileName();
   const MachOObjectFile *MachO = dyn_cast<const MachOObjectFile>(&Obj);
@@ -1796,6 +1969,9 @@ disassembleObject(ObjectFile &Obj, const ObjectFile &DbgObj,
               strchr("admtx", Name[0])) {
             AllMappingSymbols[*SecI].emplace_back(Address - SectionAddr,
                                                   Name[0]);
+            if (isMOSElf(Obj))
+              AllMOSWidthSymbols[*SecI].emplace_back(Address - SectionAddr,
+                                                     *NameOrErr);
             AllSymbols[*SecI].push_back(
                 createSymbolInfo(Obj, Symbol, /*MappingSymbol=*/true));
           }
@@ -1804,6 +1980,15 @@ disassembleObject(ObjectFile &Obj, const ObjectFile &DbgObj,
       continue;
     }
 
+    // Addresses within relocatable objects are section offsets, so the targets
+    // of indexed accesses are only known in linked files.
+    if (MOSCycles && isMOSElf(Obj) && !Obj.isRelocatableObject() &&
+        getElfSymbolType(Obj, Symbol) == ELF::STT_OBJECT) {
+      if (uint64_t Size = ELFSymbolRef(Symbol).getSize())
+        MOSDataObjects.push_back(
+            {cantFail(Symbol.getAddress()), Size, *NameOrErr});
+    }
+
     if (MachO) {
       // __mh_(execute|dylib|dylinker|bundle|preload|object)_header are special
       // symbols that support MachO header introspection. They do not bind to
@@ -1827,6 +2012,7 @@ disassembleObject(ObjectFile &Obj, const ObjectFile &DbgObj,
     else
       AbsoluteSymbols.push_back(createSymbolInfo(Obj, Symbol));
   }
+  llvm::sort(MOSDataObjects);
 
   if (AllSymbols.empty() && Obj.isELF())
     addDynamicElfSymbols(cast<ELFObjectFileBase>(Obj), AllSymbols);
@@ -1978,6 +2164,8 @@ disassembleObject(ObjectFile &Obj, const ObjectFile &DbgObj,
     SectionSymbolsTy &Symbols = AllSymbols[Section];
     auto &MappingSymbols = AllMappingSymbols[Section];
     llvm::sort(MappingSymbols);
+    auto &MOSWidthSymbols = AllMOSWidthSymbols[Section];
+    llvm::sort(MOSWidthSymbols);
 
     ArrayRef<uint8_t> Bytes = arrayRefFromStringRef(
         unwrapOrError(Section.getContents(), Obj.getFileName()));
@@ -2247,6 +2435,10 @@ disassembleObject(ObjectFile &Obj, const ObjectFile &DbgObj,
       if (SectionAddr < StartAddress)
         Index = std::max<uint64_t>(Index, StartAddress - SectionAddr);
 
+      if (isMOSElf(Obj))
+        setMOSRegisterWidths(*DT->DisAsm, MOSWidthSymbols, SectionAddr, Index,
+                             Bytes.slice(Index, End - Index));
+
       if (DisassembleAsELFData) {
         dumpELFData(SectionAddr, Index, End, Bytes, FOS);
         Index = End;
@@ -2277,12 +2469,39 @@ disassembleObject(ObjectFile &Obj, const ObjectFile &DbgObj,
                                BBAddrMapLabels);
       }
 
+      std::set<uint64_t> Reachable;
+      if (RecursiveDescent)
+        collectReachableInstructions(Bytes, DT->InstrAnalysis.get(),
+                                     DT->DisAsm.get(), SectionAddr, Index, End,
+                                     Reachable);
+
+      // --mos-cycles totals the basic blocks, which begin at branch targets and
+      // end after branches.
+      const bool CountCycles = MOSCycles && isMOSElf(Obj) && DT->InstrAnalysis;
+      std::unordered_map<uint64_t, std::string> BlockLeaders;
+      MOSCycleCounter CycleCounter;
+      if (CountCycles)
+        collectLocalBranchTargets(Bytes, DT->InstrAnalysis.get(),
+                                  DT->DisAsm.get(), DT->InstPrinter.get(),
+                                  DT->SubtargetInfo.get(), SectionAddr, Index,
+                                  End, BlockLeaders);
+
       if (DT->InstrAnalysis)
         DT->InstrAnalysis->resetState();
 
       while (Index < End) {
         uint64_t RelOffset;
 
+        // Bytes that no control flow reaches are dumped as data, up to the
+        // next reachable instruction.
+        if (RecursiveDescent && !Reachable.count(Index)) {
+          auto Next = Reachable.upper_bound(Index);
+          uint64_t DataEnd = Next == Reachable.end() ? End : *Next;
+          dumpELFData(SectionAddr, Index, DataEnd, Bytes, FOS);
+          Index = DataEnd;
+          continue;
+        }
+
         // ARM and AArch64 ELF binaries can interleave data and text in the
         // same section. We rely on the markers introduced to understand what
         // we need to dump. If the data marker is within a function, it is
@@ -2355,6 +2574,7 @@ disassembleObject(ObjectFile &Obj, const ObjectFile &DbgObj,
           }
         }
 
+        bool EndsBlock = false;
         if (DumpARMELFData) {
           Size = dumpARMELFData(SectionAddr, Index, End, Obj, Bytes,
                                 MappingSymbols, *DT->SubtargetInfo, FOS);
@@ -2584,6 +2804,16 @@ disassembleObject(ObjectFile &Obj, const ObjectFile &DbgObj,
           } else if (!Disassembled && DT->InstrAnalysis) {
             DT->InstrAnalysis->resetState();
           }
+
+          if (CountCycles) {
+            CycleCounter.count(Disassembled ? &Inst : nullptr,
+                               *DT->InstrAnalysis, *DT->SubtargetInfo,
+                               SectionAddr + Index, Size, MOSDataObjects,
+                               CommentStream);
+            EndsBlock = !Disassembled || DT->InstrAnalysis->isBranch(Inst) ||
+                        DT->InstrAnalysis->isReturn(Inst) ||
+                        DT->InstrAnalysis->isTerminator(Inst);
+          }
         }
 
         assert(DT->Context->getAsmInfo());
@@ -2609,8 +2839,15 @@ disassembleObject(ObjectFile &Obj, const ObjectFile &DbgObj,
             SectionAddr + Index + VMAAdjustment + Size, Section.getIndex()};
         LEP.printEndLine(FOS, NextAddr);
 
+        if (CountCycles &&
+            (EndsBlock || BlockLeaders.count(SectionAddr + Index + Size)))
+          CycleCounter.endBlock(FOS, *DT->Context->getAsmInfo());
+
         Index += Size;
       }
+      if (CountCycles)
+        CycleCounter.endFunction(FOS, *DT->Context->getAsmInfo(),
+                                 SymNamesHere.front());
     }
   }
   StringSet<> MissingDisasmSymbolSet =
@@ -3619,10 +3856,12 @@ static void parseObjdumpOptions(const llvm::opt::InputArgList &InputArgs) {
   InputFilenames = InputArgs.getAllArgValues(OBJDUMP_INPUT);
   MachOOpt = InputArgs.hasArg(OBJDUMP_macho);
   MCPU = InputArgs.getLastArgValue(OBJDUMP_mcpu_EQ).str();
+  MOSCycles = InputArgs.hasArg(OBJDUMP_mos_cycles);
   MAttrs = commaSeparatedValues(InputArgs, OBJDUMP_mattr_EQ);
   ShowRawInsn = !InputArgs.hasArg(OBJDUMP_no_show_raw_insn);
   LeadingAddr = !InputArgs.hasArg(OBJDUMP_no_leading_addr);
   RawClangAST = InputArgs.hasArg(OBJDUMP_raw_clang_ast);
+  RecursiveDescent = InputArgs.hasArg(OBJDUMP_recursive_descent);
   Relocations = InputArgs.hasArg(OBJDUMP_reloc);
   PrintImmHex =
       InputArgs.hasFlag(OBJDUMP_print_imm_hex, OBJDUMP_no_print_imm_hex, true);
@@ -10,6 +10,7 @@
 #include "Options.h"
 #include "ProfileGenerator.h"
 #include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringExtras.h"
 #include "llvm/DebugInfo/Symbolize/SymbolizableModule.h"
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/LineIterator.h"
@@ -354,6 +355,11 @@ PerfReaderBase::create(ProfiledBinary *Binary, PerfInputFile &PerfInput,
     return PerfReader;
   }
 
+  if (PerfInput.Format == PerfFormat::InstructionTrace) {
+    PerfReader.reset(new InstructionTraceReader(Binary, PerfInput.InputFile));
+    return PerfReader;
+  }
+
   // For perf data input, we need to convert them into perf script first.
   // If this is a kernel perf file, there is no need for retrieving PIDs.
   if (PerfInput.Format == PerfFormat::PerfData)
@@ -1360,6 +1366,83 @@ void PerfScriptReader::parsePerfTraces() {
     writeUnsymbolizedProfile(OutputFilename);
 }
 
+bool InstructionTraceReader::extractAddress(StringRef Line,
+                                            uint64_t &Address) {
+  Line = Line.ltrim();
+  // VICE prefixes the address with its memory space, e.g. `.C:`.
+  if (Line.size() > 3 && Line[0] == '.' && Line[2] == ':')
+    Line = Line.drop_front(3);
+  Line.consume_front("$");
+
+  auto TakeHex = [&]() {
+    StringRef Hex = Line.take_while(isHexDigit);
+    Line = Line.drop_front(Hex.size());
+    return Hex;
+  };
+  StringRef Hex = TakeHex();
+  // Skip a bank number, e.g. `00:8000`.
+  if (Hex.size() == 2 && Line.consume_front(":"))
+    Hex = TakeHex();
+  if (Hex.size() < 4 || Hex.size() > 6)
+    return false;
+  if (!Line.empty() && Line[0] != ':' && !isSpace(Line[0]))
+    return false;
+  return !Hex.getAsInteger(16, Address);
+}
+
+void InstructionTraceReader::parsePerfTraces() {
+  // There is no context for an instruction trace, so initialize one entry
+  // with fake "empty" context key.
+  std::shared_ptr<StringBasedCtxKey> Key =
+      std::make_shared<StringBasedCtxKey>();
+  SampleCounter &Counter =
+      SampleCounters.emplace(Hashable<ContextKey>(Key), SampleCounter())
+          .first->second;
+
+  std::optional<uint64_t> Begin;
+  uint64_t Prev = 0;
+  uint64_t NumExternal = 0;
+  auto RecordRange = [&]() {
+    if (Begin && Binary->addressIsCode(*Begin) &&
+        Binary->addressIsCode(Prev) &&
+        isValidFallThroughRange(*Begin, Prev, Binary))
+      Counter.recordRangeCount(*Begin, Prev, 1);
+  };
+
+  TraceStream TraceIt(PerfTraceFile);
+  for (; !TraceIt.isAtEoF(); TraceIt.advance()) {
+    uint64_t Address;
+    if (!extractAddress(TraceIt.getCurrentLine(), Address))
+      continue;
+    ++NumTotalSample;
+    if (!Binary->addressIsCode(Address))
+      ++NumExternal;
+    if (Begin) {
+      uint64_t Size = Binary->getInstSize(Prev);
+      if (Size && Address == Prev + Size) {
+        Prev = Address;
+        continue;
+      }
+      RecordRange();
+      // As for LBR, branches from external code are kept for the head
+      // samples of the functions they call.
+      if (Binary->addressIsCode(Address))
+        Counter.recordBranchCount(Prev, Address, 1);
+    }
+    Begin = Address;
+    Prev = Address;
+  }
+  RecordRange();
+
+  if (!NumTotalSample)
+    exitWithError("no instruction addresses found", PerfTraceFile);
+  emitWarningSummary(NumExternal, NumTotalSample,
+                     "of traced instructions are outside the binary.");
+
+  if (SkipSymbolization)
+    writeUnsymbolizedProfile(OutputFilename);
+}
+
 SmallVector<CleanupInstaller, 2> PerfScriptReader::TempFileCleanups;
 
 } // end namespace sampleprof
@@ -63,6 +63,7 @@ enum PerfFormat {
   PerfData = 1,            // Raw linux perf.data.
   PerfScript = 2,          // Perf script create by `perf script` command.
   UnsymbolizedProfile = 3, // Unsymbolized profile generated by llvm-profgen.
+  InstructionTrace = 4,    // Trace of every executed instruction address.
 
 };
 
@@ -716,6 +717,29 @@ private:
   void unwindSamples();
 };
 
+/*
+  The reader of instruction traces, which give the address of every executed
+  instruction, one per line. These are written by emulators of machines
+  without branch sampling hardware, like Mesen, VICE and MAME for MOS
+  targets, and by llvm-mos-sim with --trace. For example:
+    .C:080d  A9 00       LDA #$00       - A:00 X:00 Y:00 SP:f6 ..-...Z.
+    8000: lda #$00
+  A line is an executed instruction if it starts with an address of four to
+  six hex digits, followed by space or a colon. The address may be preceded by
+  `$`, a VICE memory space (`.C:`) or a bank (`00:`). Other lines are ignored.
+  The trace is split into runs of fall through and the branches between them,
+  which are exact rather than sampled.
+*/
+class InstructionTraceReader : public PerfScriptReader {
+public:
+  InstructionTraceReader(ProfiledBinary *Binary, StringRef Trace)
+      : PerfScriptReader(Binary, Trace, std::nullopt) {};
+  void parsePerfTraces() override;
+
+  // Extract the instruction address from one trace line.
+  static bool extractAddress(StringRef Line, uint64_t &Address);
+};
+
 /*
    Format of unsymbolized profile:
 
@@ -53,6 +53,14 @@ static cl::opt<std::string> UnsymbolizedProfFilename(
 static cl::alias UPA("up", cl::desc("Alias for --unsymbolized-profile"),
                      cl::aliasopt(UnsymbolizedProfFilename));
 
+static cl::opt<std::string> InstructionTraceFilename(
+    "instruction-trace", cl::value_desc("instruction trace"),
+    cl::desc("Path of a trace of every executed instruction address, as "
+             "written by emulators and llvm-mos-sim"),
+    cl::cat(ProfGenCategory));
+static cl::alias ITA("it", cl::desc("Alias for --instruction-trace"),
+                     cl::aliasopt(InstructionTraceFilename));
+
 static cl::opt<std::string> SampleProfFilename(
     "llvm-sample-profile", cl::value_desc("llvm sample profile"),
     cl::desc("Path of the LLVM sample profile"), cl::cat(ProfGenCategory));
@@ -88,16 +96,19 @@ static void validateCommandLine() {
     bool HasPerfScript = PerfScriptFilename.getNumOccurrences() > 0;
     bool HasUnsymbolizedProfile =
         UnsymbolizedProfFilename.getNumOccurrences() > 0;
+    bool HasInstructionTrace =
+        InstructionTraceFilename.getNumOccurrences() > 0;
     bool HasSampleProfile = SampleProfFilename.getNumOccurrences() > 0;
-    uint16_t S =
-        HasPerfData + HasPerfScript + HasUnsymbolizedProfile + HasSampleProfile;
+    uint16_t S = HasPerfData + HasPerfScript + HasUnsymbolizedProfile +
+                 HasInstructionTrace + HasSampleProfile;
     if (S != 1) {
       std::string Msg =
           S > 1
-              ? "`--perfscript`, `--perfdata` and `--unsymbolized-profile` "
-                "cannot be used together."
+              ? "`--perfscript`, `--perfdata`, `--unsymbolized-profile` and "
+                "`--instruction-trace` cannot be used together."
               : "Perf input file is missing, please use one of `--perfscript`, "
-                "`--perfdata` and `--unsymbolized-profile` for the input.";
+                "`--perfdata`, `--unsymbolized-profile` and "
+                "`--instruction-trace` for the input.";
       exitWithError(Msg);
     }
 
@@ -111,6 +122,7 @@ static void validateCommandLine() {
     CheckFileExists(HasPerfData, PerfDataFilename);
     CheckFileExists(HasPerfScript, PerfScriptFilename);
     CheckFileExists(HasUnsymbolizedProfile, UnsymbolizedProfFilename);
+    CheckFileExists(HasInstructionTrace, InstructionTraceFilename);
     CheckFileExists(HasSampleProfile, SampleProfFilename);
   }
 
@@ -139,6 +151,9 @@ static PerfInputFile getPerfInputFile() {
   } else if (UnsymbolizedProfFilename.getNumOccurrences()) {
     File.InputFile = UnsymbolizedProfFilename;
     File.Format = PerfFormat::UnsymbolizedProfile;
+  } else if (InstructionTraceFilename.getNumOccurrences()) {
+    File.InputFile = InstructionTraceFilename;
+    File.Format = PerfFormat::InstructionTrace;
   }
   return File;
 }
@@ -38,6 +38,7 @@
 #include "llvm/Object/ELFObjectFile.h"
 #include "llvm/Object/ELFTypes.h"
 #include "llvm/Object/Error.h"
+#include "llvm/Object/MOSStats.h"
 #include "llvm/Object/ObjectFile.h"
 #include "llvm/Object/RelocationResolver.h"
 #include "llvm/Object/SFrameParser.h"
@@ -227,6 +228,7 @@ public:
   void printArchSpecificInfo() override;
   void printStackMap() const override;
   void printMemtag() override;
+  void printMOSStats() override;
   void printSectionsAsSFrame(ArrayRef<std::string> Sections) override;
 
   ArrayRef<uint8_t> getMemtagGlobalsSectionContents(uint64_t ExpectedAddr);
@@ -6428,6 +6430,33 @@ ELFDumper<ELFT>::getMemtagGlobalsSectionContents(uint64_t ExpectedAddr) {
   return ArrayRef<uint8_t>();
 }
 
+template <typename ELFT> void ELFDumper<ELFT>::printMOSStats() {
+  if (Obj.getHeader().e_machine != EM_MOS)
+    return;
+  Expected<MOSStats> StatsOrErr = getMOSStats(ObjF);
+  if (!StatsOrErr) {
+    reportUniqueWarning(StatsOrErr.takeError());
+    return;
+  }
+
+  DictScope D(W, "MOSStats");
+  W.printNumber("ZeroPage", StatsOrErr->ZeroPage);
+  W.printNumber("RAM", StatsOrErr->RAM);
+  W.printNumber("ROM", StatsOrErr->ROM);
+  ListScope L(W, "Functions");
+  for (const MOSFunctionStats &F : StatsOrErr->Functions) {
+    DictScope FD(W, "Function");
+    W.printString("Name", F.Name);
+    W.printNumber("Size", F.Size);
+    W.printNumber("StaticFrameSize", F.StaticFrameSize);
+    if (!F.TimedBlocks)
+      continue;
+    W.printNumber("TimedBlocks", F.TimedBlocks);
+    W.printNumber("BestCycles", F.BestCycles);
+    W.printNumber("WorstCycles", F.WorstCycles);
+  }
+}
+
 // Reserve the lower three bits of the first byte of the step distance when
 // encoding the memtag descriptors. Found to be the best overall size tradeoff
 // when compiling Android T with full MTE globals enabled.
@@ -133,6 +133,7 @@ static bool HashSymbols;
 static bool HashTable;
 static bool HashHistogram;
 static bool Memtag;
+static bool PrintMOSStats;
 static bool NeededLibraries;
 static bool Notes;
 static bool Offloading;
@@ -273,6 +274,7 @@ static void parseOptions(const opt::InputArgList &Args) {
   opts::HashTable = Args.hasArg(OPT_hash_table);
   opts::HashHistogram = Args.hasArg(OPT_histogram);
   opts::Memtag = Args.hasArg(OPT_memtag);
+  opts::PrintMOSStats = Args.hasArg(OPT_mos_stats);
   opts::NeededLibraries = Args.hasArg(OPT_needed_libs);
   opts::Notes = Args.hasArg(OPT_notes);
   opts::Offloading = Args.hasArg(OPT_offloading);
@@ -486,6 +488,8 @@ static void dumpObject(ObjectFile &Obj, ScopedPrinter &Writer,
       Dumper->printNotes();
     if (opts::Memtag)
       Dumper->printMemtag();
+    if (opts::PrintMOSStats)
+      Dumper->printMOSStats();
     if (!opts::SFrame.empty())
       Dumper->printSectionsAsSFrame(opts::SFrame);
   }
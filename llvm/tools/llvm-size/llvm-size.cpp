@@ -13,8 +13,11 @@
 //===----------------------------------------------------------------------===//
 
 #include "llvm/ADT/APInt.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/StringMap.h"
 #include "llvm/Object/Archive.h"
 #include "llvm/Object/ELFObjectFile.h"
+#include "llvm/Object/MOSStats.h"
 #include "llvm/Object/MachO.h"
 #include "llvm/Object/MachOUniversal.h"
 #include "llvm/Object/ObjectFile.h"
@@ -30,6 +33,8 @@
 #include "llvm/Support/WithColor.h"
 #include "llvm/Support/raw_ostream.h"
 #include <algorithm>
+#include <cstring>
+#include <optional>
 #include <string>
 #include <system_error>
 
@@ -80,6 +85,8 @@ static RadixTy Radix = RadixTy::decimal;
 static bool TotalSizes;
 static bool HasMachOFiles = false;
 static bool ExcludePageZero = false;
+static bool MOSFormat = false;
+static std::string MOSBaseline;
 
 static std::vector<std::string> InputFilenames;
 
@@ -87,6 +94,7 @@ static std::string ToolName;
 
 // States
 static bool HadError = false;
+static bool HadRegression = false;
 static bool BerkeleyHeaderPrinted = false;
 static bool MoreThanOneFile = false;
 static uint64_t TotalObjectText = 0;
@@ -863,6 +871,119 @@ static void printFileSectionSizes(StringRef file) {
   }
 }
 
+static void printMOSStats(const MOSStats &Stats) {
+  outs() << "region     bytes\n"
+         << format("zero page %6" PRIu64 "\n", Stats.ZeroPage)
+         << format("ram       %6" PRIu64 "\n", Stats.RAM)
+         << format("rom       %6" PRIu64 "\n", Stats.ROM);
+  if (Stats.Functions.empty())
+    return;
+
+  size_t Width = strlen("function");
+  for (const MOSFunctionStats &F : Stats.Functions)
+    Width = std::max(Width, F.Name.size());
+  outs() << '\n'
+         << left_justify("function", Width) << "   size  frame  cycles\n";
+  for (const MOSFunctionStats &F : Stats.Functions) {
+    outs() << left_justify(F.Name, Width)
+           << format(" %6" PRIu64 " %6" PRIu64, F.Size, F.StaticFrameSize);
+    if (F.TimedBlocks)
+      outs() << format("  %" PRIu64 "-%" PRIu64, F.BestCycles, F.WorstCycles);
+    outs() << '\n';
+  }
+}
+
+// Prints the changes from Old to New, and notes whether anything grew.
+static void printMOSStatsDiff(const MOSStats &Old, const MOSStats &New) {
+  auto Change = [](StringRef What, uint64_t From, uint64_t To) {
+    if (To > From)
+      HadRegression = true;
+    return (What + " " + Twine(From) + " -> " + Twine(To) + " (" +
+            (To > From ? "+" : "-") + Twine(To > From ? To - From : From - To) +
+            ")")
+        .str();
+  };
+  if (Old.ZeroPage != New.ZeroPage)
+    outs() << Change("zero page", Old.ZeroPage, New.ZeroPage) << '\n';
+  if (Old.RAM != New.RAM)
+    outs() << Change("ram", Old.RAM, New.RAM) << '\n';
+  if (Old.ROM != New.ROM)
+    outs() << Change("rom", Old.ROM, New.ROM) << '\n';
+
+  StringMap<const MOSFunctionStats *> OldFunctions;
+  for (const MOSFunctionStats &F : Old.Functions)
+    OldFunctions.try_emplace(F.Name, &F);
+  for (const MOSFunctionStats &F : New.Functions) {
+    const MOSFunctionStats *O = OldFunctions.lookup(F.Name);
+    if (!O) {
+      outs() << F.Name << ": added\n";
+      continue;
+    }
+    OldFunctions.erase(F.Name);
+    SmallVector<std::string> Changes;
+    if (O->Size != F.Size)
+      Changes.push_back(Change("size", O->Size, F.Size));
+    if (O->StaticFrameSize != F.StaticFrameSize)
+      Changes.push_back(
+          Change("frame", O->StaticFrameSize, F.StaticFrameSize));
+    // Worst case counts are compared, since they bound the cost.
+    if (O->TimedBlocks && F.TimedBlocks && O->WorstCycles != F.WorstCycles)
+      Changes.push_back(Change("cycles", O->WorstCycles, F.WorstCycles));
+    if (!Changes.empty())
+      outs() << F.Name << ": " << join(Changes, ", ") << '\n';
+  }
+  for (const MOSFunctionStats &F : Old.Functions)
+    if (OldFunctions.contains(F.Name))
+      outs() << F.Name << ": removed\n";
+}
+
+static void printObjectMOSStats(ObjectFile *Obj, StringRef Name,
+                                const MOSStats *Baseline) {
+  Expected<MOSStats> StatsOrErr = getMOSStats(*Obj);
+  if (!StatsOrErr) {
+    error(StatsOrErr.takeError(), Name);
+    return;
+  }
+  if (MoreThanOneFile || Baseline)
+    outs() << Name << ":\n";
+  if (Baseline)
+    printMOSStatsDiff(*Baseline, *StatsOrErr);
+  else
+    printMOSStats(*StatsOrErr);
+}
+
+/// Print the MOS footprint of @p File, or how it differs from @p Baseline.
+static void printFileMOSStats(StringRef File, const MOSStats *Baseline) {
+  Expected<OwningBinary<Binary>> BinaryOrErr = createBinary(File);
+  if (!BinaryOrErr) {
+    error(BinaryOrErr.takeError(), File);
+    return;
+  }
+  Binary &Bin = *BinaryOrErr.get().getBinary();
+
+  if (Archive *A = dyn_cast<Archive>(&Bin)) {
+    Error Err = Error::success();
+    for (auto &C : A->children(Err)) {
+      Expected<std::unique_ptr<Binary>> ChildOrErr = C.getAsBinary();
+      if (!ChildOrErr) {
+        if (auto E = isNotObjectErrorInvalidFileType(ChildOrErr.takeError()))
+          error(std::move(E), A->getFileName(), C);
+        continue;
+      }
+      if (ObjectFile *O = dyn_cast<ObjectFile>(&*ChildOrErr.get()))
+        printObjectMOSStats(
+            O, (A->getFileName() + "(" + O->getFileName() + ")").str(),
+            Baseline);
+    }
+    if (Err)
+      error(std::move(Err), A->getFileName());
+  } else if (ObjectFile *O = dyn_cast<ObjectFile>(&Bin)) {
+    printObjectMOSStats(O, File, Baseline);
+  } else {
+    error("unsupported file type", File);
+  }
+}
+
 static void printBerkeleyTotals() {
   std::string fmtbuf;
   raw_string_ostream fmt(fmtbuf);
@@ -917,6 +1038,10 @@ int llvm_size_main(int argc, char **argv, const llvm::ToolContext &) {
   DarwinLongFormat = Args.hasArg(OPT_l);
   ExcludePageZero = Args.hasArg(OPT_exclude_pagezero);
   TotalSizes = Args.hasArg(OPT_totals);
+  MOSFormat = Args.hasArg(OPT_mos);
+  MOSBaseline = Args.getLastArgValue(OPT_diff_EQ).str();
+  if (!MOSBaseline.empty() && !MOSFormat)
+    error("--diff requires --mos");
   StringRef V = Args.getLastArgValue(OPT_format_EQ, "berkeley");
   if (V == "berkeley")
     OutputFormat = berkeley;
@@ -957,6 +1082,26 @@ int llvm_size_main(int argc, char **argv, const llvm::ToolContext &) {
     InputFilenames.push_back("a.out");
 
   MoreThanOneFile = InputFilenames.size() > 1;
+  if (MOSFormat) {
+    std::optional<MOSStats> Baseline;
+    if (!MOSBaseline.empty()) {
+      Expected<OwningBinary<ObjectFile>> BaseOrErr =
+          ObjectFile::createObjectFile(MOSBaseline);
+      if (!BaseOrErr) {
+        error(BaseOrErr.takeError(), MOSBaseline);
+        return 1;
+      }
+      Expected<MOSStats> StatsOrErr = getMOSStats(*BaseOrErr->getBinary());
+      if (!StatsOrErr) {
+        error(StatsOrErr.takeError(), MOSBaseline);
+        return 1;
+      }
+      Baseline = std::move(*StatsOrErr);
+    }
+    for (StringRef File : InputFilenames)
+      printFileMOSStats(File, Baseline ? &*Baseline : nullptr);
+    return HadError || HadRegression;
+  }
   llvm::for_each(InputFilenames, printFileSectionSizes);
   if (OutputFormat == berkeley && TotalSizes)
     printBerkeleyTotals();
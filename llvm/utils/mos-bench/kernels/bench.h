@@ -0,0 +1,49 @@
+//===-- bench.h - Shared support for the MOS benchmark kernels ------------===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Each kernel is a freestanding program whose main returns zero if its result
+// matches the expected checksum. The kernels use only fixed-width types, so
+// they compute the same result on a host, where they print the checksum to
+// help update the expected values.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef MOS_BENCH_BENCH_H
+#define MOS_BENCH_BENCH_H
+
+#include <stdint.h>
+
+// A value the compiler can't see through, so the kernels can't be folded
+// away at compile time.
+static volatile uint8_t bench_seed = 1;
+
+static uint16_t bench_state;
+
+static inline void bench_srand(void) { bench_state = 0xace1u ^ bench_seed; }
+
+// A 16-bit Galois LFSR.
+static inline uint8_t bench_rand(void) {
+  uint8_t Lsb = bench_state & 1;
+  bench_state >>= 1;
+  if (Lsb)
+    bench_state ^= 0xb400u;
+  return (uint8_t)bench_state;
+}
+
+#ifdef __mos__
+#define BENCH_CHECK(Value, Expected) return (Value) == (Expected) ? 0 : 1
+#else
+#include <stdio.h>
+#define BENCH_CHECK(Value, Expected)                                           \
+  do {                                                                         \
+    printf("0x%lx\n", (unsigned long)(Value));                                 \
+    return (Value) == (Expected) ? 0 : 1;                                      \
+  } while (0)
+#endif
+
+#endif // not MOS_BENCH_BENCH_H
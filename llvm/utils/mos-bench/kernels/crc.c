@@ -0,0 +1,48 @@
+//===-- crc.c - Bitwise CRC-16 and table-driven CRC-32 --------------------===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "bench.h"
+
+static uint8_t Data[1024];
+static uint32_t Table[256];
+
+// CRC-16/CCITT-FALSE, a bit at a time.
+static uint16_t crc16(const uint8_t *P, uint16_t Len) {
+  uint16_t CRC = 0xffff;
+  while (Len--) {
+    CRC ^= (uint16_t)*P++ << 8;
+    for (uint8_t I = 0; I < 8; ++I)
+      CRC = CRC & 0x8000 ? (uint16_t)(CRC << 1) ^ 0x1021 : (uint16_t)(CRC << 1);
+  }
+  return CRC;
+}
+
+// The reflected CRC-32 of zlib, a byte at a time.
+static uint32_t crc32(const uint8_t *P, uint16_t Len) {
+  uint32_t CRC = 0xffffffff;
+  while (Len--)
+    CRC = Table[(uint8_t)CRC ^ *P++] ^ CRC >> 8;
+  return ~CRC;
+}
+
+int main(void) {
+  bench_srand();
+  for (uint16_t I = 0; I < sizeof(Data); ++I)
+    Data[I] = bench_rand();
+
+  for (uint16_t I = 0; I < 256; ++I) {
+    uint32_t C = I;
+    for (uint8_t J = 0; J < 8; ++J)
+      C = C & 1 ? 0xedb88320 ^ C >> 1 : C >> 1;
+    Table[I] = C;
+  }
+
+  uint16_t C16 = crc16(Data, sizeof(Data));
+  uint32_t C32 = crc32(Data, sizeof(Data));
+  BENCH_CHECK((uint16_t)(C16 ^ (uint16_t)C32 ^ (uint16_t)(C32 >> 16)), 0xb470);
+}
@@ -0,0 +1,36 @@
+//===-- fixmath.c - 8.8 fixed point Mandelbrot set ------------------------===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "bench.h"
+
+typedef int16_t fix;
+
+static fix fmul(fix A, fix B) { return (fix)(((int32_t)A * B) >> 8); }
+
+int main(void) {
+  fix Offset = bench_seed - 1;
+  uint16_t Sum = 0;
+  for (uint8_t PY = 0; PY < 16; ++PY) {
+    fix CY = -256 + PY * 32 + Offset;
+    for (uint8_t PX = 0; PX < 24; ++PX) {
+      fix CX = -512 + PX * 32;
+      fix X = 0, Y = 0;
+      uint8_t I = 0;
+      for (; I < 16; ++I) {
+        fix X2 = fmul(X, X);
+        fix Y2 = fmul(Y, Y);
+        if (X2 + Y2 > 4 * 256)
+          break;
+        Y = 2 * fmul(X, Y) + CY;
+        X = X2 - Y2 + CX;
+      }
+      Sum += I;
+    }
+  }
+  BENCH_CHECK(Sum, 0xc1f);
+}
@@ -0,0 +1,50 @@
+//===-- int64.c - 64-bit hashing and timestamp arithmetic -----------------===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "bench.h"
+
+static uint8_t Data[256];
+
+// FNV-1a, 64-bit.
+static uint64_t fnv1a(const uint8_t *P, uint16_t Len) {
+  uint64_t H = 0xcbf29ce484222325ull;
+  while (Len--) {
+    H ^= *P++;
+    H *= 0x100000001b3ull;
+  }
+  return H;
+}
+
+int main(void) {
+  bench_srand();
+  for (uint16_t I = 0; I < sizeof(Data); ++I)
+    Data[I] = bench_rand();
+
+  uint64_t Hash = 0;
+  for (uint8_t I = 0; I < 16; ++I) {
+    Data[I] ^= I;
+    Hash ^= fnv1a(Data, sizeof(Data)) >> (I & 7);
+  }
+
+  // Advance a microsecond clock by uneven ticks, splitting it into seconds
+  // and a remainder the way a network stack would for a timestamp.
+  uint64_t Clock = 0x0123456789ull;
+  uint32_t Seconds = 0;
+  uint16_t Bits = 0;
+  for (uint8_t I = 0; I < 64; ++I) {
+    Clock += (uint64_t)bench_rand() << (I & 31);
+    Seconds ^= (uint32_t)(Clock / 1000000);
+    Bits += __builtin_popcountll(Clock) + __builtin_clzll(Clock) +
+            __builtin_ctzll(Clock | 1ull << 63);
+    Bits += (int64_t)Clock < (int64_t)Hash;
+  }
+
+  BENCH_CHECK((uint16_t)(Hash ^ Hash >> 16 ^ Hash >> 32 ^ Hash >> 48 ^
+                         Seconds ^ Seconds >> 16 ^ Bits),
+              0xd62);
+}
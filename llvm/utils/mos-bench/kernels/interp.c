@@ -0,0 +1,106 @@
+//===-- interp.c - Switch-dispatched bytecode interpreter -----------------===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "bench.h"
+
+enum {
+  HALT,
+  PUSH, // Followed by a 16-bit little-endian immediate.
+  ADD,
+  SUB,
+  DUP,
+  SWAP,
+  OVER,
+  ROT,
+  DROP,
+  JNZ, // Followed by the absolute address of the target.
+};
+
+// Sums the Fibonacci sequence modulo 2^16, keeping (A B N) on the stack.
+static uint8_t Program[] = {
+    PUSH, 0, 0,  //
+    PUSH, 1, 0,  //
+    PUSH, 0, 0,  // N, filled in by main.
+    ROT,         // 9: B N A
+    ROT,         // N A B
+    SWAP,        // N B A
+    OVER,        // N B A B
+    ADD,         // N B A+B
+    ROT,         // B A+B N
+    PUSH, 1, 0,  //
+    SUB,         // B A+B N-1
+    DUP,         //
+    JNZ, 9,      //
+    DROP,        //
+    ADD,         //
+    HALT,        //
+};
+
+static uint16_t run(const uint8_t *Code) {
+  uint16_t Stack[16];
+  uint8_t SP = 0;
+  uint8_t PC = 0;
+  for (;;) {
+    switch (Code[PC++]) {
+    case HALT:
+      return Stack[SP - 1];
+    case PUSH:
+      Stack[SP++] = Code[PC] | (uint16_t)Code[PC + 1] << 8;
+      PC += 2;
+      break;
+    case ADD:
+      --SP;
+      Stack[SP - 1] += Stack[SP];
+      break;
+    case SUB:
+      --SP;
+      Stack[SP - 1] -= Stack[SP];
+      break;
+    case DUP:
+      Stack[SP] = Stack[SP - 1];
+      ++SP;
+      break;
+    case SWAP: {
+      uint16_t T = Stack[SP - 1];
+      Stack[SP - 1] = Stack[SP - 2];
+      Stack[SP - 2] = T;
+      break;
+    }
+    case OVER:
+      Stack[SP] = Stack[SP - 2];
+      ++SP;
+      break;
+    case ROT: {
+      uint16_t T = Stack[SP - 3];
+      Stack[SP - 3] = Stack[SP - 2];
+      Stack[SP - 2] = Stack[SP - 1];
+      Stack[SP - 1] = T;
+      break;
+    }
+    case DROP:
+      --SP;
+      break;
+    case JNZ:
+      if (Stack[--SP])
+        PC = Code[PC];
+      else
+        ++PC;
+      break;
+    default:
+      return 0;
+    }
+  }
+}
+
+int main(void) {
+  uint16_t N = 299 + bench_seed;
+  Program[7] = (uint8_t)N;
+  Program[8] = (uint8_t)(N >> 8);
+  uint16_t Result = run(Program);
+  BENCH_CHECK(Result, 0x6bb9);
+}
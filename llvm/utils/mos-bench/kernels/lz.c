@@ -0,0 +1,74 @@
+//===-- lz.c - Decompression of a byte-oriented LZ77 stream ---------------===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Each token of the stream is a byte T. If T < 0x80, it is followed by T + 1
+// literal bytes. Otherwise, it's followed by an offset O, and the (T & 0x7f) +
+// 3 bytes starting O bytes back are repeated.
+//
+//===----------------------------------------------------------------------===//
+
+#include "bench.h"
+
+static const uint8_t Compressed[] = {
+    0x29, 0x53, 0x69, 0x6e, 0x67, 0x2c, 0x20, 0x4f, 0x20, 0x67, 0x6f, 0x64,
+    0x64, 0x65, 0x73, 0x73, 0x2c, 0x20, 0x74, 0x68, 0x65, 0x20, 0x61, 0x6e,
+    0x67, 0x65, 0x72, 0x20, 0x6f, 0x66, 0x20, 0x41, 0x63, 0x68, 0x69, 0x6c,
+    0x6c, 0x65, 0x73, 0x20, 0x73, 0x6f, 0x6e, 0x81, 0x10, 0x04, 0x50, 0x65,
+    0x6c, 0x65, 0x75, 0x82, 0x25, 0x0f, 0x61, 0x74, 0x20, 0x62, 0x72, 0x6f,
+    0x75, 0x67, 0x68, 0x74, 0x20, 0x63, 0x6f, 0x75, 0x6e, 0x74, 0x80, 0x25,
+    0x01, 0x73, 0x20, 0x80, 0x2c, 0x03, 0x73, 0x20, 0x75, 0x70, 0x80, 0x2c,
+    0x81, 0x46, 0x80, 0x3d, 0x0c, 0x61, 0x65, 0x61, 0x6e, 0x73, 0x2e, 0x20,
+    0x4d, 0x61, 0x6e, 0x79, 0x20, 0x61, 0x80, 0x31, 0x02, 0x61, 0x76, 0x65,
+    0x80, 0x4b, 0x13, 0x75, 0x6c, 0x20, 0x64, 0x69, 0x64, 0x20, 0x69, 0x74,
+    0x20, 0x73, 0x65, 0x6e, 0x64, 0x20, 0x68, 0x75, 0x72, 0x72, 0x79, 0x80,
+    0x87, 0x03, 0x20, 0x64, 0x6f, 0x77, 0x80, 0x3a, 0x03, 0x6f, 0x20, 0x48,
+    0x61, 0x80, 0x8b, 0x00, 0x2c, 0x80, 0x86, 0x02, 0x64, 0x20, 0x6d, 0x83,
+    0x3a, 0x03, 0x68, 0x65, 0x72, 0x6f, 0x85, 0x34, 0x04, 0x79, 0x69, 0x65,
+    0x6c, 0x64, 0x80, 0x14, 0x03, 0x70, 0x72, 0x65, 0x79, 0x81, 0x2e, 0x03,
+    0x64, 0x6f, 0x67, 0x73, 0x82, 0x2c, 0x06, 0x76, 0x75, 0x6c, 0x74, 0x75,
+    0x72, 0x65, 0x80, 0x70, 0xff, 0xd5, 0xff, 0xd5, 0xff, 0xd5, 0xa1, 0xd5,
+    0x00, 0x00, 0xa5, 0x01, 0x2e, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+    0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f, 0x10, 0x11, 0x12, 0x13,
+    0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f,
+    0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28, 0x29, 0x2a, 0x2b,
+    0x2c, 0x2d, 0x2e, 0x2f
+};
+
+static uint8_t Out[1024];
+
+static uint16_t decompress(uint8_t *Dst, const uint8_t *Src, uint16_t Len) {
+  uint8_t *Begin = Dst;
+  const uint8_t *End = Src + Len;
+  while (Src != End) {
+    uint8_t T = *Src++;
+    if (T < 0x80) {
+      uint8_t N = T + 1;
+      do
+        *Dst++ = *Src++;
+      while (--N);
+    } else {
+      const uint8_t *From = Dst - *Src++;
+      uint8_t N = (T & 0x7f) + 3;
+      do
+        *Dst++ = *From++;
+      while (--N);
+    }
+  }
+  return Dst - Begin;
+}
+
+int main(void) {
+  uint16_t Sum = 0;
+  for (uint8_t Round = 0; Round < 4; ++Round) {
+    uint16_t Len = decompress(Out, Compressed, sizeof(Compressed));
+    Sum += Len;
+    for (uint16_t I = 0; I < Len; ++I)
+      Sum = (uint16_t)(Sum << 3 | Sum >> 13) + Out[I];
+  }
+  BENCH_CHECK(Sum, 0x4844);
+}
@@ -0,0 +1,36 @@
+//===-- memcpy.c - Block copies of constant and variable size -------------===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "bench.h"
+
+static uint8_t Src[512];
+static uint8_t Dst[512];
+
+int main(void) {
+  bench_srand();
+  for (uint16_t I = 0; I < sizeof(Src); ++I)
+    Src[I] = bench_rand();
+
+  uint16_t Sum = 0;
+  for (uint8_t Round = 0; Round < 8; ++Round) {
+    uint16_t Size = 256 + Round * 32;
+    __builtin_memcpy(Dst + Round, Src + (7 - Round), Size);
+
+    // Small copies of constant size should be expanded inline.
+    uint8_t Header[8];
+    __builtin_memcpy(Header, Dst + Round, sizeof(Header));
+    for (uint8_t I = 0; I < sizeof(Header); ++I)
+      Sum += Header[I];
+
+    // As should a loop that the optimizer recognizes as a copy.
+    for (uint8_t I = 0; I < 64; ++I)
+      Dst[I] = Src[I + Round];
+    Sum += Dst[Round + Size - 1] + Dst[63];
+  }
+  BENCH_CHECK(Sum, 0x2e70);
+}
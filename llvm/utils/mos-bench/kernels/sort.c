@@ -0,0 +1,42 @@
+//===-- sort.c - Shell sort of 16-bit keys --------------------------------===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "bench.h"
+
+static uint16_t Keys[256];
+
+static const uint8_t Gaps[] = {57, 23, 10, 4, 1};
+
+static void shellSort(uint16_t *A, uint16_t N) {
+  for (uint8_t G = 0; G < sizeof(Gaps); ++G) {
+    uint8_t Gap = Gaps[G];
+    for (uint16_t I = Gap; I < N; ++I) {
+      uint16_t Key = A[I];
+      uint16_t J = I;
+      for (; J >= Gap && A[J - Gap] > Key; J -= Gap)
+        A[J] = A[J - Gap];
+      A[J] = Key;
+    }
+  }
+}
+
+int main(void) {
+  bench_srand();
+  for (uint16_t I = 0; I < 256; ++I)
+    Keys[I] = (uint16_t)bench_rand() << 8 | bench_rand();
+
+  shellSort(Keys, 256);
+
+  uint16_t Sum = 0;
+  for (uint16_t I = 0; I < 256; ++I) {
+    if (I && Keys[I - 1] > Keys[I])
+      return 2;
+    Sum = (uint16_t)(Sum * 3) + Keys[I];
+  }
+  BENCH_CHECK(Sum, 0x3a10);
+}
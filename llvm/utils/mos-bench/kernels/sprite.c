@@ -0,0 +1,50 @@
+//===-- sprite.c - Masked sprite blits to a bitmap ------------------------===//
+//
+// Part of LLVM-MOS, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "bench.h"
+
+#define WIDTH 32
+#define HEIGHT 64
+
+static uint8_t Screen[WIDTH * HEIGHT];
+
+// A 16x16 sprite, two bytes per row, and the mask of its opaque pixels.
+static uint8_t Sprite[32];
+static uint8_t Mask[32];
+
+__attribute__((noinline)) static void blit(uint8_t X, uint8_t Y) {
+  uint8_t Shift = X & 7;
+  uint8_t *Row = Screen + (uint16_t)Y * WIDTH + (X >> 3);
+  for (uint8_t R = 0; R < 16; ++R, Row += WIDTH) {
+    uint16_t S = (uint16_t)Sprite[2 * R] << 8 | Sprite[2 * R + 1];
+    uint16_t M = (uint16_t)Mask[2 * R] << 8 | Mask[2 * R + 1];
+    uint8_t Hi = 8 + Shift, Lo = 8 - Shift;
+    Row[0] = (Row[0] & ~(uint8_t)(M >> Hi)) | (uint8_t)(S >> Hi);
+    Row[1] = (Row[1] & ~(uint8_t)(M >> Shift)) | (uint8_t)(S >> Shift);
+    Row[2] = (Row[2] & ~(uint8_t)(M << Lo)) | (uint8_t)(S << Lo);
+  }
+}
+
+int main(void) {
+  bench_srand();
+  for (uint8_t I = 0; I < sizeof(Mask); ++I) {
+    Mask[I] = bench_rand() | 0x81;
+    Sprite[I] = bench_rand() & Mask[I];
+  }
+
+  for (uint8_t I = 0; I < 64; ++I) {
+    uint8_t X = (bench_rand() & 0x7f) + 64;
+    uint8_t Y = (bench_rand() & 0x1f) + 16;
+    blit(X, Y);
+  }
+
+  uint16_t Sum = 0;
+  for (uint16_t I = 0; I < sizeof(Screen); ++I)
+    Sum = (uint16_t)(Sum << 1 | Sum >> 15) ^ Screen[I];
+  BENCH_CHECK(Sum, 0xcbc6);
+}
@@ -0,0 +1,218 @@
+#!/usr/bin/env python3
+"""Measures the code the MOS backend generates for a corpus of C kernels.
+
+Each kernel in kernels/ is compiled at each optimization level for each device
+in MOSDevices.td. Its size is the total size of the functions it defines. For
+devices that llvm-mos-sim can simulate, and given the clang configuration
+file of an llvm-mos-sdk target with the simulator's memory map (e.g.
+mos-sim.cfg), the kernel is also linked and run, and its cycle count is
+recorded. A kernel that returns nonzero has computed the wrong result, and is
+recorded as failed.
+
+    mos-bench.py run --llvm-bin build/bin [--sdk-config mos-sim.cfg] -o new.json
+    mos-bench.py compare baseline.json new.json
+
+compare prints the results that changed and exits with status 1 if any got
+larger, slower, or stopped working.
+"""
+
+import argparse
+import json
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+ROOT = os.path.dirname(os.path.abspath(__file__))
+KERNELS = os.path.join(ROOT, "kernels")
+DEVICES_TD = os.path.join(
+    ROOT, "..", "..", "lib", "Target", "MOS", "MOSDevices.td"
+)
+
+OPT_LEVELS = ["O2", "Os", "Oz"]
+
+# The processors that llvm-mos-sim models.
+SIMULATED = {"mos6502", "mos6502x", "mos65c02", "mosr65c02", "mosw65c02"}
+
+FORMAT_VERSION = 1
+
+
+def get_devices():
+    with open(DEVICES_TD) as f:
+        return re.findall(r'^def : Device<"(\w+)"', f.read(), re.MULTILINE)
+
+
+def get_kernels():
+    return sorted(
+        os.path.splitext(name)[0]
+        for name in os.listdir(KERNELS)
+        if name.endswith(".c")
+    )
+
+
+def tool(args, name):
+    return os.path.join(args.llvm_bin, name)
+
+
+def code_size(args, obj):
+    out = subprocess.run(
+        [tool(args, "llvm-nm"), "--print-size", "--defined-only", obj],
+        check=True,
+        capture_output=True,
+        text=True,
+    ).stdout
+    size = 0
+    for line in out.splitlines():
+        fields = line.split()
+        if len(fields) == 4 and fields[2] in "Tt":
+            size += int(fields[1], 16)
+    return size
+
+
+def cycle_count(args, obj, device, tmp):
+    exe = os.path.join(tmp, "a.elf")
+    subprocess.run(
+        [tool(args, "clang"), "--config=" + args.sdk_config, "-mcpu=" + device]
+        + [obj, "-o", exe],
+        check=True,
+        capture_output=True,
+    )
+    run = subprocess.run(
+        [tool(args, "llvm-mos-sim"), "-print-cycles"]
+        + ["-max-cycles=%d" % args.max_cycles, exe],
+        capture_output=True,
+        text=True,
+    )
+    if run.returncode:
+        return None
+    return int(re.search(r"^cycles: (\d+)$", run.stderr, re.MULTILINE).group(1))
+
+
+def measure(args, kernel, device, opt):
+    result = {"bytes": None, "cycles": None, "status": "ok"}
+    with tempfile.TemporaryDirectory() as tmp:
+        obj = os.path.join(tmp, kernel + ".o")
+        try:
+            subprocess.run(
+                [tool(args, "clang"), "--target=mos", "-mcpu=" + device]
+                + ["-" + opt, "-c", os.path.join(KERNELS, kernel + ".c")]
+                + ["-o", obj],
+                check=True,
+                capture_output=True,
+            )
+            result["bytes"] = code_size(args, obj)
+            if args.sdk_config and device in SIMULATED:
+                result["cycles"] = cycle_count(args, obj, device, tmp)
+                if result["cycles"] is None:
+                    result["status"] = "failed"
+        except subprocess.CalledProcessError:
+            result["status"] = "error"
+    return result
+
+
+def run(args):
+    tools = ["clang", "llvm-nm"] + (["llvm-mos-sim"] if args.sdk_config else [])
+    for name in tools:
+        if not os.access(tool(args, name), os.X_OK):
+            sys.exit("%s not found in %s" % (name, args.llvm_bin))
+    devices = args.devices.split(",") if args.devices else get_devices()
+    kernels = args.kernels.split(",") if args.kernels else get_kernels()
+    opts = args.opt_levels.split(",")
+    results = {}
+    for kernel in kernels:
+        for device in devices:
+            for opt in opts:
+                key = "%s/%s/-%s" % (kernel, device, opt)
+                results[key] = measure(args, kernel, device, opt)
+                if args.verbose:
+                    print(key, results[key], file=sys.stderr)
+    with open(args.output, "w") as f:
+        json.dump({"version": FORMAT_VERSION, "results": results}, f,
+                  indent=1, sort_keys=True)
+        f.write("\n")
+    return 0
+
+
+def load(path):
+    with open(path) as f:
+        data = json.load(f)
+    if data.get("version") != FORMAT_VERSION:
+        sys.exit("%s: unsupported results version" % path)
+    return data["results"]
+
+
+def compare(args):
+    old = load(args.old)
+    new = load(args.new)
+    regressed = False
+    rows = []
+    totals = {"bytes": [0, 0], "cycles": [0, 0]}
+    for key in sorted(set(old) | set(new)):
+        o = old.get(key)
+        n = new.get(key)
+        if not o or not n:
+            rows.append((key, "added" if n else "removed"))
+            continue
+        if o["status"] != n["status"]:
+            rows.append((key, "%s -> %s" % (o["status"], n["status"])))
+            regressed |= o["status"] == "ok"
+            continue
+        changes = []
+        for metric in ("bytes", "cycles"):
+            a, b = o[metric], n[metric]
+            if a is None or b is None:
+                continue
+            totals[metric][0] += a
+            totals[metric][1] += b
+            if a == b:
+                continue
+            pct = 100.0 * (b - a) / a if a else float("inf")
+            changes.append("%s %d -> %d (%+.2f%%)" % (metric, a, b, pct))
+            regressed |= pct > args.tolerance
+        if changes:
+            rows.append((key, ", ".join(changes)))
+
+    width = max((len(key) for key, _ in rows), default=0)
+    for key, change in rows:
+        print("%-*s  %s" % (width, key, change))
+    for metric, (a, b) in totals.items():
+        if a:
+            print("total %s: %d -> %d (%+.2f%%)"
+                  % (metric, a, b, 100.0 * (b - a) / a))
+    return 1 if regressed else 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    sub = parser.add_subparsers(dest="command", required=True)
+
+    p = sub.add_parser("run", help="measure the kernels")
+    p.add_argument("--llvm-bin", required=True,
+                   help="directory with clang, llvm-nm and llvm-mos-sim")
+    p.add_argument("--sdk-config",
+                   help="clang config file of an llvm-mos-sdk target for "
+                        "llvm-mos-sim; without it, only sizes are measured")
+    p.add_argument("--devices", help="comma-separated devices (default: all)")
+    p.add_argument("--kernels", help="comma-separated kernels (default: all)")
+    p.add_argument("--opt-levels", default=",".join(OPT_LEVELS),
+                   help="comma-separated optimization levels")
+    p.add_argument("--max-cycles", type=int, default=100000000,
+                   help="cycles after which a kernel is considered hung")
+    p.add_argument("-o", "--output", required=True, help="results file")
+    p.add_argument("-v", "--verbose", action="store_true")
+    p.set_defaults(func=run)
+
+    p = sub.add_parser("compare", help="compare two results files")
+    p.add_argument("old")
+    p.add_argument("new")
+    p.add_argument("--tolerance", type=float, default=0.0,
+                   help="percentage increase not counted as a regression")
+    p.set_defaults(func=compare)
+
+    args = parser.parse_args()
+    return args.func(args)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
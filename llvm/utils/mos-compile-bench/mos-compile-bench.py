@@ -0,0 +1,319 @@
+#!/usr/bin/env python3
+"""Measures how long the MOS backend takes to compile large programs.
+
+Each generator writes a C program whose size grows with a scale factor:
+
+  table       one function filling a table with unrolled stores
+  callgraph   a call graph of many small functions, each calling two others
+  switch      a state machine driven by one deep switch
+
+The kernels of mos-bench are measured as well, as real programs. Each program
+is compiled to IR with clang, which is not timed. The IR is then compiled with
+llc at -O2 with a time trace, and linked with LTO through clang and lld, again
+with a time trace. The wall time of each step and the time spent in each pass
+are recorded in a JSON results file, keeping the fastest of --repeat runs.
+
+Generated programs are measured at each of --scales, and compare reports how
+a program's compile time grows with its size. A growth exponent well above 1
+points to a pass that is super-linear in the size of its input.
+
+    mos-compile-bench.py run --llvm-bin build/bin [--sdk-config mos-sim.cfg] \\
+        -o new.json
+    mos-compile-bench.py compare baseline.json new.json
+
+Without --sdk-config, the LTO link is a relocatable link, which still runs the
+whole code generator. compare prints the times that changed by more than
+--tolerance percent and exits with status 1 if any got slower.
+"""
+
+import argparse
+import json
+import math
+import os
+import subprocess
+import sys
+import tempfile
+import time
+
+ROOT = os.path.dirname(os.path.abspath(__file__))
+KERNELS = os.path.join(ROOT, "..", "mos-bench", "kernels")
+
+FORMAT_VERSION = 1
+
+# The passes reported by compare for each step, slowest first.
+TOP_PASSES = 5
+
+
+def gen_table(n):
+    lines = ["void fill(unsigned char *t, unsigned char k) {"]
+    for i in range(n):
+        lines.append("  t[%d] = (unsigned char)(k * %d + (k >> %d));"
+                     % (i, i * 7 + 1, i % 8))
+    lines.append("}")
+    lines.append("unsigned char t[%d];" % n)
+    lines.append("int main(void) { fill(t, 3); return t[%d]; }" % (n - 1))
+    return "\n".join(lines) + "\n"
+
+
+def gen_callgraph(n):
+    lines = ["__attribute__((noinline)) unsigned char f0(unsigned char x) "
+             "{ return x; }"]
+    for i in range(1, n):
+        # Each function calls its predecessor and one further back, so the
+        # call graph is deep as well as wide.
+        a, b = i - 1, (i * 37) % i
+        lines.append(
+            "__attribute__((noinline)) unsigned char f%d(unsigned char x) {\n"
+            "  volatile unsigned char s[2] = {x, %d};\n"
+            "  return x & 1 ? f%d(s[0] + s[1]) : f%d(s[0] ^ s[1]);\n"
+            "}" % (i, i & 0xff, a, b))
+    lines.append("volatile unsigned char in = 1;")
+    lines.append("int main(void) { return f%d(in) == 0xff; }" % (n - 1))
+    return "\n".join(lines) + "\n"
+
+
+def gen_switch(n):
+    lines = ["unsigned char run(unsigned char *in, unsigned char len) {",
+             "  unsigned state = 0, acc = 0;",
+             "  for (unsigned char i = 0; i < len; ++i) {",
+             "    switch (state) {"]
+    for i in range(n):
+        lines.append("    case %d: acc += in[i] ^ %d; "
+                     "state = acc & 1 ? %d : %d; break;"
+                     % (i, i & 0xff, (i * 5 + 1) % n, (i + 1) % n))
+    lines += ["    }", "  }", "  return acc + state;", "}",
+              "unsigned char in[16];",
+              "int main(void) { return run(in, sizeof(in)) == 0xff; }"]
+    return "\n".join(lines) + "\n"
+
+
+# The size of each generated program at scale 1.
+GENERATORS = {
+    "table": (gen_table, 500),
+    "callgraph": (gen_callgraph, 2500),
+    "switch": (gen_switch, 250),
+}
+
+
+def tool(args, name):
+    return os.path.join(args.llvm_bin, name)
+
+
+def get_programs(args):
+    """Returns (name, scale, source path) for each program to measure."""
+    programs = []
+    names = args.programs.split(",") if args.programs else None
+    for gen in sorted(GENERATORS):
+        if names and gen not in names:
+            continue
+        for scale in args.scales:
+            programs.append((gen, scale, None))
+    for name in sorted(os.listdir(KERNELS)):
+        kernel, ext = os.path.splitext(name)
+        if ext == ".c" and (not names or kernel in names):
+            programs.append((kernel, None, os.path.join(KERNELS, name)))
+    return programs
+
+
+def pass_times(trace_file):
+    """Returns the microseconds spent in each pass of a time trace."""
+    if not os.path.exists(trace_file):
+        return {}
+    with open(trace_file) as f:
+        events = json.load(f).get("traceEvents", [])
+    times = {}
+    for event in events:
+        name = event.get("name", "")
+        if event.get("ph") != "X" or name.startswith("Total "):
+            continue
+        # The legacy pass manager, which runs the code generator, records its
+        # passes as RunPass with the pass name as detail.
+        if name == "RunPass":
+            name = event.get("args", {}).get("detail", name)
+        times[name] = times.get(name, 0) + event.get("dur", 0)
+    return times
+
+
+def timed(cmd):
+    start = time.perf_counter()
+    subprocess.run(cmd, check=True, capture_output=True)
+    return time.perf_counter() - start
+
+
+def measure_once(args, src, device, tmp):
+    ir = os.path.join(tmp, "a.ll")
+    bc = os.path.join(tmp, "a.bc")
+    trace = os.path.join(tmp, "trace.json")
+    target = ["--target=mos", "-mcpu=" + device, "-O2"]
+    result = {}
+
+    subprocess.run([tool(args, "clang")] + target + ["-S", "-emit-llvm"]
+                   + [src, "-o", ir], check=True, capture_output=True)
+    wall = timed([tool(args, "llc"), "-mtriple=mos", "-mcpu=" + device, "-O2"]
+                 + ["-filetype=obj", "-time-trace",
+                    "-time-trace-granularity=0", "-time-trace-file=" + trace]
+                 + [ir, "-o", os.path.join(tmp, "a.o")])
+    result["llc"] = {"seconds": wall, "passes": pass_times(trace)}
+    os.remove(trace)
+
+    subprocess.run([tool(args, "clang")] + target + ["-flto", "-c", src]
+                   + ["-o", bc], check=True, capture_output=True)
+    if args.sdk_config:
+        link = [tool(args, "clang"), "--config=" + args.sdk_config]
+    else:
+        link = [tool(args, "clang"), "--target=mos", "-nostdlib", "-Wl,-r"]
+    link += ["-fuse-ld=lld", "-mcpu=" + device, "-O2", "-flto", bc]
+    link += ["-Wl,--time-trace=" + trace, "-Wl,--time-trace-granularity=0"]
+    wall = timed(link + ["-o", os.path.join(tmp, "a.elf")])
+    result["lld"] = {"seconds": wall, "passes": pass_times(trace)}
+    return result
+
+
+def fastest(a, b):
+    if a is None:
+        return b
+    for step in b:
+        if b[step]["seconds"] < a[step]["seconds"]:
+            a[step] = b[step]
+    return a
+
+
+def measure(args, name, scale, src):
+    with tempfile.TemporaryDirectory() as tmp:
+        if src is None:
+            gen, size = GENERATORS[name]
+            src = os.path.join(tmp, "%s.c" % name)
+            with open(src, "w") as f:
+                f.write(gen(size * scale))
+        best = None
+        try:
+            for _ in range(args.repeat):
+                best = fastest(best, measure_once(args, src, args.device, tmp))
+        except subprocess.CalledProcessError as e:
+            return {"status": "error", "command": " ".join(e.cmd)}
+    best["status"] = "ok"
+    return best
+
+
+def run(args):
+    for name in ["clang", "llc", "ld.lld"]:
+        if not os.access(tool(args, name), os.X_OK):
+            sys.exit("%s not found in %s" % (name, args.llvm_bin))
+    args.scales = [int(s) for s in args.scales.split(",")]
+    results = {}
+    for name, scale, src in get_programs(args):
+        key = name if scale is None else "%s/x%d" % (name, scale)
+        results[key] = measure(args, name, scale, src)
+        if args.verbose:
+            print(key, {step: results[key][step]["seconds"]
+                        for step in ("llc", "lld") if step in results[key]},
+                  file=sys.stderr)
+    with open(args.output, "w") as f:
+        json.dump({"version": FORMAT_VERSION, "device": args.device,
+                   "results": results}, f, indent=1, sort_keys=True)
+        f.write("\n")
+    return 0
+
+
+def load(path):
+    with open(path) as f:
+        data = json.load(f)
+    if data.get("version") != FORMAT_VERSION:
+        sys.exit("%s: unsupported results version" % path)
+    return data["results"]
+
+
+def growth(results, step):
+    """Returns the growth exponent of each generated program's step time."""
+    exponents = {}
+    for gen in GENERATORS:
+        points = sorted(
+            (int(key.split("/x")[1]), r[step]["seconds"])
+            for key, r in results.items()
+            if key.startswith(gen + "/x") and r["status"] == "ok")
+        if len(points) >= 2 and points[0][1] > 0:
+            (s0, t0), (s1, t1) = points[0], points[-1]
+            exponents[gen] = math.log(t1 / t0) / math.log(s1 / s0)
+    return exponents
+
+
+def compare(args):
+    old = load(args.old)
+    new = load(args.new)
+    regressed = False
+    for key in sorted(set(old) | set(new)):
+        o = old.get(key)
+        n = new.get(key)
+        if not o or not n:
+            print("%s: %s" % (key, "added" if n else "removed"))
+            continue
+        if o["status"] != n["status"]:
+            print("%s: %s -> %s" % (key, o["status"], n["status"]))
+            regressed |= o["status"] == "ok"
+            continue
+        if n["status"] != "ok":
+            continue
+        for step in ("llc", "lld"):
+            a, b = o[step]["seconds"], n[step]["seconds"]
+            pct = 100.0 * (b - a) / a if a else 0.0
+            if abs(pct) <= args.tolerance or abs(b - a) < args.min_seconds:
+                continue
+            regressed |= pct > 0
+            print("%s %s: %.3fs -> %.3fs (%+.1f%%)" % (key, step, a, b, pct))
+            passes = n[step]["passes"]
+            slowest = sorted(passes, key=passes.get, reverse=True)
+            for name in slowest[:TOP_PASSES]:
+                before = o[step]["passes"].get(name, 0) / 1e6
+                print("    %-40s %.3fs -> %.3fs"
+                      % (name, before, passes[name] / 1e6))
+
+    for step in ("llc", "lld"):
+        before = growth(old, step)
+        for gen, exponent in sorted(growth(new, step).items()):
+            print("%s %s growth: %.2f -> %.2f"
+                  % (gen, step, before.get(gen, float("nan")), exponent))
+            if exponent > args.max_growth:
+                regressed |= before.get(gen, 0) <= args.max_growth
+    return 1 if regressed else 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    sub = parser.add_subparsers(dest="command", required=True)
+
+    p = sub.add_parser("run", help="measure the programs")
+    p.add_argument("--llvm-bin", required=True,
+                   help="directory with clang, llc and ld.lld")
+    p.add_argument("--sdk-config",
+                   help="clang config file of an llvm-mos-sdk target to "
+                        "link against; without it, links are relocatable")
+    p.add_argument("--device", default="mos6502", help="device to compile for")
+    p.add_argument("--programs",
+                   help="comma-separated generators and kernels "
+                        "(default: all)")
+    p.add_argument("--scales", default="1,2,4",
+                   help="comma-separated sizes of the generated programs")
+    p.add_argument("--repeat", type=int, default=3,
+                   help="runs of each program, of which the fastest is kept")
+    p.add_argument("-o", "--output", required=True, help="results file")
+    p.add_argument("-v", "--verbose", action="store_true")
+    p.set_defaults(func=run)
+
+    p = sub.add_parser("compare", help="compare two results files")
+    p.add_argument("old")
+    p.add_argument("new")
+    p.add_argument("--tolerance", type=float, default=5.0,
+                   help="percentage change not reported")
+    p.add_argument("--min-seconds", type=float, default=0.05,
+                   help="change in seconds not reported")
+    p.add_argument("--max-growth", type=float, default=1.5,
+                   help="growth exponent above which a program that was "
+                        "below it counts as a regression")
+    p.set_defaults(func=compare)
+
+    args = parser.parse_args()
+    return args.func(args)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
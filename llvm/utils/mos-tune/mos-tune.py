@@ -0,0 +1,265 @@
+#!/usr/bin/env python3
+"""Tunes how each function of a MOS program is optimized against a workload.
+
+The program's sources are compiled with clang, linked with LTO through lld
+against an llvm-mos-sdk target whose memory map llvm-mos-sim simulates (e.g.
+mos-sim.cfg), and run under the simulator. The program is the workload: it
+should exercise the code to be tuned and return zero if its results were
+right. Its cost is the cycles it takes, and its size is the total size of the
+functions it links, which must stay within --rom-budget bytes if one is given.
+
+Starting from the defaults, each of the hottest --max-functions functions in
+the simulator's profile is tuned in turn, by trying each setting of:
+
+  mode         cycles, average, or bytes, as -O2, -Os, and -Oz would choose
+  inline       always or never
+  unroll       false, to keep the function's loops rolled
+  zp-priority  a weight on the function's claim to the zero page
+
+A setting is kept if the program still works and it improves the result: a
+program over its ROM budget is first made smaller, and one within it faster.
+If the program is over budget, the cold functions, which the workload never
+ran, are also tried at mode bytes. Passes are repeated until none improves.
+
+The settings are written as a YAML directive file, which later builds read
+with -mllvm -mos-function-directives=<file>:
+
+    mos-tune.py --llvm-bin build/bin --sdk-config mos-sim.cfg \\
+        --rom-budget 16384 -o directives.yaml main.c engine.c
+"""
+
+import argparse
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+SETTINGS = {
+    "mode": ["cycles", "average", "bytes"],
+    "inline": ["always", "never"],
+    "unroll": ["false"],
+    "zp-priority": ["0", "4", "16"],
+}
+
+
+def tool(args, name):
+    return os.path.join(args.llvm_bin, name)
+
+
+def write_directives(path, directives):
+    with open(path, "w") as f:
+        for name in sorted(directives):
+            settings = directives[name]
+            if not settings:
+                continue
+            f.write("- function: %s\n" % name)
+            for key in sorted(settings):
+                f.write("  %s: %s\n" % (key, settings[key]))
+
+
+def code_size(args, exe):
+    out = subprocess.run(
+        [tool(args, "llvm-nm"), "--print-size", "--defined-only", exe],
+        check=True,
+        capture_output=True,
+        text=True,
+    ).stdout
+    size = 0
+    for line in out.splitlines():
+        fields = line.split()
+        if len(fields) == 4 and fields[2] in "Tt":
+            size += int(fields[1], 16)
+    return size
+
+
+def read_profile(path):
+    """Returns the cycles spent in each function of an llvm-mos-sim profile."""
+    cycles = {}
+    with open(path) as f:
+        next(f)
+        for line in f:
+            fields = line.split()
+            if len(fields) == 5:
+                cycles[fields[4]] = int(fields[0])
+    return cycles
+
+
+class Evaluator:
+    def __init__(self, args, tmp):
+        self.args = args
+        self.tmp = tmp
+        self.cache = {}
+        self.runs = 0
+
+    def key(self, directives):
+        return tuple(sorted((name, tuple(sorted(settings.items())))
+                            for name, settings in directives.items()
+                            if settings))
+
+    def evaluate(self, directives, profile=None):
+        """Returns (bytes, cycles) of the program built with directives, or
+        None if it failed to build or computed the wrong result."""
+        key = self.key(directives)
+        if key in self.cache and profile is None:
+            return self.cache[key]
+        self.runs += 1
+        args = self.args
+        directives_file = os.path.join(self.tmp, "directives.yaml")
+        write_directives(directives_file, directives)
+        exe = os.path.join(self.tmp, "a.elf")
+        cmd = [tool(args, "clang"), "--config=" + args.sdk_config]
+        cmd += ["-mcpu=" + args.device, "-" + args.opt, "-flto"]
+        cmd += ["-mllvm", "-mos-function-directives=" + directives_file]
+        cmd += args.cflags + args.sources + ["-o", exe]
+        result = None
+        try:
+            subprocess.run(cmd, check=True, capture_output=True)
+            sim = [tool(args, "llvm-mos-sim"), "-print-cycles"]
+            sim += ["-max-cycles=%d" % args.max_cycles]
+            if profile:
+                sim += ["-profile=" + profile]
+            run = subprocess.run(sim + [exe], capture_output=True, text=True)
+            if not run.returncode:
+                cycles = re.search(r"^cycles: (\d+)$", run.stderr,
+                                   re.MULTILINE)
+                result = (code_size(args, exe), int(cycles.group(1)))
+        except subprocess.CalledProcessError:
+            pass
+        self.cache[key] = result
+        if args.verbose:
+            print(result, key, file=sys.stderr)
+        return result
+
+
+def better(args, new, old):
+    """Returns whether result new is better than result old."""
+    if new is None:
+        return False
+    if old is None:
+        return True
+    budget = args.rom_budget
+    if budget and old[0] > budget:
+        return new[0] < old[0]
+    if budget and new[0] > budget:
+        return False
+    return new[1] < old[1] or (new[1] == old[1] and new[0] < old[0])
+
+
+def tune(args, evaluator):
+    directives = {}
+    profile = os.path.join(evaluator.tmp, "profile.txt")
+    best = evaluator.evaluate(directives, profile)
+    if best is None:
+        sys.exit("the program does not build, or fails under the simulator")
+    print("baseline: %d bytes, %d cycles" % best, file=sys.stderr)
+    cycles = read_profile(profile)
+    hot = [name for name in sorted(cycles, key=cycles.get, reverse=True)
+           if cycles[name] and not name.startswith("<")]
+    hot = hot[:args.max_functions]
+    cold = get_cold(args, evaluator, cycles)
+
+    changed = True
+    passes = 0
+    while changed and passes < args.max_passes:
+        changed = False
+        passes += 1
+        for name in hot:
+            for setting, values in SETTINGS.items():
+                current = directives.get(name, {}).get(setting)
+                for value in [None] + values:
+                    if value == current:
+                        continue
+                    trial = {k: dict(v) for k, v in directives.items()}
+                    settings = trial.setdefault(name, {})
+                    if value is None:
+                        settings.pop(setting, None)
+                    else:
+                        settings[setting] = value
+                    result = evaluator.evaluate(trial)
+                    if better(args, result, best):
+                        directives, best, changed = trial, result, True
+                        current = value
+                        print("%s %s: %s -> %d bytes, %d cycles"
+                              % (name, setting, value or "default", *best),
+                              file=sys.stderr)
+
+        # Functions the workload never reaches cost nothing to shrink.
+        if args.rom_budget and best[0] > args.rom_budget:
+            trial = {k: dict(v) for k, v in directives.items()}
+            for name in cold:
+                trial.setdefault(name, {})["mode"] = "bytes"
+            result = evaluator.evaluate(trial)
+            if better(args, result, best):
+                directives, best, changed = trial, result, True
+                print("cold functions at mode bytes -> %d bytes, %d cycles"
+                      % best, file=sys.stderr)
+    return directives, best
+
+
+def get_cold(args, evaluator, cycles):
+    """Returns the functions of the last program built that the workload
+    never ran."""
+    exe = os.path.join(evaluator.tmp, "a.elf")
+    out = subprocess.run(
+        [tool(args, "llvm-nm"), "--defined-only", exe],
+        check=True,
+        capture_output=True,
+        text=True,
+    ).stdout
+    cold = []
+    for line in out.splitlines():
+        fields = line.split()
+        if len(fields) == 3 and fields[1] in "Tt":
+            if not cycles.get(fields[2]):
+                cold.append(fields[2])
+    return cold
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("sources", nargs="+", help="the program's sources")
+    parser.add_argument("--llvm-bin", required=True,
+                        help="directory with clang, llvm-nm and llvm-mos-sim")
+    parser.add_argument("--sdk-config", required=True,
+                        help="clang config file of an llvm-mos-sdk target for "
+                             "llvm-mos-sim")
+    parser.add_argument("--device", default="mos6502",
+                        help="device to compile for")
+    parser.add_argument("--opt", default="O2",
+                        help="optimization level the directives refine")
+    parser.add_argument("--cflags", default="",
+                        help="further space-separated compiler options")
+    parser.add_argument("--rom-budget", type=int,
+                        help="bytes of code the program may take")
+    parser.add_argument("--max-functions", type=int, default=16,
+                        help="hottest functions to tune")
+    parser.add_argument("--max-passes", type=int, default=3,
+                        help="passes over the functions")
+    parser.add_argument("--max-cycles", type=int, default=100000000,
+                        help="cycles after which the program is considered "
+                             "hung")
+    parser.add_argument("-o", "--output", required=True,
+                        help="directive file to write")
+    parser.add_argument("-v", "--verbose", action="store_true")
+    args = parser.parse_args()
+    args.cflags = args.cflags.split()
+
+    for name in ["clang", "llvm-nm", "llvm-mos-sim"]:
+        if not os.access(tool(args, name), os.X_OK):
+            sys.exit("%s not found in %s" % (name, args.llvm_bin))
+
+    with tempfile.TemporaryDirectory() as tmp:
+        evaluator = Evaluator(args, tmp)
+        directives, best = tune(args, evaluator)
+    write_directives(args.output, directives)
+    print("tuned: %d bytes, %d cycles, after %d builds"
+          % (best + (evaluator.runs,)), file=sys.stderr)
+    if args.rom_budget and best[0] > args.rom_budget:
+        print("the program is still over its ROM budget", file=sys.stderr)
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())